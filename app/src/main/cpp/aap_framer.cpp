@@ -0,0 +1,28 @@
+#include "aap_framer.h"
+
+namespace aap {
+
+// Pending buffer only ever holds a single partial record
+constexpr size_t PENDING_CAPACITY = AapFramer::MAX_RECORD;
+
+AapFramer::AapFramer()
+    : pending_(PENDING_CAPACITY)
+{}
+
+void AapFramer::setRecordCallback(RecordCallback callback) {
+    callback_ = std::move(callback);
+}
+
+size_t AapFramer::feed(const uint8_t* data, size_t length, uint64_t arrivalNs) {
+    return feed(data, length, arrivalNs, [this](const Record& record) {
+        if (callback_) {
+            callback_(record);
+        }
+    });
+}
+
+void AapFramer::reset() {
+    pending_.clear();
+}
+
+} // namespace aap
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "aap_message.h"
+#include "latency_histogram.h"
+#include "ring_buffer.h"
+#include "trace.h"
+#include <algorithm>
+#include <functional>
+
+namespace aap {
+
+/**
+ * A complete AAP record as framed from the USB byte stream.
+ * Payload is still encrypted (if the encrypted flag is set) and
+ * only valid for the duration of the callback.
+ */
+struct Record {
+    int channel;
+    uint8_t flags;
+    uint32_t totalLength;   // Total message size on first fragments, 0 otherwise
+    const uint8_t* data;    // Payload, header and total length stripped
+    size_t length;
+    uint64_t arrivalNs;     // As passed to feed() with the chunk completing the record
+};
+
+/**
+ * Record callback type.
+ * Called on the thread that feeds the framer, once per complete record.
+ */
+using RecordCallback = std::function<void(const Record& record)>;
+
+/**
+ * Reassembles complete AAP records from raw bulk transfer chunks.
+ *
+ * Records fully contained in a chunk are delivered straight from the
+ * chunk without copying. Only a record straddling two chunks is staged
+ * in the internal ring buffer and delivered in place from it.
+ *
+ * The per-record sink is a template parameter of feed(), so a caller that
+ * knows its next stage at compile time gets it inlined into the framing
+ * loop. The RecordCallback overload is for the JNI edge.
+ *
+ * Not thread-safe: feed() must always be called from the same thread.
+ */
+class AapFramer {
+public:
+    static constexpr size_t MAX_PAYLOAD = 0xFFFF;
+    static constexpr size_t MAX_RECORD =
+        EncryptedHeader::SIZE + EncryptedHeader::TOTAL_LENGTH_SIZE + MAX_PAYLOAD;
+
+    AapFramer();
+
+    // Non-copyable
+    AapFramer(const AapFramer&) = delete;
+    AapFramer& operator=(const AapFramer&) = delete;
+
+    /**
+     * Set record callback.
+     * Must be called before the first feed().
+     */
+    void setRecordCallback(RecordCallback callback);
+
+    /**
+     * Record the FRAME stage of timed chunks. Must be called before the first feed().
+     */
+    void setLatency(PipelineLatency* latency) { latency_ = latency; }
+
+    /**
+     * Feed raw bytes from the transport.
+     * @param data Pointer to received bytes
+     * @param length Number of bytes received
+     * @param arrivalNs LatencyHistogram::now() when the chunk was received, 0 if not timed
+     * @return Number of complete records delivered
+     */
+    size_t feed(const uint8_t* data, size_t length, uint64_t arrivalNs = 0);
+
+    /**
+     * Feed raw bytes, delivering records straight to sink instead of the
+     * record callback.
+     * @param sink Called as sink(const Record&) for every complete record
+     */
+    template <typename Sink>
+    size_t feed(const uint8_t* data, size_t length, uint64_t arrivalNs, Sink&& sink);
+
+    /**
+     * Drop any partially received record.
+     */
+    void reset();
+
+    /**
+     * Get statistics for monitoring.
+     */
+    struct Stats {
+        uint64_t recordsFramed;
+        uint64_t recordsReassembled;  // Records that straddled two chunks
+        uint64_t bytesFed;
+    };
+    Stats getStats() const { return stats_; }
+
+private:
+    // Holds the partial record straddling chunk boundaries
+    RingBuffer pending_;
+
+    RecordCallback callback_;
+    Stats stats_{};
+
+    PipelineLatency* latency_ = nullptr;
+    uint64_t arrivalNs_ = 0;  // Of the chunk being fed
+
+    /**
+     * Size of the record starting at header, or 0 if more bytes are
+     * needed to know it.
+     */
+    static size_t recordSize(const uint8_t* header, size_t available);
+
+    Record frame(const uint8_t* record);
+    template <typename Sink>
+    size_t completePending(const uint8_t*& data, size_t& length, Sink& sink);
+};
+
+inline size_t AapFramer::recordSize(const uint8_t* header, size_t available) {
+    if (available < EncryptedHeader::SIZE) {
+        return 0;
+    }
+
+    EncryptedHeader hdr;
+    hdr.decode(header);
+
+    const size_t headerSize = hdr.wireHeaderSize();
+    if (available < headerSize) {
+        return 0;
+    }
+    return headerSize + hdr.encLength;
+}
+
+inline Record AapFramer::frame(const uint8_t* record) {
+    EncryptedHeader hdr;
+    hdr.decode(record);
+
+    Record r;
+    r.channel = hdr.channel;
+    r.flags = hdr.flags;
+    r.totalLength = 0;
+    if (hdr.isFirstFragment()) {
+        const uint8_t* p = record + EncryptedHeader::SIZE;
+        r.totalLength = (static_cast<uint32_t>(p[0]) << 24) |
+                        (static_cast<uint32_t>(p[1]) << 16) |
+                        (static_cast<uint32_t>(p[2]) << 8) |
+                        static_cast<uint32_t>(p[3]);
+    }
+    r.data = record + hdr.wireHeaderSize();
+    r.length = hdr.encLength;
+    r.arrivalNs = arrivalNs_;
+
+    stats_.recordsFramed++;
+    if (latency_) {
+        (*latency_)[PipelineLatency::FRAME].recordSince(arrivalNs_);
+    }
+    return r;
+}
+
+template <typename Sink>
+size_t AapFramer::completePending(const uint8_t*& data, size_t& length, Sink& sink) {
+    // Assemble enough of the header to learn the record size
+    uint8_t header[EncryptedHeader::SIZE + EncryptedHeader::TOTAL_LENGTH_SIZE];
+    const size_t have = pending_.available();
+    size_t headerHave = pending_.peek(header, sizeof(header));
+    if (headerHave < sizeof(header)) {
+        const size_t extra = std::min(sizeof(header) - headerHave, length);
+        std::copy(data, data + extra, header + headerHave);
+        headerHave += extra;
+    }
+
+    const size_t size = recordSize(header, headerHave);
+    if (size == 0) {
+        // Still not enough for a header, everything goes to pending
+        pending_.write(data, length);
+        data += length;
+        length = 0;
+        return 0;
+    }
+
+    const size_t need = size - have;
+    const size_t take = std::min(need, length);
+    pending_.write(data, take);
+    data += take;
+    length -= take;
+
+    if (take < need) {
+        return 0;
+    }
+
+    // The ring is rewound whenever it drains, so the pending record
+    // starts at offset 0 and never wraps: parse it in place
+    const RingBuffer::ReadSpan record = pending_.acquireRead();
+    stats_.recordsReassembled++;
+    sink(frame(record.data));
+    pending_.clear();
+    return 1;
+}
+
+template <typename Sink>
+size_t AapFramer::feed(const uint8_t* data, size_t length, uint64_t arrivalNs, Sink&& sink) {
+    AAP_TRACE_SECTION("Frame");
+    stats_.bytesFed += length;
+    arrivalNs_ = arrivalNs;
+
+    size_t delivered = 0;
+    if (!pending_.isEmpty()) {
+        delivered += completePending(data, length, sink);
+        if (!pending_.isEmpty()) {
+            return delivered;
+        }
+    }
+
+    // Fast path: deliver whole records directly from the chunk
+    while (length > 0) {
+        const size_t size = recordSize(data, length);
+        if (size == 0 || size > length) {
+            break;
+        }
+        sink(frame(data));
+        delivered++;
+        data += size;
+        length -= size;
+    }
+
+    // Stage the trailing partial record for the next chunk
+    if (length > 0) {
+        pending_.write(data, length);
+    }
+
+    return delivered;
+}
+
+} // namespace aap
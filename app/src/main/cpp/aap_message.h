@@ -5,6 +5,35 @@
 
 namespace aap {
 
+// Channel priority for dispatching
+enum class ChannelPriority {
+    HIGH,    // Audio - real-time priority
+    MEDIUM,  // Video - important but can tolerate some delay
+    NORMAL,  // Control, Input, etc.
+    BACKGROUND  // Metadata - album art, turn cards, notifications
+};
+
+// What a channel carries
+enum class ChannelKind : uint8_t {
+    CONTROL,    // Protocol messages, each one matters
+    AUDIO,      // PCM stream, ACKed per record
+    VIDEO       // Codec stream, ACKed per record
+};
+
+/**
+ * Routing of one channel: a row of Channel::TABLE.
+ */
+struct ChannelInfo {
+    int id;
+    const char* name;
+    ChannelKind kind;
+    ChannelPriority priority;   // Also the dispatcher queue its records go to
+    bool ackRequired;           // The phone waits for media ACKs before sending more
+    bool bulkUplink;            // Outbound records may wait behind urgent ones
+
+    constexpr bool isMedia() const { return kind != ChannelKind::CONTROL; }
+};
+
 // AAP Channel IDs (from Channel.kt)
 namespace Channel {
     constexpr int ID_CTR = 0;   // Control
@@ -20,53 +49,59 @@ namespace Channel {
     constexpr int ID_NAV = 10;  // Navigation directions
     constexpr int ID_NOTI = 11; // Notifications
     constexpr int ID_PHONE = 12; // Phone status
+    constexpr int COUNT = 13;
+
+    // Indexed by channel id
+    constexpr ChannelInfo TABLE[COUNT] = {
+        {ID_CTR, "CONTROL", ChannelKind::CONTROL, ChannelPriority::NORMAL, false, false},
+        {ID_SEN, "SENSOR", ChannelKind::CONTROL, ChannelPriority::NORMAL, false, false},
+        {ID_VID, "VIDEO", ChannelKind::VIDEO, ChannelPriority::MEDIUM, true, false},
+        {ID_INP, "INPUT", ChannelKind::CONTROL, ChannelPriority::NORMAL, false, false},
+        {ID_AU1, "AUDIO1", ChannelKind::AUDIO, ChannelPriority::HIGH, true, false},
+        {ID_AU2, "AUDIO2", ChannelKind::AUDIO, ChannelPriority::HIGH, true, false},
+        {ID_AUD, "AUDIO", ChannelKind::AUDIO, ChannelPriority::HIGH, true, false},
+        {ID_MIC, "MIC", ChannelKind::CONTROL, ChannelPriority::NORMAL, false, true},
+        {ID_BTH, "BLUETOOTH", ChannelKind::CONTROL, ChannelPriority::NORMAL, false, false},
+        {ID_MPB, "MUSIC_PLAYBACK", ChannelKind::CONTROL, ChannelPriority::BACKGROUND, false, false},
+        {ID_NAV, "NAVIGATION", ChannelKind::CONTROL, ChannelPriority::BACKGROUND, false, false},
+        {ID_NOTI, "NOTIFICATION", ChannelKind::CONTROL, ChannelPriority::BACKGROUND, false, false},
+        {ID_PHONE, "PHONE", ChannelKind::CONTROL, ChannelPriority::NORMAL, false, false},
+    };
 
-    inline bool isAudio(int channel) {
-        return channel == ID_AUD || channel == ID_AU1 || channel == ID_AU2;
+    // Ids the phone made up, or a corrupt header
+    constexpr ChannelInfo UNKNOWN = {-1, "UNKNOWN", ChannelKind::CONTROL, ChannelPriority::NORMAL, false, false};
+
+    constexpr bool isIndexed(int index = 0) {
+        return index == COUNT || (TABLE[index].id == index && isIndexed(index + 1));
     }
+    static_assert(isIndexed(), "Channel::TABLE rows must be in channel id order");
 
-    inline bool isVideo(int channel) {
-        return channel == ID_VID;
+    /**
+     * Routing of a channel: one bounds check and a table load.
+     */
+    constexpr const ChannelInfo& info(int channel) {
+        return channel >= 0 && channel < COUNT ? TABLE[channel] : UNKNOWN;
     }
 
-    inline bool isInput(int channel) {
-        return channel == ID_INP;
+    constexpr bool isAudio(int channel) {
+        return info(channel).kind == ChannelKind::AUDIO;
     }
 
-    inline const char* name(int channel) {
-        switch (channel) {
-            case ID_CTR: return "CONTROL";
-            case ID_SEN: return "SENSOR";
-            case ID_VID: return "VIDEO";
-            case ID_INP: return "INPUT";
-            case ID_AU1: return "AUDIO1";
-            case ID_AU2: return "AUDIO2";
-            case ID_AUD: return "AUDIO";
-            case ID_MIC: return "MIC";
-            case ID_BTH: return "BLUETOOTH";
-            case ID_MPB: return "MUSIC_PLAYBACK";
-            case ID_NAV: return "NAVIGATION";
-            case ID_NOTI: return "NOTIFICATION";
-            case ID_PHONE: return "PHONE";
-            default: return "UNKNOWN";
-        }
+    constexpr bool isVideo(int channel) {
+        return info(channel).kind == ChannelKind::VIDEO;
     }
-}
 
-// Channel priority for dispatching
-enum class ChannelPriority {
-    HIGH,    // Audio - real-time priority
-    MEDIUM,  // Video - important but can tolerate some delay
-    NORMAL   // Control, Input, etc.
-};
+    constexpr bool isInput(int channel) {
+        return channel == ID_INP;
+    }
 
-inline ChannelPriority getChannelPriority(int channel) {
-    if (Channel::isAudio(channel)) {
-        return ChannelPriority::HIGH;
-    } else if (Channel::isVideo(channel)) {
-        return ChannelPriority::MEDIUM;
+    constexpr const char* name(int channel) {
+        return info(channel).name;
     }
-    return ChannelPriority::NORMAL;
+}
+
+constexpr ChannelPriority getChannelPriority(int channel) {
+    return Channel::info(channel).priority;
 }
 
 // Encrypted message header (4 bytes)
@@ -76,6 +111,11 @@ struct EncryptedHeader {
     uint16_t encLength;  // Big-endian in wire format
 
     static constexpr size_t SIZE = 4;
+    static constexpr size_t TOTAL_LENGTH_SIZE = 4;  // Follows header on first fragments
+
+    static constexpr uint8_t FLAG_FIRST = 0x01;
+    static constexpr uint8_t FLAG_LAST = 0x02;
+    static constexpr uint8_t FLAG_ENCRYPTED = 0x08;
 
     void decode(const uint8_t* buf) {
         channel = buf[0];
@@ -85,7 +125,18 @@ struct EncryptedHeader {
     }
 
     bool isEncrypted() const {
-        return (flags & 0x08) == 0x08;
+        return (flags & FLAG_ENCRYPTED) == FLAG_ENCRYPTED;
+    }
+
+    // First fragment of a multi-record message (e.g. flags 0x09),
+    // carries a 4-byte big-endian total length after the header
+    bool isFirstFragment() const {
+        return (flags & (FLAG_FIRST | FLAG_LAST)) == FLAG_FIRST;
+    }
+
+    // Bytes preceding the payload on the wire
+    size_t wireHeaderSize() const {
+        return isFirstFragment() ? SIZE + TOTAL_LENGTH_SIZE : SIZE;
     }
 };
 
@@ -0,0 +1,54 @@
+#include "aaudio_api.h"
+#include <dlfcn.h>
+
+namespace aap {
+
+namespace {
+
+template <typename T>
+bool resolve(void* lib, const char* name, T& fn) {
+    fn = reinterpret_cast<T>(dlsym(lib, name));
+    return fn != nullptr;
+}
+
+} // anonymous namespace
+
+const AAudioApi& aaudioApi() {
+    static const AAudioApi api = [] {
+        AAudioApi result;
+        void* lib = dlopen("libaaudio.so", RTLD_NOW);
+        if (!lib) {
+            return result;
+        }
+        // setInputPreset is also an API 28 entry point, skipping the 8.x releases
+        result.available =
+            resolve(lib, "AAudio_createStreamBuilder", result.createStreamBuilder) &&
+            resolve(lib, "AAudioStreamBuilder_setDirection", result.setDirection) &&
+            resolve(lib, "AAudioStreamBuilder_setFormat", result.setFormat) &&
+            resolve(lib, "AAudioStreamBuilder_setChannelCount", result.setChannelCount) &&
+            resolve(lib, "AAudioStreamBuilder_setSampleRate", result.setSampleRate) &&
+            resolve(lib, "AAudioStreamBuilder_setPerformanceMode", result.setPerformanceMode) &&
+            resolve(lib, "AAudioStreamBuilder_setSharingMode", result.setSharingMode) &&
+            resolve(lib, "AAudioStreamBuilder_setInputPreset", result.setInputPreset) &&
+            resolve(lib, "AAudioStreamBuilder_setDataCallback", result.setDataCallback) &&
+            resolve(lib, "AAudioStreamBuilder_setErrorCallback", result.setErrorCallback) &&
+            resolve(lib, "AAudioStreamBuilder_openStream", result.openStream) &&
+            resolve(lib, "AAudioStreamBuilder_delete", result.deleteBuilder) &&
+            resolve(lib, "AAudioStream_requestStart", result.requestStart) &&
+            resolve(lib, "AAudioStream_requestStop", result.requestStop) &&
+            resolve(lib, "AAudioStream_close", result.close) &&
+            resolve(lib, "AAudioStream_getFramesPerBurst", result.getFramesPerBurst) &&
+            resolve(lib, "AAudioStream_getSampleRate", result.getSampleRate) &&
+            resolve(lib, "AAudioStream_getChannelCount", result.getChannelCount) &&
+            resolve(lib, "AAudioStream_setBufferSizeInFrames", result.setBufferSizeInFrames) &&
+            resolve(lib, "AAudioStream_getSharingMode", result.getSharingMode);
+        if (result.available) {
+            resolve(lib, "AAudioStream_getTimestamp", result.getTimestamp);
+            resolve(lib, "AAudioStream_getFramesWritten", result.getFramesWritten);
+        }
+        return result;
+    }();
+    return api;
+}
+
+} // namespace aap
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <aaudio/AAudio.h>
+#include <time.h>
+
+namespace aap {
+
+/**
+ * AAudio entry points, resolved at runtime: AAudio is API 26, minSdk is 21.
+ * Only reported available on API 28+, the 8.x releases had callback and
+ * disconnect issues.
+ */
+struct AAudioApi {
+    aaudio_result_t (*createStreamBuilder)(AAudioStreamBuilder**) = nullptr;
+    void (*setDirection)(AAudioStreamBuilder*, aaudio_direction_t) = nullptr;
+    void (*setFormat)(AAudioStreamBuilder*, aaudio_format_t) = nullptr;
+    void (*setChannelCount)(AAudioStreamBuilder*, int32_t) = nullptr;
+    void (*setSampleRate)(AAudioStreamBuilder*, int32_t) = nullptr;
+    void (*setPerformanceMode)(AAudioStreamBuilder*, aaudio_performance_mode_t) = nullptr;
+    void (*setSharingMode)(AAudioStreamBuilder*, aaudio_sharing_mode_t) = nullptr;
+    void (*setInputPreset)(AAudioStreamBuilder*, aaudio_input_preset_t) = nullptr;
+    void (*setDataCallback)(AAudioStreamBuilder*, AAudioStream_dataCallback, void*) = nullptr;
+    void (*setErrorCallback)(AAudioStreamBuilder*, AAudioStream_errorCallback, void*) = nullptr;
+    aaudio_result_t (*openStream)(AAudioStreamBuilder*, AAudioStream**) = nullptr;
+    aaudio_result_t (*deleteBuilder)(AAudioStreamBuilder*) = nullptr;
+    aaudio_result_t (*requestStart)(AAudioStream*) = nullptr;
+    aaudio_result_t (*requestStop)(AAudioStream*) = nullptr;
+    aaudio_result_t (*close)(AAudioStream*) = nullptr;
+    int32_t (*getFramesPerBurst)(AAudioStream*) = nullptr;
+    int32_t (*getSampleRate)(AAudioStream*) = nullptr;
+    int32_t (*getChannelCount)(AAudioStream*) = nullptr;
+    aaudio_result_t (*setBufferSizeInFrames)(AAudioStream*, int32_t) = nullptr;
+    aaudio_sharing_mode_t (*getSharingMode)(AAudioStream*) = nullptr;
+    // Optional, nullptr if missing: the presentation position for A/V sync
+    aaudio_result_t (*getTimestamp)(AAudioStream*, clockid_t, int64_t*, int64_t*) = nullptr;
+    int64_t (*getFramesWritten)(AAudioStream*) = nullptr;
+    bool available = false;
+};
+
+const AAudioApi& aaudioApi();
+
+} // namespace aap
@@ -0,0 +1,318 @@
+#include "aes_gcm.h"
+#include <cstring>
+
+namespace aap {
+
+namespace {
+
+// AES tables, generated once from the field arithmetic
+struct AesTables {
+    uint8_t sbox[256];
+    uint32_t te0[256];
+
+    AesTables() {
+        // Walk the multiplicative group with generator 3 and its inverse
+        uint8_t p = 1, q = 1;
+        do {
+            p = static_cast<uint8_t>(p ^ (p << 1) ^ ((p & 0x80) ? 0x1b : 0));
+            q ^= static_cast<uint8_t>(q << 1);
+            q ^= static_cast<uint8_t>(q << 2);
+            q ^= static_cast<uint8_t>(q << 4);
+            if (q & 0x80) q ^= 0x09;
+            const uint8_t x = static_cast<uint8_t>(q ^ rotl(q, 1) ^ rotl(q, 2) ^ rotl(q, 3) ^ rotl(q, 4));
+            sbox[p] = static_cast<uint8_t>(x ^ 0x63);
+        } while (p != 1);
+        sbox[0] = 0x63;
+
+        for (int i = 0; i < 256; i++) {
+            const uint32_t s = sbox[i];
+            const uint32_t s2 = xtime(static_cast<uint8_t>(s));
+            const uint32_t s3 = s2 ^ s;
+            te0[i] = (s2 << 24) | (s << 16) | (s << 8) | s3;
+        }
+    }
+
+    static uint8_t rotl(uint8_t value, int shift) {
+        return static_cast<uint8_t>((value << shift) | (value >> (8 - shift)));
+    }
+
+    static uint8_t xtime(uint8_t value) {
+        return static_cast<uint8_t>((value << 1) ^ ((value & 0x80) ? 0x1b : 0));
+    }
+};
+
+const AesTables& tables() {
+    static const AesTables instance;
+    return instance;
+}
+
+inline uint32_t ror32(uint32_t value, int shift) {
+    return (value >> shift) | (value << ((32 - shift) & 31));
+}
+
+inline uint32_t load32(const uint8_t* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+inline void store32(uint8_t* p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+}
+
+inline uint64_t load64(const uint8_t* p) {
+    return (static_cast<uint64_t>(load32(p)) << 32) | load32(p + 4);
+}
+
+inline void store64(uint8_t* p, uint64_t value) {
+    store32(p, static_cast<uint32_t>(value >> 32));
+    store32(p + 4, static_cast<uint32_t>(value));
+}
+
+void encryptBlock(const AesGcmKey& key, const uint8_t in[16], uint8_t out[16]) {
+    const AesTables& t = tables();
+    const uint32_t* rk = key.roundKeys;
+
+    uint32_t s0 = load32(in) ^ rk[0];
+    uint32_t s1 = load32(in + 4) ^ rk[1];
+    uint32_t s2 = load32(in + 8) ^ rk[2];
+    uint32_t s3 = load32(in + 12) ^ rk[3];
+
+#define AAP_TE(x, shift) ror32(t.te0[(x)], shift)
+    for (int round = 1; round < key.rounds; round++) {
+        rk += 4;
+        const uint32_t t0 = AAP_TE(s0 >> 24, 0) ^ AAP_TE((s1 >> 16) & 0xff, 8) ^
+                            AAP_TE((s2 >> 8) & 0xff, 16) ^ AAP_TE(s3 & 0xff, 24) ^ rk[0];
+        const uint32_t t1 = AAP_TE(s1 >> 24, 0) ^ AAP_TE((s2 >> 16) & 0xff, 8) ^
+                            AAP_TE((s3 >> 8) & 0xff, 16) ^ AAP_TE(s0 & 0xff, 24) ^ rk[1];
+        const uint32_t t2 = AAP_TE(s2 >> 24, 0) ^ AAP_TE((s3 >> 16) & 0xff, 8) ^
+                            AAP_TE((s0 >> 8) & 0xff, 16) ^ AAP_TE(s1 & 0xff, 24) ^ rk[2];
+        const uint32_t t3 = AAP_TE(s3 >> 24, 0) ^ AAP_TE((s0 >> 16) & 0xff, 8) ^
+                            AAP_TE((s1 >> 8) & 0xff, 16) ^ AAP_TE(s2 & 0xff, 24) ^ rk[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+#undef AAP_TE
+
+    // Final round: no MixColumns
+    rk += 4;
+    const uint8_t* sb = t.sbox;
+    store32(out, ((uint32_t)sb[s0 >> 24] << 24 | (uint32_t)sb[(s1 >> 16) & 0xff] << 16 |
+                  (uint32_t)sb[(s2 >> 8) & 0xff] << 8 | sb[s3 & 0xff]) ^ rk[0]);
+    store32(out + 4, ((uint32_t)sb[s1 >> 24] << 24 | (uint32_t)sb[(s2 >> 16) & 0xff] << 16 |
+                      (uint32_t)sb[(s3 >> 8) & 0xff] << 8 | sb[s0 & 0xff]) ^ rk[1]);
+    store32(out + 8, ((uint32_t)sb[s2 >> 24] << 24 | (uint32_t)sb[(s3 >> 16) & 0xff] << 16 |
+                      (uint32_t)sb[(s0 >> 8) & 0xff] << 8 | sb[s1 & 0xff]) ^ rk[2]);
+    store32(out + 12, ((uint32_t)sb[s3 >> 24] << 24 | (uint32_t)sb[(s0 >> 16) & 0xff] << 16 |
+                       (uint32_t)sb[(s1 >> 8) & 0xff] << 8 | sb[s2 & 0xff]) ^ rk[3]);
+}
+
+// Reduction constants for the 4-bit GHASH tables
+const uint64_t GHASH_LAST4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+void ghashTables(AesGcmKey& key) {
+    uint64_t vh = load64(key.h);
+    uint64_t vl = load64(key.h + 8);
+
+    key.hl[8] = vl;
+    key.hh[8] = vh;
+    key.hl[0] = 0;
+    key.hh[0] = 0;
+
+    for (int i = 4; i > 0; i >>= 1) {
+        const uint32_t t = static_cast<uint32_t>(vl & 1) * 0xe1000000U;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ (static_cast<uint64_t>(t) << 32);
+        key.hl[i] = vl;
+        key.hh[i] = vh;
+    }
+
+    for (int i = 2; i <= 8; i *= 2) {
+        vh = key.hh[i];
+        vl = key.hl[i];
+        for (int j = 1; j < i; j++) {
+            key.hh[i + j] = vh ^ key.hh[j];
+            key.hl[i + j] = vl ^ key.hl[j];
+        }
+    }
+}
+
+// x = x * H in GF(2^128)
+void ghashMultiply(const AesGcmKey& key, uint8_t x[16]) {
+    uint8_t lo = x[15] & 0x0f;
+    uint64_t zh = key.hh[lo];
+    uint64_t zl = key.hl[lo];
+
+    for (int i = 15; i >= 0; i--) {
+        lo = x[i] & 0x0f;
+        const uint8_t hi = (x[i] >> 4) & 0x0f;
+
+        if (i != 15) {
+            const uint8_t rem = static_cast<uint8_t>(zl & 0x0f);
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (GHASH_LAST4[rem] << 48);
+            zh ^= key.hh[lo];
+            zl ^= key.hl[lo];
+        }
+
+        const uint8_t rem = static_cast<uint8_t>(zl & 0x0f);
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ (GHASH_LAST4[rem] << 48);
+        zh ^= key.hh[hi];
+        zl ^= key.hl[hi];
+    }
+
+    store64(x, zh);
+    store64(x + 8, zl);
+}
+
+void ghashUpdate(const AesGcmKey& key, uint8_t y[16], const uint8_t* data, size_t length) {
+    while (length > 0) {
+        const size_t n = length < 16 ? length : 16;
+        for (size_t i = 0; i < n; i++) {
+            y[i] ^= data[i];
+        }
+        ghashMultiply(key, y);
+        data += n;
+        length -= n;
+    }
+}
+
+inline void incrementCounter(uint8_t counter[16]) {
+    store32(counter + 12, load32(counter + 12) + 1);
+}
+
+void cryptPortable(const AesGcmKey& key, const uint8_t* nonce,
+                   const uint8_t* aad, size_t aadLength,
+                   const uint8_t* in, uint8_t* out, size_t length,
+                   bool encrypt, uint8_t* tag) {
+    uint8_t j0[16];
+    std::memcpy(j0, nonce, AesGcm::NONCE_SIZE);
+    store32(j0 + 12, 1);
+
+    uint8_t y[16] = {0};
+    ghashUpdate(key, y, aad, aadLength);
+
+    uint8_t counter[16];
+    std::memcpy(counter, j0, sizeof(counter));
+
+    uint8_t keystream[16];
+    size_t offset = 0;
+    while (offset < length) {
+        const size_t n = length - offset < 16 ? length - offset : 16;
+        incrementCounter(counter);
+        encryptBlock(key, counter, keystream);
+
+        // Authenticate ciphertext: before decrypting, in case in == out
+        if (!encrypt) {
+            ghashUpdate(key, y, in + offset, n);
+        }
+        for (size_t i = 0; i < n; i++) {
+            out[offset + i] = in[offset + i] ^ keystream[i];
+        }
+        if (encrypt) {
+            ghashUpdate(key, y, out + offset, n);
+        }
+        offset += n;
+    }
+
+    uint8_t lengths[16];
+    store64(lengths, static_cast<uint64_t>(aadLength) * 8);
+    store64(lengths + 8, static_cast<uint64_t>(length) * 8);
+    ghashUpdate(key, y, lengths, sizeof(lengths));
+
+    encryptBlock(key, j0, keystream);
+    for (int i = 0; i < 16; i++) {
+        tag[i] = y[i] ^ keystream[i];
+    }
+}
+
+} // anonymous namespace
+
+bool AesGcm::setKey(const uint8_t* key, size_t keyLength) {
+    if (keyLength != 16 && keyLength != 32) {
+        return false;
+    }
+
+    const AesTables& t = tables();
+    const int nk = static_cast<int>(keyLength / 4);
+    key_.rounds = nk + 6;
+    const int words = 4 * (key_.rounds + 1);
+
+    uint32_t* w = key_.roundKeys;
+    for (int i = 0; i < nk; i++) {
+        w[i] = load32(key + 4 * i);
+    }
+
+    uint32_t rcon = 0x01;
+    for (int i = nk; i < words; i++) {
+        uint32_t temp = w[i - 1];
+        if (i % nk == 0) {
+            temp = (temp << 8) | (temp >> 24);
+            temp = ((uint32_t)t.sbox[temp >> 24] << 24) | ((uint32_t)t.sbox[(temp >> 16) & 0xff] << 16) |
+                   ((uint32_t)t.sbox[(temp >> 8) & 0xff] << 8) | t.sbox[temp & 0xff];
+            temp ^= rcon << 24;
+            rcon = AesTables::xtime(static_cast<uint8_t>(rcon));
+        } else if (nk > 6 && i % nk == 4) {
+            temp = ((uint32_t)t.sbox[temp >> 24] << 24) | ((uint32_t)t.sbox[(temp >> 16) & 0xff] << 16) |
+                   ((uint32_t)t.sbox[(temp >> 8) & 0xff] << 8) | t.sbox[temp & 0xff];
+        }
+        w[i] = w[i - nk] ^ temp;
+    }
+
+    for (int i = 0; i < words; i++) {
+        store32(key_.roundKeyBytes + 4 * i, w[i]);
+    }
+
+    const uint8_t zero[16] = {0};
+    encryptBlock(key_, zero, key_.h);
+    ghashTables(key_);
+
+    hasKey_ = true;
+    return true;
+}
+
+bool AesGcm::isHardwareAccelerated() {
+#if defined(AAP_HAVE_ARMV8_CRYPTO)
+    static const bool available = aesGcmArmv8Available();
+    return available;
+#else
+    return false;
+#endif
+}
+
+void AesGcm::crypt(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+                   const uint8_t* in, uint8_t* out, size_t length,
+                   bool encrypt, uint8_t* tag) const {
+#if defined(AAP_HAVE_ARMV8_CRYPTO)
+    if (isHardwareAccelerated()) {
+        aesGcmCryptArmv8(key_, nonce, aad, aadLength, in, out, length, encrypt, tag);
+        return;
+    }
+#endif
+    cryptPortable(key_, nonce, aad, aadLength, in, out, length, encrypt, tag);
+}
+
+bool AesGcm::open(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+                  const uint8_t* in, uint8_t* out, size_t length, const uint8_t* tag) const {
+    uint8_t computed[TAG_SIZE];
+    crypt(nonce, aad, aadLength, in, out, length, false, computed);
+
+    // Constant-time compare
+    uint8_t diff = 0;
+    for (size_t i = 0; i < TAG_SIZE; i++) {
+        diff |= computed[i] ^ tag[i];
+    }
+    return diff == 0;
+}
+
+void AesGcm::seal(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+                  const uint8_t* in, uint8_t* out, size_t length, uint8_t* tag) const {
+    crypt(nonce, aad, aadLength, in, out, length, true, tag);
+}
+
+} // namespace aap
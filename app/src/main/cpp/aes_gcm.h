@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace aap {
+
+/**
+ * Expanded AES-GCM key material, shared by the portable and the
+ * ARMv8 Crypto Extensions implementations.
+ */
+struct AesGcmKey {
+    uint32_t roundKeys[60];        // Big-endian words, (rounds + 1) * 4 used
+    uint8_t roundKeyBytes[240];    // Same schedule as bytes for AESE
+    int rounds;
+    uint8_t h[16];                 // GHASH key, E_K(0^128)
+    uint64_t hl[16];               // 4-bit GHASH tables (portable path)
+    uint64_t hh[16];
+};
+
+/**
+ * AES-GCM with 128 or 256 bit keys, 96-bit nonces and 128-bit tags,
+ * as used by the TLS 1.2 GCM cipher suites.
+ *
+ * Uses ARMv8 AES/PMULL instructions when the CPU has them, lookup
+ * tables otherwise. Input and output may be the same buffer.
+ */
+class AesGcm {
+public:
+    static constexpr size_t NONCE_SIZE = 12;
+    static constexpr size_t TAG_SIZE = 16;
+
+    AesGcm() = default;
+
+    // Non-copyable
+    AesGcm(const AesGcm&) = delete;
+    AesGcm& operator=(const AesGcm&) = delete;
+
+    /**
+     * Set the key.
+     * @param keyLength 16 or 32 bytes
+     * @return false for unsupported key sizes
+     */
+    bool setKey(const uint8_t* key, size_t keyLength);
+
+    bool hasKey() const { return hasKey_; }
+
+    /**
+     * Decrypt and verify.
+     * @return false if the tag doesn't match; output is then undefined
+     */
+    bool open(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+              const uint8_t* in, uint8_t* out, size_t length, const uint8_t* tag) const;
+
+    /**
+     * Encrypt and compute the tag.
+     */
+    void seal(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+              const uint8_t* in, uint8_t* out, size_t length, uint8_t* tag) const;
+
+    /**
+     * Check if the hardware implementation is in use.
+     */
+    static bool isHardwareAccelerated();
+
+private:
+    AesGcmKey key_{};
+    bool hasKey_ = false;
+
+    void crypt(const uint8_t* nonce, const uint8_t* aad, size_t aadLength,
+               const uint8_t* in, uint8_t* out, size_t length,
+               bool encrypt, uint8_t* tag) const;
+};
+
+#if defined(AAP_HAVE_ARMV8_CRYPTO)
+/**
+ * ARMv8 Crypto Extensions implementation, built with +crypto in its own
+ * translation unit and only called when the CPU reports AES and PMULL.
+ */
+bool aesGcmArmv8Available();
+void aesGcmCryptArmv8(const AesGcmKey& key, const uint8_t* nonce,
+                      const uint8_t* aad, size_t aadLength,
+                      const uint8_t* in, uint8_t* out, size_t length,
+                      bool encrypt, uint8_t* tag);
+#endif
+
+} // namespace aap
@@ -0,0 +1,194 @@
+#include "aes_gcm.h"
+
+#if defined(AAP_HAVE_ARMV8_CRYPTO)
+
+#include <arm_neon.h>
+#include <cstring>
+#include <sys/auxv.h>
+
+#ifndef HWCAP_AES
+#define HWCAP_AES (1 << 3)
+#endif
+#ifndef HWCAP_PMULL
+#define HWCAP_PMULL (1 << 4)
+#endif
+
+namespace aap {
+
+namespace {
+
+inline uint8x16_t aesEncrypt(const uint8x16_t* rk, int rounds, uint8x16_t block) {
+    for (int i = 0; i < rounds - 1; i++) {
+        block = vaesmcq_u8(vaeseq_u8(block, rk[i]));
+    }
+    block = vaeseq_u8(block, rk[rounds - 1]);
+    return veorq_u8(block, rk[rounds]);
+}
+
+// Four independent blocks interleaved to keep the AES pipeline busy
+inline void aesEncrypt4(const uint8x16_t* rk, int rounds, uint8x16_t blocks[4]) {
+    for (int i = 0; i < rounds - 1; i++) {
+        blocks[0] = vaesmcq_u8(vaeseq_u8(blocks[0], rk[i]));
+        blocks[1] = vaesmcq_u8(vaeseq_u8(blocks[1], rk[i]));
+        blocks[2] = vaesmcq_u8(vaeseq_u8(blocks[2], rk[i]));
+        blocks[3] = vaesmcq_u8(vaeseq_u8(blocks[3], rk[i]));
+    }
+    for (int b = 0; b < 4; b++) {
+        blocks[b] = veorq_u8(vaeseq_u8(blocks[b], rk[rounds - 1]), rk[rounds]);
+    }
+}
+
+// GHASH works on byte-reversed blocks so PMULL sees a plain polynomial
+inline uint8x16_t reverseBytes(uint8x16_t v) {
+    v = vrev64q_u8(v);
+    return vextq_u8(v, v, 8);
+}
+
+inline uint8x16_t clmul(uint8x16_t a, int laneA, uint8x16_t b, int laneB) {
+    const uint64x2_t a64 = vreinterpretq_u64_u8(a);
+    const uint64x2_t b64 = vreinterpretq_u64_u8(b);
+    const poly64_t x = static_cast<poly64_t>(laneA ? vgetq_lane_u64(a64, 1) : vgetq_lane_u64(a64, 0));
+    const poly64_t y = static_cast<poly64_t>(laneB ? vgetq_lane_u64(b64, 1) : vgetq_lane_u64(b64, 0));
+    return vreinterpretq_u8_p128(vmull_p64(x, y));
+}
+
+// a * b in GF(2^128), reflected representation (carry-less multiply,
+// shift left by one, then reduce modulo x^128 + x^7 + x^2 + x + 1)
+uint8x16_t gfmul(uint8x16_t a, uint8x16_t b) {
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint32x4_t zero32 = vdupq_n_u32(0);
+
+    uint8x16_t lo = clmul(a, 0, b, 0);
+    uint8x16_t hi = clmul(a, 1, b, 1);
+    const uint8x16_t mid = veorq_u8(clmul(a, 0, b, 1), clmul(a, 1, b, 0));
+    lo = veorq_u8(lo, vextq_u8(zero, mid, 8));
+    hi = veorq_u8(hi, vextq_u8(mid, zero, 8));
+
+    uint32x4_t lo32 = vreinterpretq_u32_u8(lo);
+    uint32x4_t hi32 = vreinterpretq_u32_u8(hi);
+    uint32x4_t carryLo = vshrq_n_u32(lo32, 31);
+    uint32x4_t carryHi = vshrq_n_u32(hi32, 31);
+    lo32 = vshlq_n_u32(lo32, 1);
+    hi32 = vshlq_n_u32(hi32, 1);
+    const uint32x4_t carryOut = vextq_u32(carryLo, zero32, 3);
+    carryHi = vextq_u32(zero32, carryHi, 3);
+    carryLo = vextq_u32(zero32, carryLo, 3);
+    lo32 = vorrq_u32(lo32, carryLo);
+    hi32 = vorrq_u32(vorrq_u32(hi32, carryHi), carryOut);
+
+    uint32x4_t t7 = veorq_u32(veorq_u32(vshlq_n_u32(lo32, 31), vshlq_n_u32(lo32, 30)),
+                              vshlq_n_u32(lo32, 25));
+    const uint32x4_t t8 = vextq_u32(t7, zero32, 1);
+    t7 = vextq_u32(zero32, t7, 1);
+    lo32 = veorq_u32(lo32, t7);
+
+    uint32x4_t t2 = veorq_u32(veorq_u32(vshrq_n_u32(lo32, 1), vshrq_n_u32(lo32, 2)),
+                              vshrq_n_u32(lo32, 7));
+    t2 = veorq_u32(t2, t8);
+    lo32 = veorq_u32(lo32, t2);
+    hi32 = veorq_u32(hi32, lo32);
+    return vreinterpretq_u8_u32(hi32);
+}
+
+inline uint8x16_t ghashBlock(uint8x16_t y, uint8x16_t h, uint8x16_t block) {
+    return gfmul(veorq_u8(y, reverseBytes(block)), h);
+}
+
+uint8x16_t ghashBytes(uint8x16_t y, uint8x16_t h, const uint8_t* data, size_t length) {
+    while (length >= 16) {
+        y = ghashBlock(y, h, vld1q_u8(data));
+        data += 16;
+        length -= 16;
+    }
+    if (length > 0) {
+        uint8_t last[16] = {0};
+        std::memcpy(last, data, length);
+        y = ghashBlock(y, h, vld1q_u8(last));
+    }
+    return y;
+}
+
+inline uint8x16_t counterBlock(uint8x16_t j0, uint32_t counter) {
+    return vreinterpretq_u8_u32(vsetq_lane_u32(__builtin_bswap32(counter), vreinterpretq_u32_u8(j0), 3));
+}
+
+} // anonymous namespace
+
+bool aesGcmArmv8Available() {
+    const unsigned long hwcap = getauxval(AT_HWCAP);
+    return (hwcap & HWCAP_AES) && (hwcap & HWCAP_PMULL);
+}
+
+void aesGcmCryptArmv8(const AesGcmKey& key, const uint8_t* nonce,
+                      const uint8_t* aad, size_t aadLength,
+                      const uint8_t* in, uint8_t* out, size_t length,
+                      bool encrypt, uint8_t* tag) {
+    uint8x16_t rk[15];
+    for (int i = 0; i <= key.rounds; i++) {
+        rk[i] = vld1q_u8(key.roundKeyBytes + 16 * i);
+    }
+
+    const uint8x16_t h = reverseBytes(vld1q_u8(key.h));
+    uint8x16_t y = ghashBytes(vdupq_n_u8(0), h, aad, aadLength);
+
+    uint8_t j0Bytes[16];
+    std::memcpy(j0Bytes, nonce, AesGcm::NONCE_SIZE);
+    std::memset(j0Bytes + AesGcm::NONCE_SIZE, 0, 4);
+    j0Bytes[15] = 1;
+    const uint8x16_t j0 = vld1q_u8(j0Bytes);
+    uint32_t counter = 1;
+
+    size_t offset = 0;
+    while (length - offset >= 64) {
+        uint8x16_t keystream[4];
+        for (int b = 0; b < 4; b++) {
+            keystream[b] = counterBlock(j0, ++counter);
+        }
+        aesEncrypt4(rk, key.rounds, keystream);
+
+        for (int b = 0; b < 4; b++) {
+            const uint8x16_t data = vld1q_u8(in + offset);
+            const uint8x16_t result = veorq_u8(data, keystream[b]);
+            y = ghashBlock(y, h, encrypt ? result : data);
+            vst1q_u8(out + offset, result);
+            offset += 16;
+        }
+    }
+
+    while (offset < length) {
+        const size_t n = length - offset < 16 ? length - offset : 16;
+        const uint8x16_t keystream = aesEncrypt(rk, key.rounds, counterBlock(j0, ++counter));
+
+        uint8_t block[16] = {0};
+        std::memcpy(block, in + offset, n);
+        const uint8x16_t data = vld1q_u8(block);
+        const uint8x16_t result = veorq_u8(data, keystream);
+        vst1q_u8(block, result);
+
+        // GHASH sees the zero-padded ciphertext
+        if (encrypt) {
+            std::memset(block + n, 0, 16 - n);
+            y = ghashBlock(y, h, vld1q_u8(block));
+        } else {
+            y = ghashBlock(y, h, data);
+        }
+        std::memcpy(out + offset, block, n);
+        offset += n;
+    }
+
+    uint8_t lengths[16];
+    const uint64_t aadBits = static_cast<uint64_t>(aadLength) * 8;
+    const uint64_t dataBits = static_cast<uint64_t>(length) * 8;
+    for (int i = 0; i < 8; i++) {
+        lengths[i] = static_cast<uint8_t>(aadBits >> (56 - 8 * i));
+        lengths[8 + i] = static_cast<uint8_t>(dataBits >> (56 - 8 * i));
+    }
+    y = ghashBlock(y, h, vld1q_u8(lengths));
+
+    const uint8x16_t mask = aesEncrypt(rk, key.rounds, j0);
+    vst1q_u8(tag, veorq_u8(reverseBytes(y), mask));
+}
+
+} // namespace aap
+
+#endif // AAP_HAVE_ARMV8_CRYPTO
@@ -0,0 +1,198 @@
+#include "audio_dsp.h"
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define AAP_AUDIO_DSP_NEON 1
+#endif
+
+namespace aap {
+
+namespace {
+
+constexpr float PCM_SCALE = 32768.0f;
+constexpr float PCM_INV_SCALE = 1.0f / 32768.0f;
+
+inline int16_t toPcm(float sample) {
+    const float scaled = sample * PCM_SCALE;
+    if (scaled >= 32767.0f) return 32767;
+    if (scaled <= -32768.0f) return -32768;
+    return static_cast<int16_t>(std::lrintf(scaled));
+}
+
+#ifdef AAP_AUDIO_DSP_NEON
+
+// Round to nearest, float to int32 saturates
+inline int32x4_t roundToInt(float32x4_t v) {
+#if defined(__aarch64__)
+    return vcvtnq_s32_f32(v);
+#else
+    // ARMv7 only truncates: add half away from zero first
+    const uint32x4_t negative = vcltq_f32(v, vdupq_n_f32(0.0f));
+    const float32x4_t half = vbslq_f32(negative, vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f));
+    return vcvtq_s32_f32(vaddq_f32(v, half));
+#endif
+}
+
+#endif
+
+} // anonymous namespace
+
+void AudioDsp::pcmToFloat(const int16_t* in, float* out, size_t count) {
+    size_t i = 0;
+#ifdef AAP_AUDIO_DSP_NEON
+    for (; i + 8 <= count; i += 8) {
+        const int16x8_t pcm = vld1q_s16(in + i);
+        const float32x4_t low = vcvtq_f32_s32(vmovl_s16(vget_low_s16(pcm)));
+        const float32x4_t high = vcvtq_f32_s32(vmovl_s16(vget_high_s16(pcm)));
+        vst1q_f32(out + i, vmulq_n_f32(low, PCM_INV_SCALE));
+        vst1q_f32(out + i + 4, vmulq_n_f32(high, PCM_INV_SCALE));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = static_cast<float>(in[i]) * PCM_INV_SCALE;
+    }
+}
+
+void AudioDsp::floatToPcm(const float* in, int16_t* out, size_t count) {
+    size_t i = 0;
+#ifdef AAP_AUDIO_DSP_NEON
+    for (; i + 8 <= count; i += 8) {
+        const int32x4_t low = roundToInt(vmulq_n_f32(vld1q_f32(in + i), PCM_SCALE));
+        const int32x4_t high = roundToInt(vmulq_n_f32(vld1q_f32(in + i + 4), PCM_SCALE));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(low), vqmovn_s32(high)));
+    }
+#endif
+    for (; i < count; i++) {
+        out[i] = toPcm(in[i]);
+    }
+}
+
+void AudioDsp::mixWithGainRamp(float* acc, const float* in, size_t count, float gain, float step) {
+    size_t i = 0;
+#ifdef AAP_AUDIO_DSP_NEON
+    const float lanes[4] = {gain, gain + step, gain + 2 * step, gain + 3 * step};
+    float32x4_t gains = vld1q_f32(lanes);
+    const float32x4_t step4 = vdupq_n_f32(4 * step);
+    for (; i + 4 <= count; i += 4) {
+        vst1q_f32(acc + i, vmlaq_f32(vld1q_f32(acc + i), vld1q_f32(in + i), gains));
+        gains = vaddq_f32(gains, step4);
+    }
+#endif
+    for (; i < count; i++) {
+        acc[i] += in[i] * (gain + static_cast<float>(i) * step);
+    }
+}
+
+void AudioDsp::monoToStereo(const float* in, float* out, size_t frames) {
+    size_t i = 0;
+#ifdef AAP_AUDIO_DSP_NEON
+    for (; i + 4 <= frames; i += 4) {
+        const float32x4_t mono = vld1q_f32(in + i);
+        float32x4x2_t stereo;
+        stereo.val[0] = mono;
+        stereo.val[1] = mono;
+        vst2q_f32(out + i * 2, stereo);
+    }
+#endif
+    for (; i < frames; i++) {
+        out[i * 2] = in[i];
+        out[i * 2 + 1] = in[i];
+    }
+}
+
+void AudioDsp::stereoToMono(const float* in, float* out, size_t frames) {
+    size_t i = 0;
+#ifdef AAP_AUDIO_DSP_NEON
+    // Each block is loaded before it is overwritten, in place is fine
+    for (; i + 4 <= frames; i += 4) {
+        const float32x4x2_t stereo = vld2q_f32(in + i * 2);
+        vst1q_f32(out + i, vmulq_n_f32(vaddq_f32(stereo.val[0], stereo.val[1]), 0.5f));
+    }
+#endif
+    for (; i < frames; i++) {
+        out[i] = (in[i * 2] + in[i * 2 + 1]) * 0.5f;
+    }
+}
+
+void AudioDsp::resampleLinear(const float* in, size_t channels, float* out, size_t frames,
+                              double position, double step) {
+    size_t i = 0;
+#ifdef AAP_AUDIO_DSP_NEON
+    // Positions stay scalar doubles so both paths pick the same frames;
+    // the loads pair up each frame with its successor for the lerp
+    if (channels == 1) {
+        for (; i + 4 <= frames; i += 4) {
+            float32x2_t pairs[4];
+            float t[4];
+            for (size_t k = 0; k < 4; k++) {
+                const double p = position + static_cast<double>(i + k) * step;
+                const size_t index = static_cast<size_t>(p);
+                t[k] = static_cast<float>(p - static_cast<double>(index));
+                pairs[k] = vld1_f32(in + index);
+            }
+            const float32x4x2_t ab = vuzpq_f32(vcombine_f32(pairs[0], pairs[1]),
+                                               vcombine_f32(pairs[2], pairs[3]));
+            vst1q_f32(out + i, vmlaq_f32(ab.val[0], vsubq_f32(ab.val[1], ab.val[0]), vld1q_f32(t)));
+        }
+    } else if (channels == 2) {
+        for (; i + 2 <= frames; i += 2) {
+            float32x4_t pairs[2];
+            float t[4];
+            for (size_t k = 0; k < 2; k++) {
+                const double p = position + static_cast<double>(i + k) * step;
+                const size_t index = static_cast<size_t>(p);
+                t[k * 2] = t[k * 2 + 1] = static_cast<float>(p - static_cast<double>(index));
+                pairs[k] = vld1q_f32(in + index * 2);
+            }
+            const float32x4_t a = vcombine_f32(vget_low_f32(pairs[0]), vget_low_f32(pairs[1]));
+            const float32x4_t b = vcombine_f32(vget_high_f32(pairs[0]), vget_high_f32(pairs[1]));
+            vst1q_f32(out + i * 2, vmlaq_f32(a, vsubq_f32(b, a), vld1q_f32(t)));
+        }
+    }
+#endif
+    for (; i < frames; i++) {
+        const double p = position + static_cast<double>(i) * step;
+        const size_t index = static_cast<size_t>(p);
+        const float t = static_cast<float>(p - static_cast<double>(index));
+        const float* a = in + index * channels;
+        const float* b = a + channels;
+        for (size_t c = 0; c < channels; c++) {
+            out[i * channels + c] = a[c] + (b[c] - a[c]) * t;
+        }
+    }
+}
+
+bool AudioDsp::isSimdAccelerated() {
+#ifdef AAP_AUDIO_DSP_NEON
+    return true;
+#else
+    return false;
+#endif
+}
+
+LinearResampler::LinearResampler(size_t channels, size_t maxFrames, double maxRatio)
+    : channels_(channels)
+    , buffer_(new float[(HISTORY_FRAMES * 2 + static_cast<size_t>(std::ceil(maxFrames * maxRatio))) * channels]())
+{
+}
+
+void LinearResampler::process(float* out, size_t frames) {
+    if (frames == 0) {
+        return;
+    }
+    const size_t needed = inputFrames(frames);
+    AudioDsp::resampleLinear(buffer_.get(), channels_, out, frames, position_, ratio_);
+
+    // The last two frames read become the history of the next block
+    std::memmove(buffer_.get(), buffer_.get() + needed * channels_, HISTORY_FRAMES * channels_ * sizeof(float));
+    position_ += static_cast<double>(frames) * ratio_ - static_cast<double>(needed);
+}
+
+void LinearResampler::reset() {
+    position_ = HISTORY_FRAMES;
+    std::memset(buffer_.get(), 0, HISTORY_FRAMES * channels_ * sizeof(float));
+}
+
+} // namespace aap
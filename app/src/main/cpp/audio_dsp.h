@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace aap {
+
+/**
+ * Sample kernels of the native audio path, run on every output callback
+ * for the whole session.
+ *
+ * Four samples at a time with NEON where the ABI has it (arm64-v8a, and
+ * armeabi-v7a which the NDK builds with NEON), scalar loops elsewhere.
+ * Float samples are normalized to [-1, 1). Counts are samples unless the
+ * kernel changes the layout, then they are frames.
+ */
+class AudioDsp {
+public:
+    /**
+     * 16-bit PCM to float.
+     */
+    static void pcmToFloat(const int16_t* in, float* out, size_t count);
+
+    /**
+     * Float to 16-bit PCM, rounded and saturated.
+     */
+    static void floatToPcm(const float* in, int16_t* out, size_t count);
+
+    /**
+     * Add in to acc with a linear gain ramp: sample i is scaled by
+     * gain + i * step.
+     */
+    static void mixWithGainRamp(float* acc, const float* in, size_t count, float gain, float step);
+
+    /**
+     * Duplicate mono frames into interleaved stereo.
+     */
+    static void monoToStereo(const float* in, float* out, size_t frames);
+
+    /**
+     * Average interleaved stereo frames into mono, may run in place.
+     */
+    static void stereoToMono(const float* in, float* out, size_t frames);
+
+    /**
+     * Linear interpolation over interleaved frames: output frame i is taken
+     * at input frame position + i * step, so in must hold the frames up to
+     * floor(position + (frames - 1) * step) + 1.
+     */
+    static void resampleLinear(const float* in, size_t channels, float* out, size_t frames,
+                               double position, double step);
+
+    /**
+     * Check if the NEON kernels are compiled in.
+     */
+    static bool isSimdAccelerated();
+};
+
+/**
+ * Streaming linear resampler on top of AudioDsp::resampleLinear(): keeps
+ * the input position and the last frames across calls, so consecutive
+ * blocks interpolate as one signal.
+ *
+ * Per block: inputFrames() says how many new frames process() consumes,
+ * the caller writes them to input() and calls process().
+ */
+class LinearResampler {
+public:
+    static constexpr size_t HISTORY_FRAMES = 2;
+
+    /**
+     * @param maxFrames Output frames per process() call, at most
+     * @param maxRatio Input frames per output frame, at most
+     */
+    LinearResampler(size_t channels, size_t maxFrames, double maxRatio);
+
+    // Non-copyable
+    LinearResampler(const LinearResampler&) = delete;
+    LinearResampler& operator=(const LinearResampler&) = delete;
+
+    /**
+     * Input frames consumed per output frame, takes effect on the next block.
+     */
+    void setRatio(double ratio) { ratio_ = ratio; }
+    double ratio() const { return ratio_; }
+
+    /**
+     * New input frames the next process(frames) consumes.
+     */
+    size_t inputFrames(size_t frames) const {
+        return frames == 0 ? 0 : static_cast<size_t>(position_ + static_cast<double>(frames - 1) * ratio_);
+    }
+
+    /**
+     * Where the next block's input frames go, after the history.
+     */
+    float* input() { return buffer_.get() + HISTORY_FRAMES * channels_; }
+
+    void process(float* out, size_t frames);
+
+    /**
+     * Forget the history, the next block starts from silence.
+     */
+    void reset();
+
+private:
+    const size_t channels_;
+    std::unique_ptr<float[]> buffer_;
+    double ratio_ = 1.0;
+    double position_ = HISTORY_FRAMES;  // Relative to the first history frame
+};
+
+} // namespace aap
@@ -0,0 +1,146 @@
+#include "audio_jitter_buffer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <time.h>
+
+namespace aap {
+
+namespace {
+
+uint64_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+} // anonymous namespace
+
+AudioJitterBuffer::AudioJitterBuffer(int sampleRate, int channelCount)
+    : sampleRate_(sampleRate)
+    , channelCount_(static_cast<size_t>(std::min(channelCount, 2)))
+    , frameBytes_(channelCount_ * sizeof(int16_t))
+    , ring_(static_cast<size_t>(sampleRate) * frameBytes_ * CAPACITY_MS / 1000)
+    , resampler_(channelCount_, CHUNK_FRAMES, 1.0 + MAX_CORRECTION_PPM * 1e-6)
+    , scratch_(new int16_t[CHUNK_FRAMES * 2 * channelCount_])
+    , samples_(new float[CHUNK_FRAMES * channelCount_])
+    , targetFrames_(static_cast<uint32_t>(sampleRate * MIN_TARGET_MS / 1000))
+{
+}
+
+size_t AudioJitterBuffer::write(const uint8_t* pcm, size_t length) {
+    // Whole frames only, a split sample would swap channels from here on
+    length -= length % frameBytes_;
+    if (length == 0) {
+        return 0;
+    }
+
+    const uint64_t now = nowUs();
+    const double durationUs = static_cast<double>(length / frameBytes_) * 1e6 / sampleRate_;
+    if (lastArrivalUs_ != 0) {
+        // How far this record is off the previous one's duration, capped
+        // so the gap between two tracks doesn't read as jitter
+        const double deviation = std::fabs(static_cast<double>(now - lastArrivalUs_) - lastDurationUs_);
+        jitterUs_ += (std::min(deviation, MAX_TARGET_MS * 1000.0) - jitterUs_) / JITTER_SMOOTHING;
+    }
+    lastArrivalUs_ = now;
+    lastDurationUs_ = durationUs;
+
+    const double targetUs = std::min(std::max(durationUs + 3 * jitterUs_, MIN_TARGET_MS * 1000.0),
+                                     MAX_TARGET_MS * 1000.0);
+    targetFrames_.store(static_cast<uint32_t>(targetUs * sampleRate_ / 1e6), std::memory_order_release);
+    jitterPublishedUs_.store(static_cast<int32_t>(jitterUs_), std::memory_order_relaxed);
+
+    size_t space = ring_.freeSpace();
+    space -= space % frameBytes_;
+    return ring_.write(pcm, std::min(length, space));
+}
+
+size_t AudioJitterBuffer::read(int16_t* out, size_t frames) {
+    const double available = static_cast<double>(ring_.available() / frameBytes_);
+    if (buffering_) {
+        if (available < targetFrames_.load(std::memory_order_acquire)) {
+            std::memset(out, 0, frames * frameBytes_);
+            return 0;
+        }
+        buffering_ = false;
+        playing_.store(true, std::memory_order_relaxed);
+        smoothedFill_ = available;
+    }
+    smoothedFill_ += (available - smoothedFill_) / FILL_SMOOTHING;
+    fillFrames_.store(static_cast<int32_t>(smoothedFill_), std::memory_order_relaxed);
+    updateRatio();
+
+    size_t done = 0;
+    while (done < frames) {
+        const size_t chunk = std::min(frames - done, CHUNK_FRAMES);
+        if (!resample(out + done * channelCount_, chunk)) {
+            // Ran dry: play out what is left, then buffer up to the target again
+            const size_t left = ring_.read(reinterpret_cast<uint8_t*>(out + done * channelCount_),
+                                           (frames - done) * frameBytes_) / frameBytes_;
+            std::memset(out + (done + left) * channelCount_, 0, (frames - done - left) * frameBytes_);
+            underruns_.fetch_add(1, std::memory_order_relaxed);
+            rebuffer();
+            return done + left;
+        }
+        done += chunk;
+    }
+    return frames;
+}
+
+void AudioJitterBuffer::updateRatio() {
+    const double fillMs = smoothedFill_ * 1000.0 / sampleRate_;
+    const double targetMs = targetFrames_.load(std::memory_order_acquire) * 1000.0 / sampleRate_;
+    const double ppm = std::min(std::max((fillMs - targetMs) * CORRECTION_PPM_PER_MS,
+                                         static_cast<double>(-MAX_CORRECTION_PPM)),
+                                static_cast<double>(MAX_CORRECTION_PPM));
+    ratio_ = 1.0 + ppm * 1e-6;
+    correctionPpm_.store(static_cast<int32_t>(ppm), std::memory_order_relaxed);
+}
+
+bool AudioJitterBuffer::resample(int16_t* out, size_t frames) {
+    resampler_.setRatio(ratio_);
+    const size_t needed = resampler_.inputFrames(frames);
+    if (ring_.available() < needed * frameBytes_) {
+        return false;
+    }
+
+    ring_.read(reinterpret_cast<uint8_t*>(scratch_.get()), needed * frameBytes_);
+    AudioDsp::pcmToFloat(scratch_.get(), resampler_.input(), needed * channelCount_);
+    resampler_.process(samples_.get(), frames);
+    AudioDsp::floatToPcm(samples_.get(), out, frames * channelCount_);
+    return true;
+}
+
+void AudioJitterBuffer::rebuffer() {
+    buffering_ = true;
+    playing_.store(false, std::memory_order_relaxed);
+    resampler_.reset();
+}
+
+void AudioJitterBuffer::clear() {
+    ring_.clear();
+    rebuffer();
+    lastArrivalUs_ = 0;
+    lastDurationUs_ = 0;
+    jitterUs_ = 0;
+    smoothedFill_ = 0;
+    ratio_ = 1.0;
+    targetFrames_.store(static_cast<uint32_t>(sampleRate_ * MIN_TARGET_MS / 1000), std::memory_order_relaxed);
+    fillFrames_.store(0, std::memory_order_relaxed);
+    jitterPublishedUs_.store(0, std::memory_order_relaxed);
+    correctionPpm_.store(0, std::memory_order_relaxed);
+}
+
+AudioJitterBuffer::Stats AudioJitterBuffer::getStats() const {
+    Stats stats;
+    stats.fillMs = fillFrames_.load(std::memory_order_relaxed) * 1000 / sampleRate_;
+    stats.targetMs = static_cast<int32_t>(
+        static_cast<uint64_t>(targetFrames_.load(std::memory_order_relaxed)) * 1000 / sampleRate_);
+    stats.jitterUs = jitterPublishedUs_.load(std::memory_order_relaxed);
+    stats.correctionPpm = correctionPpm_.load(std::memory_order_relaxed);
+    stats.underruns = underruns_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace aap
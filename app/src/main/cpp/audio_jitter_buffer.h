@@ -0,0 +1,113 @@
+#pragma once
+
+#include "audio_dsp.h"
+#include "ring_buffer.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace aap {
+
+/**
+ * PCM jitter buffer between the AAP-Audio thread and an output callback.
+ *
+ * Depth is tracked in time, not records: the target is one record plus
+ * three times the interarrival jitter (RFC 3550 estimator), so a steady
+ * phone runs shallow and a bursty one gets more headroom. Playback starts,
+ * and restarts after running dry, once the target is buffered.
+ *
+ * The phone's clock drifts against the DAC, which would slowly empty or
+ * fill the buffer. Instead of dropping records, the consumer resamples
+ * by up to MAX_CORRECTION_PPM (LinearResampler) to hold the smoothed
+ * fill level at the target.
+ *
+ * write() is called from a single producer, read() from a single consumer.
+ */
+class AudioJitterBuffer {
+public:
+    static constexpr int CAPACITY_MS = 200;
+    static constexpr int MIN_TARGET_MS = 20;
+    static constexpr int MAX_TARGET_MS = 120;
+    static constexpr int MAX_CORRECTION_PPM = 5000;     // 0.5%, well below an audible pitch shift
+    static constexpr int CORRECTION_PPM_PER_MS = 100;   // Proportional gain on the fill error
+
+    AudioJitterBuffer(int sampleRate, int channelCount);
+
+    // Non-copyable
+    AudioJitterBuffer(const AudioJitterBuffer&) = delete;
+    AudioJitterBuffer& operator=(const AudioJitterBuffer&) = delete;
+
+    /**
+     * Queue 16-bit PCM, whole frames only (producer side).
+     * @return Bytes queued, the rest was dropped because the buffer is full
+     */
+    size_t write(const uint8_t* pcm, size_t length);
+
+    /**
+     * Fill an output buffer, padding with silence while buffering (consumer side).
+     * @return Frames taken from queued PCM, the rest is silence
+     */
+    size_t read(int16_t* out, size_t frames);
+
+    /**
+     * Drop all PCM and adaptation state.
+     * Not safe against a concurrent producer or consumer.
+     */
+    void clear();
+
+    /**
+     * PCM queued and not yet played, in frames. Either side may call it.
+     */
+    size_t queuedFrames() const { return ring_.available() / frameBytes_; }
+
+    /**
+     * Check if queued PCM is being played, rather than buffered up to the target.
+     */
+    bool isPlaying() const { return playing_.load(std::memory_order_relaxed); }
+
+    struct Stats {
+        int32_t fillMs;             // Smoothed, as seen by the consumer
+        int32_t targetMs;
+        int32_t jitterUs;
+        int32_t correctionPpm;      // Positive while playing faster to drain
+        uint64_t underruns;         // Ran dry while playing
+    };
+    Stats getStats() const;
+
+private:
+    static constexpr size_t CHUNK_FRAMES = 256;
+    static constexpr double FILL_SMOOTHING = 64.0;  // Callbacks
+    static constexpr double JITTER_SMOOTHING = 16.0;
+
+    const int sampleRate_;
+    const size_t channelCount_;
+    const size_t frameBytes_;
+    RingBuffer ring_;
+
+    // Producer state
+    uint64_t lastArrivalUs_ = 0;
+    double lastDurationUs_ = 0;
+    double jitterUs_ = 0;
+
+    // Consumer state
+    bool buffering_ = true;
+    double smoothedFill_ = 0;   // Frames
+    double ratio_ = 1.0;        // Input frames consumed per output frame
+    LinearResampler resampler_;
+    std::unique_ptr<int16_t[]> scratch_;
+    std::unique_ptr<float[]> samples_;
+
+    std::atomic<uint32_t> targetFrames_;
+    std::atomic<int32_t> fillFrames_{0};
+    std::atomic<int32_t> jitterPublishedUs_{0};
+    std::atomic<int32_t> correctionPpm_{0};
+    std::atomic<uint64_t> underruns_{0};
+    std::atomic<bool> playing_{false};
+
+    void updateRatio();
+    bool resample(int16_t* out, size_t frames);
+    void rebuffer();
+};
+
+} // namespace aap
@@ -0,0 +1,181 @@
+#include "audio_mixer.h"
+#include <algorithm>
+#include <cstring>
+
+namespace aap {
+
+namespace {
+
+// Ramps toward target by at most maxDelta
+inline float rampToward(float value, float target, float maxDelta) {
+    if (value < target) {
+        return std::min(value + maxDelta, target);
+    }
+    return std::max(value - maxDelta, target);
+}
+
+inline float rampDelta(float range, size_t frames, int rampMs) {
+    return range * static_cast<float>(frames) / (static_cast<float>(AudioMixer::OUTPUT_RATE) * rampMs / 1000.0f);
+}
+
+} // anonymous namespace
+
+AudioMixer::Input::Input(const InputFormat& format)
+    : channels(static_cast<size_t>(std::min(std::max(format.channelCount, 1), OUTPUT_CHANNELS)))
+    , factor(static_cast<size_t>(OUTPUT_RATE / format.sampleRate))
+    , jitter(format.sampleRate, static_cast<int>(channels))
+    , resampler(channels, CHUNK_FRAMES, 1.0)
+{
+    resampler.setRatio(1.0 / static_cast<double>(factor));
+}
+
+AudioMixer::AudioMixer(const InputFormat* formats, size_t count, int duckedInput, int duckingInput)
+    : inputCount_(std::min(count, MAX_INPUTS))
+    , duckedInput_(duckedInput)
+    , duckingInput_(duckingInput)
+    , pcm_(new int16_t[CHUNK_FRAMES * OUTPUT_CHANNELS])
+    , samples_(new float[CHUNK_FRAMES * OUTPUT_CHANNELS])
+    , expanded_(new float[CHUNK_FRAMES * OUTPUT_CHANNELS])
+    , mix_(new float[CHUNK_FRAMES * OUTPUT_CHANNELS])
+{
+    for (size_t i = 0; i < inputCount_; i++) {
+        inputs_[i].reset(new Input(formats[i]));
+    }
+}
+
+size_t AudioMixer::write(size_t input, const uint8_t* pcm, size_t length) {
+    if (input >= inputCount_) {
+        return 0;
+    }
+    Input& in = *inputs_[input];
+    const size_t written = in.jitter.write(pcm, length);
+    if (written < length) {
+        in.bytesDropped.fetch_add(length - written, std::memory_order_relaxed);
+    }
+    in.bytesWritten.fetch_add(written, std::memory_order_relaxed);
+    return written;
+}
+
+void AudioMixer::render(int16_t* out, size_t frames) {
+    while (frames > 0) {
+        const size_t chunk = std::min(frames, CHUNK_FRAMES);
+        renderChunk(out, chunk);
+        out += chunk * OUTPUT_CHANNELS;
+        frames -= chunk;
+    }
+}
+
+void AudioMixer::renderChunk(int16_t* out, size_t frames) {
+    const size_t samples = frames * OUTPUT_CHANNELS;
+    updateDucking(frames);
+
+    bool mixed = false;
+    std::memset(mix_.get(), 0, samples * sizeof(float));
+    for (size_t i = 0; i < inputCount_; i++) {
+        mixed |= mixInput(*inputs_[i], static_cast<int>(i) == duckedInput_, frames);
+    }
+    if (!mixed) {
+        std::memset(out, 0, samples * sizeof(int16_t));
+        return;
+    }
+    AudioDsp::floatToPcm(mix_.get(), out, samples);
+}
+
+void AudioMixer::updateDucking(size_t frames) {
+    if (duckedInput_ < 0 || duckingInput_ < 0) {
+        return;
+    }
+    const bool ducking = ducking_.load(std::memory_order_relaxed);
+    if (inputs_[duckingInput_]->jitter.isPlaying()) {
+        quietFrames_ = 0;
+        if (!ducking) {
+            ducking_.store(true, std::memory_order_relaxed);
+            ducks_.fetch_add(1, std::memory_order_relaxed);
+        }
+    } else if (ducking) {
+        quietFrames_ += frames;
+        if (quietFrames_ >= static_cast<size_t>(OUTPUT_RATE / 1000 * DUCK_HOLD_MS)) {
+            ducking_.store(false, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool AudioMixer::mixInput(Input& input, bool ducked, size_t frames) {
+    const size_t needed = input.factor == 1 ? frames : input.resampler.inputFrames(frames);
+    const size_t played = needed > 0 ? input.jitter.read(pcm_.get(), needed) : 0;
+    input.framesPlayed.fetch_add(played, std::memory_order_relaxed);
+
+    const float target = input.targetGain.load(std::memory_order_relaxed);
+    const float duckTarget = ducked && ducking_.load(std::memory_order_relaxed) ? DUCK_GAIN : 1.0f;
+    if (played == 0 && input.silent) {
+        // Idle, nothing but silence left to interpolate; gains still follow
+        input.gain = target;
+        input.duck = duckTarget;
+        return false;
+    }
+
+    const float* stereo = expand(input, needed, frames);
+    input.silent = played == 0;
+
+    const float gain = rampToward(input.gain, target, rampDelta(1.0f, frames, GAIN_RAMP_MS));
+    const float duckDelta = duckTarget < input.duck ? rampDelta(1.0f - DUCK_GAIN, frames, DUCK_ATTACK_MS)
+                                                    : rampDelta(1.0f - DUCK_GAIN, frames, DUCK_RELEASE_MS);
+    const float duck = rampToward(input.duck, duckTarget, duckDelta);
+    const float start = input.gain * input.duck;
+    const float end = gain * duck;
+    const size_t samples = frames * OUTPUT_CHANNELS;
+    AudioDsp::mixWithGainRamp(mix_.get(), stereo, samples, start,
+                              (end - start) / static_cast<float>(samples));
+    input.gain = gain;
+    input.duck = duck;
+    return true;
+}
+
+// Upsample and upmix inputFrames of pcm_ into frames of output layout
+const float* AudioMixer::expand(Input& input, size_t inputFrames, size_t frames) {
+    if (input.factor == 1) {
+        AudioDsp::pcmToFloat(pcm_.get(), samples_.get(), inputFrames * input.channels);
+    } else {
+        AudioDsp::pcmToFloat(pcm_.get(), input.resampler.input(), inputFrames * input.channels);
+        input.resampler.process(samples_.get(), frames);
+    }
+    if (input.channels == OUTPUT_CHANNELS) {
+        return samples_.get();
+    }
+    AudioDsp::monoToStereo(samples_.get(), expanded_.get(), frames);
+    return expanded_.get();
+}
+
+void AudioMixer::clear() {
+    for (size_t i = 0; i < inputCount_; i++) {
+        Input& input = *inputs_[i];
+        input.jitter.clear();
+        input.resampler.reset();
+        input.silent = true;
+        input.gain = input.targetGain.load(std::memory_order_relaxed);
+        input.duck = 1.0f;
+    }
+    quietFrames_ = 0;
+    ducking_.store(false, std::memory_order_relaxed);
+}
+
+void AudioMixer::setGain(size_t input, float gain) {
+    if (input < inputCount_) {
+        inputs_[input]->targetGain.store(std::max(gain, 0.0f), std::memory_order_relaxed);
+    }
+}
+
+AudioMixer::InputStats AudioMixer::getStats(size_t input) const {
+    InputStats stats{};
+    if (input >= inputCount_) {
+        return stats;
+    }
+    const Input& in = *inputs_[input];
+    stats.bytesWritten = in.bytesWritten.load(std::memory_order_relaxed);
+    stats.bytesDropped = in.bytesDropped.load(std::memory_order_relaxed);
+    stats.framesPlayed = in.framesPlayed.load(std::memory_order_relaxed);
+    stats.jitter = in.jitter.getStats();
+    return stats;
+}
+
+} // namespace aap
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "audio_dsp.h"
+#include "audio_jitter_buffer.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace aap {
+
+/**
+ * Mixes the AAP audio channels into one 48 kHz stereo output, so the
+ * session needs a single output stream instead of one per channel.
+ *
+ * Each input keeps its own AudioJitterBuffer at the phone's rate and
+ * layout; render() pulls from all of them, upsamples through a
+ * LinearResampler (the input rates divide OUTPUT_RATE), upmixes mono and
+ * sums them with per-input gain ramps through AudioDsp.
+ *
+ * While the ducking input plays, the ducked one is ramped down to
+ * DUCK_GAIN over DUCK_ATTACK_MS, and brought back over DUCK_RELEASE_MS
+ * once the ducking input has been quiet for DUCK_HOLD_MS, so the gaps
+ * between the words of a prompt don't pump the music. Timing follows the
+ * output clock alone, no upcall is involved.
+ *
+ * write() is called from a single producer, render() from the output
+ * callback; setGain() and the getters from any thread.
+ */
+class AudioMixer {
+public:
+    static constexpr int OUTPUT_RATE = 48000;
+    static constexpr int OUTPUT_CHANNELS = 2;
+    static constexpr size_t MAX_INPUTS = 3;
+    static constexpr float DUCK_GAIN = 0.25f;       // -12 dB
+    static constexpr int DUCK_ATTACK_MS = 50;
+    static constexpr int DUCK_RELEASE_MS = 500;
+    static constexpr int DUCK_HOLD_MS = 400;
+    static constexpr int GAIN_RAMP_MS = 20;         // Volume changes, never a step
+
+    struct InputFormat {
+        int sampleRate;     // Must divide OUTPUT_RATE
+        int channelCount;   // 1 or 2
+    };
+
+    /**
+     * @param duckedInput Input lowered while duckingInput plays, -1 for none
+     */
+    AudioMixer(const InputFormat* formats, size_t count, int duckedInput, int duckingInput);
+
+    // Non-copyable
+    AudioMixer(const AudioMixer&) = delete;
+    AudioMixer& operator=(const AudioMixer&) = delete;
+
+    /**
+     * Queue 16-bit PCM of one input (producer side).
+     * @return Bytes queued, the rest was dropped because its buffer is full
+     */
+    size_t write(size_t input, const uint8_t* pcm, size_t length);
+
+    /**
+     * Fill an interleaved stereo output buffer (consumer side).
+     */
+    void render(int16_t* out, size_t frames);
+
+    /**
+     * Drop all queued PCM and ramp state.
+     * Not safe against a concurrent producer or consumer.
+     */
+    void clear();
+
+    /**
+     * Linear volume of one input, ramped to over GAIN_RAMP_MS.
+     */
+    void setGain(size_t input, float gain);
+
+    bool isPlaying(size_t input) const { return inputs_[input]->jitter.isPlaying(); }
+    size_t queuedFrames(size_t input) const { return inputs_[input]->jitter.queuedFrames(); }
+    bool isDucking() const { return ducking_.load(std::memory_order_relaxed); }
+
+    struct InputStats {
+        uint64_t bytesWritten;
+        uint64_t bytesDropped;      // Jitter buffer full, output is behind
+        uint64_t framesPlayed;      // At the input rate
+        AudioJitterBuffer::Stats jitter;
+    };
+    InputStats getStats(size_t input) const;
+
+    /**
+     * Times the ducked input was lowered.
+     */
+    uint64_t ducks() const { return ducks_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t CHUNK_FRAMES = 256;
+
+    struct Input {
+        Input(const InputFormat& format);
+
+        const size_t channels;
+        const size_t factor;        // Output frames per input frame
+        AudioJitterBuffer jitter;
+        std::atomic<float> targetGain{1.0f};
+
+        // Consumer state
+        LinearResampler resampler;  // Unused at OUTPUT_RATE
+        bool silent = true;         // Nothing played since the last silence
+        float gain = 1.0f;
+        float duck = 1.0f;          // Ducking rides on the gain, with its own timing
+
+        std::atomic<uint64_t> bytesWritten{0};
+        std::atomic<uint64_t> bytesDropped{0};
+        std::atomic<uint64_t> framesPlayed{0};
+    };
+
+    std::unique_ptr<Input> inputs_[MAX_INPUTS];
+    size_t inputCount_;
+    const int duckedInput_;
+    const int duckingInput_;
+
+    // Consumer state
+    size_t quietFrames_ = 0;        // Output frames since the ducking input last played
+    std::unique_ptr<int16_t[]> pcm_;
+    std::unique_ptr<float[]> samples_;
+    std::unique_ptr<float[]> expanded_;
+    std::unique_ptr<float[]> mix_;
+
+    std::atomic<bool> ducking_{false};
+    std::atomic<uint64_t> ducks_{0};
+
+    void renderChunk(int16_t* out, size_t frames);
+    void updateDucking(size_t frames);
+    bool mixInput(Input& input, bool ducked, size_t frames);
+    const float* expand(Input& input, size_t inputFrames, size_t frames);
+};
+
+} // namespace aap
@@ -0,0 +1,263 @@
+#include "audio_output.h"
+#include "aap_message.h"
+#include <android/log.h>
+#include <algorithm>
+
+#define LOG_TAG "AudioOutput"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+// Media data: message type (2) + timestamp (8), then PCM
+constexpr size_t MEDIA_HEADER_SIZE = 10;
+
+struct ChannelFormat {
+    int channel;
+    int sampleRate;
+    int channelCount;
+};
+
+// Same as AudioConfigs, what the headunit announces in service discovery
+constexpr ChannelFormat FORMATS[] = {
+    {Channel::ID_AUD, 48000, 2},    // Media
+    {Channel::ID_AU1, 16000, 1},    // Speech
+    {Channel::ID_AU2, 16000, 1},    // System
+};
+
+inline uint64_t readBe64(const uint8_t* p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+// Media is ducked while guidance plays
+constexpr int DUCKED_INDEX = 0;
+constexpr int DUCKING_INDEX = 1;
+
+void renderMix(void* context, int16_t* out, size_t frames) {
+    static_cast<AudioMixer*>(context)->render(out, frames);
+}
+
+} // anonymous namespace
+
+AudioOutput::AudioOutput(bool mixed) {
+    if (!mixed) {
+        return;
+    }
+    AudioMixer::InputFormat formats[CHANNELS];
+    for (size_t i = 0; i < CHANNELS; i++) {
+        formats[i] = AudioMixer::InputFormat{FORMATS[i].sampleRate, FORMATS[i].channelCount};
+    }
+    mixer_.reset(new AudioMixer(formats, CHANNELS, DUCKED_INDEX, DUCKING_INDEX));
+    mixSink_.reset(new AudioSink(AudioMixer::OUTPUT_RATE, AudioMixer::OUTPUT_CHANNELS, &renderMix, mixer_.get()));
+}
+
+int AudioOutput::indexOf(int channel) {
+    for (size_t i = 0; i < CHANNELS; i++) {
+        if (FORMATS[i].channel == channel) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+bool AudioOutput::isMediaRecord(int channel, const uint8_t* data, size_t length) {
+    if (!Channel::isAudio(channel) || length < MEDIA_HEADER_SIZE) {
+        return false;
+    }
+    // Types 0 and 1 carry PCM, as in AapMessageHandlerImpl
+    const uint16_t type = static_cast<uint16_t>((data[0] << 8) | data[1]);
+    return type == 0 || type == 1;
+}
+
+bool AudioOutput::process(int channel, const uint8_t* data, size_t length) {
+    const int index = indexOf(channel);
+    if (index < 0 || length < MEDIA_HEADER_SIZE) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (mixer_) {
+        if (!startMixed(index)) {
+            return false;
+        }
+        mixer_->write(static_cast<size_t>(index), data + MEDIA_HEADER_SIZE, length - MEDIA_HEADER_SIZE);
+        if (clock_) {
+            updateClock(index, readBe64(data + 2), length - MEDIA_HEADER_SIZE);
+        }
+        return true;
+    }
+
+    std::unique_ptr<AudioSink>& sink = sinks_[index];
+    if (!sink) {
+        sink.reset(new AudioSink(FORMATS[index].sampleRate, FORMATS[index].channelCount));
+    }
+    if (!sink->isRunning()) {
+        if (failed_[index]) {
+            return false;
+        }
+        if (!sink->start()) {
+            failed_[index] = true;
+            return false;
+        }
+    }
+    sink->write(data + MEDIA_HEADER_SIZE, length - MEDIA_HEADER_SIZE);
+    if (clock_) {
+        updateClock(index, readBe64(data + 2), length - MEDIA_HEADER_SIZE);
+    }
+    return true;
+}
+
+// Requires mutex_
+bool AudioOutput::startMixed(int index) {
+    active_[index] = true;
+    if (!mixSink_->isRunning()) {
+        if (mixFailed_) {
+            return false;
+        }
+        if (!mixSink_->start()) {
+            mixFailed_ = true;
+            return false;
+        }
+    }
+    mixSink_->recover();
+    return true;
+}
+
+// Requires mutex_
+bool AudioOutput::isPlaying(int index) const {
+    if (mixer_) {
+        return mixSink_->isRunning() && mixer_->isPlaying(static_cast<size_t>(index));
+    }
+    return sinks_[index] && sinks_[index]->isPlaying();
+}
+
+bool AudioOutput::setGain(int channel, float gain) {
+    const int index = indexOf(channel);
+    if (!mixer_ || index < 0) {
+        return false;
+    }
+    mixer_->setGain(static_cast<size_t>(index), gain);
+    return true;
+}
+
+void AudioOutput::setClock(MediaClock* clock) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (clock_ && clockIndex_ >= 0) {
+        clock_->resetAudio();
+    }
+    clock_ = clock;
+    clockIndex_ = -1;
+}
+
+// Requires mutex_
+void AudioOutput::updateClock(int index, uint64_t timestampUs, size_t pcmLength) {
+    for (int i = 0; i < index; i++) {
+        if (isPlaying(i)) {
+            return;  // A higher priority channel is the master
+        }
+    }
+
+    const ChannelFormat& format = FORMATS[index];
+    const uint64_t frames = pcmLength / (static_cast<size_t>(format.channelCount) * sizeof(int16_t));
+    const uint64_t endUs = timestampUs + frames * 1000000ULL / static_cast<uint64_t>(format.sampleRate);
+    uint64_t mediaUs = 0;
+    int64_t atNs = 0;
+    if (mixer_) {
+        if (!isPlaying(index)) {
+            return;
+        }
+        // As AudioSink::getPresentation(), interpolation adds under one input frame
+        const uint64_t queuedUs = static_cast<uint64_t>(mixer_->queuedFrames(static_cast<size_t>(index))) *
+                                  1000000ULL / static_cast<uint64_t>(format.sampleRate);
+        mediaUs = endUs > queuedUs ? endUs - queuedUs : 0;
+        atNs = mixSink_->nextFrameHeardNs();
+    } else if (!sinks_[index]->getPresentation(endUs, mediaUs, atNs)) {
+        return;
+    }
+    if (clockIndex_ != index) {
+        LOGD("Channel %d drives the media clock", format.channel);
+        clock_->resetAudio();
+        clockIndex_ = index;
+    }
+    clock_->updateAudio(mediaUs, atNs);
+}
+
+// Requires mutex_
+void AudioOutput::releaseClock(int index) {
+    if (clock_ && clockIndex_ == index) {
+        clock_->resetAudio();
+        clockIndex_ = -1;
+    }
+}
+
+void AudioOutput::stop(int channel) {
+    const int index = indexOf(channel);
+    if (index < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    failed_[index] = false;
+    releaseClock(index);
+    if (sinks_[index]) {
+        sinks_[index]->stop();
+    }
+    if (mixer_) {
+        active_[index] = false;
+        mixFailed_ = false;
+        if (std::none_of(active_, active_ + CHANNELS, [](bool active) { return active; })) {
+            // No callback runs once the stream is stopped, the mixer has no consumer
+            mixSink_->stop();
+            mixer_->clear();
+        }
+    }
+}
+
+void AudioOutput::stopAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < CHANNELS; i++) {
+        failed_[i] = false;
+        releaseClock(static_cast<int>(i));
+        if (sinks_[i]) sinks_[i]->stop();
+        active_[i] = false;
+    }
+    if (mixer_) {
+        mixFailed_ = false;
+        mixSink_->stop();
+        mixer_->clear();
+    }
+}
+
+bool AudioOutput::getStats(int channel, AudioSink::Stats& stats, AudioSink::Backend& backend) const {
+    const int index = indexOf(channel);
+    if (index < 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (mixer_) {
+        // The channel's own buffer and counters, the stream is shared
+        const AudioSink::Stats mix = mixSink_->getStats();
+        const AudioMixer::InputStats input = mixer_->getStats(static_cast<size_t>(index));
+        stats = mix;
+        stats.bytesWritten = input.bytesWritten;
+        stats.bytesDropped = input.bytesDropped;
+        stats.framesPlayed = input.framesPlayed;
+        stats.jitter = input.jitter;
+        stats.underruns = input.jitter.underruns;
+        backend = mixSink_->backend();
+        return input.bytesWritten > 0;
+    }
+    if (!sinks_[index]) {
+        return false;
+    }
+    stats = sinks_[index]->getStats();
+    backend = sinks_[index]->backend();
+    return true;
+}
+
+} // namespace aap
@@ -0,0 +1,103 @@
+#pragma once
+
+#include "audio_mixer.h"
+#include "audio_sink.h"
+#include "media_clock.h"
+#include <memory>
+#include <mutex>
+
+namespace aap {
+
+/**
+ * Native audio stage: plays the PCM of the AAP audio channels (ID_AUD,
+ * ID_AU1, ID_AU2), each through its own AudioSink, in place of
+ * AudioDecoder and AudioTrackWrapper.
+ *
+ * process() is called from the dispatcher's AAP-Audio thread. Streams
+ * are opened on the first media record of a channel and closed by
+ * stop() when the phone stops that channel.
+ *
+ * Mixed, the channels go through an AudioMixer into a single 48 kHz
+ * stereo stream instead, open while any channel is, with media ducked
+ * natively under guidance (ID_AU1).
+ *
+ * With a MediaClock set, the first channel playing (media, then speech,
+ * then system) reports its presentation position to it every record, so
+ * video can be scheduled against what is being heard.
+ */
+class AudioOutput {
+public:
+    /**
+     * @param mixed Mix all channels into one stream
+     */
+    explicit AudioOutput(bool mixed = false);
+
+    // Non-copyable
+    AudioOutput(const AudioOutput&) = delete;
+    AudioOutput& operator=(const AudioOutput&) = delete;
+
+    /**
+     * Check if a decrypted audio channel record carries PCM, the records
+     * AapAudio.process() used to handle.
+     */
+    static bool isMediaRecord(int channel, const uint8_t* data, size_t length);
+
+    /**
+     * Drive clock from the playing audio, nullptr to stop.
+     */
+    void setClock(MediaClock* clock);
+
+    /**
+     * Queue the PCM of one media record for playback.
+     * @return false if the channel has no output
+     */
+    bool process(int channel, const uint8_t* data, size_t length);
+
+    /**
+     * Close the stream of one channel, reopened by the next media record.
+     */
+    void stop(int channel);
+    void stopAll();
+
+    /**
+     * @return false if the channel has not played yet
+     */
+    bool getStats(int channel, AudioSink::Stats& stats, AudioSink::Backend& backend) const;
+
+    /**
+     * Linear volume of one channel, mixed only.
+     * @return false if not mixed or no such channel
+     */
+    bool setGain(int channel, float gain);
+
+    bool isMixed() const { return mixer_ != nullptr; }
+
+    /**
+     * Times media was ducked under guidance, 0 if not mixed.
+     */
+    uint64_t ducks() const { return mixer_ ? mixer_->ducks() : 0; }
+
+private:
+    static constexpr size_t CHANNELS = 3;
+
+    // Sinks are created once per channel, streams come and go
+    mutable std::mutex mutex_;
+    std::unique_ptr<AudioSink> sinks_[CHANNELS];
+    bool failed_[CHANNELS] = {};    // No retry until stop(), start() logs why
+    MediaClock* clock_ = nullptr;
+    int clockIndex_ = -1;           // Channel reporting to clock_
+
+    // Mixed: one stream pulls from the mixer while any channel is active
+    std::unique_ptr<AudioMixer> mixer_;
+    std::unique_ptr<AudioSink> mixSink_;
+    bool active_[CHANNELS] = {};
+    bool mixFailed_ = false;
+
+    static int indexOf(int channel);
+    bool startMixed(int index);
+    bool isPlaying(int index) const;
+    void updateClock(int index, uint64_t timestampUs, size_t pcmLength);
+    void releaseClock(int index);
+};
+
+} // namespace aap
@@ -0,0 +1,323 @@
+#include "audio_sink.h"
+#include "aaudio_api.h"
+#include <android/log.h>
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+#include <algorithm>
+#include <memory>
+#include <time.h>
+
+#define LOG_TAG "AudioSink"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+constexpr int OPENSL_BUFFERS = 2;
+
+int64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+// One OpenSL ES engine per process, never destroyed
+SLEngineItf openSlEngine() {
+    static const SLEngineItf engine = []() -> SLEngineItf {
+        SLObjectItf object = nullptr;
+        if (slCreateEngine(&object, 0, nullptr, 0, nullptr, nullptr) != SL_RESULT_SUCCESS ||
+            (*object)->Realize(object, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS) {
+            LOGE("Failed to create OpenSL ES engine");
+            return nullptr;
+        }
+        SLEngineItf itf = nullptr;
+        if ((*object)->GetInterface(object, SL_IID_ENGINE, &itf) != SL_RESULT_SUCCESS) {
+            return nullptr;
+        }
+        return itf;
+    }();
+    return engine;
+}
+
+} // anonymous namespace
+
+struct AudioSink::OpenSl {
+    SLObjectItf outputMix = nullptr;
+    SLObjectItf player = nullptr;
+    SLPlayItf play = nullptr;
+    SLAndroidSimpleBufferQueueItf queue = nullptr;
+    std::unique_ptr<uint8_t[]> buffers;
+    size_t bufferBytes = 0;
+    int next = 0;
+};
+
+AudioSink::AudioSink(int sampleRate, int channelCount, RenderFn source, void* context)
+    : sampleRate_(sampleRate)
+    , channelCount_(channelCount)
+    , frameBytes_(static_cast<size_t>(channelCount) * sizeof(int16_t))
+    , source_(source)
+    , sourceContext_(context)
+    , jitter_(sampleRate, channelCount)
+{
+}
+
+AudioSink::~AudioSink() {
+    stop();
+}
+
+bool AudioSink::start() {
+    if (backend_ != Backend::NONE) {
+        return true;
+    }
+    if (startAAudio()) {
+        backend_ = Backend::AAUDIO;
+    } else if (startOpenSl()) {
+        backend_ = Backend::OPENSL;
+    } else {
+        LOGE("No audio output for %d Hz x%d", sampleRate_, channelCount_);
+        return false;
+    }
+    LOGI("Audio output started: %d Hz x%d, %s, burst %d frames, buffer %d frames",
+         sampleRate_, channelCount_, backend_ == Backend::AAUDIO ? "AAudio" : "OpenSL ES",
+         framesPerBurst_, bufferFrames_);
+    return true;
+}
+
+void AudioSink::stop() {
+    if (backend_ == Backend::AAUDIO) {
+        stopAAudio();
+    } else if (backend_ == Backend::OPENSL) {
+        stopOpenSl();
+    }
+    if (backend_ != Backend::NONE) {
+        LOGI("Audio output stopped: %d Hz x%d", sampleRate_, channelCount_);
+    }
+    backend_ = Backend::NONE;
+    // No callback runs any more, the jitter buffer has no consumer
+    jitter_.clear();
+}
+
+void AudioSink::recover() {
+    if (disconnected_.load(std::memory_order_acquire)) {
+        // Device route changed: reopen on the new output, not from the callback
+        LOGI("Audio stream disconnected, reopening");
+        stop();
+        disconnected_.store(false, std::memory_order_relaxed);
+        start();
+    }
+}
+
+size_t AudioSink::write(const uint8_t* pcm, size_t length) {
+    recover();
+
+    const size_t written = jitter_.write(pcm, length);
+    if (written < length) {
+        bytesDropped_.fetch_add(length - written, std::memory_order_relaxed);
+    }
+    bytesWritten_.fetch_add(written, std::memory_order_relaxed);
+    return written;
+}
+
+int64_t AudioSink::nextFrameHeardNs() const {
+    int64_t heardNs = nowNs() + static_cast<int64_t>(bufferFrames_) * 1000000000LL / sampleRate_;
+    const AAudioApi& api = aaudioApi();
+    if (backend_ == Backend::AAUDIO && api.getTimestamp && api.getFramesWritten) {
+        int64_t position = 0;
+        int64_t timeNs = 0;
+        // Fails until the first frames reached the device
+        if (api.getTimestamp(stream_, CLOCK_MONOTONIC, &position, &timeNs) == AAUDIO_OK) {
+            const int64_t written = api.getFramesWritten(stream_);
+            heardNs = timeNs + (written - position) * 1000000000LL / sampleRate_;
+        }
+    }
+    return heardNs;
+}
+
+bool AudioSink::getPresentation(uint64_t endUs, uint64_t& mediaUs, int64_t& atNs) const {
+    if (!isPlaying()) {
+        return false;
+    }
+
+    // Queued PCM plays before the frame at endUs
+    const uint64_t queuedUs = static_cast<uint64_t>(jitter_.queuedFrames()) * 1000000ULL / sampleRate_;
+    mediaUs = endUs > queuedUs ? endUs - queuedUs : 0;
+    atNs = nextFrameHeardNs();
+    return true;
+}
+
+void AudioSink::render(uint8_t* out, size_t length) {
+    // Output buffers are 16-bit PCM, aligned for int16_t
+    if (source_) {
+        source_(sourceContext_, reinterpret_cast<int16_t*>(out), length / frameBytes_);
+        framesPlayed_.fetch_add(length / frameBytes_, std::memory_order_relaxed);
+        return;
+    }
+    const size_t played = jitter_.read(reinterpret_cast<int16_t*>(out), length / frameBytes_);
+    framesPlayed_.fetch_add(played, std::memory_order_relaxed);
+}
+
+bool AudioSink::startAAudio() {
+    const AAudioApi& api = aaudioApi();
+    if (!api.available) {
+        return false;
+    }
+
+    AAudioStreamBuilder* builder = nullptr;
+    if (api.createStreamBuilder(&builder) != AAUDIO_OK) {
+        return false;
+    }
+    api.setFormat(builder, AAUDIO_FORMAT_PCM_I16);
+    api.setChannelCount(builder, channelCount_);
+    api.setSampleRate(builder, sampleRate_);
+    api.setPerformanceMode(builder, AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
+    // Falls back to shared mode if an exclusive stream isn't available
+    api.setSharingMode(builder, AAUDIO_SHARING_MODE_EXCLUSIVE);
+    api.setDataCallback(builder, &AudioSink::onAAudioData, this);
+    api.setErrorCallback(builder, &AudioSink::onAAudioError, this);
+
+    AAudioStream* stream = nullptr;
+    const aaudio_result_t result = api.openStream(builder, &stream);
+    api.deleteBuilder(builder);
+    if (result != AAUDIO_OK) {
+        LOGE("AAudio openStream failed (%d)", result);
+        return false;
+    }
+
+    // Two bursts: the smallest buffer that rides out one late callback
+    framesPerBurst_ = api.getFramesPerBurst(stream);
+    bufferFrames_ = framesPerBurst_ * 2;
+    api.setBufferSizeInFrames(stream, bufferFrames_);
+
+    if (api.requestStart(stream) != AAUDIO_OK) {
+        LOGE("AAudio requestStart failed");
+        api.close(stream);
+        return false;
+    }
+    LOGD("AAudio stream open, %s mode",
+         api.getSharingMode(stream) == AAUDIO_SHARING_MODE_EXCLUSIVE ? "exclusive" : "shared");
+    stream_ = stream;
+    return true;
+}
+
+void AudioSink::stopAAudio() {
+    if (!stream_) {
+        return;
+    }
+    const AAudioApi& api = aaudioApi();
+    api.requestStop(stream_);
+    // Waits for a callback in progress
+    api.close(stream_);
+    stream_ = nullptr;
+}
+
+aaudio_data_callback_result_t AudioSink::onAAudioData(AAudioStream* stream, void* userData,
+                                                      void* audioData, int32_t numFrames) {
+    auto* self = static_cast<AudioSink*>(userData);
+    self->render(static_cast<uint8_t*>(audioData), static_cast<size_t>(numFrames) * self->frameBytes_);
+    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
+
+void AudioSink::onAAudioError(AAudioStream* stream, void* userData, aaudio_result_t error) {
+    LOGE("AAudio stream error (%d)", error);
+    // The stream can't be closed from its own callback thread
+    static_cast<AudioSink*>(userData)->disconnected_.store(true, std::memory_order_release);
+}
+
+bool AudioSink::startOpenSl() {
+    SLEngineItf engine = openSlEngine();
+    if (!engine) {
+        return false;
+    }
+
+    std::unique_ptr<OpenSl> sl(new OpenSl());
+    if ((*engine)->CreateOutputMix(engine, &sl->outputMix, 0, nullptr, nullptr) != SL_RESULT_SUCCESS ||
+        (*sl->outputMix)->Realize(sl->outputMix, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS) {
+        LOGE("OpenSL ES output mix failed");
+        if (sl->outputMix) (*sl->outputMix)->Destroy(sl->outputMix);
+        return false;
+    }
+
+    SLDataLocator_AndroidSimpleBufferQueue queueLocator = {
+        SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, OPENSL_BUFFERS
+    };
+    SLDataFormat_PCM format = {
+        SL_DATAFORMAT_PCM,
+        static_cast<SLuint32>(channelCount_),
+        static_cast<SLuint32>(sampleRate_) * 1000,  // milliHertz
+        SL_PCMSAMPLEFORMAT_FIXED_16,
+        SL_PCMSAMPLEFORMAT_FIXED_16,
+        channelCount_ == 2 ? SLuint32{SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT} : SLuint32{SL_SPEAKER_FRONT_CENTER},
+        SL_BYTEORDER_LITTLEENDIAN
+    };
+    SLDataSource source = {&queueLocator, &format};
+    SLDataLocator_OutputMix mixLocator = {SL_DATALOCATOR_OUTPUTMIX, sl->outputMix};
+    SLDataSink sink = {&mixLocator, nullptr};
+
+    const SLInterfaceID ids[] = {SL_IID_ANDROIDSIMPLEBUFFERQUEUE};
+    const SLboolean required[] = {SL_BOOLEAN_TRUE};
+    const bool created =
+        (*engine)->CreateAudioPlayer(engine, &sl->player, &source, &sink, 1, ids, required) == SL_RESULT_SUCCESS &&
+        (*sl->player)->Realize(sl->player, SL_BOOLEAN_FALSE) == SL_RESULT_SUCCESS &&
+        (*sl->player)->GetInterface(sl->player, SL_IID_PLAY, &sl->play) == SL_RESULT_SUCCESS &&
+        (*sl->player)->GetInterface(sl->player, SL_IID_ANDROIDSIMPLEBUFFERQUEUE, &sl->queue) == SL_RESULT_SUCCESS;
+    if (!created) {
+        LOGE("OpenSL ES player failed");
+        if (sl->player) (*sl->player)->Destroy(sl->player);
+        (*sl->outputMix)->Destroy(sl->outputMix);
+        return false;
+    }
+
+    framesPerBurst_ = sampleRate_ * OPENSL_BUFFER_MS / 1000;
+    bufferFrames_ = framesPerBurst_ * OPENSL_BUFFERS;
+    sl->bufferBytes = static_cast<size_t>(framesPerBurst_) * frameBytes_;
+    sl->buffers.reset(new uint8_t[sl->bufferBytes * OPENSL_BUFFERS]);
+    openSl_ = sl.release();
+
+    (*openSl_->queue)->RegisterCallback(openSl_->queue, [](SLAndroidSimpleBufferQueueItf, void* context) {
+        static_cast<AudioSink*>(context)->enqueueOpenSlBuffer();
+    }, this);
+
+    // Prime the queue, each completed buffer is refilled from the callback
+    for (int i = 0; i < OPENSL_BUFFERS; i++) {
+        enqueueOpenSlBuffer();
+    }
+    (*openSl_->play)->SetPlayState(openSl_->play, SL_PLAYSTATE_PLAYING);
+    return true;
+}
+
+void AudioSink::enqueueOpenSlBuffer() {
+    OpenSl& sl = *openSl_;
+    uint8_t* buffer = sl.buffers.get() + sl.next * sl.bufferBytes;
+    sl.next = (sl.next + 1) % OPENSL_BUFFERS;
+    render(buffer, sl.bufferBytes);
+    (*sl.queue)->Enqueue(sl.queue, buffer, static_cast<SLuint32>(sl.bufferBytes));
+}
+
+void AudioSink::stopOpenSl() {
+    if (!openSl_) {
+        return;
+    }
+    (*openSl_->play)->SetPlayState(openSl_->play, SL_PLAYSTATE_STOPPED);
+    // Destroy waits for a callback in progress
+    (*openSl_->player)->Destroy(openSl_->player);
+    (*openSl_->outputMix)->Destroy(openSl_->outputMix);
+    delete openSl_;
+    openSl_ = nullptr;
+}
+
+AudioSink::Stats AudioSink::getStats() const {
+    Stats stats;
+    stats.bytesWritten = bytesWritten_.load(std::memory_order_relaxed);
+    stats.bytesDropped = bytesDropped_.load(std::memory_order_relaxed);
+    stats.jitter = jitter_.getStats();
+    stats.underruns = stats.jitter.underruns;
+    stats.framesPlayed = framesPlayed_.load(std::memory_order_relaxed);
+    stats.framesPerBurst = framesPerBurst_;
+    stats.bufferFrames = bufferFrames_;
+    return stats;
+}
+
+} // namespace aap
@@ -0,0 +1,139 @@
+#pragma once
+
+#include "audio_jitter_buffer.h"
+#include <aaudio/AAudio.h>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace aap {
+
+/**
+ * Native PCM output for one AAP audio channel.
+ *
+ * 16-bit PCM is written into an AudioJitterBuffer sized up front and
+ * pulled from the output callback, so the producer never blocks and no
+ * sample touches the Java heap. Plays through AAudio in low latency,
+ * exclusive mode on API 28+, OpenSL ES with a simple buffer queue before
+ * (the 8.x AAudio releases had callback and disconnect issues).
+ *
+ * write() is called from a single producer (AAP-Audio); start()/stop()
+ * must not race with it.
+ *
+ * Given a render function instead, the callback pulls its PCM from that
+ * (the AudioMixer) and the jitter buffer and write() go unused.
+ */
+class AudioSink {
+public:
+    enum class Backend {
+        NONE,
+        AAUDIO,
+        OPENSL
+    };
+
+    static constexpr int OPENSL_BUFFER_MS = 10;
+
+    // Fills frames of interleaved 16-bit PCM, from the output callback
+    using RenderFn = void (*)(void* context, int16_t* out, size_t frames);
+
+    AudioSink(int sampleRate, int channelCount, RenderFn source = nullptr, void* context = nullptr);
+    ~AudioSink();
+
+    // Non-copyable
+    AudioSink(const AudioSink&) = delete;
+    AudioSink& operator=(const AudioSink&) = delete;
+
+    /**
+     * Open and start the output stream, AAudio first.
+     * @return false if neither backend could be started
+     */
+    bool start();
+    void stop();
+
+    bool isRunning() const { return backend_ != Backend::NONE; }
+    Backend backend() const { return backend_; }
+
+    /**
+     * Check if queued PCM is being played, not buffered or stopped.
+     */
+    bool isPlaying() const { return isRunning() && jitter_.isPlaying(); }
+
+    /**
+     * Queue PCM for playback, reopening the stream after a disconnect.
+     * @return Bytes queued, the rest was dropped because the ring is full
+     */
+    size_t write(const uint8_t* pcm, size_t length);
+
+    /**
+     * Reopen the stream if its device went away. write() does this itself,
+     * a render function's producer calls it instead.
+     */
+    void recover();
+
+    /**
+     * When the next frame the callback renders will be heard, CLOCK_MONOTONIC.
+     * From the AAudio presentation timestamp where available, else
+     * estimated from the output buffer size.
+     */
+    int64_t nextFrameHeardNs() const;
+
+    /**
+     * Which media time is being heard, for A/V sync, see nextFrameHeardNs().
+     * Off by up to one burst, the callback may run while it is worked out.
+     * Producer thread only.
+     * @param endUs Media time at the end of the PCM written so far
+     * @param mediaUs Media time heard at atNs
+     * @param atNs CLOCK_MONOTONIC
+     * @return false while not playing
+     */
+    bool getPresentation(uint64_t endUs, uint64_t& mediaUs, int64_t& atNs) const;
+
+    struct Stats {
+        uint64_t bytesWritten;
+        uint64_t bytesDropped;      // Jitter buffer full, output is behind
+        uint64_t underruns;         // Jitter buffer ran dry while playing
+        uint64_t framesPlayed;
+        int32_t framesPerBurst;
+        int32_t bufferFrames;       // Output buffer size, excluding the jitter buffer
+        AudioJitterBuffer::Stats jitter;
+    };
+    Stats getStats() const;
+
+private:
+    const int sampleRate_;
+    const int channelCount_;
+    const size_t frameBytes_;
+    const RenderFn source_;
+    void* const sourceContext_;
+    AudioJitterBuffer jitter_;
+    Backend backend_ = Backend::NONE;
+
+    // AAudio
+    AAudioStream* stream_ = nullptr;
+    std::atomic<bool> disconnected_{false};
+
+    // OpenSL ES
+    struct OpenSl;
+    OpenSl* openSl_ = nullptr;
+
+    std::atomic<uint64_t> bytesWritten_{0};
+    std::atomic<uint64_t> bytesDropped_{0};
+    std::atomic<uint64_t> framesPlayed_{0};
+    int32_t framesPerBurst_ = 0;
+    int32_t bufferFrames_ = 0;
+
+    bool startAAudio();
+    void stopAAudio();
+    bool startOpenSl();
+    void stopOpenSl();
+
+    // Output callback: fill from the jitter buffer, pad with silence
+    void render(uint8_t* out, size_t length);
+    void enqueueOpenSlBuffer();
+
+    static aaudio_data_callback_result_t onAAudioData(AAudioStream* stream, void* userData,
+                                                      void* audioData, int32_t numFrames);
+    static void onAAudioError(AAudioStream* stream, void* userData, aaudio_result_t error);
+};
+
+} // namespace aap
@@ -0,0 +1,138 @@
+#include "audio_dsp.h"
+#include "audio_mixer.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+using aap::AudioDsp;
+
+// One output callback's worth, and a long block to show the steady rate
+void blockArgs(benchmark::internal::Benchmark* b) {
+    b->ArgName("frames")->Arg(192)->Arg(4096);
+}
+
+std::vector<float> sine(size_t samples) {
+    std::vector<float> out(samples);
+    for (size_t i = 0; i < samples; i++) {
+        out[i] = 0.5f * std::sin(static_cast<float>(i) * 0.05f);
+    }
+    return out;
+}
+
+const char* label() {
+    return AudioDsp::isSimdAccelerated() ? "simd" : "scalar";
+}
+
+void setSamplesProcessed(benchmark::State& state, size_t samples) {
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(samples));
+    state.SetLabel(label());
+}
+
+void BM_PcmToFloat(benchmark::State& state) {
+    const size_t samples = static_cast<size_t>(state.range(0)) * 2;
+    std::vector<int16_t> in(samples, 1234);
+    std::vector<float> out(samples);
+    for (auto _ : state) {
+        AudioDsp::pcmToFloat(in.data(), out.data(), samples);
+        benchmark::ClobberMemory();
+    }
+    setSamplesProcessed(state, samples);
+}
+BENCHMARK(BM_PcmToFloat)->Apply(blockArgs);
+
+void BM_FloatToPcm(benchmark::State& state) {
+    const size_t samples = static_cast<size_t>(state.range(0)) * 2;
+    const std::vector<float> in = sine(samples);
+    std::vector<int16_t> out(samples);
+    for (auto _ : state) {
+        AudioDsp::floatToPcm(in.data(), out.data(), samples);
+        benchmark::ClobberMemory();
+    }
+    setSamplesProcessed(state, samples);
+}
+BENCHMARK(BM_FloatToPcm)->Apply(blockArgs);
+
+void BM_MixWithGainRamp(benchmark::State& state) {
+    const size_t samples = static_cast<size_t>(state.range(0)) * 2;
+    const std::vector<float> in = sine(samples);
+    std::vector<float> acc(samples);
+    for (auto _ : state) {
+        AudioDsp::mixWithGainRamp(acc.data(), in.data(), samples, 1.0f, -0.5f / static_cast<float>(samples));
+        benchmark::ClobberMemory();
+    }
+    setSamplesProcessed(state, samples);
+}
+BENCHMARK(BM_MixWithGainRamp)->Apply(blockArgs);
+
+void BM_MonoToStereo(benchmark::State& state) {
+    const size_t frames = static_cast<size_t>(state.range(0));
+    const std::vector<float> in = sine(frames);
+    std::vector<float> out(frames * 2);
+    for (auto _ : state) {
+        AudioDsp::monoToStereo(in.data(), out.data(), frames);
+        benchmark::ClobberMemory();
+    }
+    setSamplesProcessed(state, frames * 2);
+}
+BENCHMARK(BM_MonoToStereo)->Apply(blockArgs);
+
+void BM_StereoToMono(benchmark::State& state) {
+    const size_t frames = static_cast<size_t>(state.range(0));
+    const std::vector<float> in = sine(frames * 2);
+    std::vector<float> out(frames);
+    for (auto _ : state) {
+        AudioDsp::stereoToMono(in.data(), out.data(), frames);
+        benchmark::ClobberMemory();
+    }
+    setSamplesProcessed(state, frames * 2);
+}
+BENCHMARK(BM_StereoToMono)->Apply(blockArgs);
+
+// Drift correction (0.5% fast), guidance upsampling and mic downsampling
+void resampleArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"channels", "ratio_permille"});
+    b->Args({2, 1005});
+    b->Args({1, 333});
+    b->Args({1, 3000});
+}
+
+void BM_ResampleLinear(benchmark::State& state) {
+    const size_t channels = static_cast<size_t>(state.range(0));
+    const double ratio = static_cast<double>(state.range(1)) / 1000.0;
+    const size_t frames = 256;
+    aap::LinearResampler resampler(channels, frames, ratio);
+    resampler.setRatio(ratio);
+    const std::vector<float> in = sine(static_cast<size_t>(frames * ratio + 4) * channels);
+    std::vector<float> out(frames * channels);
+    for (auto _ : state) {
+        const size_t needed = resampler.inputFrames(frames);
+        std::copy(in.begin(), in.begin() + static_cast<std::ptrdiff_t>(needed * channels), resampler.input());
+        resampler.process(out.data(), frames);
+        benchmark::ClobberMemory();
+    }
+    setSamplesProcessed(state, frames * channels);
+}
+BENCHMARK(BM_ResampleLinear)->Apply(resampleArgs);
+
+// The whole mixed output callback: stereo media plus mono guidance, ducking
+void BM_AudioMixerRender(benchmark::State& state) {
+    const aap::AudioMixer::InputFormat formats[] = {{48000, 2}, {16000, 1}};
+    aap::AudioMixer mixer(formats, 2, 0, 1);
+    const size_t frames = 192;
+    std::vector<int16_t> media(frames * 2, 1000);
+    std::vector<int16_t> guidance(frames / 3, -1000);
+    std::vector<int16_t> out(frames * 2);
+    for (auto _ : state) {
+        mixer.write(0, reinterpret_cast<const uint8_t*>(media.data()), media.size() * sizeof(int16_t));
+        mixer.write(1, reinterpret_cast<const uint8_t*>(guidance.data()), guidance.size() * sizeof(int16_t));
+        mixer.render(out.data(), frames);
+        benchmark::ClobberMemory();
+    }
+    setSamplesProcessed(state, frames * 2);
+}
+BENCHMARK(BM_AudioMixerRender);
+
+} // anonymous namespace
@@ -0,0 +1,95 @@
+#include "channel_dispatcher.h"
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+int channelArg(const benchmark::State& state) {
+    switch (static_cast<aap::ChannelPriority>(state.range(0))) {
+        case aap::ChannelPriority::HIGH: return aap::Channel::ID_AUD;
+        case aap::ChannelPriority::MEDIUM: return aap::Channel::ID_VID;
+        case aap::ChannelPriority::BACKGROUND: return aap::Channel::ID_NAV;
+        default: return aap::Channel::ID_CTR;
+    }
+}
+
+void dispatcherArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"priority", "length"});
+    for (int priority : {0, 1, 2, 3}) {
+        for (int length : {64, 3840, 16384}) {
+            b->Args({priority, length});
+        }
+    }
+}
+
+// dispatch() on this thread to the callback on the priority's thread,
+// one record in flight at a time
+void BM_DispatchLatency(benchmark::State& state) {
+    const int channel = channelArg(state);
+    const size_t length = static_cast<size_t>(state.range(1));
+    std::vector<uint8_t> payload(length, 0x11);
+
+    std::atomic<uint64_t> delivered{0};
+    auto callback = [&delivered](int, uint8_t, const uint8_t*, size_t) {
+        delivered.fetch_add(1, std::memory_order_release);
+    };
+    aap::ChannelDispatcher dispatcher;
+    dispatcher.setAudioCallback(callback);
+    dispatcher.setVideoCallback(callback);
+    dispatcher.setControlCallback(callback);
+    dispatcher.setBackgroundCallback(callback);
+    dispatcher.start();
+
+    uint64_t expected = 0;
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        dispatcher.dispatch(channel, 0x0b, payload.data(), length);
+        expected++;
+        while (delivered.load(std::memory_order_acquire) != expected) {
+        }
+        state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    dispatcher.stop();
+}
+BENCHMARK(BM_DispatchLatency)->Apply(dispatcherArgs)->UseManualTime();
+
+// Sustained rate with a few records in flight, so the queue never drops
+void BM_DispatchThroughput(benchmark::State& state) {
+    constexpr uint64_t IN_FLIGHT = 16;
+    const int channel = channelArg(state);
+    const size_t length = static_cast<size_t>(state.range(1));
+    std::vector<uint8_t> payload(length, 0x11);
+
+    std::atomic<uint64_t> delivered{0};
+    auto callback = [&delivered](int, uint8_t, const uint8_t*, size_t) {
+        delivered.fetch_add(1, std::memory_order_release);
+    };
+    aap::ChannelDispatcher dispatcher;
+    dispatcher.setAudioCallback(callback);
+    dispatcher.setVideoCallback(callback);
+    dispatcher.setControlCallback(callback);
+    dispatcher.setBackgroundCallback(callback);
+    dispatcher.start();
+
+    uint64_t dispatched = 0;
+    for (auto _ : state) {
+        while (dispatched - delivered.load(std::memory_order_acquire) >= IN_FLIGHT) {
+        }
+        dispatcher.dispatch(channel, 0x0b, payload.data(), length);
+        dispatched++;
+    }
+    while (delivered.load(std::memory_order_acquire) != dispatched) {
+    }
+    dispatcher.stop();
+
+    const aap::ChannelDispatcher::Stats stats = dispatcher.getStats();
+    const aap::ChannelDispatcher::QueueStats* queues[] = {&stats.audio, &stats.video, &stats.control, &stats.background};
+    const aap::ChannelDispatcher::QueueStats& queue = *queues[static_cast<int>(aap::getChannelPriority(channel))];
+    state.counters["drops"] = static_cast<double>(queue.queueDrops);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(length));
+}
+BENCHMARK(BM_DispatchThroughput)->Apply(dispatcherArgs);
+
+} // anonymous namespace
@@ -0,0 +1,52 @@
+#include "bench_session.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+
+/**
+ * Host benchmarks of the native hot path.
+ *
+ * Google Benchmark flags apply, e.g. --benchmark_format=json or
+ * --benchmark_out=results.json for machine-readable results. Recorded
+ * input is picked up from the environment:
+ *   AAP_BENCH_CAPTURE  SessionCapture file (NativeUsb.startCapture)
+ *   AAP_BENCH_H264     Raw Annex-B H.264 stream
+ */
+int main(int argc, char** argv) {
+    using namespace aap::bench;
+
+    static Session capture;
+    static std::string capturePath = env("AAP_BENCH_CAPTURE");
+    if (!capturePath.empty()) {
+        if (loadCapture(capturePath, capture)) {
+            benchmark::RegisterBenchmark("BM_FramerSession/capture", BM_FramerSession, &capture)
+                ->Unit(benchmark::kMillisecond);
+            benchmark::RegisterBenchmark("BM_FramerSessionInlined/capture", BM_FramerSessionInlined, &capture)
+                ->Unit(benchmark::kMillisecond);
+            benchmark::RegisterBenchmark("BM_ReplaySession/capture", BM_ReplaySession, &capturePath)
+                ->Unit(benchmark::kMillisecond)->UseRealTime();
+        } else {
+            std::fprintf(stderr, "%s is not a session capture\n", capturePath.c_str());
+            return 1;
+        }
+    }
+
+    static std::vector<std::vector<uint8_t>> stream;
+    const std::string streamPath = env("AAP_BENCH_H264");
+    if (!streamPath.empty()) {
+        if (loadAnnexB(streamPath, stream)) {
+            benchmark::RegisterBenchmark("BM_NalScanStream/recorded", BM_NalScanStream, &stream);
+        } else {
+            std::fprintf(stderr, "Cannot read %s\n", streamPath.c_str());
+            return 1;
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::AddCustomContext("capture", capturePath.empty() ? "synthetic" : capturePath);
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "bench_session.h"
+#include "nal_scanner.h"
+#include <benchmark/benchmark.h>
+
+namespace aap {
+namespace bench {
+
+namespace {
+
+const std::vector<std::vector<uint8_t>>& syntheticStream() {
+    static const std::vector<std::vector<uint8_t>> frames = syntheticH264(60, 30000);
+    return frames;
+}
+
+} // anonymous namespace
+
+/**
+ * Every NAL unit of every access unit, as NalScanner::scan() reports them.
+ */
+void BM_NalScanStream(benchmark::State& state, const std::vector<std::vector<uint8_t>>* frames) {
+    if (!frames) {
+        frames = &syntheticStream();
+    }
+    size_t bytes = 0;
+    for (const std::vector<uint8_t>& frame : *frames) {
+        bytes += frame.size();
+    }
+
+    NalUnit units[64];
+    uint64_t found = 0;
+    for (auto _ : state) {
+        for (const std::vector<uint8_t>& frame : *frames) {
+            found += NalScanner::scan(frame.data(), frame.size(), VideoCodec::H264, units, 64);
+        }
+    }
+    benchmark::DoNotOptimize(found);
+    state.SetLabel(NalScanner::isSimdAccelerated() ? "simd" : "scalar");
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(bytes));
+}
+BENCHMARK_CAPTURE(BM_NalScanStream, synthetic, nullptr);
+
+namespace {
+
+// The search alone over slice-like data, no start code until the end
+void BM_FindStartCode(benchmark::State& state) {
+    const std::vector<uint8_t> frame = syntheticH264(2, static_cast<size_t>(state.range(0)))[1];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(NalScanner::findStartCode(frame.data(), 4, frame.size()));
+    }
+    state.SetLabel(NalScanner::isSimdAccelerated() ? "simd" : "scalar");
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(frame.size() - 4));
+}
+BENCHMARK(BM_FindStartCode)->Arg(256)->Arg(4096)->Arg(65536);
+
+} // anonymous namespace
+
+} // namespace bench
+} // namespace aap
@@ -0,0 +1,84 @@
+#include "ring_buffer.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+RingBuffer::Mode modeArg(const benchmark::State& state) {
+    return state.range(0) ? RingBuffer::Mode::MIRRORED : RingBuffer::Mode::HEAP;
+}
+
+// Chunk sizes that divide the capacity never straddle the wrap point,
+// odd ones wrap every few chunks at a different offset each time
+void ringBufferArgs(benchmark::internal::Benchmark* b) {
+    b->ArgNames({"mirrored", "capacity", "chunk"});
+    for (int mirrored : {0, 1}) {
+        for (int capacity : {64 * 1024, 1024 * 1024}) {
+            for (int chunk : {64, 1024, 4093, 16384, 16411}) {
+                b->Args({mirrored, capacity, chunk});
+            }
+        }
+    }
+}
+
+void BM_RingBufferWriteRead(benchmark::State& state) {
+    RingBuffer ring(static_cast<size_t>(state.range(1)), modeArg(state));
+    const size_t chunk = static_cast<size_t>(state.range(2));
+    std::vector<uint8_t> in(chunk, 0x5a);
+    std::vector<uint8_t> out(chunk);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ring.write(in.data(), chunk));
+        benchmark::DoNotOptimize(ring.read(out.data(), chunk));
+        benchmark::ClobberMemory();
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(chunk));
+}
+BENCHMARK(BM_RingBufferWriteRead)->Apply(ringBufferArgs);
+
+// The framer's pattern: look at a header, then consume the record
+void BM_RingBufferPeekSkip(benchmark::State& state) {
+    RingBuffer ring(static_cast<size_t>(state.range(1)), modeArg(state));
+    const size_t chunk = static_cast<size_t>(state.range(2));
+    std::vector<uint8_t> in(chunk, 0x5a);
+    uint8_t header[8];
+    for (auto _ : state) {
+        ring.write(in.data(), chunk);
+        benchmark::DoNotOptimize(ring.peek(header, sizeof(header)));
+        benchmark::DoNotOptimize(ring.skip(chunk));
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(chunk));
+}
+BENCHMARK(BM_RingBufferPeekSkip)->Apply(ringBufferArgs);
+
+// Zero-copy spans: the producer fills them in place, the consumer reads
+// one header per chunk. Contiguous across the wrap point only when mirrored.
+void BM_RingBufferSpans(benchmark::State& state) {
+    RingBuffer ring(static_cast<size_t>(state.range(1)), modeArg(state));
+    const size_t chunk = static_cast<size_t>(state.range(2));
+    std::vector<uint8_t> in(chunk, 0x5a);
+    uint64_t sum = 0;
+    for (auto _ : state) {
+        size_t written = 0;
+        while (written < chunk) {
+            RingBuffer::WriteSpan span = ring.acquireWrite(chunk - written);
+            std::memcpy(span.data, in.data() + written, span.length);
+            ring.commitWrite(span.length);
+            written += span.length;
+        }
+        size_t consumed = 0;
+        while (consumed < chunk) {
+            RingBuffer::ReadSpan span = ring.acquireRead();
+            const size_t length = std::min(span.length, chunk - consumed);
+            sum += span.data[0];
+            ring.release(length);
+            consumed += length;
+        }
+    }
+    benchmark::DoNotOptimize(sum);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(chunk));
+}
+BENCHMARK(BM_RingBufferSpans)->Apply(ringBufferArgs);
+
+} // anonymous namespace
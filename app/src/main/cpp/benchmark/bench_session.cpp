@@ -0,0 +1,202 @@
+#include "bench_session.h"
+#include "aap_message.h"
+#include "nal_scanner.h"
+#include "session_capture.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+namespace aap {
+namespace bench {
+
+namespace {
+
+constexpr size_t TRANSFER_SIZE = 16384;
+constexpr size_t VIDEO_RECORD_PAYLOAD = 16384 - 16;
+
+constexpr uint8_t FLAGS_FIRST = EncryptedHeader::FLAG_ENCRYPTED | EncryptedHeader::FLAG_FIRST;
+constexpr uint8_t FLAGS_MIDDLE = EncryptedHeader::FLAG_ENCRYPTED;
+constexpr uint8_t FLAGS_LAST = EncryptedHeader::FLAG_ENCRYPTED | EncryptedHeader::FLAG_LAST;
+constexpr uint8_t FLAGS_WHOLE = FLAGS_FIRST | EncryptedHeader::FLAG_LAST;
+
+void appendRecord(std::vector<uint8_t>& stream, std::mt19937& random, int channel, uint8_t flags,
+                  size_t payload, uint32_t totalLength) {
+    stream.push_back(static_cast<uint8_t>(channel));
+    stream.push_back(flags);
+    stream.push_back(static_cast<uint8_t>(payload >> 8));
+    stream.push_back(static_cast<uint8_t>(payload & 0xFF));
+    if ((flags & (EncryptedHeader::FLAG_FIRST | EncryptedHeader::FLAG_LAST)) == EncryptedHeader::FLAG_FIRST) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            stream.push_back(static_cast<uint8_t>(totalLength >> shift));
+        }
+    }
+    for (size_t i = 0; i < payload; i++) {
+        stream.push_back(static_cast<uint8_t>(random()));
+    }
+}
+
+void appendMessage(std::vector<uint8_t>& stream, std::mt19937& random, int channel, size_t length) {
+    if (length <= VIDEO_RECORD_PAYLOAD) {
+        appendRecord(stream, random, channel, FLAGS_WHOLE, length, 0);
+        return;
+    }
+    size_t sent = 0;
+    while (sent < length) {
+        const size_t payload = std::min(VIDEO_RECORD_PAYLOAD, length - sent);
+        const uint8_t flags = sent == 0 ? FLAGS_FIRST : sent + payload == length ? FLAGS_LAST : FLAGS_MIDDLE;
+        appendRecord(stream, random, channel, flags, payload, static_cast<uint32_t>(length));
+        sent += payload;
+    }
+}
+
+// Random bytes with no 00 00 run, so no start code emulation
+void appendSlice(std::vector<uint8_t>& frame, std::mt19937& random, size_t length) {
+    uint8_t previous = 0xFF;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t value = static_cast<uint8_t>(random());
+        if (value == 0 && previous == 0) {
+            value = 0x80;
+        }
+        frame.push_back(value);
+        previous = value;
+    }
+}
+
+void appendNal(std::vector<uint8_t>& frame, std::mt19937& random, uint8_t header, size_t length) {
+    static const uint8_t START_CODE[] = {0, 0, 0, 1};
+    frame.insert(frame.end(), std::begin(START_CODE), std::end(START_CODE));
+    frame.push_back(header);
+    appendSlice(frame, random, length);
+}
+
+} // anonymous namespace
+
+Session syntheticSession(int seconds) {
+    std::mt19937 random(1);
+    std::vector<uint8_t> stream;
+
+    // 10 ms ticks: audio every 2, video every 3 (IDR each second), control every 10
+    for (int tick = 0; tick < seconds * 100; tick++) {
+        if (tick % 2 == 0) {
+            appendMessage(stream, random, Channel::ID_AUD, 2 + 8 + 3840);
+        }
+        if (tick % 3 == 0) {
+            const bool idr = tick % 100 == 0;
+            appendMessage(stream, random, Channel::ID_VID, idr ? 120000 : 12000 + random() % 30000);
+        }
+        if (tick % 10 == 0) {
+            appendMessage(stream, random, tick % 20 == 0 ? Channel::ID_CTR : Channel::ID_SEN,
+                          20 + random() % 200);
+        }
+    }
+
+    Session session;
+    for (size_t offset = 0; offset < stream.size(); offset += TRANSFER_SIZE) {
+        const size_t length = std::min(TRANSFER_SIZE, stream.size() - offset);
+        session.reads.emplace_back(stream.begin() + offset, stream.begin() + offset + length);
+        session.bytes += length;
+    }
+    return session;
+}
+
+bool loadCapture(const std::string& path, Session& session) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CaptureFileHeader header;
+    if (file.size() < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(header));
+    if (std::memcmp(header.magic, CaptureFileHeader::MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != CaptureFileHeader::VERSION) {
+        return false;
+    }
+
+    size_t offset = header.headerSize;
+    while (offset + sizeof(CaptureEntry) <= file.size()) {
+        CaptureEntry entry;
+        std::memcpy(&entry, file.data() + offset, sizeof(entry));
+        const size_t payload = offset + sizeof(entry);
+        if (entry.type == CaptureEntry::TYPE_END || payload + entry.length > file.size()) {
+            break;
+        }
+        if (entry.type == CaptureEntry::TYPE_DATA) {
+            session.reads.emplace_back(file.begin() + payload, file.begin() + payload + entry.length);
+            session.bytes += entry.length;
+        }
+        offset = payload + ((entry.length + 7) & ~static_cast<size_t>(7));
+    }
+    return !session.reads.empty();
+}
+
+std::vector<std::vector<uint8_t>> syntheticH264(int frames, size_t frameSize) {
+    std::mt19937 random(2);
+    std::vector<std::vector<uint8_t>> units;
+    for (int i = 0; i < frames; i++) {
+        std::vector<uint8_t> frame;
+        if (i == 0) {
+            appendNal(frame, random, 0x67, 12);  // SPS
+            appendNal(frame, random, 0x68, 4);   // PPS
+            appendNal(frame, random, 0x65, frameSize * 4);  // IDR slice
+        } else {
+            appendNal(frame, random, 0x41, frameSize);  // Non-IDR slice
+        }
+        units.push_back(std::move(frame));
+    }
+    return units;
+}
+
+bool loadAnnexB(const std::string& path, std::vector<std::vector<uint8_t>>& frames) {
+    std::ifstream in(path, std::ios::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (file.empty()) {
+        return false;
+    }
+
+    // An access unit ends after its slice; parameter sets start the next one
+    size_t frameStart = NalScanner::findStartCode(file.data(), 0, file.size());
+    size_t pos = frameStart;
+    bool sawSlice = false;
+    while (pos < file.size()) {
+        const size_t next = NalScanner::findStartCode(file.data(), pos + 3, file.size());
+        const int type = pos + 3 < file.size() ? NalScanner::nalType(VideoCodec::H264, file[pos + 3]) : -1;
+        const bool slice = type == 1 || type == 5;
+        if (sawSlice && (slice || type == 7 || type == 9)) {
+            frames.emplace_back(file.begin() + frameStart, file.begin() + pos);
+            frameStart = pos;
+            sawSlice = false;
+        }
+        sawSlice = sawSlice || slice;
+        pos = next;
+    }
+    if (frameStart < file.size()) {
+        frames.emplace_back(file.begin() + frameStart, file.end());
+    }
+    return !frames.empty();
+}
+
+std::string tempCapture(const Session& session) {
+    const std::string dir = env("TMPDIR").empty() ? "/tmp" : env("TMPDIR");
+    const std::string path = dir + "/headunit_bench.aapcap";
+    SessionCapture capture;
+    if (!capture.open(path.c_str())) {
+        return std::string();
+    }
+    for (const std::vector<uint8_t>& read : session.reads) {
+        capture.appendData(read.data(), read.size());
+    }
+    const bool complete = capture.getStats().failures == 0;
+    capture.close();
+    return complete ? path : std::string();
+}
+
+std::string env(const char* name) {
+    const char* value = std::getenv(name);
+    return value ? value : "";
+}
+
+} // namespace bench
+} // namespace aap
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <benchmark/benchmark.h>
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace aap {
+namespace bench {
+
+/**
+ * Inbound byte stream of a session, as the transport read it.
+ */
+struct Session {
+    std::vector<std::vector<uint8_t>> reads;
+    size_t bytes = 0;
+};
+
+/**
+ * A few seconds of typical projection traffic: 30 fps video fragmented
+ * into 16 KB records, 48 kHz stereo audio in 20 ms records and a trickle
+ * of control records, cut into 16 KB bulk transfers.
+ */
+Session syntheticSession(int seconds);
+
+/**
+ * Data entries of a SessionCapture file.
+ * @return false if the file is not a capture
+ */
+bool loadCapture(const std::string& path, Session& session);
+
+/**
+ * Annex-B access units: an IDR with SPS and PPS, then P frames, payload
+ * free of start code emulation like a real encoder's.
+ */
+std::vector<std::vector<uint8_t>> syntheticH264(int frames, size_t frameSize);
+
+/**
+ * Split a raw Annex-B file into access units at each first slice.
+ * @return false if it can't be read
+ */
+bool loadAnnexB(const std::string& path, std::vector<std::vector<uint8_t>>& frames);
+
+/**
+ * Write a session to a SessionCapture file in the temp directory.
+ * @return The file's path, empty on failure
+ */
+std::string tempCapture(const Session& session);
+
+/**
+ * Environment variable value, empty if unset.
+ */
+std::string env(const char* name);
+
+// Benchmarks over recorded input, also registered by main() for the
+// files named in the environment
+void BM_FramerSession(benchmark::State& state, const Session* input);
+void BM_FramerSessionInlined(benchmark::State& state, const Session* input);
+void BM_ReplaySession(benchmark::State& state, const std::string* path);
+void BM_NalScanStream(benchmark::State& state, const std::vector<std::vector<uint8_t>>* frames);
+
+} // namespace bench
+} // namespace aap
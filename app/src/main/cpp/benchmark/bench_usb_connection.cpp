@@ -0,0 +1,108 @@
+#include "bench_session.h"
+#include "usb_connection.h"
+#include "mock_usb.h"
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+namespace {
+
+const aap::bench::Session& session() {
+    static const aap::bench::Session synthetic = aap::bench::syntheticSession(2);
+    return synthetic;
+}
+
+bool openMock(benchmark::State& state, aap::UsbConnection& usb, int transfers) {
+    aap::mockUsbReset();
+    aap::TransferConfig config;
+    config.numTransfers = transfers;
+    if (!usb.open(0, config)) {
+        state.SkipWithError(usb.getLastError());
+        return false;
+    }
+    return true;
+}
+
+// Whole session through the mock device, transfer completion to the
+// RawDataCallback on AAP-USB-Event, with the given transfers in flight
+void BM_UsbConnectionSession(benchmark::State& state) {
+    aap::UsbConnection usb;
+    if (!openMock(state, usb, static_cast<int>(state.range(0)))) {
+        return;
+    }
+    std::atomic<uint64_t> received{0};
+    usb.setRawDataCallback([&received](const uint8_t*, size_t length) {
+        received.fetch_add(length, std::memory_order_relaxed);
+    });
+    usb.startReading();
+
+    for (auto _ : state) {
+        for (const std::vector<uint8_t>& read : session().reads) {
+            aap::mockUsbFeed(read.data(), read.size());
+        }
+        if (!aap::mockUsbWaitIdle(10000)) {
+            state.SkipWithError("Mock device stalled");
+            break;
+        }
+    }
+    usb.close();
+
+    const aap::MockUsbStats stats = aap::getMockUsbStats();
+    state.counters["transfers"] = benchmark::Counter(static_cast<double>(stats.inCompleted),
+                                                     benchmark::Counter::kIsRate);
+    state.SetBytesProcessed(static_cast<int64_t>(received.load()));
+}
+BENCHMARK(BM_UsbConnectionSession)->ArgName("transfers")->Arg(1)->Arg(4)->Arg(16)
+    ->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// One 16 KB completion at a time, from the device thread to the callback
+void BM_UsbCompletionLatency(benchmark::State& state) {
+    aap::UsbConnection usb;
+    if (!openMock(state, usb, 4)) {
+        return;
+    }
+    std::atomic<uint64_t> completions{0};
+    usb.setRawDataCallback([&completions](const uint8_t*, size_t) {
+        completions.fetch_add(1, std::memory_order_release);
+    });
+    usb.startReading();
+
+    const std::vector<uint8_t> transfer(16384, 0x5a);
+    uint64_t expected = 0;
+    for (auto _ : state) {
+        const auto start = std::chrono::steady_clock::now();
+        aap::mockUsbFeed(transfer.data(), transfer.size());
+        expected++;
+        while (completions.load(std::memory_order_acquire) != expected) {
+        }
+        state.SetIterationTime(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    usb.close();
+}
+BENCHMARK(BM_UsbCompletionLatency)->UseManualTime();
+
+// Small records written while reading, coalesced into OUT transfers
+void BM_UsbConnectionWrite(benchmark::State& state) {
+    aap::UsbConnection usb;
+    if (!openMock(state, usb, 4)) {
+        return;
+    }
+    usb.startReading();
+
+    const std::vector<uint8_t> record(static_cast<size_t>(state.range(0)), 0x0b);
+    for (auto _ : state) {
+        if (usb.write(record.data(), record.size()) < 0) {
+            state.SkipWithError(usb.getLastError());
+            break;
+        }
+    }
+    usb.close();
+
+    const aap::MockUsbStats stats = aap::getMockUsbStats();
+    state.counters["transfers"] = static_cast<double>(stats.outCompleted);
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(record.size()));
+}
+BENCHMARK(BM_UsbConnectionWrite)->ArgName("length")->Arg(64)->Arg(1024)->UseRealTime();
+
+} // anonymous namespace
@@ -0,0 +1,160 @@
+// Known-answer check of AesGcm and TlsRecordLayer against the GCM spec's
+// test vectors (McGrew & Viega, test cases 4 and 16), run by ctest:
+//   build-host/benchmark/headunit_gcm_check
+// Exits non-zero on the first mismatch. Covers whichever implementation
+// AesGcm picks on the host, the ARMv8 one only when run on such a CPU.
+#include "aes_gcm.h"
+#include "tls_record.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace {
+
+struct Vector {
+    const char* name;
+    const char* key;
+    const char* iv;
+    const char* aad;
+    const char* plaintext;
+    const char* ciphertext;
+    const char* tag;
+};
+
+// Test case 16 is test case 4 under a 256 bit key
+const Vector VECTORS[] = {
+    {
+        "Test case 4 (AES-128)",
+        "feffe9928665731c6d6a8f9467308308",
+        "cafebabefacedbaddecaf888",
+        "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+        "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+        "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+        "42831ec2217774244b7221b784d0d49ce3aa212f2c02a4e035c17e2329aca12e"
+        "21d514b25466931c7d8f6a5aac84aa051ba30b396a0aac973d58e091",
+        "5bc94fbc3221a5db94fae95ae7121a47",
+    },
+    {
+        "Test case 16 (AES-256)",
+        "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308",
+        "cafebabefacedbaddecaf888",
+        "feedfacedeadbeeffeedfacedeadbeefabaddad2",
+        "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+        "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39",
+        "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+        "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662",
+        "76fc6ece0f4e1768cddf8853bb2d551b",
+    },
+};
+
+std::vector<uint8_t> fromHex(const char* hex) {
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; hex[i] && hex[i + 1]; i += 2) {
+        unsigned value = 0;
+        std::sscanf(hex + i, "%2x", &value);
+        bytes.push_back(static_cast<uint8_t>(value));
+    }
+    return bytes;
+}
+
+bool check(bool ok, const char* name, const char* what) {
+    if (!ok) {
+        std::fprintf(stderr, "%s: %s\n", name, what);
+    }
+    return ok;
+}
+
+// Seal into a separate buffer, then open in place
+bool checkAesGcm(const Vector& vector) {
+    const std::vector<uint8_t> key = fromHex(vector.key);
+    const std::vector<uint8_t> iv = fromHex(vector.iv);
+    const std::vector<uint8_t> aad = fromHex(vector.aad);
+    const std::vector<uint8_t> plaintext = fromHex(vector.plaintext);
+    const std::vector<uint8_t> ciphertext = fromHex(vector.ciphertext);
+    const std::vector<uint8_t> tag = fromHex(vector.tag);
+
+    aap::AesGcm gcm;
+    if (!check(gcm.setKey(key.data(), key.size()), vector.name, "key rejected")) {
+        return false;
+    }
+
+    std::vector<uint8_t> sealed(plaintext.size());
+    uint8_t sealedTag[aap::AesGcm::TAG_SIZE];
+    gcm.seal(iv.data(), aad.data(), aad.size(), plaintext.data(), sealed.data(), plaintext.size(), sealedTag);
+    if (!check(sealed == ciphertext, vector.name, "seal: ciphertext mismatch") ||
+        !check(std::memcmp(sealedTag, tag.data(), tag.size()) == 0, vector.name, "seal: tag mismatch")) {
+        return false;
+    }
+
+    std::vector<uint8_t> buffer = ciphertext;
+    if (!check(gcm.open(iv.data(), aad.data(), aad.size(), buffer.data(), buffer.data(), buffer.size(), tag.data()),
+               vector.name, "open: tag rejected") ||
+        !check(buffer == plaintext, vector.name, "open: plaintext mismatch")) {
+        return false;
+    }
+
+    uint8_t badTag[aap::AesGcm::TAG_SIZE];
+    std::memcpy(badTag, tag.data(), sizeof(badTag));
+    badTag[0] ^= 0x01;
+    buffer = ciphertext;
+    return check(!gcm.open(iv.data(), aad.data(), aad.size(), buffer.data(), buffer.data(), buffer.size(), badTag),
+                 vector.name, "open: corrupted tag accepted");
+}
+
+// The vector's IV is a TLS salt followed by the sequence number as its
+// explicit nonce, so the record ciphertext is the vector's; the tag covers
+// the record header instead of the vector's AAD
+bool checkTlsRecord(const Vector& vector) {
+    const std::vector<uint8_t> key = fromHex(vector.key);
+    const std::vector<uint8_t> iv = fromHex(vector.iv);
+    const std::vector<uint8_t> plaintext = fromHex(vector.plaintext);
+    const std::vector<uint8_t> ciphertext = fromHex(vector.ciphertext);
+    uint64_t sequence = 0;
+    for (size_t i = aap::TlsRecordLayer::SALT_SIZE; i < iv.size(); i++) {
+        sequence = (sequence << 8) | iv[i];
+    }
+
+    aap::TlsRecordLayer layer;
+    if (!check(layer.setWriteKey(key.data(), key.size(), iv.data(), sequence) &&
+               layer.setReadKey(key.data(), key.size(), iv.data(), sequence),
+               vector.name, "TLS: key rejected")) {
+        return false;
+    }
+
+    std::vector<uint8_t> record(plaintext.size() + aap::TlsRecordLayer::OVERHEAD);
+    const int recordLength = layer.encrypt(plaintext.data(), plaintext.size(), record.data());
+    const size_t payload = aap::TlsRecordLayer::HEADER_SIZE + aap::TlsRecordLayer::EXPLICIT_NONCE_SIZE;
+    if (!check(recordLength == static_cast<int>(record.size()), vector.name, "TLS: record length") ||
+        !check(std::memcmp(record.data() + aap::TlsRecordLayer::HEADER_SIZE, iv.data() + aap::TlsRecordLayer::SALT_SIZE,
+                           aap::TlsRecordLayer::EXPLICIT_NONCE_SIZE) == 0, vector.name, "TLS: explicit nonce") ||
+        !check(std::memcmp(record.data() + payload, ciphertext.data(), ciphertext.size()) == 0,
+               vector.name, "TLS: ciphertext mismatch")) {
+        return false;
+    }
+
+    const int decrypted = layer.decrypt(record.data(), record.size(), record.data() + payload);
+    if (!check(decrypted == static_cast<int>(plaintext.size()), vector.name, "TLS: record rejected") ||
+        !check(std::memcmp(record.data() + payload, plaintext.data(), plaintext.size()) == 0,
+               vector.name, "TLS: plaintext mismatch")) {
+        return false;
+    }
+
+    // The next record, with one ciphertext bit flipped
+    layer.encrypt(plaintext.data(), plaintext.size(), record.data());
+    record[payload] ^= 0x01;
+    return check(layer.decrypt(record.data(), record.size(), record.data() + payload) < 0,
+                 vector.name, "TLS: corrupted record accepted");
+}
+
+} // anonymous namespace
+
+int main() {
+    std::printf("AES-GCM %s implementation\n", aap::AesGcm::isHardwareAccelerated() ? "hardware" : "portable");
+    for (const Vector& vector : VECTORS) {
+        if (!checkAesGcm(vector) || !checkTlsRecord(vector)) {
+            return 1;
+        }
+        std::printf("%s: ok\n", vector.name);
+    }
+    return 0;
+}
@@ -1,9 +1,9 @@
 #include "channel_dispatcher.h"
+#include "thread_policy.h"
+#include "trace.h"
 #include <android/log.h>
-#include <pthread.h>
-#include <sched.h>
-#include <unistd.h>
-#include <sys/resource.h>
+#include <algorithm>
+#include <time.h>
 
 #define LOG_TAG "ChannelDispatcher"
 #define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
@@ -11,65 +11,139 @@
 
 namespace aap {
 
-// Queue size limits
-constexpr size_t AUDIO_QUEUE_SIZE = 64;   // ~100ms at typical audio frame rate
-constexpr size_t VIDEO_QUEUE_SIZE = 16;   // Video frames are larger, fewer needed
-constexpr size_t CONTROL_QUEUE_SIZE = 32; // Control messages
-
-// MessageQueue implementation
-ChannelDispatcher::MessageQueue::MessageQueue(size_t maxSize)
-    : maxSize_(maxSize)
-{}
-
-bool ChannelDispatcher::MessageQueue::push(QueuedMessage&& msg) {
-    std::unique_lock<std::mutex> lock(mutex_);
+static inline uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
 
-    if (shutdown_) {
-        return false;
+static inline size_t latencyBucket(uint64_t latencyNs) {
+    const uint64_t us = latencyNs / 1000;
+    if (us == 0) {
+        return 0;
     }
+    const size_t bucket = 64 - __builtin_clzll(us);
+    return bucket < ChannelDispatcher::LATENCY_BUCKETS ? bucket : ChannelDispatcher::LATENCY_BUCKETS - 1;
+}
 
-    // Drop oldest if queue is full (for audio, we want latest data)
-    if (queue_.size() >= maxSize_) {
-        queue_.pop();
-        return false; // Indicate drop occurred
-    }
+// Counters have a single writer, so a relaxed load/store pair is enough
+static inline void bump(std::atomic<uint64_t>& counter, uint64_t delta = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
 
-    queue_.push(std::move(msg));
-    lock.unlock();
-    cv_.notify_one();
-    return true;
+// Consumer counters of a pooled priority, written by every worker
+static inline void bumpShared(std::atomic<uint64_t>& counter, uint64_t delta = 1) {
+    counter.fetch_add(delta, std::memory_order_relaxed);
 }
 
-bool ChannelDispatcher::MessageQueue::pop(QueuedMessage& msg) {
-    std::unique_lock<std::mutex> lock(mutex_);
+static std::unique_ptr<SpscMessageQueue> makeQueue(const QueueConfig& config) {
+    return std::make_unique<SpscMessageQueue>(config.slots > 0 ? config.slots : 1,
+                                              std::max(config.bytes, QueueConfig::MIN_QUEUE_BYTES));
+}
 
-    cv_.wait(lock, [this] {
-        return !queue_.empty() || shutdown_;
-    });
+static std::unique_ptr<SpscMessageQueue> makeLaneQueue(const DispatcherConfig& config, const QueueConfig& lane) {
+    return config.poolWorkers > 0 ? nullptr : makeQueue(lane);
+}
 
-    if (shutdown_ && queue_.empty()) {
-        return false;
-    }
+// Row of executors_ serving channel
+static inline size_t executorIndex(int channel) {
+    return channel >= 0 && channel < Channel::COUNT ? static_cast<size_t>(channel) : Channel::COUNT;
+}
 
-    msg = std::move(queue_.front());
-    queue_.pop();
-    return true;
+static inline ChannelPriority executorPriority(size_t index) {
+    return index < Channel::COUNT ? Channel::TABLE[index].priority : Channel::UNKNOWN.priority;
 }
 
-void ChannelDispatcher::MessageQueue::shutdown() {
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        shutdown_ = true;
+// Records a pooled channel may deliver before the other queued channels get a turn
+static constexpr size_t EXECUTOR_RUN_BUDGET = 16;
+
+struct ChannelDispatcher::ChannelExecutor : PoolTask {
+    ChannelExecutor(size_t slots, size_t bytes, QueueCounters& laneCounters,
+                    const MessageCallback& laneCallback, size_t laneIndex)
+        : queue(slots, bytes), counters(laneCounters), callback(laneCallback), lane(laneIndex) {}
+
+    SpscMessageQueue queue;
+    QueueCounters& counters;
+    // The priority's callback, which is set before start()
+    const MessageCallback& callback;
+    // Also the pool injector its records are submitted through
+    const size_t lane;
+    // Queued on the pool or running: the producer submits it only on the
+    // transition from idle, so one worker at a time consumes the queue
+    std::atomic<bool> scheduled{false};
+
+    bool run() override;
+};
+
+bool ChannelDispatcher::ChannelExecutor::run() {
+    // Payload is delivered in place from the queue arena
+    SpscMessageQueue::Message msg;
+    for (size_t i = 0; i < EXECUTOR_RUN_BUDGET; i++) {
+        if (!queue.tryAcquire(msg)) {
+            scheduled.store(false, std::memory_order_seq_cst);
+            // Pairs with the fence in push(): a record queued meanwhile is
+            // either seen here, or its producer finds the channel idle
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            return queue.size() > 0 && !scheduled.exchange(true, std::memory_order_acq_rel);
+        }
+        const uint64_t acquiredNs = monotonicNs();
+        recordWait(counters, msg, acquiredNs, true);
+        if (callback) {
+            AAP_TRACE_SECTION(counters.callbackTrace);
+            callback(msg.channel, msg.flags, msg.data, msg.length);
+            recordCallback(counters, acquiredNs);
+        }
+        queue.release();
+        bumpShared(counters.delivered);
     }
-    cv_.notify_all();
+    return true;
 }
 
 // ChannelDispatcher implementation
-ChannelDispatcher::ChannelDispatcher()
-    : audioQueue_(std::make_unique<MessageQueue>(AUDIO_QUEUE_SIZE))
-    , videoQueue_(std::make_unique<MessageQueue>(VIDEO_QUEUE_SIZE))
-    , controlQueue_(std::make_unique<MessageQueue>(CONTROL_QUEUE_SIZE))
-{}
+ChannelDispatcher::ChannelDispatcher(const DispatcherConfig& config)
+    : audioQueue_(makeQueue(config.audio))
+    , videoQueue_(makeLaneQueue(config, config.video))
+    , controlQueue_(makeLaneQueue(config, config.control))
+    , backgroundQueue_(makeLaneQueue(config, config.background))
+    , audioStats_("AAP audio queue", "Audio callback", config.audio)
+    , videoStats_("AAP video queue", "Video callback", config.video)
+    , controlStats_("AAP control queue", "Control callback", config.control)
+    , backgroundStats_("AAP background queue", "Background callback", config.background)
+    , lanes_{{audioQueue_.get(), &audioStats_},       // HIGH
+             {videoQueue_.get(), &videoStats_},       // MEDIUM
+             {controlQueue_.get(), &controlStats_},   // NORMAL
+             {backgroundQueue_.get(), &backgroundStats_}}  // BACKGROUND
+{
+    static_assert(static_cast<int>(ChannelPriority::HIGH) == 0 &&
+                  static_cast<int>(ChannelPriority::MEDIUM) == 1 &&
+                  static_cast<int>(ChannelPriority::NORMAL) == 2,
+                  "lanes_ is indexed by ChannelPriority");
+
+    if (config.poolWorkers == 0) {
+        return;
+    }
+    const QueueConfig* laneConfigs[LANE_COUNT] = {&config.audio, &config.video, &config.control, &config.background};
+    const MessageCallback* laneCallbacks[LANE_COUNT] = {
+        &audioCallback_, &videoCallback_, &controlCallback_, &backgroundCallback_
+    };
+    size_t channels[LANE_COUNT] = {};
+    for (size_t i = 0; i <= Channel::COUNT; i++) {
+        channels[static_cast<size_t>(executorPriority(i))]++;
+    }
+    for (size_t i = 0; i <= Channel::COUNT; i++) {
+        const size_t lane = static_cast<size_t>(executorPriority(i));
+        if (lane == static_cast<size_t>(ChannelPriority::HIGH)) {
+            continue;
+        }
+        // The priority's payload bytes are split between its channels
+        const QueueConfig& queue = *laneConfigs[lane];
+        executors_[i] = std::make_unique<ChannelExecutor>(
+                queue.slots > 0 ? queue.slots : 1,
+                std::max(queue.bytes / channels[lane], QueueConfig::MIN_QUEUE_BYTES),
+                *lanes_[lane].counters, *laneCallbacks[lane], lane);
+    }
+    pool_ = std::make_unique<WorkStealingPool>(config.poolWorkers, LANE_COUNT, Channel::COUNT + 1, "AAP-Worker");
+}
 
 ChannelDispatcher::~ChannelDispatcher() {
     stop();
@@ -87,6 +161,27 @@ void ChannelDispatcher::setControlCallback(MessageCallback callback) {
     controlCallback_ = std::move(callback);
 }
 
+void ChannelDispatcher::setBackgroundCallback(MessageCallback callback) {
+    backgroundCallback_ = std::move(callback);
+}
+
+void ChannelDispatcher::setLatency(PipelineLatency* latency) {
+    audioStats_.stages = latency;
+    videoStats_.stages = latency;
+    controlStats_.stages = latency;
+    backgroundStats_.stages = latency;
+}
+
+void ChannelDispatcher::setCpuShare(int share, int shares) {
+    cpuShare_ = share;
+    cpuShares_ = shares;
+}
+
+void ChannelDispatcher::setControlBatchCallback(BatchCallback callback, uint32_t maxLatencyUs) {
+    controlBatchCallback_ = std::move(callback);
+    controlBatchLatencyNs_ = static_cast<uint64_t>(maxLatencyUs) * 1000;
+}
+
 void ChannelDispatcher::start() {
     if (running_.exchange(true)) {
         return; // Already running
@@ -95,8 +190,17 @@ void ChannelDispatcher::start() {
     LOGD("Starting dispatcher threads");
 
     audioThread_ = std::thread(&ChannelDispatcher::audioWorker, this);
+    if (pool_) {
+        if (controlBatchCallback_) {
+            LOGD("Control batching is off with the worker pool, records are delivered one by one");
+        }
+        pool_->setCpuShare(cpuShare_, cpuShares_);
+        pool_->start();
+        return;
+    }
     videoThread_ = std::thread(&ChannelDispatcher::videoWorker, this);
     controlThread_ = std::thread(&ChannelDispatcher::controlWorker, this);
+    backgroundThread_ = std::thread(&ChannelDispatcher::backgroundWorker, this);
 }
 
 void ChannelDispatcher::stop() {
@@ -107,124 +211,253 @@ void ChannelDispatcher::stop() {
     LOGD("Stopping dispatcher threads");
 
     // Signal queues to shutdown
-    audioQueue_->shutdown();
-    videoQueue_->shutdown();
-    controlQueue_->shutdown();
+    for (const Lane& lane : lanes_) {
+        if (lane.queue) {
+            lane.queue->shutdown();
+        }
+    }
+    for (auto& executor : executors_) {
+        if (executor) {
+            executor->queue.shutdown();
+        }
+    }
 
     // Wait for threads to finish
     if (audioThread_.joinable()) audioThread_.join();
     if (videoThread_.joinable()) videoThread_.join();
     if (controlThread_.joinable()) controlThread_.join();
+    if (backgroundThread_.joinable()) backgroundThread_.join();
+    // Delivers what the channels still hold, like the threads above
+    if (pool_) {
+        pool_->stop();
+    }
 
     LOGD("Dispatcher threads stopped");
 }
 
-void ChannelDispatcher::dispatch(int channel, const uint8_t* data, size_t length) {
-    QueuedMessage msg;
-    msg.channel = channel;
-    msg.data.assign(data, data + length);
+void ChannelDispatcher::dispatch(int channel, uint8_t flags, const uint8_t* data, size_t length) {
+    AAP_TRACE_SECTION("Dispatch");
+    const Lane& lane = laneOf(channel);
+    ChannelExecutor* executor = executorOf(channel);
+    if (!executor) {
+        enqueue(*lane.queue, *lane.counters, channel, flags, data, length);
+        return;
+    }
+    if (enqueue(executor->queue, *lane.counters, channel, flags, data, length) &&
+        !executor->scheduled.exchange(true, std::memory_order_acq_rel)) {
+        pool_->submit(executor->lane, executor);
+    }
+}
 
-    bool dropped = false;
-    ChannelPriority priority = getChannelPriority(channel);
+ChannelDispatcher::ChannelExecutor* ChannelDispatcher::executorOf(int channel) const {
+    return pool_ ? executors_[executorIndex(channel)].get() : nullptr;
+}
 
-    switch (priority) {
-        case ChannelPriority::HIGH:
-            dropped = !audioQueue_->push(std::move(msg));
-            if (dropped) {
-                std::lock_guard<std::mutex> lock(statsMutex_);
-                stats_.audioQueueDrops++;
-            } else {
-                std::lock_guard<std::mutex> lock(statsMutex_);
-                stats_.audioMessagesDispatched++;
-            }
-            break;
-
-        case ChannelPriority::MEDIUM:
-            dropped = !videoQueue_->push(std::move(msg));
-            if (dropped) {
-                std::lock_guard<std::mutex> lock(statsMutex_);
-                stats_.videoQueueDrops++;
-            } else {
-                std::lock_guard<std::mutex> lock(statsMutex_);
-                stats_.videoMessagesDispatched++;
-            }
-            break;
-
-        case ChannelPriority::NORMAL:
-        default:
-            controlQueue_->push(std::move(msg));
-            {
-                std::lock_guard<std::mutex> lock(statsMutex_);
-                stats_.controlMessagesDispatched++;
-            }
-            break;
+size_t ChannelDispatcher::pooledDepth(ChannelPriority priority) const {
+    size_t depth = 0;
+    for (size_t i = 0; i <= Channel::COUNT; i++) {
+        if (executors_[i] && executorPriority(i) == priority) {
+            depth += executors_[i]->queue.size();
+        }
     }
+    return depth;
 }
 
-ChannelDispatcher::Stats ChannelDispatcher::getStats() const {
-    std::lock_guard<std::mutex> lock(statsMutex_);
-    return stats_;
+ChannelDispatcher::LaneProgress ChannelDispatcher::laneProgress(ChannelPriority priority) const {
+    const Lane& lane = lanes_[static_cast<size_t>(priority)];
+    const size_t depth = lane.queue ? lane.queue->size() : pooledDepth(priority);
+    return {lane.counters->delivered.load(std::memory_order_relaxed), depth};
 }
 
-void ChannelDispatcher::setRealtimePriority() {
-    // Try to set SCHED_FIFO for real-time audio processing
-    struct sched_param param;
-    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+uint32_t ChannelDispatcher::queueFill(int channel) const {
+    const ChannelExecutor* executor = executorOf(channel);
+    const SpscMessageQueue* queue = executor ? &executor->queue : laneOf(channel).queue;
+    return static_cast<uint32_t>(queue->size() * 100 / queue->capacity());
+}
+
+bool ChannelDispatcher::enqueue(SpscMessageQueue& queue, QueueCounters& counters,
+                                int channel, uint8_t flags, const uint8_t* data, size_t length) {
+    const uint64_t now = monotonicNs();
+    if (!queue.push(channel, flags, data, length, now)) {
+        if (counters.policy == DropPolicy::DROP_NEWEST ||
+            (counters.policy == DropPolicy::BLOCK && counters.shedding.load(std::memory_order_relaxed))) {
+            bump(counters.drops);
+            return false;
+        }
+        AAP_TRACE_SECTION("Dispatch blocked");
+        const uint64_t timeoutNs = counters.policy == DropPolicy::NEVER_DROP
+                ? SpscMessageQueue::NO_TIMEOUT : counters.blockTimeoutNs;
+        const bool queued = queue.pushFor(channel, flags, data, length, now, timeoutNs);
+        bump(counters.blocks);
+        bump(counters.blockedNs, monotonicNs() - now);
+        if (!queued) {
+            bump(counters.drops);
+            return false;
+        }
+    }
+
+    bump(counters.dispatched);
+    bump(counters.bytes, length);
+
+    const uint64_t depth = queue.size();
+    AAP_TRACE_COUNTER(counters.depthTrace, depth);
+    if (depth > counters.highWater.load(std::memory_order_relaxed)) {
+        counters.highWater.store(depth, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+ChannelDispatcher::QueueStats ChannelDispatcher::QueueCounters::snapshot() const {
+    QueueStats stats;
+    stats.messagesDispatched = dispatched.load(std::memory_order_relaxed);
+    stats.queueDrops = drops.load(std::memory_order_relaxed);
+    stats.queueBlocks = blocks.load(std::memory_order_relaxed);
+    stats.blockedNs = blockedNs.load(std::memory_order_relaxed);
+    stats.bytesDispatched = bytes.load(std::memory_order_relaxed);
+    stats.queueHighWater = highWater.load(std::memory_order_relaxed);
+    stats.batchesDelivered = batches.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+        stats.latencyHistogram[i] = latency[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+ChannelDispatcher::Stats ChannelDispatcher::getStats() const {
+    Stats stats;
+    stats.audio = audioStats_.snapshot();
+    stats.video = videoStats_.snapshot();
+    stats.control = controlStats_.snapshot();
+    stats.background = backgroundStats_.snapshot();
+    return stats;
+}
 
-    int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
-    if (result != 0) {
-        // Fall back to high nice value
-        LOGD("Could not set SCHED_FIFO (error %d), using high priority nice", result);
-        nice(-19);
+void ChannelDispatcher::recordWait(QueueCounters& counters, const SpscMessageQueue::Message& msg,
+                                   uint64_t now, bool shared) {
+    const uint64_t waitNs = now - msg.timestampNs;
+    if (shared) {
+        bumpShared(counters.latency[latencyBucket(waitNs)]);
     } else {
-        LOGD("Audio thread running with SCHED_FIFO priority %d", param.sched_priority);
+        bump(counters.latency[latencyBucket(waitNs)]);
+    }
+    if (counters.stages) {
+        (*counters.stages)[PipelineLatency::QUEUE_WAIT].record(waitNs);
     }
 }
 
-void ChannelDispatcher::audioWorker() {
-    pthread_setname_np(pthread_self(), "AAP-Audio");
-    setRealtimePriority();
+void ChannelDispatcher::recordCallback(QueueCounters& counters, uint64_t startNs) {
+    if (counters.stages) {
+        (*counters.stages)[PipelineLatency::CALLBACK].recordSince(startNs);
+    }
+}
 
-    LOGD("Audio worker started");
+void ChannelDispatcher::drain(SpscMessageQueue& queue, QueueCounters& counters,
+                              const MessageCallback& callback) {
+    // Payload is delivered in place from the queue arena
+    SpscMessageQueue::Message msg;
+    while (queue.acquire(msg)) {
+        const uint64_t acquiredNs = monotonicNs();
+        recordWait(counters, msg, acquiredNs);
+        if (callback) {
+            AAP_TRACE_SECTION(counters.callbackTrace);
+            callback(msg.channel, msg.flags, msg.data, msg.length);
+            recordCallback(counters, acquiredNs);
+        }
+        queue.release();
+        bump(counters.delivered);
+        AAP_TRACE_COUNTER(counters.depthTrace, queue.size());
+    }
+}
+
+void ChannelDispatcher::drainBatched(SpscMessageQueue& queue, QueueCounters& counters, RecordBatch& batch,
+                                     const BatchCallback& batchCallback, const MessageCallback& callback,
+                                     uint64_t maxLatencyNs) {
+    auto flush = [&]() {
+        AAP_TRACE_SECTION(counters.callbackTrace);
+        const uint64_t startNs = counters.stages ? monotonicNs() : 0;
+        batchCallback(batch);
+        recordCallback(counters, startNs);
+        batch.clear();
+        bump(counters.batches);
+    };
+
+    SpscMessageQueue::Message msg;
+    while (queue.acquire(msg)) {
+        // The first record bounds how long the whole batch may wait
+        const uint64_t deadline = msg.timestampNs + maxLatencyNs;
+        while (true) {
+            recordWait(counters, msg, monotonicNs());
+            if (!batch.append(msg.channel, msg.flags, msg.data, msg.length)) {
+                // Flush first to keep records in order
+                if (!batch.empty()) {
+                    flush();
+                }
+                if (!batch.append(msg.channel, msg.flags, msg.data, msg.length) && callback) {
+                    AAP_TRACE_SECTION(counters.callbackTrace);
+                    const uint64_t startNs = counters.stages ? monotonicNs() : 0;
+                    callback(msg.channel, msg.flags, msg.data, msg.length);
+                    recordCallback(counters, startNs);
+                }
+            }
+            queue.release();
+            bump(counters.delivered);
+            AAP_TRACE_COUNTER(counters.depthTrace, queue.size());
 
-    QueuedMessage msg;
-    while (audioQueue_->pop(msg)) {
-        if (audioCallback_) {
-            audioCallback_(msg.channel, msg.data.data(), msg.data.size());
+            const uint64_t now = monotonicNs();
+            if (batch.full() || now >= deadline || !queue.acquireFor(msg, deadline - now)) {
+                break;
+            }
+        }
+        if (!batch.empty()) {
+            flush();
         }
     }
+}
+
+void ChannelDispatcher::audioWorker() {
+    // SCHED_FIFO on the big cores unless Kotlin configured otherwise
+    applyThreadPolicy("AAP-Audio", cpuShare_, cpuShares_);
+
+    LOGD("Audio worker started");
+
+    drain(*audioQueue_, audioStats_, audioCallback_);
 
     LOGD("Audio worker stopped");
 }
 
 void ChannelDispatcher::videoWorker() {
-    pthread_setname_np(pthread_self(), "AAP-Video");
+    applyThreadPolicy("AAP-Video", cpuShare_, cpuShares_);
 
     LOGD("Video worker started");
 
-    QueuedMessage msg;
-    while (videoQueue_->pop(msg)) {
-        if (videoCallback_) {
-            videoCallback_(msg.channel, msg.data.data(), msg.data.size());
-        }
-    }
+    drain(*videoQueue_, videoStats_, videoCallback_);
 
     LOGD("Video worker stopped");
 }
 
 void ChannelDispatcher::controlWorker() {
-    pthread_setname_np(pthread_self(), "AAP-Control");
+    applyThreadPolicy("AAP-Control", cpuShare_, cpuShares_);
 
     LOGD("Control worker started");
 
-    QueuedMessage msg;
-    while (controlQueue_->pop(msg)) {
-        if (controlCallback_) {
-            controlCallback_(msg.channel, msg.data.data(), msg.data.size());
-        }
+    if (controlBatchCallback_) {
+        drainBatched(*controlQueue_, controlStats_, controlBatch_, controlBatchCallback_,
+                     controlCallback_, controlBatchLatencyNs_);
+    } else {
+        drain(*controlQueue_, controlStats_, controlCallback_);
     }
 
     LOGD("Control worker stopped");
 }
 
+void ChannelDispatcher::backgroundWorker() {
+    // Nice and on the little cores unless Kotlin configured otherwise
+    applyThreadPolicy("AAP-Background", cpuShare_, cpuShares_);
+
+    LOGD("Background worker started");
+
+    drain(*backgroundQueue_, backgroundStats_, backgroundCallback_);
+
+    LOGD("Background worker stopped");
+}
+
 } // namespace aap
@@ -1,21 +1,67 @@
 #pragma once
 
 #include "aap_message.h"
+#include "latency_histogram.h"
+#include "message_queue.h"
+#include "record_batch.h"
+#include "work_stealing_pool.h"
 #include <functional>
 #include <thread>
-#include <mutex>
-#include <condition_variable>
-#include <queue>
 #include <atomic>
-#include <vector>
 
 namespace aap {
 
 /**
  * Callback type for dispatching messages to Kotlin.
- * Parameters: channel, data pointer, data length
+ * Parameters: channel, record flags, data pointer, data length
  */
-using MessageCallback = std::function<void(int channel, const uint8_t* data, size_t length)>;
+using MessageCallback = std::function<void(int channel, uint8_t flags, const uint8_t* data, size_t length)>;
+
+/**
+ * Callback for a batch of control records. The batch is cleared once
+ * the callback returns.
+ */
+using BatchCallback = std::function<void(RecordBatch& batch)>;
+
+/**
+ * What dispatch() does with a record its queue has no room for.
+ * Waiting holds up the USB read thread, and every channel behind it.
+ */
+enum class DropPolicy : int {
+    DROP_NEWEST = 0,  // Discard the record
+    BLOCK = 1,        // Wait up to blockTimeoutUs for room, then discard it
+    NEVER_DROP = 2,   // Wait for room until the dispatcher stops
+};
+
+/**
+ * Limits of one priority queue.
+ */
+struct QueueConfig {
+    size_t slots;             // Records queued at once, rounded up to a power of two
+    size_t bytes;             // Payload bytes queued at once, at least MIN_QUEUE_BYTES
+    DropPolicy policy;
+    uint32_t blockTimeoutUs;  // BLOCK only
+
+    // Any record fits however the arena wraps
+    static constexpr size_t MIN_QUEUE_BYTES = 2 * 0x10000;
+};
+
+/**
+ * Queue limits per priority. Control records are never dropped by
+ * default: a lost control message stalls the protocol, a lost frame
+ * only costs a keyframe. Metadata gets room for a few album covers, and
+ * only briefly holds up the USB thread once that is full: a stale turn
+ * card is better than late control traffic.
+ */
+struct DispatcherConfig {
+    QueueConfig audio = {64, 512 * 1024, DropPolicy::DROP_NEWEST, 0};     // ~100ms at typical audio frame rate
+    QueueConfig video = {16, 17 * 0x10000, DropPolicy::DROP_NEWEST, 0};   // A full queue of maximum size records
+    QueueConfig control = {32, 256 * 1024, DropPolicy::NEVER_DROP, 0};
+    QueueConfig background = {64, 1024 * 1024, DropPolicy::BLOCK, 20000};
+    // Workers of the pool that runs the video, control and metadata
+    // channels instead of a thread per priority, 0 for the dedicated threads
+    size_t poolWorkers = 0;
+};
 
 /**
  * Channel dispatcher routes AAP messages to priority-based queues
@@ -24,10 +70,19 @@ using MessageCallback = std::function<void(int channel, const uint8_t* data, siz
  * - Audio: High priority, real-time thread (SCHED_FIFO if available)
  * - Video: Medium priority, normal thread
  * - Control/Other: Normal priority, normal thread
+ * - Background (metadata channels): low priority thread on the little cores
+ *
+ * With DispatcherConfig::poolWorkers set, only audio keeps its thread.
+ * Every other channel gets its own queue, split from its priority's
+ * limits, and is run as a serial task on a WorkStealingPool: records of
+ * one channel are still delivered in order by one worker at a time, but a
+ * burst on one channel, or a slow callback, no longer holds up the others
+ * in its priority, and several channels use several cores. Callbacks of
+ * one priority may then run concurrently for different channels.
  */
 class ChannelDispatcher {
 public:
-    ChannelDispatcher();
+    explicit ChannelDispatcher(const DispatcherConfig& config = DispatcherConfig());
     ~ChannelDispatcher();
 
     // Non-copyable
@@ -41,6 +96,41 @@ public:
     void setAudioCallback(MessageCallback callback);
     void setVideoCallback(MessageCallback callback);
     void setControlCallback(MessageCallback callback);
+    void setBackgroundCallback(MessageCallback callback);
+
+    /**
+     * Deliver control records in batches instead of one callback each.
+     * A batch is flushed when it is full, or once its first record has
+     * waited maxLatencyUs since it was queued; zero flushes as soon as the
+     * queue is empty.
+     * Records that don't fit an empty batch still go to the control
+     * callback. Must be called before start(). Ignored when pooled, the
+     * batch has a single writer.
+     */
+    void setControlBatchCallback(BatchCallback callback, uint32_t maxLatencyUs);
+
+    /**
+     * Record the QUEUE_WAIT and CALLBACK stages of every queue.
+     * Must be called before start().
+     */
+    void setLatency(PipelineLatency* latency);
+
+    /**
+     * Run the worker threads on share of shares slices of their CPUs, one
+     * slice per concurrent connection. Must be called before start().
+     */
+    void setCpuShare(int share, int shares);
+    bool isControlBatched() const { return controlBatchCallback_ && !pool_; }
+
+    /**
+     * Whether the non-audio channels run on the worker pool, AAP-Worker.
+     */
+    bool isPooled() const { return pool_ != nullptr; }
+
+    /**
+     * Buffer the control batches are packed into, owned by the dispatcher.
+     */
+    RecordBatch& controlBatch() { return controlBatch_; }
 
     /**
      * Start dispatcher threads.
@@ -54,76 +144,179 @@ public:
 
     /**
      * Dispatch a decrypted message to the appropriate queue.
-     * This is called from the USB read thread.
+     * This is called from the USB read thread. Each queue has a single
+     * producer, so other callers (the DecryptPool workers) must be
+     * serialized with it for the channels they deliver.
      * Returns immediately after queuing.
      */
-    void dispatch(int channel, const uint8_t* data, size_t length);
+    void dispatch(int channel, uint8_t flags, const uint8_t* data, size_t length);
+
+    /**
+     * How full the queue channel is dispatched to is right now, in percent
+     * of its slots: its own queue when pooled. Safe to call from any thread.
+     */
+    uint32_t queueFill(int channel) const;
+
+    /**
+     * Latency histogram buckets, enqueue to callback.
+     * Bucket 0 counts latencies below 1us, bucket i counts [2^(i-1), 2^i) us,
+     * the last bucket also collects everything slower.
+     */
+    static constexpr size_t LATENCY_BUCKETS = 20;
+
+    /**
+     * Per-queue statistics snapshot.
+     */
+    struct QueueStats {
+        uint64_t messagesDispatched;
+        uint64_t queueDrops;
+        uint64_t queueBlocks;      // Records that waited for room
+        uint64_t blockedNs;        // Total time dispatch() waited for room
+        uint64_t bytesDispatched;
+        uint64_t queueHighWater;   // Deepest queue occupancy seen, of one channel when pooled
+        uint64_t batchesDelivered; // Zero unless the queue is batched
+        uint64_t latencyHistogram[LATENCY_BUCKETS];
+    };
 
     /**
      * Get statistics for monitoring.
+     * Lock-free, safe to poll from any thread.
      */
     struct Stats {
-        uint64_t audioMessagesDispatched;
-        uint64_t videoMessagesDispatched;
-        uint64_t controlMessagesDispatched;
-        uint64_t audioQueueDrops;
-        uint64_t videoQueueDrops;
+        QueueStats audio;
+        QueueStats video;
+        QueueStats control;
+        QueueStats background;
     };
     Stats getStats() const;
 
-private:
-    // Message structure for internal queuing
-    struct QueuedMessage {
-        int channel;
-        std::vector<uint8_t> data;
+    /**
+     * Records dropped by the full video queue so far. The video consumer
+     * compares it between records to notice a gap mid-frame.
+     */
+    uint64_t videoDrops() const { return videoStats_.drops.load(std::memory_order_relaxed); }
+
+    /**
+     * Where the worker of one priority is, for StallWatchdog.
+     * Safe to call from any thread.
+     */
+    struct LaneProgress {
+        uint64_t delivered;     // Records the worker is done with
+        size_t depth;           // Queued right now, across its channels when pooled
     };
+    LaneProgress laneProgress(ChannelPriority priority) const;
+
+    /**
+     * Shed background records under load: while set, a full background
+     * queue discards records at once instead of holding up the USB thread
+     * for its block timeout. Safe to call from any thread.
+     */
+    void setBackgroundShedding(bool shed) {
+        backgroundStats_.shedding.store(shed, std::memory_order_relaxed);
+    }
+
+private:
+    // Counters for one queue. Producer and consumer fields live on
+    // separate cache lines, each field has a single writer; when pooled,
+    // the consumer fields are written by every worker.
+    struct QueueCounters {
+        alignas(64) std::atomic<uint64_t> dispatched{0};
+        std::atomic<uint64_t> drops{0};
+        std::atomic<uint64_t> blocks{0};
+        std::atomic<uint64_t> blockedNs{0};
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> highWater{0};
+
+        alignas(64) std::atomic<uint64_t> latency[LATENCY_BUCKETS]{};
+        std::atomic<uint64_t> batches{0};
+        std::atomic<uint64_t> delivered{0};
 
-    // Thread-safe queue with size limit
-    class MessageQueue {
-    public:
-        explicit MessageQueue(size_t maxSize);
-
-        bool push(QueuedMessage&& msg);  // Returns false if queue full (dropped)
-        bool pop(QueuedMessage& msg);    // Blocking pop
-        void shutdown();
-
-    private:
-        std::queue<QueuedMessage> queue_;
-        std::mutex mutex_;
-        std::condition_variable cv_;
-        size_t maxSize_;
-        std::atomic<bool> shutdown_{false};
+        // System trace names for the queue depth and the consumer callbacks
+        const char* const depthTrace;
+        const char* const callbackTrace;
+        // Shared QUEUE_WAIT and CALLBACK stages, may be null
+        PipelineLatency* stages = nullptr;
+        // What enqueue() does when the queue is full
+        const DropPolicy policy;
+        const uint64_t blockTimeoutNs;
+        // BLOCK queues drop instead of waiting, see setBackgroundShedding()
+        std::atomic<bool> shedding{false};
+
+        QueueCounters(const char* depthTraceName, const char* callbackTraceName, const QueueConfig& config)
+            : depthTrace(depthTraceName), callbackTrace(callbackTraceName)
+            , policy(config.policy), blockTimeoutNs(static_cast<uint64_t>(config.blockTimeoutUs) * 1000) {}
+
+        QueueStats snapshot() const;
     };
 
-    // Queues for each priority level
-    std::unique_ptr<MessageQueue> audioQueue_;
-    std::unique_ptr<MessageQueue> videoQueue_;
-    std::unique_ptr<MessageQueue> controlQueue_;
+    // Queues for each priority level, null for the pooled ones
+    std::unique_ptr<SpscMessageQueue> audioQueue_;
+    std::unique_ptr<SpscMessageQueue> videoQueue_;
+    std::unique_ptr<SpscMessageQueue> controlQueue_;
+    std::unique_ptr<SpscMessageQueue> backgroundQueue_;
 
     // Worker threads
     std::thread audioThread_;
     std::thread videoThread_;
     std::thread controlThread_;
+    std::thread backgroundThread_;
 
     // Callbacks
     MessageCallback audioCallback_;
     MessageCallback videoCallback_;
     MessageCallback controlCallback_;
+    MessageCallback backgroundCallback_;
+    BatchCallback controlBatchCallback_;
+    uint64_t controlBatchLatencyNs_ = 0;
+    RecordBatch controlBatch_;
 
     // State
     std::atomic<bool> running_{false};
+    int cpuShare_ = 0;
+    int cpuShares_ = 1;
 
     // Statistics
-    mutable std::mutex statsMutex_;
-    Stats stats_{};
+    QueueCounters audioStats_;
+    QueueCounters videoStats_;
+    QueueCounters controlStats_;
+    QueueCounters backgroundStats_;
+
+    // One channel of a pooled priority, see channel_dispatcher.cpp
+    struct ChannelExecutor;
+
+    // Queue and counters per ChannelPriority, so routing is one table lookup
+    struct Lane {
+        SpscMessageQueue* queue;
+        QueueCounters* counters;
+    };
+    static constexpr size_t LANE_COUNT = static_cast<size_t>(ChannelPriority::BACKGROUND) + 1;
+    const Lane lanes_[LANE_COUNT];
+    const Lane& laneOf(int channel) const {
+        return lanes_[static_cast<size_t>(getChannelPriority(channel))];
+    }
+
+    // Optional: indexed by channel id, unknown ids share the last one;
+    // null for audio channels
+    std::unique_ptr<WorkStealingPool> pool_;
+    std::unique_ptr<ChannelExecutor> executors_[Channel::COUNT + 1];
+    ChannelExecutor* executorOf(int channel) const;
+    size_t pooledDepth(ChannelPriority priority) const;
 
     // Worker thread functions
     void audioWorker();
     void videoWorker();
     void controlWorker();
-
-    // Set thread priority (platform-specific)
-    static void setRealtimePriority();
+    void backgroundWorker();
+    static bool enqueue(SpscMessageQueue& queue, QueueCounters& counters,
+                        int channel, uint8_t flags, const uint8_t* data, size_t length);
+    static void drain(SpscMessageQueue& queue, QueueCounters& counters,
+                      const MessageCallback& callback);
+    static void recordWait(QueueCounters& counters, const SpscMessageQueue::Message& msg, uint64_t now,
+                           bool shared = false);
+    static void recordCallback(QueueCounters& counters, uint64_t startNs);
+    static void drainBatched(SpscMessageQueue& queue, QueueCounters& counters, RecordBatch& batch,
+                             const BatchCallback& batchCallback, const MessageCallback& callback,
+                             uint64_t maxLatencyNs);
 };
 
 } // namespace aap
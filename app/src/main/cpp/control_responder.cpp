@@ -0,0 +1,115 @@
+#include "control_responder.h"
+#include <time.h>
+
+namespace aap {
+
+namespace {
+
+// Encrypted, first and last fragment: ID_CTR replies and media ACKs alike
+constexpr uint8_t REPLY_FLAGS = 0x0b;
+
+// Protobuf wire types
+constexpr uint8_t WIRE_VARINT = 0;
+
+uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+uint8_t* writeVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+uint8_t* writeVarintField(uint8_t* out, int field, uint64_t value) {
+    return writeVarint(writeVarint(out, (static_cast<uint64_t>(field) << 3) | WIRE_VARINT), value);
+}
+
+// Header and message type, the body follows
+uint8_t* writeHeader(uint8_t* out, int channel, uint16_t type) {
+    out[0] = static_cast<uint8_t>(channel);
+    out[1] = REPLY_FLAGS;
+    out[4] = static_cast<uint8_t>(type >> 8);
+    out[5] = static_cast<uint8_t>(type & 0xFF);
+    return out + EncryptedHeader::SIZE + 2;
+}
+
+size_t finish(uint8_t* out, const uint8_t* end) {
+    const size_t length = static_cast<size_t>(end - out);
+    const size_t payload = length - EncryptedHeader::SIZE;
+    out[2] = static_cast<uint8_t>(payload >> 8);
+    out[3] = static_cast<uint8_t>(payload & 0xFF);
+    return length;
+}
+
+void updateMax(std::atomic<uint64_t>& max, uint64_t value) {
+    uint64_t current = max.load(std::memory_order_relaxed);
+    while (value > current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+} // anonymous namespace
+
+bool ControlResponder::isPingRequest(int channel, const uint8_t* data, size_t length) {
+    return channel == Channel::ID_CTR && length >= 2 &&
+           static_cast<uint16_t>((data[0] << 8) | data[1]) == PING_REQUEST;
+}
+
+size_t ControlResponder::answer(int channel, const uint8_t* data, size_t length, uint8_t* out) {
+    if (!isPingRequest(channel, data, length)) {
+        return 0;
+    }
+    // PingResponse{timestamp = 1}, the request's own timestamp isn't echoed
+    uint8_t* end = writeHeader(out, channel, PING_RESPONSE);
+    end = writeVarintField(end, 1, monotonicNs());
+    pings_.fetch_add(1, std::memory_order_relaxed);
+    return finish(out, end);
+}
+
+void ControlResponder::setSessionId(int channel, int32_t sessionId) {
+    if (channel >= 0 && channel < MAX_CHANNELS) {
+        sessions_[channel].store(sessionId, std::memory_order_relaxed);
+    }
+}
+
+size_t ControlResponder::mediaAck(int channel, uint32_t count, uint8_t* out) {
+    const int64_t session = channel >= 0 && channel < MAX_CHANNELS
+            ? sessions_[channel].load(std::memory_order_relaxed) : NO_SESSION;
+    if (session == NO_SESSION) {
+        noSession_.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+    // Ack{session_id = 1, ack = 2}, a negative int32 is sign-extended to 10 bytes
+    uint8_t* end = writeHeader(out, channel, MEDIA_ACK);
+    end = writeVarintField(end, 1, static_cast<uint64_t>(session));
+    end = writeVarintField(end, 2, count);
+    acks_.fetch_add(1, std::memory_order_relaxed);
+    return finish(out, end);
+}
+
+void ControlResponder::sent(bool ok, uint64_t startNs, uint64_t nowNs) {
+    if (!ok) {
+        failures_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (startNs != 0 && nowNs > startNs) {
+        updateMax(maxTurnaroundNs_, nowNs - startNs);
+    }
+}
+
+ControlResponder::Stats ControlResponder::getStats() const {
+    Stats stats;
+    stats.pings = pings_.load(std::memory_order_relaxed);
+    stats.acks = acks_.load(std::memory_order_relaxed);
+    stats.noSession = noSession_.load(std::memory_order_relaxed);
+    stats.failures = failures_.load(std::memory_order_relaxed);
+    stats.maxTurnaroundNs = maxTurnaroundNs_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace aap
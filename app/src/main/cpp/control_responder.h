@@ -0,0 +1,95 @@
+#pragma once
+
+#include "aap_message.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace aap {
+
+/**
+ * Builds the replies to trivial control traffic natively, so keepalive
+ * latency no longer depends on the JVM.
+ *
+ * A ping request on the control channel is recognised by its message type
+ * right after decrypt and answered with a PingResponse stamped with
+ * CLOCK_MONOTONIC, the clock System.nanoTime() reads. Coalesced media ACKs
+ * are encoded with the session id Kotlin registered for their channel.
+ *
+ * Only the plaintext message is built here: the caller seals it with the
+ * connection's write layer and writes it, ID_CTR records take the urgent
+ * TX reservation and ACKs the non-bulk one. Kotlin still gets every record.
+ */
+class ControlResponder {
+public:
+    static constexpr uint16_t PING_REQUEST = 0x000B;
+    static constexpr uint16_t PING_RESPONSE = 0x000C;
+    static constexpr uint16_t MEDIA_ACK = 0x8004;
+    // Header, message type and two varint fields at most 10 bytes each
+    static constexpr size_t MAX_MESSAGE = EncryptedHeader::SIZE + 2 + 2 * 11;
+    static constexpr int MAX_CHANNELS = 16;
+    static_assert(Channel::COUNT <= MAX_CHANNELS, "Every ACKed channel needs a session slot");
+
+    ControlResponder() = default;
+
+    // Non-copyable
+    ControlResponder(const ControlResponder&) = delete;
+    ControlResponder& operator=(const ControlResponder&) = delete;
+
+    /**
+     * True for a record this class answers, data starts at the message type.
+     */
+    static bool isPingRequest(int channel, const uint8_t* data, size_t length);
+
+    /**
+     * Build the reply to a record.
+     * @param out At least MAX_MESSAGE bytes
+     * @return Message length including the header, 0 if the record is left to Kotlin
+     */
+    size_t answer(int channel, const uint8_t* data, size_t length, uint8_t* out);
+
+    /**
+     * Register the session a channel's media ACKs refer to, from MediaStart.
+     * Safe to call from any thread.
+     */
+    void setSessionId(int channel, int32_t sessionId);
+
+    /**
+     * Build a media ACK covering count records.
+     * @param out At least MAX_MESSAGE bytes
+     * @return Message length including the header, 0 while the channel has no session
+     */
+    size_t mediaAck(int channel, uint32_t count, uint8_t* out);
+
+    /**
+     * Account for one reply the caller sealed and wrote, or failed to.
+     * @param startNs When the request was decrypted, 0 for an ACK
+     */
+    void sent(bool ok, uint64_t startNs, uint64_t nowNs);
+
+    struct Stats {
+        uint64_t pings;             // Ping requests answered natively
+        uint64_t acks;              // Media ACKs encoded natively
+        uint64_t noSession;         // ACKs left to Kotlin, channel had no session yet
+        uint64_t failures;          // Replies the write layer or transport refused
+        uint64_t maxTurnaroundNs;   // Decrypt of a ping to its response written
+    };
+    Stats getStats() const;
+
+private:
+    // Unset channels hold NO_SESSION, a session id is an int32
+    static constexpr int64_t NO_SESSION = INT64_MIN;
+    std::atomic<int64_t> sessions_[MAX_CHANNELS] = {
+        {NO_SESSION}, {NO_SESSION}, {NO_SESSION}, {NO_SESSION},
+        {NO_SESSION}, {NO_SESSION}, {NO_SESSION}, {NO_SESSION},
+        {NO_SESSION}, {NO_SESSION}, {NO_SESSION}, {NO_SESSION},
+        {NO_SESSION}, {NO_SESSION}, {NO_SESSION}, {NO_SESSION}};
+
+    std::atomic<uint64_t> pings_{0};
+    std::atomic<uint64_t> acks_{0};
+    std::atomic<uint64_t> noSession_{0};
+    std::atomic<uint64_t> failures_{0};
+    std::atomic<uint64_t> maxTurnaroundNs_{0};
+};
+
+} // namespace aap
@@ -0,0 +1,278 @@
+#include "decrypt_pool.h"
+#include "aap_framer.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <pthread.h>
+#include <algorithm>
+#include <cstring>
+
+#define LOG_TAG "DecryptPool"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+constexpr size_t PLAINTEXT_OFFSET = TlsRecordLayer::HEADER_SIZE + TlsRecordLayer::EXPLICIT_NONCE_SIZE;
+
+DecryptPool::DecryptPool(TlsRecordLayer& layer, RecordPool& records, size_t workers)
+    : layer_(layer)
+    , records_(records)
+    , numWorkers_(workers)
+{
+    if (numWorkers_ == 0) {
+        // Leave one core for the USB event thread
+        const size_t cores = std::max(2u, std::thread::hardware_concurrency());
+        numWorkers_ = cores - 1;
+    }
+    numWorkers_ = std::min(numWorkers_, MAX_WORKERS);
+    activeWorkers_ = numWorkers_;
+
+    for (size_t i = 0; i < JOB_SLOTS; i++) {
+        jobs_[i].next = freeJobs_;
+        freeJobs_ = &jobs_[i];
+    }
+}
+
+DecryptPool::~DecryptPool() {
+    stop();
+}
+
+void DecryptPool::setEmitCallback(MessageCallback callback) {
+    emitCallback_ = std::move(callback);
+}
+
+void DecryptPool::setFailureCallback(DecryptFailureCallback callback) {
+    failureCallback_ = std::move(callback);
+}
+
+void DecryptPool::start() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_) {
+            return;
+        }
+        running_ = true;
+    }
+
+    LOGD("Starting %zu decrypt workers", numWorkers_);
+    for (size_t i = 0; i < numWorkers_; i++) {
+        workers_.emplace_back(&DecryptPool::workerLoop, this, i);
+    }
+}
+
+void DecryptPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+
+    workAvailable_.notify_all();
+    slotAvailable_.notify_all();
+    for (auto& worker : workers_) {
+        if (worker.joinable()) worker.join();
+    }
+    workers_.clear();
+
+    // Drop whatever was still in flight
+    std::lock_guard<std::mutex> lock(mutex_);
+    workHead_ = 0;
+    workCount_ = 0;
+    freeJobs_ = nullptr;
+    for (size_t i = 0; i < JOB_SLOTS; i++) {
+        if (jobs_[i].buffer) {
+            records_.release(jobs_[i].buffer);
+            jobs_[i].buffer = nullptr;
+        }
+        jobs_[i].next = freeJobs_;
+        freeJobs_ = &jobs_[i];
+    }
+    for (auto& order : order_) {
+        order = ChannelOrder{};
+    }
+    LOGD("Decrypt workers stopped");
+}
+
+void DecryptPool::setActiveWorkers(size_t workers) {
+    workers = std::min(std::max<size_t>(workers, 1), numWorkers_);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (workers == activeWorkers_) {
+            return;
+        }
+        activeWorkers_ = workers;
+    }
+    LOGD("Decrypt workers active: %zu of %zu", workers, numWorkers_);
+    // Woken workers above the limit go back to sleep
+    workAvailable_.notify_all();
+}
+
+bool DecryptPool::accepts(int channel, size_t length) {
+    if (!Channel::isVideo(channel)) {
+        return false;
+    }
+    if (length >= MIN_PARALLEL_RECORD) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return order_[channel].depth > 0;
+}
+
+void DecryptPool::submit(int channel, uint8_t flags, const uint8_t* record, size_t length) {
+    if (length > AapFramer::MAX_PAYLOAD) {
+        LOGE("submit: record too large (%zu)", length);
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    RecordPool::Buffer* buffer = nullptr;
+    auto ready = [this, &buffer, length] {
+        if (!running_) return true;
+        if (!freeJobs_) return false;
+        buffer = records_.acquire(length);
+        return buffer != nullptr;
+    };
+    if (!ready()) {
+        stats_.slotWaits++;
+        slotAvailable_.wait(lock, ready);
+    }
+    if (!running_) {
+        if (buffer) records_.release(buffer);
+        return;
+    }
+    Job* job = freeJobs_;
+    freeJobs_ = job->next;
+    lock.unlock();
+
+    // The record lives in a transfer buffer that is resubmitted once we return
+    job->buffer = buffer;
+    std::memcpy(buffer->data, record, length);
+    job->length = length;
+    job->channel = channel;
+    job->flags = flags;
+    job->sequence = layer_.reserveReadSequence();
+    job->plaintextLength = -1;
+    job->done = false;
+    job->next = nullptr;
+
+    const bool parallel = length >= MIN_PARALLEL_RECORD;
+
+    lock.lock();
+    ChannelOrder& order = order_[channel];
+    if (order.tail) {
+        order.tail->next = job;
+    } else {
+        order.head = job;
+    }
+    order.tail = job;
+    order.depth++;
+    stats_.reorderHighWater = std::max<uint64_t>(stats_.reorderHighWater, order.depth);
+
+    if (parallel) {
+        work_[(workHead_ + workCount_) % JOB_SLOTS] = job;
+        workCount_++;
+        stats_.recordsParallel++;
+        // The one woken might be a sleeping worker above the limit
+        const bool limited = activeWorkers_ < numWorkers_;
+        lock.unlock();
+        if (limited) {
+            workAvailable_.notify_all();
+        } else {
+            workAvailable_.notify_one();
+        }
+        return;
+    }
+
+    // Small record queued behind larger ones, no point waking a worker
+    stats_.recordsOrdered++;
+    lock.unlock();
+    decrypt(job);
+    complete(job);
+}
+
+void DecryptPool::workerLoop(size_t index) {
+    applyThreadPolicy("AAP-Decrypt", cpuShare_, cpuShares_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        workAvailable_.wait(lock, [this, index] {
+            return (workCount_ > 0 && index < activeWorkers_) || !running_;
+        });
+        if (!running_) {
+            return;
+        }
+
+        Job* job = work_[workHead_];
+        workHead_ = (workHead_ + 1) % JOB_SLOTS;
+        workCount_--;
+
+        lock.unlock();
+        decrypt(job);
+        complete(job);
+        lock.lock();
+    }
+}
+
+void DecryptPool::decrypt(Job* job) {
+    uint8_t* data = job->buffer->data;
+    const uint64_t startNs = latency_ ? LatencyHistogram::now() : 0;
+    job->plaintextLength = layer_.decryptAt(data, job->length, data + PLAINTEXT_OFFSET, job->sequence);
+    if (latency_) {
+        (*latency_)[PipelineLatency::DECRYPT].recordSince(startNs);
+    }
+}
+
+void DecryptPool::complete(Job* job) {
+    const int channel = job->channel;
+    uint64_t failuresBefore;
+    uint64_t failuresAfter;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job->done = true;
+        failuresBefore = stats_.authFailures;
+        emitReady(order_[channel]);
+        failuresAfter = stats_.authFailures;
+    }
+    slotAvailable_.notify_one();
+
+    // Keep the JNI upcall out of the lock
+    if (failuresAfter != failuresBefore && failureCallback_) {
+        failureCallback_(channel);
+    }
+}
+
+// Called with mutex_ held, emits are serialized by it
+void DecryptPool::emitReady(ChannelOrder& order) {
+    while (order.head && order.head->done) {
+        Job* job = order.head;
+        order.head = job->next;
+        if (!order.head) {
+            order.tail = nullptr;
+        }
+        order.depth--;
+
+        if (job->plaintextLength < 0) {
+            stats_.authFailures++;
+            LOGE("Record on channel %d failed authentication", job->channel);
+        } else if (emitCallback_) {
+            emitCallback_(job->channel, job->flags, job->buffer->data + PLAINTEXT_OFFSET,
+                          static_cast<size_t>(job->plaintextLength));
+        }
+
+        records_.release(job->buffer);
+        job->buffer = nullptr;
+        job->next = freeJobs_;
+        freeJobs_ = job;
+    }
+}
+
+DecryptPool::Stats DecryptPool::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.activeWorkers = activeWorkers_;
+    return stats;
+}
+
+} // namespace aap
@@ -0,0 +1,161 @@
+#pragma once
+
+#include "channel_dispatcher.h"
+#include "latency_histogram.h"
+#include "record_pool.h"
+#include "tls_record.h"
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aap {
+
+/**
+ * Called once per record that failed authentication.
+ */
+using DecryptFailureCallback = std::function<void(int channel)>;
+
+/**
+ * Decrypts large records on a small worker pool.
+ *
+ * Sequence numbers are assigned in framing order by the submitting
+ * thread, so records can be decrypted out of order. Plaintext is then
+ * re-ordered per channel before it reaches the emit callback. Emits
+ * are serialized, so the callback may feed a single-producer queue.
+ *
+ * Records are copied into RecordPool buffers sized to them, which stay
+ * with the job until its plaintext has been emitted.
+ *
+ * submit() must always be called from the same thread, the one that
+ * owns the TLS read sequence.
+ */
+class DecryptPool {
+public:
+    static constexpr size_t JOB_SLOTS = 8;
+    static constexpr size_t MAX_WORKERS = 3;
+    static constexpr size_t MAX_CHANNELS = 256;
+
+    // Records below this size are cheaper to decrypt on the USB thread
+    static constexpr size_t MIN_PARALLEL_RECORD = 8192;
+
+    /**
+     * @param layer Record layer with the read key already set; must outlive the pool
+     * @param records Buffers for records in flight; must outlive the pool
+     * @param workers Worker threads, 0 picks one per spare core up to MAX_WORKERS
+     */
+    DecryptPool(TlsRecordLayer& layer, RecordPool& records, size_t workers = 0);
+    ~DecryptPool();
+
+    // Non-copyable
+    DecryptPool(const DecryptPool&) = delete;
+    DecryptPool& operator=(const DecryptPool&) = delete;
+
+    /**
+     * Set callbacks. Must be called before start().
+     */
+    void setEmitCallback(MessageCallback callback);
+    void setFailureCallback(DecryptFailureCallback callback);
+
+    /**
+     * Record the DECRYPT stage. Must be called before start().
+     */
+    void setLatency(PipelineLatency* latency) { latency_ = latency; }
+
+    /**
+     * Run the workers on share of shares slices of the CPUs, see
+     * ChannelDispatcher::setCpuShare(). Must be called before start().
+     */
+    void setCpuShare(int share, int shares) {
+        cpuShare_ = share;
+        cpuShares_ = shares;
+    }
+
+    void start();
+    void stop();
+
+    /**
+     * Limit how many workers take jobs, between one and the workers
+     * started; the others sleep until the limit is raised again. Safe to
+     * call from any thread, in-flight jobs finish where they are.
+     */
+    void setActiveWorkers(size_t workers);
+    size_t workerCount() const { return numWorkers_; }
+
+    /**
+     * Check whether a record must go through the pool.
+     * True for large video records, and for any record on a channel that
+     * still has records in flight so it can't overtake them.
+     */
+    bool accepts(int channel, size_t length);
+
+    /**
+     * Copy a record, assign its sequence number and queue it for decryption.
+     * Blocks while all job slots or record buffers are in flight.
+     */
+    void submit(int channel, uint8_t flags, const uint8_t* record, size_t length);
+
+    struct Stats {
+        uint64_t recordsParallel;   // Decrypted on a worker
+        uint64_t recordsOrdered;    // Decrypted inline, held for ordering
+        uint64_t reorderHighWater;  // Deepest per-channel backlog seen
+        uint64_t slotWaits;         // submit() calls that blocked for a slot or buffer
+        uint64_t authFailures;
+        uint64_t activeWorkers;     // Taking jobs right now, see setActiveWorkers()
+    };
+    Stats getStats() const;
+
+private:
+    struct Job {
+        RecordPool::Buffer* buffer = nullptr;
+        size_t length = 0;
+        int channel = 0;
+        uint8_t flags = 0;
+        uint64_t sequence = 0;
+        int plaintextLength = -1;
+        bool done = false;
+        Job* next = nullptr;    // Free list or per-channel order
+    };
+
+    // Records of one channel, oldest first
+    struct ChannelOrder {
+        Job* head = nullptr;
+        Job* tail = nullptr;
+        size_t depth = 0;
+    };
+
+    TlsRecordLayer& layer_;
+    RecordPool& records_;
+    size_t numWorkers_;
+    size_t activeWorkers_;
+    std::vector<std::thread> workers_;
+
+    Job jobs_[JOB_SLOTS];
+    Job* freeJobs_ = nullptr;
+    Job* work_[JOB_SLOTS];
+    size_t workHead_ = 0;
+    size_t workCount_ = 0;
+    ChannelOrder order_[MAX_CHANNELS];
+
+    MessageCallback emitCallback_;
+    DecryptFailureCallback failureCallback_;
+    PipelineLatency* latency_ = nullptr;
+    int cpuShare_ = 0;
+    int cpuShares_ = 1;
+
+    mutable std::mutex mutex_;
+    std::condition_variable workAvailable_;
+    std::condition_variable slotAvailable_;
+    bool running_ = false;
+
+    Stats stats_{};
+
+    void workerLoop(size_t index);
+    void decrypt(Job* job);
+    void complete(Job* job);
+    void emitReady(ChannelOrder& order);
+};
+
+} // namespace aap
@@ -0,0 +1,249 @@
+#include "device_calibration.h"
+#include "aap_framer.h"
+#include "aes_gcm.h"
+#include "channel_dispatcher.h"
+#include "decrypt_pool.h"
+#include "latency_histogram.h"
+#include "load_generator.h"
+#include "memory_profile.h"
+#include "thread_policy.h"
+#include "tls_record.h"
+#include <android/log.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#define LOG_TAG "DeviceCalibration"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+// Each measurement repeats until it has taken this long, or moved this much
+constexpr uint64_t MIN_MEASURE_NS = 200 * 1000 * 1000;
+constexpr uint64_t MAX_MEASURE_BYTES = 256 * 1024 * 1024;
+// Records sealed once, then decrypted over and over
+constexpr size_t DECRYPT_RECORDS = 64;
+constexpr size_t DECRYPT_PLAINTEXT = 16 * 1024;
+// A larger transfer size has to be this much faster to be worth its memory
+constexpr uint64_t TRANSFER_GAIN_PERCENT = 10;
+// Generous, the sessions take a fraction of their stream time
+constexpr auto SESSION_TIMEOUT = std::chrono::seconds(30);
+
+uint64_t megabytesPerSecond(uint64_t bytes, uint64_t ns) {
+    return ns > 0 ? bytes * 1000 / ns : 0;
+}
+
+int popcount(uint64_t mask) {
+    int count = 0;
+    for (; mask; mask &= mask - 1) {
+        count++;
+    }
+    return count;
+}
+
+} // anonymous namespace
+
+constexpr size_t DeviceCalibration::TRANSFER_SIZES[];
+
+DeviceCalibration::DeviceCalibration(const CalibrationConfig& config)
+    : config_(config)
+{
+}
+
+CalibrationResult DeviceCalibration::run() {
+    CalibrationResult result;
+    const CpuTopology& topology = cpuTopology();
+    result.cpuCount = topology.cpuCount;
+    result.bigCores = popcount(topology.bigCores);
+    result.hardwareAes = AesGcm::isHardwareAccelerated();
+    result.copyMBps = measureCopy();
+    result.decryptMBps = measureDecrypt();
+
+    for (size_t transferSize : TRANSFER_SIZES) {
+        const uint64_t mbps = measurePipeline(transferSize);
+        LOGI("Receive path at %zu byte transfers: %llu MB/s", transferSize, static_cast<unsigned long long>(mbps));
+        if (mbps * 100 > result.pipelineMBps * (100 + TRANSFER_GAIN_PERCENT)) {
+            result.pipelineMBps = mbps;
+            result.transferSize = transferSize;
+        }
+    }
+
+    tune(result);
+    LOGI("Calibrated: copy %llu MB/s, decrypt %llu MB/s%s, receive %llu MB/s on %d CPUs (%d big); "
+         "%d x %zu byte transfers, %zu decrypt workers, %zu pool workers",
+         static_cast<unsigned long long>(result.copyMBps), static_cast<unsigned long long>(result.decryptMBps),
+         result.hardwareAes ? " (hardware)" : "", static_cast<unsigned long long>(result.pipelineMBps),
+         result.cpuCount, result.bigCores, result.numTransfers, result.transferSize,
+         result.decryptWorkers, result.poolWorkers);
+    return result;
+}
+
+void DeviceCalibration::tune(CalibrationResult& result) {
+    // Times the heaviest stream the receive path keeps up with
+    const uint64_t headroom = result.pipelineMBps / PEAK_STREAM_MBPS;
+
+    // More transfers in flight keep the phone sending while a slow read
+    // thread catches up, deeper video queues hold what it decrypted meanwhile
+    if (headroom >= 8) {
+        result.numTransfers = 4;
+    } else if (headroom >= 4) {
+        result.numTransfers = 8;
+    } else {
+        result.numTransfers = 16;
+    }
+    if (headroom < 4) {
+        const QueueConfig video = DispatcherConfig().video;
+        result.videoQueueSlots = video.slots * 2;
+        result.videoQueueBytes = video.bytes * 2;
+    }
+    if (result.transferSize == 0) {
+        result.transferSize = TRANSFER_SIZES[0];
+    }
+
+    // Decryption alone taking over a quarter of a core at the peak is worth
+    // spreading, if there are cores to spare for it
+    if (result.decryptMBps < PEAK_STREAM_MBPS * 4 && result.bigCores >= 2 && result.cpuCount >= 4) {
+        result.decryptWorkers = std::min<size_t>(static_cast<size_t>(result.bigCores - 1), DecryptPool::MAX_WORKERS);
+    }
+    // Three lane threads would outnumber the cores left beside the read and audio threads
+    if (result.cpuCount > 0 && result.cpuCount <= 4) {
+        result.poolWorkers = 2;
+    }
+}
+
+uint64_t DeviceCalibration::measureCopy() {
+    const size_t size = std::max<size_t>(config_.copyBytes, 4096);
+    std::vector<uint8_t> from(size, 0x5a);
+    std::vector<uint8_t> to(size);
+
+    uint64_t bytes = 0;
+    const uint64_t start = LatencyHistogram::now();
+    uint64_t elapsed = 0;
+    while (elapsed < MIN_MEASURE_NS && bytes < MAX_MEASURE_BYTES) {
+        std::memcpy(to.data(), from.data(), size);
+        std::swap(from, to);
+        bytes += size;
+        elapsed = LatencyHistogram::now() - start;
+    }
+    return megabytesPerSecond(bytes, elapsed);
+}
+
+uint64_t DeviceCalibration::measureDecrypt() {
+    uint8_t key[16];
+    uint8_t salt[TlsRecordLayer::SALT_SIZE];
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = static_cast<uint8_t>(i * 29 + 7);
+    }
+    std::memset(salt, 0xa5, sizeof(salt));
+    TlsRecordLayer layer;
+    if (!layer.setWriteKey(key, sizeof(key), salt, 0) || !layer.setReadKey(key, sizeof(key), salt, 0)) {
+        LOGE("measureDecrypt: test key rejected");
+        return 0;
+    }
+
+    const size_t recordSize = DECRYPT_PLAINTEXT + TlsRecordLayer::OVERHEAD;
+    std::vector<uint8_t> records(DECRYPT_RECORDS * recordSize);
+    std::vector<uint8_t> plaintext(DECRYPT_PLAINTEXT, 0x3c);
+    for (size_t i = 0; i < DECRYPT_RECORDS; i++) {
+        if (layer.encrypt(plaintext.data(), plaintext.size(), records.data() + i * recordSize) < 0) {
+            LOGE("measureDecrypt: encrypt failed");
+            return 0;
+        }
+    }
+
+    uint64_t bytes = 0;
+    const uint64_t start = LatencyHistogram::now();
+    uint64_t elapsed = 0;
+    while (elapsed < MIN_MEASURE_NS && bytes < MAX_MEASURE_BYTES) {
+        for (size_t i = 0; i < DECRYPT_RECORDS; i++) {
+            if (layer.decryptAt(records.data() + i * recordSize, recordSize, plaintext.data(), i) < 0) {
+                LOGE("measureDecrypt: record %zu failed authentication", i);
+                return 0;
+            }
+        }
+        bytes += DECRYPT_RECORDS * recordSize;
+        elapsed = LatencyHistogram::now() - start;
+    }
+    return megabytesPerSecond(bytes, elapsed);
+}
+
+uint64_t DeviceCalibration::measurePipeline(size_t transferSize) {
+    LoadConfig load;
+    load.seconds = config_.seconds;
+    load.speed = 0;
+    load.width = 1920;
+    load.height = 1080;
+    load.videoKbps = config_.videoKbps;
+    load.transferSize = transferSize;
+
+    LoadGenerator generator;
+    CaptureReadKey key;
+    TlsRecordLayer layer;
+    if (!generator.open(load) || !generator.readKey(key) ||
+        !layer.setReadKey(key.key, key.keyLength, key.salt, key.sequence)) {
+        LOGE("measurePipeline: no synthetic session at %zu byte transfers: %s", transferSize,
+             generator.getLastError());
+        return 0;
+    }
+
+    ChannelDispatcher dispatcher(memoryProfile().dispatcher);
+    const MessageCallback discard = [](int, uint8_t, const uint8_t*, size_t) {};
+    dispatcher.setAudioCallback(discard);
+    dispatcher.setVideoCallback(discard);
+    dispatcher.setControlCallback(discard);
+    dispatcher.setBackgroundCallback(discard);
+    dispatcher.start();
+
+    // Only touched on the generator thread, until the end of the stream
+    AapFramer framer;
+    std::vector<uint8_t> plaintext(AapFramer::MAX_PAYLOAD);
+    uint64_t busyNs = 0;
+    uint64_t bytes = 0;
+    uint64_t failures = 0;
+    generator.setRawDataCallback([&](const uint8_t* data, size_t length) {
+        const uint64_t start = LatencyHistogram::now();
+        framer.feed(data, length, 0, [&](const Record& record) {
+            const int decrypted = layer.decrypt(record.data, record.length, plaintext.data());
+            if (decrypted < 0) {
+                failures++;
+                return;
+            }
+            dispatcher.dispatch(record.channel, record.flags, plaintext.data(), static_cast<size_t>(decrypted));
+        });
+        busyNs += LatencyHistogram::now() - start;
+        bytes += length;
+    });
+
+    std::mutex doneMutex;
+    std::condition_variable doneWake;
+    bool done = false;
+    generator.setErrorCallback([&](int, const char*) {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        done = true;
+        doneWake.notify_all();
+    });
+
+    generator.startReading();
+    bool finished;
+    {
+        std::unique_lock<std::mutex> lock(doneMutex);
+        finished = doneWake.wait_for(lock, SESSION_TIMEOUT, [&] { return done; });
+    }
+    generator.stopReading();
+    dispatcher.stop();
+
+    if (!finished || failures > 0) {
+        LOGE("measurePipeline: session at %zu byte transfers %s, %llu records failed", transferSize,
+             finished ? "finished" : "timed out", static_cast<unsigned long long>(failures));
+        return 0;
+    }
+    return megabytesPerSecond(bytes, busyNs);
+}
+
+} // namespace aap
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace aap {
+
+/**
+ * How long DeviceCalibration measures.
+ */
+struct CalibrationConfig {
+    // Stream time of each synthetic session, generated as fast as possible
+    double seconds = 2.0;
+    // Video bitrate of those sessions, the heaviest stream phones send at 1080p
+    int videoKbps = 20000;
+    // Buffer copied back and forth for the memory bandwidth
+    size_t copyBytes = 8 * 1024 * 1024;
+};
+
+/**
+ * What a calibration run measured on this device, and the pipeline
+ * parameters picked from it. Tuned values of 0 keep the default.
+ */
+struct CalibrationResult {
+    // Measured on one thread, in MB/s
+    uint64_t copyMBps = 0;
+    uint64_t decryptMBps = 0;    // AES-GCM over full 16 KiB records
+    uint64_t pipelineMBps = 0;   // Framing, decryption and dispatch, at transferSize
+    int cpuCount = 0;
+    int bigCores = 0;
+    bool hardwareAes = false;
+
+    // Tuned
+    int numTransfers = 0;        // Bulk IN transfers kept in flight
+    size_t transferSize = 0;     // Bytes per bulk IN transfer
+    size_t decryptWorkers = 0;   // DecryptPool workers, 0 decrypts on the read thread
+    size_t poolWorkers = 0;      // DispatcherConfig::poolWorkers
+    size_t videoQueueSlots = 0;
+    size_t videoQueueBytes = 0;
+};
+
+/**
+ * First-launch calibration of the native pipeline.
+ *
+ * Runs LoadGenerator sessions through the framer, TLS decryption and a
+ * ChannelDispatcher on the calling thread, once per candidate transfer
+ * size, and times the receive path on its own, without the generator.
+ * Plain memcpy and record decryption are timed separately. Takes a
+ * second or two and uses a few MB; call it off the main thread, with no
+ * session running, so the numbers are the device's and not the load's.
+ *
+ * The tuned values compare the receive path against the heaviest stream
+ * a phone sends: a device with little headroom keeps more transfers in
+ * flight and deeper video queues to ride out slow spells, one whose
+ * decryption alone takes a good share of a core spreads it on workers,
+ * and one with few cores runs its lanes on a small pool.
+ */
+class DeviceCalibration {
+public:
+    // The heaviest phone stream, video bursts included
+    static constexpr uint64_t PEAK_STREAM_MBPS = 5;
+    static constexpr size_t TRANSFER_SIZES[] = {16384, 32768, 65536};
+
+    explicit DeviceCalibration(const CalibrationConfig& config = CalibrationConfig());
+
+    // Non-copyable
+    DeviceCalibration(const DeviceCalibration&) = delete;
+    DeviceCalibration& operator=(const DeviceCalibration&) = delete;
+
+    /**
+     * Measure and tune, on the calling thread.
+     */
+    CalibrationResult run();
+
+    /**
+     * The tuned values for a device that measured as result did.
+     */
+    static void tune(CalibrationResult& result);
+
+private:
+    const CalibrationConfig config_;
+
+    uint64_t measureCopy();
+    uint64_t measureDecrypt();
+    // Of the receive path at transferSize, 0 if the session couldn't run
+    uint64_t measurePipeline(size_t transferSize);
+};
+
+} // namespace aap
@@ -0,0 +1,361 @@
+#include "fast_log.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_TAG "FastLog"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace detail {
+std::atomic<int> fastLogPriority{ANDROID_LOG_SILENT};
+} // namespace detail
+
+namespace {
+
+// Entries per thread, and how often AAP-Log drains them
+constexpr size_t RING_ENTRIES = 512;
+constexpr int64_t FLUSH_PERIOD_MS = 20;
+constexpr size_t LINE_SIZE = 512;
+
+struct Entry {
+    uint64_t timestampNs;
+    const char* tag;
+    const char* format;
+    int32_t priority;
+    int32_t count;
+    uint64_t args[detail::FAST_LOG_MAX_ARGS];
+};
+
+/**
+ * One thread's entries: that thread produces, AAP-Log (or flushFastLog()
+ * under flushMutex) consumes. Freed by the consumer once the thread has
+ * exited and everything was written.
+ */
+struct ThreadRing {
+    Entry entries[RING_ENTRIES];
+    alignas(64) std::atomic<uint64_t> head{0};
+    alignas(64) std::atomic<uint64_t> tail{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> closed{false};
+    int tid = 0;
+    char threadName[17] = {0};
+};
+
+struct Logger {
+    std::mutex ringsMutex;
+    std::vector<ThreadRing*> rings;  // Guarded by ringsMutex
+    uint64_t threads = 0;            // Guarded by ringsMutex
+    uint64_t retiredDropped = 0;     // Guarded by ringsMutex
+
+    std::mutex flushMutex;           // One consumer at a time
+    FILE* file = nullptr;            // Guarded by flushMutex
+
+    std::mutex threadMutex;
+    bool started = false;            // Guarded by threadMutex
+
+    std::atomic<uint64_t> written{0};
+};
+
+Logger& logger() {
+    // Never destroyed: threads may log while the process exits
+    static Logger* instance = new Logger();
+    return *instance;
+}
+
+// Marks the ring closed when its thread exits
+struct RingOwner {
+    ThreadRing* ring = nullptr;
+    ~RingOwner() {
+        if (ring) {
+            ring->closed.store(true, std::memory_order_release);
+        }
+    }
+};
+
+thread_local RingOwner ringOwner;
+
+uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+ThreadRing* registerThread() {
+    auto* ring = new ThreadRing();
+    ring->tid = static_cast<int>(syscall(SYS_gettid));
+    prctl(PR_GET_NAME, ring->threadName, 0, 0, 0);
+    Logger& log = logger();
+    {
+        std::lock_guard<std::mutex> lock(log.ringsMutex);
+        log.rings.push_back(ring);
+        log.threads++;
+    }
+    ringOwner.ring = ring;
+    return ring;
+}
+
+// Append one printf conversion of value to out
+size_t formatArg(char* out, size_t size, const char* spec, size_t specLength, const char* length,
+                 char conversion, uint64_t value) {
+    // The spec's flags, width and precision, then our own length modifier
+    char format[32];
+    if (specLength + 4 > sizeof(format)) {
+        return 0;
+    }
+    std::memcpy(format, spec, specLength);
+    size_t at = specLength;
+
+    int written = 0;
+    switch (conversion) {
+        case 'd':
+        case 'i': {
+            long long v = static_cast<long long>(value);
+            if (std::strcmp(length, "hh") == 0) v = static_cast<signed char>(v);
+            else if (std::strcmp(length, "h") == 0) v = static_cast<short>(v);
+            else if (length[0] == '\0') v = static_cast<int>(v);
+            format[at++] = 'l';
+            format[at++] = 'l';
+            format[at++] = conversion;
+            format[at] = '\0';
+            written = std::snprintf(out, size, format, v);
+            break;
+        }
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X': {
+            unsigned long long v = value;
+            if (std::strcmp(length, "hh") == 0) v = static_cast<unsigned char>(v);
+            else if (std::strcmp(length, "h") == 0) v = static_cast<unsigned short>(v);
+            else if (length[0] == '\0') v = static_cast<unsigned int>(v);
+            format[at++] = 'l';
+            format[at++] = 'l';
+            format[at++] = conversion;
+            format[at] = '\0';
+            written = std::snprintf(out, size, format, v);
+            break;
+        }
+        case 'c':
+            format[at++] = 'c';
+            format[at] = '\0';
+            written = std::snprintf(out, size, format, static_cast<int>(value));
+            break;
+        case 'p':
+            format[at++] = 'p';
+            format[at] = '\0';
+            written = std::snprintf(out, size, format, reinterpret_cast<void*>(static_cast<uintptr_t>(value)));
+            break;
+        case 's': {
+            const char* s = reinterpret_cast<const char*>(static_cast<uintptr_t>(value));
+            format[at++] = 's';
+            format[at] = '\0';
+            written = std::snprintf(out, size, format, s ? s : "(null)");
+            break;
+        }
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+            double d;
+            std::memcpy(&d, &value, sizeof(d));
+            format[at++] = conversion;
+            format[at] = '\0';
+            written = std::snprintf(out, size, format, d);
+            break;
+        }
+        default:
+            return 0;
+    }
+    return written > 0 ? std::min(static_cast<size_t>(written), size - 1) : 0;
+}
+
+// printf the entry's format with its stored arguments
+void formatEntry(const Entry& entry, char* out, size_t size) {
+    size_t at = 0;
+    int arg = 0;
+    const char* p = entry.format;
+    while (*p && at + 1 < size) {
+        if (*p != '%') {
+            out[at++] = *p++;
+            continue;
+        }
+        if (p[1] == '%') {
+            out[at++] = '%';
+            p += 2;
+            continue;
+        }
+
+        const char* spec = p++;
+        while (*p && std::strchr("-+ #0", *p)) p++;
+        while (*p && ((*p >= '0' && *p <= '9') || *p == '.')) p++;
+        const size_t specLength = static_cast<size_t>(p - spec);
+        char length[3] = {0};
+        size_t lengthChars = 0;
+        while (*p && std::strchr("hlLqjzt", *p)) {
+            if (lengthChars < 2) {
+                length[lengthChars++] = *p;
+            }
+            p++;
+        }
+        const char conversion = *p;
+        if (!conversion) {
+            break;
+        }
+        p++;
+
+        if (arg >= entry.count) {
+            out[at++] = '?';
+            continue;
+        }
+        at += formatArg(out + at, size - at, spec, specLength, length, conversion, entry.args[arg++]);
+    }
+    out[at] = '\0';
+}
+
+char priorityLetter(int priority) {
+    static const char letters[] = "??VDIWEF";
+    return priority >= 0 && priority < 8 ? letters[priority] : '?';
+}
+
+// Requires flushMutex
+void writeEntry(Logger& log, const ThreadRing& ring, const Entry& entry) {
+    char text[LINE_SIZE];
+    formatEntry(entry, text, sizeof(text));
+    const unsigned long long us = entry.timestampNs / 1000;
+    if (log.file) {
+        std::fprintf(log.file, "%llu.%06llu %d %s %c %s: %s\n", us / 1000000, us % 1000000, ring.tid,
+                     ring.threadName, priorityLetter(entry.priority), entry.tag, text);
+    } else {
+        __android_log_print(entry.priority, entry.tag, "[%llu.%06llu %s] %s", us / 1000000, us % 1000000,
+                            ring.threadName, text);
+    }
+}
+
+void flushRings(Logger& log) {
+    std::lock_guard<std::mutex> flush(log.flushMutex);
+    std::lock_guard<std::mutex> lock(log.ringsMutex);
+    uint64_t written = 0;
+    for (auto it = log.rings.begin(); it != log.rings.end();) {
+        ThreadRing* ring = *it;
+        // Closed first: whatever it wrote before exiting is then visible
+        const bool closed = ring->closed.load(std::memory_order_acquire);
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        for (; tail != head; tail++) {
+            writeEntry(log, *ring, ring->entries[tail % RING_ENTRIES]);
+            written++;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+
+        if (closed) {
+            log.retiredDropped += ring->dropped.load(std::memory_order_relaxed);
+            delete ring;
+            it = log.rings.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (log.file && written > 0) {
+        std::fflush(log.file);
+    }
+    log.written.fetch_add(written, std::memory_order_relaxed);
+}
+
+void flushLoop() {
+    applyThreadPolicy("AAP-Log");
+    Logger& log = logger();
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(FLUSH_PERIOD_MS));
+        flushRings(log);
+    }
+}
+
+} // anonymous namespace
+
+void setFastLogPriority(int priority) {
+    Logger& log = logger();
+    if (priority < ANDROID_LOG_SILENT) {
+        std::lock_guard<std::mutex> lock(log.threadMutex);
+        if (!log.started) {
+            // Lives for the process, like the rings it drains
+            std::thread(flushLoop).detach();
+            log.started = true;
+        }
+    }
+    const int previous = detail::fastLogPriority.exchange(priority, std::memory_order_relaxed);
+    if (previous != priority) {
+        LOGI("Fast log priority %d (points below %d compiled out)", priority, AAP_LOG_MIN_PRIORITY);
+    }
+}
+
+bool setFastLogFile(const char* path) {
+    Logger& log = logger();
+    FILE* file = nullptr;
+    if (path) {
+        file = std::fopen(path, "ae");
+        if (!file) {
+            LOGE("Fast log file %s: %s", path, std::strerror(errno));
+            return false;
+        }
+    }
+    flushRings(log);
+    std::lock_guard<std::mutex> lock(log.flushMutex);
+    if (log.file) {
+        std::fclose(log.file);
+    }
+    log.file = file;
+    return true;
+}
+
+void flushFastLog() {
+    flushRings(logger());
+}
+
+FastLogStats getFastLogStats() {
+    Logger& log = logger();
+    FastLogStats stats = {};
+    stats.written = log.written.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(log.ringsMutex);
+    stats.dropped = log.retiredDropped;
+    for (const ThreadRing* ring : log.rings) {
+        stats.dropped += ring->dropped.load(std::memory_order_relaxed);
+    }
+    stats.threads = log.threads;
+    return stats;
+}
+
+namespace detail {
+
+void fastLogWrite(int priority, const char* tag, const char* format, const uint64_t* args, int count) {
+    ThreadRing* ring = ringOwner.ring;
+    if (!ring) {
+        ring = registerThread();
+    }
+    const uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= RING_ENTRIES) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Entry& entry = ring->entries[head % RING_ENTRIES];
+    entry.timestampNs = monotonicNs();
+    entry.tag = tag;
+    entry.format = format;
+    entry.priority = priority;
+    entry.count = count;
+    std::memcpy(entry.args, args, static_cast<size_t>(count) * sizeof(uint64_t));
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+} // namespace detail
+
+} // namespace aap
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+/**
+ * Fast log points below this android_LogPriority are compiled out.
+ * Set from CMake (AAP_LOG_MIN_PRIORITY); 3 is ANDROID_LOG_DEBUG.
+ */
+#ifndef AAP_LOG_MIN_PRIORITY
+#define AAP_LOG_MIN_PRIORITY 3
+#endif
+
+namespace aap {
+
+/**
+ * Binary logging for hot paths, where __android_log_print would format
+ * and make a syscall on the I/O thread for every packet.
+ *
+ * A log point stores its priority, tag, format and up to MAX_ARGS raw
+ * arguments in a fixed entry of the calling thread's own ring; nothing is
+ * formatted, locked or allocated there. The AAP-Log thread drains every
+ * ring, formats the entries and writes them to logcat or a file. A full
+ * ring drops the entry and counts it rather than wait.
+ *
+ * Points below AAP_LOG_MIN_PRIORITY are compiled out. The rest are off
+ * until setFastLogPriority(): a point below the runtime priority costs one
+ * relaxed load, so they can stay in field builds.
+ *
+ * Tags, formats and %s arguments are stored as pointers and must be
+ * string literals or otherwise live for the whole process. Arguments are
+ * integers, pointers, doubles or such strings.
+ */
+
+namespace detail {
+extern std::atomic<int> fastLogPriority;
+} // namespace detail
+
+inline bool isFastLogged(int priority) {
+    return priority >= detail::fastLogPriority.load(std::memory_order_relaxed);
+}
+
+/**
+ * Record points at priority and above, starting the AAP-Log thread on
+ * first use. ANDROID_LOG_SILENT (the default) turns recording off.
+ */
+void setFastLogPriority(int priority);
+
+/**
+ * Write formatted entries to path instead of logcat, appending.
+ * nullptr goes back to logcat.
+ * @return false if the file could not be opened, logcat is kept then
+ */
+bool setFastLogFile(const char* path);
+
+/**
+ * Format and write everything recorded so far, from the calling thread.
+ */
+void flushFastLog();
+
+struct FastLogStats {
+    uint64_t written;   // Entries formatted and written
+    uint64_t dropped;   // Lost to a full ring
+    uint64_t threads;   // Threads that logged
+};
+FastLogStats getFastLogStats();
+
+namespace detail {
+
+constexpr int FAST_LOG_MAX_ARGS = 6;
+
+// One argument, as the format's conversion will read it
+template <typename T>
+uint64_t fastLogArg(T value) {
+    if constexpr (std::is_floating_point<T>::value) {
+        const double d = static_cast<double>(value);
+        uint64_t bits;
+        std::memcpy(&bits, &d, sizeof(bits));
+        return bits;
+    } else if constexpr (std::is_pointer<T>::value) {
+        return static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value));
+    } else if constexpr (std::is_enum<T>::value) {
+        return static_cast<uint64_t>(static_cast<int64_t>(value));
+    } else if constexpr (std::is_signed<T>::value) {
+        return static_cast<uint64_t>(static_cast<int64_t>(value));
+    } else {
+        return static_cast<uint64_t>(value);
+    }
+}
+
+void fastLogWrite(int priority, const char* tag, const char* format, const uint64_t* args, int count);
+
+template <typename... Args>
+inline void fastLog(int priority, const char* tag, const char* format, Args... args) {
+    static_assert(sizeof...(Args) <= FAST_LOG_MAX_ARGS, "Too many fast log arguments");
+    const uint64_t values[sizeof...(Args) + 1] = {fastLogArg(args)..., 0};
+    fastLogWrite(priority, tag, format, values, static_cast<int>(sizeof...(Args)));
+}
+
+} // namespace detail
+
+// Log point: arguments are only evaluated while the priority is recorded
+#define AAP_FAST_LOG(priority, tag, ...) \
+    do { \
+        if ((priority) >= AAP_LOG_MIN_PRIORITY && ::aap::isFastLogged(priority)) \
+            ::aap::detail::fastLog(priority, tag, __VA_ARGS__); \
+    } while (0)
+
+} // namespace aap
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace aap {
+
+/**
+ * Sleep while word still holds expected, or until the relative timeout
+ * passes (nullptr waits forever). Spurious returns are possible.
+ */
+inline void futexWait(std::atomic<uint32_t>& word, uint32_t expected,
+                      const struct timespec* timeout = nullptr) {
+    syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, expected, timeout, nullptr, 0);
+}
+
+inline void futexWake(std::atomic<uint32_t>& word, int count = INT_MAX) {
+    syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+inline struct timespec relativeTimeout(uint64_t ns) {
+    struct timespec timeout;
+    timeout.tv_sec = static_cast<time_t>(ns / 1000000000ULL);
+    timeout.tv_nsec = static_cast<long>(ns % 1000000000ULL);
+    return timeout;
+}
+
+} // namespace aap
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <time.h>
+
+namespace aap {
+
+/**
+ * Fixed table of objects addressed by generation-tagged handles.
+ *
+ * A handle is the slot index in the low INDEX_BITS and the slot's
+ * generation above them, so a closed handle never reaches the object that
+ * reuses its slot, and 0 is never a valid handle.
+ *
+ * acquire() is lock-free: one compare-and-swap on the slot's state word,
+ * which packs the generation, a closed bit and the number of leases held,
+ * retried only when another lease is taken or dropped at the same moment.
+ * A stale handle is turned away without writing to the slot. To close,
+ * retire() stops new leases and reclaim() waits for the held ones to be
+ * released before handing the object back, so no caller is left with a
+ * destroyed object. Inserting and closing are serialized by a mutex
+ * lookups never take.
+ */
+template <typename T, size_t Capacity = 16>
+class HandleTable {
+    struct Slot;
+
+public:
+    static constexpr int INDEX_BITS = 8;
+    static_assert(Capacity > 0 && Capacity <= (size_t{1} << INDEX_BITS), "Capacity must fit the index bits");
+
+    HandleTable() = default;
+    ~HandleTable() { clear(); }
+
+    // Non-copyable
+    HandleTable(const HandleTable&) = delete;
+    HandleTable& operator=(const HandleTable&) = delete;
+
+    /**
+     * Keeps the object of an open handle alive until destroyed.
+     * Empty if the handle was not open.
+     */
+    class Lease {
+    public:
+        Lease() = default;
+        ~Lease() { reset(); }
+
+        Lease(Lease&& other) noexcept : slot_(other.slot_), object_(other.object_) {
+            other.slot_ = nullptr;
+            other.object_ = nullptr;
+        }
+
+        Lease& operator=(Lease&& other) noexcept {
+            if (this != &other) {
+                reset();
+                slot_ = other.slot_;
+                object_ = other.object_;
+                other.slot_ = nullptr;
+                other.object_ = nullptr;
+            }
+            return *this;
+        }
+
+        // Non-copyable
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        T* get() const { return object_; }
+        T* operator->() const { return object_; }
+        explicit operator bool() const { return object_ != nullptr; }
+
+        void reset() {
+            if (slot_) {
+                slot_->state.fetch_sub(1, std::memory_order_release);
+                slot_ = nullptr;
+                object_ = nullptr;
+            }
+        }
+
+    private:
+        friend class HandleTable;
+        Lease(Slot* slot, T* object) : slot_(slot), object_(object) {}
+
+        Slot* slot_ = nullptr;
+        T* object_ = nullptr;
+    };
+
+    static size_t indexOf(int64_t handle) {
+        return static_cast<size_t>(handle) & INDEX_MASK;
+    }
+
+    /**
+     * Store object in the lowest free slot.
+     * @return Its handle, or 0 if every slot is taken
+     */
+    int64_t insert(std::unique_ptr<T> object) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t index = 0; index < Capacity; index++) {
+            Slot& slot = slots_[index];
+            if (slot.object) {
+                continue;  // Open, or retired and not reclaimed yet
+            }
+            slot.object = std::move(object);
+
+            // Closed with no leases, nothing else writes the state until it opens
+            const uint64_t state = slot.state.load(std::memory_order_relaxed);
+            uint64_t generation = ((state >> GENERATION_SHIFT) + 1) & GENERATION_MASK;
+            if (generation == 0) {
+                generation = 1;
+            }
+            slot.state.store(generation << GENERATION_SHIFT, std::memory_order_release);
+            return static_cast<int64_t>((generation << INDEX_BITS) | index);
+        }
+        return 0;
+    }
+
+    /**
+     * A lease on handle's object, empty for a handle that is not open or
+     * was retired.
+     */
+    Lease acquire(int64_t handle) {
+        Slot* slot = slotOf(handle);
+        if (!slot) {
+            return Lease();
+        }
+        uint64_t state = slot->state.load(std::memory_order_acquire);
+        do {
+            if ((state & CLOSED) != 0 || (state >> GENERATION_SHIFT) != generationOf(handle)) {
+                return Lease();
+            }
+        } while (!slot->state.compare_exchange_weak(state, state + 1, std::memory_order_acquire,
+                                                    std::memory_order_acquire));
+        return Lease(slot, slot->object.get());
+    }
+
+    /**
+     * Stop handing out leases for handle. Leases already held stay valid
+     * until reclaim(), so the object can be shut down first to unblock them.
+     * @return The object, still owned by the table, or nullptr if handle is not open
+     */
+    T* retire(int64_t handle) {
+        Slot* slot = slotOf(handle);
+        if (!slot) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t state = slot->state.load(std::memory_order_relaxed);
+        do {
+            if ((state & CLOSED) != 0 || (state >> GENERATION_SHIFT) != generationOf(handle)) {
+                return nullptr;
+            }
+        } while (!slot->state.compare_exchange_weak(state, state | CLOSED, std::memory_order_acq_rel,
+                                                    std::memory_order_relaxed));
+        return slot->object.get();
+    }
+
+    /**
+     * Wait until every lease on a retired handle is released, then free
+     * its slot. Must not be called while holding a lease on it.
+     * @return The object, or nullptr if handle was not retired
+     */
+    std::unique_ptr<T> reclaim(int64_t handle) {
+        Slot* slot = slotOf(handle);
+        if (!slot) {
+            return nullptr;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const uint64_t state = slot->state.load(std::memory_order_relaxed);
+            if ((state & CLOSED) == 0 || (state >> GENERATION_SHIFT) != generationOf(handle) || !slot->object) {
+                return nullptr;
+            }
+        }
+
+        // Leases are held across one JNI call; closing is rare, poll for them
+        for (int spins = 0; (slot->state.load(std::memory_order_acquire) & LEASE_MASK) != 0; spins++) {
+            if (spins < 64) {
+                std::this_thread::yield();
+            } else {
+                const struct timespec pause = {0, 1000000};
+                nanosleep(&pause, nullptr);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::move(slot->object);
+    }
+
+    /**
+     * Retire and reclaim every open handle.
+     */
+    void clear() {
+        for (size_t index = 0; index < Capacity; index++) {
+            const uint64_t state = slots_[index].state.load(std::memory_order_acquire);
+            const int64_t handle = static_cast<int64_t>(((state >> GENERATION_SHIFT) << INDEX_BITS) | index);
+            retire(handle);
+            reclaim(handle);
+        }
+    }
+
+private:
+    static constexpr uint64_t INDEX_MASK = (uint64_t{1} << INDEX_BITS) - 1;
+    // State word: leases held, closed bit, generation
+    static constexpr uint64_t LEASE_MASK = (uint64_t{1} << 31) - 1;
+    static constexpr uint64_t CLOSED = uint64_t{1} << 31;
+    static constexpr int GENERATION_SHIFT = 32;
+    static constexpr uint64_t GENERATION_MASK = 0xFFFFFFFFULL;
+
+    struct Slot {
+        // A free slot is closed, generation 0 is never handed out
+        std::atomic<uint64_t> state{CLOSED};
+        // Written under mutex_ while no lease can be taken
+        std::unique_ptr<T> object;
+    };
+
+    static uint64_t generationOf(int64_t handle) {
+        return (static_cast<uint64_t>(handle) >> INDEX_BITS) & GENERATION_MASK;
+    }
+
+    Slot* slotOf(int64_t handle) {
+        if (handle <= 0 || indexOf(handle) >= Capacity) {
+            return nullptr;
+        }
+        return &slots_[indexOf(handle)];
+    }
+
+    std::mutex mutex_;
+    Slot slots_[Capacity];
+};
+
+} // namespace aap
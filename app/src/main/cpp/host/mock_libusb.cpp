@@ -0,0 +1,515 @@
+#include "mock_usb.h"
+#include "libusb.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * The subset of libusb that UsbConnection uses, backed by MockUsbDevice
+ * instead of usbfs. Only built off-device.
+ */
+
+struct libusb_context {
+    int eventFd = -1;
+    libusb_pollfd pollfd = {};
+    // Completed transfers waiting for libusb_handle_events, under device mutex
+    std::deque<libusb_transfer*> completed;
+};
+
+struct libusb_device {
+    int unused = 0;
+};
+
+struct libusb_device_handle {
+    libusb_context* context = nullptr;
+    libusb_device device;
+};
+
+namespace aap {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr uint8_t IN_ENDPOINT = 0x81;
+constexpr uint8_t OUT_ENDPOINT = 0x01;
+constexpr uint16_t MAX_PACKET_SIZE = 512;
+
+struct Device {
+    std::mutex mutex;
+    std::condition_variable wake;       // Device thread: work or stop
+    std::condition_variable progress;   // Completions queued or delivered
+
+    libusb_device_handle* handle = nullptr;
+    std::thread thread;
+    bool stopping = false;
+    bool disconnected = false;
+
+    std::deque<libusb_transfer*> inPending;
+    std::deque<libusb_transfer*> outPending;
+    std::deque<std::vector<uint8_t>> inbound;
+    int failStatus = LIBUSB_TRANSFER_ERROR;
+    int failCount = 0;
+    bool halted = false;
+    size_t inboundOffset = 0;  // Into inbound.front()
+    int callbacksRunning = 0;
+
+    Clock::duration period = Clock::duration::zero();
+    Clock::time_point nextDue;
+
+    std::function<void(const uint8_t*, size_t)> writeCallback;
+    MockUsbStats stats = {};
+};
+
+Device& device() {
+    static Device instance;
+    return instance;
+}
+
+bool isIn(const libusb_transfer* transfer) {
+    return (transfer->endpoint & LIBUSB_ENDPOINT_DIR_MASK) == LIBUSB_ENDPOINT_IN;
+}
+
+// Called with the device mutex held
+void complete(Device& d, libusb_transfer* transfer, libusb_transfer_status status) {
+    transfer->status = status;
+    if (!d.handle) {
+        return;
+    }
+    d.handle->context->completed.push_back(transfer);
+    const uint64_t one = 1;
+    if (::write(d.handle->context->eventFd, &one, sizeof(one)) < 0) {
+        // Counter overflow only, the fd is readable either way
+    }
+    d.progress.notify_all();
+}
+
+// Called with the device mutex held: copy the next fed chunk into buffer
+size_t takeInbound(Device& d, uint8_t* buffer, size_t length) {
+    std::vector<uint8_t>& chunk = d.inbound.front();
+    const size_t count = std::min(length, chunk.size() - d.inboundOffset);
+    std::memcpy(buffer, chunk.data() + d.inboundOffset, count);
+    d.inboundOffset += count;
+    if (d.inboundOffset == chunk.size()) {
+        d.inbound.pop_front();
+        d.inboundOffset = 0;
+    }
+    d.stats.bytesRead += count;
+    return count;
+}
+
+void deviceLoop() {
+    Device& d = device();
+    std::unique_lock<std::mutex> lock(d.mutex);
+    while (!d.stopping) {
+        if (!d.outPending.empty()) {
+            libusb_transfer* transfer = d.outPending.front();
+            d.outPending.pop_front();
+            auto callback = d.writeCallback;
+            lock.unlock();
+            if (callback) {
+                callback(transfer->buffer, static_cast<size_t>(transfer->length));
+            }
+            lock.lock();
+            transfer->actual_length = transfer->length;
+            d.stats.outCompleted++;
+            d.stats.bytesWritten += static_cast<uint64_t>(transfer->length);
+            complete(d, transfer, LIBUSB_TRANSFER_COMPLETED);
+            continue;
+        }
+        if (d.disconnected) {
+            while (!d.inPending.empty()) {
+                complete(d, d.inPending.front(), LIBUSB_TRANSFER_NO_DEVICE);
+                d.inPending.pop_front();
+            }
+        }
+        if (!d.inPending.empty() && (d.halted || d.failCount > 0)) {
+            libusb_transfer* transfer = d.inPending.front();
+            d.inPending.pop_front();
+            if (!d.halted) {
+                d.failCount--;
+                d.halted = d.failStatus == LIBUSB_TRANSFER_STALL;
+            }
+            d.stats.inFailed++;
+            complete(d, transfer, d.halted ? LIBUSB_TRANSFER_STALL : static_cast<libusb_transfer_status>(d.failStatus));
+            continue;
+        }
+        if (d.inPending.empty() || d.inbound.empty()) {
+            d.wake.wait(lock);
+            continue;
+        }
+        if (d.period != Clock::duration::zero()) {
+            const Clock::time_point now = Clock::now();
+            if (now < d.nextDue) {
+                d.wake.wait_until(lock, d.nextDue);
+                continue;
+            }
+            d.nextDue = std::max(d.nextDue + d.period, now - d.period);
+        }
+
+        libusb_transfer* transfer = d.inPending.front();
+        d.inPending.pop_front();
+        transfer->actual_length = static_cast<int>(
+            takeInbound(d, transfer->buffer, static_cast<size_t>(transfer->length)));
+        d.stats.inCompleted++;
+        complete(d, transfer, LIBUSB_TRANSFER_COMPLETED);
+    }
+}
+
+} // anonymous namespace
+
+void mockUsbReset() {
+    Device& d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    d.inbound.clear();
+    d.inboundOffset = 0;
+    d.disconnected = false;
+    d.failCount = 0;
+    d.halted = false;
+    d.period = Clock::duration::zero();
+    d.writeCallback = nullptr;
+    d.stats = {};
+}
+
+void mockUsbFeed(const uint8_t* data, size_t length) {
+    if (length == 0) {
+        return;
+    }
+    Device& d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    d.inbound.emplace_back(data, data + length);
+    d.wake.notify_one();
+}
+
+void mockUsbSetCompletionRate(double transfersPerSecond) {
+    Device& d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    d.period = transfersPerSecond > 0
+        ? std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / transfersPerSecond))
+        : Clock::duration::zero();
+    d.nextDue = Clock::now();
+    d.wake.notify_one();
+}
+
+void mockUsbDisconnect() {
+    Device& d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    d.disconnected = true;
+    d.wake.notify_one();
+}
+
+void mockUsbFailIn(int status, int count) {
+    Device& d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    d.failStatus = status;
+    d.failCount = count;
+    d.wake.notify_one();
+}
+
+void mockUsbSetWriteCallback(std::function<void(const uint8_t* data, size_t length)> callback) {
+    Device& d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    d.writeCallback = std::move(callback);
+}
+
+bool mockUsbWaitIdle(int timeoutMs) {
+    Device& d = device();
+    std::unique_lock<std::mutex> lock(d.mutex);
+    return d.progress.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&d] {
+        return d.inbound.empty() && d.callbacksRunning == 0 &&
+               (!d.handle || d.handle->context->completed.empty());
+    });
+}
+
+MockUsbStats getMockUsbStats() {
+    Device& d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    return d.stats;
+}
+
+} // namespace aap
+
+using aap::Device;
+using aap::device;
+
+int LIBUSB_CALLV libusb_set_option(libusb_context*, enum libusb_option, ...) {
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_init(libusb_context** ctx) {
+    auto* context = new libusb_context();
+    context->eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (context->eventFd < 0) {
+        delete context;
+        return LIBUSB_ERROR_NO_MEM;
+    }
+    context->pollfd.fd = context->eventFd;
+    context->pollfd.events = POLLIN;
+    *ctx = context;
+    return LIBUSB_SUCCESS;
+}
+
+void LIBUSB_CALL libusb_exit(libusb_context* ctx) {
+    if (ctx) {
+        ::close(ctx->eventFd);
+        delete ctx;
+    }
+}
+
+const char* LIBUSB_CALL libusb_error_name(int errorCode) {
+    switch (errorCode) {
+        case LIBUSB_SUCCESS: return "LIBUSB_SUCCESS";
+        case LIBUSB_ERROR_IO: return "LIBUSB_ERROR_IO";
+        case LIBUSB_ERROR_INVALID_PARAM: return "LIBUSB_ERROR_INVALID_PARAM";
+        case LIBUSB_ERROR_BUSY: return "LIBUSB_ERROR_BUSY";
+        case LIBUSB_ERROR_NO_DEVICE: return "LIBUSB_ERROR_NO_DEVICE";
+        case LIBUSB_ERROR_TIMEOUT: return "LIBUSB_ERROR_TIMEOUT";
+        case LIBUSB_ERROR_NO_MEM: return "LIBUSB_ERROR_NO_MEM";
+        default: return "LIBUSB_ERROR_OTHER";
+    }
+}
+
+int LIBUSB_CALL libusb_wrap_sys_device(libusb_context* ctx, intptr_t, libusb_device_handle** devHandle) {
+    Device& d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    if (d.handle) {
+        return LIBUSB_ERROR_BUSY;
+    }
+    d.handle = new libusb_device_handle();
+    d.handle->context = ctx;
+    d.stopping = false;
+    d.nextDue = aap::Clock::now();
+    d.thread = std::thread(aap::deviceLoop);
+    *devHandle = d.handle;
+    return LIBUSB_SUCCESS;
+}
+
+void LIBUSB_CALL libusb_close(libusb_device_handle* devHandle) {
+    Device& d = device();
+    {
+        std::lock_guard<std::mutex> lock(d.mutex);
+        if (d.handle != devHandle) {
+            return;
+        }
+        d.stopping = true;
+        d.wake.notify_one();
+    }
+    d.thread.join();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    d.inPending.clear();
+    d.outPending.clear();
+    d.handle = nullptr;
+    d.progress.notify_all();
+    delete devHandle;
+}
+
+libusb_device* LIBUSB_CALL libusb_get_device(libusb_device_handle* devHandle) {
+    return &devHandle->device;
+}
+
+int LIBUSB_CALL libusb_get_device_speed(libusb_device*) {
+    return LIBUSB_SPEED_HIGH;
+}
+
+int LIBUSB_CALL libusb_get_active_config_descriptor(libusb_device*, libusb_config_descriptor** config) {
+    // One interface with a bulk endpoint pair, like the accessory interface
+    auto* endpoints = static_cast<libusb_endpoint_descriptor*>(calloc(2, sizeof(libusb_endpoint_descriptor)));
+    endpoints[0].bEndpointAddress = aap::IN_ENDPOINT;
+    endpoints[0].bmAttributes = LIBUSB_TRANSFER_TYPE_BULK;
+    endpoints[0].wMaxPacketSize = aap::MAX_PACKET_SIZE;
+    endpoints[1].bEndpointAddress = aap::OUT_ENDPOINT;
+    endpoints[1].bmAttributes = LIBUSB_TRANSFER_TYPE_BULK;
+    endpoints[1].wMaxPacketSize = aap::MAX_PACKET_SIZE;
+
+    auto* altsetting = static_cast<libusb_interface_descriptor*>(calloc(1, sizeof(libusb_interface_descriptor)));
+    altsetting->bNumEndpoints = 2;
+    altsetting->endpoint = endpoints;
+
+    auto* interface = static_cast<libusb_interface*>(calloc(1, sizeof(libusb_interface)));
+    interface->altsetting = altsetting;
+    interface->num_altsetting = 1;
+
+    *config = static_cast<libusb_config_descriptor*>(calloc(1, sizeof(libusb_config_descriptor)));
+    (*config)->bNumInterfaces = 1;
+    (*config)->interface = interface;
+    return LIBUSB_SUCCESS;
+}
+
+void LIBUSB_CALL libusb_free_config_descriptor(libusb_config_descriptor* config) {
+    if (!config) {
+        return;
+    }
+    free(const_cast<libusb_endpoint_descriptor*>(config->interface->altsetting->endpoint));
+    free(const_cast<libusb_interface_descriptor*>(config->interface->altsetting));
+    free(const_cast<libusb_interface*>(config->interface));
+    free(config);
+}
+
+int LIBUSB_CALL libusb_claim_interface(libusb_device_handle*, int) {
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_clear_halt(libusb_device_handle*, unsigned char endpoint) {
+    Device& d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    if (d.disconnected) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    if (endpoint == aap::IN_ENDPOINT) {
+        d.halted = false;
+        d.stats.haltsCleared++;
+        d.wake.notify_one();
+    }
+    return LIBUSB_SUCCESS;
+}
+
+// No usbfs mapping: UsbConnection falls back to heap buffers
+unsigned char* LIBUSB_CALL libusb_dev_mem_alloc(libusb_device_handle*, size_t) {
+    return nullptr;
+}
+
+int LIBUSB_CALL libusb_dev_mem_free(libusb_device_handle*, unsigned char*, size_t) {
+    return LIBUSB_SUCCESS;
+}
+
+libusb_transfer* LIBUSB_CALL libusb_alloc_transfer(int isoPackets) {
+    const size_t size = sizeof(libusb_transfer) +
+                        static_cast<size_t>(isoPackets) * sizeof(libusb_iso_packet_descriptor);
+    return static_cast<libusb_transfer*>(calloc(1, size));
+}
+
+void LIBUSB_CALL libusb_free_transfer(libusb_transfer* transfer) {
+    if (transfer && (transfer->flags & LIBUSB_TRANSFER_FREE_BUFFER)) {
+        free(transfer->buffer);
+    }
+    free(transfer);
+}
+
+int LIBUSB_CALL libusb_submit_transfer(libusb_transfer* transfer) {
+    Device& d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    if (d.disconnected) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    if (!d.handle || transfer->dev_handle != d.handle) {
+        return LIBUSB_ERROR_INVALID_PARAM;
+    }
+    transfer->actual_length = 0;
+    (aap::isIn(transfer) ? d.inPending : d.outPending).push_back(transfer);
+    d.wake.notify_one();
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_cancel_transfer(libusb_transfer* transfer) {
+    Device& d = device();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    std::deque<libusb_transfer*>& pending = aap::isIn(transfer) ? d.inPending : d.outPending;
+    auto it = std::find(pending.begin(), pending.end(), transfer);
+    if (it == pending.end()) {
+        return LIBUSB_ERROR_NOT_FOUND;
+    }
+    pending.erase(it);
+    aap::complete(d, transfer, LIBUSB_TRANSFER_CANCELLED);
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_bulk_transfer(libusb_device_handle*, unsigned char endpoint,
+                                     unsigned char* data, int length, int* transferred,
+                                     unsigned int timeout) {
+    Device& d = device();
+    *transferred = 0;
+    if ((endpoint & LIBUSB_ENDPOINT_DIR_MASK) != LIBUSB_ENDPOINT_IN) {
+        std::function<void(const uint8_t*, size_t)> callback;
+        {
+            std::lock_guard<std::mutex> lock(d.mutex);
+            if (d.disconnected) {
+                return LIBUSB_ERROR_NO_DEVICE;
+            }
+            callback = d.writeCallback;
+            d.stats.bytesWritten += static_cast<uint64_t>(length);
+        }
+        if (callback) {
+            callback(data, static_cast<size_t>(length));
+        }
+        *transferred = length;
+        return LIBUSB_SUCCESS;
+    }
+
+    std::unique_lock<std::mutex> lock(d.mutex);
+    const auto ready = [&d] { return !d.inbound.empty() || d.disconnected; };
+    if (timeout == 0) {
+        d.progress.wait(lock, ready);
+    } else if (!d.progress.wait_for(lock, std::chrono::milliseconds(timeout), ready)) {
+        return LIBUSB_ERROR_TIMEOUT;
+    }
+    if (d.inbound.empty()) {
+        return LIBUSB_ERROR_NO_DEVICE;
+    }
+    *transferred = static_cast<int>(aap::takeInbound(d, data, static_cast<size_t>(length)));
+    d.progress.notify_all();
+    return LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_handle_events_timeout_completed(libusb_context* ctx, struct timeval* tv, int*) {
+    Device& d = device();
+    uint64_t value;
+    while (::read(ctx->eventFd, &value, sizeof(value)) > 0) {
+    }
+
+    std::deque<libusb_transfer*> completed;
+    {
+        std::unique_lock<std::mutex> lock(d.mutex);
+        if (ctx->completed.empty() && tv && (tv->tv_sec > 0 || tv->tv_usec > 0)) {
+            d.progress.wait_for(lock, std::chrono::seconds(tv->tv_sec) + std::chrono::microseconds(tv->tv_usec),
+                                [ctx] { return !ctx->completed.empty(); });
+        }
+        completed.swap(ctx->completed);
+        d.callbacksRunning++;
+    }
+    for (libusb_transfer* transfer : completed) {
+        transfer->callback(transfer);
+    }
+
+    std::lock_guard<std::mutex> lock(d.mutex);
+    d.callbacksRunning--;
+    d.progress.notify_all();
+    return d.disconnected && d.inPending.empty() ? LIBUSB_ERROR_NO_DEVICE : LIBUSB_SUCCESS;
+}
+
+int LIBUSB_CALL libusb_handle_events(libusb_context* ctx) {
+    struct timeval tv = {60, 0};
+    return libusb_handle_events_timeout_completed(ctx, &tv, nullptr);
+}
+
+int LIBUSB_CALL libusb_pollfds_handle_timeouts(libusb_context*) {
+    // Mock transfers never time out
+    return 1;
+}
+
+int LIBUSB_CALL libusb_get_next_timeout(libusb_context*, struct timeval*) {
+    return 0;
+}
+
+const struct libusb_pollfd** LIBUSB_CALL libusb_get_pollfds(libusb_context* ctx) {
+    auto** pollfds = static_cast<const libusb_pollfd**>(calloc(2, sizeof(libusb_pollfd*)));
+    pollfds[0] = &ctx->pollfd;
+    return pollfds;
+}
+
+void LIBUSB_CALL libusb_free_pollfds(const struct libusb_pollfd** pollfds) {
+    free(pollfds);
+}
+
+void LIBUSB_CALL libusb_set_pollfd_notifiers(libusb_context*, libusb_pollfd_added_cb,
+                                             libusb_pollfd_removed_cb, void*) {
+    // The eventfd is the only pollfd and never changes
+}
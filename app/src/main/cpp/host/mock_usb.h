@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+namespace aap {
+
+/**
+ * The phone on the other end of the host build's libusb stand-in
+ * (mock_libusb.cpp), which replaces the real library off-device so
+ * UsbConnection runs unchanged on a workstation.
+ *
+ * One device exists at a time, wrapped by libusb_wrap_sys_device()
+ * whatever the descriptor. Its thread completes submitted IN transfers
+ * with the fed bytes, at most at the configured rate, and completes OUT
+ * transfers at once; completions reach the event loop through a pollfd
+ * like real ones.
+ */
+
+/**
+ * Forget queued bytes, callbacks, rate and statistics; reconnects a
+ * disconnected device. Call with no connection open.
+ */
+void mockUsbReset();
+
+/**
+ * Queue bytes sent by the phone. Each call completes one IN transfer,
+ * or several if it is longer than the transfer. Safe from any thread.
+ */
+void mockUsbFeed(const uint8_t* data, size_t length);
+
+/**
+ * Pace IN completions.
+ * @param transfersPerSecond 0 completes them as fast as they are resubmitted
+ */
+void mockUsbSetCompletionRate(double transfersPerSecond);
+
+/**
+ * Unplug: pending IN transfers fail with LIBUSB_TRANSFER_NO_DEVICE and
+ * new submissions with LIBUSB_ERROR_NO_DEVICE.
+ */
+void mockUsbDisconnect();
+
+/**
+ * Fail the next count IN transfers with status (a libusb_transfer_status)
+ * instead of completing them, without consuming fed bytes. A STALL also
+ * halts the endpoint: every IN transfer then stalls until libusb_clear_halt().
+ */
+void mockUsbFailIn(int status, int count);
+
+/**
+ * Receives every OUT transfer and synchronous write, on the device thread
+ * or the writer's. Set before opening the connection.
+ */
+void mockUsbSetWriteCallback(std::function<void(const uint8_t* data, size_t length)> callback);
+
+/**
+ * Wait until every fed byte has been delivered and its completion
+ * callback has returned.
+ * @return false on timeout
+ */
+bool mockUsbWaitIdle(int timeoutMs);
+
+struct MockUsbStats {
+    uint64_t inCompleted;
+    uint64_t bytesRead;
+    uint64_t outCompleted;
+    uint64_t bytesWritten;
+    uint64_t inFailed;
+    uint64_t haltsCleared;
+};
+MockUsbStats getMockUsbStats();
+
+} // namespace aap
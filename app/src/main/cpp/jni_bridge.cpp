@@ -1,44 +1,246 @@
 #include <jni.h>
 #include <android/log.h>
+#include <android/native_window_jni.h>
 #include "usb_connection.h"
-#include <unordered_map>
+#include "usb_context.h"
+#include "tcp_connection.h"
+#include "replay_transport.h"
+#include "load_generator.h"
+#include "device_calibration.h"
+#include "shadow_framer.h"
+#include "session_capture.h"
+#include "aap_framer.h"
+#include "latency_histogram.h"
+#include "channel_dispatcher.h"
+#include "tls_record.h"
+#include "decrypt_pool.h"
+#include "record_pool.h"
+#include "audio_output.h"
+#include "media_clock.h"
+#include "media_ack.h"
+#include "control_responder.h"
+#include "sensor_aggregator.h"
+#include "touch_input.h"
+#include "mic_input.h"
+#include "shared_record_ring.h"
+#include "jni_threads.h"
+#include "video_assembler.h"
+#include "video_decoder.h"
+#include "nal_scanner.h"
+#include "sps_parser.h"
+#include "thread_policy.h"
+#include "handle_table.h"
+#include "streaming_memory.h"
+#include "memory_profile.h"
+#include "quality_governor.h"
+#include "stall_watchdog.h"
+#include "stats_export.h"
+#include "trace.h"
+#include "fast_log.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <mutex>
+#include <vector>
 
 #define LOG_TAG "JNI_Bridge"
 #define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+#define LOGD_FAST(...) AAP_FAST_LOG(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
 
 namespace {
 
 // Connection handle management
 struct ConnectionHandle {
-    std::unique_ptr<aap::UsbConnection> connection;
+    // USB, or TCP for wireless: the pipeline below only uses the Transport surface
+    std::unique_ptr<aap::Transport> transport;
+    // Backend extras (zero-copy slots, socket stats), null for the other backend
+    aap::UsbConnection* usb = nullptr;
+    aap::TcpConnection* tcp = nullptr;
+    aap::ReplayTransport* replay = nullptr;
+    aap::LoadGenerator* loadGenerator = nullptr;
+    // This connection's NativeUsb.Callbacks, every upcall goes to it
+    jobject callbacks = nullptr;
+    // Slice of the CPUs its dispatcher and decrypt threads run on
+    int cpuShare = 0;
+    // Optional: inbound bytes and the read key are written to a capture file
+    std::unique_ptr<aap::SessionCapture> capture;
+    std::unique_ptr<aap::AapFramer> framer;
+    // Optional while Kotlin parses: the native framer runs on the same
+    // transfers and is checked against it, see nativeSetShadowFramingEnabled()
+    std::unique_ptr<aap::ShadowFramer> shadow;
+    // Always on: every native stage records into it, see nativeGetStats()
+    aap::PipelineLatency latency;
+    // Reused for every record upcall, Kotlin must not retain it
+    jbyteArray recordBuffer = nullptr;
+
+    // Native dispatch mode: Kotlin decrypts into plaintextBuffer on the
+    // USB thread, records are then delivered on the dispatcher threads
+    std::unique_ptr<aap::ChannelDispatcher> dispatcher;
+    // Per channel id, unknown ids share the last: reused for every record
+    // of the channel, which one thread at a time delivers. Kotlin must not
+    // retain it
+    jbyteArray channelRecordBuffers[aap::Channel::COUNT + 1] = {};
+    jobject plaintextBuffer = nullptr;
+    uint8_t* plaintext = nullptr;
+    size_t plaintextCapacity = 0;
+
+    // Set once the handshake keys are exported: records are then
+    // decrypted in place on the USB thread without a Kotlin upcall
+    std::unique_ptr<aap::TlsRecordLayer> recordLayer;
+    // Records held across threads come from preallocated slabs
+    std::unique_ptr<aap::RecordPool> recordPool;
+    // Optional: large video records are decrypted on worker threads
+    std::unique_ptr<aap::DecryptPool> decryptPool;
+
+    // Set once the write keys are exported: outgoing messages are sealed
+    // in txRecord and gathered behind their header into the TX path,
+    // without a Kotlin allocation
+    std::unique_ptr<aap::TlsRecordLayer> writeLayer;
+    std::unique_ptr<uint8_t[]> txRecord;
+    // Held from encrypt to write, so sequence numbers reach the wire in order
+    std::mutex txRecordMutex;
+
+    // Optional: pings are answered and media ACKs sent from native code,
+    // needs the write layer. Declared ahead of ackBatcher, which uses it
+    std::unique_ptr<aap::ControlResponder> responder;
+    std::atomic<aap::ControlResponder*> responderStage{nullptr};
+
+    // Optional: media ACKs of natively consumed records are coalesced
+    std::unique_ptr<aap::MediaAckBatcher> ackBatcher;
+    std::atomic<aap::MediaAckBatcher*> ackStage{nullptr};
+
+    // Optional: sensor updates are coalesced into one record per window
+    std::unique_ptr<aap::SensorAggregator> sensorAggregator;
+
+    // Optional: touch samples are encoded on AAP-Input and written by Kotlin at once
+    std::unique_ptr<aap::TouchInput> touchInput;
+    // Reused for every input record upcall, Kotlin must not retain it
+    jbyteArray inputRecordBuffer = nullptr;
+
+    // Optional: control records are published to a ring Kotlin drains itself
+    std::unique_ptr<aap::SharedRecordRing> controlRing;
+    std::atomic<aap::SharedRecordRing*> controlRingStage{nullptr};
+    // The ring has one producer: pooled control channels take turns
+    std::mutex controlRingMutex;
+
+    // Optional: the microphone is captured natively, records go to Kotlin to encrypt
+    std::unique_ptr<aap::MicInput> micInput;
+
+    // Native audio drives it for the decoder in A/V sync, outlives both
+    aap::MediaClock mediaClock;
+
+    // Optional: audio PCM is played natively from the AAP-Audio thread
+    std::unique_ptr<aap::AudioOutput> audioOutput;
+    std::atomic<aap::AudioOutput*> audioStage{nullptr};
+
+    // Optional: video media is reassembled natively on the dispatcher's
+    // video thread, only a per-record notification reaches Kotlin
+    std::unique_ptr<aap::VideoAssembler> videoAssembler;
+    std::atomic<aap::VideoAssembler*> videoStage{nullptr};
+    uint64_t videoDropsSeen = 0;    // Video thread only
+    // Projection in the background: video media skips the video lane and
+    // is screened for keyframes by the dispatching thread, see nativeSetIdle()
+    std::atomic<bool> videoIdle{false};
+    // Optional: frames are decoded with AMediaCodec without reaching Kotlin
+    std::unique_ptr<aap::VideoDecoder> videoDecoder;
+    std::atomic<aap::VideoDecoder*> decoderStage{nullptr};
+
+    // Optional: thermal status and load throttle the decrypt workers and
+    // the background lane, samples the dispatcher and the decoder
+    std::unique_ptr<aap::QualityGovernor> governor;
+    // Optional: heartbeats of the pipeline threads are checked, a stall
+    // writes a diagnostic snapshot, see nativeSetStallWatchdogEnabled()
+    std::unique_ptr<aap::StallWatchdog> watchdog;
+    // Optional: the stats are published to a mapped file for readers
+    // outside JNI, see nativeSetStatsExportEnabled()
+    std::unique_ptr<aap::StatsExport> statsExport;
 };
 
-std::mutex handlesMutex;
-std::unordered_map<jlong, std::unique_ptr<ConnectionHandle>> handles;
-jlong nextHandle = 1;
+// Every JNI call leases its connection, so nativeClose() can't free it mid-call
+using HandleTable = aap::HandleTable<ConnectionHandle>;
+using HandleLease = HandleTable::Lease;
+HandleTable handles;
+
+// Held from the first USB connection on: libusb, its event thread and the
+// recycled transfer pools survive reconnects
+std::mutex contextMutex;
+std::shared_ptr<aap::UsbContext> usbContext;  // Guarded by contextMutex
+
+// Longest heap array write done inside a JNI critical region
+constexpr jint MAX_CRITICAL_WRITE = 64 * 1024;
+
+// Largest TLS plaintext fragment (RFC 5246); longer outgoing messages
+// are split into FIRST/LAST fragments of this much, a record each
+constexpr size_t MAX_TX_PLAINTEXT = 16 * 1024;
+constexpr size_t TX_RECORD_SIZE = MAX_TX_PLAINTEXT + aap::TlsRecordLayer::OVERHEAD;
+// Longest outgoing message taken apart into fragments
+constexpr size_t MAX_TX_MESSAGE = 1024 * 1024;
+
+// Connections expected at once, each gets its own slice of the CPUs
+std::atomic<int> coreShares{1};
 
 // Cached JNI references
-JavaVM* javaVm = nullptr;
-jclass nativeUsbClass = nullptr;
-jmethodID onRawDataMethod = nullptr;
-jmethodID onErrorMethod = nullptr;
+jclass callbacksClass = nullptr;
 
-// Get JNIEnv for current thread
-JNIEnv* getEnv() {
-    JNIEnv* env = nullptr;
-    if (javaVm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) == JNI_EDETACHED) {
-        javaVm->AttachCurrentThread(&env, nullptr);
-    }
-    return env;
+// NativeUsb.Callbacks upcalls, resolved once in JNI_OnLoad
+struct Upcalls {
+    jmethodID onRawData = nullptr;
+    jmethodID onRecord = nullptr;
+    jmethodID onSlotData = nullptr;
+    jmethodID onDecryptRecord = nullptr;
+    jmethodID onAudioRecord = nullptr;
+    jmethodID onVideoRecord = nullptr;
+    jmethodID onControlRecord = nullptr;
+    jmethodID onControlBatch = nullptr;
+    jmethodID onBackgroundRecord = nullptr;
+    jmethodID onAudioMediaConsumed = nullptr;
+    jmethodID onVideoMediaConsumed = nullptr;
+    jmethodID onVideoKeyframeNeeded = nullptr;
+    jmethodID onMediaAck = nullptr;
+    jmethodID onMicRecord = nullptr;
+    jmethodID onSensorBatch = nullptr;
+    jmethodID onInputRecord = nullptr;
+    jmethodID onError = nullptr;
+};
+Upcalls upcalls;
+
+struct UpcallMethod {
+    jmethodID Upcalls::* id;
+    const char* name;
+    const char* signature;
+};
+
+const UpcallMethod UPCALL_METHODS[] = {
+    {&Upcalls::onRawData, "onRawData", "([BI)V"},
+    {&Upcalls::onRecord, "onRecord", "(III[BI)V"},
+    {&Upcalls::onSlotData, "onSlotData", "(III)V"},
+    {&Upcalls::onDecryptRecord, "onDecryptRecord", "(II[BI)I"},
+    {&Upcalls::onAudioRecord, "onAudioRecord", "(III[BI)V"},
+    {&Upcalls::onVideoRecord, "onVideoRecord", "(III[BI)V"},
+    {&Upcalls::onControlRecord, "onControlRecord", "(III[BI)V"},
+    {&Upcalls::onControlBatch, "onControlBatch", "(I)V"},
+    {&Upcalls::onBackgroundRecord, "onBackgroundRecord", "(III[BI)V"},
+    {&Upcalls::onAudioMediaConsumed, "onAudioMediaConsumed", "(I)V"},
+    {&Upcalls::onVideoMediaConsumed, "onVideoMediaConsumed", "(I)V"},
+    {&Upcalls::onVideoKeyframeNeeded, "onVideoKeyframeNeeded", "(I)V"},
+    {&Upcalls::onMediaAck, "onMediaAck", "(II)V"},
+    {&Upcalls::onMicRecord, "onMicRecord", "([BI)V"},
+    {&Upcalls::onSensorBatch, "onSensorBatch", "([BI)V"},
+    {&Upcalls::onInputRecord, "onInputRecord", "([BI)V"},
+    {&Upcalls::onError, "onError", "(ILjava/lang/String;)V"},
+};
+
+// Get JNIEnv for current thread, cached per thread
+inline JNIEnv* getEnv() {
+    return aap::JniThreads::env();
 }
 
 // Callback for raw USB data
-void callRawDataCallback(const uint8_t* data, size_t length) {
+void callRawDataCallback(ConnectionHandle* h, const uint8_t* data, size_t length) {
     JNIEnv* env = getEnv();
-    if (!env || !nativeUsbClass || !onRawDataMethod) {
+    if (!env || !h->callbacks || !upcalls.onRawData) {
         LOGE("callRawDataCallback: JNI not ready");
         return;
     }
@@ -47,31 +249,570 @@ void callRawDataCallback(const uint8_t* data, size_t length) {
     if (jdata) {
         env->SetByteArrayRegion(jdata, 0, static_cast<jsize>(length),
                                 reinterpret_cast<const jbyte*>(data));
-        env->CallStaticVoidMethod(nativeUsbClass, onRawDataMethod,
+        env->CallVoidMethod(h->callbacks, upcalls.onRawData,
                                   jdata, static_cast<jint>(length));
         env->DeleteLocalRef(jdata);
     }
 }
 
+// Callback for complete AAP records from the native framer
+void callRecordCallback(ConnectionHandle* h, const aap::Record& record) {
+    JNIEnv* env = getEnv();
+    if (!env || !h->callbacks || !upcalls.onRecord) {
+        LOGE("callRecordCallback: JNI not ready");
+        return;
+    }
+
+    if (!h->recordBuffer) {
+        jbyteArray local = env->NewByteArray(static_cast<jsize>(aap::AapFramer::MAX_PAYLOAD));
+        if (!local) return;
+        h->recordBuffer = reinterpret_cast<jbyteArray>(env->NewGlobalRef(local));
+        env->DeleteLocalRef(local);
+    }
+
+    env->SetByteArrayRegion(h->recordBuffer, 0, static_cast<jsize>(record.length),
+                            reinterpret_cast<const jbyte*>(record.data));
+    env->CallVoidMethod(h->callbacks, upcalls.onRecord,
+                              static_cast<jint>(record.channel),
+                              static_cast<jint>(record.flags),
+                              static_cast<jint>(record.totalLength),
+                              h->recordBuffer,
+                              static_cast<jint>(record.length));
+}
+
 // Callback for errors
-void callErrorCallback(int errorCode, const char* message) {
+void callErrorCallback(ConnectionHandle* h, int errorCode, const char* message) {
     JNIEnv* env = getEnv();
-    if (!env || !nativeUsbClass || !onErrorMethod) return;
+    if (!env || !h->callbacks || !upcalls.onError) return;
 
     jstring jmessage = env->NewStringUTF(message);
     if (jmessage) {
-        env->CallStaticVoidMethod(nativeUsbClass, onErrorMethod, errorCode, jmessage);
+        env->CallVoidMethod(h->callbacks, upcalls.onError, errorCode, jmessage);
         env->DeleteLocalRef(jmessage);
     }
 }
 
-ConnectionHandle* getHandle(jlong handle) {
-    std::lock_guard<std::mutex> lock(handlesMutex);
-    auto it = handles.find(handle);
-    if (it != handles.end()) {
-        return it->second.get();
+// Plaintext of the record sealed in place in txRecord
+uint8_t* txPlaintext(ConnectionHandle* h) {
+    return h->txRecord.get() + aap::TlsRecordLayer::HEADER_SIZE + aap::TlsRecordLayer::EXPLICIT_NONCE_SIZE;
+}
+
+// Seal the fragment staged at txPlaintext() and write it behind its
+// header, gathered rather than joined; txRecordMutex held.
+// totalLength is only sent on the first of several fragments.
+int writeTxRecord(ConnectionHandle* h, uint8_t channel, uint8_t flags, size_t plaintextLength,
+                  size_t totalLength) {
+    uint8_t* record = h->txRecord.get();
+    const int recordLength = h->writeLayer->encrypt(txPlaintext(h), plaintextLength, record);
+    if (recordLength < 0) {
+        LOGE("writeTxRecord: encrypt failed");
+        return -1;
+    }
+    uint8_t header[aap::EncryptedHeader::SIZE] = {
+        channel, flags, static_cast<uint8_t>(recordLength >> 8), static_cast<uint8_t>(recordLength & 0xFF)
+    };
+    uint8_t total[aap::EncryptedHeader::TOTAL_LENGTH_SIZE] = {
+        static_cast<uint8_t>(totalLength >> 24), static_cast<uint8_t>(totalLength >> 16),
+        static_cast<uint8_t>(totalLength >> 8), static_cast<uint8_t>(totalLength & 0xFF)
+    };
+    aap::TxSegment segments[3];
+    size_t count = 0;
+    segments[count++] = {header, sizeof(header)};
+    if (totalLength > 0) {
+        segments[count++] = {total, sizeof(total)};
+    }
+    segments[count++] = {record, static_cast<size_t>(recordLength)};
+
+    // While reading, each segment is only copied into a TX transfer
+    return h->transport->writeSegments(segments, count);
+}
+
+// Seal and write a message of length plaintext bytes, split into
+// fragments when it doesn't fit one record; txRecordMutex held.
+// stage(out, offset, length) copies plaintext bytes [offset, offset + length) to out.
+template <typename Stage>
+int writeTxMessage(ConnectionHandle* h, const uint8_t* header, size_t length, Stage stage) {
+    using aap::EncryptedHeader;
+    const bool fragmented = length > MAX_TX_PLAINTEXT;
+    int written = 0;
+    size_t offset = 0;
+    do {
+        const size_t chunk = std::min(length - offset, MAX_TX_PLAINTEXT);
+        uint8_t flags = header[1];
+        if (fragmented) {
+            flags &= static_cast<uint8_t>(~(EncryptedHeader::FLAG_FIRST | EncryptedHeader::FLAG_LAST));
+            flags |= offset == 0 ? EncryptedHeader::FLAG_FIRST : 0;
+            flags |= offset + chunk == length ? EncryptedHeader::FLAG_LAST : 0;
+        }
+        stage(txPlaintext(h), offset, chunk);
+        const int result = writeTxRecord(h, header[0], flags, chunk, fragmented && offset == 0 ? length : 0);
+        if (result < 0) {
+            return -1;
+        }
+        written += result;
+        offset += chunk;
+    } while (offset < length);
+    return written;
+}
+
+// Encrypt and write a message built natively: the 4-byte header, then the plaintext
+bool sendNativeMessage(ConnectionHandle* h, const uint8_t* message, size_t length) {
+    std::lock_guard<std::mutex> lock(h->txRecordMutex);
+    if (!h->writeLayer) {
+        return false;
+    }
+    const uint8_t* plaintext = message + aap::EncryptedHeader::SIZE;
+    return writeTxMessage(h, message, length - aap::EncryptedHeader::SIZE,
+                          [plaintext](uint8_t* out, size_t offset, size_t chunk) {
+                              std::memcpy(out, plaintext + offset, chunk);
+                          }) >= 0;
+}
+
+// Right after decrypt: a ping is answered before the record is even queued
+void answerControlRecord(ConnectionHandle* h, int channel, const uint8_t* data, size_t length,
+                         uint64_t startNs) {
+    aap::ControlResponder* responder = h->responderStage.load(std::memory_order_acquire);
+    if (!responder || !aap::ControlResponder::isPingRequest(channel, data, length)) {
+        return;
+    }
+    uint8_t message[aap::ControlResponder::MAX_MESSAGE];
+    const size_t messageLength = responder->answer(channel, data, length, message);
+    if (messageLength > 0) {
+        const bool ok = sendNativeMessage(h, message, messageLength);
+        responder->sent(ok, startNs, aap::LatencyHistogram::now());
+    }
+}
+
+void notifyMediaConsumed(ConnectionHandle* h, jmethodID method, int channel);
+
+// Hand a decrypted record to its dispatcher lane. While idle the video stage
+// only keeps parameter sets and keyframes, cheap enough to do inline, so
+// AAP-Video stays parked on its empty queue.
+void dispatchRecord(ConnectionHandle* h, int channel, uint8_t flags, const uint8_t* data, size_t length) {
+    if (h->videoIdle.load(std::memory_order_relaxed) && aap::Channel::isVideo(channel)) {
+        aap::VideoAssembler* stage = h->videoStage.load(std::memory_order_acquire);
+        if (stage && aap::VideoAssembler::isMediaRecord(flags, data, length)) {
+            stage->process(channel, flags, data, length);
+            notifyMediaConsumed(h, upcalls.onVideoMediaConsumed, channel);
+            return;
+        }
+    }
+    h->dispatcher->dispatch(channel, flags, data, length);
+}
+
+// Decrypt a framed record natively, in place in the transfer or framer buffer
+void decryptNativeAndDispatch(ConnectionHandle* h, const aap::Record& record) {
+    if ((record.flags & aap::EncryptedHeader::FLAG_ENCRYPTED) == 0) {
+        LOGE("decryptNativeAndDispatch: unencrypted record on channel %d", record.channel);
+        return;
+    }
+
+    if (h->decryptPool && h->decryptPool->accepts(record.channel, record.length)) {
+        h->decryptPool->submit(record.channel, record.flags, record.data, record.length);
+        return;
+    }
+
+    // Record buffers are owned by the connection and framer until the callback returns
+    uint8_t* data = const_cast<uint8_t*>(record.data);
+    uint8_t* plaintext = data + aap::TlsRecordLayer::HEADER_SIZE + aap::TlsRecordLayer::EXPLICIT_NONCE_SIZE;
+    const uint64_t startNs = aap::LatencyHistogram::now();
+    int length = h->recordLayer->decrypt(data, record.length, plaintext);
+    h->latency[aap::PipelineLatency::DECRYPT].recordSince(startNs);
+    if (length < 0) {
+        LOGE("decryptNativeAndDispatch: bad record on channel %d, length %zu", record.channel, record.length);
+        callErrorCallback(h, -1, "TLS record authentication failed");
+        return;
+    }
+
+    answerControlRecord(h, record.channel, plaintext, static_cast<size_t>(length), startNs);
+    dispatchRecord(h, record.channel, record.flags, plaintext, static_cast<size_t>(length));
+}
+
+// Decrypt a framed record in Kotlin, then hand the plaintext to the dispatcher
+void decryptAndDispatch(ConnectionHandle* h, const aap::Record& record) {
+    if (h->recordLayer) {
+        decryptNativeAndDispatch(h, record);
+        return;
+    }
+
+    JNIEnv* env = getEnv();
+    if (!env || !h->callbacks || !upcalls.onDecryptRecord) {
+        LOGE("decryptAndDispatch: JNI not ready");
+        return;
+    }
+
+    if (!h->recordBuffer) {
+        jbyteArray local = env->NewByteArray(static_cast<jsize>(aap::AapFramer::MAX_PAYLOAD));
+        if (!local) return;
+        h->recordBuffer = reinterpret_cast<jbyteArray>(env->NewGlobalRef(local));
+        env->DeleteLocalRef(local);
+    }
+
+    const uint64_t startNs = aap::LatencyHistogram::now();
+    env->SetByteArrayRegion(h->recordBuffer, 0, static_cast<jsize>(record.length),
+                            reinterpret_cast<const jbyte*>(record.data));
+    jint length = env->CallIntMethod(h->callbacks, upcalls.onDecryptRecord,
+                                           static_cast<jint>(record.channel),
+                                           static_cast<jint>(record.flags),
+                                           h->recordBuffer,
+                                           static_cast<jint>(record.length));
+    h->latency[aap::PipelineLatency::DECRYPT].recordSince(startNs);
+    if (length < 0 || static_cast<size_t>(length) > h->plaintextCapacity) {
+        return;
+    }
+
+    answerControlRecord(h, record.channel, h->plaintext, static_cast<size_t>(length), startNs);
+    dispatchRecord(h, record.channel, record.flags, h->plaintext, static_cast<size_t>(length));
+}
+
+// Callback from a dispatcher thread with one decrypted record, in the
+// channel's reused array; msg_type goes up front so Kotlin routes without
+// reading the payload
+void callDispatchedRecord(ConnectionHandle* h, jmethodID method, int channel, uint8_t flags,
+                          const uint8_t* data, size_t length) {
+    JNIEnv* env = getEnv();
+    if (!env || !h->callbacks || !method) {
+        LOGE("callDispatchedRecord: JNI not ready");
+        return;
+    }
+
+    const bool known = channel >= 0 && channel < aap::Channel::COUNT;
+    jbyteArray& buffer = h->channelRecordBuffers[known ? channel : aap::Channel::COUNT];
+    if (!buffer) {
+        jbyteArray local = env->NewByteArray(static_cast<jsize>(aap::AapFramer::MAX_PAYLOAD));
+        if (!local) return;
+        buffer = reinterpret_cast<jbyteArray>(env->NewGlobalRef(local));
+        env->DeleteLocalRef(local);
+    }
+    // Records are at most one framed payload, anything larger gets its own array
+    jbyteArray jdata = length <= aap::AapFramer::MAX_PAYLOAD ? buffer : env->NewByteArray(static_cast<jsize>(length));
+    if (!jdata) {
+        return;
+    }
+
+    const int msgType = length >= 2 ? (data[0] << 8) | data[1] : -1;
+    env->SetByteArrayRegion(jdata, 0, static_cast<jsize>(length),
+                            reinterpret_cast<const jbyte*>(data));
+    env->CallVoidMethod(h->callbacks, method,
+                              static_cast<jint>(channel), static_cast<jint>(flags),
+                              static_cast<jint>(msgType), jdata, static_cast<jint>(length));
+    if (jdata != buffer) {
+        env->DeleteLocalRef(jdata);
+    }
+}
+
+// Callback from AAP-Control with a packed batch, Kotlin reads it from the batch buffer view
+void callControlBatchCallback(ConnectionHandle* h, const aap::RecordBatch& batch) {
+    JNIEnv* env = getEnv();
+    if (!env || !h->callbacks || !upcalls.onControlBatch) {
+        LOGE("callControlBatchCallback: JNI not ready");
+        return;
+    }
+    env->CallVoidMethod(h->callbacks, upcalls.onControlBatch,
+                              static_cast<jint>(batch.count()));
+}
+
+// One media record was consumed natively: Kotlin still owns the media ACK window
+void notifyMediaConsumed(ConnectionHandle* h, jmethodID method, int channel) {
+    aap::MediaAckBatcher* batcher = h->ackStage.load(std::memory_order_acquire);
+    if (batcher) {
+        batcher->consumed(channel);
+        return;
+    }
+    JNIEnv* env = getEnv();
+    if (env && h->callbacks && method) {
+        env->CallVoidMethod(h->callbacks, method, static_cast<jint>(channel));
+    }
+}
+
+// Callback from a consuming thread or AAP-Ack with a coalesced media ACK,
+// written natively once the channel's session is known
+void callMediaAckCallback(ConnectionHandle* h, int channel, uint32_t count) {
+    aap::ControlResponder* responder = h->responderStage.load(std::memory_order_acquire);
+    if (responder) {
+        uint8_t message[aap::ControlResponder::MAX_MESSAGE];
+        const size_t messageLength = responder->mediaAck(channel, count, message);
+        if (messageLength > 0) {
+            const bool ok = sendNativeMessage(h, message, messageLength);
+            responder->sent(ok, 0, 0);
+            if (ok) {
+                return;
+            }
+        }
+    }
+
+    JNIEnv* env = getEnv();
+    if (!env || !h->callbacks || !upcalls.onMediaAck) {
+        LOGE("callMediaAckCallback: JNI not ready");
+        return;
+    }
+    env->CallVoidMethod(h->callbacks, upcalls.onMediaAck,
+                              static_cast<jint>(channel), static_cast<jint>(count));
+}
+
+// Callback from AAP-Mic with one framed mic record
+void callMicRecordCallback(ConnectionHandle* h, const uint8_t* record, size_t length) {
+    JNIEnv* env = getEnv();
+    if (!env || !h->callbacks || !upcalls.onMicRecord) {
+        LOGE("callMicRecordCallback: JNI not ready");
+        return;
+    }
+
+    // Queued by AapTransport until sent, so a fresh array per record
+    jbyteArray jdata = env->NewByteArray(static_cast<jsize>(length));
+    if (jdata) {
+        env->SetByteArrayRegion(jdata, 0, static_cast<jsize>(length),
+                                reinterpret_cast<const jbyte*>(record));
+        env->CallVoidMethod(h->callbacks, upcalls.onMicRecord,
+                                  jdata, static_cast<jint>(length));
+        env->DeleteLocalRef(jdata);
+    }
+}
+
+// Callback from AAP-Sensor with one coalesced sensor record
+void callSensorBatchCallback(ConnectionHandle* h, const uint8_t* record, size_t length) {
+    JNIEnv* env = getEnv();
+    if (!env || !h->callbacks || !upcalls.onSensorBatch) {
+        LOGE("callSensorBatchCallback: JNI not ready");
+        return;
+    }
+
+    // Queued by AapTransport until sent, so a fresh array per record
+    jbyteArray jdata = env->NewByteArray(static_cast<jsize>(length));
+    if (jdata) {
+        env->SetByteArrayRegion(jdata, 0, static_cast<jsize>(length),
+                                reinterpret_cast<const jbyte*>(record));
+        env->CallVoidMethod(h->callbacks, upcalls.onSensorBatch,
+                                  jdata, static_cast<jint>(length));
+        env->DeleteLocalRef(jdata);
+    }
+}
+
+// Callback from AAP-Input with one encoded touch record, written before it returns
+void callInputRecordCallback(ConnectionHandle* h, const uint8_t* record, size_t length) {
+    JNIEnv* env = getEnv();
+    if (!env || !h->callbacks || !upcalls.onInputRecord || !h->inputRecordBuffer) {
+        LOGE("callInputRecordCallback: JNI not ready");
+        return;
+    }
+    env->SetByteArrayRegion(h->inputRecordBuffer, 0, static_cast<jsize>(length),
+                            reinterpret_cast<const jbyte*>(record));
+    env->CallVoidMethod(h->callbacks, upcalls.onInputRecord,
+                              h->inputRecordBuffer, static_cast<jint>(length));
+}
+
+// Control dispatcher callback: records go to the shared ring when enabled
+void dispatchControlRecord(ConnectionHandle* h, int channel, uint8_t flags,
+                           const uint8_t* data, size_t length) {
+    aap::SharedRecordRing* ring = h->controlRingStage.load(std::memory_order_acquire);
+    bool published = false;
+    if (ring && h->dispatcher->isPooled()) {
+        std::lock_guard<std::mutex> lock(h->controlRingMutex);
+        published = ring->publish(channel, flags, data, length);
+    } else if (ring) {
+        published = ring->publish(channel, flags, data, length);
+    }
+    if (!published) {
+        callDispatchedRecord(h, upcalls.onControlRecord, channel, flags, data, length);
+    }
+}
+
+// Audio dispatcher callback: PCM goes to the native audio stage when enabled
+void dispatchAudioRecord(ConnectionHandle* h, int channel, uint8_t flags,
+                         const uint8_t* data, size_t length) {
+    aap::AudioOutput* stage = h->audioStage.load(std::memory_order_acquire);
+    if (!stage || !aap::AudioOutput::isMediaRecord(channel, data, length)) {
+        callDispatchedRecord(h, upcalls.onAudioRecord, channel, flags, data, length);
+        return;
+    }
+
+    stage->process(channel, data, length);
+    notifyMediaConsumed(h, upcalls.onAudioMediaConsumed, channel);
+}
+
+// Video dispatcher callback: media goes to the native video stage when enabled
+void dispatchVideoRecord(ConnectionHandle* h, int channel, uint8_t flags,
+                         const uint8_t* data, size_t length) {
+    aap::VideoAssembler* stage = h->videoStage.load(std::memory_order_acquire);
+    if (!stage || !aap::VideoAssembler::isMediaRecord(flags, data, length)) {
+        callDispatchedRecord(h, upcalls.onVideoRecord, channel, flags, data, length);
+        return;
+    }
+
+    // A record dropped by the full video queue leaves a hole in the frame
+    const uint64_t drops = h->dispatcher->videoDrops();
+    if (drops != h->videoDropsSeen) {
+        h->videoDropsSeen = drops;
+        stage->skipToKeyframe();
+    }
+
+    stage->process(channel, flags, data, length);
+    notifyMediaConsumed(h, upcalls.onVideoMediaConsumed, channel);
+
+    JNIEnv* env = getEnv();
+    if (stage->takeKeyframeRequest() && env && h->callbacks && upcalls.onVideoKeyframeNeeded) {
+        env->CallVoidMethod(h->callbacks, upcalls.onVideoKeyframeNeeded, static_cast<jint>(channel));
+    }
+}
+
+// Callback for zero-copy transfer slots - Kotlin reads the direct buffer view
+void callSlotDataCallback(ConnectionHandle* h, int slot, size_t offset, size_t length) {
+    JNIEnv* env = getEnv();
+    if (!env || !h->callbacks || !upcalls.onSlotData) {
+        LOGE("callSlotDataCallback: JNI not ready");
+        return;
+    }
+
+    env->CallVoidMethod(h->callbacks, upcalls.onSlotData,
+                              static_cast<jint>(slot),
+                              static_cast<jint>(offset),
+                              static_cast<jint>(length));
+}
+
+// Kotlin parses the raw stream until framing is enabled
+void setTransportCallbacks(ConnectionHandle* h) {
+    if (aap::ShadowFramer* shadow = h->shadow.get()) {
+        h->transport->setRawDataCallback([h, shadow](const uint8_t* data, size_t length) {
+            shadow->feed(data, length);
+            callRawDataCallback(h, data, length);
+        });
+    } else {
+        h->transport->setRawDataCallback([h](const uint8_t* data, size_t length) {
+            callRawDataCallback(h, data, length);
+        });
+    }
+    h->transport->setErrorCallback([h](int errorCode, const char* message) {
+        callErrorCallback(h, errorCode, message);
+    });
+}
+
+// Framer, then sink, composed into the one lambda behind the transport's
+// RawDataCallback: the per-record path has no indirect call until the
+// dispatcher queue or the Kotlin upcall
+template <typename Sink>
+void setFramingSink(ConnectionHandle* h, Sink sink) {
+    aap::AapFramer* framer = h->framer.get();
+    aap::UsbConnection* usb = h->usb;
+    // USB knows when the data came off the wire, which is well before
+    // delivery once transfer buffers are swapped
+    h->transport->setRawDataCallback([framer, usb, sink](const uint8_t* data, size_t length) {
+        framer->feed(data, length, usb ? usb->arrivalNs() : aap::LatencyHistogram::now(), sink);
+    });
+}
+
+// Framed records are decrypted and routed once native dispatch is enabled,
+// until then each goes to Kotlin
+void setFramingStages(ConnectionHandle* h) {
+    if (h->dispatcher) {
+        setFramingSink(h, [h](const aap::Record& record) { decryptAndDispatch(h, record); });
+    } else {
+        setFramingSink(h, [h](const aap::Record& record) { callRecordCallback(h, record); });
+    }
+}
+
+int coreShareCount() {
+    return coreShares.load(std::memory_order_relaxed);
+}
+
+jlong addHandle(std::unique_ptr<ConnectionHandle> handle) {
+    ConnectionHandle* h = handle.get();
+    jlong handleId = handles.insert(std::move(handle));
+    if (handleId == 0) {
+        LOGE("No free connection slot");
+        return 0;
+    }
+    // Slots are taken lowest first, so concurrent connections get distinct shares.
+    // Kotlin doesn't have the handle yet, nothing else touches h.
+    h->cpuShare = static_cast<int>(HandleTable::indexOf(handleId)) % coreShareCount();
+    return handleId;
+}
+
+HandleLease getHandle(jlong handle) {
+    return handles.acquire(handle);
+}
+
+// offset and length describe a range within a buffer of capacity bytes
+bool inBounds(jint offset, jint length, jlong capacity) {
+    return offset >= 0 && length >= 0 && static_cast<jlong>(offset) + length <= capacity;
+}
+
+// Audio, video, control and background limits as NativeUsb.DispatchQueues
+// packs them, four ints each: slots, bytes, policy, block timeout us. Zero
+// or negative keeps the memory profile's size.
+// Layout written by NativeUsb.DispatchQueues.pack()
+constexpr jsize DISPATCH_CONFIG_SIZE = 17;
+
+aap::DispatcherConfig dispatcherConfig(JNIEnv* env, jintArray packed) {
+    aap::DispatcherConfig config = aap::memoryProfile().dispatcher;
+    if (!packed || env->GetArrayLength(packed) != DISPATCH_CONFIG_SIZE) {
+        return config;
+    }
+    jint values[DISPATCH_CONFIG_SIZE];
+    env->GetIntArrayRegion(packed, 0, DISPATCH_CONFIG_SIZE, values);
+
+    aap::QueueConfig* queues[4] = {&config.audio, &config.video, &config.control, &config.background};
+    for (int i = 0; i < 4; i++) {
+        const jint* v = values + i * 4;
+        if (v[0] > 0) queues[i]->slots = static_cast<size_t>(v[0]);
+        if (v[1] > 0) queues[i]->bytes = static_cast<size_t>(v[1]);
+        if (v[2] >= 0 && v[2] <= static_cast<jint>(aap::DropPolicy::NEVER_DROP)) {
+            queues[i]->policy = static_cast<aap::DropPolicy>(v[2]);
+        }
+        if (v[3] > 0) queues[i]->blockTimeoutUs = static_cast<uint32_t>(v[3]);
+        LOGI("Dispatcher queue %d: %zu slots, %zu bytes, policy %d, block %u us", i,
+             queues[i]->slots, queues[i]->bytes, static_cast<int>(queues[i]->policy),
+             queues[i]->blockTimeoutUs);
+    }
+    if (values[16] > 0) {
+        config.poolWorkers = static_cast<size_t>(values[16]);
+        LOGI("Dispatcher pool: %zu workers", config.poolWorkers);
+    }
+    return config;
+}
+
+// Layout written by NativeUsb.LoadProfile.pack()
+constexpr jsize LOAD_CONFIG_SIZE = 16;
+
+aap::LoadConfig loadConfig(JNIEnv* env, jintArray packed, jdouble seconds, jdouble speed) {
+    aap::LoadConfig config;
+    config.seconds = std::max(0.0, static_cast<double>(seconds));
+    config.speed = std::max(0.0, static_cast<double>(speed));
+    if (!packed || env->GetArrayLength(packed) != LOAD_CONFIG_SIZE) {
+        return config;
+    }
+    jint v[LOAD_CONFIG_SIZE];
+    env->GetIntArrayRegion(packed, 0, LOAD_CONFIG_SIZE, v);
+
+    config.width = v[0];
+    config.height = v[1];
+    config.fps = v[2];
+    config.videoKbps = v[3];
+    config.keyframeInterval = v[4];
+    config.keyframeScale = v[5];
+    config.maxNalSize = static_cast<size_t>(std::max(0, v[6]));
+    config.audioStreams = static_cast<uint32_t>(v[7]);
+    config.audioFrameMs = v[8];
+    config.pingHz = v[9];
+    config.metadataHz = v[10];
+    config.albumArtBytes = static_cast<size_t>(std::max(0, v[11]));
+    if (v[12] > 0) config.maxRecordPayload = static_cast<size_t>(v[12]);
+    if (v[13] > 0) config.transferSize = static_cast<size_t>(v[13]);
+    config.encrypt = v[14] != 0;
+    config.seed = static_cast<uint32_t>(v[15]);
+    return config;
+}
+
+// Decrypt records natively from now on, with a key from the handshake or a capture
+bool installReadKey(ConnectionHandle* h, const uint8_t* key, size_t keyLength,
+                    const uint8_t* salt, uint64_t sequence) {
+    auto layer = std::make_unique<aap::TlsRecordLayer>();
+    if (!layer->setReadKey(key, keyLength, salt, sequence)) {
+        return false;
     }
-    return nullptr;
+    h->recordLayer = std::move(layer);
+    LOGI("Native record decryption enabled, AES-%zu, hardware=%d",
+         keyLength * 8, aap::AesGcm::isHardwareAccelerated());
+    return true;
 }
 
 } // anonymous namespace
@@ -80,7 +821,7 @@ extern "C" {
 
 JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void* reserved) {
     LOGI("JNI_OnLoad called");
-    javaVm = vm;
+    aap::JniThreads::init(vm);
 
     JNIEnv* env = nullptr;
     if (vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) != JNI_OK) {
@@ -89,20 +830,21 @@ JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void* reserved) {
     }
 
     // Cache class and method references
-    jclass localClass = env->FindClass("info/anodsplace/headunit/connection/NativeUsb");
+    jclass localClass = env->FindClass("info/anodsplace/headunit/connection/NativeUsb$Callbacks");
     if (!localClass) {
-        LOGE("Failed to find NativeUsb class");
+        LOGE("Failed to find NativeUsb.Callbacks class");
         return JNI_ERR;
     }
-    nativeUsbClass = reinterpret_cast<jclass>(env->NewGlobalRef(localClass));
+    callbacksClass = reinterpret_cast<jclass>(env->NewGlobalRef(localClass));
     env->DeleteLocalRef(localClass);
 
-    onRawDataMethod = env->GetStaticMethodID(nativeUsbClass, "onRawData", "([BI)V");
-    onErrorMethod = env->GetStaticMethodID(nativeUsbClass, "onError", "(ILjava/lang/String;)V");
-
-    if (!onRawDataMethod || !onErrorMethod) {
-        LOGE("Failed to find callback methods");
-        return JNI_ERR;
+    for (const UpcallMethod& method : UPCALL_METHODS) {
+        jmethodID id = env->GetMethodID(callbacksClass, method.name, method.signature);
+        if (!id) {
+            LOGE("Failed to find callback method %s%s", method.name, method.signature);
+            return JNI_ERR;
+        }
+        upcalls.*method.id = id;
     }
 
     LOGI("JNI initialized successfully");
@@ -114,135 +856,2445 @@ JNIEXPORT void JNICALL JNI_OnUnload(JavaVM* vm, void* reserved) {
 
     JNIEnv* env = nullptr;
     if (vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) == JNI_OK) {
-        if (nativeUsbClass) {
-            env->DeleteGlobalRef(nativeUsbClass);
-            nativeUsbClass = nullptr;
+        if (callbacksClass) {
+            env->DeleteGlobalRef(callbacksClass);
+            callbacksClass = nullptr;
         }
     }
 
     // Clean up all handles
-    std::lock_guard<std::mutex> lock(handlesMutex);
     handles.clear();
+    std::lock_guard<std::mutex> lock(contextMutex);
+    usbContext.reset();
 
-    javaVm = nullptr;
+    aap::JniThreads::init(nullptr);
 }
 
 JNIEXPORT jlong JNICALL
 Java_info_anodsplace_headunit_connection_NativeUsb_nativeOpen(
-        JNIEnv* env, jclass clazz, jint fileDescriptor) {
+        JNIEnv* env, jclass clazz, jint fileDescriptor,
+        jint numTransfers, jint transferSize, jboolean adaptive, jint spareBuffers) {
+
+    LOGI("nativeOpen called with fd=%d, transfers=%d x %d, adaptive=%d, spares=%d",
+         fileDescriptor, numTransfers, transferSize, adaptive, spareBuffers);
 
-    LOGI("nativeOpen called with fd=%d", fileDescriptor);
+    {
+        std::lock_guard<std::mutex> lock(contextMutex);
+        if (!usbContext) {
+            usbContext = aap::UsbContext::acquire();
+        }
+    }
 
     auto handle = std::make_unique<ConnectionHandle>();
-    handle->connection = std::make_unique<aap::UsbConnection>();
+    auto usb = std::make_unique<aap::UsbConnection>();
+    handle->usb = usb.get();
+    handle->transport = std::move(usb);
+    setTransportCallbacks(handle.get());
 
-    // Set up raw data callback - Kotlin handles parsing
-    handle->connection->setRawDataCallback(callRawDataCallback);
-    handle->connection->setErrorCallback(callErrorCallback);
+    aap::TransferConfig config;
+    if (numTransfers > 0) config.numTransfers = numTransfers;
+    if (transferSize > 0) config.transferSize = static_cast<size_t>(transferSize);
+    config.adaptive = adaptive == JNI_TRUE;
+    config.spareBuffers = std::max(0, static_cast<int>(spareBuffers));
 
     // Open USB device
-    if (!handle->connection->open(fileDescriptor)) {
-        LOGE("Failed to open USB device: %s", handle->connection->getLastError());
+    if (!handle->usb->open(fileDescriptor, config)) {
+        LOGE("Failed to open USB device: %s", handle->usb->getLastError());
         return 0;
     }
 
-    // Store handle
-    std::lock_guard<std::mutex> lock(handlesMutex);
-    jlong handleId = nextHandle++;
-    handles[handleId] = std::move(handle);
-
+    jlong handleId = addHandle(std::move(handle));
     LOGI("USB device opened successfully, handle=%ld", (long)handleId);
     return handleId;
 }
 
-JNIEXPORT void JNICALL
-Java_info_anodsplace_headunit_connection_NativeUsb_nativeClose(
-        JNIEnv* env, jclass clazz, jlong handle) {
+JNIEXPORT jlong JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeOpenSocket(
+        JNIEnv* env, jclass clazz, jint fileDescriptor, jint receiveBufferSize) {
 
-    LOGI("nativeClose called for handle=%ld", (long)handle);
+    LOGI("nativeOpenSocket called with fd=%d, receive buffer %d", fileDescriptor, receiveBufferSize);
 
-    std::lock_guard<std::mutex> lock(handlesMutex);
-    auto it = handles.find(handle);
-    if (it != handles.end()) {
-        // Destructor will clean up
-        handles.erase(it);
+    auto handle = std::make_unique<ConnectionHandle>();
+    auto tcp = std::make_unique<aap::TcpConnection>();
+    handle->tcp = tcp.get();
+    handle->transport = std::move(tcp);
+    setTransportCallbacks(handle.get());
+
+    aap::TcpConfig config;
+    if (receiveBufferSize > 0) config.receiveBufferSize = receiveBufferSize;
+
+    if (!handle->tcp->open(fileDescriptor, config)) {
+        LOGE("Failed to open socket: %s", handle->tcp->getLastError());
+        return 0;
     }
+
+    jlong handleId = addHandle(std::move(handle));
+    LOGI("Socket opened successfully, handle=%ld", (long)handleId);
+    return handleId;
 }
 
-JNIEXPORT void JNICALL
-Java_info_anodsplace_headunit_connection_NativeUsb_nativeStartReading(
-        JNIEnv* env, jclass clazz, jlong handle) {
+JNIEXPORT jlong JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeOpenReplay(
+        JNIEnv* env, jclass clazz, jstring path, jdouble speed) {
 
-    LOGI("nativeStartReading called for handle=%ld", (long)handle);
+    const char* capturePath = env->GetStringUTFChars(path, nullptr);
+    if (!capturePath) {
+        return 0;
+    }
+    LOGI("nativeOpenReplay called for %s, speed %.2f", capturePath, speed);
 
-    ConnectionHandle* h = getHandle(handle);
-    if (h) {
-        h->connection->startReading();
+    auto handle = std::make_unique<ConnectionHandle>();
+    auto replay = std::make_unique<aap::ReplayTransport>();
+    handle->replay = replay.get();
+    handle->transport = std::move(replay);
+    setTransportCallbacks(handle.get());
+
+    aap::ReplayConfig config;
+    config.speed = std::max(0.0, static_cast<double>(speed));
+    const bool ok = handle->replay->open(capturePath, config);
+    env->ReleaseStringUTFChars(path, capturePath);
+    if (!ok) {
+        LOGE("Failed to open capture: %s", handle->replay->getLastError());
+        return 0;
     }
+
+    jlong handleId = addHandle(std::move(handle));
+    LOGI("Capture opened for replay, handle=%ld", (long)handleId);
+    return handleId;
 }
 
-JNIEXPORT void JNICALL
-Java_info_anodsplace_headunit_connection_NativeUsb_nativeStopReading(
-        JNIEnv* env, jclass clazz, jlong handle) {
+JNIEXPORT jlong JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeOpenLoadGenerator(
+        JNIEnv* env, jclass clazz, jintArray profile, jdouble seconds, jdouble speed) {
 
-    LOGI("nativeStopReading called for handle=%ld", (long)handle);
+    const aap::LoadConfig config = loadConfig(env, profile, seconds, speed);
+    LOGI("nativeOpenLoadGenerator called: %dx%d@%d, %d kbps, audio 0x%x, %.1f s at speed %.2f",
+         config.width, config.height, config.fps, config.videoKbps, config.audioStreams,
+         config.seconds, config.speed);
 
-    ConnectionHandle* h = getHandle(handle);
-    if (h) {
-        h->connection->stopReading();
+    auto handle = std::make_unique<ConnectionHandle>();
+    auto generator = std::make_unique<aap::LoadGenerator>();
+    handle->loadGenerator = generator.get();
+    handle->transport = std::move(generator);
+    setTransportCallbacks(handle.get());
+
+    if (!handle->loadGenerator->open(config)) {
+        LOGE("Failed to open load generator: %s", handle->loadGenerator->getLastError());
+        return 0;
     }
+
+    jlong handleId = addHandle(std::move(handle));
+    LOGI("Load generator opened, handle=%ld", (long)handleId);
+    return handleId;
 }
 
-JNIEXPORT jint JNICALL
-Java_info_anodsplace_headunit_connection_NativeUsb_nativeWrite(
-        JNIEnv* env, jclass clazz, jlong handle, jbyteArray data, jint length) {
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetCallbacks(
+        JNIEnv* env, jclass clazz, jlong handle, jobject callbacks) {
 
-    LOGD("nativeWrite called: handle=%ld, length=%d", (long)handle, length);
+    LOGI("nativeSetCallbacks called for handle=%ld", (long)handle);
 
-    ConnectionHandle* h = getHandle(handle);
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
     if (!h) {
-        LOGE("nativeWrite: invalid handle %ld", (long)handle);
-        return -1;
+        LOGE("nativeSetCallbacks: invalid handle %ld", (long)handle);
+        return;
     }
 
-    jbyte* bytes = env->GetByteArrayElements(data, nullptr);
-    if (!bytes) {
-        LOGE("nativeWrite: failed to get byte array");
-        return -1;
+    // Before startReading(): no native thread is calling up yet
+    if (h->callbacks) {
+        env->DeleteGlobalRef(h->callbacks);
     }
+    h->callbacks = callbacks ? env->NewGlobalRef(callbacks) : nullptr;
+}
 
-    int result = h->connection->write(reinterpret_cast<uint8_t*>(bytes), length);
-    LOGD("nativeWrite: result=%d", result);
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetCoreShares(
+        JNIEnv* env, jclass clazz, jint shares) {
 
-    env->ReleaseByteArrayElements(data, bytes, JNI_ABORT);
+    LOGI("nativeSetCoreShares called with shares=%d", shares);
 
-    return result;
+    coreShares.store(std::max(1, static_cast<int>(shares)), std::memory_order_relaxed);
 }
 
-JNIEXPORT jint JNICALL
-Java_info_anodsplace_headunit_connection_NativeUsb_nativeRead(
-        JNIEnv* env, jclass clazz, jlong handle, jbyteArray data, jint length, jint timeoutMs) {
-
-    LOGD("nativeRead called: handle=%ld, length=%d, timeout=%d", (long)handle, length, timeoutMs);
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeClose(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    LOGI("nativeClose called for handle=%ld", (long)handle);
+
+    // No new leases from here; calls in flight keep it alive until reclaim()
+    ConnectionHandle* removed = handles.retire(handle);
+    if (removed) {
+        if (removed->watchdog) {
+            // Probes every thread stopped below
+            removed->watchdog->stop();
+        }
+        if (removed->statsExport) {
+            removed->statsExport->stop();
+        }
+        if (removed->governor) {
+            // Samples the dispatcher and decoder stopped below
+            removed->governor->stop();
+        }
+        if (removed->micInput) {
+            removed->micInput->stop();
+        }
+        if (removed->sensorAggregator) {
+            removed->sensorAggregator->stop();
+        }
+        if (removed->touchInput) {
+            removed->touchInput->stop();
+        }
+        // Stop the event thread before releasing the record buffer it writes into
+        removed->transport->close();
+        if (removed->capture) {
+            removed->transport->setCapture(nullptr);
+            removed->capture->close();
+        }
+        if (removed->decryptPool) {
+            removed->decryptPool->stop();
+        }
+        if (removed->controlRing) {
+            // AAP-Control may be waiting for ring space
+            removed->controlRing->shutdown();
+        }
+        if (removed->dispatcher) {
+            removed->dispatcher->stop();
+        }
+        if (removed->ackBatcher) {
+            // After the dispatcher, so the last consumed records are acknowledged
+            removed->ackBatcher->stop();
+        }
+        if (removed->audioOutput) {
+            removed->audioOutput->stopAll();
+        }
+        if (removed->videoDecoder) {
+            removed->videoDecoder->stop();
+        }
+        if (removed->videoAssembler) {
+            removed->videoAssembler->shutdown();
+        }
+    }
+
+    // Everything is stopped, wait out the calls still holding a lease
+    std::unique_ptr<ConnectionHandle> owned = handles.reclaim(handle);
+    if (owned) {
+        if (owned->plaintextBuffer) {
+            env->DeleteGlobalRef(owned->plaintextBuffer);
+            owned->plaintextBuffer = nullptr;
+        }
+        if (owned->recordBuffer) {
+            env->DeleteGlobalRef(owned->recordBuffer);
+            owned->recordBuffer = nullptr;
+        }
+        for (jbyteArray& buffer : owned->channelRecordBuffers) {
+            if (buffer) {
+                env->DeleteGlobalRef(buffer);
+                buffer = nullptr;
+            }
+        }
+        if (owned->inputRecordBuffer) {
+            env->DeleteGlobalRef(owned->inputRecordBuffer);
+            owned->inputRecordBuffer = nullptr;
+        }
+        if (owned->callbacks) {
+            env->DeleteGlobalRef(owned->callbacks);
+            owned->callbacks = nullptr;
+        }
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetFramingEnabled(
+        JNIEnv* env, jclass clazz, jlong handle, jboolean enabled) {
+
+    LOGI("nativeSetFramingEnabled called for handle=%ld, enabled=%d", (long)handle, enabled);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        LOGE("nativeSetFramingEnabled: invalid handle %ld", (long)handle);
+        return;
+    }
+
+    if (enabled) {
+        if (!h->framer) {
+            h->framer = std::make_unique<aap::AapFramer>();
+            h->framer->setLatency(&h->latency);
+        }
+        h->framer->reset();
+        setFramingStages(h);
+    } else {
+        setTransportCallbacks(h);
+    }
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetShadowFramingEnabled(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    LOGI("nativeSetShadowFramingEnabled called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || h->framer) {
+        LOGE("nativeSetShadowFramingEnabled: invalid handle %ld or native framing enabled", (long)handle);
+        return JNI_FALSE;
+    }
+
+    if (!h->shadow) {
+        h->shadow = std::make_unique<aap::ShadowFramer>();
+        setTransportCallbacks(h);
+    }
+    return JNI_TRUE;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeReportShadowRecords(
+        JNIEnv* env, jclass clazz, jlong handle, jintArray records, jint count, jlong parseNs, jlong decryptNs) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    const jsize fields = static_cast<jsize>(aap::ShadowFramer::RECORD_FIELDS);
+    if (!h || !h->shadow || count < 0 || env->GetArrayLength(records) / fields < count) {
+        return;
+    }
+
+    void* values = env->GetPrimitiveArrayCritical(records, nullptr);
+    if (!values) return;
+    h->shadow->compare(static_cast<const int32_t*>(values), static_cast<size_t>(count),
+                       static_cast<uint64_t>(std::max<jlong>(parseNs, 0)),
+                       static_cast<uint64_t>(std::max<jlong>(decryptNs, 0)));
+    env->ReleasePrimitiveArrayCritical(records, values, JNI_ABORT);
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeStartReading(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    LOGI("nativeStartReading called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (h) {
+        h->transport->startReading();
+    }
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeStopReading(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    LOGI("nativeStopReading called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (h) {
+        h->transport->stopReading();
+    }
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetDispatchEnabled(
+        JNIEnv* env, jclass clazz, jlong handle, jobject plaintextBuffer, jint controlBatchLatencyUs,
+        jintArray queueConfig) {
+
+    LOGI("nativeSetDispatchEnabled called for handle=%ld, control batch latency %d us",
+         (long)handle, controlBatchLatencyUs);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->framer) {
+        LOGE("nativeSetDispatchEnabled: invalid handle %ld or framing disabled", (long)handle);
+        return JNI_FALSE;
+    }
+
+    uint8_t* address = static_cast<uint8_t*>(env->GetDirectBufferAddress(plaintextBuffer));
+    jlong capacity = env->GetDirectBufferCapacity(plaintextBuffer);
+    if (!address || capacity <= 0) {
+        LOGE("nativeSetDispatchEnabled: plaintext buffer must be a direct ByteBuffer");
+        return JNI_FALSE;
+    }
+
+    if (h->plaintextBuffer) {
+        env->DeleteGlobalRef(h->plaintextBuffer);
+    }
+    h->plaintextBuffer = env->NewGlobalRef(plaintextBuffer);
+    h->plaintext = address;
+    h->plaintextCapacity = static_cast<size_t>(capacity);
+
+    if (!h->dispatcher) {
+        h->dispatcher = std::make_unique<aap::ChannelDispatcher>(dispatcherConfig(env, queueConfig));
+        h->dispatcher->setLatency(&h->latency);
+        h->dispatcher->setCpuShare(h->cpuShare, coreShareCount());
+        h->dispatcher->setAudioCallback([h](int channel, uint8_t flags, const uint8_t* data, size_t length) {
+            dispatchAudioRecord(h, channel, flags, data, length);
+        });
+        h->dispatcher->setVideoCallback([h](int channel, uint8_t flags, const uint8_t* data, size_t length) {
+            dispatchVideoRecord(h, channel, flags, data, length);
+        });
+        h->dispatcher->setControlCallback([h](int channel, uint8_t flags, const uint8_t* data, size_t length) {
+            dispatchControlRecord(h, channel, flags, data, length);
+        });
+        h->dispatcher->setBackgroundCallback([h](int channel, uint8_t flags, const uint8_t* data, size_t length) {
+            callDispatchedRecord(h, upcalls.onBackgroundRecord, channel, flags, data, length);
+        });
+        if (controlBatchLatencyUs >= 0) {
+            h->dispatcher->setControlBatchCallback(
+                    [h](aap::RecordBatch& batch) { callControlBatchCallback(h, batch); },
+                    static_cast<uint32_t>(controlBatchLatencyUs));
+        }
+    }
+    h->dispatcher->start();
+    // Faulting the slabs in takes a while, do it before the read key arrives
+    if (!h->recordPool) {
+        h->recordPool = std::make_unique<aap::RecordPool>(aap::memoryProfile().recordPool);
+    }
+
+    setFramingStages(h);
+    return JNI_TRUE;
+}
+
+JNIEXPORT jobject JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetControlBatchBuffer(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->dispatcher || !h->dispatcher->isControlBatched()) {
+        LOGE("nativeGetControlBatchBuffer: invalid handle %ld or control batching disabled", (long)handle);
+        return nullptr;
+    }
+
+    // View stays valid until nativeClose()
+    aap::RecordBatch& batch = h->dispatcher->controlBatch();
+    return env->NewDirectByteBuffer(batch.data(), static_cast<jlong>(batch.capacity()));
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetReadKey(
+        JNIEnv* env, jclass clazz, jlong handle, jbyteArray key, jbyteArray salt, jlong sequence) {
+
+    LOGI("nativeSetReadKey called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !(h->dispatcher || h->shadow)) {
+        LOGE("nativeSetReadKey: invalid handle %ld, native dispatch and shadow framing disabled", (long)handle);
+        return JNI_FALSE;
+    }
+
+    jsize keyLength = env->GetArrayLength(key);
+    if (keyLength != 16 && keyLength != 32) {
+        LOGE("nativeSetReadKey: unsupported key length %d", keyLength);
+        return JNI_FALSE;
+    }
+    if (env->GetArrayLength(salt) != static_cast<jsize>(aap::TlsRecordLayer::SALT_SIZE)) {
+        LOGE("nativeSetReadKey: salt must be %zu bytes", aap::TlsRecordLayer::SALT_SIZE);
+        return JNI_FALSE;
+    }
+
+    uint8_t keyBytes[32];
+    uint8_t saltBytes[aap::TlsRecordLayer::SALT_SIZE];
+    env->GetByteArrayRegion(key, 0, keyLength, reinterpret_cast<jbyte*>(keyBytes));
+    env->GetByteArrayRegion(salt, 0, static_cast<jsize>(sizeof(saltBytes)), reinterpret_cast<jbyte*>(saltBytes));
+
+    if (h->capture) {
+        // A replay decrypts the records that follow with this key
+        h->capture->appendReadKey(keyBytes, static_cast<size_t>(keyLength), saltBytes,
+                                  static_cast<uint64_t>(sequence));
+    }
+    // Kotlin keeps decrypting with shadow framing, the key only checks it
+    const bool ok = h->dispatcher
+        ? installReadKey(h, keyBytes, static_cast<size_t>(keyLength), saltBytes, static_cast<uint64_t>(sequence))
+        : h->shadow->setReadKey(keyBytes, static_cast<size_t>(keyLength), saltBytes, static_cast<uint64_t>(sequence));
+    std::memset(keyBytes, 0, sizeof(keyBytes));
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetWriteKey(
+        JNIEnv* env, jclass clazz, jlong handle, jbyteArray key, jbyteArray salt, jlong sequence) {
+
+    LOGI("nativeSetWriteKey called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        LOGE("nativeSetWriteKey: invalid handle %ld", (long)handle);
+        return JNI_FALSE;
+    }
+
+    jsize keyLength = env->GetArrayLength(key);
+    if (keyLength != 16 && keyLength != 32) {
+        LOGE("nativeSetWriteKey: unsupported key length %d", keyLength);
+        return JNI_FALSE;
+    }
+    if (env->GetArrayLength(salt) != static_cast<jsize>(aap::TlsRecordLayer::SALT_SIZE)) {
+        LOGE("nativeSetWriteKey: salt must be %zu bytes", aap::TlsRecordLayer::SALT_SIZE);
+        return JNI_FALSE;
+    }
+
+    uint8_t keyBytes[32];
+    uint8_t saltBytes[aap::TlsRecordLayer::SALT_SIZE];
+    env->GetByteArrayRegion(key, 0, keyLength, reinterpret_cast<jbyte*>(keyBytes));
+    env->GetByteArrayRegion(salt, 0, static_cast<jsize>(sizeof(saltBytes)), reinterpret_cast<jbyte*>(saltBytes));
+
+    auto layer = std::make_unique<aap::TlsRecordLayer>();
+    const bool ok = layer->setWriteKey(keyBytes, static_cast<size_t>(keyLength), saltBytes,
+                                       static_cast<uint64_t>(sequence));
+    std::memset(keyBytes, 0, sizeof(keyBytes));
+    if (!ok) {
+        return JNI_FALSE;
+    }
+
+    std::lock_guard<std::mutex> lock(h->txRecordMutex);
+    if (!h->txRecord) {
+        h->txRecord.reset(new uint8_t[TX_RECORD_SIZE]);
+    }
+    h->writeLayer = std::move(layer);
+    LOGI("Native record encryption enabled, AES-%d", keyLength * 8);
+    return JNI_TRUE;
+}
+
+JNIEXPORT jint JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSendRecord(
+        JNIEnv* env, jclass clazz, jlong handle, jbyteArray data, jint length) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        LOGE("nativeSendRecord: invalid handle %ld", (long)handle);
+        return -1;
+    }
+    constexpr jint headerSize = static_cast<jint>(aap::EncryptedHeader::SIZE);
+    if (!inBounds(0, length, env->GetArrayLength(data)) || length < headerSize ||
+        static_cast<size_t>(length - headerSize) > MAX_TX_MESSAGE) {
+        LOGE("nativeSendRecord: bad message length %d", length);
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(h->txRecordMutex);
+    if (!h->writeLayer) {
+        LOGE("nativeSendRecord: no write key");
+        return -1;
+    }
+
+    // Each fragment's plaintext is copied straight to where it is sealed in place
+    uint8_t header[aap::EncryptedHeader::SIZE];
+    env->GetByteArrayRegion(data, 0, headerSize, reinterpret_cast<jbyte*>(header));
+    return writeTxMessage(h, header, static_cast<size_t>(length - headerSize),
+                          [env, data](uint8_t* out, size_t offset, size_t chunk) {
+                              env->GetByteArrayRegion(data, static_cast<jsize>(headerSize + offset),
+                                                      static_cast<jsize>(chunk), reinterpret_cast<jbyte*>(out));
+                          });
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeLoadReplayReadKey(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    LOGI("nativeLoadReplayReadKey called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !(h->replay || h->loadGenerator) || !h->dispatcher) {
+        LOGE("nativeLoadReplayReadKey: invalid handle %ld, not a replay or native dispatch disabled",
+             (long)handle);
+        return JNI_FALSE;
+    }
+
+    aap::CaptureReadKey key;
+    const bool found = h->replay ? h->replay->readKey(key) : h->loadGenerator->readKey(key);
+    if (!found) {
+        LOGE("nativeLoadReplayReadKey: %s has no read key", h->replay ? "capture" : "load generator");
+        return JNI_FALSE;
+    }
+    const bool ok = installReadKey(h, key.key, key.keyLength, key.salt, key.sequence);
+    std::memset(&key, 0, sizeof(key));
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetParallelDecryptEnabled(
+        JNIEnv* env, jclass clazz, jlong handle, jint workers) {
+
+    LOGI("nativeSetParallelDecryptEnabled called for handle=%ld, workers=%d", (long)handle, workers);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->recordLayer) {
+        LOGE("nativeSetParallelDecryptEnabled: invalid handle %ld or no read key", (long)handle);
+        return JNI_FALSE;
+    }
+    if (h->decryptPool) {
+        return JNI_TRUE;
+    }
+
+    if (!h->recordPool) {
+        h->recordPool = std::make_unique<aap::RecordPool>(aap::memoryProfile().recordPool);
+    }
+    auto pool = std::make_unique<aap::DecryptPool>(*h->recordLayer, *h->recordPool,
+                                                   static_cast<size_t>(std::max(0, static_cast<int>(workers))));
+    pool->setEmitCallback([h](int channel, uint8_t flags, const uint8_t* data, size_t length) {
+        dispatchRecord(h, channel, flags, data, length);
+    });
+    pool->setFailureCallback([h](int channel) {
+        callErrorCallback(h, -1, "TLS record authentication failed");
+    });
+    pool->setLatency(&h->latency);
+    pool->setCpuShare(h->cpuShare, coreShareCount());
+    pool->start();
+    h->decryptPool = std::move(pool);
+    return JNI_TRUE;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetRecordPoolStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->recordPool) {
+        return nullptr;
+    }
+
+    const aap::RecordPool::Stats stats = h->recordPool->getStats();
+    constexpr int CLASS_VALUES = 4;
+    constexpr int COUNT = aap::RecordPool::NUM_CLASSES * CLASS_VALUES + 2;
+    jlong values[COUNT];
+    for (int i = 0; i < aap::RecordPool::NUM_CLASSES; i++) {
+        values[i * CLASS_VALUES] = static_cast<jlong>(stats.classes[i].size);
+        values[i * CLASS_VALUES + 1] = static_cast<jlong>(stats.classes[i].slabs);
+        values[i * CLASS_VALUES + 2] = static_cast<jlong>(stats.classes[i].inUse);
+        values[i * CLASS_VALUES + 3] = static_cast<jlong>(stats.classes[i].highWater);
+    }
+    values[COUNT - 2] = static_cast<jlong>(stats.promotions);
+    values[COUNT - 1] = static_cast<jlong>(stats.exhausted);
+    jlongArray result = env->NewLongArray(COUNT);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, COUNT, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetQualityGovernorEnabled(
+        JNIEnv* env, jclass clazz, jlong handle, jint intervalMs) {
+
+    LOGI("nativeSetQualityGovernorEnabled called for handle=%ld, intervalMs=%d", (long)handle, intervalMs);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->dispatcher) {
+        LOGE("nativeSetQualityGovernorEnabled: invalid handle %ld or native dispatch disabled", (long)handle);
+        return JNI_FALSE;
+    }
+    if (h->governor) {
+        return JNI_TRUE;
+    }
+
+    auto governor = std::make_unique<aap::QualityGovernor>(
+        intervalMs > 0 ? intervalMs : aap::QualityGovernor::DEFAULT_INTERVAL_MS);
+    governor->setSampler([h] {
+        aap::GovernorSample sample;
+        const aap::ChannelDispatcher::Stats stats = h->dispatcher->getStats();
+        sample.videoQueueFill = h->dispatcher->queueFill(aap::Channel::ID_VID);
+        sample.videoDrops = stats.video.queueDrops;
+        sample.backgroundBlockedNs = stats.background.blockedNs;
+        if (aap::VideoDecoder* decoder = h->decoderStage.load(std::memory_order_acquire)) {
+            const aap::VideoDecoder::LatencyStats latency = decoder->getLatencyStats();
+            sample.framesDecoded = latency.frames;
+            sample.decodeTotalUs = latency.decodeTotalUs;
+        }
+        return sample;
+    });
+    // The decrypt pool, if any, was enabled before the governor thread starts
+    aap::DecryptPool* pool = h->decryptPool.get();
+    governor->setCallback([h, pool](aap::QualityLevel level) {
+        h->dispatcher->setBackgroundShedding(level >= aap::QualityLevel::ELEVATED);
+        if (pool) {
+            pool->setActiveWorkers(aap::QualityGovernor::decryptWorkers(level, pool->workerCount()));
+        }
+    });
+    governor->start();
+    h->governor = std::move(governor);
+    return JNI_TRUE;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetQualityGovernorStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->governor) {
+        return nullptr;
+    }
+
+    const aap::QualityGovernor::Stats stats = h->governor->getStats();
+    jlong values[9] = {
+        static_cast<jlong>(stats.level),
+        static_cast<jlong>(stats.maxLevel),
+        static_cast<jlong>(stats.levelChanges),
+        static_cast<jlong>(stats.thermalStatus),
+        static_cast<jlong>(stats.thermalSource),
+        static_cast<jlong>(stats.loadLevel),
+        static_cast<jlong>(stats.videoQueueFill),
+        static_cast<jlong>(stats.decodeAvgUs),
+        static_cast<jlong>(stats.samples)
+    };
+    jlongArray result = env->NewLongArray(9);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 9, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetStallWatchdogEnabled(
+        JNIEnv* env, jclass clazz, jlong handle, jstring path, jint thresholdMs) {
+
+    LOGI("nativeSetStallWatchdogEnabled called for handle=%ld, thresholdMs=%d", (long)handle, thresholdMs);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !path) {
+        LOGE("nativeSetStallWatchdogEnabled: invalid handle %ld or no path", (long)handle);
+        return JNI_FALSE;
+    }
+    if (h->watchdog) {
+        return JNI_TRUE;
+    }
+
+    auto watchdog = std::make_unique<aap::StallWatchdog>(thresholdMs);
+    const char* snapshotPath = env->GetStringUTFChars(path, nullptr);
+    if (!snapshotPath) {
+        return JNI_FALSE;
+    }
+    const bool opened = watchdog->open(snapshotPath);
+    env->ReleaseStringUTFChars(path, snapshotPath);
+    if (!opened) {
+        return JNI_FALSE;
+    }
+
+    aap::Transport* transport = h->transport.get();
+    const char* eventThread = h->usb ? "AAP-USB-Event" : h->tcp ? "AAP-TCP-Event" : "transport";
+    watchdog->watch("rx", eventThread, [transport] {
+        const aap::TransportProgress p = transport->progress();
+        return aap::WatchSample{p.deliveries, p.delivering ? 1u : 0u};
+    });
+    watchdog->watch("tx", eventThread, [transport] {
+        const aap::TransportProgress p = transport->progress();
+        return aap::WatchSample{p.txCompleted, p.txPending};
+    });
+
+    // Dispatch mode is fixed before this is called
+    if (aap::ChannelDispatcher* dispatcher = h->dispatcher.get()) {
+        static const struct {
+            const char* name;
+            const char* thread;
+            aap::ChannelPriority priority;
+        } lanes[] = {
+            {"audio-lane", "AAP-Audio", aap::ChannelPriority::HIGH},
+            {"video-lane", "AAP-Video", aap::ChannelPriority::MEDIUM},
+            {"control-lane", "AAP-Control", aap::ChannelPriority::NORMAL},
+            {"bg-lane", "AAP-Background", aap::ChannelPriority::BACKGROUND},
+        };
+        for (const auto& lane : lanes) {
+            const aap::ChannelPriority priority = lane.priority;
+            const bool pooled = dispatcher->isPooled() && priority != aap::ChannelPriority::HIGH;
+            watchdog->watch(lane.name, pooled ? "AAP-Worker" : lane.thread, [dispatcher, priority] {
+                const aap::ChannelDispatcher::LaneProgress p = dispatcher->laneProgress(priority);
+                return aap::WatchSample{p.delivered, p.depth};
+            });
+        }
+    }
+
+    // The decoder may be enabled later, frames waiting in the assembler are its work
+    watchdog->watch("decode-feed", "AAP-Decode", [h] {
+        aap::WatchSample sample;
+        if (aap::VideoDecoder* decoder = h->decoderStage.load(std::memory_order_acquire)) {
+            const aap::VideoDecoder::Stats stats = decoder->getStats();
+            sample.progress = stats.framesQueued + stats.framesSkipped;
+            if (aap::VideoAssembler* assembler = h->videoStage.load(std::memory_order_acquire)) {
+                sample.pending = assembler->getStats().framesQueued;
+            }
+        }
+        return sample;
+    });
+
+    // Never stall, listed for when each stage last saw a record
+    static const struct {
+        const char* name;
+        aap::PipelineLatency::Stage stage;
+    } stages[] = {
+        {"stage-frame", aap::PipelineLatency::FRAME},
+        {"stage-decrypt", aap::PipelineLatency::DECRYPT},
+        {"stage-queue", aap::PipelineLatency::QUEUE_WAIT},
+        {"stage-callback", aap::PipelineLatency::CALLBACK},
+        {"stage-decode", aap::PipelineLatency::DECODE_FEED},
+    };
+    for (const auto& stage : stages) {
+        const aap::LatencyHistogram* histogram = &h->latency.stages[stage.stage];
+        watchdog->watch(stage.name, "-", [histogram] {
+            return aap::WatchSample{histogram->summarize().count, 0};
+        });
+    }
+
+    watchdog->setDetails([h, transport](aap::SnapshotText& out) {
+        const aap::TransportProgress p = transport->progress();
+        out.append("transport: rx in flight %llu, tx pending %llu, tx completed %llu, delivering %d\n",
+                   static_cast<unsigned long long>(p.rxInFlight), static_cast<unsigned long long>(p.txPending),
+                   static_cast<unsigned long long>(p.txCompleted), p.delivering ? 1 : 0);
+        if (aap::ChannelDispatcher* dispatcher = h->dispatcher.get()) {
+            const aap::ChannelDispatcher::Stats stats = dispatcher->getStats();
+            out.append("dispatcher: video queue %u%%, video drops %llu, background blocked %llu ms\n",
+                       dispatcher->queueFill(aap::Channel::ID_VID),
+                       static_cast<unsigned long long>(stats.video.queueDrops),
+                       static_cast<unsigned long long>(stats.background.blockedNs / 1000000));
+        }
+        if (aap::VideoAssembler* assembler = h->videoStage.load(std::memory_order_acquire)) {
+            const aap::VideoAssembler::Stats stats = assembler->getStats();
+            out.append("assembler: assembled %llu, ready %llu, dropped %llu\n",
+                       static_cast<unsigned long long>(stats.framesAssembled),
+                       static_cast<unsigned long long>(stats.framesQueued),
+                       static_cast<unsigned long long>(stats.framesDropped));
+        }
+        if (aap::VideoDecoder* decoder = h->decoderStage.load(std::memory_order_acquire)) {
+            const aap::VideoDecoder::Stats stats = decoder->getStats();
+            out.append("decoder: queued %llu, skipped %llu, rendered %llu, codec errors %llu\n",
+                       static_cast<unsigned long long>(stats.framesQueued),
+                       static_cast<unsigned long long>(stats.framesSkipped),
+                       static_cast<unsigned long long>(stats.framesRendered),
+                       static_cast<unsigned long long>(stats.codecErrors));
+        }
+    });
+
+    watchdog->start();
+    h->watchdog = std::move(watchdog);
+    return JNI_TRUE;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetStallWatchdogStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->watchdog) {
+        return nullptr;
+    }
+
+    const aap::StallWatchdog::Stats stats = h->watchdog->getStats();
+    jlong values[5] = {
+        static_cast<jlong>(stats.checks),
+        static_cast<jlong>(stats.stalls),
+        static_cast<jlong>(stats.stalledNow),
+        static_cast<jlong>(stats.longestStallMs),
+        static_cast<jlong>(stats.lastStalled)
+    };
+    jlongArray result = env->NewLongArray(5);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 5, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetStatsExportEnabled(
+        JNIEnv* env, jclass clazz, jlong handle, jstring path, jint intervalMs) {
+
+    LOGI("nativeSetStatsExportEnabled called for handle=%ld, intervalMs=%d", (long)handle, intervalMs);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !path) {
+        LOGE("nativeSetStatsExportEnabled: invalid handle %ld or no path", (long)handle);
+        return JNI_FALSE;
+    }
+    if (h->statsExport) {
+        return JNI_TRUE;
+    }
+
+    auto statsExport = std::make_unique<aap::StatsExport>(intervalMs);
+    const char* statsPath = env->GetStringUTFChars(path, nullptr);
+    if (!statsPath) {
+        return JNI_FALSE;
+    }
+    const bool opened = statsExport->open(statsPath);
+    env->ReleaseStringUTFChars(path, statsPath);
+    if (!opened) {
+        return JNI_FALSE;
+    }
+
+    // Dispatch mode, and with it the record pool, is fixed before this is called
+    aap::ChannelDispatcher* dispatcher = h->dispatcher.get();
+    aap::RecordPool* recordPool = h->recordPool.get();
+    statsExport->setCollector([h, dispatcher, recordPool](aap::StatsValues& values) {
+        values.transport(h->transport->progress());
+        if (h->usb) {
+            values.link(h->usb->getLinkStats());
+        }
+        values.latency(h->latency);
+        if (dispatcher) {
+            values.lanes(*dispatcher);
+        }
+        aap::VideoAssembler::Stats assembler;
+        aap::DecoderCounts decoder;
+        aap::VideoAssembler* assemblerStage = h->videoStage.load(std::memory_order_acquire);
+        aap::VideoDecoder* decoderStage = h->decoderStage.load(std::memory_order_acquire);
+        if (assemblerStage) {
+            assembler = assemblerStage->getStats();
+        }
+        if (decoderStage) {
+            const aap::VideoDecoder::Stats stats = decoderStage->getStats();
+            decoder = {stats.framesQueued, stats.framesCopied, stats.framesSkipped,
+                       stats.framesRendered, stats.codecErrors, stats.framesLate};
+        }
+        values.video(assemblerStage ? &assembler : nullptr, decoderStage ? &decoder : nullptr);
+        if (recordPool) {
+            values.pool(recordPool->getStats());
+        }
+    });
+    statsExport->start();
+    h->statsExport = std::move(statsExport);
+    return JNI_TRUE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetMediaAckBatching(
+        JNIEnv* env, jclass clazz, jlong handle, jint threshold, jint tickMs, jboolean flowControl) {
+
+    LOGI("nativeSetMediaAckBatching called for handle=%ld, threshold=%d, tickMs=%d, flowControl=%d",
+         (long)handle, threshold, tickMs, flowControl);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->dispatcher) {
+        LOGE("nativeSetMediaAckBatching: invalid handle %ld or native dispatch disabled", (long)handle);
+        return JNI_FALSE;
+    }
+    if (h->ackBatcher) {
+        return JNI_TRUE;
+    }
+
+    h->ackBatcher = std::make_unique<aap::MediaAckBatcher>(
+        threshold > 0 ? static_cast<uint32_t>(threshold) : aap::MediaAckBatcher::DEFAULT_THRESHOLD,
+        tickMs > 0 ? tickMs : aap::MediaAckBatcher::DEFAULT_TICK_MS);
+    h->ackBatcher->setCallback([h](int channel, uint32_t count) {
+        callMediaAckCallback(h, channel, count);
+    });
+    if (flowControl) {
+        h->ackBatcher->setFlowControl([h](int channel) {
+            return h->dispatcher->queueFill(channel);
+        });
+    }
+    h->ackBatcher->start();
+    h->ackStage.store(h->ackBatcher.get(), std::memory_order_release);
+    return JNI_TRUE;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetMediaAckStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->ackBatcher) {
+        return nullptr;
+    }
+
+    const aap::MediaAckBatcher::Stats stats = h->ackBatcher->getStats();
+    jlong values[7] = {
+        static_cast<jlong>(stats.acksSent),
+        static_cast<jlong>(stats.recordsAcked),
+        static_cast<jlong>(stats.thresholdFlushes),
+        static_cast<jlong>(stats.maxBatch),
+        static_cast<jlong>(stats.holds),
+        static_cast<jlong>(stats.holdTimeouts),
+        static_cast<jlong>(stats.heldNs)
+    };
+    jlongArray result = env->NewLongArray(7);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 7, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetNativeKeepalive(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    LOGI("nativeSetNativeKeepalive called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        LOGE("nativeSetNativeKeepalive: invalid handle %ld", (long)handle);
+        return JNI_FALSE;
+    }
+    {
+        std::lock_guard<std::mutex> lock(h->txRecordMutex);
+        if (!h->writeLayer) {
+            LOGE("nativeSetNativeKeepalive: no write key");
+            return JNI_FALSE;
+        }
+    }
+    if (!h->responder) {
+        h->responder = std::make_unique<aap::ControlResponder>();
+        h->responderStage.store(h->responder.get(), std::memory_order_release);
+    }
+    return JNI_TRUE;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetMediaSessionId(
+        JNIEnv* env, jclass clazz, jlong handle, jint channel, jint sessionId) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->responder) {
+        return;
+    }
+    h->responder->setSessionId(channel, sessionId);
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetKeepaliveStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->responder) {
+        return nullptr;
+    }
+
+    const aap::ControlResponder::Stats stats = h->responder->getStats();
+    jlong values[5] = {
+        static_cast<jlong>(stats.pings),
+        static_cast<jlong>(stats.acks),
+        static_cast<jlong>(stats.noSession),
+        static_cast<jlong>(stats.failures),
+        static_cast<jlong>(stats.maxTurnaroundNs)
+    };
+    jlongArray result = env->NewLongArray(5);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 5, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetSensorBatching(
+        JNIEnv* env, jclass clazz, jlong handle, jint windowMs) {
+
+    LOGI("nativeSetSensorBatching called for handle=%ld, windowMs=%d", (long)handle, windowMs);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        LOGE("nativeSetSensorBatching: invalid handle %ld", (long)handle);
+        return JNI_FALSE;
+    }
+    if (h->sensorAggregator) {
+        return JNI_TRUE;
+    }
+
+    h->sensorAggregator = std::make_unique<aap::SensorAggregator>(
+        windowMs > 0 ? windowMs : aap::SensorAggregator::DEFAULT_WINDOW_MS);
+    h->sensorAggregator->setCallback([h](const uint8_t* record, size_t length) {
+        callSensorBatchCallback(h, record, length);
+    });
+    h->sensorAggregator->start();
+    return JNI_TRUE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSubmitSensor(
+        JNIEnv* env, jclass clazz, jlong handle, jint sensorType, jbyteArray data, jint offset, jint length) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->sensorAggregator || offset < 0 || length <= 0 ||
+            static_cast<size_t>(length) > aap::SensorAggregator::MAX_UPDATE_SIZE ||
+            offset + length > env->GetArrayLength(data)) {
+        return JNI_FALSE;
+    }
+
+    uint8_t update[aap::SensorAggregator::MAX_UPDATE_SIZE];
+    env->GetByteArrayRegion(data, offset, length, reinterpret_cast<jbyte*>(update));
+    return h->sensorAggregator->submit(sensorType, update, static_cast<size_t>(length))
+        ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetSensorBatchStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->sensorAggregator) {
+        return nullptr;
+    }
+
+    const aap::SensorAggregator::Stats stats = h->sensorAggregator->getStats();
+    jlong values[4] = {
+        static_cast<jlong>(stats.updatesSubmitted),
+        static_cast<jlong>(stats.updatesSuperseded),
+        static_cast<jlong>(stats.recordsSent),
+        static_cast<jlong>(stats.maxUpdatesPerRecord)
+    };
+    jlongArray result = env->NewLongArray(4);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 4, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetTouchInputEnabled(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    LOGI("nativeSetTouchInputEnabled called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        LOGE("nativeSetTouchInputEnabled: invalid handle %ld", (long)handle);
+        return JNI_FALSE;
+    }
+    if (h->touchInput) {
+        return JNI_TRUE;
+    }
+
+    jbyteArray buffer = env->NewByteArray(static_cast<jsize>(aap::TouchInput::MAX_RECORD_SIZE));
+    if (!buffer) {
+        return JNI_FALSE;
+    }
+    h->inputRecordBuffer = static_cast<jbyteArray>(env->NewGlobalRef(buffer));
+    env->DeleteLocalRef(buffer);
+
+    h->touchInput = std::make_unique<aap::TouchInput>();
+    h->touchInput->setRecordCallback([h](const uint8_t* record, size_t length) {
+        callInputRecordCallback(h, record, length);
+    });
+    h->touchInput->start();
+    return JNI_TRUE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSubmitTouch(
+        JNIEnv* env, jclass clazz, jlong handle, jlong timestampNs, jint action, jint actionIndex,
+        jint pointerCount, jintArray pointers) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->touchInput || pointerCount <= 0 || pointerCount > aap::TouchSample::MAX_POINTERS ||
+            env->GetArrayLength(pointers) < pointerCount * 3) {
+        return JNI_FALSE;
+    }
+
+    jint values[aap::TouchSample::MAX_POINTERS * 3];
+    env->GetIntArrayRegion(pointers, 0, pointerCount * 3, values);
+
+    aap::TouchSample sample;
+    sample.timestampNs = static_cast<uint64_t>(timestampNs);
+    sample.action = static_cast<uint8_t>(action);
+    sample.actionIndex = static_cast<uint8_t>(actionIndex);
+    sample.pointerCount = static_cast<uint8_t>(pointerCount);
+    for (int i = 0; i < pointerCount; i++) {
+        sample.pointers[i].id = static_cast<uint32_t>(values[i * 3]);
+        sample.pointers[i].x = static_cast<uint32_t>(values[i * 3 + 1]);
+        sample.pointers[i].y = static_cast<uint32_t>(values[i * 3 + 2]);
+    }
+    return h->touchInput->submit(sample) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetTouchInputStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->touchInput) {
+        return nullptr;
+    }
+
+    const aap::TouchInput::Stats stats = h->touchInput->getStats();
+    jlong values[4] = {
+        static_cast<jlong>(stats.samplesSubmitted),
+        static_cast<jlong>(stats.movesCoalesced),
+        static_cast<jlong>(stats.recordsSent),
+        static_cast<jlong>(stats.samplesDropped)
+    };
+    jlongArray result = env->NewLongArray(4);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 4, values);
+    }
+    return result;
+}
+
+JNIEXPORT jobject JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetControlRingEnabled(
+        JNIEnv* env, jclass clazz, jlong handle, jint capacity) {
+
+    LOGI("nativeSetControlRingEnabled called for handle=%ld, capacity=%d", (long)handle, capacity);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->dispatcher) {
+        LOGE("nativeSetControlRingEnabled: invalid handle %ld or native dispatch disabled", (long)handle);
+        return nullptr;
+    }
+    if (!h->controlRing) {
+        h->controlRing = std::make_unique<aap::SharedRecordRing>(
+            capacity > 0 ? static_cast<size_t>(capacity) : aap::SharedRecordRing::DEFAULT_CAPACITY);
+        h->controlRingStage.store(h->controlRing.get(), std::memory_order_release);
+    }
+
+    // View stays valid until nativeClose()
+    return env->NewDirectByteBuffer(h->controlRing->data(),
+                                    static_cast<jlong>(h->controlRing->capacity()));
+}
+
+JNIEXPORT jlong JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeAwaitControlRing(
+        JNIEnv* env, jclass clazz, jlong handle, jlong readPosition, jint timeoutMs) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->controlRing) {
+        return -1;
+    }
+    return static_cast<jlong>(h->controlRing->await(static_cast<uint64_t>(readPosition), timeoutMs));
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetControlRingStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->controlRing) {
+        return nullptr;
+    }
+
+    const aap::SharedRecordRing::Stats stats = h->controlRing->getStats();
+    jlong values[4] = {
+        static_cast<jlong>(stats.recordsPublished),
+        static_cast<jlong>(stats.bytesPublished),
+        static_cast<jlong>(stats.producerWaits),
+        static_cast<jlong>(stats.recordsRejected)
+    };
+    jlongArray result = env->NewLongArray(4);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 4, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeStartMic(
+        JNIEnv* env, jclass clazz, jlong handle, jint sampleRate) {
+
+    LOGI("nativeStartMic called for handle=%ld, sampleRate=%d", (long)handle, sampleRate);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        LOGE("nativeStartMic: invalid handle %ld", (long)handle);
+        return JNI_FALSE;
+    }
+    if (h->micInput && h->micInput->sampleRate() != sampleRate) {
+        h->micInput->stop();
+        h->micInput.reset();
+    }
+    if (!h->micInput) {
+        h->micInput = std::make_unique<aap::MicInput>(sampleRate);
+        h->micInput->setRecordCallback([h](const uint8_t* record, size_t length) {
+            callMicRecordCallback(h, record, length);
+        });
+    }
+    return h->micInput->start() ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeStopMic(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    LOGI("nativeStopMic called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (h && h->micInput) {
+        h->micInput->stop();
+    }
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetMicStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->micInput) {
+        return nullptr;
+    }
+
+    const aap::MicInput::Stats stats = h->micInput->getStats();
+    jlong values[6] = {
+        static_cast<jlong>(stats.bytesCaptured),
+        static_cast<jlong>(stats.bytesDropped),
+        static_cast<jlong>(stats.recordsSent),
+        static_cast<jlong>(stats.reopens),
+        static_cast<jlong>(stats.framesPerBurst),
+        static_cast<jlong>(stats.deviceRate)
+    };
+    jlongArray result = env->NewLongArray(6);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 6, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetAudioOutputEnabled(
+        JNIEnv* env, jclass clazz, jlong handle, jboolean mixed) {
+
+    LOGI("nativeSetAudioOutputEnabled called for handle=%ld, mixed=%d", (long)handle, mixed);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->dispatcher) {
+        LOGE("nativeSetAudioOutputEnabled: invalid handle %ld or native dispatch disabled", (long)handle);
+        return JNI_FALSE;
+    }
+    if (h->audioOutput) {
+        return JNI_TRUE;
+    }
+
+    h->audioOutput = std::make_unique<aap::AudioOutput>(mixed == JNI_TRUE);
+    h->audioStage.store(h->audioOutput.get(), std::memory_order_release);
+    return JNI_TRUE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetAudioOutputGain(
+        JNIEnv* env, jclass clazz, jlong handle, jint channel, jfloat gain) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->audioOutput) {
+        return JNI_FALSE;
+    }
+    return h->audioOutput->setGain(channel, gain) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeStopAudioOutput(
+        JNIEnv* env, jclass clazz, jlong handle, jint channel) {
+
+    LOGI("nativeStopAudioOutput called for handle=%ld, channel=%d", (long)handle, channel);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (h && h->audioOutput) {
+        h->audioOutput->stop(channel);
+    }
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetAudioOutputStats(
+        JNIEnv* env, jclass clazz, jlong handle, jint channel) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->audioOutput) {
+        return nullptr;
+    }
+
+    aap::AudioSink::Stats stats{};
+    aap::AudioSink::Backend backend = aap::AudioSink::Backend::NONE;
+    if (!h->audioOutput->getStats(channel, stats, backend)) {
+        return nullptr;
+    }
+    jlong values[12] = {
+        static_cast<jlong>(stats.bytesWritten),
+        static_cast<jlong>(stats.bytesDropped),
+        static_cast<jlong>(stats.underruns),
+        static_cast<jlong>(stats.framesPlayed),
+        static_cast<jlong>(stats.framesPerBurst),
+        static_cast<jlong>(stats.bufferFrames),
+        static_cast<jlong>(backend),
+        static_cast<jlong>(stats.jitter.fillMs),
+        static_cast<jlong>(stats.jitter.targetMs),
+        static_cast<jlong>(stats.jitter.jitterUs),
+        static_cast<jlong>(stats.jitter.correctionPpm),
+        static_cast<jlong>(h->audioOutput->ducks())
+    };
+    jlongArray result = env->NewLongArray(12);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 12, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetVideoStageEnabled(
+        JNIEnv* env, jclass clazz, jlong handle, jboolean hevc) {
+
+    LOGI("nativeSetVideoStageEnabled called for handle=%ld, hevc=%d", (long)handle, hevc);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->dispatcher) {
+        LOGE("nativeSetVideoStageEnabled: invalid handle %ld or native dispatch disabled", (long)handle);
+        return JNI_FALSE;
+    }
+    if (h->videoAssembler) {
+        return JNI_TRUE;
+    }
+
+    const aap::MemoryProfile profile = aap::memoryProfile();
+    h->videoAssembler = std::make_unique<aap::VideoAssembler>(
+            hevc ? aap::VideoCodec::H265 : aap::VideoCodec::H264, profile.maxFrameSize, profile.frameSlots);
+    h->videoStage.store(h->videoAssembler.get(), std::memory_order_release);
+    return JNI_TRUE;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetIdle(
+        JNIEnv* env, jclass clazz, jlong handle, jboolean idle) {
+
+    LOGI("nativeSetIdle called for handle=%ld, idle=%d", (long)handle, idle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        LOGE("nativeSetIdle: invalid handle %ld", (long)handle);
+        return;
+    }
+
+    // The stage switches first either way, so video records never reach
+    // the inline path while it still assembles into decoder buffers
+    aap::VideoAssembler* stage = h->videoStage.load(std::memory_order_acquire);
+    if (stage) {
+        stage->setIdle(idle);
+    }
+    h->videoIdle.store(idle && stage, std::memory_order_relaxed);
+    h->transport->setIdle(idle);
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetVideoFrameBuffers(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->videoAssembler) {
+        LOGE("nativeGetVideoFrameBuffers: invalid handle %ld or video stage disabled", (long)handle);
+        return nullptr;
+    }
+
+    if (!h->videoAssembler->reserveFrameBuffers()) {
+        LOGE("nativeGetVideoFrameBuffers: could not allocate frame buffers");
+        return nullptr;
+    }
+
+    jclass bufferClass = env->FindClass("java/nio/ByteBuffer");
+    if (!bufferClass) return nullptr;
+
+    const jsize count = static_cast<jsize>(h->videoAssembler->slotCount());
+    jobjectArray result = env->NewObjectArray(count, bufferClass, nullptr);
+    env->DeleteLocalRef(bufferClass);
+    if (!result) return nullptr;
+
+    // Views stay valid until nativeClose()
+    for (jsize i = 0; i < count; i++) {
+        jobject view = env->NewDirectByteBuffer(h->videoAssembler->frameBuffer(i),
+                                                static_cast<jlong>(h->videoAssembler->frameSize()));
+        if (!view) return nullptr;
+        env->SetObjectArrayElement(result, i, view);
+        env->DeleteLocalRef(view);
+    }
+    return result;
+}
+
+JNIEXPORT jint JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativePollVideoFrame(
+        JNIEnv* env, jclass clazz, jlong handle, jintArray info, jint timeoutMs) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->videoAssembler) {
+        return -1;
+    }
+
+    aap::VideoFrameInfo frame{};
+    const int slot = h->videoAssembler->acquireFrame(frame, timeoutMs);
+    if (slot < 0) {
+        return -1;
+    }
+
+    // [length, first NAL type, flags]
+    jint values[3] = {
+        static_cast<jint>(frame.length),
+        static_cast<jint>(frame.nalType),
+        static_cast<jint>(frame.flags)
+    };
+    env->SetIntArrayRegion(info, 0, 3, values);
+    return slot;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeReleaseVideoFrame(
+        JNIEnv* env, jclass clazz, jlong handle, jint slot) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (h && h->videoAssembler) {
+        h->videoAssembler->releaseFrame(slot);
+    }
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetVideoStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->videoAssembler) {
+        return nullptr;
+    }
+
+    const aap::VideoAssembler::Stats stats = h->videoAssembler->getStats();
+    jlong values[10] = {
+        static_cast<jlong>(stats.framesAssembled),
+        static_cast<jlong>(stats.framesDropped),
+        static_cast<jlong>(stats.recordsDropped),
+        static_cast<jlong>(stats.parameterSetUpdates),
+        static_cast<jlong>(stats.framesQueued),
+        static_cast<jlong>(stats.framesDirect),
+        static_cast<jlong>(stats.keyframeRequests),
+        static_cast<jlong>(stats.framesSkippedIdle),
+        static_cast<jlong>(stats.keyframesCached),
+        static_cast<jlong>(stats.keyframesReplayed)
+    };
+    jlongArray result = env->NewLongArray(10);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 10, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeStartVideoDecoder(
+        JNIEnv* env, jclass clazz, jlong handle, jobject surface, jint width, jint height,
+        jboolean lowLatency, jboolean avSync) {
+
+    LOGI("nativeStartVideoDecoder called for handle=%ld, %dx%d, lowLatency=%d, avSync=%d",
+         (long)handle, width, height, lowLatency, avSync);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->videoAssembler) {
+        LOGE("nativeStartVideoDecoder: invalid handle %ld or video stage disabled", (long)handle);
+        return JNI_FALSE;
+    }
+
+    ANativeWindow* window = ANativeWindow_fromSurface(env, surface);
+    if (!window) {
+        LOGE("nativeStartVideoDecoder: no window for surface");
+        return JNI_FALSE;
+    }
+
+    if (!h->videoDecoder) {
+        h->videoDecoder = std::make_unique<aap::VideoDecoder>(*h->videoAssembler, h->videoAssembler->codec());
+        h->videoDecoder->setLatency(&h->latency);
+        h->decoderStage.store(h->videoDecoder.get(), std::memory_order_release);
+    }
+    // Sync follows native audio only, Kotlin playback has no clock to offer
+    aap::MediaClock* clock = avSync == JNI_TRUE && h->audioOutput ? &h->mediaClock : nullptr;
+    if (avSync == JNI_TRUE && !clock) {
+        LOGE("nativeStartVideoDecoder: A/V sync needs the native audio output");
+    }
+    if (!h->videoDecoder->isRunning()) {
+        h->videoDecoder->setClock(clock);
+    }
+    if (h->audioOutput) {
+        h->audioOutput->setClock(clock);
+    }
+    // The decoder holds its own window reference
+    const bool started = h->videoDecoder->start(window, width, height, lowLatency == JNI_TRUE);
+    ANativeWindow_release(window);
+    return started ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativePrepareVideoDecoder(
+        JNIEnv* env, jclass clazz, jlong handle, jint width, jint height,
+        jboolean lowLatency, jboolean avSync) {
+
+    LOGI("nativePrepareVideoDecoder called for handle=%ld, %dx%d, lowLatency=%d, avSync=%d",
+         (long)handle, width, height, lowLatency, avSync);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->videoAssembler) {
+        LOGE("nativePrepareVideoDecoder: invalid handle %ld or video stage disabled", (long)handle);
+        return JNI_FALSE;
+    }
+
+    if (!h->videoDecoder) {
+        h->videoDecoder = std::make_unique<aap::VideoDecoder>(*h->videoAssembler, h->videoAssembler->codec());
+        h->videoDecoder->setLatency(&h->latency);
+        h->decoderStage.store(h->videoDecoder.get(), std::memory_order_release);
+    }
+    if (h->videoDecoder->isRunning()) {
+        return JNI_TRUE;
+    }
+    aap::MediaClock* clock = avSync == JNI_TRUE && h->audioOutput ? &h->mediaClock : nullptr;
+    h->videoDecoder->setClock(clock);
+    if (h->audioOutput) {
+        h->audioOutput->setClock(clock);
+    }
+    return h->videoDecoder->prepare(width, height, lowLatency == JNI_TRUE) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeParkVideoDecoder(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    LOGI("nativeParkVideoDecoder called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (h && h->videoDecoder) {
+        h->videoDecoder->park();
+    }
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetVideoLateFrameBudget(
+        JNIEnv* env, jclass clazz, jlong handle, jint budgetMs) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->videoDecoder || budgetMs < 0) {
+        return JNI_FALSE;
+    }
+    h->videoDecoder->setLateFrameBudget(static_cast<uint64_t>(budgetMs) * 1000);
+    return JNI_TRUE;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeStopVideoDecoder(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    LOGI("nativeStopVideoDecoder called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (h && h->videoDecoder) {
+        h->videoDecoder->stop();
+    }
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetVideoDecoderStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
 
-    ConnectionHandle* h = getHandle(handle);
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->videoDecoder) {
+        return nullptr;
+    }
+
+    const aap::VideoDecoder::Stats stats = h->videoDecoder->getStats();
+    jlong values[6] = {
+        static_cast<jlong>(stats.framesQueued),
+        static_cast<jlong>(stats.framesCopied),
+        static_cast<jlong>(stats.framesSkipped),
+        static_cast<jlong>(stats.framesRendered),
+        static_cast<jlong>(stats.codecErrors),
+        static_cast<jlong>(stats.framesLate)
+    };
+    jlongArray result = env->NewLongArray(6);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 6, values);
+    }
+    return result;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetVideoLatencyStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->videoDecoder) {
+        return nullptr;
+    }
+
+    const aap::VideoDecoder::LatencyStats stats = h->videoDecoder->getLatencyStats();
+    jlong values[7] = {
+        static_cast<jlong>(stats.frames),
+        static_cast<jlong>(stats.queueTotalUs),
+        static_cast<jlong>(stats.decodeTotalUs),
+        static_cast<jlong>(stats.presentTotalUs),
+        static_cast<jlong>(stats.queueLastUs),
+        static_cast<jlong>(stats.decodeLastUs),
+        static_cast<jlong>(stats.presentLastUs)
+    };
+    jlongArray result = env->NewLongArray(7);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 7, values);
+    }
+    return result;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetAvSyncStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->videoDecoder) {
+        return nullptr;
+    }
+
+    const aap::MediaClock::Stats stats = h->mediaClock.getStats();
+    jlong values[4] = {
+        static_cast<jlong>(stats.framesSynced),
+        static_cast<jlong>(stats.framesLate),
+        static_cast<jlong>(stats.framesFreeRunning),
+        static_cast<jlong>(stats.leadLastUs)
+    };
+    jlongArray result = env->NewLongArray(4);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 4, values);
+    }
+    return result;
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetVideoParameterSets(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->videoAssembler) {
+        return nullptr;
+    }
+
+    aap::VideoAssembler::ParameterSets sets;
+    if (!h->videoAssembler->getParameterSets(sets)) {
+        return nullptr;
+    }
+
+    jclass arrayClass = env->FindClass("[B");
+    if (!arrayClass) return nullptr;
+
+    // [vps,] sps, pps: H.265 joins all three into csd-0, H.264 uses csd-0/csd-1
+    const std::vector<uint8_t>* parts[] = {&sets.vps, &sets.sps, &sets.pps};
+    const jsize first = sets.vps.empty() ? 1 : 0;
+    jobjectArray result = env->NewObjectArray(3 - first, arrayClass, nullptr);
+    env->DeleteLocalRef(arrayClass);
+    if (!result) return nullptr;
+
+    for (jsize i = first; i < 3; i++) {
+        const std::vector<uint8_t>& part = *parts[i];
+        jbyteArray bytes = env->NewByteArray(static_cast<jsize>(part.size()));
+        if (!bytes) return nullptr;
+        env->SetByteArrayRegion(bytes, 0, static_cast<jsize>(part.size()),
+                                reinterpret_cast<const jbyte*>(part.data()));
+        env->SetObjectArrayElement(result, i - first, bytes);
+        env->DeleteLocalRef(bytes);
+    }
+    return result;
+}
+
+JNIEXPORT jint JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeScanNalUnits(
+        JNIEnv* env, jclass clazz, jbyteArray data, jint offset, jint length, jboolean hevc, jintArray units) {
+
+    const jsize capacity = env->GetArrayLength(units) / 3;
+    if (offset < 0 || length < 0 || offset + length > env->GetArrayLength(data) || capacity == 0) {
+        return 0;
+    }
+
+    // At most 32 units per call keeps the result on the stack
+    aap::NalUnit found[32];
+    const size_t maxUnits = std::min<size_t>(static_cast<size_t>(capacity), 32);
+
+    void* bytes = env->GetPrimitiveArrayCritical(data, nullptr);
+    if (!bytes) return 0;
+    const size_t count = aap::NalScanner::scan(static_cast<const uint8_t*>(bytes) + offset,
+                                               static_cast<size_t>(length),
+                                               hevc ? aap::VideoCodec::H265 : aap::VideoCodec::H264,
+                                               found, maxUnits);
+    env->ReleasePrimitiveArrayCritical(data, bytes, JNI_ABORT);
+
+    // [offset, length, type] per unit, offsets relative to the array
+    jint values[32 * 3];
+    for (size_t i = 0; i < count; i++) {
+        values[i * 3] = static_cast<jint>(found[i].offset) + offset;
+        values[i * 3 + 1] = static_cast<jint>(found[i].length);
+        values[i * 3 + 2] = static_cast<jint>(found[i].type);
+    }
+    env->SetIntArrayRegion(units, 0, static_cast<jsize>(count * 3), values);
+    return static_cast<jint>(count);
+}
+
+JNIEXPORT jintArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeParseSps(
+        JNIEnv* env, jclass clazz, jbyteArray data, jboolean hevc) {
+
+    const jsize length = env->GetArrayLength(data);
+    if (length <= 0 || static_cast<size_t>(length) > aap::VideoAssembler::MAX_PARAMETER_SET) {
+        return nullptr;
+    }
+    uint8_t bytes[aap::VideoAssembler::MAX_PARAMETER_SET];
+    env->GetByteArrayRegion(data, 0, length, reinterpret_cast<jbyte*>(bytes));
+
+    // With or without its start code, 3 or 4 bytes
+    size_t nal = aap::NalScanner::findStartCode(bytes, 0, static_cast<size_t>(length));
+    nal = nal < static_cast<size_t>(length) ? nal + 3 : 0;
+    aap::VideoStreamInfo info;
+    if (!aap::SpsParser::parseSps(hevc ? aap::VideoCodec::H265 : aap::VideoCodec::H264,
+                                  bytes + nal, static_cast<size_t>(length) - nal, info)) {
+        return nullptr;
+    }
+
+    // [width, height, profile, level, max frame bytes, frame rate x1000]
+    jint values[6] = {
+        static_cast<jint>(info.width),
+        static_cast<jint>(info.height),
+        static_cast<jint>(info.profile),
+        static_cast<jint>(info.level),
+        static_cast<jint>(std::min<size_t>(info.maxFrameBytes(), INT32_MAX)),
+        static_cast<jint>(info.frameRate() * 1000)
+    };
+    jintArray result = env->NewIntArray(6);
+    if (result) {
+        env->SetIntArrayRegion(result, 0, 6, values);
+    }
+    return result;
+}
+
+JNIEXPORT jint JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetThermalResolutionSteps(
+        JNIEnv* env, jclass clazz) {
+
+    aap::QualityGovernor::ThermalSource source = aap::QualityGovernor::ThermalSource::NONE;
+    const int status = aap::QualityGovernor::thermalStatus(&source);
+    const int steps = aap::QualityGovernor::resolutionSteps(aap::QualityGovernor::thermalLevel(status));
+    if (steps > 0) {
+        LOGI("Thermal status %d (source %d): offering %d resolution(s) lower", status, static_cast<int>(source), steps);
+    }
+    return steps;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetThreadPolicy(
+        JNIEnv* env, jclass clazz, jstring name, jint policy, jint priority, jlong cpuMask) {
+
+    const char* threadName = env->GetStringUTFChars(name, nullptr);
+    if (!threadName) {
+        return JNI_FALSE;
+    }
+    LOGI("nativeSetThreadPolicy called for %s: policy=%d, priority=%d, cpus=0x%llx",
+         threadName, policy, priority, static_cast<unsigned long long>(cpuMask));
+
+    aap::ThreadPolicy threadPolicy;
+    threadPolicy.policy = policy;
+    threadPolicy.priority = priority;
+    threadPolicy.cpuMask = static_cast<uint64_t>(cpuMask);
+    const bool ok = aap::setThreadPolicy(threadName, threadPolicy);
+    env->ReleaseStringUTFChars(name, threadName);
+    return ok ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetCpuTopology(
+        JNIEnv* env, jclass clazz) {
+
+    const aap::CpuTopology& topology = aap::cpuTopology();
+    jlong values[3] = {
+        static_cast<jlong>(topology.cpuCount),
+        static_cast<jlong>(topology.bigCores),
+        static_cast<jlong>(topology.littleCores)
+    };
+    jlongArray result = env->NewLongArray(3);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 3, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetTracingEnabled(
+        JNIEnv* env, jclass clazz, jboolean enabled) {
+
+    LOGI("nativeSetTracingEnabled called: enabled=%d", enabled);
+    return aap::setTracingEnabled(enabled == JNI_TRUE) ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetFastLog(
+        JNIEnv* env, jclass clazz, jint priority, jstring path) {
+
+    LOGI("nativeSetFastLog called: priority=%d", priority);
+
+    bool opened = true;
+    if (path) {
+        const char* snapshotPath = env->GetStringUTFChars(path, nullptr);
+        if (!snapshotPath) {
+            return JNI_FALSE;
+        }
+        opened = aap::setFastLogFile(snapshotPath);
+        env->ReleaseStringUTFChars(path, snapshotPath);
+    } else {
+        aap::setFastLogFile(nullptr);
+    }
+    aap::setFastLogPriority(priority);
+    return opened ? JNI_TRUE : JNI_FALSE;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetFastLogStats(
+        JNIEnv* env, jclass clazz) {
+
+    aap::flushFastLog();
+    const aap::FastLogStats stats = aap::getFastLogStats();
+    jlong values[3] = {
+        static_cast<jlong>(stats.written),
+        static_cast<jlong>(stats.dropped),
+        static_cast<jlong>(stats.threads)
+    };
+    jlongArray result = env->NewLongArray(3);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 3, values);
+    }
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetStreamingMemoryOptions(
+        JNIEnv* env, jclass clazz, jboolean populate, jboolean hugePages, jboolean lock) {
+
+    LOGI("nativeSetStreamingMemoryOptions called: populate=%d, hugePages=%d, lock=%d",
+         populate, hugePages, lock);
+
+    aap::StreamingMemoryOptions options;
+    options.populate = populate == JNI_TRUE;
+    options.hugePages = hugePages == JNI_TRUE;
+    options.lock = lock == JNI_TRUE;
+    aap::setStreamingMemoryOptions(options);
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetStreamingMemoryStats(
+        JNIEnv* env, jclass clazz) {
+
+    const aap::StreamingMemoryStats stats = aap::getStreamingMemoryStats();
+    jlong values[5] = {
+        static_cast<jlong>(stats.bytesMapped),
+        static_cast<jlong>(stats.bytesLocked),
+        static_cast<jlong>(stats.bytesHugeAdvised),
+        static_cast<jlong>(stats.lockFailures),
+        static_cast<jlong>(stats.bytesResident)
+    };
+    jlongArray result = env->NewLongArray(5);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 5, values);
+    }
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetMemoryProfile(
+        JNIEnv* env, jclass clazz, jboolean lean, jint width, jint height, jint fps, jint bitrateKbps) {
+
+    if (lean != JNI_TRUE) {
+        aap::setMemoryProfile(aap::MemoryProfile::standard());
+        return;
+    }
+    aap::VideoFormat format;
+    format.width = width;
+    format.height = height;
+    format.fps = fps;
+    format.bitrateKbps = bitrateKbps;
+    aap::setMemoryProfile(aap::MemoryProfile::leanFor(format));
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeSetZeroCopyEnabled(
+        JNIEnv* env, jclass clazz, jlong handle, jboolean enabled) {
+
+    LOGI("nativeSetZeroCopyEnabled called for handle=%ld, enabled=%d", (long)handle, enabled);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->usb) {
+        LOGE("nativeSetZeroCopyEnabled: invalid handle %ld or not USB", (long)handle);
+        return;
+    }
+
+    aap::ShadowFramer* shadow = h->shadow.get();
+    if (enabled && shadow) {
+        aap::UsbConnection* usb = h->usb;
+        h->usb->setSlotCallback([h, usb, shadow](int slot, size_t offset, size_t length) {
+            shadow->feed(usb->slotBuffer(slot) + offset, length);
+            callSlotDataCallback(h, slot, offset, length);
+        });
+    } else if (enabled) {
+        h->usb->setSlotCallback([h](int slot, size_t offset, size_t length) {
+            callSlotDataCallback(h, slot, offset, length);
+        });
+    } else {
+        h->usb->setSlotCallback(nullptr);
+    }
+}
+
+JNIEXPORT jobjectArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetSlotBuffers(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->usb) {
+        LOGE("nativeGetSlotBuffers: invalid handle %ld or not USB", (long)handle);
+        return nullptr;
+    }
+
+    // Every slot needs a buffer before it can be viewed
+    if (!h->usb->reserveSlotBuffers()) {
+        LOGE("nativeGetSlotBuffers: %s", h->usb->getLastError());
+        return nullptr;
+    }
+
+    jclass bufferClass = env->FindClass("java/nio/ByteBuffer");
+    if (!bufferClass) return nullptr;
+
+    const int count = h->usb->slotCount();
+    jobjectArray result = env->NewObjectArray(count, bufferClass, nullptr);
+    env->DeleteLocalRef(bufferClass);
+    if (!result) return nullptr;
+
+    // Views stay valid until nativeClose()
+    for (int i = 0; i < count; i++) {
+        jobject view = env->NewDirectByteBuffer(h->usb->slotBuffer(i),
+                                                static_cast<jlong>(h->usb->slotSize()));
+        if (!view) return nullptr;
+        env->SetObjectArrayElement(result, i, view);
+        env->DeleteLocalRef(view);
+    }
+    return result;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeReleaseSlot(
+        JNIEnv* env, jclass clazz, jlong handle, jint slot) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (h && h->usb) {
+        h->usb->releaseSlot(slot);
+    }
+}
+
+JNIEXPORT jint JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeWrite(
+        JNIEnv* env, jclass clazz, jlong handle, jbyteArray data, jint offset, jint length) {
+
+    LOGD_FAST("nativeWrite called: handle=%ld, offset=%d, length=%d", (long)handle, offset, length);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        LOGE("nativeWrite: invalid handle %ld", (long)handle);
+        return -1;
+    }
+    if (!inBounds(offset, length, env->GetArrayLength(data))) {
+        LOGE("nativeWrite: range %d+%d outside the array", offset, length);
+        return -1;
+    }
+
+    int result;
+    if (h->transport->isReading() && length <= MAX_CRITICAL_WRITE) {
+        // Queued writes only memcpy into a TX transfer: pin the array, no copy
+        void* bytes = env->GetPrimitiveArrayCritical(data, nullptr);
+        if (!bytes) {
+            LOGE("nativeWrite: failed to pin byte array");
+            return -1;
+        }
+        result = h->transport->write(static_cast<const uint8_t*>(bytes) + offset, static_cast<size_t>(length));
+        env->ReleasePrimitiveArrayCritical(data, bytes, JNI_ABORT);
+    } else {
+        // Handshake writes block on the wire, outside a critical region
+        jbyte* bytes = env->GetByteArrayElements(data, nullptr);
+        if (!bytes) {
+            LOGE("nativeWrite: failed to get byte array");
+            return -1;
+        }
+        result = h->transport->write(reinterpret_cast<const uint8_t*>(bytes) + offset, static_cast<size_t>(length));
+        env->ReleaseByteArrayElements(data, bytes, JNI_ABORT);
+    }
+
+    LOGD_FAST("nativeWrite: result=%d", result);
+    return result;
+}
+
+JNIEXPORT jint JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeWriteBuffer(
+        JNIEnv* env, jclass clazz, jlong handle, jobject buffer, jint offset, jint length) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        LOGE("nativeWriteBuffer: invalid handle %ld", (long)handle);
+        return -1;
+    }
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(env->GetDirectBufferAddress(buffer));
+    if (!bytes || !inBounds(offset, length, env->GetDirectBufferCapacity(buffer))) {
+        LOGE("nativeWriteBuffer: not a direct ByteBuffer or range %d+%d outside it", offset, length);
+        return -1;
+    }
+    return h->transport->write(bytes + offset, static_cast<size_t>(length));
+}
+
+JNIEXPORT jint JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeRead(
+        JNIEnv* env, jclass clazz, jlong handle, jbyteArray data, jint offset, jint length, jint timeoutMs) {
+
+    LOGD_FAST("nativeRead called: handle=%ld, offset=%d, length=%d, timeout=%d", (long)handle, offset, length, timeoutMs);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
     if (!h) {
         LOGE("nativeRead: invalid handle");
         return -1;
     }
+    if (!inBounds(offset, length, env->GetArrayLength(data))) {
+        LOGE("nativeRead: range %d+%d outside the array", offset, length);
+        return -1;
+    }
+
+    // Blocks for up to timeoutMs, so no pinning: only the bytes read are copied back
+    thread_local std::vector<uint8_t> scratch;
+    if (scratch.size() < static_cast<size_t>(length)) {
+        scratch.resize(static_cast<size_t>(length));
+    }
+    int result = h->transport->read(scratch.data(), static_cast<size_t>(length), timeoutMs);
+    if (result > 0) {
+        env->SetByteArrayRegion(data, offset, result, reinterpret_cast<const jbyte*>(scratch.data()));
+    }
+
+    LOGD_FAST("nativeRead: result=%d", result);
+    return result;
+}
+
+JNIEXPORT jint JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeReadBuffer(
+        JNIEnv* env, jclass clazz, jlong handle, jobject buffer, jint offset, jint length, jint timeoutMs) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        LOGE("nativeReadBuffer: invalid handle %ld", (long)handle);
+        return -1;
+    }
 
-    jbyte* bytes = env->GetByteArrayElements(data, nullptr);
-    if (!bytes) {
-        LOGE("nativeRead: failed to get byte array");
+    uint8_t* bytes = static_cast<uint8_t*>(env->GetDirectBufferAddress(buffer));
+    if (!bytes || !inBounds(offset, length, env->GetDirectBufferCapacity(buffer))) {
+        LOGE("nativeReadBuffer: not a direct ByteBuffer or range %d+%d outside it", offset, length);
         return -1;
     }
+    return h->transport->read(bytes + offset, static_cast<size_t>(length), timeoutMs);
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetSocketStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->tcp) {
+        return nullptr;
+    }
+
+    const aap::TcpConnection::Stats stats = h->tcp->getStats();
+    jlong values[4] = {
+        static_cast<jlong>(stats.bytesReceived),
+        static_cast<jlong>(stats.bytesSent),
+        static_cast<jlong>(stats.sendQueued),
+        static_cast<jlong>(stats.txBacklogHighWater)
+    };
+    jlongArray result = env->NewLongArray(4);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 4, values);
+    }
+    return result;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetLinkStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->usb) {
+        return nullptr;
+    }
+
+    const aap::UsbLinkMonitor::Stats stats = h->usb->getLinkStats();
+    constexpr size_t scalars = 13;
+    constexpr jsize size = static_cast<jsize>(scalars + aap::UsbLinkMonitor::STATUS_COUNT + 2);
+    jlong values[size] = {
+        static_cast<jlong>(stats.speed),
+        static_cast<jlong>(stats.bytesIn),
+        static_cast<jlong>(stats.bytesOut),
+        static_cast<jlong>(stats.transfersIn),
+        static_cast<jlong>(stats.transfersOut),
+        static_cast<jlong>(stats.shortTransfersIn),
+        static_cast<jlong>(stats.bytesInPerSec),
+        static_cast<jlong>(stats.bytesOutPerSec),
+        static_cast<jlong>(stats.inFlight),
+        static_cast<jlong>(stats.inFlightAvgMilli),
+        static_cast<jlong>(stats.endpointIdleNs),
+        static_cast<jlong>(stats.resubmitGapTotalNs),
+        static_cast<jlong>(stats.resubmitGapMaxNs)
+    };
+    for (size_t i = 0; i < aap::UsbLinkMonitor::STATUS_COUNT; i++) {
+        values[scalars + i] = static_cast<jlong>(stats.failures[i]);
+    }
+    values[size - 2] = static_cast<jlong>(stats.retryRounds);
+    values[size - 1] = static_cast<jlong>(stats.haltsCleared);
+    jlongArray result = env->NewLongArray(size);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, size, values);
+    }
+    return result;
+}
+
+JNIEXPORT jboolean JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeStartCapture(
+        JNIEnv* env, jclass clazz, jlong handle, jstring path) {
+
+    LOGI("nativeStartCapture called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || h->replay || h->loadGenerator) {
+        LOGE("nativeStartCapture: invalid handle %ld or a replay", (long)handle);
+        return JNI_FALSE;
+    }
+    if (h->capture) {
+        return JNI_TRUE;
+    }
+
+    const char* capturePath = env->GetStringUTFChars(path, nullptr);
+    if (!capturePath) {
+        return JNI_FALSE;
+    }
+    auto capture = std::make_unique<aap::SessionCapture>();
+    const bool ok = capture->open(capturePath);
+    env->ReleaseStringUTFChars(path, capturePath);
+    if (!ok) {
+        return JNI_FALSE;
+    }
+    h->transport->setCapture(capture.get());
+    h->capture = std::move(capture);
+    return JNI_TRUE;
+}
+
+JNIEXPORT void JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeStopCapture(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    LOGI("nativeStopCapture called for handle=%ld", (long)handle);
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->capture) {
+        return;
+    }
+    // The event thread is done with the capture once setCapture() returns
+    h->transport->setCapture(nullptr);
+    h->capture->close();
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetCaptureStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->capture) {
+        return nullptr;
+    }
+
+    const aap::SessionCapture::Stats stats = h->capture->getStats();
+    jlong values[4] = {
+        static_cast<jlong>(stats.bytesCaptured),
+        static_cast<jlong>(stats.entries),
+        static_cast<jlong>(stats.fileSize),
+        static_cast<jlong>(stats.failures)
+    };
+    jlongArray result = env->NewLongArray(4);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 4, values);
+    }
+    return result;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetReplayStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->replay) {
+        return nullptr;
+    }
+
+    const aap::ReplayTransport::Stats stats = h->replay->getStats();
+    jlong values[4] = {
+        static_cast<jlong>(stats.entriesReplayed),
+        static_cast<jlong>(stats.bytesReplayed),
+        static_cast<jlong>(stats.elapsedNs),
+        static_cast<jlong>(stats.maxLagNs)
+    };
+    jlongArray result = env->NewLongArray(4);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 4, values);
+    }
+    return result;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetShadowFramingStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->shadow) {
+        return nullptr;
+    }
+
+    const aap::ShadowFramer::Stats stats = h->shadow->getStats();
+    jlong values[15] = {
+        static_cast<jlong>(stats.transfers),
+        static_cast<jlong>(stats.bytes),
+        static_cast<jlong>(stats.nativeRecords),
+        static_cast<jlong>(stats.kotlinRecords),
+        static_cast<jlong>(stats.matched),
+        static_cast<jlong>(stats.mismatched),
+        static_cast<jlong>(stats.nativeOnly),
+        static_cast<jlong>(stats.kotlinOnly),
+        static_cast<jlong>(stats.decryptMismatches),
+        static_cast<jlong>(stats.nativeDecrypts),
+        static_cast<jlong>(stats.kotlinDecrypts),
+        static_cast<jlong>(stats.nativeFrameNs),
+        static_cast<jlong>(stats.nativeDecryptNs),
+        static_cast<jlong>(stats.kotlinParseNs),
+        static_cast<jlong>(stats.kotlinDecryptNs)
+    };
+    jlongArray result = env->NewLongArray(15);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 15, values);
+    }
+    return result;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetLoadGeneratorStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
+
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h || !h->loadGenerator) {
+        return nullptr;
+    }
+
+    const aap::LoadGenerator::Stats stats = h->loadGenerator->getStats();
+    jlong values[11] = {
+        static_cast<jlong>(stats.bytesGenerated),
+        static_cast<jlong>(stats.transfers),
+        static_cast<jlong>(stats.records),
+        static_cast<jlong>(stats.videoFrames),
+        static_cast<jlong>(stats.keyframes),
+        static_cast<jlong>(stats.audioFrames),
+        static_cast<jlong>(stats.pings),
+        static_cast<jlong>(stats.metadata),
+        static_cast<jlong>(stats.streamNs),
+        static_cast<jlong>(stats.elapsedNs),
+        static_cast<jlong>(stats.maxLagNs)
+    };
+    jlongArray result = env->NewLongArray(11);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 11, values);
+    }
+    return result;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeCalibrate(
+        JNIEnv* env, jclass clazz, jdouble seconds) {
+
+    LOGI("nativeCalibrate called, %.1f s per session", seconds);
+
+    aap::CalibrationConfig config;
+    if (seconds > 0) {
+        config.seconds = seconds;
+    }
+    const aap::CalibrationResult calibration = aap::DeviceCalibration(config).run();
+    if (calibration.pipelineMBps == 0) {
+        return nullptr;
+    }
+
+    jlong values[12] = {
+        static_cast<jlong>(calibration.copyMBps),
+        static_cast<jlong>(calibration.decryptMBps),
+        static_cast<jlong>(calibration.pipelineMBps),
+        static_cast<jlong>(calibration.cpuCount),
+        static_cast<jlong>(calibration.bigCores),
+        calibration.hardwareAes ? 1 : 0,
+        static_cast<jlong>(calibration.numTransfers),
+        static_cast<jlong>(calibration.transferSize),
+        static_cast<jlong>(calibration.decryptWorkers),
+        static_cast<jlong>(calibration.poolWorkers),
+        static_cast<jlong>(calibration.videoQueueSlots),
+        static_cast<jlong>(calibration.videoQueueBytes)
+    };
+    jlongArray result = env->NewLongArray(12);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, 12, values);
+    }
+    return result;
+}
 
-    int result = h->connection->read(reinterpret_cast<uint8_t*>(bytes), length, timeoutMs);
+JNIEXPORT jlongArray JNICALL
+Java_info_anodsplace_headunit_connection_NativeUsb_nativeGetStats(
+        JNIEnv* env, jclass clazz, jlong handle) {
 
-    // Copy data back to Java array
-    env->ReleaseByteArrayElements(data, bytes, 0);
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        return nullptr;
+    }
 
-    LOGD("nativeRead: result=%d", result);
+    constexpr jsize size = static_cast<jsize>(aap::PipelineLatency::PACKED_SIZE);
+    int64_t values[size];
+    h->latency.pack(values);
+    jlongArray result = env->NewLongArray(size);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, size, reinterpret_cast<const jlong*>(values));
+    }
     return result;
 }
 
@@ -250,8 +3302,12 @@ JNIEXPORT jboolean JNICALL
 Java_info_anodsplace_headunit_connection_NativeUsb_nativeIsOpen(
         JNIEnv* env, jclass clazz, jlong handle) {
 
-    ConnectionHandle* h = getHandle(handle);
-    return h && h->connection->isOpen() ? JNI_TRUE : JNI_FALSE;
+    HandleLease lease = getHandle(handle);
+    ConnectionHandle* h = lease.get();
+    if (!h) {
+        return JNI_FALSE;
+    }
+    return h->transport->isOpen() ? JNI_TRUE : JNI_FALSE;
 }
 
 } // extern "C"
@@ -0,0 +1,65 @@
+#include "jni_threads.h"
+#include <android/log.h>
+#include <pthread.h>
+
+#define LOG_TAG "JniThreads"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+// Thread exit hook, thread_local destructors are unreliable below API 23
+pthread_key_t detachKey;
+pthread_once_t detachKeyOnce = PTHREAD_ONCE_INIT;
+
+} // anonymous namespace
+
+JavaVM* JniThreads::vm_ = nullptr;
+thread_local JNIEnv* JniThreads::cachedEnv_ = nullptr;
+std::atomic<uint64_t> JniThreads::attachCount_{0};
+
+void JniThreads::init(JavaVM* vm) {
+    vm_ = vm;
+}
+
+JNIEnv* JniThreads::attach() {
+    if (!vm_) {
+        return nullptr;
+    }
+
+    JNIEnv* env = nullptr;
+    const jint status = vm_->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6);
+    if (status == JNI_OK) {
+        // A VM thread, it stays attached for its whole life
+        cachedEnv_ = env;
+        return env;
+    }
+    if (status != JNI_EDETACHED) {
+        return nullptr;
+    }
+
+    char name[16] = {};
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    JavaVMAttachArgs args = {JNI_VERSION_1_6, name, nullptr};
+    if (vm_->AttachCurrentThread(&env, &args) != JNI_OK) {
+        LOGE("Failed to attach thread %s", name);
+        return nullptr;
+    }
+
+    pthread_once(&detachKeyOnce, [] { pthread_key_create(&detachKey, &JniThreads::onThreadExit); });
+    pthread_setspecific(detachKey, env);
+    cachedEnv_ = env;
+    attachCount_.fetch_add(1, std::memory_order_relaxed);
+    LOGD("Attached thread %s", name);
+    return env;
+}
+
+void JniThreads::onThreadExit(void*) {
+    if (vm_) {
+        vm_->DetachCurrentThread();
+    }
+}
+
+} // namespace aap
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <jni.h>
+#include <atomic>
+#include <cstdint>
+
+namespace aap {
+
+/**
+ * JNI attachment of native threads.
+ *
+ * A native thread is attached the first time it upcalls, under its
+ * pthread name (AAP-Video, AAP-Audio, ...), so it shows up properly in
+ * traces and ANR dumps. The JNIEnv is then cached in a thread_local and
+ * every further upcall skips GetEnv(). Threads attached here are
+ * detached when they exit; VM threads are only cached.
+ */
+class JniThreads {
+public:
+    /**
+     * Set the VM, from JNI_OnLoad. nullptr from JNI_OnUnload.
+     */
+    static void init(JavaVM* vm);
+
+    /**
+     * JNIEnv of the calling thread, attaching it if needed.
+     * @return nullptr if the VM is gone or the thread can't be attached
+     */
+    static JNIEnv* env() {
+        JNIEnv* env = cachedEnv_;
+        return env ? env : attach();
+    }
+
+    /**
+     * Number of native threads attached so far.
+     */
+    static uint64_t attachCount() { return attachCount_.load(std::memory_order_relaxed); }
+
+private:
+    static JavaVM* vm_;
+    static thread_local JNIEnv* cachedEnv_;
+    static std::atomic<uint64_t> attachCount_;
+
+    static JNIEnv* attach();
+    static void onThreadExit(void* env);
+};
+
+} // namespace aap
@@ -0,0 +1,100 @@
+#include "latency_histogram.h"
+#include <time.h>
+
+namespace aap {
+
+namespace {
+
+// Smallest bucket holding the sample of the given rank (1-based)
+uint64_t valueAtRank(const uint64_t* buckets, uint64_t rank, uint64_t maxNs) {
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            const uint64_t bound = LatencyHistogram::bucketUpperBound(i);
+            return bound < maxNs ? bound : maxNs;
+        }
+    }
+    return maxNs;
+}
+
+uint64_t rankOf(uint64_t count, uint64_t perMille) {
+    const uint64_t rank = (count * perMille + 999) / 1000;
+    return rank > 0 ? rank : 1;
+}
+
+} // anonymous namespace
+
+uint64_t LatencyHistogram::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+size_t LatencyHistogram::bucketOf(uint64_t valueNs) {
+    if (valueNs < SUB_BUCKETS) {
+        return static_cast<size_t>(valueNs);
+    }
+    const int exponent = 63 - __builtin_clzll(valueNs);
+    if (exponent > MAX_EXPONENT) {
+        return BUCKETS - 1;
+    }
+    const size_t sub = static_cast<size_t>(valueNs >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+    return static_cast<size_t>(exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    const int shift = static_cast<int>(bucket / SUB_BUCKETS) - 1;
+    const uint64_t lower = static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return lower + (uint64_t{1} << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t valueNs) {
+    buckets_[bucketOf(valueNs)].fetch_add(1, std::memory_order_relaxed);
+    sumNs_.fetch_add(valueNs, std::memory_order_relaxed);
+
+    uint64_t max = maxNs_.load(std::memory_order_relaxed);
+    while (valueNs > max && !maxNs_.compare_exchange_weak(max, valueNs, std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Summary LatencyHistogram::summarize() const {
+    // Percentiles come from the bucket copy, so they agree with its count
+    uint64_t buckets[BUCKETS];
+    uint64_t count = 0;
+    for (size_t i = 0; i < BUCKETS; i++) {
+        buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        count += buckets[i];
+    }
+
+    Summary summary = {};
+    summary.count = count;
+    if (count == 0) {
+        return summary;
+    }
+    summary.maxNs = maxNs_.load(std::memory_order_relaxed);
+    summary.meanNs = sumNs_.load(std::memory_order_relaxed) / count;
+    summary.p50Ns = valueAtRank(buckets, rankOf(count, 500), summary.maxNs);
+    summary.p90Ns = valueAtRank(buckets, rankOf(count, 900), summary.maxNs);
+    summary.p99Ns = valueAtRank(buckets, rankOf(count, 990), summary.maxNs);
+    summary.p999Ns = valueAtRank(buckets, rankOf(count, 999), summary.maxNs);
+    return summary;
+}
+
+void PipelineLatency::pack(int64_t* out) const {
+    for (size_t i = 0; i < STAGE_COUNT; i++) {
+        const LatencyHistogram::Summary summary = stages[i].summarize();
+        const uint64_t fields[FIELDS_PER_STAGE] = {
+            summary.count, summary.meanNs, summary.p50Ns, summary.p90Ns,
+            summary.p99Ns, summary.p999Ns, summary.maxNs
+        };
+        for (size_t f = 0; f < FIELDS_PER_STAGE; f++) {
+            *out++ = static_cast<int64_t>(fields[f]);
+        }
+    }
+}
+
+} // namespace aap
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace aap {
+
+/**
+ * Fixed-bucket latency histogram in the HDR style: every power of two is
+ * split into SUB_BUCKETS linear buckets, so any percentile is reported
+ * within 1/SUB_BUCKETS (12.5%) of the true value from 1 ns up to ~68 s.
+ *
+ * record() is wait-free and may be called from any number of threads:
+ * buckets are relaxed atomics, so a snapshot taken while recording can
+ * be off by the samples in flight but is never torn within a bucket.
+ */
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 3;
+    static constexpr size_t SUB_BUCKETS = size_t{1} << SUB_BUCKET_BITS;
+    // Values of 2^36 ns and above share the last bucket
+    static constexpr int MAX_EXPONENT = 35;
+    static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+    LatencyHistogram() = default;
+
+    // Non-copyable
+    LatencyHistogram(const LatencyHistogram&) = delete;
+    LatencyHistogram& operator=(const LatencyHistogram&) = delete;
+
+    /**
+     * CLOCK_MONOTONIC in ns, the clock all stages stamp with.
+     */
+    static uint64_t now();
+
+    void record(uint64_t valueNs);
+
+    /**
+     * Record the time since startNs; a zero start (never stamped) is ignored.
+     */
+    void recordSince(uint64_t startNs) {
+        if (startNs != 0) {
+            const uint64_t nowNs = now();
+            record(nowNs > startNs ? nowNs - startNs : 0);
+        }
+    }
+
+    /**
+     * Percentiles are the upper bound of the bucket holding them.
+     */
+    struct Summary {
+        uint64_t count;
+        uint64_t meanNs;
+        uint64_t p50Ns;
+        uint64_t p90Ns;
+        uint64_t p99Ns;
+        uint64_t p999Ns;
+        uint64_t maxNs;
+    };
+    Summary summarize() const;
+
+    static size_t bucketOf(uint64_t valueNs);
+    // Largest value that falls into bucket
+    static uint64_t bucketUpperBound(size_t bucket);
+
+private:
+    std::atomic<uint64_t> buckets_[BUCKETS]{};
+    std::atomic<uint64_t> sumNs_{0};
+    std::atomic<uint64_t> maxNs_{0};
+};
+
+/**
+ * Latency of each native stage a record passes through, for tail
+ * latency in production where traces aren't running.
+ *
+ * Records are stamped with their arrival time as the transport's read
+ * callback hands them to the framer; the later stages time their own
+ * work. One instance per connection, shared by its components.
+ */
+struct PipelineLatency {
+    enum Stage {
+        FRAME,          // Transfer arrival until the framer delivers the record
+        DECRYPT,        // Decrypting one record, natively or through Kotlin
+        QUEUE_WAIT,     // Dispatcher enqueue until a worker picks the record up
+        CALLBACK,       // Dispatcher consumer callback, per record or batch
+        DECODE_FEED,    // First fragment of a video frame until it is queued to the codec
+        STAGE_COUNT
+    };
+
+    static constexpr size_t FIELDS_PER_STAGE = sizeof(LatencyHistogram::Summary) / sizeof(uint64_t);
+    static constexpr size_t PACKED_SIZE = STAGE_COUNT * FIELDS_PER_STAGE;
+
+    LatencyHistogram stages[STAGE_COUNT];
+
+    LatencyHistogram& operator[](Stage stage) { return stages[stage]; }
+
+    /**
+     * Write every stage's Summary, in Stage order, as PACKED_SIZE values.
+     */
+    void pack(int64_t* out) const;
+};
+
+} // namespace aap
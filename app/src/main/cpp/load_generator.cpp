@@ -0,0 +1,592 @@
+#include "load_generator.h"
+#include "aap_framer.h"
+#include "aap_message.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#define LOG_TAG "LoadGenerator"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+// Media and control message types, the first two bytes of a message
+constexpr uint16_t MSG_MEDIA_DATA = 0x0000;     // Followed by an 8-byte timestamp
+constexpr uint16_t MSG_CODEC_CONFIG = 0x0001;
+constexpr uint16_t MSG_PING_REQUEST = 0x000B;
+constexpr uint16_t MSG_PLAYBACK_METADATA = 0x8001;
+
+constexpr uint8_t FLAGS_MIDDLE = EncryptedHeader::FLAG_ENCRYPTED;
+constexpr uint8_t FLAGS_FIRST = FLAGS_MIDDLE | EncryptedHeader::FLAG_FIRST;
+constexpr uint8_t FLAGS_LAST = FLAGS_MIDDLE | EncryptedHeader::FLAG_LAST;
+constexpr uint8_t FLAGS_COMPLETE = FLAGS_FIRST | EncryptedHeader::FLAG_LAST;
+
+constexpr uint8_t START_CODE[4] = {0, 0, 0, 1};
+constexpr uint8_t NAL_SPS = 0x67;
+constexpr uint8_t NAL_PPS = 0x68;
+constexpr uint8_t NAL_IDR = 0x65;
+constexpr uint8_t NAL_SLICE = 0x41;
+
+constexpr int MAX_DIMENSION = 4096;
+constexpr int MIN_RECORD_PAYLOAD = 64;
+constexpr size_t MAX_TRANSFER_SIZE = 1024 * 1024;
+// Slice payload is copied out of this much noise
+constexpr size_t NOISE_SIZE = 256 * 1024;
+// 500 Hz fits whole periods into every frame of an even number of ms
+constexpr double TONE_HZ = 500.0;
+constexpr double TONE_AMPLITUDE = 1000.0;  // About -30 dBFS
+constexpr double PI = 3.14159265358979323846;
+
+/**
+ * RBSP writer for the few parameter set fields we need.
+ */
+class BitWriter {
+public:
+    void put(uint32_t value, int bits) {
+        for (int i = bits - 1; i >= 0; i--) {
+            current_ = static_cast<uint8_t>((current_ << 1) | ((value >> i) & 1));
+            if (++used_ == 8) {
+                bytes_.push_back(current_);
+                current_ = 0;
+                used_ = 0;
+            }
+        }
+    }
+
+    // Exp-Golomb ue(v)
+    void ue(uint32_t value) {
+        const uint64_t coded = static_cast<uint64_t>(value) + 1;
+        int bits = 0;
+        while ((coded >> (bits + 1)) != 0) bits++;
+        put(0, bits);
+        put(static_cast<uint32_t>(coded), bits + 1);
+    }
+
+    // rbsp_trailing_bits()
+    const std::vector<uint8_t>& finish() {
+        put(1, 1);
+        while (used_ != 0) put(0, 1);
+        return bytes_;
+    }
+
+private:
+    std::vector<uint8_t> bytes_;
+    uint8_t current_ = 0;
+    int used_ = 0;
+};
+
+// Start code, NAL header and the RBSP with emulation prevention bytes
+void appendNal(std::vector<uint8_t>& out, uint8_t header, const std::vector<uint8_t>& rbsp) {
+    out.insert(out.end(), std::begin(START_CODE), std::end(START_CODE));
+    out.push_back(header);
+    int zeros = 0;
+    for (const uint8_t byte : rbsp) {
+        if (zeros == 2 && byte <= 3) {
+            out.push_back(3);
+            zeros = 0;
+        }
+        out.push_back(byte);
+        zeros = byte == 0 ? zeros + 1 : 0;
+    }
+}
+
+// Lowest H.264 level (Table A-1) for the picture size and rate
+int levelFor(int macroblocks, int fps) {
+    struct Level { int idc; int maxFrameMbs; int maxMbsPerSecond; };
+    static const Level LEVELS[] = {
+        {31, 3600, 108000}, {32, 5120, 216000}, {40, 8192, 245760}, {42, 8704, 522240},
+        {50, 22080, 589824}, {51, 36864, 983040}, {52, 36864, 2073600},
+    };
+    for (const Level& level : LEVELS) {
+        if (macroblocks <= level.maxFrameMbs &&
+            static_cast<int64_t>(macroblocks) * fps <= level.maxMbsPerSecond) {
+            return level.idc;
+        }
+    }
+    return 52;
+}
+
+/**
+ * Baseline profile SPS and PPS with VUI timing, which SpsParser and
+ * MediaCodec both take for the configured picture.
+ */
+void buildParameterSets(int width, int height, int fps, std::vector<uint8_t>& out) {
+    const int mbWidth = (width + 15) / 16;
+    const int mbHeight = (height + 15) / 16;
+
+    BitWriter sps;
+    sps.put(66, 8);     // profile_idc: Baseline
+    sps.put(0xC0, 8);   // constraint_set0_flag, constraint_set1_flag
+    sps.put(static_cast<uint32_t>(levelFor(mbWidth * mbHeight, fps)), 8);
+    sps.ue(0);          // seq_parameter_set_id
+    sps.ue(0);          // log2_max_frame_num_minus4
+    sps.ue(2);          // pic_order_cnt_type
+    sps.ue(1);          // max_num_ref_frames
+    sps.put(0, 1);      // gaps_in_frame_num_value_allowed_flag
+    sps.ue(static_cast<uint32_t>(mbWidth - 1));
+    sps.ue(static_cast<uint32_t>(mbHeight - 1));
+    sps.put(1, 1);      // frame_mbs_only_flag
+    sps.put(1, 1);      // direct_8x8_inference_flag
+    const int cropRight = (mbWidth * 16 - width) / 2;
+    const int cropBottom = (mbHeight * 16 - height) / 2;
+    const bool cropped = cropRight > 0 || cropBottom > 0;
+    sps.put(cropped ? 1 : 0, 1);
+    if (cropped) {
+        sps.ue(0);
+        sps.ue(static_cast<uint32_t>(cropRight));
+        sps.ue(0);
+        sps.ue(static_cast<uint32_t>(cropBottom));
+    }
+    sps.put(1, 1);      // vui_parameters_present_flag
+    sps.put(0, 4);      // aspect ratio, overscan, video signal type, chroma location
+    sps.put(1, 1);      // timing_info_present_flag
+    sps.put(1, 32);     // num_units_in_tick
+    sps.put(static_cast<uint32_t>(fps * 2), 32);  // time_scale, two ticks a frame
+    sps.put(1, 1);      // fixed_frame_rate_flag
+    sps.put(0, 4);      // NAL and VCL HRD, pic_struct, bitstream restriction
+    appendNal(out, NAL_SPS, sps.finish());
+
+    BitWriter pps;
+    pps.ue(0);          // pic_parameter_set_id
+    pps.ue(0);          // seq_parameter_set_id
+    pps.put(0, 2);      // CAVLC, bottom_field_pic_order_in_frame_present_flag
+    pps.ue(0);          // num_slice_groups_minus1
+    pps.ue(0);          // num_ref_idx_l0_default_active_minus1
+    pps.ue(0);          // num_ref_idx_l1_default_active_minus1
+    pps.put(0, 3);      // weighted_pred_flag, weighted_bipred_idc
+    pps.ue(0);          // pic_init_qp_minus26, se(0)
+    pps.ue(0);          // pic_init_qs_minus26
+    pps.ue(0);          // chroma_qp_index_offset
+    pps.put(1, 1);      // deblocking_filter_control_present_flag
+    pps.put(0, 2);      // constrained_intra_pred_flag, redundant_pic_cnt_present_flag
+    appendNal(out, NAL_PPS, pps.finish());
+}
+
+// One frame of tone, 16-bit little endian PCM
+void buildTone(int sampleRate, int channels, int frameMs, std::vector<uint8_t>& out) {
+    const int samples = sampleRate / 1000 * frameMs;
+    out.resize(static_cast<size_t>(samples) * channels * 2);
+    uint8_t* p = out.data();
+    for (int i = 0; i < samples; i++) {
+        const auto value = static_cast<int16_t>(
+            TONE_AMPLITUDE * std::sin(2.0 * PI * TONE_HZ * i / sampleRate));
+        for (int c = 0; c < channels; c++) {
+            *p++ = static_cast<uint8_t>(value & 0xFF);
+            *p++ = static_cast<uint8_t>((value >> 8) & 0xFF);
+        }
+    }
+}
+
+void putBe16(std::vector<uint8_t>& out, uint16_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value & 0xFF));
+}
+
+void putBe64(std::vector<uint8_t>& out, uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+void putVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Length-delimited protobuf field
+void putBytesField(std::vector<uint8_t>& out, int field, const uint8_t* data, size_t length) {
+    putVarint(out, static_cast<uint64_t>(field) << 3 | 2);
+    putVarint(out, length);
+    out.insert(out.end(), data, data + length);
+}
+
+} // anonymous namespace
+
+LoadGenerator::LoadGenerator() = default;
+
+LoadGenerator::~LoadGenerator() {
+    close();
+}
+
+bool LoadGenerator::open(const LoadConfig& config) {
+    if (open_) {
+        setError("Already open");
+        return false;
+    }
+    const bool video = config.videoKbps > 0;
+    if (video && (config.fps <= 0 || config.width <= 0 || config.height <= 0 ||
+                  config.width > MAX_DIMENSION || config.height > MAX_DIMENSION ||
+                  config.width % 2 != 0 || config.height % 2 != 0 || config.keyframeInterval <= 0 ||
+                  config.keyframeScale <= 0)) {
+        setError("Unsupported video: %dx%d at %d fps", config.width, config.height, config.fps);
+        return false;
+    }
+    if (config.audioStreams != 0 && (config.audioFrameMs <= 0 || config.audioFrameMs > 100)) {
+        setError("Unsupported audio frame of %d ms", config.audioFrameMs);
+        return false;
+    }
+    if (config.maxRecordPayload < MIN_RECORD_PAYLOAD ||
+        config.maxRecordPayload + TlsRecordLayer::OVERHEAD > AapFramer::MAX_PAYLOAD ||
+        config.transferSize == 0 || config.transferSize > MAX_TRANSFER_SIZE) {
+        setError("Unsupported record payload %zu or transfer size %zu",
+                 config.maxRecordPayload, config.transferSize);
+        return false;
+    }
+
+    config_ = config;
+    random_.seed(config.seed);
+    for (uint8_t& byte : key_) byte = static_cast<uint8_t>(random_());
+    for (uint8_t& byte : salt_) byte = static_cast<uint8_t>(random_());
+    if (config.encrypt && !layer_.setWriteKey(key_, sizeof(key_), salt_, 0)) {
+        setError("Cannot set the test key");
+        return false;
+    }
+
+    parameterSets_.clear();
+    if (video) {
+        buildParameterSets(config.width, config.height, config.fps, parameterSets_);
+    }
+    // No zero bytes at all, so never a start code or emulation prevention
+    noise_.resize(NOISE_SIZE);
+    for (uint8_t& byte : noise_) {
+        byte = static_cast<uint8_t>(random_() % 255 + 1);
+    }
+    buildTone(48000, 2, config.audioFrameMs, pcm48_);
+    buildTone(16000, 1, config.audioFrameMs, pcm16_);
+
+    stream_.reserve(config.transferSize * 2);
+    record_.resize(config.maxRecordPayload + TlsRecordLayer::OVERHEAD);
+    open_ = true;
+    LOGI("Load generator: %dx%d at %d fps, %d kbps, audio 0x%x, ping %d Hz, metadata %d Hz, "
+         "records of %zu bytes, speed %.2f, encrypted %d",
+         config.width, config.height, config.fps, config.videoKbps, config.audioStreams,
+         config.pingHz, config.metadataHz, config.maxRecordPayload, config.speed, config.encrypt);
+    return true;
+}
+
+bool LoadGenerator::readKey(CaptureReadKey& key) const {
+    if (!open_ || !config_.encrypt) {
+        return false;
+    }
+    std::memset(&key, 0, sizeof(key));
+    key.keyLength = sizeof(key_);
+    std::memcpy(key.key, key_, sizeof(key_));
+    std::memcpy(key.salt, salt_, sizeof(salt_));
+    key.sequence = 0;
+    return true;
+}
+
+void LoadGenerator::close() {
+    stopReading();
+    open_ = false;
+}
+
+void LoadGenerator::setRawDataCallback(RawDataCallback callback) {
+    std::lock_guard<std::mutex> lock(callbackMutex_);
+    rawDataCallback_ = std::move(callback);
+}
+
+void LoadGenerator::setErrorCallback(ErrorCallback callback) {
+    std::lock_guard<std::mutex> lock(callbackMutex_);
+    errorCallback_ = std::move(callback);
+}
+
+void LoadGenerator::setCapture(SessionCapture*) {
+    // The same config and seed generate the same stream again
+}
+
+void LoadGenerator::startReading() {
+    if (!open_ || running_ || thread_.joinable()) {
+        return;
+    }
+    running_ = true;
+    thread_ = std::thread(&LoadGenerator::generatorLoop, this);
+}
+
+void LoadGenerator::stopReading() {
+    {
+        std::lock_guard<std::mutex> lock(pacingMutex_);
+        running_ = false;
+    }
+    pacingWake_.notify_all();
+    if (thread_.joinable() && thread_.get_id() != std::this_thread::get_id()) {
+        thread_.join();
+    }
+}
+
+int LoadGenerator::write(const uint8_t*, size_t length) {
+    return static_cast<int>(length);
+}
+
+int LoadGenerator::read(uint8_t*, size_t, int) {
+    return 0;
+}
+
+void LoadGenerator::generatorLoop() {
+    applyThreadPolicy("AAP-LoadGen");
+
+    // Every source is due at whole multiples of its period in stream time
+    enum Kind { VIDEO, AUDIO_MEDIA, AUDIO_GUIDANCE, AUDIO_SYSTEM, PING, METADATA, KIND_COUNT };
+    uint64_t periodNs[KIND_COUNT] = {0};
+    if (config_.videoKbps > 0) periodNs[VIDEO] = 1000000000ULL / config_.fps;
+    const uint64_t audioNs = static_cast<uint64_t>(config_.audioFrameMs) * 1000000;
+    if (config_.audioStreams & LoadConfig::AUDIO_MEDIA) periodNs[AUDIO_MEDIA] = audioNs;
+    if (config_.audioStreams & LoadConfig::AUDIO_GUIDANCE) periodNs[AUDIO_GUIDANCE] = audioNs;
+    if (config_.audioStreams & LoadConfig::AUDIO_SYSTEM) periodNs[AUDIO_SYSTEM] = audioNs;
+    if (config_.pingHz > 0) periodNs[PING] = 1000000000ULL / config_.pingHz;
+    if (config_.metadataHz > 0) periodNs[METADATA] = 1000000000ULL / config_.metadataHz;
+    uint64_t count[KIND_COUNT] = {0};
+
+    const uint64_t endNs = config_.seconds > 0
+            ? static_cast<uint64_t>(config_.seconds * 1e9) : UINT64_MAX;
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+
+    if (periodNs[VIDEO] > 0) {
+        appendCodecConfig();
+    }
+    while (running_) {
+        int next = -1;
+        uint64_t dueNs = UINT64_MAX;
+        for (int kind = 0; kind < KIND_COUNT; kind++) {
+            if (periodNs[kind] > 0 && count[kind] * periodNs[kind] < dueNs) {
+                dueNs = count[kind] * periodNs[kind];
+                next = kind;
+            }
+        }
+        if (next < 0 || dueNs >= endNs) {
+            break;
+        }
+
+        if (config_.speed > 0) {
+            const auto due = start + std::chrono::nanoseconds(
+                static_cast<int64_t>(static_cast<double>(dueNs) / config_.speed));
+            if (due > Clock::now()) {
+                // A short transfer, as the phone's when it has nothing more to send
+                deliver(true);
+                std::unique_lock<std::mutex> lock(pacingMutex_);
+                pacingWake_.wait_until(lock, due, [this] { return !running_; });
+                if (!running_) {
+                    break;
+                }
+            }
+            const auto lag = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - due).count();
+            if (lag > 0 && static_cast<uint64_t>(lag) > maxLagNs_.load(std::memory_order_relaxed)) {
+                maxLagNs_.store(static_cast<uint64_t>(lag), std::memory_order_relaxed);
+            }
+        }
+
+        const uint64_t timestampUs = dueNs / 1000;
+        switch (next) {
+            case VIDEO: appendVideoFrame(count[next], timestampUs); break;
+            case AUDIO_MEDIA: appendAudioFrame(Channel::ID_AUD, pcm48_, timestampUs); break;
+            case AUDIO_GUIDANCE: appendAudioFrame(Channel::ID_AU1, pcm16_, timestampUs); break;
+            case AUDIO_SYSTEM: appendAudioFrame(Channel::ID_AU2, pcm16_, timestampUs); break;
+            case PING: appendPing(timestampUs); break;
+            case METADATA: appendMetadata(count[next]); break;
+        }
+        count[next]++;
+        streamNs_.store(dueNs, std::memory_order_relaxed);
+        deliver(false);
+        elapsedNs_.store(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()),
+            std::memory_order_relaxed);
+    }
+    deliver(true);
+
+    if (running_.exchange(false)) {
+        LOGI("Load generated: %llu records, %llu bytes in %llu ms",
+             static_cast<unsigned long long>(records_.load()),
+             static_cast<unsigned long long>(bytesGenerated_.load()),
+             static_cast<unsigned long long>(elapsedNs_.load() / 1000000));
+        std::lock_guard<std::mutex> lock(callbackMutex_);
+        if (errorCallback_) {
+            errorCallback_(ERROR_END_OF_STREAM, "End of generated stream");
+        }
+    }
+}
+
+void LoadGenerator::appendCodecConfig() {
+    message_.clear();
+    putBe16(message_, MSG_CODEC_CONFIG);
+    message_.insert(message_.end(), parameterSets_.begin(), parameterSets_.end());
+    appendMessage(Channel::ID_VID);
+}
+
+void LoadGenerator::appendVideoFrame(uint64_t frame, uint64_t timestampUs) {
+    // Sized so a GOP averages the bitrate: one keyframe of keyframeScale P frames
+    const uint64_t average = static_cast<uint64_t>(config_.videoKbps) * 1000 / 8 / config_.fps;
+    const uint64_t gop = static_cast<uint64_t>(config_.keyframeInterval);
+    const uint64_t predicted = gop * average / (gop - 1 + config_.keyframeScale);
+    const bool keyframe = frame % gop == 0;
+    size_t size;
+    if (keyframe) {
+        size = static_cast<size_t>(predicted * config_.keyframeScale);
+    } else {
+        // Motion varies, 75% to 125% of the mean
+        size = static_cast<size_t>(predicted * (3 + random_() % 3) / 4);
+    }
+
+    message_.clear();
+    putBe16(message_, MSG_MEDIA_DATA);
+    putBe64(message_, timestampUs);
+    appendSlices(keyframe ? NAL_IDR : NAL_SLICE, std::max<size_t>(size, 16));
+    appendMessage(Channel::ID_VID);
+
+    videoFrames_.fetch_add(1, std::memory_order_relaxed);
+    if (keyframe) {
+        keyframes_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void LoadGenerator::appendAudioFrame(int channel, const std::vector<uint8_t>& pcm, uint64_t timestampUs) {
+    message_.clear();
+    putBe16(message_, MSG_MEDIA_DATA);
+    putBe64(message_, timestampUs);
+    message_.insert(message_.end(), pcm.begin(), pcm.end());
+    appendMessage(channel);
+    audioFrames_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadGenerator::appendPing(uint64_t timestampUs) {
+    message_.clear();
+    putBe16(message_, MSG_PING_REQUEST);
+    putVarint(message_, 1 << 3);  // timestamp
+    putVarint(message_, timestampUs);
+    appendMessage(Channel::ID_CTR);
+    pings_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadGenerator::appendMetadata(uint64_t index) {
+    char song[32];
+    const int songLength = snprintf(song, sizeof(song), "Track %llu", static_cast<unsigned long long>(index));
+    static const char ARTIST[] = "Load generator";
+
+    message_.clear();
+    putBe16(message_, MSG_PLAYBACK_METADATA);
+    putBytesField(message_, 1, reinterpret_cast<const uint8_t*>(song), static_cast<size_t>(songLength));
+    putBytesField(message_, 2, reinterpret_cast<const uint8_t*>(ARTIST), sizeof(ARTIST) - 1);
+    if (config_.albumArtBytes > 0) {
+        putVarint(message_, 4 << 3 | 2);  // albumart
+        putVarint(message_, config_.albumArtBytes);
+        appendRandom(message_, config_.albumArtBytes);
+    }
+    putVarint(message_, 6 << 3);  // duration
+    putVarint(message_, 180);
+    appendMessage(Channel::ID_MPB);
+    metadata_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadGenerator::appendSlices(uint8_t nalHeader, size_t length) {
+    const size_t slice = config_.maxNalSize > 0 ? config_.maxNalSize : length;
+    size_t written = 0;
+    while (written < length) {
+        const size_t body = std::min(slice, length - written);
+        message_.insert(message_.end(), std::begin(START_CODE), std::end(START_CODE));
+        message_.push_back(nalHeader);
+        appendRandom(message_, body);
+        written += body;
+    }
+}
+
+void LoadGenerator::appendRandom(std::vector<uint8_t>& out, size_t length) {
+    while (length > 0) {
+        const size_t offset = random_() % noise_.size();
+        const size_t chunk = std::min(length, noise_.size() - offset);
+        out.insert(out.end(), noise_.begin() + offset, noise_.begin() + offset + chunk);
+        length -= chunk;
+    }
+}
+
+void LoadGenerator::appendMessage(int channel) {
+    const size_t total = message_.size();
+    if (total <= config_.maxRecordPayload) {
+        appendRecord(channel, FLAGS_COMPLETE, message_.data(), total, 0);
+        return;
+    }
+    size_t sent = 0;
+    while (sent < total) {
+        const size_t payload = std::min(config_.maxRecordPayload, total - sent);
+        const uint8_t flags = sent == 0 ? FLAGS_FIRST : sent + payload == total ? FLAGS_LAST : FLAGS_MIDDLE;
+        appendRecord(channel, flags, message_.data() + sent, payload, static_cast<uint32_t>(total));
+        sent += payload;
+    }
+}
+
+void LoadGenerator::appendRecord(int channel, uint8_t flags, const uint8_t* payload, size_t length,
+                                 uint32_t total) {
+    const uint8_t* wire = payload;
+    size_t wireLength = length;
+    if (config_.encrypt) {
+        const int encrypted = layer_.encrypt(payload, length, record_.data());
+        if (encrypted < 0) {
+            return;
+        }
+        wire = record_.data();
+        wireLength = static_cast<size_t>(encrypted);
+    }
+
+    stream_.push_back(static_cast<uint8_t>(channel));
+    stream_.push_back(flags);
+    putBe16(stream_, static_cast<uint16_t>(wireLength));
+    if (flags == FLAGS_FIRST) {
+        for (int shift = 24; shift >= 0; shift -= 8) {
+            stream_.push_back(static_cast<uint8_t>(total >> shift));
+        }
+    }
+    stream_.insert(stream_.end(), wire, wire + wireLength);
+    records_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void LoadGenerator::deliver(bool flushAll) {
+    const size_t size = config_.transferSize;
+    size_t offset = 0;
+    std::lock_guard<std::mutex> lock(callbackMutex_);
+    while (stream_.size() - offset >= size || (flushAll && offset < stream_.size())) {
+        const size_t length = std::min(size, stream_.size() - offset);
+        if (rawDataCallback_) {
+            rawDataCallback_(stream_.data() + offset, length);
+        }
+        offset += length;
+        transfers_.fetch_add(1, std::memory_order_relaxed);
+        bytesGenerated_.fetch_add(length, std::memory_order_relaxed);
+    }
+    stream_.erase(stream_.begin(), stream_.begin() + static_cast<std::ptrdiff_t>(offset));
+}
+
+LoadGenerator::Stats LoadGenerator::getStats() const {
+    Stats stats;
+    stats.bytesGenerated = bytesGenerated_.load(std::memory_order_relaxed);
+    stats.transfers = transfers_.load(std::memory_order_relaxed);
+    stats.records = records_.load(std::memory_order_relaxed);
+    stats.videoFrames = videoFrames_.load(std::memory_order_relaxed);
+    stats.keyframes = keyframes_.load(std::memory_order_relaxed);
+    stats.audioFrames = audioFrames_.load(std::memory_order_relaxed);
+    stats.pings = pings_.load(std::memory_order_relaxed);
+    stats.metadata = metadata_.load(std::memory_order_relaxed);
+    stats.streamNs = streamNs_.load(std::memory_order_relaxed);
+    stats.elapsedNs = elapsedNs_.load(std::memory_order_relaxed);
+    stats.maxLagNs = maxLagNs_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void LoadGenerator::setError(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(lastError_, sizeof(lastError_), format, args);
+    va_end(args);
+    LOGE("%s", lastError_);
+}
+
+} // namespace aap
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "transport.h"
+#include "session_capture.h"
+#include "tls_record.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace aap {
+
+/**
+ * What a LoadGenerator streams, and how fast.
+ */
+struct LoadConfig {
+    // Audio streams in audioStreams
+    static constexpr uint32_t AUDIO_MEDIA = 0x01;     // ID_AUD, 48 kHz stereo
+    static constexpr uint32_t AUDIO_GUIDANCE = 0x02;  // ID_AU1, 16 kHz mono
+    static constexpr uint32_t AUDIO_SYSTEM = 0x04;    // ID_AU2, 16 kHz mono
+
+    double seconds = 10.0;      // Stream time to generate, 0 until stopReading()
+    double speed = 1.0;         // 1.0 for real time, 2.0 for twice as fast, 0 as fast as possible
+    uint32_t seed = 1;
+
+    // H.264 video, an IDR every keyframeInterval frames keyframeScale times a P frame
+    int width = 1280;
+    int height = 720;
+    int fps = 30;
+    int videoKbps = 6000;       // 0 for no video
+    int keyframeInterval = 60;
+    int keyframeScale = 8;
+    size_t maxNalSize = 0;      // Slices per frame are cut to this size, 0 for one slice
+
+    uint32_t audioStreams = AUDIO_MEDIA;
+    int audioFrameMs = 20;
+
+    int pingHz = 1;             // Ping requests on the control channel
+    int metadataHz = 0;         // Playback metadata on the background lane
+    size_t albumArtBytes = 0;   // Cover art carried by each metadata message
+
+    // Largest record payload; longer messages are fragmented, first (0x09),
+    // middle (0x08) and last (0x0A) records, like the phone does
+    size_t maxRecordPayload = 16384 - TlsRecordLayer::OVERHEAD;
+    size_t transferSize = 16384;  // Bytes per RawDataCallback, as USB bulk transfers
+    bool encrypt = true;          // TLS records under a test key, see readKey()
+};
+
+/**
+ * Transport that synthesizes a phone's record stream, to stress the native
+ * pipeline at rates no phone produces yet.
+ *
+ * The AAP-LoadGen thread builds valid AAP records: codec config with an
+ * SPS and PPS the decoders accept, then Annex-B access units at the
+ * configured bitrate, PCM media on each audio channel, ping requests and
+ * playback metadata. Each record is encrypted under a TLS test key, which
+ * readKey() hands out like a capture's, and cut into transfers for the
+ * RawDataCallback, so framer, decryption, dispatcher and sinks all run as
+ * on a live session. Without encryption the plaintext is framed as is,
+ * flagged encrypted as on the wire, for harnesses that stop at the framer.
+ *
+ * Writes are discarded and read() has nothing to return: there is no
+ * handshake. The end of the stream is reported like a disconnect.
+ */
+class LoadGenerator : public Transport {
+public:
+    // Reported through the ErrorCallback at the end of the stream,
+    // the same code as ReplayTransport::ERROR_END_OF_CAPTURE
+    static constexpr int ERROR_END_OF_STREAM = -4;
+
+    LoadGenerator();
+    ~LoadGenerator() override;
+
+    // Non-copyable
+    LoadGenerator(const LoadGenerator&) = delete;
+    LoadGenerator& operator=(const LoadGenerator&) = delete;
+
+    /**
+     * @return false if the config can't be generated
+     */
+    bool open(const LoadConfig& config);
+
+    /**
+     * The test key records are encrypted with, from the seed.
+     * @return false without encryption
+     */
+    bool readKey(CaptureReadKey& key) const;
+
+    void close() override;
+    bool isOpen() const override { return open_; }
+    bool isReading() const override { return running_.load(std::memory_order_relaxed); }
+    void setRawDataCallback(RawDataCallback callback) override;
+    void setErrorCallback(ErrorCallback callback) override;
+    void setCapture(SessionCapture* capture) override;
+    void startReading() override;
+    void stopReading() override;
+
+    /**
+     * Discarded: nothing listens on the other end.
+     * @return length
+     */
+    int write(const uint8_t* data, size_t length) override;
+
+    /**
+     * @return 0, as on a timeout
+     */
+    int read(uint8_t* buffer, size_t length, int timeoutMs) override;
+
+    const char* getLastError() const override { return lastError_; }
+
+    struct Stats {
+        uint64_t bytesGenerated;    // On the wire, headers and TLS overhead included
+        uint64_t transfers;
+        uint64_t records;
+        uint64_t videoFrames;
+        uint64_t keyframes;
+        uint64_t audioFrames;
+        uint64_t pings;
+        uint64_t metadata;
+        uint64_t streamNs;          // Stream time generated
+        uint64_t elapsedNs;         // Wall time taken
+        uint64_t maxLagNs;          // Largest delay behind the paced schedule
+    };
+    Stats getStats() const;
+
+private:
+    LoadConfig config_;
+    bool open_ = false;
+    uint8_t key_[16] = {0};
+    uint8_t salt_[TlsRecordLayer::SALT_SIZE] = {0};
+    TlsRecordLayer layer_;
+    std::mt19937 random_;
+
+    // Built by open(): SPS and PPS in Annex-B, slice payload with no
+    // start code in it, and one audio frame of tone per sample rate
+    std::vector<uint8_t> parameterSets_;
+    std::vector<uint8_t> noise_;
+    std::vector<uint8_t> pcm48_;
+    std::vector<uint8_t> pcm16_;
+
+    // Generator thread only: the stream not yet delivered, one message and one record
+    std::vector<uint8_t> stream_;
+    std::vector<uint8_t> message_;
+    std::vector<uint8_t> record_;
+
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    // Paced waits end early on stopReading()
+    std::mutex pacingMutex_;
+    std::condition_variable pacingWake_;
+
+    RawDataCallback rawDataCallback_;
+    ErrorCallback errorCallback_;
+    std::mutex callbackMutex_;
+
+    std::atomic<uint64_t> bytesGenerated_{0};
+    std::atomic<uint64_t> transfers_{0};
+    std::atomic<uint64_t> records_{0};
+    std::atomic<uint64_t> videoFrames_{0};
+    std::atomic<uint64_t> keyframes_{0};
+    std::atomic<uint64_t> audioFrames_{0};
+    std::atomic<uint64_t> pings_{0};
+    std::atomic<uint64_t> metadata_{0};
+    std::atomic<uint64_t> streamNs_{0};
+    std::atomic<uint64_t> elapsedNs_{0};
+    std::atomic<uint64_t> maxLagNs_{0};
+
+    char lastError_[256] = {0};
+
+    void generatorLoop();
+    void appendCodecConfig();
+    void appendVideoFrame(uint64_t frame, uint64_t timestampUs);
+    void appendAudioFrame(int channel, const std::vector<uint8_t>& pcm, uint64_t timestampUs);
+    void appendPing(uint64_t timestampUs);
+    void appendMetadata(uint64_t index);
+    void appendSlices(uint8_t nalHeader, size_t length);
+    void appendRandom(std::vector<uint8_t>& out, size_t length);
+    // Frame message_ into records on channel and append them to stream_
+    void appendMessage(int channel);
+    void appendRecord(int channel, uint8_t flags, const uint8_t* payload, size_t length, uint32_t total);
+    // Hand complete transfers to the callback, and the rest too if flushAll
+    void deliver(bool flushAll);
+    void setError(const char* format, ...);
+};
+
+} // namespace aap
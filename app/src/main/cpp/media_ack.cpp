@@ -0,0 +1,182 @@
+#include "media_ack.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <pthread.h>
+#include <time.h>
+
+#define LOG_TAG "MediaAck"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+} // anonymous namespace
+
+MediaAckBatcher::MediaAckBatcher(uint32_t threshold, int tickMs)
+    : threshold_(threshold > 0 ? threshold : 1)
+    , tick_(tickMs > 0 ? tickMs : DEFAULT_TICK_MS)
+{
+}
+
+MediaAckBatcher::~MediaAckBatcher() {
+    stop();
+}
+
+void MediaAckBatcher::setCallback(MediaAckCallback callback) {
+    callback_ = std::move(callback);
+}
+
+void MediaAckBatcher::setFlowControl(QueueFillProbe probe, uint32_t highWater, uint32_t lowWater,
+                                     int maxHoldMs) {
+    fillProbe_ = std::move(probe);
+    highWater_ = highWater > 0 ? highWater : DEFAULT_HIGH_WATER;
+    lowWater_ = lowWater < highWater_ ? lowWater : highWater_ / 2;
+    maxHoldNs_ = static_cast<uint64_t>(maxHoldMs > 0 ? maxHoldMs : DEFAULT_MAX_HOLD_MS) * 1000000ULL;
+}
+
+void MediaAckBatcher::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    thread_ = std::thread(&MediaAckBatcher::tickLoop, this);
+    LOGD("Media ACK batching started, threshold %u, tick %lld ms",
+         threshold_, static_cast<long long>(tick_.count()));
+}
+
+void MediaAckBatcher::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    armed_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    flushAll(true);
+}
+
+void MediaAckBatcher::consumed(int channel) {
+    if (!Channel::info(channel).ackRequired) {
+        return;
+    }
+    const uint32_t count = pending_[channel].fetch_add(1, std::memory_order_acq_rel) + 1;
+    if (count >= threshold_ && flush(channel)) {
+        thresholdFlushes_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // First pending record since the last tick wakes the tick thread,
+    // which also releases a held channel once its queue drains
+    if (!hasPending_.exchange(true, std::memory_order_acq_rel)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        armed_.notify_one();
+    }
+}
+
+void MediaAckBatcher::tickLoop() {
+    applyThreadPolicy("AAP-Ack");
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        armed_.wait(lock, [this] {
+            return !running_ || hasPending_.load(std::memory_order_acquire);
+        });
+        if (!running_) {
+            return;
+        }
+        // Give the batch one tick to fill up
+        armed_.wait_for(lock, tick_, [this] { return !running_; });
+        hasPending_.store(false, std::memory_order_release);
+
+        lock.unlock();
+        if (!flushAll()) {
+            // Held back: look at the queue again next tick
+            hasPending_.store(true, std::memory_order_release);
+        }
+        lock.lock();
+    }
+}
+
+bool MediaAckBatcher::isHeld(int channel) {
+    // Called by the consuming thread and AAP-Ack alike, a hold starts and ends once
+    uint64_t heldSince = heldSinceNs_[channel].load(std::memory_order_acquire);
+    const uint32_t fill = fillProbe_(channel);
+    if (heldSince == 0) {
+        if (fill < highWater_) {
+            return false;
+        }
+        const uint64_t now = monotonicNs();
+        if (heldSinceNs_[channel].compare_exchange_strong(heldSince, now, std::memory_order_acq_rel)) {
+            holds_.fetch_add(1, std::memory_order_relaxed);
+            LOGD("Channel %d queue %u%% full, withholding ACKs", channel, fill);
+        }
+        return true;
+    }
+
+    const uint64_t now = monotonicNs();
+    const bool timedOut = now - heldSince >= maxHoldNs_;
+    if (fill >= lowWater_ && !timedOut) {
+        return true;
+    }
+    if (heldSinceNs_[channel].compare_exchange_strong(heldSince, 0, std::memory_order_acq_rel)) {
+        heldNs_.fetch_add(now - heldSince, std::memory_order_relaxed);
+        if (timedOut) {
+            holdTimeouts_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return false;
+}
+
+bool MediaAckBatcher::flush(int channel, bool force) {
+    if (!force && fillProbe_ && pending_[channel].load(std::memory_order_acquire) != 0 && isHeld(channel)) {
+        return false;
+    }
+    const uint32_t count = pending_[channel].exchange(0, std::memory_order_acq_rel);
+    if (count == 0) {
+        return true;
+    }
+
+    acksSent_.fetch_add(1, std::memory_order_relaxed);
+    recordsAcked_.fetch_add(count, std::memory_order_relaxed);
+    uint64_t max = maxBatch_.load(std::memory_order_relaxed);
+    while (count > max && !maxBatch_.compare_exchange_weak(max, count, std::memory_order_relaxed)) {
+    }
+
+    if (callback_) {
+        callback_(channel, count);
+    }
+    return true;
+}
+
+bool MediaAckBatcher::flushAll(bool force) {
+    bool drained = true;
+    for (int channel = 0; channel < MAX_CHANNELS; channel++) {
+        drained &= flush(channel, force);
+    }
+    return drained;
+}
+
+MediaAckBatcher::Stats MediaAckBatcher::getStats() const {
+    Stats stats;
+    stats.acksSent = acksSent_.load(std::memory_order_relaxed);
+    stats.recordsAcked = recordsAcked_.load(std::memory_order_relaxed);
+    stats.thresholdFlushes = thresholdFlushes_.load(std::memory_order_relaxed);
+    stats.maxBatch = maxBatch_.load(std::memory_order_relaxed);
+    stats.holds = holds_.load(std::memory_order_relaxed);
+    stats.holdTimeouts = holdTimeouts_.load(std::memory_order_relaxed);
+    stats.heldNs = heldNs_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace aap
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "aap_message.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace aap {
+
+/**
+ * Callback for a coalesced media ACK.
+ * Parameters: channel, number of records acknowledged
+ */
+using MediaAckCallback = std::function<void(int channel, uint32_t count)>;
+
+/**
+ * How full, in percent, the queue a channel's records wait in is.
+ */
+using QueueFillProbe = std::function<uint32_t(int channel)>;
+
+/**
+ * Coalesces the media ACKs of natively consumed audio and video records.
+ *
+ * consumed() only bumps a per-channel counter. An ACK covering every
+ * pending record goes out once a channel reaches the threshold, from the
+ * consuming thread, or after at most one tick from the AAP-Ack thread,
+ * so a quiet channel never holds back the phone's send window.
+ *
+ * With flow control, a channel whose queue is filling up has its ACKs
+ * withheld until the consumer catches up, so the phone's send window
+ * closes and its encoder backs off instead of the queue dropping records
+ * that were already received and decrypted.
+ *
+ * The callback sends the ACK: natively through the ControlResponder once
+ * the write keys are exported and the channel's session is known, else
+ * by Kotlin, whose SSLEngine then still owns the write sequence.
+ */
+class MediaAckBatcher {
+public:
+    static constexpr int MAX_CHANNELS = 16;
+    static_assert(Channel::COUNT <= MAX_CHANNELS, "Every ACKed channel needs a counter");
+    static constexpr uint32_t DEFAULT_THRESHOLD = 4;
+    static constexpr int DEFAULT_TICK_MS = 4;
+    static constexpr uint32_t DEFAULT_HIGH_WATER = 75;
+    static constexpr uint32_t DEFAULT_LOW_WATER = 25;
+    static constexpr int DEFAULT_MAX_HOLD_MS = 200;
+
+    MediaAckBatcher(uint32_t threshold = DEFAULT_THRESHOLD, int tickMs = DEFAULT_TICK_MS);
+    ~MediaAckBatcher();
+
+    // Non-copyable
+    MediaAckBatcher(const MediaAckBatcher&) = delete;
+    MediaAckBatcher& operator=(const MediaAckBatcher&) = delete;
+
+    /**
+     * Must be called before start().
+     */
+    void setCallback(MediaAckCallback callback);
+
+    /**
+     * Withhold a channel's ACKs once its queue is highWater percent full,
+     * until it drains below lowWater percent. ACKs are never held longer
+     * than maxHoldMs, so the phone doesn't give up on the channel.
+     * Must be called before start().
+     */
+    void setFlowControl(QueueFillProbe probe, uint32_t highWater = DEFAULT_HIGH_WATER,
+                        uint32_t lowWater = DEFAULT_LOW_WATER, int maxHoldMs = DEFAULT_MAX_HOLD_MS);
+
+    void start();
+
+    /**
+     * Stop the tick thread, pending records are acknowledged first.
+     */
+    void stop();
+
+    /**
+     * Count one consumed media record. Safe to call from any thread.
+     */
+    void consumed(int channel);
+
+    struct Stats {
+        uint64_t acksSent;
+        uint64_t recordsAcked;
+        uint64_t thresholdFlushes;  // Sent from the consuming thread
+        uint64_t maxBatch;
+        uint64_t holds;             // Times a channel's ACKs were withheld
+        uint64_t holdTimeouts;      // Holds released by maxHoldMs, not by the queue draining
+        uint64_t heldNs;            // Total time ACKs were withheld
+    };
+    Stats getStats() const;
+
+private:
+    const uint32_t threshold_;
+    const std::chrono::milliseconds tick_;
+
+    MediaAckCallback callback_;
+    std::atomic<uint32_t> pending_[MAX_CHANNELS] = {};
+
+    // Flow control, off without a probe
+    QueueFillProbe fillProbe_;
+    uint32_t highWater_ = DEFAULT_HIGH_WATER;
+    uint32_t lowWater_ = DEFAULT_LOW_WATER;
+    uint64_t maxHoldNs_ = 0;
+    std::atomic<uint64_t> heldSinceNs_[MAX_CHANNELS] = {};  // 0 while ACKs flow
+
+    // Tick thread sleeps until a record is pending
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable armed_;
+    bool running_ = false;
+    std::atomic<bool> hasPending_{false};
+
+    std::atomic<uint64_t> acksSent_{0};
+    std::atomic<uint64_t> recordsAcked_{0};
+    std::atomic<uint64_t> thresholdFlushes_{0};
+    std::atomic<uint64_t> maxBatch_{0};
+    std::atomic<uint64_t> holds_{0};
+    std::atomic<uint64_t> holdTimeouts_{0};
+    std::atomic<uint64_t> heldNs_{0};
+
+    void tickLoop();
+    bool isHeld(int channel);
+    // @return true if nothing is left pending on channel
+    bool flush(int channel, bool force = false);
+    // @return true if nothing is left pending on any channel
+    bool flushAll(bool force = false);
+};
+
+} // namespace aap
@@ -0,0 +1,64 @@
+#include "media_clock.h"
+
+namespace aap {
+
+namespace {
+
+// Offset smoothing, in reports
+constexpr int64_t OFFSET_SMOOTHING = 8;
+
+} // anonymous namespace
+
+void MediaClock::updateAudio(uint64_t mediaUs, int64_t atNs) {
+    const int64_t offsetUs = static_cast<int64_t>(mediaUs) - atNs / 1000;
+    const int64_t errorUs = offsetUs - smoothedOffsetUs_;
+    if (!smoothing_ || errorUs > RESYNC_US || errorUs < -RESYNC_US) {
+        // First report, or the stream restarted: no point easing into it
+        smoothedOffsetUs_ = offsetUs;
+        smoothing_ = true;
+    } else {
+        smoothedOffsetUs_ += errorUs / OFFSET_SMOOTHING;
+    }
+    offsetUs_.store(smoothedOffsetUs_, std::memory_order_relaxed);
+    updatedNs_.store(atNs, std::memory_order_release);
+}
+
+void MediaClock::resetAudio() {
+    smoothing_ = false;
+    updatedNs_.store(0, std::memory_order_release);
+}
+
+int64_t MediaClock::schedule(uint64_t videoUs, int64_t nowNs) {
+    const int64_t updatedNs = updatedNs_.load(std::memory_order_acquire);
+    // A report can be stamped slightly ahead of now, it is still fresh
+    if (updatedNs == 0 || nowNs - updatedNs > AUDIO_TIMEOUT_NS) {
+        framesFreeRunning_.fetch_add(1, std::memory_order_relaxed);
+        return nowNs;
+    }
+
+    const int64_t audioUs = nowNs / 1000 + offsetUs_.load(std::memory_order_relaxed);
+    const int64_t leadUs = static_cast<int64_t>(videoUs) - audioUs;
+    if (leadUs > MAX_SKEW_US || leadUs < -MAX_SKEW_US) {
+        framesFreeRunning_.fetch_add(1, std::memory_order_relaxed);
+        return nowNs;
+    }
+    leadLastUs_.store(leadUs, std::memory_order_relaxed);
+
+    if (leadUs <= 0) {
+        framesLate_.fetch_add(1, std::memory_order_relaxed);
+        return nowNs;
+    }
+    framesSynced_.fetch_add(1, std::memory_order_relaxed);
+    return nowNs + (leadUs < MAX_LEAD_US ? leadUs : MAX_LEAD_US) * 1000;
+}
+
+MediaClock::Stats MediaClock::getStats() const {
+    Stats stats;
+    stats.framesSynced = framesSynced_.load(std::memory_order_relaxed);
+    stats.framesLate = framesLate_.load(std::memory_order_relaxed);
+    stats.framesFreeRunning = framesFreeRunning_.load(std::memory_order_relaxed);
+    stats.leadLastUs = leadLastUs_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace aap
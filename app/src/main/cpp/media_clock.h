@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace aap {
+
+/**
+ * Shared presentation clock of one session: audio is the master, video
+ * frames are scheduled against it.
+ *
+ * The audio stage reports, every record, which media timestamp is being
+ * heard at which CLOCK_MONOTONIC time. The offset between the two is
+ * smoothed, so the few milliseconds an estimate can be off by do not move
+ * the clock. A video frame is then held until audio reaches its media
+ * timestamp: up to MAX_LEAD_US, and a late frame is presented at once.
+ *
+ * Without a recent audio report, or with timestamps too far apart to share
+ * a timebase, video is presented immediately as before.
+ *
+ * updateAudio()/resetAudio() are called from a single audio thread,
+ * schedule() from the decoder's output thread.
+ */
+class MediaClock {
+public:
+    static constexpr int64_t MAX_LEAD_US = 250000;          // Longest a frame is held for audio
+    static constexpr int64_t MAX_SKEW_US = 2000000;         // Further apart, not the same timebase
+    static constexpr int64_t AUDIO_TIMEOUT_NS = 500000000;  // Reports older than this are stale
+    static constexpr int64_t RESYNC_US = 40000;             // Offset jump taken at once, not smoothed
+
+    MediaClock() = default;
+
+    // Non-copyable
+    MediaClock(const MediaClock&) = delete;
+    MediaClock& operator=(const MediaClock&) = delete;
+
+    /**
+     * Audio at media time mediaUs is heard at atNs.
+     */
+    void updateAudio(uint64_t mediaUs, int64_t atNs);
+
+    /**
+     * Audio stopped, or another channel takes over as master.
+     */
+    void resetAudio();
+
+    /**
+     * When to present a video frame with media timestamp videoUs.
+     * @return CLOCK_MONOTONIC time, nowNs when not held
+     */
+    int64_t schedule(uint64_t videoUs, int64_t nowNs);
+
+    struct Stats {
+        uint64_t framesSynced;      // Held for audio
+        uint64_t framesLate;        // Behind audio, presented at once
+        uint64_t framesFreeRunning; // No usable audio clock
+        int64_t leadLastUs;         // Video ahead of audio, negative when behind
+    };
+    Stats getStats() const;
+
+private:
+    // Audio thread only
+    bool smoothing_ = false;
+    int64_t smoothedOffsetUs_ = 0;
+
+    // Media time minus CLOCK_MONOTONIC time, in microseconds
+    std::atomic<int64_t> offsetUs_{0};
+    std::atomic<int64_t> updatedNs_{0};
+
+    std::atomic<uint64_t> framesSynced_{0};
+    std::atomic<uint64_t> framesLate_{0};
+    std::atomic<uint64_t> framesFreeRunning_{0};
+    std::atomic<int64_t> leadLastUs_{0};
+};
+
+} // namespace aap
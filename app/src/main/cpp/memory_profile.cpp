@@ -0,0 +1,88 @@
+#include "memory_profile.h"
+#include "video_assembler.h"
+#include <android/log.h>
+#include <algorithm>
+#include <mutex>
+
+#define LOG_TAG "MemoryProfile"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+// H.264 at the quality the phone streams, roughly 0.2 bits per pixel
+constexpr int64_t BITS_PER_PIXEL_X10 = 2;
+// A keyframe compresses at least 4:1 against its 4:2:0 picture, and is
+// rarely more than eight average frames
+constexpr size_t KEYFRAME_RATIO = 4;
+constexpr size_t KEYFRAME_AVERAGE_FRAMES = 8;
+constexpr size_t MIN_FRAME_SIZE = 64 * 1024;
+constexpr size_t FRAME_ALIGNMENT = 16 * 1024;
+// Slots to ride out 250ms of decoder stall, never fewer than a handful
+constexpr size_t MIN_FRAME_SLOTS = 4;
+
+std::mutex profileMutex;
+MemoryProfile current = MemoryProfile::standard();
+
+} // anonymous namespace
+
+int VideoFormat::estimatedBitrateKbps() const {
+    if (bitrateKbps > 0) {
+        return bitrateKbps;
+    }
+    const int64_t bits = static_cast<int64_t>(width) * height * std::max(fps, 1) * BITS_PER_PIXEL_X10 / 10;
+    return static_cast<int>(std::max<int64_t>(bits / 1000, 1));
+}
+
+MemoryProfile MemoryProfile::standard() {
+    MemoryProfile profile;
+    profile.maxFrameSize = VideoAssembler::MAX_FRAME_SIZE;
+    profile.frameSlots = VideoAssembler::FRAME_SLOTS;
+    return profile;
+}
+
+MemoryProfile MemoryProfile::leanFor(const VideoFormat& format) {
+    MemoryProfile profile;
+    profile.lean = true;
+
+    const int fps = std::max(format.fps, 1);
+    const size_t bytesPerSecond = static_cast<size_t>(format.estimatedBitrateKbps()) * 1000 / 8;
+    const size_t picture = static_cast<size_t>(std::max(format.width, 0)) * std::max(format.height, 0) * 3 / 2;
+    size_t frame = std::max(picture / KEYFRAME_RATIO, bytesPerSecond / fps * KEYFRAME_AVERAGE_FRAMES);
+    frame = (frame + FRAME_ALIGNMENT - 1) / FRAME_ALIGNMENT * FRAME_ALIGNMENT;
+    profile.maxFrameSize = std::min(std::max(frame, MIN_FRAME_SIZE), VideoAssembler::MAX_FRAME_SIZE);
+    profile.frameSlots = std::min(std::max(static_cast<size_t>(fps / 4), MIN_FRAME_SLOTS),
+                                  VideoAssembler::FRAME_SLOTS);
+
+    // Every queue at the arena minimum, video with a quarter second of
+    // stream but never more than the standard queue
+    const size_t minimum = QueueConfig::MIN_QUEUE_BYTES;
+    profile.dispatcher.audio.bytes = minimum;
+    profile.dispatcher.video.bytes = std::min(profile.dispatcher.video.bytes,
+                                              std::max(minimum, bytesPerSecond / 4));
+    profile.dispatcher.video.slots = 8;
+    profile.dispatcher.control.bytes = minimum;
+    profile.dispatcher.background.bytes = minimum;
+    profile.dispatcher.background.slots = 16;
+
+    profile.recordPool.smallSlabs = 64;
+    profile.recordPool.mediumSlabs = 16;
+    profile.recordPool.largeSlabs = 4;
+    return profile;
+}
+
+void setMemoryProfile(const MemoryProfile& profile) {
+    std::lock_guard<std::mutex> lock(profileMutex);
+    current = profile;
+    LOGI("Memory profile: lean=%d, %zu frame slots of %zu KB, video queue %zu KB",
+         profile.lean, profile.frameSlots, profile.maxFrameSize / 1024,
+         profile.dispatcher.video.bytes / 1024);
+}
+
+MemoryProfile memoryProfile() {
+    std::lock_guard<std::mutex> lock(profileMutex);
+    return current;
+}
+
+} // namespace aap
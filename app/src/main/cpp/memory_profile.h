@@ -0,0 +1,53 @@
+#pragma once
+
+#include "channel_dispatcher.h"
+#include "record_pool.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace aap {
+
+/**
+ * The video stream a session negotiated. The phone doesn't report a
+ * bitrate, 0 estimates one from the resolution and frame rate.
+ */
+struct VideoFormat {
+    int width = 0;
+    int height = 0;
+    int fps = 30;
+    int bitrateKbps = 0;
+
+    int estimatedBitrateKbps() const;
+};
+
+/**
+ * How much memory the native pools take: video frame slots, dispatcher
+ * queue arenas and the record pool.
+ *
+ * standard() keeps the fixed sizes that cover any stream up to 4K. lean()
+ * sizes everything from the negotiated video format instead, for head
+ * units with little RAM: frame slots from the largest keyframe the
+ * resolution plausibly produces, the video queue from a quarter second
+ * of the bitrate, the other queues and the pool from the minimums any
+ * record fits in.
+ */
+struct MemoryProfile {
+    bool lean = false;
+    size_t maxFrameSize;  // Bytes per video frame slot
+    size_t frameSlots;    // At most VideoAssembler::FRAME_SLOTS
+    DispatcherConfig dispatcher;
+    RecordPoolConfig recordPool;
+
+    static MemoryProfile standard();
+    static MemoryProfile leanFor(const VideoFormat& format);
+};
+
+/**
+ * Set the profile for pools created afterwards, call it before open().
+ * Safe to call from any thread; existing pools keep their size.
+ */
+void setMemoryProfile(const MemoryProfile& profile);
+
+MemoryProfile memoryProfile();
+
+} // namespace aap
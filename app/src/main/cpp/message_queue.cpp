@@ -0,0 +1,221 @@
+#include "message_queue.h"
+#include "futex.h"
+#include "streaming_memory.h"
+#include <cstring>
+#include <new>
+#include <time.h>
+
+namespace aap {
+
+namespace {
+
+size_t roundUpPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+} // anonymous namespace
+
+SpscMessageQueue::SpscMessageQueue(size_t slots, size_t arenaSize)
+    : slots_(new Slot[roundUpPowerOfTwo(slots)])
+    , slotMask_(roundUpPowerOfTwo(slots) - 1)
+    , arenaSize_(arenaSize)
+{
+    arena_ = allocateStreamingMemory(arenaSize);
+    if (!arena_) {
+        throw std::bad_alloc();
+    }
+}
+
+SpscMessageQueue::~SpscMessageQueue() {
+    freeStreamingMemory(arena_);
+}
+
+bool SpscMessageQueue::push(int channel, uint8_t flags, const uint8_t* data, size_t length,
+                            uint64_t timestampNs) {
+    if (shutdown_.load(std::memory_order_relaxed) || length > arenaSize_) {
+        return false;
+    }
+
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) > slotMask_) {
+        return false; // No free slot
+    }
+
+    // Payloads are contiguous: skip the arena tail if the message would wrap
+    uint64_t start = arenaHead_;
+    const size_t offset = start % arenaSize_;
+    if (offset + length > arenaSize_) {
+        start += arenaSize_ - offset;
+    }
+    if (start + length - arenaTail_.load(std::memory_order_acquire) > arenaSize_) {
+        return false; // Arena full
+    }
+
+    std::memcpy(arena_ + (start % arenaSize_), data, length);
+
+    Slot& slot = slots_[head & slotMask_];
+    slot.channel = channel;
+    slot.flags = flags;
+    slot.length = static_cast<uint32_t>(length);
+    slot.arenaStart = start;
+    slot.timestampNs = timestampNs;
+    arenaHead_ = start + length;
+
+    head_.store(head + 1, std::memory_order_release);
+
+    // Pairs with the fence in acquire(): either we see the consumer parked
+    // or the consumer sees the new head before sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting_.load(std::memory_order_relaxed)) {
+        wake();
+    }
+    return true;
+}
+
+bool SpscMessageQueue::pushFor(int channel, uint8_t flags, const uint8_t* data, size_t length,
+                               uint64_t timestampNs, uint64_t timeoutNs) {
+    const uint64_t deadline = timeoutNs == NO_TIMEOUT ? 0 : monotonicNs() + timeoutNs;
+    while (true) {
+        const uint64_t tail = tail_.load(std::memory_order_acquire);
+        if (push(channel, flags, data, length, timestampNs)) {
+            return true;
+        }
+        // Waiting can't help once shut down, or if it doesn't fit an empty queue
+        if (shutdown_.load(std::memory_order_acquire) || length > arenaSize_ ||
+            head_.load(std::memory_order_relaxed) == tail) {
+            return false;
+        }
+
+        struct timespec timeout;
+        const struct timespec* wait = nullptr;
+        if (deadline != 0) {
+            const uint64_t now = monotonicNs();
+            if (now >= deadline) {
+                return false;
+            }
+            timeout = relativeTimeout(deadline - now);
+            wait = &timeout;
+        }
+        parkProducer(tail, wait);
+    }
+}
+
+bool SpscMessageQueue::acquire(Message& msg) {
+    while (true) {
+        if (peek(msg)) {
+            return true;
+        }
+        if (shutdown_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        park(nullptr);
+    }
+}
+
+bool SpscMessageQueue::acquireFor(Message& msg, uint64_t timeoutNs) {
+    const uint64_t deadline = monotonicNs() + timeoutNs;
+    while (true) {
+        if (peek(msg)) {
+            return true;
+        }
+        if (shutdown_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        const uint64_t now = monotonicNs();
+        if (now >= deadline) {
+            return false;
+        }
+        const struct timespec timeout = relativeTimeout(deadline - now);
+        park(&timeout);
+    }
+}
+
+bool SpscMessageQueue::peek(Message& msg) const {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) {
+        return false;
+    }
+    const Slot& slot = slots_[tail & slotMask_];
+    msg.channel = slot.channel;
+    msg.flags = slot.flags;
+    msg.data = arena_ + (slot.arenaStart % arenaSize_);
+    msg.length = slot.length;
+    msg.timestampNs = slot.timestampNs;
+    return true;
+}
+
+// Sleep until push() or shutdown() wakes us, or the relative timeout passes
+void SpscMessageQueue::park(const struct timespec* timeout) {
+    const uint32_t seq = wakeSeq_.load(std::memory_order_acquire);
+    waiting_.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in push()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (isEmpty() && !shutdown_.load(std::memory_order_acquire)) {
+        futexWait(wakeSeq_, seq, timeout);
+    }
+    waiting_.store(false, std::memory_order_relaxed);
+}
+
+// Sleep until release() frees what tail held, shutdown(), or the relative timeout passes
+void SpscMessageQueue::parkProducer(uint64_t tail, const struct timespec* timeout) {
+    const uint32_t seq = spaceSeq_.load(std::memory_order_acquire);
+    producerWaiting_.store(true, std::memory_order_relaxed);
+    // Pairs with the fence in release()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (tail_.load(std::memory_order_acquire) == tail && !shutdown_.load(std::memory_order_acquire)) {
+        futexWait(spaceSeq_, seq, timeout);
+    }
+    producerWaiting_.store(false, std::memory_order_relaxed);
+}
+
+void SpscMessageQueue::release() {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const Slot& slot = slots_[tail & slotMask_];
+    arenaTail_.store(slot.arenaStart + slot.length, std::memory_order_release);
+    tail_.store(tail + 1, std::memory_order_release);
+
+    // Either we see the producer parked or it sees the new tail before sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (producerWaiting_.load(std::memory_order_relaxed)) {
+        wakeProducer();
+    }
+}
+
+void SpscMessageQueue::shutdown() {
+    shutdown_.store(true, std::memory_order_release);
+    wake();
+    wakeProducer();
+}
+
+size_t SpscMessageQueue::size() const {
+    return static_cast<size_t>(head_.load(std::memory_order_acquire) -
+                               tail_.load(std::memory_order_acquire));
+}
+
+bool SpscMessageQueue::isEmpty() const {
+    return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_relaxed);
+}
+
+void SpscMessageQueue::wake() {
+    wakeSeq_.fetch_add(1, std::memory_order_release);
+    futexWake(wakeSeq_);
+}
+
+void SpscMessageQueue::wakeProducer() {
+    spaceSeq_.fetch_add(1, std::memory_order_release);
+    futexWake(spaceSeq_);
+}
+
+} // namespace aap
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace aap {
+
+/**
+ * Lock-free Single-Producer Single-Consumer queue of AAP messages.
+ *
+ * Message descriptors live in a fixed power-of-two slot array and payloads
+ * are copied into a pre-sized byte arena, so push() never allocates.
+ * The consumer reads payloads in place and returns them with release().
+ *
+ * The consumer parks on a futex only when the queue is empty, and the
+ * producer issues a wake syscall only while the consumer is parked.
+ * pushFor() parks the producer the same way until release() frees room.
+ */
+class SpscMessageQueue {
+public:
+    /**
+     * View of a queued message, valid until release().
+     */
+    struct Message {
+        int channel;
+        uint8_t flags;
+        const uint8_t* data;
+        size_t length;
+        uint64_t timestampNs;  // As passed to push()
+    };
+
+    /**
+     * @param slots Maximum number of queued messages (rounded up to a power of two)
+     * @param arenaSize Total payload bytes that can be queued at once
+     */
+    SpscMessageQueue(size_t slots, size_t arenaSize);
+    ~SpscMessageQueue();
+
+    // Non-copyable
+    SpscMessageQueue(const SpscMessageQueue&) = delete;
+    SpscMessageQueue& operator=(const SpscMessageQueue&) = delete;
+
+    /**
+     * Copy a message into the queue (producer side).
+     * @param timestampNs Opaque enqueue time handed back with the message
+     * @return false if the queue or arena is full (message dropped)
+     */
+    bool push(int channel, uint8_t flags, const uint8_t* data, size_t length,
+              uint64_t timestampNs = 0);
+
+    static constexpr uint64_t NO_TIMEOUT = UINT64_MAX;
+
+    /**
+     * Copy a message into the queue, waiting at most timeoutNs for room
+     * (producer side). NO_TIMEOUT waits until shutdown().
+     * @return false if there is still no room, or the queue was shut down
+     */
+    bool pushFor(int channel, uint8_t flags, const uint8_t* data, size_t length,
+                 uint64_t timestampNs, uint64_t timeoutNs);
+
+    /**
+     * Wait for the next message (consumer side).
+     * @return false once the queue is shut down and drained
+     */
+    bool acquire(Message& msg);
+
+    /**
+     * Wait at most timeoutNs for the next message (consumer side).
+     * @return false on timeout, or once the queue is shut down and drained
+     */
+    bool acquireFor(Message& msg, uint64_t timeoutNs);
+
+    /**
+     * Take the next message without waiting (consumer side). The consumer
+     * may change threads between messages if the handover orders them.
+     * @return false if the queue is empty
+     */
+    bool tryAcquire(Message& msg) { return peek(msg); }
+
+    /**
+     * Return the message obtained by acquire() (consumer side).
+     */
+    void release();
+
+    /**
+     * Wake the consumer and make acquire() fail once drained.
+     */
+    void shutdown();
+
+    /**
+     * Number of queued messages.
+     */
+    size_t size() const;
+
+    size_t capacity() const { return slotMask_ + 1; }
+
+private:
+    struct Slot {
+        int channel;
+        uint8_t flags;
+        uint32_t length;
+        uint64_t arenaStart;  // Monotonic arena index of the payload
+        uint64_t timestampNs;
+    };
+
+    std::unique_ptr<Slot[]> slots_;
+    size_t slotMask_;
+    uint8_t* arena_;
+    size_t arenaSize_;
+
+    // Producer side
+    alignas(64) std::atomic<uint64_t> head_{0};
+    uint64_t arenaHead_ = 0;
+
+    // Consumer side
+    alignas(64) std::atomic<uint64_t> tail_{0};
+    std::atomic<uint64_t> arenaTail_{0};
+
+    // Parking
+    alignas(64) std::atomic<uint32_t> wakeSeq_{0};
+    std::atomic<bool> waiting_{false};
+    std::atomic<bool> shutdown_{false};
+    // A producer waiting in pushFor(), woken by release()
+    alignas(64) std::atomic<uint32_t> spaceSeq_{0};
+    std::atomic<bool> producerWaiting_{false};
+
+    bool isEmpty() const;
+    bool peek(Message& msg) const;
+    void park(const struct timespec* timeout);
+    void parkProducer(uint64_t tail, const struct timespec* timeout);
+    void wake();
+    void wakeProducer();
+};
+
+} // namespace aap
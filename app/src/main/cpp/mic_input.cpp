@@ -0,0 +1,266 @@
+#include "mic_input.h"
+#include "aaudio_api.h"
+#include "aap_message.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <pthread.h>
+#include <time.h>
+#include <algorithm>
+#include <cerrno>
+
+#define LOG_TAG "MicInput"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+constexpr uint8_t MIC_RECORD_FLAGS = 0x0b;
+constexpr int WAIT_TIMEOUT_MS = 100;
+constexpr size_t MAX_CAPTURE_CHANNELS = 2;
+
+// SystemClock.elapsedRealtime()
+uint64_t elapsedRealtimeMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+} // anonymous namespace
+
+MicInput::MicInput(int sampleRate)
+    : sampleRate_(sampleRate)
+    , chunkBytes_(static_cast<size_t>(sampleRate) * sizeof(int16_t) * CHUNK_MS / 1000)
+    , ring_(static_cast<size_t>(std::max(sampleRate, MAX_CAPTURE_RATE)) * MAX_CAPTURE_CHANNELS
+            * sizeof(int16_t) * RING_MS / 1000)
+    , record_(new uint8_t[RECORD_HEADER_SIZE + chunkBytes_])
+    , deviceChunkBytes_(chunkBytes_)
+    , chunkFrames_(chunkBytes_ / sizeof(int16_t))
+{
+    // One record's worth of capture at the highest rate accepted
+    const size_t maxCaptureFrames = chunkFrames_ * static_cast<size_t>(std::max(sampleRate, MAX_CAPTURE_RATE))
+                                    / static_cast<size_t>(sampleRate) + LinearResampler::HISTORY_FRAMES * 2;
+    capture_.reset(new int16_t[maxCaptureFrames * MAX_CAPTURE_CHANNELS]);
+    samples_.reset(new float[std::max(maxCaptureFrames * MAX_CAPTURE_CHANNELS, chunkFrames_)]);
+    sem_init(&dataReady_, 0, 0);
+}
+
+MicInput::~MicInput() {
+    stop();
+    sem_destroy(&dataReady_);
+}
+
+void MicInput::setRecordCallback(MicRecordCallback callback) {
+    callback_ = std::move(callback);
+}
+
+bool MicInput::start() {
+    if (running_.load(std::memory_order_acquire)) {
+        return true;
+    }
+    if (!openStream()) {
+        return false;
+    }
+    running_.store(true, std::memory_order_release);
+    thread_ = std::thread(&MicInput::senderLoop, this);
+    LOGI("Mic input started: %d Hz, burst %d frames", sampleRate_, framesPerBurst_);
+    return true;
+}
+
+void MicInput::stop() {
+    if (!running_.exchange(false, std::memory_order_acq_rel)) {
+        return;
+    }
+    sem_post(&dataReady_);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    closeStream();
+    // Neither side runs any more
+    ring_.clear();
+    if (resampler_) {
+        resampler_->reset();
+    }
+    while (sem_trywait(&dataReady_) == 0) {
+    }
+    LOGI("Mic input stopped");
+}
+
+bool MicInput::openStream() {
+    const AAudioApi& api = aaudioApi();
+    if (!api.available) {
+        LOGD("AAudio unavailable, no native mic input");
+        return false;
+    }
+
+    AAudioStreamBuilder* builder = nullptr;
+    if (api.createStreamBuilder(&builder) != AAUDIO_OK) {
+        return false;
+    }
+    api.setDirection(builder, AAUDIO_DIRECTION_INPUT);
+    api.setFormat(builder, AAUDIO_FORMAT_PCM_I16);
+    api.setChannelCount(builder, 1);
+    api.setSampleRate(builder, sampleRate_);
+    api.setPerformanceMode(builder, AAUDIO_PERFORMANCE_MODE_LOW_LATENCY);
+    // Shared: an exclusive input would lock out the phone call path
+    api.setSharingMode(builder, AAUDIO_SHARING_MODE_SHARED);
+    api.setInputPreset(builder, AAUDIO_INPUT_PRESET_VOICE_RECOGNITION);
+    api.setDataCallback(builder, &MicInput::onAAudioData, this);
+    api.setErrorCallback(builder, &MicInput::onAAudioError, this);
+
+    AAudioStream* stream = nullptr;
+    const aaudio_result_t result = api.openStream(builder, &stream);
+    api.deleteBuilder(builder);
+    if (result != AAUDIO_OK) {
+        LOGE("AAudio input openStream failed (%d)", result);
+        return false;
+    }
+    const int rate = api.getSampleRate(stream);
+    const int channels = api.getChannelCount(stream);
+    if (rate <= 0 || rate > std::max(sampleRate_, MAX_CAPTURE_RATE) ||
+        channels < 1 || channels > static_cast<int>(MAX_CAPTURE_CHANNELS)) {
+        LOGE("AAudio input opened at %d Hz, %d channels, unusable", rate, channels);
+        api.close(stream);
+        return false;
+    }
+    if (rate != deviceRate_ || static_cast<size_t>(channels) != deviceChannels_) {
+        // No callback runs: start() or the reopen closed the previous stream
+        ring_.clear();
+        deviceRate_ = rate;
+        deviceChannels_ = static_cast<size_t>(channels);
+        deviceFrameBytes_ = deviceChannels_ * sizeof(int16_t);
+        deviceChunkBytes_ = static_cast<size_t>(rate) * deviceFrameBytes_ * CHUNK_MS / 1000;
+        resampler_.reset();
+        if (rate != sampleRate_ || channels != 1) {
+            LOGI("Mic input captured at %d Hz, %d channels, converted to %d Hz mono", rate, channels, sampleRate_);
+            resampler_.reset(new LinearResampler(1, chunkFrames_,
+                                                 static_cast<double>(rate) / sampleRate_));
+            resampler_->setRatio(static_cast<double>(rate) / sampleRate_);
+        }
+    }
+
+    framesPerBurst_ = api.getFramesPerBurst(stream);
+    if (api.requestStart(stream) != AAUDIO_OK) {
+        LOGE("AAudio input requestStart failed");
+        api.close(stream);
+        return false;
+    }
+    stream_ = stream;
+    return true;
+}
+
+void MicInput::closeStream() {
+    if (!stream_) {
+        return;
+    }
+    const AAudioApi& api = aaudioApi();
+    api.requestStop(stream_);
+    // Waits for a callback in progress
+    api.close(stream_);
+    stream_ = nullptr;
+}
+
+aaudio_data_callback_result_t MicInput::onAAudioData(AAudioStream* stream, void* userData,
+                                                     void* audioData, int32_t numFrames) {
+    auto* self = static_cast<MicInput*>(userData);
+    const size_t length = static_cast<size_t>(numFrames) * self->deviceFrameBytes_;
+    const size_t written = self->ring_.write(static_cast<const uint8_t*>(audioData), length);
+    self->bytesCaptured_.fetch_add(written, std::memory_order_relaxed);
+    if (written < length) {
+        self->bytesDropped_.fetch_add(length - written, std::memory_order_relaxed);
+    }
+    if (self->ring_.available() >= self->deviceChunkBytes_) {
+        sem_post(&self->dataReady_);
+    }
+    return AAUDIO_CALLBACK_RESULT_CONTINUE;
+}
+
+void MicInput::onAAudioError(AAudioStream* stream, void* userData, aaudio_result_t error) {
+    LOGE("AAudio input error (%d)", error);
+    // The stream can't be closed from its own callback thread
+    auto* self = static_cast<MicInput*>(userData);
+    self->disconnected_.store(true, std::memory_order_release);
+    sem_post(&self->dataReady_);
+}
+
+void MicInput::senderLoop() {
+    applyThreadPolicy("AAP-Mic");
+
+    record_[0] = static_cast<uint8_t>(Channel::ID_MIC);
+    record_[1] = MIC_RECORD_FLAGS;
+    while (running_.load(std::memory_order_acquire)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += WAIT_TIMEOUT_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (sem_timedwait(&dataReady_, &deadline) != 0 && errno == EINTR) {
+        }
+
+        if (disconnected_.exchange(false, std::memory_order_acq_rel)) {
+            // Input route changed: reopen on the new device
+            closeStream();
+            reopens_.fetch_add(1, std::memory_order_relaxed);
+            if (!openStream()) {
+                LOGE("Mic input lost");
+            }
+        }
+
+        while (readChunk(reinterpret_cast<int16_t*>(record_.get() + RECORD_HEADER_SIZE))) {
+            uint64_t time = elapsedRealtimeMs();
+            for (int i = 9; i >= 2; i--) {
+                record_[i] = static_cast<uint8_t>(time & 0xFF);
+                time >>= 8;
+            }
+            if (callback_) {
+                callback_(record_.get(), RECORD_HEADER_SIZE + chunkBytes_);
+            }
+            recordsSent_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+}
+
+// One record of requested-format PCM, if enough has been captured
+bool MicInput::readChunk(int16_t* out) {
+    if (!resampler_) {
+        if (ring_.available() < chunkBytes_) {
+            return false;
+        }
+        ring_.read(reinterpret_cast<uint8_t*>(out), chunkBytes_);
+        return true;
+    }
+
+    const size_t needed = resampler_->inputFrames(chunkFrames_);
+    const size_t length = needed * deviceFrameBytes_;
+    if (ring_.available() < length) {
+        return false;
+    }
+    ring_.read(reinterpret_cast<uint8_t*>(capture_.get()), length);
+    float* input = resampler_->input();
+    if (deviceChannels_ == 2) {
+        AudioDsp::pcmToFloat(capture_.get(), samples_.get(), needed * 2);
+        AudioDsp::stereoToMono(samples_.get(), input, needed);
+    } else {
+        AudioDsp::pcmToFloat(capture_.get(), input, needed);
+    }
+    resampler_->process(samples_.get(), chunkFrames_);
+    AudioDsp::floatToPcm(samples_.get(), out, chunkFrames_);
+    return true;
+}
+
+MicInput::Stats MicInput::getStats() const {
+    Stats stats;
+    stats.bytesCaptured = bytesCaptured_.load(std::memory_order_relaxed);
+    stats.bytesDropped = bytesDropped_.load(std::memory_order_relaxed);
+    stats.recordsSent = recordsSent_.load(std::memory_order_relaxed);
+    stats.reopens = reopens_.load(std::memory_order_relaxed);
+    stats.framesPerBurst = framesPerBurst_;
+    stats.deviceRate = deviceRate_;
+    return stats;
+}
+
+} // namespace aap
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "audio_dsp.h"
+#include "ring_buffer.h"
+#include <aaudio/AAudio.h>
+#include <semaphore.h>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <thread>
+
+namespace aap {
+
+/**
+ * Callback with one framed ID_MIC record, ready for encryption.
+ * Parameters: record pointer, record length. The record is reused once
+ * the callback returns.
+ */
+using MicRecordCallback = std::function<void(const uint8_t* record, size_t length)>;
+
+/**
+ * Native microphone uplink: an AAudio input stream writes 16-bit mono
+ * PCM into a pre-sized ring from its callback, and the AAP-Mic thread
+ * frames it into CHUNK_MS ID_MIC records.
+ *
+ * Capture never waits for the uplink, so a stalled consumer (GC, a slow
+ * write) only delays records instead of losing audio, up to RING_MS.
+ * If the device captures at another rate than the phone asked for, or
+ * in stereo, the AAP-Mic thread downmixes and resamples each record
+ * through AudioDsp rather than giving up on the native path.
+ * Requires AAudio (API 28+); start() fails otherwise and the Java
+ * MicRecorder has to be used.
+ */
+class MicInput {
+public:
+    static constexpr int CHUNK_MS = 20;
+    static constexpr int RING_MS = 500;
+    static constexpr int MAX_CAPTURE_RATE = 48000;
+    // Channel, flags and an 8-byte timestamp, as AapTransport.onMicDataAvailable() lays them out
+    static constexpr size_t RECORD_HEADER_SIZE = 10;
+
+    explicit MicInput(int sampleRate);
+    ~MicInput();
+
+    // Non-copyable
+    MicInput(const MicInput&) = delete;
+    MicInput& operator=(const MicInput&) = delete;
+
+    /**
+     * Must be called before start().
+     */
+    void setRecordCallback(MicRecordCallback callback);
+
+    /**
+     * Open the input stream and start the AAP-Mic thread.
+     * @return false if AAudio is unavailable or the stream can't be opened
+     */
+    bool start();
+    void stop();
+
+    bool isRunning() const { return running_.load(std::memory_order_acquire); }
+    int sampleRate() const { return sampleRate_; }
+
+    struct Stats {
+        uint64_t bytesCaptured;
+        uint64_t bytesDropped;      // Ring full, the uplink is behind
+        uint64_t recordsSent;
+        uint64_t reopens;           // Stream reopened after a disconnect
+        int32_t framesPerBurst;
+        int32_t deviceRate;         // Resampled to sampleRate() when different
+    };
+    Stats getStats() const;
+
+private:
+    const int sampleRate_;
+    const size_t chunkBytes_;
+    RingBuffer ring_;
+    std::unique_ptr<uint8_t[]> record_;
+
+    // Capture format, set before the stream starts
+    int deviceRate_ = 0;
+    size_t deviceChannels_ = 1;
+    size_t deviceFrameBytes_ = sizeof(int16_t);
+    size_t deviceChunkBytes_;
+    size_t chunkFrames_;
+    std::unique_ptr<LinearResampler> resampler_;    // Null while the format matches
+    std::unique_ptr<int16_t[]> capture_;
+    std::unique_ptr<float[]> samples_;
+
+    MicRecordCallback callback_;
+    AAudioStream* stream_ = nullptr;
+    std::atomic<bool> disconnected_{false};
+    int32_t framesPerBurst_ = 0;
+
+    // Posted from the audio callback, sem_post is safe there
+    sem_t dataReady_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+
+    std::atomic<uint64_t> bytesCaptured_{0};
+    std::atomic<uint64_t> bytesDropped_{0};
+    std::atomic<uint64_t> recordsSent_{0};
+    std::atomic<uint64_t> reopens_{0};
+
+    bool openStream();
+    void closeStream();
+    void senderLoop();
+    bool readChunk(int16_t* out);
+
+    static aaudio_data_callback_result_t onAAudioData(AAudioStream* stream, void* userData,
+                                                      void* audioData, int32_t numFrames);
+    static void onAAudioError(AAudioStream* stream, void* userData, aaudio_result_t error);
+};
+
+} // namespace aap
@@ -0,0 +1,111 @@
+#include "nal_scanner.h"
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define AAP_NAL_SCAN_NEON 1
+#endif
+
+namespace aap {
+
+namespace {
+
+size_t findStartCodeScalar(const uint8_t* data, size_t pos, size_t end) {
+    while (pos + 3 <= end) {
+        const void* one = std::memchr(data + pos + 2, 1, end - pos - 2);
+        if (!one) {
+            return end;
+        }
+        const size_t i = static_cast<const uint8_t*>(one) - data;
+        if (data[i - 1] == 0 && data[i - 2] == 0) {
+            return i - 2;
+        }
+        pos = i - 1;
+    }
+    return end;
+}
+
+#ifdef AAP_NAL_SCAN_NEON
+
+// Index of the first non-zero byte lane, the mask has at least one
+inline size_t firstSetLane(uint8x16_t mask) {
+    const uint64x2_t lanes = vreinterpretq_u64_u8(mask);
+    const uint64_t low = vgetq_lane_u64(lanes, 0);
+    if (low) {
+        return static_cast<size_t>(__builtin_ctzll(low)) / 8;
+    }
+    return 8 + static_cast<size_t>(__builtin_ctzll(vgetq_lane_u64(lanes, 1))) / 8;
+}
+
+inline bool anySet(uint8x16_t mask) {
+#if defined(__aarch64__)
+    return vmaxvq_u8(mask) != 0;
+#else
+    const uint64x2_t lanes = vreinterpretq_u64_u8(mask);
+    return (vgetq_lane_u64(lanes, 0) | vgetq_lane_u64(lanes, 1)) != 0;
+#endif
+}
+
+size_t findStartCodeNeon(const uint8_t* data, size_t pos, size_t end) {
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+
+    // Test 16 candidate positions at once: b[i] == 0, b[i+1] == 0, b[i+2] == 1
+    while (pos + 18 <= end) {
+        const uint8x16_t b0 = vld1q_u8(data + pos);
+        const uint8x16_t b1 = vld1q_u8(data + pos + 1);
+        const uint8x16_t b2 = vld1q_u8(data + pos + 2);
+        const uint8x16_t match = vandq_u8(vandq_u8(vceqq_u8(b0, zero), vceqq_u8(b1, zero)),
+                                          vceqq_u8(b2, one));
+        if (anySet(match)) {
+            return pos + firstSetLane(match);
+        }
+        pos += 16;
+    }
+    return findStartCodeScalar(data, pos, end);
+}
+
+#endif
+
+} // anonymous namespace
+
+size_t NalScanner::findStartCode(const uint8_t* data, size_t pos, size_t end) {
+#ifdef AAP_NAL_SCAN_NEON
+    return findStartCodeNeon(data, pos, end);
+#else
+    return findStartCodeScalar(data, pos, end);
+#endif
+}
+
+size_t NalScanner::scan(const uint8_t* data, size_t length, VideoCodec codec,
+                        NalUnit* units, size_t maxUnits) {
+    size_t count = 0;
+    size_t pos = findStartCode(data, 0, length);
+    while (count < maxUnits && pos + 3 < length) {
+        const size_t nal = pos + 3;
+        const size_t next = findStartCode(data, nal, length);
+
+        // Trailing zeros before a 4-byte start code belong to the next NAL
+        size_t nalEnd = next;
+        while (nalEnd > nal && data[nalEnd - 1] == 0) {
+            nalEnd--;
+        }
+
+        units[count].offset = static_cast<uint32_t>(nal);
+        units[count].length = static_cast<uint32_t>(nalEnd - nal);
+        units[count].type = nalType(codec, data[nal]);
+        count++;
+        pos = next;
+    }
+    return count;
+}
+
+bool NalScanner::isSimdAccelerated() {
+#ifdef AAP_NAL_SCAN_NEON
+    return true;
+#else
+    return false;
+#endif
+}
+
+} // namespace aap
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace aap {
+
+enum class VideoCodec {
+    H264,
+    H265
+};
+
+/**
+ * One NAL unit found in an Annex-B buffer.
+ */
+struct NalUnit {
+    uint32_t offset;    // NAL header, the byte after the start code
+    uint32_t length;    // Up to the next start code, trailing zeros excluded
+    int type;
+};
+
+/**
+ * Annex-B start code scanner.
+ *
+ * Looks for 00 00 01 sixteen bytes at a time with NEON where the ABI has
+ * it (arm64-v8a, and armeabi-v7a which the NDK builds with NEON), and
+ * falls back to a memchr-driven scalar loop elsewhere. A 4-byte start
+ * code is reported as the 3-byte one after its leading zero.
+ */
+class NalScanner {
+public:
+    /**
+     * Find the next 00 00 01 at or after pos.
+     * @return Offset of its first byte, or end if there is none
+     */
+    static size_t findStartCode(const uint8_t* data, size_t pos, size_t end);
+
+    /**
+     * Find all NAL units in one pass.
+     * @param units Receives up to maxUnits entries
+     * @return Number of units stored
+     */
+    static size_t scan(const uint8_t* data, size_t length, VideoCodec codec,
+                       NalUnit* units, size_t maxUnits);
+
+    /**
+     * NAL unit type from the first header byte.
+     */
+    static int nalType(VideoCodec codec, uint8_t header) {
+        return codec == VideoCodec::H265 ? (header >> 1) & 0x3f : header & 0x1f;
+    }
+
+    /**
+     * Check if the NEON scanner is compiled in.
+     */
+    static bool isSimdAccelerated();
+};
+
+} // namespace aap
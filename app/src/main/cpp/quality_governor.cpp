@@ -0,0 +1,290 @@
+#include "quality_governor.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <dlfcn.h>
+
+#define LOG_TAG "QualityGovernor"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+
+// Opaque, <android/thermal.h> only declares it from API 30
+struct AThermalManager;
+
+namespace aap {
+
+namespace {
+
+// AThermal_acquireManager and AThermal_getCurrentThermalStatus are API 30
+using AcquireThermalManagerFn = AThermalManager* (*)();
+using GetThermalStatusFn = int (*)(AThermalManager*);
+
+struct ThermalApi {
+    AThermalManager* manager = nullptr;
+    GetThermalStatusFn getStatus = nullptr;
+};
+
+// The manager is acquired once and kept for the life of the process
+const ThermalApi& thermalApi() {
+    static const ThermalApi api = [] {
+        ThermalApi result;
+        void* lib = dlopen("libandroid.so", RTLD_NOW);
+        if (!lib) {
+            return result;
+        }
+        auto acquire = reinterpret_cast<AcquireThermalManagerFn>(dlsym(lib, "AThermal_acquireManager"));
+        auto getStatus = reinterpret_cast<GetThermalStatusFn>(dlsym(lib, "AThermal_getCurrentThermalStatus"));
+        if (acquire && getStatus) {
+            result.manager = acquire();
+            result.getStatus = result.manager ? getStatus : nullptr;
+        }
+        return result;
+    }();
+    return api;
+}
+
+// Zones are numbered from 0 without gaps
+constexpr int MAX_THERMAL_ZONES = 64;
+// Readings outside this are a sensor that isn't wired up, millidegrees Celsius
+constexpr int MIN_ZONE_TEMP = 1;
+constexpr int MAX_ZONE_TEMP = 200000;
+
+// Hottest zone to AThermalStatus, roughly where SoC thermal HALs start
+// throttling. A zone is no skin temperature, so these err on the warm side
+constexpr int ZONE_STATUS_TEMPS[] = {
+    50000,  // THERMAL_STATUS_LIGHT
+    60000,  // THERMAL_STATUS_MODERATE
+    70000,  // THERMAL_STATUS_SEVERE
+    80000,  // THERMAL_STATUS_CRITICAL
+    90000,  // THERMAL_STATUS_EMERGENCY
+};
+
+/**
+ * Hottest readable /sys/class/thermal zone.
+ * SELinux denies the zones to apps on many releases.
+ */
+bool hottestZone(int& milliCelsius) {
+    bool found = false;
+    for (int zone = 0; zone < MAX_THERMAL_ZONES; zone++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/class/thermal/thermal_zone%d/temp", zone);
+        FILE* file = fopen(path, "r");
+        if (!file) {
+            if (errno == ENOENT) {
+                break;
+            }
+            continue;
+        }
+        int temp = 0;
+        const bool ok = fscanf(file, "%d", &temp) == 1;
+        fclose(file);
+        if (ok && temp >= MIN_ZONE_TEMP && temp <= MAX_ZONE_TEMP) {
+            milliCelsius = found ? std::max(milliCelsius, temp) : temp;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// Service discovery always asks for 30 fps
+constexpr uint64_t FRAME_INTERVAL_US = 1000000 / 30;
+// Video queue this full means the consumer is falling behind
+constexpr uint32_t BUSY_QUEUE_FILL = 50;
+// Share of an interval the USB thread may wait on the background queue
+constexpr uint64_t BLOCKED_SHARE_DIVISOR = 10;
+
+int levelValue(QualityLevel level) {
+    return static_cast<int>(level);
+}
+
+} // anonymous namespace
+
+QualityGovernor::QualityGovernor(int intervalMs)
+    : interval_(intervalMs > 0 ? intervalMs : DEFAULT_INTERVAL_MS)
+{
+    stats_.thermalStatus = THERMAL_UNKNOWN;
+}
+
+QualityGovernor::~QualityGovernor() {
+    stop();
+}
+
+void QualityGovernor::setSampler(GovernorSampler sampler) {
+    sampler_ = std::move(sampler);
+}
+
+void QualityGovernor::setCallback(GovernorCallback callback) {
+    callback_ = std::move(callback);
+}
+
+void QualityGovernor::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    haveLast_ = false;
+    calmSamples_ = 0;
+    stats_ = Stats{};
+    stats_.thermalStatus = THERMAL_UNKNOWN;
+    thread_ = std::thread(&QualityGovernor::governorLoop, this);
+    LOGD("Quality governor started, interval %lld ms", static_cast<long long>(interval_.count()));
+}
+
+void QualityGovernor::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+int QualityGovernor::thermalStatus(ThermalSource* source) {
+    const ThermalApi& api = thermalApi();
+    if (api.getStatus) {
+        const int status = api.getStatus(api.manager);
+        if (status >= THERMAL_NONE) {
+            if (source) *source = ThermalSource::THERMAL_API;
+            return std::min(status, THERMAL_SHUTDOWN);
+        }
+    }
+
+    int milliCelsius = 0;
+    if (hottestZone(milliCelsius)) {
+        int status = THERMAL_NONE;
+        for (const int temp : ZONE_STATUS_TEMPS) {
+            if (milliCelsius >= temp) status++;
+        }
+        if (source) *source = ThermalSource::SYSFS;
+        return status;
+    }
+
+    if (source) *source = ThermalSource::NONE;
+    return THERMAL_UNKNOWN;
+}
+
+QualityLevel QualityGovernor::thermalLevel(int status) {
+    // THERMAL_STATUS_LIGHT is UX-only throttling, nothing to do for us yet
+    switch (status) {
+        case 2: return QualityLevel::ELEVATED;  // MODERATE
+        case 3: return QualityLevel::HIGH;      // SEVERE
+        case 4: case 5: case 6: return QualityLevel::CRITICAL;
+        default: return QualityLevel::NOMINAL;
+    }
+}
+
+size_t QualityGovernor::decryptWorkers(QualityLevel level, size_t started) {
+    switch (level) {
+        case QualityLevel::HIGH: return std::max<size_t>((started + 1) / 2, 1);
+        case QualityLevel::CRITICAL: return 1;
+        default: return started;
+    }
+}
+
+int QualityGovernor::resolutionSteps(QualityLevel level) {
+    switch (level) {
+        case QualityLevel::HIGH: return 1;
+        case QualityLevel::CRITICAL: return 2;
+        default: return 0;
+    }
+}
+
+QualityLevel QualityGovernor::level() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return static_cast<QualityLevel>(stats_.level);
+}
+
+QualityLevel QualityGovernor::loadLevel(const GovernorSample& sample, uint64_t decodeAvgUs) const {
+    const uint64_t drops = haveLast_ ? sample.videoDrops - last_.videoDrops : 0;
+    const uint64_t blockedNs = haveLast_ ? sample.backgroundBlockedNs - last_.backgroundBlockedNs : 0;
+    const uint64_t intervalNs = static_cast<uint64_t>(interval_.count()) * 1000000;
+
+    // Frames lost, or decoding slower than they arrive
+    if (drops > 0 || decodeAvgUs > FRAME_INTERVAL_US) {
+        return QualityLevel::HIGH;
+    }
+    if (sample.videoQueueFill >= BUSY_QUEUE_FILL || decodeAvgUs > FRAME_INTERVAL_US / 2 ||
+        blockedNs > intervalNs / BLOCKED_SHARE_DIVISOR) {
+        return QualityLevel::ELEVATED;
+    }
+    return QualityLevel::NOMINAL;
+}
+
+QualityLevel QualityGovernor::evaluate(QualityLevel target, QualityLevel current) {
+    if (target > current) {
+        calmSamples_ = 0;
+        return target;
+    }
+    if (target == current) {
+        calmSamples_ = 0;
+        return current;
+    }
+    if (++calmSamples_ < COOLDOWN_SAMPLES) {
+        return current;
+    }
+    calmSamples_ = 0;
+    return static_cast<QualityLevel>(levelValue(current) - 1);
+}
+
+void QualityGovernor::governorLoop() {
+    applyThreadPolicy("AAP-Governor");
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        lock.unlock();
+        ThermalSource source = ThermalSource::NONE;
+        const int thermal = thermalStatus(&source);
+        const GovernorSample sample = sampler_ ? sampler_() : GovernorSample{};
+
+        uint64_t decodeAvgUs = 0;
+        if (haveLast_ && sample.framesDecoded > last_.framesDecoded) {
+            decodeAvgUs = (sample.decodeTotalUs - last_.decodeTotalUs) /
+                          (sample.framesDecoded - last_.framesDecoded);
+        }
+        const QualityLevel load = loadLevel(sample, decodeAvgUs);
+        last_ = sample;
+        haveLast_ = true;
+
+        const QualityLevel target = std::max(thermalLevel(thermal), load);
+        lock.lock();
+        const QualityLevel current = static_cast<QualityLevel>(stats_.level);
+        const QualityLevel next = evaluate(target, current);
+        stats_.samples++;
+        stats_.thermalStatus = thermal;
+        stats_.thermalSource = static_cast<int>(source);
+        stats_.loadLevel = levelValue(load);
+        stats_.videoQueueFill = sample.videoQueueFill;
+        stats_.decodeAvgUs = decodeAvgUs;
+
+        if (next != current) {
+            stats_.level = levelValue(next);
+            stats_.maxLevel = std::max(stats_.maxLevel, stats_.level);
+            stats_.levelChanges++;
+            lock.unlock();
+            LOGI("Quality level %d -> %d: thermal %d (source %d), load %d, video queue %u%%, decode %llu us",
+                 levelValue(current), levelValue(next), thermal, static_cast<int>(source),
+                 levelValue(load), sample.videoQueueFill, static_cast<unsigned long long>(decodeAvgUs));
+            if (callback_) {
+                callback_(next);
+            }
+            lock.lock();
+        }
+
+        wake_.wait_for(lock, interval_, [this] { return !running_; });
+    }
+}
+
+QualityGovernor::Stats QualityGovernor::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace aap
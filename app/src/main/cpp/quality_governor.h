@@ -0,0 +1,158 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace aap {
+
+/**
+ * How hard the pipeline has to back off, from thermal status and load.
+ */
+enum class QualityLevel : int {
+    NOMINAL = 0,    // Full quality
+    ELEVATED = 1,   // Background records are shed instead of waited for
+    HIGH = 2,       // Half the decrypt workers, next session one resolution down
+    CRITICAL = 3,   // One decrypt worker, next session two resolutions down
+};
+
+/**
+ * One look at the pipeline. Counters are running totals, the governor
+ * works on the difference between samples.
+ */
+struct GovernorSample {
+    uint32_t videoQueueFill = 0;    // Percent of the video queue's slots
+    uint64_t videoDrops = 0;        // Records the full video queue discarded
+    uint64_t backgroundBlockedNs = 0; // dispatch() waiting for room in the background queue
+    uint64_t framesDecoded = 0;     // 0 without a native decoder
+    uint64_t decodeTotalUs = 0;     // Queued to the codec until output, over framesDecoded
+};
+
+/**
+ * Called on the governor thread for each sample.
+ */
+using GovernorSampler = std::function<GovernorSample()>;
+
+/**
+ * Called on the governor thread whenever the level changes.
+ */
+using GovernorCallback = std::function<void(QualityLevel level)>;
+
+/**
+ * Thermal- and load-aware quality governor.
+ *
+ * Once per interval it reads the device's thermal status, with
+ * AThermal_getCurrentThermalStatus() from API 30 and the hottest
+ * /sys/class/thermal zone before that, and samples the pipeline: video
+ * queue fill and drops, time the USB thread spent waiting on the
+ * background queue, and decode time per frame. The level is the worse of
+ * the thermal and the load level. It rises at once and falls one step at
+ * a time after COOLDOWN_SAMPLES calmer samples, so a policy isn't flipped
+ * back and forth by one quiet second.
+ *
+ * What a level does is up to the callback; decryptWorkers() and
+ * resolutionSteps() say what it should mean for the decrypt pool and the
+ * next session's video configuration.
+ */
+class QualityGovernor {
+public:
+    static constexpr int DEFAULT_INTERVAL_MS = 1000;
+    // Calmer samples before the level steps down
+    static constexpr int COOLDOWN_SAMPLES = 5;
+
+    // AThermalStatus, THERMAL_STATUS_NONE .. THERMAL_STATUS_SHUTDOWN
+    static constexpr int THERMAL_UNKNOWN = -1;
+    static constexpr int THERMAL_NONE = 0;
+    static constexpr int THERMAL_SHUTDOWN = 6;
+
+    enum class ThermalSource : int {
+        NONE = 0,       // Neither is readable
+        THERMAL_API = 1,
+        SYSFS = 2,
+    };
+
+    explicit QualityGovernor(int intervalMs = DEFAULT_INTERVAL_MS);
+    ~QualityGovernor();
+
+    // Non-copyable
+    QualityGovernor(const QualityGovernor&) = delete;
+    QualityGovernor& operator=(const QualityGovernor&) = delete;
+
+    /**
+     * Must be called before start().
+     */
+    void setSampler(GovernorSampler sampler);
+    void setCallback(GovernorCallback callback);
+
+    void start();
+
+    /**
+     * Stop the governor thread. The level last reached is kept for getStats().
+     */
+    void stop();
+
+    /**
+     * The device's thermal status right now, as an AThermalStatus.
+     * Safe to call from any thread.
+     * @param source Where it came from, may be null
+     * @return THERMAL_UNKNOWN if there is no way to tell
+     */
+    static int thermalStatus(ThermalSource* source = nullptr);
+
+    /**
+     * Level for a thermal status on its own.
+     */
+    static QualityLevel thermalLevel(int status);
+
+    /**
+     * Decrypt workers to keep taking jobs at level, of started.
+     */
+    static size_t decryptWorkers(QualityLevel level, size_t started);
+
+    /**
+     * Resolutions below the selected one a session should offer at level.
+     */
+    static int resolutionSteps(QualityLevel level);
+
+    QualityLevel level() const;
+
+    struct Stats {
+        uint64_t samples;
+        uint64_t levelChanges;
+        int level;                  // QualityLevel
+        int maxLevel;               // Highest since start()
+        int thermalStatus;          // Last read, THERMAL_UNKNOWN if unreadable
+        int thermalSource;          // ThermalSource
+        int loadLevel;              // QualityLevel the last sample asked for on load alone
+        uint32_t videoQueueFill;    // Last sample, percent
+        uint64_t decodeAvgUs;       // Over the last interval, 0 without decoded frames
+    };
+    Stats getStats() const;
+
+private:
+    const std::chrono::milliseconds interval_;
+    GovernorSampler sampler_;
+    GovernorCallback callback_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+    bool running_ = false;
+
+    // Governor thread only
+    GovernorSample last_{};
+    bool haveLast_ = false;
+    int calmSamples_ = 0;
+
+    Stats stats_{};
+
+    void governorLoop();
+    QualityLevel loadLevel(const GovernorSample& sample, uint64_t decodeAvgUs) const;
+    QualityLevel evaluate(QualityLevel target, QualityLevel current);
+};
+
+} // namespace aap
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <time.h>
+
+namespace aap {
+
+/**
+ * A value read on hot paths without a lock and replaced rarely, in the
+ * manner of RCU.
+ *
+ * The value is immutable once published. A reader pins it for one read
+ * section by registering in the counter of the current grace period,
+ * which takes no lock and never waits for a writer or another reader.
+ * update() publishes a copy, starts a new grace period and waits for the
+ * readers of the previous one before freeing the old value, so once it
+ * returns nothing uses the old value or anything it captured.
+ *
+ * Updates are serialized by a mutex readers never take. A read section
+ * must not update its own cell; it would wait for itself.
+ */
+template <typename T>
+class RcuCell {
+public:
+    RcuCell() : current_(new T()) {}
+    ~RcuCell() { delete current_.load(std::memory_order_relaxed); }
+
+    // Non-copyable
+    RcuCell(const RcuCell&) = delete;
+    RcuCell& operator=(const RcuCell&) = delete;
+
+    /**
+     * The value pinned for as long as the section lives.
+     */
+    class ReadSection {
+    public:
+        ~ReadSection() { readers_->fetch_sub(1, std::memory_order_release); }
+
+        // Non-copyable
+        ReadSection(const ReadSection&) = delete;
+        ReadSection& operator=(const ReadSection&) = delete;
+
+        const T& operator*() const { return *value_; }
+        const T* operator->() const { return value_; }
+
+    private:
+        friend class RcuCell;
+        ReadSection(std::atomic<uint32_t>* readers, const T* value) : readers_(readers), value_(value) {}
+
+        std::atomic<uint32_t>* readers_;
+        const T* value_;
+    };
+
+    ReadSection read() const {
+        while (true) {
+            const uint32_t period = period_.load(std::memory_order_seq_cst);
+            std::atomic<uint32_t>& readers = readers_[period & 1];
+            readers.fetch_add(1, std::memory_order_seq_cst);
+            // Registered before the period moved on, so its writer waits for us
+            if (period_.load(std::memory_order_seq_cst) == period) {
+                return ReadSection(&readers, current_.load(std::memory_order_acquire));
+            }
+            readers.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    /**
+     * Publish a modified copy of the value. editor(T&) changes the copy.
+     * Returns once no reader can still see the previous value.
+     */
+    template <typename Editor>
+    void update(Editor&& editor) {
+        std::lock_guard<std::mutex> lock(writeMutex_);
+        const T* old = current_.load(std::memory_order_relaxed);
+        std::unique_ptr<T> next(new T(*old));
+        editor(*next);
+        current_.store(next.release(), std::memory_order_seq_cst);
+
+        // Readers registering from here on see the new value; wait out the
+        // ones in the period that may have loaded the old
+        const uint32_t period = period_.fetch_add(1, std::memory_order_seq_cst);
+        const std::atomic<uint32_t>& readers = readers_[period & 1];
+        for (int spins = 0; readers.load(std::memory_order_acquire) != 0; spins++) {
+            if (spins < 64) {
+                std::this_thread::yield();
+            } else {
+                const struct timespec pause = {0, 100000};
+                nanosleep(&pause, nullptr);
+            }
+        }
+        delete old;
+    }
+
+private:
+    std::atomic<const T*> current_;
+    mutable std::atomic<uint32_t> period_{0};
+    // Readers registered in even and odd grace periods
+    mutable std::atomic<uint32_t> readers_[2] = {};
+    std::mutex writeMutex_;
+};
+
+} // namespace aap
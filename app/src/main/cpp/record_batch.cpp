@@ -0,0 +1,37 @@
+#include "record_batch.h"
+#include <cstring>
+
+namespace aap {
+
+RecordBatch::RecordBatch()
+    : buffer_(new uint8_t[CAPACITY])
+{
+}
+
+bool RecordBatch::append(int channel, uint8_t flags, const uint8_t* data, size_t length) {
+    if (full() || length > PAYLOAD_CAPACITY - payloadUsed_) {
+        return false;
+    }
+
+    const size_t offset = PAYLOAD_OFFSET + payloadUsed_;
+    memcpy(buffer_.get() + offset, data, length);
+
+    const int32_t descriptor[DESCRIPTOR_INTS] = {
+        channel,
+        flags,
+        static_cast<int32_t>(offset),
+        static_cast<int32_t>(length),
+    };
+    memcpy(buffer_.get() + count_ * DESCRIPTOR_SIZE, descriptor, DESCRIPTOR_SIZE);
+
+    count_++;
+    payloadUsed_ += length;
+    return true;
+}
+
+void RecordBatch::clear() {
+    count_ = 0;
+    payloadUsed_ = 0;
+}
+
+} // namespace aap
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace aap {
+
+/**
+ * Fixed buffer that packs several records for a single JNI upcall.
+ *
+ * Layout, all integers in native byte order:
+ *   [0, PAYLOAD_OFFSET)   MAX_RECORDS descriptors of four int32s:
+ *                         channel, flags, offset, length
+ *   [PAYLOAD_OFFSET, ...) payloads, back to back
+ *
+ * offset is measured from the start of the buffer, so Kotlin can read a
+ * record straight from a DirectByteBuffer view of data().
+ */
+class RecordBatch {
+public:
+    static constexpr size_t MAX_RECORDS = 64;
+    static constexpr size_t DESCRIPTOR_INTS = 4;
+    static constexpr size_t DESCRIPTOR_SIZE = DESCRIPTOR_INTS * sizeof(int32_t);
+    static constexpr size_t PAYLOAD_OFFSET = MAX_RECORDS * DESCRIPTOR_SIZE;
+    static constexpr size_t PAYLOAD_CAPACITY = 128 * 1024;
+    static constexpr size_t CAPACITY = PAYLOAD_OFFSET + PAYLOAD_CAPACITY;
+
+    RecordBatch();
+
+    // Non-copyable
+    RecordBatch(const RecordBatch&) = delete;
+    RecordBatch& operator=(const RecordBatch&) = delete;
+
+    /**
+     * Copy a record into the batch.
+     * @return false if the descriptor table or the payload area is full
+     */
+    bool append(int channel, uint8_t flags, const uint8_t* data, size_t length);
+
+    void clear();
+
+    size_t count() const { return count_; }
+    bool empty() const { return count_ == 0; }
+    bool full() const { return count_ == MAX_RECORDS; }
+    size_t payloadBytes() const { return payloadUsed_; }
+
+    uint8_t* data() { return buffer_.get(); }
+    size_t capacity() const { return CAPACITY; }
+
+private:
+    std::unique_ptr<uint8_t[]> buffer_;
+    size_t count_ = 0;
+    size_t payloadUsed_ = 0;
+};
+
+} // namespace aap
@@ -0,0 +1,112 @@
+#include "record_pool.h"
+#include "streaming_memory.h"
+#include <android/log.h>
+#include <cstring>
+
+#define LOG_TAG "RecordPool"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+RecordPool::RecordPool(const RecordPoolConfig& config) {
+    const size_t slabs[NUM_CLASSES] = {config.smallSlabs, config.mediumSlabs, config.largeSlabs};
+    size_t total = 0;
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        Class& cls = classes_[i];
+        cls.slabs = slabs[i];
+        if (cls.slabs == 0) {
+            continue;
+        }
+        cls.storage.reset(allocateStreamingMemory(cls.slabs * CLASS_SIZES[i]));
+        if (!cls.storage) {
+            LOGE("Could not allocate %zu slabs of %zu bytes", cls.slabs, CLASS_SIZES[i]);
+            cls.slabs = 0;
+            continue;
+        }
+        cls.buffers.reset(new Buffer[cls.slabs]);
+        // Fault the pages in now rather than on the first records
+        std::memset(cls.storage.get(), 0, cls.slabs * CLASS_SIZES[i]);
+        for (size_t j = cls.slabs; j-- > 0;) {
+            Buffer& buffer = cls.buffers[j];
+            buffer.data = cls.storage.get() + j * CLASS_SIZES[i];
+            buffer.capacity = CLASS_SIZES[i];
+            buffer.sizeClass = i;
+            buffer.next = cls.free;
+            cls.free = &buffer;
+        }
+        total += cls.slabs * CLASS_SIZES[i];
+    }
+    LOGD("Record pool: %zu/%zu/%zu slabs, %zu KB", config.smallSlabs, config.mediumSlabs,
+         config.largeSlabs, total / 1024);
+}
+
+RecordPool::~RecordPool() {
+    for (const Class& cls : classes_) {
+        if (cls.inUse > 0) {
+            LOGE("Record pool destroyed with %llu buffers in use",
+                 static_cast<unsigned long long>(cls.inUse));
+        }
+    }
+}
+
+RecordPool::Buffer* RecordPool::take(Class& cls) {
+    std::lock_guard<std::mutex> lock(cls.mutex);
+    Buffer* buffer = cls.free;
+    if (buffer) {
+        cls.free = buffer->next;
+        buffer->next = nullptr;
+        if (++cls.inUse > cls.highWater) {
+            cls.highWater = cls.inUse;
+        }
+    }
+    return buffer;
+}
+
+RecordPool::Buffer* RecordPool::acquire(size_t length) {
+    int sizeClass = 0;
+    while (sizeClass < NUM_CLASSES && CLASS_SIZES[sizeClass] < length) {
+        sizeClass++;
+    }
+
+    for (int i = sizeClass; i < NUM_CLASSES; i++) {
+        Buffer* buffer = take(classes_[i]);
+        if (buffer) {
+            if (i != sizeClass) {
+                promotions_.fetch_add(1, std::memory_order_relaxed);
+            }
+            buffer->refs.store(1, std::memory_order_relaxed);
+            return buffer;
+        }
+    }
+    exhausted_.fetch_add(1, std::memory_order_relaxed);
+    return nullptr;
+}
+
+void RecordPool::release(Buffer* buffer) {
+    if (buffer->refs.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+        return;
+    }
+    Class& cls = classes_[buffer->sizeClass];
+    std::lock_guard<std::mutex> lock(cls.mutex);
+    buffer->next = cls.free;
+    cls.free = buffer;
+    cls.inUse--;
+}
+
+RecordPool::Stats RecordPool::getStats() const {
+    Stats stats;
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        const Class& cls = classes_[i];
+        std::lock_guard<std::mutex> lock(cls.mutex);
+        stats.classes[i].size = CLASS_SIZES[i];
+        stats.classes[i].slabs = cls.slabs;
+        stats.classes[i].inUse = cls.inUse;
+        stats.classes[i].highWater = cls.highWater;
+    }
+    stats.promotions = promotions_.load(std::memory_order_relaxed);
+    stats.exhausted = exhausted_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace aap
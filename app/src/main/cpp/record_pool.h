@@ -0,0 +1,100 @@
+#pragma once
+
+#include "streaming_memory.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+namespace aap {
+
+/**
+ * Slabs per size class, all allocated when the pool is created.
+ */
+struct RecordPoolConfig {
+    size_t smallSlabs = 128;   // 256 B: control, input, sensor records
+    size_t mediumSlabs = 32;   // 4 KB: audio and small video records
+    size_t largeSlabs = 16;    // 64 KB: the largest AAP record
+};
+
+/**
+ * Size-classed slab pool for records held across threads.
+ *
+ * Every slab is allocated and touched up front, so acquiring one in
+ * steady state never reaches malloc. Buffers are reference counted: the
+ * stage that acquires one can hand extra references to later stages, and
+ * the last release() returns it to its class. A request its own class
+ * can't serve is promoted to the next larger one before it fails.
+ *
+ * Safe to use from any thread.
+ */
+class RecordPool {
+public:
+    static constexpr int NUM_CLASSES = 3;
+    static constexpr size_t CLASS_SIZES[NUM_CLASSES] = {256, 4096, 65536};
+
+    struct Buffer {
+        uint8_t* data = nullptr;
+        size_t capacity = 0;
+        std::atomic<uint32_t> refs{0};
+        int sizeClass = 0;
+        Buffer* next = nullptr;  // Free list
+    };
+
+    explicit RecordPool(const RecordPoolConfig& config = RecordPoolConfig());
+    ~RecordPool();
+
+    // Non-copyable
+    RecordPool(const RecordPool&) = delete;
+    RecordPool& operator=(const RecordPool&) = delete;
+
+    /**
+     * Take a buffer of at least length bytes, holding one reference.
+     * @return nullptr if length exceeds the largest class or every class
+     *         that could hold it is exhausted
+     */
+    Buffer* acquire(size_t length);
+
+    /**
+     * Add a reference for another owner.
+     */
+    static void retain(Buffer* buffer) { buffer->refs.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * Drop a reference; the last one returns the buffer to the pool.
+     */
+    void release(Buffer* buffer);
+
+    struct ClassStats {
+        uint64_t size;
+        uint64_t slabs;
+        uint64_t inUse;
+        uint64_t highWater;
+    };
+    struct Stats {
+        ClassStats classes[NUM_CLASSES];
+        uint64_t promotions;  // Served by a larger class than requested
+        uint64_t exhausted;   // acquire() calls that failed
+    };
+    Stats getStats() const;
+
+private:
+    struct Class {
+        StreamingBuffer storage;
+        std::unique_ptr<Buffer[]> buffers;
+        size_t slabs = 0;
+        Buffer* free = nullptr;
+        uint64_t inUse = 0;
+        uint64_t highWater = 0;
+        mutable std::mutex mutex;
+    };
+    Class classes_[NUM_CLASSES];
+
+    std::atomic<uint64_t> promotions_{0};
+    std::atomic<uint64_t> exhausted_{0};
+
+    Buffer* take(Class& cls);
+};
+
+} // namespace aap
@@ -0,0 +1,234 @@
+#include "replay_transport.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LOG_TAG "ReplayTransport"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+size_t padded(size_t length) {
+    return (length + 7) & ~static_cast<size_t>(7);
+}
+
+} // anonymous namespace
+
+ReplayTransport::ReplayTransport() = default;
+
+ReplayTransport::~ReplayTransport() {
+    close();
+}
+
+bool ReplayTransport::open(const char* path, const ReplayConfig& config) {
+    if (mapping_) {
+        setError("Already open");
+        return false;
+    }
+
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        setError("Cannot open %s: %s", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(CaptureFileHeader)) {
+        setError("%s is too short for a capture", path);
+        ::close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        setError("Cannot map %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    CaptureFileHeader header;
+    std::memcpy(&header, mapped, sizeof(header));
+    if (std::memcmp(header.magic, CaptureFileHeader::MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != CaptureFileHeader::VERSION ||
+            header.headerSize < sizeof(header) || header.headerSize > static_cast<size_t>(st.st_size)) {
+        setError("%s is not a version %u capture", path, CaptureFileHeader::VERSION);
+        munmap(mapped, static_cast<size_t>(st.st_size));
+        return false;
+    }
+    // Read sequentially once; let the kernel read ahead
+    madvise(mapped, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    mapping_ = static_cast<uint8_t*>(mapped);
+    size_ = static_cast<size_t>(st.st_size);
+    config_ = config;
+    LOGI("Replaying %s, %zu bytes, speed %.2f", path, size_, config.speed);
+    return true;
+}
+
+const CaptureEntry* ReplayTransport::entryAt(size_t offset) const {
+    if (offset + sizeof(CaptureEntry) > size_) {
+        return nullptr;
+    }
+    // Entries are 8 byte aligned in the file and the mapping is page aligned
+    const auto* entry = reinterpret_cast<const CaptureEntry*>(mapping_ + offset);
+    if (entry->type == CaptureEntry::TYPE_END ||
+            offset + sizeof(CaptureEntry) + entry->length > size_) {
+        return nullptr;
+    }
+    return entry;
+}
+
+bool ReplayTransport::readKey(CaptureReadKey& key) const {
+    if (!mapping_) {
+        return false;
+    }
+    size_t offset = reinterpret_cast<const CaptureFileHeader*>(mapping_)->headerSize;
+    while (const CaptureEntry* entry = entryAt(offset)) {
+        if (entry->type == CaptureEntry::TYPE_READ_KEY && entry->length >= sizeof(CaptureReadKey)) {
+            std::memcpy(&key, entry + 1, sizeof(key));
+            return key.keyLength <= sizeof(key.key);
+        }
+        offset += sizeof(CaptureEntry) + padded(entry->length);
+    }
+    return false;
+}
+
+void ReplayTransport::close() {
+    stopReading();
+    if (mapping_) {
+        munmap(mapping_, size_);
+        mapping_ = nullptr;
+        size_ = 0;
+    }
+}
+
+void ReplayTransport::setRawDataCallback(RawDataCallback callback) {
+    std::lock_guard<std::mutex> lock(callbackMutex_);
+    rawDataCallback_ = std::move(callback);
+}
+
+void ReplayTransport::setErrorCallback(ErrorCallback callback) {
+    std::lock_guard<std::mutex> lock(callbackMutex_);
+    errorCallback_ = std::move(callback);
+}
+
+void ReplayTransport::setCapture(SessionCapture*) {
+    // Capturing a replay would only copy the file
+}
+
+void ReplayTransport::startReading() {
+    if (!mapping_ || running_) {
+        return;
+    }
+    running_ = true;
+    thread_ = std::thread(&ReplayTransport::replayLoop, this);
+}
+
+void ReplayTransport::stopReading() {
+    {
+        std::lock_guard<std::mutex> lock(pacingMutex_);
+        running_ = false;
+    }
+    pacingWake_.notify_all();
+    if (thread_.joinable() && thread_.get_id() != std::this_thread::get_id()) {
+        thread_.join();
+    }
+}
+
+int ReplayTransport::write(const uint8_t*, size_t length) {
+    return static_cast<int>(length);
+}
+
+int ReplayTransport::read(uint8_t*, size_t, int) {
+    return 0;
+}
+
+void ReplayTransport::replayLoop() {
+    applyThreadPolicy("AAP-Replay");
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point start = Clock::now();
+    bool first = true;
+    uint64_t firstNs = 0;
+
+    size_t offset = reinterpret_cast<const CaptureFileHeader*>(mapping_)->headerSize;
+    while (running_) {
+        const CaptureEntry* entry = entryAt(offset);
+        if (!entry) {
+            break;
+        }
+        offset += sizeof(CaptureEntry) + padded(entry->length);
+        if (entry->type != CaptureEntry::TYPE_DATA) {
+            continue;
+        }
+        if (first) {
+            firstNs = entry->timestampNs;
+            first = false;
+        }
+
+        if (config_.speed > 0) {
+            const auto due = start + std::chrono::nanoseconds(
+                static_cast<int64_t>(static_cast<double>(entry->timestampNs - firstNs) / config_.speed));
+            std::unique_lock<std::mutex> lock(pacingMutex_);
+            pacingWake_.wait_until(lock, due, [this] { return !running_; });
+            if (!running_) {
+                break;
+            }
+            const auto lag = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - due).count();
+            if (lag > 0 && static_cast<uint64_t>(lag) > maxLagNs_.load(std::memory_order_relaxed)) {
+                maxLagNs_.store(static_cast<uint64_t>(lag), std::memory_order_relaxed);
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(callbackMutex_);
+            if (rawDataCallback_) {
+                rawDataCallback_(reinterpret_cast<const uint8_t*>(entry + 1), entry->length);
+            }
+        }
+        entriesReplayed_.fetch_add(1, std::memory_order_relaxed);
+        bytesReplayed_.fetch_add(entry->length, std::memory_order_relaxed);
+        elapsedNs_.store(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()),
+            std::memory_order_relaxed);
+    }
+
+    if (running_.exchange(false)) {
+        LOGI("Replay finished: %llu entries, %llu bytes in %llu ms",
+             static_cast<unsigned long long>(entriesReplayed_.load()),
+             static_cast<unsigned long long>(bytesReplayed_.load()),
+             static_cast<unsigned long long>(elapsedNs_.load() / 1000000));
+        std::lock_guard<std::mutex> lock(callbackMutex_);
+        if (errorCallback_) {
+            errorCallback_(ERROR_END_OF_CAPTURE, "End of capture");
+        }
+    }
+}
+
+ReplayTransport::Stats ReplayTransport::getStats() const {
+    Stats stats;
+    stats.entriesReplayed = entriesReplayed_.load(std::memory_order_relaxed);
+    stats.bytesReplayed = bytesReplayed_.load(std::memory_order_relaxed);
+    stats.elapsedNs = elapsedNs_.load(std::memory_order_relaxed);
+    stats.maxLagNs = maxLagNs_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void ReplayTransport::setError(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(lastError_, sizeof(lastError_), format, args);
+    va_end(args);
+    LOGE("%s", lastError_);
+}
+
+} // namespace aap
@@ -0,0 +1,116 @@
+#pragma once
+
+#include "transport.h"
+#include "session_capture.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+namespace aap {
+
+/**
+ * Pacing for a replay.
+ */
+struct ReplayConfig {
+    double speed = 0.0;  // 1.0 for recorded pace, 2.0 for twice as fast, 0 as fast as possible
+};
+
+/**
+ * Transport that feeds a SessionCapture file through the native pipeline,
+ * for offline benchmarks and reproducing performance problems.
+ *
+ * The AAP-Replay thread reads the memory-mapped file and hands each data
+ * entry to the RawDataCallback, exactly as the capturing transport did,
+ * so the framer, decryption with the captured read key and the dispatcher
+ * all see the original byte stream. Writes are discarded and read() has
+ * nothing to return: the handshake itself is not replayed.
+ *
+ * The end of the capture is reported like a disconnect.
+ */
+class ReplayTransport : public Transport {
+public:
+    // Reported through the ErrorCallback at the end of the capture,
+    // the same code as TcpConnection::ERROR_DISCONNECTED
+    static constexpr int ERROR_END_OF_CAPTURE = -4;
+
+    ReplayTransport();
+    ~ReplayTransport() override;
+
+    // Non-copyable
+    ReplayTransport(const ReplayTransport&) = delete;
+    ReplayTransport& operator=(const ReplayTransport&) = delete;
+
+    /**
+     * Map a capture file.
+     * @return false if it can't be read or is not a capture
+     */
+    bool open(const char* path, const ReplayConfig& config = ReplayConfig());
+
+    /**
+     * First read key in the capture.
+     * @return false if the capture has none, records then stay encrypted
+     */
+    bool readKey(CaptureReadKey& key) const;
+
+    void close() override;
+    bool isOpen() const override { return mapping_ != nullptr; }
+    bool isReading() const override { return running_.load(std::memory_order_relaxed); }
+    void setRawDataCallback(RawDataCallback callback) override;
+    void setErrorCallback(ErrorCallback callback) override;
+    void setCapture(SessionCapture* capture) override;
+    void startReading() override;
+    void stopReading() override;
+
+    /**
+     * Discarded: nothing listens on the other end.
+     * @return length
+     */
+    int write(const uint8_t* data, size_t length) override;
+
+    /**
+     * @return 0, as on a timeout
+     */
+    int read(uint8_t* buffer, size_t length, int timeoutMs) override;
+
+    const char* getLastError() const override { return lastError_; }
+
+    struct Stats {
+        uint64_t entriesReplayed;
+        uint64_t bytesReplayed;
+        uint64_t elapsedNs;  // From the first entry to the last one delivered
+        uint64_t maxLagNs;   // Largest delay behind the paced schedule
+    };
+    Stats getStats() const;
+
+private:
+    uint8_t* mapping_ = nullptr;
+    size_t size_ = 0;
+    ReplayConfig config_;
+
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    // Paced waits end early on stopReading()
+    std::mutex pacingMutex_;
+    std::condition_variable pacingWake_;
+
+    RawDataCallback rawDataCallback_;
+    ErrorCallback errorCallback_;
+    std::mutex callbackMutex_;
+
+    std::atomic<uint64_t> entriesReplayed_{0};
+    std::atomic<uint64_t> bytesReplayed_{0};
+    std::atomic<uint64_t> elapsedNs_{0};
+    std::atomic<uint64_t> maxLagNs_{0};
+
+    char lastError_[256] = {0};
+
+    // Entry at offset, nullptr at the end or on a truncated entry
+    const CaptureEntry* entryAt(size_t offset) const;
+    void replayLoop();
+    void setError(const char* format, ...);
+};
+
+} // namespace aap
@@ -1,102 +1,149 @@
 #include "ring_buffer.h"
+#include "streaming_memory.h"
 #include <algorithm>
 #include <cstring>
-
-RingBuffer::RingBuffer(size_t capacity)
-    : capacity_(capacity)
+#include <new>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+RingBuffer::RingBuffer(size_t capacity, Mode mode)
+    : buffer_(nullptr)
+    , capacity_(capacity)
+    , mirrored_(false)
+    , locked_(false)
     , writePos_(0)
     , readPos_(0)
 {
-    // Allocate with alignment for better cache performance
-    buffer_ = new (std::align_val_t(64)) uint8_t[capacity];
+    if (mode == Mode::MIRRORED) {
+        const size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        const size_t rounded = (capacity + pageSize - 1) / pageSize * pageSize;
+        if (mapMirrored(rounded)) {
+            capacity_ = rounded;
+        }
+    }
+
+    if (!mirrored_) {
+        // Page aligned, and populated or locked per the streaming memory options
+        buffer_ = aap::allocateStreamingMemory(capacity_);
+        if (!buffer_) {
+            throw std::bad_alloc();
+        }
+    }
+
+    mask_ = capacity_ > 1 && (capacity_ & (capacity_ - 1)) == 0 ? capacity_ - 1 : 0;
 }
 
 RingBuffer::~RingBuffer() {
-    ::operator delete[](buffer_, std::align_val_t(64));
+    if (mirrored_) {
+        aap::releaseStreamingMapping(buffer_, capacity_, locked_);
+        munmap(buffer_, capacity_ * 2);
+    } else {
+        aap::freeStreamingMemory(buffer_);
+    }
 }
 
-size_t RingBuffer::write(const uint8_t* data, size_t length) {
-    const size_t currentRead = readPos_.load(std::memory_order_acquire);
-    const size_t currentWrite = writePos_.load(std::memory_order_relaxed);
+bool RingBuffer::mapMirrored(size_t capacity) {
+    // memfd_create has no libc wrapper before API 30, call it directly
+    const int fd = static_cast<int>(syscall(__NR_memfd_create, "aap-ring", MFD_CLOEXEC));
+    if (fd < 0) {
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(capacity)) != 0) {
+        close(fd);
+        return false;
+    }
 
-    // Calculate available space
-    size_t available;
-    if (currentWrite >= currentRead) {
-        available = capacity_ - (currentWrite - currentRead) - 1;
-    } else {
-        available = currentRead - currentWrite - 1;
+    // Reserve twice the range, then map the same pages into both halves
+    void* reserved = mmap(nullptr, capacity * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reserved == MAP_FAILED) {
+        close(fd);
+        return false;
     }
 
+    uint8_t* base = static_cast<uint8_t*>(reserved);
+    const bool mapped =
+        mmap(base, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED &&
+        mmap(base + capacity, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) != MAP_FAILED;
+    close(fd);
+
+    if (!mapped) {
+        munmap(reserved, capacity * 2);
+        return false;
+    }
+
+    buffer_ = base;
+    mirrored_ = true;
+    // Both halves share the pages, so the first covers them all
+    locked_ = aap::prepareStreamingMapping(base, capacity);
+    return true;
+}
+
+size_t RingBuffer::powerOfTwoCapacity(size_t capacity) {
+    size_t result = 2;
+    while (result < capacity) {
+        result <<= 1;
+    }
+    return result;
+}
+
+size_t RingBuffer::write(const uint8_t* data, size_t length) {
+    const uint64_t currentRead = readPos_.load(std::memory_order_acquire);
+    const uint64_t currentWrite = writePos_.load(std::memory_order_relaxed);
+
+    const size_t available = capacity_ - static_cast<size_t>(currentWrite - currentRead);
     const size_t toWrite = std::min(length, available);
     if (toWrite == 0) {
         return 0;
     }
 
     // Write data, handling wrap-around
-    const size_t firstPart = std::min(toWrite, capacity_ - currentWrite);
-    std::memcpy(buffer_ + currentWrite, data, firstPart);
+    const size_t start = offset(currentWrite);
+    const size_t firstPart = std::min(toWrite, contiguous(start));
+    std::memcpy(buffer_ + start, data, firstPart);
 
     if (toWrite > firstPart) {
         std::memcpy(buffer_, data + firstPart, toWrite - firstPart);
     }
 
     // Update write position
-    const size_t newWrite = (currentWrite + toWrite) % capacity_;
-    writePos_.store(newWrite, std::memory_order_release);
+    writePos_.store(currentWrite + toWrite, std::memory_order_release);
 
     return toWrite;
 }
 
 size_t RingBuffer::read(uint8_t* data, size_t maxLength) {
-    const size_t currentWrite = writePos_.load(std::memory_order_acquire);
-    const size_t currentRead = readPos_.load(std::memory_order_relaxed);
-
-    // Calculate available data
-    size_t available;
-    if (currentWrite >= currentRead) {
-        available = currentWrite - currentRead;
-    } else {
-        available = capacity_ - currentRead + currentWrite;
-    }
-
-    const size_t toRead = std::min(maxLength, available);
+    const size_t toRead = peek(data, maxLength);
     if (toRead == 0) {
         return 0;
     }
 
-    // Read data, handling wrap-around
-    const size_t firstPart = std::min(toRead, capacity_ - currentRead);
-    std::memcpy(data, buffer_ + currentRead, firstPart);
-
-    if (toRead > firstPart) {
-        std::memcpy(data + firstPart, buffer_, toRead - firstPart);
-    }
-
     // Update read position
-    const size_t newRead = (currentRead + toRead) % capacity_;
-    readPos_.store(newRead, std::memory_order_release);
+    const uint64_t currentRead = readPos_.load(std::memory_order_relaxed);
+    readPos_.store(currentRead + toRead, std::memory_order_release);
 
     return toRead;
 }
 
 size_t RingBuffer::peek(uint8_t* data, size_t maxLength) const {
-    const size_t currentWrite = writePos_.load(std::memory_order_acquire);
-    const size_t currentRead = readPos_.load(std::memory_order_relaxed);
-
-    size_t available;
-    if (currentWrite >= currentRead) {
-        available = currentWrite - currentRead;
-    } else {
-        available = capacity_ - currentRead + currentWrite;
-    }
+    const uint64_t currentWrite = writePos_.load(std::memory_order_acquire);
+    const uint64_t currentRead = readPos_.load(std::memory_order_relaxed);
 
+    const size_t available = static_cast<size_t>(currentWrite - currentRead);
     const size_t toPeek = std::min(maxLength, available);
     if (toPeek == 0) {
         return 0;
     }
 
-    const size_t firstPart = std::min(toPeek, capacity_ - currentRead);
-    std::memcpy(data, buffer_ + currentRead, firstPart);
+    // Read data, handling wrap-around
+    const size_t start = offset(currentRead);
+    const size_t firstPart = std::min(toPeek, contiguous(start));
+    std::memcpy(data, buffer_ + start, firstPart);
 
     if (toPeek > firstPart) {
         std::memcpy(data + firstPart, buffer_, toPeek - firstPart);
@@ -106,40 +153,55 @@ size_t RingBuffer::peek(uint8_t* data, size_t maxLength) const {
 }
 
 size_t RingBuffer::skip(size_t length) {
-    const size_t currentWrite = writePos_.load(std::memory_order_acquire);
-    const size_t currentRead = readPos_.load(std::memory_order_relaxed);
-
-    size_t available;
-    if (currentWrite >= currentRead) {
-        available = currentWrite - currentRead;
-    } else {
-        available = capacity_ - currentRead + currentWrite;
-    }
+    const uint64_t currentWrite = writePos_.load(std::memory_order_acquire);
+    const uint64_t currentRead = readPos_.load(std::memory_order_relaxed);
 
-    const size_t toSkip = std::min(length, available);
+    const size_t toSkip = std::min(length, static_cast<size_t>(currentWrite - currentRead));
     if (toSkip == 0) {
         return 0;
     }
 
-    const size_t newRead = (currentRead + toSkip) % capacity_;
-    readPos_.store(newRead, std::memory_order_release);
+    readPos_.store(currentRead + toSkip, std::memory_order_release);
 
     return toSkip;
 }
 
-size_t RingBuffer::available() const {
-    const size_t currentWrite = writePos_.load(std::memory_order_acquire);
-    const size_t currentRead = readPos_.load(std::memory_order_acquire);
+RingBuffer::WriteSpan RingBuffer::acquireWrite(size_t length) {
+    const uint64_t currentRead = readPos_.load(std::memory_order_acquire);
+    const uint64_t currentWrite = writePos_.load(std::memory_order_relaxed);
 
-    if (currentWrite >= currentRead) {
-        return currentWrite - currentRead;
-    } else {
-        return capacity_ - currentRead + currentWrite;
-    }
+    const size_t available = capacity_ - static_cast<size_t>(currentWrite - currentRead);
+    const size_t start = offset(currentWrite);
+    return { buffer_ + start, std::min({length, available, contiguous(start)}) };
+}
+
+void RingBuffer::commitWrite(size_t length) {
+    const uint64_t currentWrite = writePos_.load(std::memory_order_relaxed);
+    writePos_.store(currentWrite + length, std::memory_order_release);
+}
+
+RingBuffer::ReadSpan RingBuffer::acquireRead() const {
+    const uint64_t currentWrite = writePos_.load(std::memory_order_acquire);
+    const uint64_t currentRead = readPos_.load(std::memory_order_relaxed);
+
+    const size_t available = static_cast<size_t>(currentWrite - currentRead);
+    const size_t start = offset(currentRead);
+    return { buffer_ + start, std::min(available, contiguous(start)) };
+}
+
+void RingBuffer::release(size_t length) {
+    const uint64_t currentRead = readPos_.load(std::memory_order_relaxed);
+    readPos_.store(currentRead + length, std::memory_order_release);
+}
+
+size_t RingBuffer::available() const {
+    const uint64_t currentWrite = writePos_.load(std::memory_order_acquire);
+    const uint64_t currentRead = readPos_.load(std::memory_order_acquire);
+    return static_cast<size_t>(currentWrite - currentRead);
 }
 
 size_t RingBuffer::freeSpace() const {
-    return capacity_ - available() - 1;
+    return capacity_ - available();
 }
 
 bool RingBuffer::isEmpty() const {
@@ -8,10 +8,40 @@
  * Lock-free Single-Producer Single-Consumer (SPSC) ring buffer.
  * Used to pass USB data from the read thread to processing threads
  * without blocking or allocation.
+ *
+ * Read and write positions are monotonically increasing 64-bit indices,
+ * so the whole capacity is usable. A power-of-two capacity wraps with a
+ * mask instead of a modulo.
+ *
+ * In mirrored mode the storage is a memfd mapped twice back to back, so
+ * every readable or writable region is one contiguous pointer, even
+ * across the wrap point.
  */
 class RingBuffer {
 public:
-    explicit RingBuffer(size_t capacity);
+    enum class Mode {
+        HEAP,      // Plain aligned heap allocation
+        MIRRORED   // Double-mapped memfd, capacity rounded up to whole pages
+    };
+
+    /**
+     * Contiguous region of the buffer, accessed in place.
+     */
+    struct WriteSpan {
+        uint8_t* data;
+        size_t length;
+    };
+    struct ReadSpan {
+        const uint8_t* data;
+        size_t length;
+    };
+
+    /**
+     * @param capacity Buffer size in bytes
+     * @param mode Storage mode. MIRRORED falls back to HEAP if the kernel
+     *             can't provide the mapping (check isMirrored()).
+     */
+    explicit RingBuffer(size_t capacity, Mode mode = Mode::HEAP);
     ~RingBuffer();
 
     // Non-copyable
@@ -49,6 +79,33 @@ public:
      */
     size_t skip(size_t length);
 
+    /**
+     * Get a contiguous writable region in place (producer side).
+     * May be shorter than requested when space is low or, unless mirrored,
+     * at the end of the buffer; call again after commitWrite() for the
+     * remainder.
+     * @param length Number of bytes wanted
+     */
+    WriteSpan acquireWrite(size_t length);
+
+    /**
+     * Publish bytes written into the span from acquireWrite().
+     * @param length Number of bytes written, at most the span length
+     */
+    void commitWrite(size_t length);
+
+    /**
+     * Get the contiguous readable region in place (consumer side).
+     * Unless mirrored, may be shorter than available() when the data wraps.
+     */
+    ReadSpan acquireRead() const;
+
+    /**
+     * Consume bytes read from the span from acquireRead().
+     * @param length Number of bytes consumed, at most the span length
+     */
+    void release(size_t length);
+
     /**
      * Get the number of bytes available to read.
      */
@@ -74,16 +131,53 @@ public:
      */
     size_t capacity() const { return capacity_; }
 
+    /**
+     * Start of the storage, for sharing it outside the class (e.g. as a
+     * DirectByteBuffer). Position p lives at offset p modulo capacity().
+     */
+    uint8_t* data() const { return buffer_; }
+
+    /**
+     * Check if the capacity is a power of two (mask-based wrap).
+     */
+    bool isPowerOfTwo() const { return mask_ != 0; }
+
+    /**
+     * Check if the storage is double-mapped (regions never split).
+     */
+    bool isMirrored() const { return mirrored_; }
+
+    /**
+     * Round a capacity up to the next power of two.
+     */
+    static size_t powerOfTwoCapacity(size_t capacity);
+
     /**
      * Clear the buffer.
+     * Not safe against a concurrent producer or consumer.
      */
     void clear();
 
 private:
     uint8_t* buffer_;
     size_t capacity_;
+    size_t mask_;  // capacity_ - 1 for power-of-two capacities, else 0
+    bool mirrored_;
+    bool locked_;  // Mirrored pages mlock'd by the streaming memory options
 
     // Cache line padding to prevent false sharing
-    alignas(64) std::atomic<size_t> writePos_;
-    alignas(64) std::atomic<size_t> readPos_;
+    alignas(64) std::atomic<uint64_t> writePos_;
+    alignas(64) std::atomic<uint64_t> readPos_;
+
+    size_t offset(uint64_t position) const {
+        return mask_ ? static_cast<size_t>(position & mask_)
+                     : static_cast<size_t>(position % capacity_);
+    }
+
+    // Contiguous bytes starting at offset start, limited by the wrap point
+    size_t contiguous(size_t start) const {
+        return mirrored_ ? capacity_ : capacity_ - start;
+    }
+
+    bool mapMirrored(size_t capacity);
 };
@@ -0,0 +1,144 @@
+#include "sensor_aggregator.h"
+#include "aap_message.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <cstring>
+
+#define LOG_TAG "SensorAggregator"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+constexpr uint8_t SENSOR_RECORD_FLAGS = 0x0b;
+constexpr uint16_t SENSOR_EVENT = 0x8003;
+
+} // anonymous namespace
+
+SensorAggregator::SensorAggregator(int windowMs)
+    : window_(windowMs > 0 ? windowMs : DEFAULT_WINDOW_MS)
+{
+}
+
+SensorAggregator::~SensorAggregator() {
+    stop();
+}
+
+void SensorAggregator::setCallback(SensorBatchCallback callback) {
+    callback_ = std::move(callback);
+}
+
+void SensorAggregator::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    thread_ = std::thread(&SensorAggregator::senderLoop, this);
+    LOGD("Sensor batching started, window %lld ms", static_cast<long long>(window_.count()));
+}
+
+void SensorAggregator::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    armed_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool SensorAggregator::submit(int sensorType, const uint8_t* batch, size_t length) {
+    if (sensorType < 0 || sensorType >= MAX_SENSOR_TYPES || length == 0 || length > MAX_UPDATE_SIZE) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_) {
+        return false;
+    }
+    Update& update = updates_[sensorType];
+    if (update.pending) {
+        updatesSuperseded_++;
+    } else {
+        update.pending = true;
+        // First pending update starts the window
+        if (pendingCount_++ == 0) {
+            armed_.notify_one();
+        }
+    }
+    std::memcpy(update.data, batch, length);
+    update.length = length;
+    updatesSubmitted_++;
+    return true;
+}
+
+void SensorAggregator::senderLoop() {
+    applyThreadPolicy("AAP-Sensor");
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        armed_.wait(lock, [this] { return !running_ || pendingCount_ > 0; });
+        if (!running_) {
+            return;
+        }
+        // Give other sensors one window to join the record
+        armed_.wait_for(lock, window_, [this] { return !running_; });
+        if (!running_) {
+            return;
+        }
+
+        const size_t length = buildRecord();
+        lock.unlock();
+        if (callback_) {
+            callback_(record_, length);
+        }
+        lock.lock();
+    }
+}
+
+size_t SensorAggregator::buildRecord() {
+    size_t offset = EncryptedHeader::SIZE + 2;
+    uint64_t count = 0;
+    for (Update& update : updates_) {
+        if (!update.pending) {
+            continue;
+        }
+        std::memcpy(record_ + offset, update.data, update.length);
+        offset += update.length;
+        update.pending = false;
+        count++;
+    }
+    pendingCount_ = 0;
+
+    const size_t payload = offset - EncryptedHeader::SIZE;
+    record_[0] = static_cast<uint8_t>(Channel::ID_SEN);
+    record_[1] = SENSOR_RECORD_FLAGS;
+    record_[2] = static_cast<uint8_t>(payload >> 8);
+    record_[3] = static_cast<uint8_t>(payload & 0xFF);
+    record_[4] = static_cast<uint8_t>(SENSOR_EVENT >> 8);
+    record_[5] = static_cast<uint8_t>(SENSOR_EVENT & 0xFF);
+
+    recordsSent_++;
+    if (count > maxUpdatesPerRecord_) {
+        maxUpdatesPerRecord_ = count;
+    }
+    return offset;
+}
+
+SensorAggregator::Stats SensorAggregator::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.updatesSubmitted = updatesSubmitted_;
+    stats.updatesSuperseded = updatesSuperseded_;
+    stats.recordsSent = recordsSent_;
+    stats.maxUpdatesPerRecord = maxUpdatesPerRecord_;
+    return stats;
+}
+
+} // namespace aap
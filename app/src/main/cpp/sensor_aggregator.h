@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace aap {
+
+/**
+ * Callback for a coalesced sensor record.
+ * Parameters: plaintext ID_SEN record (header, message type, SensorBatch), length
+ */
+using SensorBatchCallback = std::function<void(const uint8_t* record, size_t length)>;
+
+/**
+ * Coalesces sensor channel updates into one SENSOR_EVENT record per window.
+ *
+ * Every SensorBatch field is repeated, so serialized batches concatenate
+ * into one valid batch. submit() keeps only the latest update per sensor
+ * type; the first pending update arms the AAP-Sensor thread, which sends
+ * everything pending once the window has passed. Telemetry is latency
+ * tolerant, a location fix held back by one window is still current.
+ *
+ * The record is still encrypted and sent by Kotlin, on its low priority
+ * lane: outgoing records share the SSLEngine's write sequence.
+ */
+class SensorAggregator {
+public:
+    static constexpr int MAX_SENSOR_TYPES = 24;  // SensorType values are 1..21
+    static constexpr size_t MAX_UPDATE_SIZE = 512;
+    static constexpr int DEFAULT_WINDOW_MS = 100;
+
+    explicit SensorAggregator(int windowMs = DEFAULT_WINDOW_MS);
+    ~SensorAggregator();
+
+    // Non-copyable
+    SensorAggregator(const SensorAggregator&) = delete;
+    SensorAggregator& operator=(const SensorAggregator&) = delete;
+
+    /**
+     * Must be called before start().
+     */
+    void setCallback(SensorBatchCallback callback);
+
+    void start();
+
+    /**
+     * Stop the sender thread. Pending updates are dropped, the connection
+     * they were meant for is going away.
+     */
+    void stop();
+
+    /**
+     * Queue one update, replacing a pending one of the same type.
+     * Safe to call from any thread.
+     * @param batch Serialized SensorBatch for this sensor type
+     * @return false if the type or size can't be batched; send it directly
+     */
+    bool submit(int sensorType, const uint8_t* batch, size_t length);
+
+    struct Stats {
+        uint64_t updatesSubmitted;
+        uint64_t updatesSuperseded;  // Replaced before they were sent
+        uint64_t recordsSent;
+        uint64_t maxUpdatesPerRecord;
+    };
+    Stats getStats() const;
+
+private:
+    struct Update {
+        uint8_t data[MAX_UPDATE_SIZE];
+        size_t length = 0;
+        bool pending = false;
+    };
+
+    const std::chrono::milliseconds window_;
+
+    SensorBatchCallback callback_;
+
+    // Guards updates_ and the counters below; the record is only built by
+    // the sender thread
+    mutable std::mutex mutex_;
+    std::condition_variable armed_;
+    Update updates_[MAX_SENSOR_TYPES];
+    int pendingCount_ = 0;
+    bool running_ = false;
+    std::thread thread_;
+
+    // Header, message type, then every pending update
+    uint8_t record_[6 + MAX_SENSOR_TYPES * MAX_UPDATE_SIZE];
+
+    uint64_t updatesSubmitted_ = 0;
+    uint64_t updatesSuperseded_ = 0;
+    uint64_t recordsSent_ = 0;
+    uint64_t maxUpdatesPerRecord_ = 0;
+
+    void senderLoop();
+    // Called with mutex_ held, returns the record length
+    size_t buildRecord();
+};
+
+} // namespace aap
@@ -0,0 +1,170 @@
+#include "session_capture.h"
+#include <android/log.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_TAG "SessionCapture"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+constexpr char CaptureFileHeader::MAGIC[8];
+
+namespace {
+
+uint64_t clockNs(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+size_t padded(size_t length) {
+    return (length + 7) & ~static_cast<size_t>(7);
+}
+
+} // anonymous namespace
+
+SessionCapture::SessionCapture() = default;
+
+SessionCapture::~SessionCapture() {
+    close();
+}
+
+bool SessionCapture::open(const char* path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ >= 0) {
+        return false;
+    }
+
+    fd_ = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd_ < 0) {
+        LOGE("Cannot create %s: %s", path, strerror(errno));
+        return false;
+    }
+    void* mapped = MAP_FAILED;
+    if (ftruncate(fd_, static_cast<off_t>(INITIAL_SIZE)) == 0) {
+        mapped = mmap(nullptr, INITIAL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    }
+    if (mapped == MAP_FAILED) {
+        LOGE("Cannot map %s: %s", path, strerror(errno));
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    mapping_ = static_cast<uint8_t*>(mapped);
+    mappedSize_ = INITIAL_SIZE;
+
+    CaptureFileHeader header;
+    std::memcpy(header.magic, CaptureFileHeader::MAGIC, sizeof(header.magic));
+    header.version = CaptureFileHeader::VERSION;
+    header.headerSize = sizeof(CaptureFileHeader);
+    header.startRealtimeNs = clockNs(CLOCK_REALTIME);
+    std::memcpy(mapping_, &header, sizeof(header));
+    offset_ = sizeof(header);
+    startNs_ = clockNs(CLOCK_MONOTONIC);
+
+    bytesCaptured_ = 0;
+    entries_ = 0;
+    failures_ = 0;
+    LOGI("Capturing to %s", path);
+    return true;
+}
+
+void SessionCapture::close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fd_ < 0) {
+        return;
+    }
+    munmap(mapping_, mappedSize_);
+    mapping_ = nullptr;
+    // Keep the terminating zero entry header
+    ftruncate(fd_, static_cast<off_t>(offset_ + sizeof(CaptureEntry)));
+    ::close(fd_);
+    fd_ = -1;
+    LOGI("Capture closed: %llu entries, %llu bytes",
+         static_cast<unsigned long long>(entries_), static_cast<unsigned long long>(bytesCaptured_));
+}
+
+bool SessionCapture::reserve(size_t length) {
+    // Always leave room for the zero entry that ends the file
+    const size_t needed = offset_ + length + sizeof(CaptureEntry);
+    if (needed <= mappedSize_) {
+        return true;
+    }
+    size_t size = mappedSize_;
+    while (size < needed) {
+        size *= 2;
+    }
+    if (ftruncate(fd_, static_cast<off_t>(size)) != 0) {
+        return false;
+    }
+    void* mapped = mremap(mapping_, mappedSize_, size, MREMAP_MAYMOVE);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+    mapping_ = static_cast<uint8_t*>(mapped);
+    mappedSize_ = size;
+    return true;
+}
+
+bool SessionCapture::append(uint32_t type, const void* payload, size_t length) {
+    if (fd_ < 0) {
+        return false;
+    }
+    if (!reserve(sizeof(CaptureEntry) + padded(length))) {
+        if (failures_++ == 0) {
+            LOGE("Capture file can't grow past %zu bytes: %s", mappedSize_, strerror(errno));
+        }
+        return false;
+    }
+
+    CaptureEntry entry;
+    entry.type = type;
+    entry.length = static_cast<uint32_t>(length);
+    entry.timestampNs = clockNs(CLOCK_MONOTONIC) - startNs_;
+    std::memcpy(mapping_ + offset_, &entry, sizeof(entry));
+    std::memcpy(mapping_ + offset_ + sizeof(entry), payload, length);
+    offset_ += sizeof(entry) + padded(length);
+    entries_++;
+    return true;
+}
+
+void SessionCapture::appendData(const uint8_t* data, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (append(CaptureEntry::TYPE_DATA, data, length)) {
+        bytesCaptured_ += length;
+    }
+}
+
+void SessionCapture::appendReadKey(const uint8_t* key, size_t keyLength, const uint8_t* salt,
+                                   uint64_t sequence) {
+    CaptureReadKey readKey = {};
+    if (keyLength > sizeof(readKey.key)) {
+        return;
+    }
+    readKey.keyLength = static_cast<uint32_t>(keyLength);
+    std::memcpy(readKey.key, key, keyLength);
+    std::memcpy(readKey.salt, salt, sizeof(readKey.salt));
+    readKey.sequence = sequence;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    append(CaptureEntry::TYPE_READ_KEY, &readKey, sizeof(readKey));
+    std::memset(&readKey, 0, sizeof(readKey));
+}
+
+SessionCapture::Stats SessionCapture::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.bytesCaptured = bytesCaptured_;
+    stats.entries = entries_;
+    stats.fileSize = offset_;
+    stats.failures = failures_;
+    return stats;
+}
+
+} // namespace aap
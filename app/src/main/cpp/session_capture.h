@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+
+namespace aap {
+
+/**
+ * Capture file layout, shared with ReplayTransport.
+ *
+ * A CaptureFileHeader, then entries until one with type 0: each is a
+ * CaptureEntry followed by its payload, padded to 8 bytes. The file grows
+ * in zeroed steps, so a capture cut short still ends in a type 0 entry.
+ */
+struct CaptureFileHeader {
+    static constexpr char MAGIC[8] = {'A', 'A', 'P', 'C', 'A', 'P', 'T', '1'};
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t startRealtimeNs;  // CLOCK_REALTIME at open(), for naming only
+};
+
+struct CaptureEntry {
+    static constexpr uint32_t TYPE_END = 0;
+    static constexpr uint32_t TYPE_DATA = 1;      // Raw bytes as read from the transport
+    static constexpr uint32_t TYPE_READ_KEY = 2;  // CaptureReadKey
+
+    uint32_t type;
+    uint32_t length;       // Payload bytes, without padding
+    uint64_t timestampNs;  // CLOCK_MONOTONIC, relative to open()
+};
+
+/**
+ * Exported TLS read key, so a replay can decrypt natively.
+ */
+struct CaptureReadKey {
+    uint32_t keyLength;
+    uint8_t key[32];
+    uint8_t salt[4];
+    uint64_t sequence;  // Of the first record read after this entry
+};
+
+/**
+ * Append-only capture of a session's inbound bytes, for offline replay.
+ *
+ * The file is memory mapped and every append is a copy into the mapping,
+ * so the event thread never blocks on write(); the mapping grows by
+ * doubling. The capture holds the session's read key, keep it in the
+ * app's private storage.
+ *
+ * Safe to use from any thread.
+ */
+class SessionCapture {
+public:
+    SessionCapture();
+    ~SessionCapture();
+
+    // Non-copyable
+    SessionCapture(const SessionCapture&) = delete;
+    SessionCapture& operator=(const SessionCapture&) = delete;
+
+    /**
+     * Create or truncate the capture file.
+     * @return false if it can't be created or mapped
+     */
+    bool open(const char* path);
+
+    /**
+     * Trim the file to what was written and close it.
+     */
+    void close();
+
+    bool isOpen() const { return fd_ >= 0; }
+
+    /**
+     * Append raw inbound bytes, from the transport's event thread.
+     */
+    void appendData(const uint8_t* data, size_t length);
+
+    /**
+     * Append the read key, before the data it decrypts.
+     */
+    void appendReadKey(const uint8_t* key, size_t keyLength, const uint8_t* salt, uint64_t sequence);
+
+    struct Stats {
+        uint64_t bytesCaptured;  // Payload of TYPE_DATA entries
+        uint64_t entries;
+        uint64_t fileSize;
+        uint64_t failures;       // Entries lost because the file could not grow
+    };
+    Stats getStats() const;
+
+private:
+    static constexpr size_t INITIAL_SIZE = 4 * 1024 * 1024;
+
+    mutable std::mutex mutex_;
+    int fd_ = -1;
+    uint8_t* mapping_ = nullptr;
+    size_t mappedSize_ = 0;
+    size_t offset_ = 0;
+    uint64_t startNs_ = 0;
+
+    uint64_t bytesCaptured_ = 0;
+    uint64_t entries_ = 0;
+    uint64_t failures_ = 0;
+
+    // Called with mutex_ held
+    bool reserve(size_t length);
+    bool append(uint32_t type, const void* payload, size_t length);
+};
+
+} // namespace aap
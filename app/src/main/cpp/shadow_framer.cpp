@@ -0,0 +1,130 @@
+#include "shadow_framer.h"
+#include <android/log.h>
+#include <algorithm>
+
+#define LOG_TAG "ShadowFramer"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+// Records per transfer before expected_ has to grow
+constexpr size_t EXPECTED_RESERVE = 256;
+
+} // anonymous namespace
+
+ShadowFramer::ShadowFramer()
+    : scratch_(new uint8_t[AapFramer::MAX_PAYLOAD])
+{
+    expected_.reserve(EXPECTED_RESERVE);
+}
+
+bool ShadowFramer::setReadKey(const uint8_t* key, size_t keyLength, const uint8_t* salt, uint64_t sequence) {
+    if (!layer_.setReadKey(key, keyLength, salt, sequence)) {
+        return false;
+    }
+    LOGI("Shadow decrypt enabled, sequence %llu", static_cast<unsigned long long>(sequence));
+    return true;
+}
+
+void ShadowFramer::feed(const uint8_t* data, size_t length) {
+    // Kotlin reported nothing for the last transfer
+    const size_t unreported = expected_.size();
+    expected_.clear();
+    transfers_++;
+
+    const bool decrypt = layer_.hasReadKey();
+    uint64_t decryptNs = 0;
+    const uint64_t start = LatencyHistogram::now();
+    framer_.feed(data, length, 0, [&](const Record& record) {
+        Expected e{record.channel, record.flags, record.length, NOT_DECRYPTED};
+        if (decrypt && (record.flags & EncryptedHeader::FLAG_ENCRYPTED)) {
+            const uint64_t decryptStart = LatencyHistogram::now();
+            e.decrypted = layer_.decrypt(record.data, record.length, scratch_.get()) >= 0 ? 1 : 0;
+            decryptNs += LatencyHistogram::now() - decryptStart;
+        }
+        expected_.push_back(e);
+    });
+    const uint64_t elapsed = LatencyHistogram::now() - start;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.nativeOnly += unreported;
+    stats_.transfers++;
+    stats_.bytes += length;
+    stats_.nativeRecords += expected_.size();
+    stats_.nativeFrameNs += elapsed - decryptNs;
+    stats_.nativeDecryptNs += decryptNs;
+    if (decrypt) {
+        for (const Expected& e : expected_) {
+            if (e.decrypted != NOT_DECRYPTED) stats_.nativeDecrypts++;
+        }
+    }
+}
+
+void ShadowFramer::compare(const int32_t* records, size_t count, uint64_t parseNs, uint64_t decryptNs) {
+    const size_t paired = std::min(count, expected_.size());
+    uint64_t matched = 0;
+    uint64_t mismatched = 0;
+    uint64_t decryptMismatches = 0;
+    uint64_t kotlinDecrypts = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        const int32_t* k = records + i * RECORD_FIELDS;
+        if (k[3] != NOT_DECRYPTED) kotlinDecrypts++;
+        if (i >= paired) {
+            logMismatch("Kotlin only", nullptr, k);
+            continue;
+        }
+
+        const Expected& e = expected_[i];
+        if (e.channel != k[0] || e.flags != static_cast<uint8_t>(k[1]) ||
+            e.length != static_cast<size_t>(k[2])) {
+            mismatched++;
+            logMismatch("Mismatch", &e, k);
+            continue;
+        }
+        matched++;
+        // Only comparable where both paths decrypted
+        if (e.decrypted != NOT_DECRYPTED && k[3] != NOT_DECRYPTED && e.decrypted != k[3]) {
+            decryptMismatches++;
+            logMismatch("Decrypt mismatch", &e, k);
+        }
+    }
+    for (size_t i = paired; i < expected_.size(); i++) {
+        logMismatch("Native only", &expected_[i], nullptr);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.kotlinRecords += count;
+    stats_.matched += matched;
+    stats_.mismatched += mismatched;
+    stats_.nativeOnly += expected_.size() - paired;
+    stats_.kotlinOnly += count - paired;
+    stats_.decryptMismatches += decryptMismatches;
+    stats_.kotlinDecrypts += kotlinDecrypts;
+    stats_.kotlinParseNs += parseNs;
+    stats_.kotlinDecryptNs += decryptNs;
+    expected_.clear();
+}
+
+void ShadowFramer::logMismatch(const char* what, const Expected* native, const int32_t* kotlin) {
+    if (logged_ >= MAX_LOGGED_MISMATCHES) {
+        return;
+    }
+    logged_++;
+    LOGW("%s in transfer %llu: native chan=%d flags=0x%02x len=%zu dec=%d, kotlin chan=%d flags=0x%02x len=%d dec=%d",
+         what, static_cast<unsigned long long>(transfers_),
+         native ? native->channel : -1, native ? native->flags : 0,
+         native ? native->length : 0, native ? native->decrypted : NOT_DECRYPTED,
+         kotlin ? kotlin[0] : -1, kotlin ? kotlin[1] : 0,
+         kotlin ? kotlin[2] : 0, kotlin ? kotlin[3] : NOT_DECRYPTED);
+}
+
+ShadowFramer::Stats ShadowFramer::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace aap
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "aap_framer.h"
+#include "tls_record.h"
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace aap {
+
+/**
+ * Runs the native framer, and optionally the native decrypt, in the
+ * shadow of the Kotlin parser, to check both see the same records.
+ *
+ * feed() gets each transfer just before Kotlin does. It frames the
+ * transfer and remembers every record, decrypting it into a scratch
+ * buffer once a read key is set; nothing is delivered. Kotlin parses the
+ * same transfer synchronously and reports the records it completed, with
+ * its own timing, through compare() before the next feed(). Records are
+ * matched in order on channel, flags and length, and on whether each path
+ * authenticated it. A record only one path saw from the transfer counts
+ * as native or Kotlin only.
+ *
+ * feed() and compare() must be called from the one thread delivering the
+ * transfers, getStats() from any.
+ */
+class ShadowFramer {
+public:
+    // Ints per record in compare(): channel, flags, length, decrypted
+    static constexpr size_t RECORD_FIELDS = 4;
+    // Decrypted field of a record Kotlin didn't decrypt
+    static constexpr int NOT_DECRYPTED = -1;
+    // Mismatches logged in detail, the rest are only counted
+    static constexpr uint64_t MAX_LOGGED_MISMATCHES = 16;
+
+    ShadowFramer();
+
+    // Non-copyable
+    ShadowFramer(const ShadowFramer&) = delete;
+    ShadowFramer& operator=(const ShadowFramer&) = delete;
+
+    /**
+     * Decrypt the shadowed records too, with the key Kotlin decrypts with.
+     * Must be called before the first feed() it should apply to.
+     * @return false on an invalid key
+     */
+    bool setReadKey(const uint8_t* key, size_t keyLength, const uint8_t* salt, uint64_t sequence);
+
+    /**
+     * Frame one transfer Kotlin is about to parse.
+     */
+    void feed(const uint8_t* data, size_t length);
+
+    /**
+     * Check the records Kotlin parsed from the last transfer.
+     * @param records RECORD_FIELDS ints per record, in stream order
+     * @param parseNs Kotlin time to frame the transfer
+     * @param decryptNs Kotlin time to decrypt its records
+     */
+    void compare(const int32_t* records, size_t count, uint64_t parseNs, uint64_t decryptNs);
+
+    struct Stats {
+        uint64_t transfers;
+        uint64_t bytes;
+        uint64_t nativeRecords;
+        uint64_t kotlinRecords;
+        uint64_t matched;
+        uint64_t mismatched;        // Same position, another channel, flags or length
+        uint64_t nativeOnly;
+        uint64_t kotlinOnly;
+        uint64_t decryptMismatches; // Authenticated by one path only
+        uint64_t nativeDecrypts;
+        uint64_t kotlinDecrypts;
+        uint64_t nativeFrameNs;
+        uint64_t nativeDecryptNs;
+        uint64_t kotlinParseNs;
+        uint64_t kotlinDecryptNs;
+    };
+    Stats getStats() const;
+
+private:
+    struct Expected {
+        int channel;
+        uint8_t flags;
+        size_t length;
+        int decrypted;      // NOT_DECRYPTED without a read key
+    };
+
+    AapFramer framer_;
+    TlsRecordLayer layer_;
+    std::unique_ptr<uint8_t[]> scratch_;
+
+    // Delivering thread only: records of the last transfer, not yet compared
+    std::vector<Expected> expected_;
+    uint64_t transfers_ = 0;
+    uint64_t logged_ = 0;
+
+    mutable std::mutex mutex_;
+    Stats stats_{};
+
+    void logMismatch(const char* what, const Expected* native, const int32_t* kotlin);
+};
+
+} // namespace aap
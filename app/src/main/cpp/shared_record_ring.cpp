@@ -0,0 +1,157 @@
+#include "shared_record_ring.h"
+#include "futex.h"
+#include <android/log.h>
+#include <cstring>
+#include <time.h>
+
+#define LOG_TAG "SharedRecordRing"
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+// Producer re-checks for shutdown at least this often while the ring is full
+constexpr uint64_t SPACE_WAIT_NS = 100 * 1000000ULL;
+
+uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+size_t alignedSize(size_t length) {
+    return (SharedRecordRing::HEADER_SIZE + length + SharedRecordRing::ALIGNMENT - 1) &
+           ~(SharedRecordRing::ALIGNMENT - 1);
+}
+
+} // anonymous namespace
+
+SharedRecordRing::SharedRecordRing(size_t capacity)
+    : ring_(RingBuffer::powerOfTwoCapacity(capacity))
+{
+}
+
+void SharedRecordRing::writeHeader(uint8_t* at, int32_t length, uint8_t channel, uint8_t flags) {
+    std::memcpy(at, &length, sizeof(length));
+    at[4] = channel;
+    at[5] = flags;
+    at[6] = 0;
+    at[7] = 0;
+}
+
+bool SharedRecordRing::publish(int channel, uint8_t flags, const uint8_t* data, size_t length) {
+    const size_t recordSize = alignedSize(length);
+    if (recordSize > ring_.capacity() / 2) {
+        LOGE("Record of %zu bytes doesn't fit the shared ring", length);
+        recordsRejected_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    while (true) {
+        if (shutdown_.load(std::memory_order_acquire)) {
+            recordsRejected_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        const RingBuffer::WriteSpan span = ring_.acquireWrite(recordSize);
+        const size_t toEnd = ring_.capacity() - static_cast<size_t>(span.data - ring_.data());
+        if (toEnd < recordSize && span.length == toEnd) {
+            // Records never wrap, pad out the tail of the ring
+            writeHeader(span.data, PADDING, 0, 0);
+            ring_.commitWrite(toEnd);
+            continue;
+        }
+        if (span.length < recordSize) {
+            waitForSpace(recordSize);
+            continue;
+        }
+
+        writeHeader(span.data, static_cast<int32_t>(length), static_cast<uint8_t>(channel), flags);
+        std::memcpy(span.data + HEADER_SIZE, data, length);
+        ring_.commitWrite(recordSize);
+        recordsPublished_.fetch_add(1, std::memory_order_relaxed);
+        bytesPublished_.fetch_add(length, std::memory_order_relaxed);
+
+        // Pairs with the fence in await()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (consumerWaiting_.load(std::memory_order_relaxed)) {
+            dataSeq_.fetch_add(1, std::memory_order_release);
+            futexWake(dataSeq_);
+        }
+        return true;
+    }
+}
+
+void SharedRecordRing::waitForSpace(size_t length) {
+    producerWaits_.fetch_add(1, std::memory_order_relaxed);
+
+    const uint32_t seq = spaceSeq_.load(std::memory_order_acquire);
+    producerWaiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (ring_.freeSpace() < length && !shutdown_.load(std::memory_order_acquire)) {
+        const struct timespec timeout = relativeTimeout(SPACE_WAIT_NS);
+        futexWait(spaceSeq_, seq, &timeout);
+    }
+    producerWaiting_.store(false, std::memory_order_relaxed);
+}
+
+int64_t SharedRecordRing::await(uint64_t readPosition, int timeoutMs) {
+    uint64_t head = readPosition_ + ring_.available();
+    if (readPosition > readPosition_ && readPosition <= head) {
+        ring_.release(static_cast<size_t>(readPosition - readPosition_));
+        readPosition_ = readPosition;
+
+        // Pairs with the fence in waitForSpace()
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (producerWaiting_.load(std::memory_order_relaxed)) {
+            spaceSeq_.fetch_add(1, std::memory_order_release);
+            futexWake(spaceSeq_);
+        }
+    }
+
+    const uint64_t deadline = monotonicNs() + static_cast<uint64_t>(timeoutMs > 0 ? timeoutMs : 0) * 1000000ULL;
+    while (true) {
+        head = readPosition_ + ring_.available();
+        if (head != readPosition_) {
+            return static_cast<int64_t>(head);
+        }
+        if (shutdown_.load(std::memory_order_acquire)) {
+            return -1;
+        }
+        const uint64_t now = monotonicNs();
+        if (now >= deadline) {
+            return static_cast<int64_t>(readPosition_);
+        }
+
+        const uint32_t seq = dataSeq_.load(std::memory_order_acquire);
+        consumerWaiting_.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (ring_.isEmpty() && !shutdown_.load(std::memory_order_acquire)) {
+            const struct timespec timeout = relativeTimeout(deadline - now);
+            futexWait(dataSeq_, seq, &timeout);
+        }
+        consumerWaiting_.store(false, std::memory_order_relaxed);
+    }
+}
+
+void SharedRecordRing::shutdown() {
+    shutdown_.store(true, std::memory_order_release);
+    spaceSeq_.fetch_add(1, std::memory_order_release);
+    futexWake(spaceSeq_);
+    dataSeq_.fetch_add(1, std::memory_order_release);
+    futexWake(dataSeq_);
+}
+
+SharedRecordRing::Stats SharedRecordRing::getStats() const {
+    Stats stats;
+    stats.recordsPublished = recordsPublished_.load(std::memory_order_relaxed);
+    stats.bytesPublished = bytesPublished_.load(std::memory_order_relaxed);
+    stats.producerWaits = producerWaits_.load(std::memory_order_relaxed);
+    stats.recordsRejected = recordsRejected_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace aap
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "ring_buffer.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace aap {
+
+/**
+ * Record ring shared with Kotlin as a DirectByteBuffer, so control records
+ * are drained by a Kotlin thread at its own pace instead of upcalls.
+ *
+ * Records are 8-byte aligned and never wrap:
+ *   [int32 length][uint8 channel][uint8 flags][2 reserved][payload][padding]
+ * A length of PADDING skips to the start of the ring. Integers are in
+ * native byte order, position p lives at offset p & (capacity() - 1).
+ *
+ * The producer waits for space instead of dropping: it runs on the
+ * AAP-Control thread, the dispatcher queue in front of it absorbs bursts.
+ * The consumer only moves forward through await(), which returns its
+ * space to the producer and parks on a futex until more is published.
+ */
+class SharedRecordRing {
+public:
+    static constexpr size_t HEADER_SIZE = 8;
+    static constexpr size_t ALIGNMENT = 8;
+    static constexpr int32_t PADDING = -1;
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+
+    /**
+     * @param capacity Ring size in bytes, rounded up to a power of two
+     */
+    explicit SharedRecordRing(size_t capacity = DEFAULT_CAPACITY);
+
+    // Non-copyable
+    SharedRecordRing(const SharedRecordRing&) = delete;
+    SharedRecordRing& operator=(const SharedRecordRing&) = delete;
+
+    /**
+     * Copy a record into the ring (producer side), waiting for space.
+     * @return false if the record is larger than half the ring, or after shutdown()
+     */
+    bool publish(int channel, uint8_t flags, const uint8_t* data, size_t length);
+
+    /**
+     * Consume everything before readPosition, then wait up to timeoutMs
+     * for records past it (consumer side, one thread).
+     * @return Write position, readPosition itself on timeout, or -1 once
+     *         shut down and drained
+     */
+    int64_t await(uint64_t readPosition, int timeoutMs);
+
+    /**
+     * Wake both sides: publish() fails and await() returns -1 once drained.
+     */
+    void shutdown();
+
+    uint8_t* data() const { return ring_.data(); }
+    size_t capacity() const { return ring_.capacity(); }
+
+    struct Stats {
+        uint64_t recordsPublished;
+        uint64_t bytesPublished;
+        uint64_t producerWaits;     // Ring full, Kotlin is behind
+        uint64_t recordsRejected;
+    };
+    Stats getStats() const;
+
+private:
+    RingBuffer ring_;
+    uint64_t readPosition_ = 0;     // Consumer only
+
+    // Producer parks on spaceSeq_, the consumer on dataSeq_
+    alignas(64) std::atomic<uint32_t> spaceSeq_{0};
+    std::atomic<bool> producerWaiting_{false};
+    alignas(64) std::atomic<uint32_t> dataSeq_{0};
+    std::atomic<bool> consumerWaiting_{false};
+    std::atomic<bool> shutdown_{false};
+
+    std::atomic<uint64_t> recordsPublished_{0};
+    std::atomic<uint64_t> bytesPublished_{0};
+    std::atomic<uint64_t> producerWaits_{0};
+    std::atomic<uint64_t> recordsRejected_{0};
+
+    static void writeHeader(uint8_t* at, int32_t length, uint8_t channel, uint8_t flags);
+    void waitForSpace(size_t length);
+};
+
+} // namespace aap
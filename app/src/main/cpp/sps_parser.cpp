@@ -0,0 +1,484 @@
+#include "sps_parser.h"
+#include <algorithm>
+
+namespace aap {
+
+namespace {
+
+// Exp-Golomb reader over RBSP, skipping emulation prevention bytes as it goes
+class BitReader {
+public:
+    BitReader(const uint8_t* data, size_t length) : data_(data), length_(length) {}
+
+    uint32_t bits(int count) {
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++) {
+            value = (value << 1) | bit();
+        }
+        return value;
+    }
+
+    uint32_t bit() {
+        if (bitPos_ == 0) {
+            // 00 00 03 -> 00 00
+            if (pos_ >= 2 && pos_ < length_ && data_[pos_] == 3 && data_[pos_ - 1] == 0 && data_[pos_ - 2] == 0) {
+                pos_++;
+            }
+        }
+        if (pos_ >= length_) {
+            overrun_ = true;
+            return 0;
+        }
+        const uint32_t value = (data_[pos_] >> (7 - bitPos_)) & 1;
+        if (++bitPos_ == 8) {
+            bitPos_ = 0;
+            pos_++;
+        }
+        return value;
+    }
+
+    void skip(int count) {
+        while (count-- > 0) {
+            bit();
+        }
+    }
+
+    uint32_t ue() {
+        int zeros = 0;
+        while (bit() == 0) {
+            if (++zeros > 31 || overrun_) {
+                overrun_ = true;
+                return 0;
+            }
+        }
+        return zeros == 0 ? 0 : ((1u << zeros) - 1) + bits(zeros);
+    }
+
+    int32_t se() {
+        const uint32_t value = ue();
+        return (value & 1) ? static_cast<int32_t>((value + 1) / 2) : -static_cast<int32_t>(value / 2);
+    }
+
+    bool ok() const { return !overrun_; }
+
+private:
+    const uint8_t* data_;
+    size_t length_;
+    size_t pos_ = 0;
+    int bitPos_ = 0;
+    bool overrun_ = false;
+};
+
+// Level limits: sample rate and minimum compression ratio (H.264 Table A-1,
+// H.265 Table A.8, Main tier)
+struct LevelLimit {
+    int level;
+    uint64_t maxRate;   // MaxMBPS for H.264, MaxLumaSr for H.265
+    int minCr;
+};
+
+constexpr LevelLimit H264_LEVELS[] = {
+    {9, 1485, 2}, {10, 1485, 2}, {11, 3000, 2}, {12, 6000, 2}, {13, 11880, 2},
+    {20, 11880, 2}, {21, 19800, 2}, {22, 20250, 2}, {30, 40500, 2},
+    {31, 108000, 4}, {32, 216000, 4}, {40, 245760, 4}, {41, 245760, 2}, {42, 522240, 2},
+    {50, 589824, 2}, {51, 983040, 2}, {52, 2073600, 2},
+};
+
+constexpr LevelLimit H265_LEVELS[] = {
+    {30, 552960, 2}, {60, 3686400, 2}, {63, 7372800, 2}, {90, 16588800, 2}, {93, 33177600, 2},
+    {120, 66846720, 4}, {123, 133693440, 4}, {150, 267386880, 6}, {153, 534773760, 8},
+    {156, 1069547520, 8}, {180, 1069547520, 8}, {183, 2139095040, 8}, {186, 4278190080ULL, 6},
+};
+
+// Both specs bound the first picture by a fraction of a second of the level's rate
+constexpr uint64_t H264_FIRST_PICTURE_DIVISOR = 172;
+constexpr uint64_t H265_FIRST_PICTURE_DIVISOR = 300;
+
+const LevelLimit* findLevel(bool h265, int level) {
+    const LevelLimit* begin = h265 ? H265_LEVELS : H264_LEVELS;
+    const LevelLimit* end = h265 ? H265_LEVELS + sizeof(H265_LEVELS) / sizeof(H265_LEVELS[0])
+                                 : H264_LEVELS + sizeof(H264_LEVELS) / sizeof(H264_LEVELS[0]);
+    for (const LevelLimit* limit = begin; limit != end; limit++) {
+        if (limit->level == level) {
+            return limit;
+        }
+    }
+    return nullptr;
+}
+
+// H.264 7.3.2.1.1.1, the values are only read past
+void skipScalingList(BitReader& reader, int size) {
+    int last = 8;
+    int next = 8;
+    for (int i = 0; i < size && next != 0; i++) {
+        next = (last + reader.se() + 256) % 256;
+        last = next == 0 ? last : next;
+    }
+}
+
+// Shared by both VUI syntaxes up to chroma_loc_info
+void skipVuiHeader(BitReader& reader) {
+    if (reader.bit()) {                 // aspect_ratio_info_present_flag
+        if (reader.bits(8) == 255) {    // Extended_SAR
+            reader.skip(32);
+        }
+    }
+    if (reader.bit()) {                 // overscan_info_present_flag
+        reader.skip(1);
+    }
+    if (reader.bit()) {                 // video_signal_type_present_flag
+        reader.skip(4);
+        if (reader.bit()) {             // colour_description_present_flag
+            reader.skip(24);
+        }
+    }
+    if (reader.bit()) {                 // chroma_loc_info_present_flag
+        reader.ue();
+        reader.ue();
+    }
+}
+
+void readTiming(BitReader& reader, VideoStreamInfo& info) {
+    const uint32_t units = reader.bits(32);
+    const uint32_t scale = reader.bits(32);
+    if (reader.ok() && units > 0 && scale > 0) {
+        info.numUnitsInTick = units;
+        info.timeScale = scale;
+    }
+}
+
+bool parseH264Sps(BitReader& reader, VideoStreamInfo& info) {
+    info.profile = static_cast<int>(reader.bits(8));
+    reader.skip(8);                     // constraint_set flags
+    info.level = static_cast<int>(reader.bits(8));
+    reader.ue();                        // seq_parameter_set_id
+
+    int chromaFormat = 1;
+    bool separateColourPlane = false;
+    switch (info.profile) {
+        case 100: case 110: case 122: case 244: case 44: case 83:
+        case 86: case 118: case 128: case 138: case 139: case 134: case 135: {
+            chromaFormat = static_cast<int>(reader.ue());
+            if (chromaFormat == 3) {
+                separateColourPlane = reader.bit() != 0;
+            }
+            info.bitDepth = 8 + static_cast<int>(reader.ue());
+            reader.ue();                // bit_depth_chroma_minus8
+            reader.skip(1);             // qpprime_y_zero_transform_bypass_flag
+            if (reader.bit()) {         // seq_scaling_matrix_present_flag
+                const int lists = chromaFormat == 3 ? 12 : 8;
+                for (int i = 0; i < lists; i++) {
+                    if (reader.bit()) {
+                        skipScalingList(reader, i < 6 ? 16 : 64);
+                    }
+                }
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    info.chromaFormat = chromaFormat;
+
+    reader.ue();                        // log2_max_frame_num_minus4
+    const uint32_t pocType = reader.ue();
+    if (pocType == 0) {
+        reader.ue();                    // log2_max_pic_order_cnt_lsb_minus4
+    } else if (pocType == 1) {
+        reader.skip(1);
+        reader.se();
+        reader.se();
+        const uint32_t cycle = reader.ue();
+        if (cycle > 255) {
+            return false;
+        }
+        for (uint32_t i = 0; i < cycle; i++) {
+            reader.se();
+        }
+    }
+    reader.ue();                        // max_num_ref_frames
+    reader.skip(1);                     // gaps_in_frame_num_value_allowed_flag
+    const uint32_t widthMbs = reader.ue() + 1;
+    const uint32_t heightMapUnits = reader.ue() + 1;
+    const bool frameMbsOnly = reader.bit() != 0;
+    if (!frameMbsOnly) {
+        reader.skip(1);                 // mb_adaptive_frame_field_flag
+    }
+    reader.skip(1);                     // direct_8x8_inference_flag
+    if (!reader.ok() || widthMbs > 1024 || heightMapUnits > 1024) {
+        return false;
+    }
+
+    info.codedWidth = static_cast<int>(widthMbs * 16);
+    info.codedHeight = static_cast<int>(heightMapUnits * 16 * (frameMbsOnly ? 1 : 2));
+    info.width = info.codedWidth;
+    info.height = info.codedHeight;
+    if (reader.bit()) {                 // frame_cropping_flag
+        const uint32_t left = reader.ue();
+        const uint32_t right = reader.ue();
+        const uint32_t top = reader.ue();
+        const uint32_t bottom = reader.ue();
+        const bool sampled = chromaFormat != 0 && !separateColourPlane;
+        const int cropX = sampled && chromaFormat < 3 ? 2 : 1;
+        const int cropY = (sampled && chromaFormat == 1 ? 2 : 1) * (frameMbsOnly ? 1 : 2);
+        info.width -= static_cast<int>((left + right) * cropX);
+        info.height -= static_cast<int>((top + bottom) * cropY);
+    }
+
+    if (reader.bit()) {                 // vui_parameters_present_flag
+        skipVuiHeader(reader);
+        if (reader.bit()) {             // timing_info_present_flag
+            readTiming(reader, info);
+        }
+    }
+    return reader.ok() && info.width > 0 && info.height > 0;
+}
+
+// H.265 7.3.3, general profile and level, sub-layer ones skipped
+void readProfileTierLevel(BitReader& reader, int maxSubLayersMinus1, VideoStreamInfo& info) {
+    reader.skip(2);                     // general_profile_space
+    info.highTier = reader.bit() != 0;
+    info.profile = static_cast<int>(reader.bits(5));
+    reader.skip(32 + 48);               // Compatibility and constraint flags
+    info.level = static_cast<int>(reader.bits(8));
+
+    bool profilePresent[8] = {};
+    bool levelPresent[8] = {};
+    for (int i = 0; i < maxSubLayersMinus1; i++) {
+        profilePresent[i] = reader.bit() != 0;
+        levelPresent[i] = reader.bit() != 0;
+    }
+    if (maxSubLayersMinus1 > 0) {
+        reader.skip(2 * (8 - maxSubLayersMinus1));
+    }
+    for (int i = 0; i < maxSubLayersMinus1; i++) {
+        if (profilePresent[i]) reader.skip(88);
+        if (levelPresent[i]) reader.skip(8);
+    }
+}
+
+// H.265 7.3.4
+void skipH265ScalingList(BitReader& reader) {
+    for (int sizeId = 0; sizeId < 4; sizeId++) {
+        for (int matrixId = 0; matrixId < 6; matrixId += sizeId == 3 ? 3 : 1) {
+            if (!reader.bit()) {        // scaling_list_pred_mode_flag
+                reader.ue();
+                continue;
+            }
+            const int coefficients = std::min(64, 1 << (4 + (sizeId << 1)));
+            if (sizeId > 1) {
+                reader.se();
+            }
+            for (int i = 0; i < coefficients; i++) {
+                reader.se();
+            }
+        }
+    }
+}
+
+// H.265 7.3.7, returns NumDeltaPocs of the set
+bool skipShortTermRefPicSet(BitReader& reader, uint32_t index, const uint32_t* deltaPocs, uint32_t& count) {
+    if (index != 0 && reader.bit()) {   // inter_ref_pic_set_prediction_flag
+        reader.skip(1);                 // delta_rps_sign
+        reader.ue();                    // abs_delta_rps_minus1
+        const uint32_t referenced = deltaPocs[index - 1];
+        count = 0;
+        for (uint32_t j = 0; j <= referenced; j++) {
+            const bool used = reader.bit() != 0;
+            if (used || reader.bit()) { // use_delta_flag, inferred 1 when used
+                count++;
+            }
+        }
+        return reader.ok();
+    }
+    const uint32_t negative = reader.ue();
+    const uint32_t positive = reader.ue();
+    if (negative > 16 || positive > 16) {
+        return false;
+    }
+    for (uint32_t i = 0; i < negative + positive; i++) {
+        reader.ue();                    // delta_poc_sx_minus1
+        reader.skip(1);                 // used_by_curr_pic_sx_flag
+    }
+    count = negative + positive;
+    return reader.ok();
+}
+
+bool parseH265Sps(BitReader& reader, VideoStreamInfo& info) {
+    reader.skip(4);                     // sps_video_parameter_set_id
+    const int maxSubLayersMinus1 = static_cast<int>(reader.bits(3));
+    reader.skip(1);                     // sps_temporal_id_nesting_flag
+    readProfileTierLevel(reader, maxSubLayersMinus1, info);
+    reader.ue();                        // sps_seq_parameter_set_id
+
+    const int chromaFormat = static_cast<int>(reader.ue());
+    if (chromaFormat > 3) {
+        return false;
+    }
+    bool separateColourPlane = false;
+    if (chromaFormat == 3) {
+        separateColourPlane = reader.bit() != 0;
+    }
+    info.chromaFormat = chromaFormat;
+    info.codedWidth = static_cast<int>(reader.ue());
+    info.codedHeight = static_cast<int>(reader.ue());
+    if (!reader.ok() || info.codedWidth <= 0 || info.codedHeight <= 0 ||
+        info.codedWidth > 16888 || info.codedHeight > 16888) {
+        return false;
+    }
+    info.width = info.codedWidth;
+    info.height = info.codedHeight;
+    if (reader.bit()) {                 // conformance_window_flag
+        const uint32_t left = reader.ue();
+        const uint32_t right = reader.ue();
+        const uint32_t top = reader.ue();
+        const uint32_t bottom = reader.ue();
+        const bool sampled = chromaFormat != 0 && !separateColourPlane;
+        const int cropX = sampled && chromaFormat < 3 ? 2 : 1;
+        const int cropY = sampled && chromaFormat == 1 ? 2 : 1;
+        info.width -= static_cast<int>((left + right) * cropX);
+        info.height -= static_cast<int>((top + bottom) * cropY);
+    }
+    info.bitDepth = 8 + static_cast<int>(reader.ue());
+    reader.ue();                        // bit_depth_chroma_minus8
+    const int pocLsbBits = 4 + static_cast<int>(reader.ue());
+    if (pocLsbBits > 16) {
+        return false;
+    }
+    const bool orderingInfo = reader.bit() != 0;
+    for (int i = orderingInfo ? 0 : maxSubLayersMinus1; i <= maxSubLayersMinus1; i++) {
+        reader.ue();
+        reader.ue();
+        reader.ue();
+    }
+    for (int i = 0; i < 6; i++) {
+        reader.ue();                    // Coding and transform block sizes, hierarchy depths
+    }
+    if (reader.bit() && reader.bit()) { // scaling_list_enabled, sps_scaling_list_data_present
+        skipH265ScalingList(reader);
+    }
+    reader.skip(2);                     // amp_enabled_flag, sample_adaptive_offset_enabled_flag
+    if (reader.bit()) {                 // pcm_enabled_flag
+        reader.skip(8);
+        reader.ue();
+        reader.ue();
+        reader.skip(1);
+    }
+
+    const uint32_t sets = reader.ue();
+    if (sets > 64) {
+        return false;
+    }
+    uint32_t deltaPocs[64];
+    for (uint32_t i = 0; i < sets; i++) {
+        if (!skipShortTermRefPicSet(reader, i, deltaPocs, deltaPocs[i])) {
+            return false;
+        }
+    }
+    if (reader.bit()) {                 // long_term_ref_pics_present_flag
+        const uint32_t longTerm = reader.ue();
+        if (longTerm > 32) {
+            return false;
+        }
+        reader.skip(static_cast<int>(longTerm) * (pocLsbBits + 1));
+    }
+    reader.skip(2);                     // sps_temporal_mvp_enabled_flag, strong_intra_smoothing_enabled_flag
+
+    if (reader.bit()) {                 // vui_parameters_present_flag
+        skipVuiHeader(reader);
+        reader.skip(3);                 // neutral_chroma, field_seq, frame_field_info_present
+        if (reader.bit()) {             // default_display_window_flag
+            for (int i = 0; i < 4; i++) {
+                reader.ue();
+            }
+        }
+        if (reader.bit()) {             // vui_timing_info_present_flag
+            readTiming(reader, info);
+        }
+    }
+    return reader.ok() && info.width > 0 && info.height > 0;
+}
+
+} // anonymous namespace
+
+double VideoStreamInfo::frameRate() const {
+    if (numUnitsInTick == 0 || timeScale == 0) {
+        return 0;
+    }
+    // H.264 ticks are fields
+    return static_cast<double>(timeScale) / numUnitsInTick / (h265 ? 1 : 2);
+}
+
+size_t VideoStreamInfo::maxFrameBytes() const {
+    // Bytes per luma sample of the raw picture, x8
+    static constexpr uint64_t CHROMA_FACTOR_X8[] = {8, 12, 16, 24};
+    const uint64_t samples = static_cast<uint64_t>(std::max(codedWidth, 0)) * std::max(codedHeight, 0);
+    const uint64_t factor = CHROMA_FACTOR_X8[std::min(std::max(chromaFormat, 0), 3)] * std::max(bitDepth, 8) / 8;
+
+    const LevelLimit* limit = findLevel(h265, level);
+    if (!limit) {
+        // Unknown level, assume the loosest ratio any level allows
+        return static_cast<size_t>(samples * factor / 8 / 2);
+    }
+    // H.264 rates are in macroblocks
+    const uint64_t rateSamples = h265 ? limit->maxRate : limit->maxRate * 256;
+    const uint64_t divisor = h265 ? H265_FIRST_PICTURE_DIVISOR : H264_FIRST_PICTURE_DIVISOR;
+    const uint64_t bound = std::max(samples, rateSamples / divisor);
+    return static_cast<size_t>(bound * factor / 8 / static_cast<uint64_t>(limit->minCr));
+}
+
+bool SpsParser::parseSps(VideoCodec codec, const uint8_t* nal, size_t length, VideoStreamInfo& info) {
+    const bool h265 = codec == VideoCodec::H265;
+    const size_t header = h265 ? 2 : 1;
+    if (!nal || length <= header || NalScanner::nalType(codec, nal[0]) != (h265 ? 33 : 7)) {
+        return false;
+    }
+
+    VideoStreamInfo parsed;
+    parsed.h265 = h265;
+    // Timing the VPS provided stays unless the SPS has its own
+    parsed.numUnitsInTick = info.numUnitsInTick;
+    parsed.timeScale = info.timeScale;
+    BitReader reader(nal + header, length - header);
+    if (!(h265 ? parseH265Sps(reader, parsed) : parseH264Sps(reader, parsed))) {
+        return false;
+    }
+    info = parsed;
+    return true;
+}
+
+bool SpsParser::parseVps(const uint8_t* nal, size_t length, VideoStreamInfo& info) {
+    if (!nal || length <= 2 || NalScanner::nalType(VideoCodec::H265, nal[0]) != 32) {
+        return false;
+    }
+
+    BitReader reader(nal + 2, length - 2);
+    reader.skip(4 + 2 + 6);             // vps_video_parameter_set_id, layer flags, vps_max_layers_minus1
+    const int maxSubLayersMinus1 = static_cast<int>(reader.bits(3));
+    reader.skip(1 + 16);                // vps_temporal_id_nesting_flag, reserved
+    VideoStreamInfo parsed = info;
+    readProfileTierLevel(reader, maxSubLayersMinus1, parsed);
+    const bool orderingInfo = reader.bit() != 0;
+    for (int i = orderingInfo ? 0 : maxSubLayersMinus1; i <= maxSubLayersMinus1; i++) {
+        reader.ue();
+        reader.ue();
+        reader.ue();
+    }
+    const uint32_t maxLayerId = reader.bits(6);
+    const uint32_t layerSets = reader.ue() + 1;
+    if (layerSets > 1024) {
+        return false;
+    }
+    reader.skip(static_cast<int>((layerSets - 1) * (maxLayerId + 1)));
+    if (reader.bit()) {                 // vps_timing_info_present_flag
+        readTiming(reader, parsed);
+    }
+    if (!reader.ok()) {
+        return false;
+    }
+    parsed.h265 = true;
+    info = parsed;
+    return true;
+}
+
+} // namespace aap
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "nal_scanner.h"
+#include <cstdint>
+#include <cstddef>
+
+namespace aap {
+
+/**
+ * What a sequence parameter set says about the stream, enough to
+ * configure a decoder before the first picture arrives.
+ */
+struct VideoStreamInfo {
+    int profile = 0;            // profile_idc, general_profile_idc for H.265
+    int level = 0;              // level_idc (31 = 3.1), general_level_idc (93 = 3.1) for H.265
+    bool highTier = false;      // H.265 only
+    int chromaFormat = 1;       // 0 monochrome, 1 4:2:0, 2 4:2:2, 3 4:4:4
+    int bitDepth = 8;
+    int codedWidth = 0;         // Decoded picture, macroblock or CTB aligned
+    int codedHeight = 0;
+    int width = 0;              // After the cropping / conformance window
+    int height = 0;
+    uint32_t numUnitsInTick = 0; // VUI timing, 0 when absent
+    uint32_t timeScale = 0;
+    bool h265 = false;
+
+    /**
+     * Frames per second from VUI timing, 0 without it.
+     */
+    double frameRate() const;
+
+    /**
+     * Upper bound on one coded picture: the raw picture over the level's
+     * minimum compression ratio, as the Level limits of both specs put it.
+     */
+    size_t maxFrameBytes() const;
+};
+
+/**
+ * H.264 / H.265 parameter set parser.
+ *
+ * Reads the fields up to and including VUI timing; everything after is
+ * left alone. Emulation prevention bytes are skipped while reading, so the
+ * NAL unit is parsed where it lies. Truncated or unsupported parameter
+ * sets fail rather than yield partial results.
+ */
+class SpsParser {
+public:
+    /**
+     * @param nal NAL unit from its header byte(s), without the start code
+     * @return false if the NAL unit isn't a parseable SPS
+     */
+    static bool parseSps(VideoCodec codec, const uint8_t* nal, size_t length, VideoStreamInfo& info);
+
+    /**
+     * Take profile, level and timing from an H.265 VPS, for an SPS
+     * without VUI timing. Fields the VPS doesn't carry are left as they are.
+     */
+    static bool parseVps(const uint8_t* nal, size_t length, VideoStreamInfo& info);
+};
+
+} // namespace aap
@@ -0,0 +1,296 @@
+#include "stall_watchdog.h"
+#include "latency_histogram.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define LOG_TAG "StallWatchdog"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+constexpr uint64_t NS_PER_MS = 1000000;
+
+uint64_t msSince(uint64_t nowNs, uint64_t thenNs) {
+    return nowNs > thenNs ? (nowNs - thenNs) / NS_PER_MS : 0;
+}
+
+// Reads a small /proc file whole, NUL terminated
+bool readProcFile(const char* path, char* buffer, size_t capacity) {
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    const ssize_t length = ::read(fd, buffer, capacity - 1);
+    ::close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+    return true;
+}
+
+} // anonymous namespace
+
+void SnapshotText::append(const char* format, ...) {
+    if (length_ + 1 >= capacity_) {
+        return;
+    }
+    va_list args;
+    va_start(args, format);
+    const int written = vsnprintf(buffer_ + length_, capacity_ - length_, format, args);
+    va_end(args);
+    if (written > 0) {
+        length_ = std::min(length_ + static_cast<size_t>(written), capacity_ - 1);
+    }
+}
+
+StallWatchdog::StallWatchdog(int thresholdMs, int intervalMs)
+    : threshold_(thresholdMs > 0 ? thresholdMs : DEFAULT_THRESHOLD_MS)
+    , interval_(intervalMs > 0 ? intervalMs : DEFAULT_INTERVAL_MS)
+{
+    stats_.lastStalled = -1;
+}
+
+StallWatchdog::~StallWatchdog() {
+    stop();
+    if (map_) {
+        munmap(map_, SNAPSHOT_SIZE);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool StallWatchdog::open(const char* path) {
+    if (fd_ >= 0) {
+        return false;
+    }
+
+    fd_ = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd_ < 0) {
+        LOGE("Cannot create %s: %s", path, strerror(errno));
+        return false;
+    }
+    void* mapped = MAP_FAILED;
+    if (ftruncate(fd_, static_cast<off_t>(SNAPSHOT_SIZE)) == 0) {
+        mapped = mmap(nullptr, SNAPSHOT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    }
+    if (mapped == MAP_FAILED) {
+        LOGE("Cannot map %s: %s", path, strerror(errno));
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    map_ = static_cast<char*>(mapped);
+    return true;
+}
+
+void StallWatchdog::watch(const char* name, const char* thread, WatchProbe probe) {
+    Watched w;
+    w.name = name;
+    w.thread = thread;
+    w.probe = std::move(probe);
+    watched_.push_back(std::move(w));
+}
+
+void StallWatchdog::setDetails(SnapshotDetails details) {
+    details_ = std::move(details);
+}
+
+void StallWatchdog::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    episode_ = false;
+    const uint64_t nowNs = LatencyHistogram::now();
+    for (Watched& w : watched_) {
+        w.last = w.probe();
+        w.advancedNs = nowNs;
+        w.busySinceNs = nowNs;
+        w.stalled = false;
+    }
+    thread_ = std::thread(&StallWatchdog::watchdogLoop, this);
+    LOGD("Stall watchdog started, %zu probes, threshold %lld ms", watched_.size(),
+         static_cast<long long>(threshold_.count()));
+}
+
+void StallWatchdog::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void StallWatchdog::watchdogLoop() {
+    applyThreadPolicy("AAP-Watchdog");
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        lock.unlock();
+        check(LatencyHistogram::now());
+        lock.lock();
+        wake_.wait_for(lock, interval_, [this] { return !running_; });
+    }
+}
+
+void StallWatchdog::check(uint64_t nowNs) {
+    const uint64_t thresholdNs = static_cast<uint64_t>(threshold_.count()) * NS_PER_MS;
+    size_t stalledNow = 0;
+    size_t first = watched_.size();
+    uint64_t longestMs = 0;
+
+    for (size_t i = 0; i < watched_.size(); i++) {
+        Watched& w = watched_[i];
+        const WatchSample sample = w.probe();
+        if (sample.progress != w.last.progress) {
+            w.advancedNs = nowNs;
+            w.busySinceNs = nowNs;
+        } else if (sample.pending == 0) {
+            w.busySinceNs = nowNs;
+        }
+        w.last = sample;
+
+        const uint64_t busyNs = nowNs - w.busySinceNs;
+        w.stalled = busyNs >= thresholdNs;
+        if (w.stalled) {
+            longestMs = std::max(longestMs, busyNs / NS_PER_MS);
+            stalledNow++;
+            // The longest stalled is the likeliest cause, the others wait on it
+            if (first == watched_.size() || w.busySinceNs < watched_[first].busySinceNs) {
+                first = i;
+            }
+        }
+    }
+
+    const bool newEpisode = stalledNow > 0 && !episode_;
+    episode_ = stalledNow > 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.checks++;
+        stats_.stalledNow = stalledNow;
+        stats_.longestStallMs = std::max(stats_.longestStallMs, longestMs);
+        if (newEpisode) {
+            stats_.stalls++;
+            stats_.lastStalled = static_cast<int>(first);
+        }
+    }
+    if (newEpisode) {
+        const Watched& w = watched_[first];
+        LOGE("Stall: %s (%s) made no progress for %llu ms with %llu pending", w.name.c_str(),
+             w.thread.c_str(), static_cast<unsigned long long>(msSince(nowNs, w.busySinceNs)),
+             static_cast<unsigned long long>(w.last.pending));
+        writeSnapshot(nowNs, first);
+    }
+}
+
+void StallWatchdog::writeSnapshot(uint64_t nowNs, size_t stalled) {
+    if (!map_) {
+        return;
+    }
+
+    SnapshotText out(map_, SNAPSHOT_SIZE);
+    const Watched& cause = watched_[stalled];
+    uint64_t episodes;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        episodes = stats_.stalls;
+    }
+    out.append("AAP stall snapshot %llu at %llu ms (CLOCK_MONOTONIC)\n",
+               static_cast<unsigned long long>(episodes), static_cast<unsigned long long>(nowNs / NS_PER_MS));
+    out.append("stalled: %s on %s, no progress for %llu ms\n\n", cause.name.c_str(), cause.thread.c_str(),
+               static_cast<unsigned long long>(msSince(nowNs, cause.busySinceNs)));
+
+    out.append("%-14s %-16s %12s %10s %10s\n", "probe", "thread", "progress", "pending", "moved_ms");
+    for (const Watched& w : watched_) {
+        out.append("%-14s %-16s %12llu %10llu %10llu%s\n", w.name.c_str(), w.thread.c_str(),
+                   static_cast<unsigned long long>(w.last.progress),
+                   static_cast<unsigned long long>(w.last.pending),
+                   static_cast<unsigned long long>(msSince(nowNs, w.advancedNs)),
+                   w.stalled ? " STALLED" : "");
+    }
+
+    if (details_) {
+        out.append("\n");
+        details_(out);
+    }
+
+    out.append("\n");
+    appendThreads(out);
+
+    // The rest of the previous snapshot must not read as part of this one
+    std::memset(map_ + out.length(), 0, SNAPSHOT_SIZE - out.length());
+    msync(map_, SNAPSHOT_SIZE, MS_ASYNC);
+}
+
+void StallWatchdog::appendThreads(SnapshotText& out) {
+    DIR* dir = opendir("/proc/self/task");
+    if (!dir) {
+        out.append("threads: /proc/self/task unreadable: %s\n", strerror(errno));
+        return;
+    }
+
+    // state: R running, S sleeping, D uninterruptible (I/O), T stopped;
+    // utime and stime in clock ticks, wchan where the kernel lets apps see it
+    out.append("%-7s %-16s %5s %8s %8s %s\n", "tid", "name", "state", "utime", "stime", "wchan");
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+            continue;
+        }
+        // Room for any d_name, which keeps -Wformat-truncation quiet
+        char path[sizeof("/proc/self/task//wchan") + sizeof(entry->d_name)];
+        char stat[512];
+        snprintf(path, sizeof(path), "/proc/self/task/%s/stat", entry->d_name);
+        if (!readProcFile(path, stat, sizeof(stat))) {
+            continue;
+        }
+
+        // tid (comm) state ...; comm is at most 15 characters and may hold spaces or parens
+        const char* open = strchr(stat, '(');
+        const char* close = strrchr(stat, ')');
+        if (!open || !close || close < open) {
+            continue;
+        }
+        char state = '?';
+        unsigned long utime = 0;
+        unsigned long stime = 0;
+        sscanf(close + 1, " %c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &state, &utime, &stime);
+
+        char wchan[64] = "-";
+        snprintf(path, sizeof(path), "/proc/self/task/%s/wchan", entry->d_name);
+        if (!readProcFile(path, wchan, sizeof(wchan)) || strcmp(wchan, "0") == 0) {
+            strcpy(wchan, "-");
+        }
+
+        out.append("%-7s %-16.*s %5c %8lu %8lu %s\n", entry->d_name, static_cast<int>(close - open - 1), open + 1,
+                   state, utime, stime, wchan);
+    }
+    closedir(dir);
+}
+
+StallWatchdog::Stats StallWatchdog::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+} // namespace aap
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace aap {
+
+/**
+ * One look at a watched thread. progress is a running total of work it
+ * finished; pending is work waiting for it, 0 when it is idle.
+ */
+struct WatchSample {
+    uint64_t progress = 0;
+    uint64_t pending = 0;
+};
+
+/**
+ * Called on the watchdog thread. Must not block on the watched thread.
+ */
+using WatchProbe = std::function<WatchSample()>;
+
+/**
+ * Text of a snapshot being written, straight into the mapped file.
+ */
+class SnapshotText {
+public:
+    SnapshotText(char* buffer, size_t capacity) : buffer_(buffer), capacity_(capacity) {}
+
+    void append(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    size_t length() const { return length_; }
+
+private:
+    char* buffer_;
+    size_t capacity_;
+    size_t length_ = 0;
+};
+
+/**
+ * Adds what the probes don't say to a snapshot, called on the watchdog thread.
+ */
+using SnapshotDetails = std::function<void(SnapshotText& out)>;
+
+/**
+ * Stall watchdog for the native pipeline threads.
+ *
+ * Every interval the AAP-Watchdog thread samples its probes: heartbeat
+ * counters the watched threads bump anyway, so watching costs them
+ * nothing. A probe whose progress hasn't moved for the threshold while it
+ * has work pending is stalled, and the first stall of an episode writes a
+ * snapshot to a memory-mapped file: every probe with its progress,
+ * pending work and time since it last moved, the owner's details (queue
+ * depths, transfers in flight), and the state and CPU time of every
+ * thread of the process from /proc/self/task. The file is mapped up
+ * front, so a snapshot neither allocates nor opens anything, and the
+ * kernel writes it back even if the process is killed right after.
+ *
+ * Probes without pending work, like stage counters, are listed for the
+ * time since they last moved but never stall.
+ */
+class StallWatchdog {
+public:
+    static constexpr int DEFAULT_INTERVAL_MS = 100;
+    static constexpr int DEFAULT_THRESHOLD_MS = 2000;
+    static constexpr size_t SNAPSHOT_SIZE = 64 * 1024;
+
+    explicit StallWatchdog(int thresholdMs = DEFAULT_THRESHOLD_MS, int intervalMs = DEFAULT_INTERVAL_MS);
+    ~StallWatchdog();
+
+    // Non-copyable
+    StallWatchdog(const StallWatchdog&) = delete;
+    StallWatchdog& operator=(const StallWatchdog&) = delete;
+
+    /**
+     * Create, or truncate, and map the snapshot file.
+     * @return false if it can't be created or mapped
+     */
+    bool open(const char* path);
+
+    /**
+     * Must be called before start().
+     * @param name Shown in the snapshot
+     * @param thread Name of the thread behind it, shown in the snapshot
+     */
+    void watch(const char* name, const char* thread, WatchProbe probe);
+    void setDetails(SnapshotDetails details);
+
+    void start();
+    void stop();
+
+    struct Stats {
+        uint64_t checks;
+        uint64_t stalls;            // Episodes, each wrote one snapshot
+        uint64_t stalledNow;        // Probes stalled at the last check
+        uint64_t longestStallMs;    // Longest a probe went without progress with work pending
+        int lastStalled;            // Probe index of the last episode, -1 if none yet
+    };
+    Stats getStats() const;
+
+private:
+    struct Watched {
+        std::string name;
+        std::string thread;
+        WatchProbe probe;
+        WatchSample last;
+        uint64_t advancedNs = 0;    // Progress last moved
+        uint64_t busySinceNs = 0;   // Progress last moved, or last idle
+        bool stalled = false;
+    };
+
+    const std::chrono::milliseconds threshold_;
+    const std::chrono::milliseconds interval_;
+    std::vector<Watched> watched_;
+    SnapshotDetails details_;
+
+    int fd_ = -1;
+    char* map_ = nullptr;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+    bool running_ = false;
+    bool episode_ = false;          // Watchdog thread only, a snapshot was written for it
+
+    Stats stats_{};
+
+    void watchdogLoop();
+    void check(uint64_t nowNs);
+    void writeSnapshot(uint64_t nowNs, size_t stalled);
+    static void appendThreads(SnapshotText& out);
+};
+
+} // namespace aap
@@ -0,0 +1,256 @@
+#include "stats_export.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define LOG_TAG "StatsExport"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "the sequence is shared with other processes");
+static_assert(StatsLayout::SECTION_COUNT <= StatsExportHeader::MAX_SECTIONS, "header section table too small");
+// Readers hardcode these, NativeStatsFile among them
+static_assert(offsetof(StatsExportHeader, sequence) == 16 && offsetof(StatsExportHeader, present) == 40 &&
+              offsetof(StatsExportHeader, sections) == 48, "header layout changed, bump VERSION");
+
+namespace {
+
+int64_t value(uint64_t v) {
+    return static_cast<int64_t>(v);
+}
+
+void packLane(int64_t* out, const ChannelDispatcher::QueueStats& stats,
+              const ChannelDispatcher::LaneProgress& progress) {
+    out[0] = value(stats.messagesDispatched);
+    out[1] = value(progress.delivered);
+    out[2] = value(progress.depth);
+    out[3] = value(stats.queueDrops);
+    out[4] = value(stats.queueBlocks);
+    out[5] = value(stats.blockedNs);
+    out[6] = value(stats.bytesDispatched);
+    out[7] = value(stats.queueHighWater);
+    out[8] = value(stats.batchesDelivered);
+}
+
+} // anonymous namespace
+
+int64_t* StatsValues::section(StatsLayout::Section section) {
+    present_ |= 1u << section;
+    return values_ + StatsLayout::offsetOf(section);
+}
+
+void StatsValues::transport(const TransportProgress& progress) {
+    int64_t* out = section(StatsLayout::TRANSPORT);
+    out[0] = value(progress.deliveries);
+    out[1] = progress.delivering ? 1 : 0;
+    out[2] = value(progress.txCompleted);
+    out[3] = value(progress.txPending);
+    out[4] = value(progress.rxInFlight);
+}
+
+void StatsValues::link(const UsbLinkMonitor::Stats& stats) {
+    int64_t* out = section(StatsLayout::LINK);
+    out[0] = stats.speed;
+    out[1] = value(stats.bytesIn);
+    out[2] = value(stats.bytesOut);
+    out[3] = value(stats.transfersIn);
+    out[4] = value(stats.transfersOut);
+    out[5] = value(stats.shortTransfersIn);
+    out[6] = value(stats.bytesInPerSec);
+    out[7] = value(stats.bytesOutPerSec);
+    out[8] = value(stats.inFlight);
+    out[9] = value(stats.inFlightAvgMilli);
+    out[10] = value(stats.endpointIdleNs);
+    out[11] = value(stats.resubmitGapTotalNs);
+    out[12] = value(stats.resubmitGapMaxNs);
+    for (size_t i = 0; i < UsbLinkMonitor::STATUS_COUNT; i++) {
+        out[13 + i] = value(stats.failures[i]);
+    }
+    out[13 + UsbLinkMonitor::STATUS_COUNT] = value(stats.retryRounds);
+    out[14 + UsbLinkMonitor::STATUS_COUNT] = value(stats.haltsCleared);
+}
+
+void StatsValues::latency(const PipelineLatency& latency) {
+    latency.pack(section(StatsLayout::LATENCY));
+}
+
+void StatsValues::lanes(const ChannelDispatcher& dispatcher) {
+    int64_t* out = section(StatsLayout::LANES);
+    const ChannelDispatcher::Stats stats = dispatcher.getStats();
+    const ChannelDispatcher::QueueStats* lanes[StatsLayout::LANE_COUNT] = {
+        &stats.audio, &stats.video, &stats.control, &stats.background
+    };
+    for (size_t i = 0; i < StatsLayout::LANE_COUNT; i++) {
+        packLane(out + i * StatsLayout::LANE_FIELDS, *lanes[i],
+                 dispatcher.laneProgress(static_cast<ChannelPriority>(i)));
+    }
+}
+
+void StatsValues::video(const VideoAssembler::Stats* assembler, const DecoderCounts* decoder) {
+    if (!assembler && !decoder) {
+        return;
+    }
+    int64_t* out = section(StatsLayout::VIDEO);
+    if (assembler) {
+        out[0] = value(assembler->framesAssembled);
+        out[1] = value(assembler->framesDropped);
+        out[2] = value(assembler->recordsDropped);
+        out[3] = value(assembler->parameterSetUpdates);
+        out[4] = value(assembler->framesQueued);
+        out[5] = value(assembler->framesDirect);
+        out[6] = value(assembler->keyframeRequests);
+        out[7] = value(assembler->framesSkippedIdle);
+        out[8] = value(assembler->keyframesCached);
+        out[9] = value(assembler->keyframesReplayed);
+    }
+    if (decoder) {
+        int64_t* d = out + StatsLayout::VIDEO_ASSEMBLER_FIELDS;
+        d[0] = value(decoder->framesQueued);
+        d[1] = value(decoder->framesCopied);
+        d[2] = value(decoder->framesSkipped);
+        d[3] = value(decoder->framesRendered);
+        d[4] = value(decoder->codecErrors);
+        d[5] = value(decoder->framesLate);
+    }
+}
+
+void StatsValues::pool(const RecordPool::Stats& stats) {
+    int64_t* out = section(StatsLayout::POOL);
+    for (int i = 0; i < RecordPool::NUM_CLASSES; i++) {
+        const RecordPool::ClassStats& cls = stats.classes[i];
+        out[i * 4] = value(cls.size);
+        out[i * 4 + 1] = value(cls.slabs);
+        out[i * 4 + 2] = value(cls.inUse);
+        out[i * 4 + 3] = value(cls.highWater);
+    }
+    out[RecordPool::NUM_CLASSES * 4] = value(stats.promotions);
+    out[RecordPool::NUM_CLASSES * 4 + 1] = value(stats.exhausted);
+}
+
+StatsExport::StatsExport(int intervalMs)
+    : interval_(intervalMs > 0 ? intervalMs : DEFAULT_INTERVAL_MS)
+    , staging_(new StatsValues())
+{
+}
+
+StatsExport::~StatsExport() {
+    stop();
+    if (map_) {
+        munmap(map_, fileSize());
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+}
+
+bool StatsExport::open(const char* path) {
+    if (fd_ >= 0) {
+        return false;
+    }
+
+    fd_ = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd_ < 0) {
+        LOGE("Cannot create %s: %s", path, strerror(errno));
+        return false;
+    }
+    void* mapped = MAP_FAILED;
+    if (ftruncate(fd_, static_cast<off_t>(fileSize())) == 0) {
+        mapped = mmap(nullptr, fileSize(), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    }
+    if (mapped == MAP_FAILED) {
+        LOGE("Cannot map %s: %s", path, strerror(errno));
+        ::close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    map_ = mapped;
+
+    // The truncated file reads as zeros: sequence 0 and nothing present
+    header_ = new (map_) StatsExportHeader();
+    header_->headerSize = static_cast<uint32_t>(headerSize());
+    header_->valueCount = static_cast<uint32_t>(StatsLayout::VALUE_COUNT);
+    header_->sectionCount = StatsLayout::SECTION_COUNT;
+    for (size_t i = 0; i < StatsLayout::SECTION_COUNT; i++) {
+        header_->sections[i].offset = static_cast<uint32_t>(StatsLayout::offsetOf(static_cast<StatsLayout::Section>(i)));
+        header_->sections[i].count = static_cast<uint32_t>(StatsLayout::SIZES[i]);
+    }
+    header_->version = StatsExportHeader::VERSION;
+    values_ = reinterpret_cast<int64_t*>(static_cast<char*>(map_) + headerSize());
+    // Last, so a reader that sees the magic sees the whole header
+    std::atomic_thread_fence(std::memory_order_release);
+    header_->magic = StatsExportHeader::MAGIC;
+    return true;
+}
+
+void StatsExport::setCollector(Collector collector) {
+    collector_ = std::move(collector);
+}
+
+void StatsExport::publish() {
+    if (!header_ || !collector_) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(publishMutex_);
+    StatsValues& staged = *staging_;
+    std::memset(staged.values_, 0, sizeof(staged.values_));
+    staged.present_ = 0;
+    collector_(staged);
+
+    const uint64_t sequence = header_->sequence.load(std::memory_order_relaxed);
+    header_->sequence.store(sequence + 1, std::memory_order_relaxed);
+    // Orders the odd sequence before the values, for readers
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(values_, staged.values_, sizeof(staged.values_));
+    header_->present = staged.present_;
+    header_->publishedNs = LatencyHistogram::now();
+    header_->publishes++;
+    header_->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void StatsExport::start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    thread_ = std::thread(&StatsExport::exportLoop, this);
+    LOGD("Stats export started, %zu values every %lld ms", StatsLayout::VALUE_COUNT,
+         static_cast<long long>(interval_.count()));
+}
+
+void StatsExport::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+    }
+    wake_.notify_all();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void StatsExport::exportLoop() {
+    applyThreadPolicy("AAP-Stats");
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        lock.unlock();
+        publish();
+        lock.lock();
+        wake_.wait_for(lock, interval_, [this] { return !running_; });
+    }
+}
+
+} // namespace aap
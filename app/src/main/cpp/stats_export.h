@@ -0,0 +1,202 @@
+#pragma once
+
+#include "channel_dispatcher.h"
+#include "latency_histogram.h"
+#include "record_pool.h"
+#include "transport.h"
+#include "usb_link_monitor.h"
+#include "video_assembler.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace aap {
+
+/**
+ * Fixed layout of the exported stats, one int64 per value.
+ *
+ * Sections keep their place whether or not the stage is running: a stage
+ * that isn't has its present bit clear and its values zero. New values
+ * are only ever appended to a section's end or as a new section, both a
+ * version bump; readers find a section through the header table, so an
+ * older reader keeps working on a newer file.
+ */
+namespace StatsLayout {
+
+enum Section {
+    TRANSPORT,  // deliveries, delivering, tx completed, tx pending, rx in flight
+    LINK,       // USB only, in NativeUsb.getLinkStats() order
+    LATENCY,    // Per PipelineLatency stage: count, mean, p50, p90, p99, p99.9, max (ns)
+    LANES,      // Per lane (audio, video, control, background): LANE_FIELDS values
+    VIDEO,      // Assembler, in NativeUsb.getVideoStats() order, then the decoder's
+    POOL,       // Per record pool class: size, slabs, in use, high water; promotions, exhausted
+    SECTION_COUNT
+};
+
+// Per lane: dispatched, delivered, depth, drops, blocks, blocked ns, bytes, high water, batches
+constexpr size_t LANE_FIELDS = 9;
+constexpr size_t LANE_COUNT = 4;
+constexpr size_t VIDEO_ASSEMBLER_FIELDS = 10;
+constexpr size_t VIDEO_DECODER_FIELDS = 6;
+
+constexpr size_t SIZES[SECTION_COUNT] = {
+    5,
+    13 + UsbLinkMonitor::STATUS_COUNT + 2,
+    PipelineLatency::PACKED_SIZE,
+    LANE_COUNT * LANE_FIELDS,
+    VIDEO_ASSEMBLER_FIELDS + VIDEO_DECODER_FIELDS,
+    RecordPool::NUM_CLASSES * 4 + 2,
+};
+
+constexpr size_t offsetOf(Section section) {
+    size_t offset = 0;
+    for (size_t i = 0; i < static_cast<size_t>(section); i++) {
+        offset += SIZES[i];
+    }
+    return offset;
+}
+
+constexpr size_t VALUE_COUNT = offsetOf(SECTION_COUNT);
+
+} // namespace StatsLayout
+
+/**
+ * Start of the stats file. Values follow at headerSize, in native byte
+ * order; everything is naturally aligned.
+ *
+ * Seqlock: sequence is odd while values are being written. A reader
+ * reads sequence, then the values, then sequence again, and retries
+ * unless both reads are the same even number.
+ */
+struct StatsExportHeader {
+    static constexpr uint32_t MAGIC = 0x53504141;  // "AAPS" in a little endian file
+    static constexpr uint32_t VERSION = 2;
+    static constexpr size_t MAX_SECTIONS = 8;
+
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerSize;        // Bytes before the first value
+    uint32_t valueCount;
+    std::atomic<uint64_t> sequence;
+    uint64_t publishedNs;       // CLOCK_MONOTONIC of the last publish
+    uint64_t publishes;
+    uint32_t present;           // Bit per StatsLayout::Section with a running stage
+    uint32_t sectionCount;
+    struct {
+        uint32_t offset;        // In values
+        uint32_t count;
+    } sections[MAX_SECTIONS];
+};
+
+/**
+ * The VideoDecoder counters, which live with the NDK media glue outside
+ * the core; the owner's collector copies them in.
+ */
+struct DecoderCounts {
+    uint64_t framesQueued;
+    uint64_t framesCopied;
+    uint64_t framesSkipped;
+    uint64_t framesRendered;
+    uint64_t codecErrors;
+    uint64_t framesLate;        // Since VERSION 2
+};
+
+/**
+ * Values of one publish, filled section by section by the owner's
+ * collector. Sections not filled stay zero and absent.
+ */
+class StatsValues {
+public:
+    void transport(const TransportProgress& progress);
+    void link(const UsbLinkMonitor::Stats& stats);
+    void latency(const PipelineLatency& latency);
+    void lanes(const ChannelDispatcher& dispatcher);
+    // Either may be null, the section is present with one of them
+    void video(const VideoAssembler::Stats* assembler, const DecoderCounts* decoder);
+    void pool(const RecordPool::Stats& stats);
+
+private:
+    friend class StatsExport;
+
+    int64_t values_[StatsLayout::VALUE_COUNT];
+    uint32_t present_ = 0;
+
+    int64_t* section(StatsLayout::Section section);
+};
+
+/**
+ * Publishes the native stats into a memory-mapped file, for readers that
+ * shouldn't have to poll over JNI: a fleet collector or the UI reads the
+ * file at its own rate, and never takes a lock the pipeline holds.
+ *
+ * Every interval the AAP-Stats thread runs the collector, which reads the
+ * stages' own lock-free or briefly locked getters into a StatsValues,
+ * then copies it into the mapping under the seqlock. The pipeline threads
+ * do nothing for it; the write side of the seqlock is only the copy.
+ */
+class StatsExport {
+public:
+    static constexpr int DEFAULT_INTERVAL_MS = 250;
+
+    using Collector = std::function<void(StatsValues& values)>;
+
+    explicit StatsExport(int intervalMs = DEFAULT_INTERVAL_MS);
+    ~StatsExport();
+
+    // Non-copyable
+    StatsExport(const StatsExport&) = delete;
+    StatsExport& operator=(const StatsExport&) = delete;
+
+    /**
+     * Create, or truncate, and map the stats file, and write its header.
+     * @return false if it can't be created or mapped
+     */
+    bool open(const char* path);
+
+    /**
+     * Must be called before start(). Called on the AAP-Stats thread.
+     */
+    void setCollector(Collector collector);
+
+    void start();
+    void stop();
+
+    /**
+     * Collect and publish once, on the calling thread.
+     */
+    void publish();
+
+    static constexpr size_t headerSize() {
+        return (sizeof(StatsExportHeader) + 63) & ~size_t{63};
+    }
+    static constexpr size_t fileSize() {
+        return headerSize() + StatsLayout::VALUE_COUNT * sizeof(int64_t);
+    }
+
+private:
+    const std::chrono::milliseconds interval_;
+    Collector collector_;
+
+    int fd_ = -1;
+    void* map_ = nullptr;
+    StatsExportHeader* header_ = nullptr;
+    int64_t* values_ = nullptr;
+    // Staging for the collector, so the odd sequence only covers a copy
+    std::unique_ptr<StatsValues> staging_;
+    std::mutex publishMutex_;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::thread thread_;
+    bool running_ = false;
+
+    void exportLoop();
+};
+
+} // namespace aap
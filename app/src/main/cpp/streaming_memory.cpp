@@ -0,0 +1,214 @@
+#include "streaming_memory.h"
+#include <android/log.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#define LOG_TAG "StreamingMemory"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+#ifndef MADV_HUGEPAGE
+#define MADV_HUGEPAGE 14
+#endif
+
+namespace aap {
+
+namespace {
+
+constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+std::atomic<bool> populate{false};
+std::atomic<bool> hugePages{false};
+std::atomic<bool> lockPages{false};
+
+std::atomic<uint64_t> bytesMapped{0};
+std::atomic<uint64_t> bytesLocked{0};
+std::atomic<uint64_t> bytesHugeAdvised{0};
+std::atomic<uint64_t> lockFailures{0};
+
+size_t pageSize() {
+    static const size_t size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return size;
+}
+
+size_t roundToPages(size_t size) {
+    return (size + pageSize() - 1) / pageSize() * pageSize();
+}
+
+// Live ranges for the resident count, added and removed at allocation rate
+struct Range {
+    uint8_t* data;
+    size_t size;
+};
+std::mutex rangesMutex;
+std::vector<Range> ranges;
+
+void addRange(uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(rangesMutex);
+    ranges.push_back({data, size});
+}
+
+void removeRange(uint8_t* data) {
+    std::lock_guard<std::mutex> lock(rangesMutex);
+    for (auto it = ranges.begin(); it != ranges.end(); ++it) {
+        if (it->data == data) {
+            *it = ranges.back();
+            ranges.pop_back();
+            return;
+        }
+    }
+}
+
+uint64_t residentBytes() {
+    std::lock_guard<std::mutex> lock(rangesMutex);
+    std::vector<unsigned char> pages;
+    uint64_t resident = 0;
+    for (const Range& range : ranges) {
+        const size_t count = roundToPages(range.size) / pageSize();
+        pages.resize(count);
+        if (mincore(range.data, count * pageSize(), pages.data()) != 0) {
+            continue;
+        }
+        for (unsigned char page : pages) {
+            if (page & 1) {
+                resident += pageSize();
+            }
+        }
+    }
+    return resident;
+}
+
+// Header in front of the buffer so free knows how it was mapped
+struct Mapping {
+    size_t length;
+    bool locked;
+};
+
+void lockRange(uint8_t* data, size_t size, bool& locked) {
+    locked = false;
+    if (!lockPages.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (mlock(data, size) == 0) {
+        locked = true;
+        bytesLocked.fetch_add(size, std::memory_order_relaxed);
+    } else if (lockFailures.fetch_add(1, std::memory_order_relaxed) == 0) {
+        LOGE("mlock of %zu KB failed: %s", size / 1024, strerror(errno));
+    }
+}
+
+} // anonymous namespace
+
+void setStreamingMemoryOptions(const StreamingMemoryOptions& options) {
+    populate.store(options.populate, std::memory_order_relaxed);
+    hugePages.store(options.hugePages, std::memory_order_relaxed);
+    lockPages.store(options.lock, std::memory_order_relaxed);
+    LOGD("Streaming memory: populate=%d hugePages=%d lock=%d",
+         options.populate, options.hugePages, options.lock);
+}
+
+uint8_t* allocateStreamingMemory(size_t size) {
+    if (size == 0) {
+        return nullptr;
+    }
+    // The header takes the page in front so the buffer itself stays page aligned
+    const size_t header = pageSize();
+    const size_t rounded = roundToPages(size);
+    const bool huge = hugePages.load(std::memory_order_relaxed) && size >= HUGE_PAGE_SIZE;
+    // Huge pages need a 2 MB aligned range: map extra and trim
+    const size_t slack = huge ? HUGE_PAGE_SIZE : 0;
+    const size_t mappedLength = header + rounded + slack;
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (populate.load(std::memory_order_relaxed) && !huge) {
+        flags |= MAP_POPULATE;
+    }
+    void* mapped = mmap(nullptr, mappedLength, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (mapped == MAP_FAILED) {
+        LOGE("mmap of %zu KB failed: %s", mappedLength / 1024, strerror(errno));
+        return nullptr;
+    }
+
+    auto* base = static_cast<uint8_t*>(mapped);
+    uint8_t* data = base + header;
+    if (huge) {
+        const uintptr_t aligned = (reinterpret_cast<uintptr_t>(data) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        data = reinterpret_cast<uint8_t*>(aligned);
+        if (data - header > base) {
+            munmap(base, static_cast<size_t>(data - header - base));
+        }
+        uint8_t* end = base + mappedLength;
+        if (end > data + rounded) {
+            munmap(data + rounded, static_cast<size_t>(end - data - rounded));
+        }
+        // Advisory, the kernel may not have transparent huge pages enabled
+        if (madvise(data, rounded, MADV_HUGEPAGE) == 0) {
+            bytesHugeAdvised.fetch_add(rounded, std::memory_order_relaxed);
+        }
+        // Populated after the advice so the faults can take huge pages
+        if (populate.load(std::memory_order_relaxed)) {
+            for (size_t offset = 0; offset < rounded; offset += pageSize()) {
+                data[offset] = 0;
+            }
+        }
+    }
+
+    auto* mapping = reinterpret_cast<Mapping*>(data - header);
+    mapping->length = header + rounded;
+    lockRange(data, rounded, mapping->locked);
+    bytesMapped.fetch_add(rounded, std::memory_order_relaxed);
+    addRange(data, rounded);
+    return data;
+}
+
+void freeStreamingMemory(uint8_t* data) {
+    if (!data) {
+        return;
+    }
+    uint8_t* base = data - pageSize();
+    const Mapping mapping = *reinterpret_cast<Mapping*>(base);
+    const size_t rounded = mapping.length - pageSize();
+    if (mapping.locked) {
+        bytesLocked.fetch_sub(rounded, std::memory_order_relaxed);
+    }
+    bytesMapped.fetch_sub(rounded, std::memory_order_relaxed);
+    removeRange(data);
+    munmap(base, mapping.length);
+}
+
+bool prepareStreamingMapping(uint8_t* data, size_t size) {
+    bool locked;
+    lockRange(data, size, locked);
+    if (!locked && populate.load(std::memory_order_relaxed)) {
+        // mlock faults the pages in itself; otherwise touch one byte per page
+        for (size_t offset = 0; offset < size; offset += pageSize()) {
+            reinterpret_cast<volatile uint8_t*>(data)[offset] = 0;
+        }
+    }
+    addRange(data, size);
+    return locked;
+}
+
+void releaseStreamingMapping(uint8_t* data, size_t size, bool locked) {
+    removeRange(data);
+    if (locked) {
+        bytesLocked.fetch_sub(size, std::memory_order_relaxed);
+    }
+}
+
+StreamingMemoryStats getStreamingMemoryStats() {
+    StreamingMemoryStats stats;
+    stats.bytesMapped = bytesMapped.load(std::memory_order_relaxed);
+    stats.bytesLocked = bytesLocked.load(std::memory_order_relaxed);
+    stats.bytesHugeAdvised = bytesHugeAdvised.load(std::memory_order_relaxed);
+    stats.lockFailures = lockFailures.load(std::memory_order_relaxed);
+    stats.bytesResident = residentBytes();
+    return stats;
+}
+
+} // namespace aap
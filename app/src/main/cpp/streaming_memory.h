@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace aap {
+
+/**
+ * Backing for the large, continuously touched streaming buffers: rings,
+ * queue arenas, the record pool, video frame slots and heap transfer
+ * buffers. All off by default.
+ */
+struct StreamingMemoryOptions {
+    bool populate = false;   // MAP_POPULATE: no page faults once streaming
+    bool hugePages = false;  // MADV_HUGEPAGE on buffers of 2 MB and up
+    bool lock = false;       // mlock: the pages can't be reclaimed under pressure
+};
+
+/**
+ * Set the options for buffers allocated afterwards. Safe to call from any
+ * thread; buffers already allocated keep their backing.
+ */
+void setStreamingMemoryOptions(const StreamingMemoryOptions& options);
+
+/**
+ * Allocate a zeroed, page aligned buffer with the current options.
+ * @return nullptr on failure
+ */
+uint8_t* allocateStreamingMemory(size_t size);
+
+/**
+ * Free a buffer from allocateStreamingMemory().
+ */
+void freeStreamingMemory(uint8_t* data);
+
+struct StreamingMemoryDeleter {
+    void operator()(uint8_t* data) const { freeStreamingMemory(data); }
+};
+using StreamingBuffer = std::unique_ptr<uint8_t[], StreamingMemoryDeleter>;
+
+/**
+ * Apply populate and lock to a mapping made elsewhere (e.g. the mirrored
+ * ring), and count it in bytesResident. munmap undoes it; report that with
+ * releaseStreamingMapping() first.
+ * @return true if the mapping was locked
+ */
+bool prepareStreamingMapping(uint8_t* data, size_t size);
+void releaseStreamingMapping(uint8_t* data, size_t size, bool locked);
+
+struct StreamingMemoryStats {
+    uint64_t bytesMapped;
+    uint64_t bytesLocked;
+    uint64_t bytesHugeAdvised;
+    uint64_t lockFailures;  // Typically RLIMIT_MEMLOCK
+    uint64_t bytesResident; // Of every live buffer and prepared mapping, per mincore
+};
+
+/**
+ * Current totals. Walks every live buffer for bytesResident, so poll it
+ * rather than calling it per record.
+ */
+StreamingMemoryStats getStreamingMemoryStats();
+
+} // namespace aap
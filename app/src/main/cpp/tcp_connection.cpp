@@ -0,0 +1,502 @@
+#include "tcp_connection.h"
+#include "session_capture.h"
+#include "thread_policy.h"
+#include "trace.h"
+#include <android/log.h>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LOG_TAG "TcpConnection"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+// Handshake writes wait this long for the send buffer
+constexpr int WRITE_TIMEOUT_MS = 1000;
+
+constexpr uint32_t SOCKET_EVENTS = EPOLLIN | EPOLLRDHUP;
+
+static int64_t monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+TcpConnection::TcpConnection() = default;
+
+TcpConnection::~TcpConnection() {
+    close();
+}
+
+bool TcpConnection::open(int fd, const TcpConfig& config) {
+    if (fd < 0) {
+        setError("Invalid socket descriptor %d", fd);
+        return false;
+    }
+    fd_ = fd;
+
+    const int flags = fcntl(fd_, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd_, F_SETFL, flags | O_NONBLOCK) != 0) {
+        setError("fcntl(O_NONBLOCK) failed: %s", strerror(errno));
+        close();
+        return false;
+    }
+
+    const int noDelay = 1;
+    if (setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay)) != 0) {
+        LOGE("TCP_NODELAY failed: %s", strerror(errno));
+    }
+    // The receive window scale was fixed at connect time, Kotlin sets
+    // SO_RCVBUF before connecting too; this still grows the queue itself
+    if (config.receiveBufferSize > 0 &&
+        setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &config.receiveBufferSize, sizeof(int)) != 0) {
+        LOGE("SO_RCVBUF failed: %s", strerror(errno));
+    }
+    if (config.sendBufferSize > 0 &&
+        setsockopt(fd_, SOL_SOCKET, SO_SNDBUF, &config.sendBufferSize, sizeof(int)) != 0) {
+        LOGE("SO_SNDBUF failed: %s", strerror(errno));
+    }
+
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd_ < 0 || wakeFd_ < 0) {
+        setError("epoll/eventfd setup failed: %s", strerror(errno));
+        close();
+        return false;
+    }
+
+    struct epoll_event event {};
+    event.events = SOCKET_EVENTS;
+    event.data.fd = fd_;
+    struct epoll_event wake {};
+    wake.events = EPOLLIN;
+    wake.data.fd = wakeFd_;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd_, &event) != 0 ||
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &wake) != 0) {
+        setError("epoll_ctl failed: %s", strerror(errno));
+        close();
+        return false;
+    }
+
+    readSize_ = config.readSize > 0 ? config.readSize : TcpConfig().readSize;
+    readBuffer_.reset(new uint8_t[readSize_]);
+
+    int receiveBuffer = 0;
+    socklen_t optionLength = sizeof(receiveBuffer);
+    getsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &receiveBuffer, &optionLength);
+    LOGI("TCP connection opened: fd=%d, SO_RCVBUF=%d, read size %zu", fd_, receiveBuffer, readSize_);
+    return true;
+}
+
+void TcpConnection::close() {
+    stopReading();
+
+    if (epollFd_ >= 0) {
+        ::close(epollFd_);
+        epollFd_ = -1;
+    }
+    if (wakeFd_ >= 0) {
+        ::close(wakeFd_);
+        wakeFd_ = -1;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+        LOGI("TCP connection closed");
+    }
+}
+
+void TcpConnection::setRawDataCallback(RawDataCallback callback) {
+    callbacks_.update([&callback](Callbacks& callbacks) { callbacks.rawData = std::move(callback); });
+}
+
+void TcpConnection::setErrorCallback(ErrorCallback callback) {
+    callbacks_.update([&callback](Callbacks& callbacks) { callbacks.error = std::move(callback); });
+}
+
+void TcpConnection::setCapture(SessionCapture* capture) {
+    callbacks_.update([capture](Callbacks& callbacks) { callbacks.capture = capture; });
+}
+
+void TcpConnection::startReading() {
+    if (running_.exchange(true)) {
+        return; // Already running
+    }
+
+    if (fd_ < 0) {
+        setError("Socket not open");
+        running_ = false;
+        return;
+    }
+
+    LOGI("Starting TCP reading");
+    eventThread_ = std::thread(&TcpConnection::eventLoop, this);
+}
+
+void TcpConnection::stopReading() {
+    // The event thread clears running_ itself when the peer goes away
+    if (!running_.exchange(false) && !eventThread_.joinable()) {
+        return; // Already stopped
+    }
+
+    LOGI("Stopping TCP reading");
+
+    const uint64_t one = 1;
+    if (::write(wakeFd_, &one, sizeof(one)) < 0) {
+        LOGE("eventfd write failed: %s", strerror(errno));
+    }
+    if (eventThread_.joinable()) {
+        if (eventThread_.get_id() == std::this_thread::get_id()) {
+            // From the error callback: the loop has exited, and the thread
+            // touches nothing of ours once the callback returns
+            eventThread_.detach();
+        } else {
+            eventThread_.join();
+        }
+    }
+
+    // Drop anything not yet sent, as the USB TX path does
+    std::lock_guard<std::mutex> lock(txMutex_);
+    txBacklog_.clear();
+    txOffset_ = 0;
+    txBacklogBytes_.store(0, std::memory_order_relaxed);
+    armWrite(false);
+
+    LOGI("TCP reading stopped");
+}
+
+ssize_t TcpConnection::sendSome(const uint8_t* data, size_t length) {
+    const TxSegment segment{data, length};
+    return sendSegments(&segment, 1, 0);
+}
+
+ssize_t TcpConnection::sendSegments(const TxSegment* segments, size_t count, size_t offset) {
+    // Skip what already went out
+    size_t i = 0;
+    while (i < count && offset >= segments[i].length) {
+        offset -= segments[i].length;
+        i++;
+    }
+    iovec iov[MAX_SEND_SEGMENTS];
+    size_t used = 0;
+    for (; i < count && used < MAX_SEND_SEGMENTS; i++) {
+        iov[used].iov_base = const_cast<uint8_t*>(segments[i].data) + offset;
+        iov[used].iov_len = segments[i].length - offset;
+        offset = 0;
+        used++;
+    }
+    if (used == 0) {
+        return 0;
+    }
+
+    msghdr message{};
+    message.msg_iov = iov;
+    message.msg_iovlen = used;
+    while (true) {
+        const ssize_t sent = sendmsg(fd_, &message, MSG_NOSIGNAL);
+        if (sent >= 0) {
+            bytesSent_.fetch_add(static_cast<uint64_t>(sent), std::memory_order_relaxed);
+            return sent;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        setError("send failed: %s", strerror(errno));
+        return -1;
+    }
+}
+
+int TcpConnection::write(const uint8_t* data, size_t length) {
+    const TxSegment segment{data, length};
+    return writeSegments(&segment, 1);
+}
+
+int TcpConnection::writeSegments(const TxSegment* segments, size_t count) {
+    if (fd_ < 0) {
+        LOGE("Write failed: socket not open");
+        return -1;
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+        length += segments[i].length;
+    }
+
+    std::lock_guard<std::mutex> lock(txMutex_);
+
+    if (!running_) {
+        // Handshake: no event thread to flush a backlog
+        const int64_t deadline = monotonicMs() + WRITE_TIMEOUT_MS;
+        size_t written = 0;
+        while (written < length) {
+            const ssize_t sent = sendSegments(segments, count, written);
+            if (sent < 0) {
+                return -1;
+            }
+            written += static_cast<size_t>(sent);
+            if (written == length) {
+                break;
+            }
+            const int64_t remaining = deadline - monotonicMs();
+            if (remaining <= 0) {
+                LOGE("Write timeout, %zu of %zu bytes sent", written, length);
+                break;
+            }
+            struct pollfd pfd { fd_, POLLOUT, 0 };
+            poll(&pfd, 1, static_cast<int>(remaining));
+        }
+        return static_cast<int>(written);
+    }
+
+    size_t written = 0;
+    if (txOffset_ == txBacklog_.size()) {
+        // Nothing queued ahead, so the bytes can go out in order right away
+        const ssize_t sent = sendSegments(segments, count, 0);
+        if (sent < 0) {
+            return -1;
+        }
+        written = static_cast<size_t>(sent);
+        if (written == length) {
+            return static_cast<int>(length);
+        }
+    }
+
+    const size_t rest = length - written;
+    if (txBacklog_.size() - txOffset_ + rest > MAX_TX_BACKLOG) {
+        setError("TX backlog full, %zu bytes dropped", rest);
+        return -1;
+    }
+    if (txOffset_ > 0 && txOffset_ == txBacklog_.size()) {
+        txBacklog_.clear();
+        txOffset_ = 0;
+    }
+    // What the socket didn't take, segment by segment
+    size_t skip = written;
+    for (size_t i = 0; i < count; i++) {
+        const TxSegment& segment = segments[i];
+        if (skip >= segment.length) {
+            skip -= segment.length;
+            continue;
+        }
+        txBacklog_.insert(txBacklog_.end(), segment.data + skip, segment.data + segment.length);
+        skip = 0;
+    }
+    sendQueued_.fetch_add(1, std::memory_order_relaxed);
+
+    const uint64_t depth = txBacklog_.size() - txOffset_;
+    txBacklogBytes_.store(depth, std::memory_order_relaxed);
+    if (depth > txBacklogHighWater_.load(std::memory_order_relaxed)) {
+        txBacklogHighWater_.store(depth, std::memory_order_relaxed);
+    }
+    armWrite(true);
+    return static_cast<int>(length);
+}
+
+bool TcpConnection::flushBacklog() {
+    while (txOffset_ < txBacklog_.size()) {
+        const ssize_t sent = sendSome(txBacklog_.data() + txOffset_, txBacklog_.size() - txOffset_);
+        if (sent < 0) {
+            return false;
+        }
+        if (sent == 0) {
+            return true; // Still full, EPOLLOUT stays armed
+        }
+        txOffset_ += static_cast<size_t>(sent);
+        txBacklogBytes_.store(txBacklog_.size() - txOffset_, std::memory_order_relaxed);
+    }
+    txBacklog_.clear();
+    txOffset_ = 0;
+    armWrite(false);
+    return true;
+}
+
+void TcpConnection::armWrite(bool armed) {
+    if (writeArmed_ == armed || epollFd_ < 0) {
+        return;
+    }
+    struct epoll_event event {};
+    event.events = armed ? SOCKET_EVENTS | EPOLLOUT : SOCKET_EVENTS;
+    event.data.fd = fd_;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd_, &event) == 0) {
+        writeArmed_ = armed;
+    }
+}
+
+int TcpConnection::read(uint8_t* buffer, size_t length, int timeoutMs) {
+    if (fd_ < 0) {
+        LOGE("Read failed: socket not open");
+        return -1;
+    }
+    if (running_) {
+        LOGE("Read failed: the event thread owns the socket");
+        return -1;
+    }
+
+    struct pollfd pfd { fd_, POLLIN, 0 };
+    int ready;
+    while ((ready = poll(&pfd, 1, timeoutMs)) < 0 && errno == EINTR) {
+    }
+    if (ready == 0) {
+        LOGD("Read timeout after %dms", timeoutMs);
+        return 0;
+    }
+
+    while (true) {
+        const ssize_t received = recv(fd_, buffer, length, 0);
+        if (received > 0) {
+            bytesReceived_.fetch_add(static_cast<uint64_t>(received), std::memory_order_relaxed);
+            return static_cast<int>(received);
+        }
+        if (received == 0) {
+            setError("Connection closed by peer");
+            return -1;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        setError("recv failed: %s", strerror(errno));
+        return -1;
+    }
+}
+
+bool TcpConnection::drainSocket() {
+    AAP_TRACE_SECTION("TCP read");
+    while (true) {
+        const ssize_t received = recv(fd_, readBuffer_.get(), readSize_, 0);
+        if (received > 0) {
+            bytesReceived_.fetch_add(static_cast<uint64_t>(received), std::memory_order_relaxed);
+            const auto callbacks = callbacks_.read();
+            if (callbacks->capture) {
+                callbacks->capture->appendData(readBuffer_.get(), static_cast<size_t>(received));
+            }
+            if (callbacks->rawData) {
+                deliveriesStarted_.fetch_add(1, std::memory_order_relaxed);
+                callbacks->rawData(readBuffer_.get(), static_cast<size_t>(received));
+                deliveriesDone_.fetch_add(1, std::memory_order_relaxed);
+            }
+            // A short read means the socket is drained, skip the EAGAIN syscall
+            if (static_cast<size_t>(received) < readSize_) {
+                return true;
+            }
+            continue;
+        }
+        if (received == 0) {
+            return false;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return true;
+        }
+        setError("recv failed: %s", strerror(errno));
+        return false;
+    }
+}
+
+void TcpConnection::reportDisconnect(const char* message) {
+    const auto callbacks = callbacks_.read();
+    if (callbacks->error) {
+        callbacks->error(ERROR_DISCONNECTED, message);
+    }
+}
+
+void TcpConnection::eventLoop() {
+    applyThreadPolicy("AAP-TCP-Event");
+    LOGD("TCP event loop started");
+
+    // Reported once the loop is left, with txMutex_ released, so the
+    // callback may stop or close this connection
+    const char* disconnect = nullptr;
+    struct epoll_event events[4];
+    while (running_) {
+        const int count = epoll_wait(epollFd_, events, 4, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGE("epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < count && running_; i++) {
+            if (events[i].data.fd == wakeFd_) {
+                uint64_t value;
+                while (::read(wakeFd_, &value, sizeof(value)) > 0) {
+                }
+                continue;
+            }
+
+            const uint32_t ready = events[i].events;
+            if (ready & EPOLLOUT) {
+                std::lock_guard<std::mutex> lock(txMutex_);
+                if (!flushBacklog()) {
+                    disconnect = "TCP send failed";
+                    running_ = false;
+                    break;
+                }
+            }
+            if (ready & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                // Data queued before a FIN is still delivered first
+                if (!drainSocket()) {
+                    disconnect = "TCP connection closed";
+                    running_ = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    LOGD("TCP event loop stopped");
+    if (disconnect != nullptr) {
+        reportDisconnect(disconnect);
+    }
+}
+
+TcpConnection::Stats TcpConnection::getStats() const {
+    Stats stats;
+    stats.bytesReceived = bytesReceived_.load(std::memory_order_relaxed);
+    stats.bytesSent = bytesSent_.load(std::memory_order_relaxed);
+    stats.sendQueued = sendQueued_.load(std::memory_order_relaxed);
+    stats.txBacklogHighWater = txBacklogHighWater_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+TransportProgress TcpConnection::progress() const {
+    TransportProgress p;
+    p.deliveries = deliveriesDone_.load(std::memory_order_relaxed);
+    p.delivering = deliveriesStarted_.load(std::memory_order_relaxed) != p.deliveries;
+    p.txCompleted = bytesSent_.load(std::memory_order_relaxed);
+    p.txPending = txBacklogBytes_.load(std::memory_order_relaxed);
+    return p;
+}
+
+void TcpConnection::setError(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(lastError_, sizeof(lastError_), format, args);
+    va_end(args);
+    LOGE("%s", lastError_);
+}
+
+} // namespace aap
@@ -0,0 +1,166 @@
+#pragma once
+
+#include "rcu_cell.h"
+#include "transport.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace aap {
+
+/**
+ * Socket options for a wireless (TCP) connection.
+ */
+struct TcpConfig {
+    int receiveBufferSize = 512 * 1024;  // SO_RCVBUF, 0 keeps the kernel default
+    int sendBufferSize = 256 * 1024;     // SO_SNDBUF, 0 keeps the kernel default
+    size_t readSize = 65536;             // Bytes per recv() on the event thread
+};
+
+/**
+ * TCP transport for wireless Android Auto, so the framer and dispatcher
+ * pipeline runs unchanged over the air.
+ *
+ * Takes ownership of an already connected socket from Android, switches
+ * it to non-blocking with TCP_NODELAY and reads it from one epoll event
+ * thread. An eventfd wakes that thread for shutdown, so stopReading()
+ * returns immediately. A disconnect is reported after the loop has exited,
+ * so the ErrorCallback may stop and close the connection itself.
+ *
+ * Writes go straight to the socket from the calling thread; whatever the
+ * send buffer can't take is kept in order and flushed on EPOLLOUT.
+ */
+class TcpConnection : public Transport {
+public:
+    // Reported through the ErrorCallback when the peer goes away,
+    // the same code as LIBUSB_ERROR_NO_DEVICE so Kotlin treats both alike
+    static constexpr int ERROR_DISCONNECTED = -4;
+
+    TcpConnection();
+    ~TcpConnection() override;
+
+    // Non-copyable
+    TcpConnection(const TcpConnection&) = delete;
+    TcpConnection& operator=(const TcpConnection&) = delete;
+
+    /**
+     * Take over a connected socket.
+     * @param fd Socket descriptor, closed by close()
+     * @param config Socket options
+     * @return true on success, false on failure (fd is closed)
+     */
+    bool open(int fd, const TcpConfig& config = TcpConfig());
+
+    /**
+     * Stop reading and close the socket.
+     */
+    void close() override;
+
+    bool isOpen() const override { return fd_ >= 0; }
+
+    bool isReading() const override { return running_.load(std::memory_order_relaxed); }
+
+    /**
+     * Set raw data callback, called on the event thread for each recv().
+     */
+    void setRawDataCallback(RawDataCallback callback) override;
+
+    void setErrorCallback(ErrorCallback callback) override;
+    void setCapture(SessionCapture* capture) override;
+
+    /**
+     * Start the event thread. Raw data is delivered via the RawDataCallback.
+     */
+    void startReading() override;
+    void stopReading() override;
+
+    /**
+     * Write data to the socket. Safe to call from any thread.
+     * While reading, bytes the socket can't take yet are queued in order;
+     * otherwise (handshake) it waits up to a second for them to go out.
+     * @return Number of bytes written or queued, or negative on error
+     */
+    int write(const uint8_t* data, size_t length) override;
+
+    /**
+     * Like write(), the segments gathered by sendmsg() and only copied
+     * for the part that has to wait in the backlog.
+     */
+    int writeSegments(const TxSegment* segments, size_t count) override;
+
+    /**
+     * Read data from the socket (synchronous, for handshake).
+     * @return Number of bytes read, 0 on timeout, or negative on error
+     */
+    int read(uint8_t* buffer, size_t length, int timeoutMs) override;
+
+    const char* getLastError() const override { return lastError_; }
+
+    struct Stats {
+        uint64_t bytesReceived;
+        uint64_t bytesSent;
+        uint64_t sendQueued;       // Writes the socket couldn't take at once
+        uint64_t txBacklogHighWater;
+    };
+    Stats getStats() const;
+
+    TransportProgress progress() const override;
+
+private:
+    // Queued writes beyond this fail, the peer has stopped reading
+    static constexpr size_t MAX_TX_BACKLOG = 4 * 1024 * 1024;
+    // Header, total length and record of a fragment, with room to spare
+    static constexpr size_t MAX_SEND_SEGMENTS = 8;
+
+    int fd_ = -1;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    size_t readSize_ = 0;
+    std::unique_ptr<uint8_t[]> readBuffer_;
+
+    // Unsent bytes, txBacklog_[txOffset_..] goes out first
+    std::vector<uint8_t> txBacklog_;
+    size_t txOffset_ = 0;
+    bool writeArmed_ = false;  // EPOLLOUT registered, guarded by txMutex_
+    std::mutex txMutex_;
+
+    std::thread eventThread_;
+    std::atomic<bool> running_{false};
+
+    // Read without a lock on every receive, see UsbConnection
+    struct Callbacks {
+        RawDataCallback rawData;
+        ErrorCallback error;
+        SessionCapture* capture = nullptr;
+    };
+    RcuCell<Callbacks> callbacks_;
+
+    std::atomic<uint64_t> bytesReceived_{0};
+    std::atomic<uint64_t> bytesSent_{0};
+    std::atomic<uint64_t> sendQueued_{0};
+    std::atomic<uint64_t> txBacklogHighWater_{0};
+    // Written under txMutex_, read by progress()
+    std::atomic<uint64_t> txBacklogBytes_{0};
+    // Bumped around every delivery, watched by progress()
+    std::atomic<uint64_t> deliveriesStarted_{0};
+    std::atomic<uint64_t> deliveriesDone_{0};
+
+    char lastError_[256] = {0};
+
+    void eventLoop();
+    // Returns false once the peer closed the connection or it failed
+    bool drainSocket();
+    bool flushBacklog();       // Requires txMutex_
+    void armWrite(bool armed); // Requires txMutex_
+    ssize_t sendSome(const uint8_t* data, size_t length);
+    // Sends from offset bytes into the joined segments, at most MAX_SEND_SEGMENTS of them
+    ssize_t sendSegments(const TxSegment* segments, size_t count, size_t offset);
+    void reportDisconnect(const char* message);
+    void setError(const char* format, ...);
+};
+
+} // namespace aap
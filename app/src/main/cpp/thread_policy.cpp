@@ -0,0 +1,257 @@
+#include "thread_policy.h"
+#include <android/log.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define LOG_TAG "ThreadPolicy"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+constexpr int MAX_CPUS = 64;
+// Used when a real-time policy is refused, THREAD_PRIORITY_URGENT_AUDIO
+constexpr int FALLBACK_NICE = -19;
+// THREAD_PRIORITY_AUDIO
+constexpr int EVENT_THREAD_NICE = -16;
+// THREAD_PRIORITY_BACKGROUND
+constexpr int BACKGROUND_THREAD_NICE = 10;
+
+bool readValue(const char* path, uint64_t& value) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+    unsigned long long parsed = 0;
+    const bool ok = fscanf(file, "%llu", &parsed) == 1;
+    fclose(file);
+    value = parsed;
+    return ok;
+}
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::pair<std::string, ThreadPolicy>> policies;
+
+    Registry() {
+        const CpuTopology& topology = cpuTopology();
+
+        // Audio stays on the big cores: a migration to a little core is an underrun
+        ThreadPolicy audio;
+        audio.policy = ThreadPolicy::POLICY_FIFO;
+        audio.cpuMask = topology.bigCores;
+        policies.emplace_back("AAP-Audio", audio);
+
+        // Every record passes through the event thread first
+        ThreadPolicy event;
+        event.policy = ThreadPolicy::POLICY_OTHER;
+        event.priority = EVENT_THREAD_NICE;
+        event.cpuMask = topology.bigCores;
+        policies.emplace_back("AAP-USB-Event", event);
+        policies.emplace_back("AAP-TCP-Event", event);
+        // Touch records are written from the input thread, ahead of the handler
+        policies.emplace_back("AAP-Input", event);
+
+        // Metadata never competes with the real-time threads for a big core
+        ThreadPolicy background;
+        background.policy = ThreadPolicy::POLICY_OTHER;
+        background.priority = BACKGROUND_THREAD_NICE;
+        background.cpuMask = topology.littleCores;
+        policies.emplace_back("AAP-Background", background);
+        // Once a second, and the thing it watches for is a hot big core
+        policies.emplace_back("AAP-Governor", background);
+        // Only reads counters, a snapshot is the one thing it ever writes
+        policies.emplace_back("AAP-Watchdog", background);
+        policies.emplace_back("AAP-Stats", background);
+    }
+};
+
+Registry& registry() {
+    static Registry instance;
+    return instance;
+}
+
+void setAffinity(pid_t tid, const char* name, uint64_t mask) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (mask & (1ULL << cpu)) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    if (sched_setaffinity(tid, sizeof(set), &set) != 0) {
+        LOGE("%s: sched_setaffinity(0x%llx) failed: %s", name,
+             static_cast<unsigned long long>(mask), strerror(errno));
+    }
+}
+
+void setScheduling(pid_t tid, const char* name, const ThreadPolicy& policy) {
+    struct sched_param param = {};
+    if (policy.policy == ThreadPolicy::POLICY_OTHER) {
+        sched_setscheduler(tid, SCHED_OTHER, &param);
+        if (setpriority(PRIO_PROCESS, tid, policy.priority) != 0) {
+            LOGE("%s: setpriority(%d) failed: %s", name, policy.priority, strerror(errno));
+        }
+        return;
+    }
+
+    param.sched_priority = policy.priority > 0 ? policy.priority : sched_get_priority_max(policy.policy);
+    const int result = pthread_setschedparam(pthread_self(), policy.policy, &param);
+    if (result != 0) {
+        LOGD("%s: could not set real-time policy %d (error %d), using nice %d",
+             name, policy.policy, result, FALLBACK_NICE);
+        setpriority(PRIO_PROCESS, tid, FALLBACK_NICE);
+    } else {
+        LOGD("%s: real-time policy %d priority %d", name, policy.policy, param.sched_priority);
+    }
+}
+
+ThreadPolicy lookup(const char* name) {
+    ThreadPolicy policy;
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (const auto& entry : reg.policies) {
+        if (entry.first == name) {
+            policy = entry.second;
+            break;
+        }
+    }
+    return policy;
+}
+
+void applyPolicy(const char* name, const ThreadPolicy& policy) {
+    pthread_setname_np(pthread_self(), name);
+    const pid_t tid = gettid();
+    if (policy.cpuMask != 0) {
+        setAffinity(tid, name, policy.cpuMask);
+    }
+    if (policy.policy != ThreadPolicy::POLICY_UNCHANGED) {
+        setScheduling(tid, name, policy);
+    }
+}
+
+// Slice share of mask's CPUs in order, the last slice takes the remainder
+uint64_t shareOf(uint64_t mask, int share, int shares) {
+    int cpus[MAX_CPUS];
+    int count = 0;
+    for (int cpu = 0; cpu < MAX_CPUS; cpu++) {
+        if (mask & (1ULL << cpu)) {
+            cpus[count++] = cpu;
+        }
+    }
+    if (shares <= 1 || count < shares) {
+        return mask;
+    }
+    const int perShare = count / shares;
+    const int first = (share % shares) * perShare;
+    const int last = share % shares == shares - 1 ? count : first + perShare;
+    uint64_t result = 0;
+    for (int i = first; i < last; i++) {
+        result |= 1ULL << cpus[i];
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+const CpuTopology& cpuTopology() {
+    static const CpuTopology topology = [] {
+        CpuTopology result;
+        const long configured = sysconf(_SC_NPROCESSORS_CONF);
+        result.cpuCount = static_cast<int>(configured < 1 ? 1 : configured > MAX_CPUS ? MAX_CPUS : configured);
+
+        uint64_t capacity[MAX_CPUS] = {};
+        uint64_t lowest = UINT64_MAX;
+        uint64_t highest = 0;
+        for (int cpu = 0; cpu < result.cpuCount; cpu++) {
+            char path[96];
+            snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpu_capacity", cpu);
+            if (!readValue(path, capacity[cpu])) {
+                snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+                readValue(path, capacity[cpu]);
+            }
+            lowest = std::min(lowest, capacity[cpu]);
+            highest = std::max(highest, capacity[cpu]);
+        }
+
+        const uint64_t all = result.cpuCount == MAX_CPUS ? ~0ULL : (1ULL << result.cpuCount) - 1;
+        if (highest == lowest) {
+            result.bigCores = all;
+            result.littleCores = all;
+        } else {
+            for (int cpu = 0; cpu < result.cpuCount; cpu++) {
+                if (capacity[cpu] == lowest) {
+                    result.littleCores |= 1ULL << cpu;
+                } else {
+                    result.bigCores |= 1ULL << cpu;
+                }
+            }
+        }
+        LOGI("CPU topology: %d CPUs, big 0x%llx, little 0x%llx", result.cpuCount,
+             static_cast<unsigned long long>(result.bigCores),
+             static_cast<unsigned long long>(result.littleCores));
+        return result;
+    }();
+    return topology;
+}
+
+bool setThreadPolicy(const char* name, const ThreadPolicy& policy) {
+    if (!name || !*name) {
+        return false;
+    }
+    switch (policy.policy) {
+        case ThreadPolicy::POLICY_UNCHANGED:
+            break;
+        case ThreadPolicy::POLICY_OTHER:
+            if (policy.priority < -20 || policy.priority > 19) return false;
+            break;
+        case ThreadPolicy::POLICY_FIFO:
+        case ThreadPolicy::POLICY_RR:
+            if (policy.priority < 0 || policy.priority > sched_get_priority_max(policy.policy)) return false;
+            break;
+        default:
+            return false;
+    }
+
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto& entry : reg.policies) {
+        if (entry.first == name) {
+            entry.second = policy;
+            return true;
+        }
+    }
+    reg.policies.emplace_back(name, policy);
+    return true;
+}
+
+void applyThreadPolicy(const char* name) {
+    applyPolicy(name, lookup(name));
+}
+
+void applyThreadPolicy(const char* name, int share, int shares) {
+    ThreadPolicy policy = lookup(name);
+    if (shares > 1 && share >= 0) {
+        const int cpuCount = std::min(cpuTopology().cpuCount, MAX_CPUS);
+        const uint64_t all = cpuCount >= MAX_CPUS ? ~0ULL : (1ULL << cpuCount) - 1;
+        policy.cpuMask = shareOf(policy.cpuMask != 0 ? policy.cpuMask : all, share, shares);
+        LOGD("%s: connection share %d/%d on CPUs 0x%llx", name, share, shares,
+             static_cast<unsigned long long>(policy.cpuMask));
+    }
+    applyPolicy(name, policy);
+}
+
+} // namespace aap
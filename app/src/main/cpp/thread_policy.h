@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+
+namespace aap {
+
+/**
+ * Scheduling and placement for one named native thread.
+ */
+struct ThreadPolicy {
+    // Values of SCHED_OTHER, SCHED_FIFO and SCHED_RR
+    static constexpr int POLICY_UNCHANGED = -1;
+    static constexpr int POLICY_OTHER = 0;
+    static constexpr int POLICY_FIFO = 1;
+    static constexpr int POLICY_RR = 2;
+
+    int policy = POLICY_UNCHANGED;
+    // Nice value for POLICY_OTHER, real-time priority for FIFO/RR (0 = highest)
+    int priority = 0;
+    // CPUs the thread may run on, 0 leaves the affinity alone
+    uint64_t cpuMask = 0;
+};
+
+/**
+ * CPU clusters from /sys/devices/system/cpu, by cpu_capacity or else
+ * cpuinfo_max_freq. On a homogeneous SoC both masks cover every CPU.
+ */
+struct CpuTopology {
+    int cpuCount = 0;
+    uint64_t bigCores = 0;     // Every CPU above the slowest cluster
+    uint64_t littleCores = 0;  // The slowest cluster
+};
+
+/**
+ * Read once, on first use.
+ */
+const CpuTopology& cpuTopology();
+
+/**
+ * Register the policy for a thread name (e.g. "AAP-Audio"), replacing the
+ * default. Applies to threads started afterwards. Safe to call from any thread.
+ * @return false for an empty name or a policy outside the valid range
+ */
+bool setThreadPolicy(const char* name, const ThreadPolicy& policy);
+
+/**
+ * Name the calling thread and apply the policy registered for that name.
+ * Every native thread calls this first. Failures are logged and fall
+ * back: a real-time policy the process may not use becomes nice -19.
+ */
+void applyThreadPolicy(const char* name);
+
+/**
+ * As applyThreadPolicy(name), then narrowed to share of shares equal
+ * slices of the policy's CPUs (every CPU when the policy leaves affinity
+ * alone), so the threads of concurrent connections don't compete for the
+ * same cores. A mask with fewer CPUs than shares is used whole.
+ */
+void applyThreadPolicy(const char* name, int share, int shares);
+
+} // namespace aap
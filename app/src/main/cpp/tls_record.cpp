@@ -0,0 +1,122 @@
+#include "tls_record.h"
+#include "trace.h"
+#include <cstring>
+
+namespace aap {
+
+namespace {
+
+constexpr size_t AAD_SIZE = 13;
+
+void storeBe64(uint8_t* p, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = static_cast<uint8_t>(value >> (56 - 8 * i));
+    }
+}
+
+} // anonymous namespace
+
+bool TlsRecordLayer::setKey(Direction& dir, const uint8_t* key, size_t keyLength,
+                            const uint8_t* salt, uint64_t sequence) {
+    if (!dir.cipher.setKey(key, keyLength)) {
+        return false;
+    }
+    std::memcpy(dir.salt, salt, SALT_SIZE);
+    dir.sequence = sequence;
+    return true;
+}
+
+bool TlsRecordLayer::setReadKey(const uint8_t* key, size_t keyLength,
+                                const uint8_t* salt, uint64_t sequence) {
+    return setKey(read_, key, keyLength, salt, sequence);
+}
+
+bool TlsRecordLayer::setWriteKey(const uint8_t* key, size_t keyLength,
+                                 const uint8_t* salt, uint64_t sequence) {
+    return setKey(write_, key, keyLength, salt, sequence);
+}
+
+// additional_data = seq_num + type + version + length
+void TlsRecordLayer::buildAad(uint8_t* aad, uint64_t sequence, size_t plaintextLength) {
+    storeBe64(aad, sequence);
+    aad[8] = CONTENT_APPLICATION_DATA;
+    aad[9] = static_cast<uint8_t>(VERSION_TLS12 >> 8);
+    aad[10] = static_cast<uint8_t>(VERSION_TLS12 & 0xFF);
+    aad[11] = static_cast<uint8_t>(plaintextLength >> 8);
+    aad[12] = static_cast<uint8_t>(plaintextLength & 0xFF);
+}
+
+int TlsRecordLayer::decrypt(const uint8_t* record, size_t length, uint8_t* out) {
+    const int plaintextLength = decryptAt(record, length, out, read_.sequence);
+    if (plaintextLength < 0) {
+        stats_.authFailures++;
+        return -1;
+    }
+
+    read_.sequence++;
+    stats_.recordsDecrypted++;
+    return plaintextLength;
+}
+
+int TlsRecordLayer::decryptAt(const uint8_t* record, size_t length, uint8_t* out,
+                              uint64_t sequence) const {
+    AAP_TRACE_SECTION("Decrypt");
+    if (!read_.cipher.hasKey() || length < OVERHEAD) {
+        return -1;
+    }
+
+    const uint16_t version = static_cast<uint16_t>((record[1] << 8) | record[2]);
+    const size_t recordLength = (static_cast<size_t>(record[3]) << 8) | record[4];
+    if (record[0] != CONTENT_APPLICATION_DATA || version != VERSION_TLS12 ||
+        recordLength != length - HEADER_SIZE) {
+        return -1;
+    }
+
+    const size_t plaintextLength = length - OVERHEAD;
+    const uint8_t* explicitNonce = record + HEADER_SIZE;
+    const uint8_t* ciphertext = explicitNonce + EXPLICIT_NONCE_SIZE;
+    const uint8_t* tag = ciphertext + plaintextLength;
+
+    uint8_t nonce[AesGcm::NONCE_SIZE];
+    std::memcpy(nonce, read_.salt, SALT_SIZE);
+    std::memcpy(nonce + SALT_SIZE, explicitNonce, EXPLICIT_NONCE_SIZE);
+
+    uint8_t aad[AAD_SIZE];
+    buildAad(aad, sequence, plaintextLength);
+
+    if (!read_.cipher.open(nonce, aad, AAD_SIZE, ciphertext, out, plaintextLength, tag)) {
+        return -1;
+    }
+    return static_cast<int>(plaintextLength);
+}
+
+int TlsRecordLayer::encrypt(const uint8_t* plaintext, size_t length, uint8_t* out) {
+    if (!write_.cipher.hasKey() || length + OVERHEAD - HEADER_SIZE > 0xFFFF) {
+        return -1;
+    }
+
+    // The sequence number doubles as the explicit nonce, as most stacks do
+    uint8_t* explicitNonce = out + HEADER_SIZE;
+    uint8_t* ciphertext = explicitNonce + EXPLICIT_NONCE_SIZE;
+
+    uint8_t nonce[AesGcm::NONCE_SIZE];
+    std::memcpy(nonce, write_.salt, SALT_SIZE);
+    storeBe64(nonce + SALT_SIZE, write_.sequence);
+
+    uint8_t aad[AAD_SIZE];
+    buildAad(aad, write_.sequence, length);
+
+    write_.cipher.seal(nonce, aad, AAD_SIZE, plaintext, ciphertext, length, ciphertext + length);
+
+    const size_t recordLength = length + OVERHEAD - HEADER_SIZE;
+    std::memcpy(out, aad + 8, 3); // type + version
+    out[3] = static_cast<uint8_t>(recordLength >> 8);
+    out[4] = static_cast<uint8_t>(recordLength & 0xFF);
+    std::memcpy(explicitNonce, nonce + SALT_SIZE, EXPLICIT_NONCE_SIZE);
+
+    write_.sequence++;
+    stats_.recordsEncrypted++;
+    return static_cast<int>(length + OVERHEAD);
+}
+
+} // namespace aap
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "aes_gcm.h"
+#include <cstdint>
+#include <cstddef>
+
+namespace aap {
+
+/**
+ * TLS 1.2 AES-GCM record protection (RFC 5288) for application data,
+ * keyed with traffic secrets exported after the SSLEngine handshake.
+ *
+ * Record layout: type(1) version(2) length(2) explicit_nonce(8)
+ * ciphertext tag(16). Not thread-safe: each direction must be used
+ * from one thread, in record order.
+ */
+class TlsRecordLayer {
+public:
+    static constexpr size_t HEADER_SIZE = 5;
+    static constexpr size_t SALT_SIZE = 4;
+    static constexpr size_t EXPLICIT_NONCE_SIZE = 8;
+    static constexpr size_t OVERHEAD = HEADER_SIZE + EXPLICIT_NONCE_SIZE + AesGcm::TAG_SIZE;
+    static constexpr uint8_t CONTENT_APPLICATION_DATA = 0x17;
+    static constexpr uint16_t VERSION_TLS12 = 0x0303;
+
+    TlsRecordLayer() = default;
+
+    // Non-copyable
+    TlsRecordLayer(const TlsRecordLayer&) = delete;
+    TlsRecordLayer& operator=(const TlsRecordLayer&) = delete;
+
+    /**
+     * Set the key for records received from the phone.
+     * @param keyLength 16 or 32 bytes
+     * @param salt Implicit nonce part (client/server write IV)
+     * @param sequence Next expected record sequence number
+     */
+    bool setReadKey(const uint8_t* key, size_t keyLength, const uint8_t* salt, uint64_t sequence);
+
+    /**
+     * Set the key for records sent to the phone.
+     */
+    bool setWriteKey(const uint8_t* key, size_t keyLength, const uint8_t* salt, uint64_t sequence);
+
+    bool hasReadKey() const { return read_.cipher.hasKey(); }
+    bool hasWriteKey() const { return write_.cipher.hasKey(); }
+
+    /**
+     * Verify and decrypt one record.
+     * out may point at record + HEADER_SIZE + EXPLICIT_NONCE_SIZE to decrypt in place.
+     * @return Plaintext length, or -1 if the record is malformed or fails authentication
+     */
+    int decrypt(const uint8_t* record, size_t length, uint8_t* out);
+
+    /**
+     * Hand out the next read sequence number for decryptAt().
+     * Must be called in record order, from the thread that frames records.
+     */
+    uint64_t reserveReadSequence() { return read_.sequence++; }
+
+    /**
+     * Verify and decrypt one record with an already assigned sequence number.
+     * Safe to call concurrently once the read key is set; does not update stats.
+     * @return Plaintext length, or -1 if the record is malformed or fails authentication
+     */
+    int decryptAt(const uint8_t* record, size_t length, uint8_t* out, uint64_t sequence) const;
+
+    /**
+     * Encrypt plaintext into a complete record.
+     * @param out Must hold length + OVERHEAD bytes; may alias plaintext
+     *            at out + HEADER_SIZE + EXPLICIT_NONCE_SIZE
+     * @return Record length, or -1 without a write key
+     */
+    int encrypt(const uint8_t* plaintext, size_t length, uint8_t* out);
+
+    struct Stats {
+        uint64_t recordsDecrypted;
+        uint64_t recordsEncrypted;
+        uint64_t authFailures;
+    };
+    Stats getStats() const { return stats_; }
+
+private:
+    struct Direction {
+        AesGcm cipher;
+        uint8_t salt[SALT_SIZE] = {};
+        uint64_t sequence = 0;
+    };
+
+    Direction read_;
+    Direction write_;
+    Stats stats_{};
+
+    static bool setKey(Direction& dir, const uint8_t* key, size_t keyLength,
+                       const uint8_t* salt, uint64_t sequence);
+    static void buildAad(uint8_t* aad, uint64_t sequence, size_t plaintextLength);
+};
+
+} // namespace aap
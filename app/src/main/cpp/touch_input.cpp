@@ -0,0 +1,189 @@
+#include "touch_input.h"
+#include "aap_message.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <cstring>
+#include <time.h>
+
+#define LOG_TAG "TouchInput"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+constexpr uint8_t INPUT_RECORD_FLAGS = 0x0b;
+constexpr uint16_t INPUT_EVENT = 0x8001;
+
+// Protobuf wire types
+constexpr uint8_t WIRE_VARINT = 0;
+constexpr uint8_t WIRE_LENGTH = 2;
+
+uint64_t monotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+uint8_t* writeVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+uint8_t* writeTag(uint8_t* out, int field, uint8_t wireType) {
+    return writeVarint(out, (static_cast<uint64_t>(field) << 3) | wireType);
+}
+
+uint8_t* writeVarintField(uint8_t* out, int field, uint64_t value) {
+    return writeVarint(writeTag(out, field, WIRE_VARINT), value);
+}
+
+} // anonymous namespace
+
+TouchInput::TouchInput()
+    : queue_(QUEUE_SLOTS, QUEUE_SLOTS * sizeof(TouchSample))
+{
+}
+
+TouchInput::~TouchInput() {
+    stop();
+}
+
+void TouchInput::setRecordCallback(InputRecordCallback callback) {
+    callback_ = std::move(callback);
+}
+
+void TouchInput::start() {
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    thread_ = std::thread(&TouchInput::inputLoop, this);
+    LOGD("Touch input fast path started");
+}
+
+void TouchInput::stop() {
+    if (!running_) {
+        return;
+    }
+    running_ = false;
+    queue_.shutdown();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool TouchInput::submit(const TouchSample& sample) {
+    if (sample.pointerCount == 0 || sample.pointerCount > TouchSample::MAX_POINTERS) {
+        return false;
+    }
+    TouchSample stamped = sample;
+    if (stamped.timestampNs == 0) {
+        stamped.timestampNs = monotonicNs();
+    }
+    if (!queue_.push(Channel::ID_INP, stamped.action, reinterpret_cast<const uint8_t*>(&stamped),
+                     sizeof(stamped), stamped.timestampNs)) {
+        samplesDropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    samplesSubmitted_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void TouchInput::inputLoop() {
+    applyThreadPolicy("AAP-Input");
+
+    TouchSample pending;
+    bool havePending = false;
+    while (true) {
+        SpscMessageQueue::Message msg;
+        // Only block with nothing held back: a pending MOVE goes out as soon
+        // as the queue runs dry
+        const bool got = havePending ? queue_.acquireFor(msg, 0) : queue_.acquire(msg);
+        if (!got) {
+            if (!havePending) {
+                return;  // Shut down and drained
+            }
+            send(pending);
+            havePending = false;
+            continue;
+        }
+
+        TouchSample sample;
+        std::memcpy(&sample, msg.data, sizeof(sample));
+        queue_.release();
+
+        if (havePending) {
+            if (pending.action == TouchSample::ACTION_MOVE && sample.action == TouchSample::ACTION_MOVE &&
+                    pending.pointerCount == sample.pointerCount) {
+                movesCoalesced_.fetch_add(1, std::memory_order_relaxed);
+                pending = sample;
+                continue;
+            }
+            send(pending);
+        }
+        pending = sample;
+        havePending = true;
+    }
+}
+
+void TouchInput::send(const TouchSample& sample) {
+    const size_t length = encode(sample);
+    recordsSent_.fetch_add(1, std::memory_order_relaxed);
+    if (callback_) {
+        callback_(record_, length);
+    }
+}
+
+// Same encoding as the Kotlin TouchEvent message
+size_t TouchInput::encode(const TouchSample& sample) {
+    // TouchEvent: pointer_data = 1, action_index = 2, action = 3
+    uint8_t touch[TouchSample::MAX_POINTERS * 20 + 16];
+    uint8_t* out = touch;
+    for (int i = 0; i < sample.pointerCount; i++) {
+        // Pointer: x = 1, y = 2, pointer_id = 3
+        uint8_t pointer[20];
+        uint8_t* p = writeVarintField(pointer, 1, sample.pointers[i].x);
+        p = writeVarintField(p, 2, sample.pointers[i].y);
+        p = writeVarintField(p, 3, sample.pointers[i].id);
+        out = writeTag(out, 1, WIRE_LENGTH);
+        out = writeVarint(out, static_cast<uint64_t>(p - pointer));
+        std::memcpy(out, pointer, static_cast<size_t>(p - pointer));
+        out += p - pointer;
+    }
+    out = writeVarintField(out, 2, sample.actionIndex);
+    out = writeVarintField(out, 3, sample.action);
+
+    // InputReport: timestamp = 1, touch_event = 3
+    uint8_t* report = record_ + EncryptedHeader::SIZE + 2;
+    uint8_t* end = writeVarintField(report, 1, sample.timestampNs);
+    end = writeTag(end, 3, WIRE_LENGTH);
+    end = writeVarint(end, static_cast<uint64_t>(out - touch));
+    std::memcpy(end, touch, static_cast<size_t>(out - touch));
+    end += out - touch;
+
+    const size_t length = static_cast<size_t>(end - record_);
+    const size_t payload = length - EncryptedHeader::SIZE;
+    record_[0] = static_cast<uint8_t>(Channel::ID_INP);
+    record_[1] = INPUT_RECORD_FLAGS;
+    record_[2] = static_cast<uint8_t>(payload >> 8);
+    record_[3] = static_cast<uint8_t>(payload & 0xFF);
+    record_[4] = static_cast<uint8_t>(INPUT_EVENT >> 8);
+    record_[5] = static_cast<uint8_t>(INPUT_EVENT & 0xFF);
+    return length;
+}
+
+TouchInput::Stats TouchInput::getStats() const {
+    Stats stats;
+    stats.samplesSubmitted = samplesSubmitted_.load(std::memory_order_relaxed);
+    stats.movesCoalesced = movesCoalesced_.load(std::memory_order_relaxed);
+    stats.recordsSent = recordsSent_.load(std::memory_order_relaxed);
+    stats.samplesDropped = samplesDropped_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace aap
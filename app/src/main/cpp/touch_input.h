@@ -0,0 +1,110 @@
+#pragma once
+
+#include "message_queue.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <thread>
+
+namespace aap {
+
+/**
+ * Callback for one encoded input record.
+ * Parameters: plaintext ID_INP record (header, message type, InputReport), length.
+ * The record is reused once the callback returns.
+ */
+using InputRecordCallback = std::function<void(const uint8_t* record, size_t length)>;
+
+/**
+ * One touch sample as reported by the view, in phone screen coordinates.
+ */
+struct TouchSample {
+    static constexpr int MAX_POINTERS = 10;
+
+    // TouchEvent.PointerAction values
+    static constexpr uint8_t ACTION_DOWN = 0;
+    static constexpr uint8_t ACTION_UP = 1;
+    static constexpr uint8_t ACTION_MOVE = 2;
+
+    struct Pointer {
+        uint32_t id;
+        uint32_t x;
+        uint32_t y;
+    };
+
+    uint64_t timestampNs;  // CLOCK_MONOTONIC time of the sample
+    uint8_t action;
+    uint8_t actionIndex;
+    uint8_t pointerCount;
+    Pointer pointers[MAX_POINTERS];
+};
+
+/**
+ * Touch input fast path on its own AAP-Input thread.
+ *
+ * submit() only copies the sample into a lock-free queue. The input
+ * thread encodes each sample into an InputReport record and hands it to
+ * Kotlin, which encrypts and writes it at once, ahead of anything queued
+ * on the transport's handler. While a write is in progress new samples
+ * queue up here, and a run of MOVE samples is coalesced into the latest
+ * one. DOWN, UP and pointer changes are never coalesced.
+ */
+class TouchInput {
+public:
+    static constexpr size_t QUEUE_SLOTS = 256;
+    // Header, message type, InputReport with up to MAX_POINTERS pointers
+    static constexpr size_t MAX_RECORD_SIZE = 6 + 32 + TouchSample::MAX_POINTERS * 20;
+
+    TouchInput();
+    ~TouchInput();
+
+    // Non-copyable
+    TouchInput(const TouchInput&) = delete;
+    TouchInput& operator=(const TouchInput&) = delete;
+
+    /**
+     * Must be called before start().
+     */
+    void setRecordCallback(InputRecordCallback callback);
+
+    void start();
+
+    /**
+     * Stop the input thread, samples already queued are sent first.
+     */
+    void stop();
+
+    /**
+     * Queue a sample. Producer side: call from one thread at a time.
+     * @return false if the queue is full or the sample is invalid
+     */
+    bool submit(const TouchSample& sample);
+
+    struct Stats {
+        uint64_t samplesSubmitted;
+        uint64_t movesCoalesced;  // MOVE samples replaced by a later one
+        uint64_t recordsSent;
+        uint64_t samplesDropped;  // Queue full
+    };
+    Stats getStats() const;
+
+private:
+    SpscMessageQueue queue_;
+    InputRecordCallback callback_;
+    std::thread thread_;
+    bool running_ = false;
+
+    uint8_t record_[MAX_RECORD_SIZE];  // Input thread only
+
+    std::atomic<uint64_t> samplesSubmitted_{0};
+    std::atomic<uint64_t> movesCoalesced_{0};
+    std::atomic<uint64_t> recordsSent_{0};
+    std::atomic<uint64_t> samplesDropped_{0};
+
+    void inputLoop();
+    void send(const TouchSample& sample);
+    size_t encode(const TouchSample& sample);
+};
+
+} // namespace aap
@@ -0,0 +1,99 @@
+#include "trace.h"
+#include <android/log.h>
+#include <dlfcn.h>
+
+#define LOG_TAG "Trace"
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace detail {
+std::atomic<bool> tracingEnabled{false};
+} // namespace detail
+
+namespace {
+
+/**
+ * ATrace entry points from libandroid, resolved at runtime: minSdk is 21.
+ */
+struct ATraceApi {
+    bool (*isEnabled)() = nullptr;
+    void (*beginSection)(const char*) = nullptr;
+    void (*endSection)() = nullptr;
+    // API 29
+    void (*beginAsyncSection)(const char*, int32_t) = nullptr;
+    void (*endAsyncSection)(const char*, int32_t) = nullptr;
+    void (*setCounter)(const char*, int64_t) = nullptr;
+};
+
+template <typename T>
+void resolve(void* lib, const char* name, T& fn) {
+    fn = reinterpret_cast<T>(dlsym(lib, name));
+}
+
+const ATraceApi& atrace() {
+    static const ATraceApi api = [] {
+        ATraceApi result;
+        void* lib = dlopen("libandroid.so", RTLD_NOW);
+        if (!lib) {
+            return result;
+        }
+        resolve(lib, "ATrace_isEnabled", result.isEnabled);
+        resolve(lib, "ATrace_beginSection", result.beginSection);
+        resolve(lib, "ATrace_endSection", result.endSection);
+        resolve(lib, "ATrace_beginAsyncSection", result.beginAsyncSection);
+        resolve(lib, "ATrace_endAsyncSection", result.endAsyncSection);
+        resolve(lib, "ATrace_setCounter", result.setCounter);
+        if (!result.isEnabled || !result.beginSection || !result.endSection) {
+            result = ATraceApi();
+        }
+        return result;
+    }();
+    return api;
+}
+
+} // anonymous namespace
+
+bool setTracingEnabled(bool enabled) {
+    const bool available = atrace().isEnabled != nullptr;
+    detail::tracingEnabled.store(enabled && available, std::memory_order_relaxed);
+    LOGI("Native tracing %s%s", enabled && available ? "enabled" : "disabled",
+         enabled && !available ? ", ATrace not available" : "");
+    return available || !enabled;
+}
+
+bool traceBegin(const char* name) {
+    const ATraceApi& api = atrace();
+    if (!api.beginSection || !api.isEnabled()) {
+        return false;
+    }
+    api.beginSection(name);
+    return true;
+}
+
+void traceEnd() {
+    atrace().endSection();
+}
+
+void traceAsyncBegin(const char* name, int32_t cookie) {
+    const ATraceApi& api = atrace();
+    if (api.beginAsyncSection && api.isEnabled()) {
+        api.beginAsyncSection(name, cookie);
+    }
+}
+
+void traceAsyncEnd(const char* name, int32_t cookie) {
+    const ATraceApi& api = atrace();
+    if (api.endAsyncSection && api.isEnabled()) {
+        api.endAsyncSection(name, cookie);
+    }
+}
+
+void traceCounter(const char* name, int64_t value) {
+    const ATraceApi& api = atrace();
+    if (api.setCounter && api.isEnabled()) {
+        api.setCounter(name, value);
+    }
+}
+
+} // namespace aap
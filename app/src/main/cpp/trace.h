@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace aap {
+
+/**
+ * Trace sections and counters for system traces (Perfetto, systrace),
+ * so native stages show up next to SurfaceFlinger and MediaCodec.
+ *
+ * Compiled in everywhere but off until setTracingEnabled(): a disabled
+ * trace point costs one relaxed load. Once enabled, a point only emits
+ * while the app is being traced. ATrace is resolved at runtime, sections
+ * are API 23 and counters and async sections API 29; where it is missing
+ * (older releases, the host build) trace points stay no-ops.
+ */
+
+namespace detail {
+extern std::atomic<bool> tracingEnabled;
+} // namespace detail
+
+inline bool isTracingEnabled() {
+    return detail::tracingEnabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * @return false if ATrace is not available, tracing then stays off
+ */
+bool setTracingEnabled(bool enabled);
+
+/**
+ * Begin a section on this thread.
+ * @return false if nothing was begun, skip traceEnd() then
+ */
+bool traceBegin(const char* name);
+void traceEnd();
+
+/**
+ * Section spanning threads, e.g. submit to completion. Matched by name and cookie.
+ */
+void traceAsyncBegin(const char* name, int32_t cookie);
+void traceAsyncEnd(const char* name, int32_t cookie);
+
+void traceCounter(const char* name, int64_t value);
+
+/**
+ * Section for the rest of the enclosing scope.
+ */
+class TraceSection {
+public:
+    explicit TraceSection(const char* name)
+        : active_(isTracingEnabled() && traceBegin(name)) {}
+    ~TraceSection() {
+        if (active_) {
+            traceEnd();
+        }
+    }
+
+    // Non-copyable
+    TraceSection(const TraceSection&) = delete;
+    TraceSection& operator=(const TraceSection&) = delete;
+
+private:
+    const bool active_;
+};
+
+// Trace points: arguments are only evaluated while tracing is enabled
+#define AAP_TRACE_CONCAT_(a, b) a##b
+#define AAP_TRACE_CONCAT(a, b) AAP_TRACE_CONCAT_(a, b)
+#define AAP_TRACE_SECTION(name) ::aap::TraceSection AAP_TRACE_CONCAT(aapTraceSection, __LINE__)(name)
+
+#define AAP_TRACE_COUNTER(name, value) \
+    do { if (::aap::isTracingEnabled()) ::aap::traceCounter(name, static_cast<int64_t>(value)); } while (0)
+
+#define AAP_TRACE_ASYNC_BEGIN(name, cookie) \
+    do { if (::aap::isTracingEnabled()) ::aap::traceAsyncBegin(name, static_cast<int32_t>(cookie)); } while (0)
+
+#define AAP_TRACE_ASYNC_END(name, cookie) \
+    do { if (::aap::isTracingEnabled()) ::aap::traceAsyncEnd(name, static_cast<int32_t>(cookie)); } while (0)
+
+} // namespace aap
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+namespace aap {
+
+/**
+ * Error callback type.
+ * Parameters: error code, error message
+ */
+using ErrorCallback = std::function<void(int errorCode, const char* message)>;
+
+/**
+ * Raw data callback type.
+ * Parameters: data pointer, data length
+ * Called directly from the transport's event thread for each read, or
+ * from UsbConnection's AAP-USB-Rx thread when it swaps transfer buffers.
+ * The data is only valid until the callback returns.
+ */
+using RawDataCallback = std::function<void(const uint8_t* data, size_t length)>;
+
+class SessionCapture;
+
+/**
+ * One piece of an outgoing record for Transport::writeSegments(), e.g.
+ * the AAP header, a fragment's total length or the sealed TLS record.
+ */
+struct TxSegment {
+    const uint8_t* data;
+    size_t length;
+};
+
+/**
+ * Where the event thread and the TX path are, for StallWatchdog.
+ * Counters are running totals.
+ */
+struct TransportProgress {
+    uint64_t deliveries = 0;    // Reads the callbacks returned from
+    bool delivering = false;    // A callback is running right now
+    uint64_t txCompleted = 0;   // OUT transfers completed, or bytes sent
+    uint64_t txPending = 0;     // OUT transfers in flight, or bytes in the backlog
+    uint64_t rxInFlight = 0;    // IN transfers submitted, 0 for a socket
+};
+
+/**
+ * Byte stream to the phone, implemented by UsbConnection and TcpConnection.
+ *
+ * Opening is backend specific; once open, the framer, TLS record layer,
+ * dispatcher and TX path are built on this surface only, so USB and
+ * wireless share one data path.
+ */
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    /**
+     * Stop reading and release the connection.
+     */
+    virtual void close() = 0;
+
+    virtual bool isOpen() const = 0;
+
+    /**
+     * Set raw data callback. Safe to call while reading, but not from a
+     * callback of the same transport: it returns once the old callback
+     * is no longer running.
+     */
+    virtual void setRawDataCallback(RawDataCallback callback) = 0;
+
+    virtual void setErrorCallback(ErrorCallback callback) = 0;
+
+    /**
+     * Copy every read into a capture, before the RawDataCallback sees it.
+     * Safe to call while reading; nullptr stops capturing. The capture
+     * must outlive its use here.
+     */
+    virtual void setCapture(SessionCapture* capture) = 0;
+
+    /**
+     * Start the event thread. Raw data is delivered via the RawDataCallback.
+     */
+    virtual void startReading() = 0;
+    virtual void stopReading() = 0;
+
+    /**
+     * Between startReading() and stopReading(): write() is then queued
+     * rather than blocking on the wire.
+     */
+    virtual bool isReading() const = 0;
+
+    /**
+     * Write data. Safe to call from any thread.
+     * While reading the data may be queued and sent from the event thread;
+     * otherwise (handshake) it is written synchronously.
+     * @return Number of bytes written or queued, or negative on error
+     */
+    virtual int write(const uint8_t* data, size_t length) = 0;
+
+    /**
+     * Write segments back to back, as if joined into one write(): each is
+     * copied once, into the backend's own TX buffer, never into a joined
+     * copy first. Safe to call from any thread, like write().
+     *
+     * The default writes the segments in turn, which is only the same as
+     * a single write() for a backend no other thread writes to meanwhile.
+     * @return Number of bytes written or queued, or negative on error
+     */
+    virtual int writeSegments(const TxSegment* segments, size_t count) {
+        int total = 0;
+        for (size_t i = 0; i < count; i++) {
+            const int written = write(segments[i].data, segments[i].length);
+            if (written < 0) {
+                return total > 0 ? total : written;
+            }
+            total += written;
+            if (static_cast<size_t>(written) < segments[i].length) {
+                break;
+            }
+        }
+        return total;
+    }
+
+    /**
+     * Read data (synchronous, for handshake).
+     * @return Number of bytes read, 0 on timeout, or negative on error
+     */
+    virtual int read(uint8_t* buffer, size_t length, int timeoutMs) = 0;
+
+    /**
+     * Keep less in flight while little more than audio flows, with the
+     * projection in the background. Safe to call from any thread; nothing
+     * to do for a backend with nothing queued to the device.
+     */
+    virtual void setIdle(bool idle) { (void)idle; }
+
+    /**
+     * Safe to call from any thread, takes no lock the data path holds.
+     */
+    virtual TransportProgress progress() const { return TransportProgress{}; }
+
+    /**
+     * Get the last error message.
+     */
+    virtual const char* getLastError() const = 0;
+};
+
+} // namespace aap
@@ -1,25 +1,67 @@
 #include "usb_connection.h"
+#include "aap_message.h"
+#include "fast_log.h"
+#include "session_capture.h"
+#include "thread_policy.h"
+#include "trace.h"
 #include <android/log.h>
+#include <cerrno>
 #include <cstdarg>
+#include <algorithm>
 #include <cstring>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
 
 #define LOG_TAG "UsbConnection"
 #define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+// Per-packet points, recorded off the I/O thread
+#define LOGD_FAST(...) AAP_FAST_LOG(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
 
 namespace aap {
 
 // USB timeouts
 constexpr int WRITE_TIMEOUT_MS = 1000;
 
+// Adaptive depth: grow after every in-flight transfer completed full this
+// many times in a row, shrink one step per idle period
+constexpr int GROW_STREAK_ROUNDS = 2;
+constexpr int64_t IDLE_SHRINK_MS = 1000;
+// Idle check period while the depth is above the minimum
+constexpr int64_t SHRINK_TICK_MS = 250;
+// Leaving idle, retry restoring a slot that was still busy this soon
+constexpr int64_t IDLE_RETRY_MS = 10;
+
+// Failed IN transfers wait out a backoff that doubles with every round of
+// failures from the first value to the last, and error upcalls go out at
+// most once per interval however fast transfers fail
+constexpr int64_t RETRY_BACKOFF_MIN_US = 1000;
+constexpr int64_t RETRY_BACKOFF_MAX_US = 128000;
+constexpr int64_t ERROR_REPORT_INTERVAL_MS = 1000;
+
+// OUT transfers that bulk uplink (mic audio) may not take, so control,
+// input and ACK records never wait behind it for a free transfer
+constexpr int TX_RESERVED_URGENT = 2;
+
+static bool isBulkUplink(uint8_t channel) {
+    return Channel::info(channel).bulkUplink;
+}
+
+static int64_t monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
 UsbConnection::UsbConnection() = default;
 
 UsbConnection::~UsbConnection() {
     close();
 }
 
-bool UsbConnection::open(int fd) {
+bool UsbConnection::open(int fd, const TransferConfig& config) {
     if (deviceHandle_) {
         setError("Already open");
         return false;
@@ -27,57 +69,69 @@ bool UsbConnection::open(int fd) {
 
     LOGI("Opening USB connection with fd=%d", fd);
 
-    // On Android with wrapped file descriptors, we must disable device discovery
-    // since we're using Android's USB subsystem to get the FD
-    int rc = libusb_set_option(nullptr, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
-    if (rc != LIBUSB_SUCCESS) {
-        LOGE("libusb_set_option(NO_DEVICE_DISCOVERY) failed: %s (continuing anyway)", libusb_error_name(rc));
-    }
-
-    // Initialize libusb
-    rc = libusb_init(&context_);
-    if (rc != LIBUSB_SUCCESS) {
-        setError("libusb_init failed: %s", libusb_error_name(rc));
+    minDepth_ = std::max(1, std::min(config.numTransfers, MAX_TRANSFERS));
+    loggedMemory_ = false;
+    adaptive_ = config.adaptive;
+    poolSize_ = adaptive_ ? MAX_TRANSFERS : minDepth_;
+    transferSize_ = std::max<size_t>(1, std::min(config.transferSize, MAX_TRANSFER_SIZE));
+    // One buffer per transfer plus the spares
+    rxCapacity_ = config.spareBuffers > 0 ? poolSize_ + std::min(config.spareBuffers, MAX_SPARE_BUFFERS) : 0;
+
+    // libusb is initialised once per process, see UsbContext
+    context_ = UsbContext::acquire();
+    if (!context_) {
+        setError("libusb context unavailable");
         return false;
     }
 
-    // Set debug level
-    libusb_set_option(context_, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_WARNING);
-
     // Wrap the Android file descriptor
-    rc = libusb_wrap_sys_device(context_, (intptr_t)fd, &deviceHandle_);
+    int rc = libusb_wrap_sys_device(context_->get(), (intptr_t)fd, &deviceHandle_);
     if (rc != LIBUSB_SUCCESS) {
         setError("libusb_wrap_sys_device failed: %s", libusb_error_name(rc));
-        libusb_exit(context_);
-        context_ = nullptr;
+        context_.reset();
         return false;
     }
 
     LOGI("Device wrapped successfully");
 
-    // Find endpoints
-    if (!findEndpoints()) {
+    // Find endpoints, allocate the transfer pools and the timers
+    if (!findEndpoints() || !allocateTransfers() || !allocateTxTransfers() ||
+        !openTimer(timerFd_, &UsbConnection::onShrinkTick) || !openTimer(retryTimerFd_, &UsbConnection::onRetryTick) ||
+        !openTimer(idleTimerFd_, &UsbConnection::onIdleTick)) {
+        closeTimers();
+        freeTxTransfers();
+        freeTransfers();
         libusb_close(deviceHandle_);
         deviceHandle_ = nullptr;
-        libusb_exit(context_);
-        context_ = nullptr;
+        context_.reset();
         return false;
     }
+    context_->countAttach();
 
     // When using libusb_wrap_sys_device with an Android file descriptor,
     // the interface is already claimed by Android's UsbDeviceConnection.
     // We should NOT call libusb_claim_interface as it will fail with BUSY.
     LOGI("Skipping interface claim - Android already claimed it");
 
+    const int speed = libusb_get_device_speed(libusb_get_device(deviceHandle_));
+    linkMonitor_.reset(speed);
+
     LOGI("USB connection opened successfully");
     LOGI("  IN endpoint: 0x%02x, OUT endpoint: 0x%02x", inEndpoint_, outEndpoint_);
-    LOGI("  Max packet size: %d", maxPacketSize_);
+    LOGI("  Max packet size: %d, speed: %d", maxPacketSize_, speed);
+    LOGI("  Transfers: %d x %zu bytes%s", minDepth_, transferSize_, adaptive_ ? " (adaptive)" : "");
+    if (rxBuffers_) {
+        LOGI("  Resubmit-first: %d spare buffers", rxCapacity_ - poolSize_);
+    }
 
     return true;
 }
 
 void UsbConnection::close() {
     stopReading();
+    closeTimers();
+    freeTxTransfers();
+    freeTransfers();
 
     if (deviceHandle_) {
         LOGI("Closing USB connection");
@@ -86,9 +140,192 @@ void UsbConnection::close() {
         deviceHandle_ = nullptr;
     }
 
-    if (context_) {
-        libusb_exit(context_);
-        context_ = nullptr;
+    // The context and its event thread stay up for the next connection
+    context_.reset();
+}
+
+bool UsbConnection::openTimer(int& fd, void (UsbConnection::*onTick)()) {
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        setError("Timer: %s", strerror(errno));
+        return false;
+    }
+    if (!context_->watch(fd, [this, onTick] { (this->*onTick)(); })) {
+        setError("Timer not watched");
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    return true;
+}
+
+void UsbConnection::closeTimers() {
+    for (int* fd : {&timerFd_, &retryTimerFd_, &idleTimerFd_}) {
+        if (*fd >= 0) {
+            context_->unwatch(*fd);
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+    timerArmed_ = false;
+    retryArmed_ = false;
+}
+
+void UsbConnection::onShrinkTick() {
+    uint64_t value;
+    while (::read(timerFd_, &value, sizeof(value)) > 0) {
+    }
+    if (!running_) {
+        armShrinkTimer(false);
+        return;
+    }
+    shrinkIfIdle();
+}
+
+void UsbConnection::armShrinkTimer(bool armed) {
+    if (armed == timerArmed_) {
+        return;
+    }
+    timerArmed_ = armed;
+    struct itimerspec spec = {};
+    if (armed) {
+        spec.it_value.tv_sec = SHRINK_TICK_MS / 1000;
+        spec.it_value.tv_nsec = (SHRINK_TICK_MS % 1000) * 1000000L;
+        spec.it_interval = spec.it_value;
+    }
+    timerfd_settime(timerFd_, 0, &spec, nullptr);
+}
+
+void UsbConnection::transferFailed(Transfer& transfer, int status) {
+    // Rate limited: a dead link fails every transfer as fast as it is submitted
+    const int64_t now = monotonicMs();
+    if (now - lastErrorReportMs_ >= ERROR_REPORT_INTERVAL_MS) {
+        LOGE("Transfer failed: status=%d, %d more failures not reported", status, errorsSuppressed_);
+        lastErrorReportMs_ = now;
+        errorsSuppressed_ = 0;
+        // Report error but try to continue
+        reportError(status, "USB transfer failed");
+    } else {
+        errorsSuppressed_++;
+    }
+
+    // A stalled endpoint fails everything until its halt is cleared. The
+    // other statuses are glitches the next submit may not see.
+    if (status == LIBUSB_TRANSFER_STALL) {
+        haltPending_ = true;
+    }
+    transfer.retry = true;
+    if (!retryArmed_) {
+        // Every transfer failing before the timer fires joins this round
+        const int64_t delayUs = std::min(RETRY_BACKOFF_MIN_US << std::min(retryRound_, 16), RETRY_BACKOFF_MAX_US);
+        retryRound_++;
+        retryArmed_ = true;
+        linkMonitor_.retryScheduled();
+        struct itimerspec spec = {};
+        spec.it_value.tv_sec = delayUs / 1000000;
+        spec.it_value.tv_nsec = (delayUs % 1000000) * 1000L;
+        timerfd_settime(retryTimerFd_, 0, &spec, nullptr);
+    }
+}
+
+void UsbConnection::onRetryTick() {
+    uint64_t value;
+    while (::read(retryTimerFd_, &value, sizeof(value)) > 0) {
+    }
+    retryArmed_ = false;
+    if (!running_) {
+        return;
+    }
+
+    if (haltPending_) {
+        // A usbfs ioctl, not a transfer, so fine on the event thread
+        haltPending_ = false;
+        const int rc = libusb_clear_halt(deviceHandle_, inEndpoint_);
+        if (rc == LIBUSB_SUCCESS) {
+            linkMonitor_.haltCleared();
+            LOGI("Cleared halt on IN endpoint 0x%02x", inEndpoint_);
+        } else {
+            LOGE("libusb_clear_halt failed: %s", libusb_error_name(rc));
+        }
+    }
+
+    // Resubmit unless retired by an adaptive shrink meanwhile
+    const int depth = activeDepth_;
+    for (int i = 0; i < poolSize_; i++) {
+        Transfer& t = transfers_[i];
+        if (!t.retry) {
+            continue;
+        }
+        t.retry = false;
+        if (i < depth && !t.pending) {
+            submitTransfer(t);
+        }
+    }
+}
+
+void UsbConnection::setIdle(bool idle) {
+    if (idle_.exchange(idle) == idle || idleTimerFd_ < 0) {
+        return;
+    }
+    struct itimerspec spec = {};
+    spec.it_value.tv_nsec = 1;
+    timerfd_settime(idleTimerFd_, 0, &spec, nullptr);
+}
+
+void UsbConnection::onIdleTick() {
+    uint64_t value;
+    while (::read(idleTimerFd_, &value, sizeof(value)) > 0) {
+    }
+    if (!running_) {
+        return;
+    }
+
+    const int depth = activeDepth_;
+    if (idle_) {
+        // Like a shrink, but nothing in flight is cancelled
+        if (depth > 1) {
+            activeDepth_ = 1;
+            fullStreak_ = 0;
+            LOGI("Transfer depth decreased to 1 while idle");
+        }
+        return;
+    }
+    if (depth >= minDepth_) {
+        return;
+    }
+
+    // One slot at a time, as adaptDepth() grows: a slot that is in flight,
+    // with the consumer or parked is retried on the next tick
+    int restored = depth;
+    while (restored < minDepth_) {
+        Transfer& t = transfers_[restored];
+        if (t.pending || t.held || t.retry) {
+            break;
+        }
+        if (rxBuffers_) {
+            // Raised under rxMutex_, so returnRxBuffer() either sees the new depth or the slot parked
+            std::lock_guard<std::mutex> lock(rxMutex_);
+            if (t.rxBuffer < 0) {
+                break;
+            }
+            activeDepth_ = restored + 1;
+        } else {
+            if (!t.buffer) {
+                break;
+            }
+            activeDepth_ = restored + 1;
+        }
+        t.completedNs = 0;
+        submitTransfer(t);
+        restored++;
+    }
+
+    if (restored < minDepth_) {
+        struct itimerspec spec = {};
+        spec.it_value.tv_nsec = IDLE_RETRY_MS * 1000000L;
+        timerfd_settime(idleTimerFd_, 0, &spec, nullptr);
+    } else {
+        LOGI("Transfer depth restored to %d", minDepth_);
     }
 }
 
@@ -150,81 +387,384 @@ bool UsbConnection::findEndpoints() {
 }
 
 void UsbConnection::setRawDataCallback(RawDataCallback callback) {
-    std::lock_guard<std::mutex> lock(callbackMutex_);
-    rawDataCallback_ = std::move(callback);
+    callbacks_.update([&callback](Callbacks& callbacks) { callbacks.rawData = std::move(callback); });
+}
+
+void UsbConnection::setSlotCallback(SlotCallback callback) {
+    if (callback && rxBuffers_) {
+        LOGE("Slot callback refused: transfer buffers are swapped");
+        return;
+    }
+    callbacks_.update([&callback](Callbacks& callbacks) { callbacks.slot = std::move(callback); });
+}
+
+void UsbConnection::setCapture(SessionCapture* capture) {
+    callbacks_.update([capture](Callbacks& callbacks) { callbacks.capture = capture; });
+}
+
+void UsbConnection::releaseSlot(int slot) {
+    if (slot < 0 || slot >= poolSize_) {
+        LOGE("releaseSlot: invalid slot %d", slot);
+        return;
+    }
+
+    Transfer& t = transfers_[slot];
+    t.held = false;
+    // Slots retired by an adaptive shrink stay idle
+    if (running_ && t.transfer && !t.pending && slot < activeDepth_) {
+        submitTransfer(t);
+    }
+}
+
+bool UsbConnection::reserveSlotBuffers() {
+    if (rxBuffers_) {
+        setError("No slot buffers: transfer buffers are swapped");
+        return false;
+    }
+    for (int i = 0; i < poolSize_; i++) {
+        if (!transfers_[i].buffer && !allocateBuffer(transfers_[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint8_t* UsbConnection::slotBuffer(int slot) const {
+    if (slot < 0 || slot >= poolSize_) {
+        return nullptr;
+    }
+    return transfers_[slot].buffer;
 }
 
 void UsbConnection::setErrorCallback(ErrorCallback callback) {
-    std::lock_guard<std::mutex> lock(callbackMutex_);
-    errorCallback_ = std::move(callback);
+    callbacks_.update([&callback](Callbacks& callbacks) { callbacks.error = std::move(callback); });
 }
 
 void UsbConnection::startReading() {
-    if (running_.exchange(true)) {
+    if (reading_.exchange(true)) {
         return; // Already running
     }
 
     if (!deviceHandle_) {
         setError("Device not open");
-        running_ = false;
+        reading_ = false;
         return;
     }
+    running_ = true;
 
     LOGI("Starting async USB reading");
+    if (rxBuffers_) {
+        resetRxBuffers();
+        startRxThread();
+    }
 
-    // Allocate and submit transfers
-    for (int i = 0; i < NUM_TRANSFERS; i++) {
-        Transfer& t = transfers_[i];
-        t.transfer = libusb_alloc_transfer(0);
-        if (!t.transfer) {
-            setError("Failed to allocate transfer %d", i);
-            running_ = false;
-            return;
+    // Submit the active transfers
+    fullStreak_ = 0;
+    lastCompletionMs_ = monotonicMs();
+    retryRound_ = 0;
+    haltPending_ = false;
+    for (int i = 0; i < poolSize_; i++) {
+        transfers_[i].retry = false;
+    }
+    const int depth = activeDepth_;
+    for (int i = 0; i < depth; i++) {
+        transfers_[i].completedNs = 0;
+        if (!transfers_[i].held && transfers_[i].buffer) {
+            submitTransfer(transfers_[i]);
         }
-        t.buffer = new uint8_t[TRANSFER_SIZE];
-        t.connection = this;
-        t.pending = false;
-
-        submitTransfer(t);
     }
-
-    // Start event handling thread
-    eventThread_ = std::thread(&UsbConnection::eventLoop, this);
 }
 
 void UsbConnection::stopReading() {
-    if (!running_.exchange(false)) {
-        return; // Already stopped
+    if (!reading_.exchange(false)) {
+        return;
     }
 
     LOGI("Stopping async USB reading");
+    // Already cleared if the device went away
+    running_ = false;
+    // Deliver what was already queued; nothing resubmits a parked transfer after this
+    stopRxThread();
 
     // Cancel pending transfers
-    for (int i = 0; i < NUM_TRANSFERS; i++) {
+    for (int i = 0; i < poolSize_; i++) {
         if (transfers_[i].transfer && transfers_[i].pending) {
             libusb_cancel_transfer(transfers_[i].transfer);
         }
     }
 
-    // Wait for event thread to finish
-    if (eventThread_.joinable()) {
-        eventThread_.join();
+    // Cancel in-flight writes and drop anything still staged
+    {
+        std::lock_guard<std::mutex> lock(txMutex_);
+        for (int i = 0; i < NUM_TX_TRANSFERS; i++) {
+            if (txTransfers_[i].pending) {
+                libusb_cancel_transfer(txTransfers_[i].transfer);
+            }
+        }
+        if (txStaging_) {
+            txFree_[txFreeCount_++] = txStaging_;
+            txStaging_ = nullptr;
+        }
+    }
+    txAvailable_.notify_all();
+
+    reapCancelled();
+
+    if (rxBuffers_) {
+        std::lock_guard<std::mutex> lock(rxMutex_);
+        LOGI("Transfers parked for want of a spare buffer: %llu", static_cast<unsigned long long>(rxParks_));
+    }
+    LOGI("Async USB reading stopped");
+}
+
+bool UsbConnection::allocateTransfers() {
+    // Whole packets only, a short buffer would overflow on a full packet
+    if (maxPacketSize_ > 0) {
+        const size_t packet = static_cast<size_t>(maxPacketSize_);
+        transferSize_ = (transferSize_ + packet - 1) / packet * packet;
     }
 
-    // Free transfers
-    for (int i = 0; i < NUM_TRANSFERS; i++) {
+    transfers_.reset(new Transfer[poolSize_]);
+    for (int i = 0; i < poolSize_; i++) {
+        Transfer& t = transfers_[i];
+        t.transfer = context_->takeTransfer();
+        if (!t.transfer) {
+            setError("Failed to allocate transfer %d", i);
+            return false;
+        }
+        t.connection = this;
+        t.index = i;
+        t.pending = false;
+        t.held = false;
+        t.rxBuffer = -1;
+    }
+
+    if (rxCapacity_ > 0) {
+        // Buffers for the initial depth and every spare, adaptive slots
+        // add theirs as the depth grows; startReading() attaches them
+        rxBuffers_.reset(new RxBuffer[rxCapacity_]);
+        rxAllocated_ = 0;
+        const int count = minDepth_ + rxCapacity_ - poolSize_;
+        for (int i = 0; i < count; i++) {
+            if (allocateRxBuffer() < 0) {
+                return false;
+            }
+        }
+        activeDepth_ = minDepth_;
+        return true;
+    }
+
+    // Adaptive slots beyond the initial depth get buffers when first used
+    for (int i = 0; i < minDepth_; i++) {
+        if (!allocateBuffer(transfers_[i])) {
+            return false;
+        }
+    }
+    activeDepth_ = minDepth_;
+    return true;
+}
+
+bool UsbConnection::allocateBuffer(Transfer& transfer) {
+    transfer.buffer = allocateMemory(transfer.deviceMemory);
+    if (!transfer.buffer) {
+        setError("Failed to allocate %zu byte buffer for transfer %d", transferSize_, transfer.index);
+        return false;
+    }
+    return true;
+}
+
+uint8_t* UsbConnection::allocateMemory(bool& deviceMemory) {
+    // Prefer usbfs device memory: the kernel DMAs straight into the mapping
+    // instead of copying every URB. Not available on older kernels.
+    uint8_t* buffer = libusb_dev_mem_alloc(deviceHandle_, transferSize_);
+    deviceMemory = buffer != nullptr;
+    if (deviceMemory != deviceMemory_ || !loggedMemory_) {
+        LOGI("Transfer buffers: %s", deviceMemory ? "usbfs device memory" : "heap");
+        loggedMemory_ = true;
+    }
+    deviceMemory_ = deviceMemory;
+    if (!buffer) {
+        buffer = context_->takeBuffer(transferSize_);
+    }
+    return buffer;
+}
+
+void UsbConnection::freeMemory(uint8_t* buffer, bool deviceMemory) {
+    // Device memory is a mapping of this device's usbfs fd
+    if (deviceMemory) {
+        libusb_dev_mem_free(deviceHandle_, buffer, transferSize_);
+    } else {
+        context_->recycleBuffer(buffer, transferSize_);
+    }
+}
+
+void UsbConnection::freeTransfers() {
+    for (int i = 0; i < poolSize_ && transfers_; i++) {
         Transfer& t = transfers_[i];
         if (t.transfer) {
-            libusb_free_transfer(t.transfer);
+            context_->recycleTransfer(t.transfer);
             t.transfer = nullptr;
         }
-        if (t.buffer) {
-            delete[] t.buffer;
+        if (rxBuffers_) {
+            // Owned by rxBuffers_
             t.buffer = nullptr;
+            t.rxBuffer = -1;
+        } else if (t.buffer) {
+            freeMemory(t.buffer, t.deviceMemory);
+            t.buffer = nullptr;
+            t.deviceMemory = false;
         }
+        t.pending = false;
     }
+    transfers_.reset();
+    activeDepth_ = 0;
 
-    LOGI("Async USB reading stopped");
+    for (int i = 0; i < rxAllocated_; i++) {
+        freeMemory(rxBuffers_[i].data, rxBuffers_[i].deviceMemory);
+    }
+    rxBuffers_.reset();
+    rxAllocated_ = 0;
+    rxQueue_.reset();
+    std::lock_guard<std::mutex> lock(rxMutex_);
+    rxFree_.clear();
+    rxParked_.clear();
+}
+
+int UsbConnection::allocateRxBuffer() {
+    if (rxAllocated_ >= rxCapacity_) {
+        return -1;
+    }
+    RxBuffer& buffer = rxBuffers_[rxAllocated_];
+    buffer.data = allocateMemory(buffer.deviceMemory);
+    if (!buffer.data) {
+        setError("Failed to allocate %zu byte buffer %d", transferSize_, rxAllocated_);
+        return -1;
+    }
+    return rxAllocated_++;
+}
+
+bool UsbConnection::attachRxBuffer(Transfer& transfer) {
+    if (rxFree_.empty()) {
+        return false;
+    }
+    transfer.rxBuffer = rxFree_.back();
+    transfer.buffer = rxBuffers_[transfer.rxBuffer].data;
+    rxFree_.pop_back();
+    return true;
+}
+
+void UsbConnection::resetRxBuffers() {
+    // Whatever a transfer doesn't hold is free, including buffers whose
+    // delivery was cut short by the last stop
+    std::lock_guard<std::mutex> lock(rxMutex_);
+    std::vector<bool> attached(rxAllocated_, false);
+    for (int i = 0; i < poolSize_; i++) {
+        if (transfers_[i].rxBuffer >= 0) {
+            attached[transfers_[i].rxBuffer] = true;
+        }
+    }
+    rxFree_.clear();
+    rxParked_.clear();
+    rxFree_.reserve(rxCapacity_);
+    rxParked_.reserve(poolSize_);
+    for (int i = rxAllocated_ - 1; i >= 0; i--) {
+        if (!attached[i]) {
+            rxFree_.push_back(i);
+        }
+    }
+    const int depth = activeDepth_;
+    for (int i = 0; i < depth; i++) {
+        Transfer& t = transfers_[i];
+        if (t.rxBuffer < 0 && !attachRxBuffer(t)) {
+            rxParked_.push_back(i);
+        }
+    }
+    rxParks_ = 0;
+}
+
+void UsbConnection::startRxThread() {
+    // Room for every buffer at once, so a push only fails once shut down
+    rxQueue_.reset(new SpscMessageQueue(rxCapacity_, rxCapacity_ * sizeof(RxCompletion)));
+    rxThread_ = std::thread(&UsbConnection::rxLoop, this);
+}
+
+void UsbConnection::stopRxThread() {
+    if (rxQueue_) {
+        rxQueue_->shutdown();
+    }
+    if (rxThread_.joinable()) {
+        rxThread_.join();
+    }
+}
+
+void UsbConnection::rxLoop() {
+    applyThreadPolicy("AAP-USB-Rx");
+    LOGD("USB delivery thread started");
+
+    SpscMessageQueue::Message msg;
+    while (rxQueue_->acquire(msg)) {
+        RxCompletion completion;
+        std::memcpy(&completion, msg.data, sizeof(completion));
+        const uint64_t arrival = msg.timestampNs;
+        rxQueue_->release();
+        {
+            AAP_TRACE_SECTION("USB deliver");
+            arrivalNs_ = arrival;
+            deliver(*callbacks_.read(), rxBuffers_[completion.buffer].data,
+                    static_cast<size_t>(completion.length));
+        }
+        returnRxBuffer(completion.buffer);
+    }
+
+    LOGD("USB delivery thread stopped");
+}
+
+void UsbConnection::completeSwapped(Transfer& transfer, int actualLength) {
+    const RxCompletion completion = {transfer.rxBuffer, actualLength};
+    const uint64_t arrival = transfer.completedNs;
+    bool parked;
+    {
+        std::lock_guard<std::mutex> lock(rxMutex_);
+        parked = !attachRxBuffer(transfer);
+        if (parked) {
+            // Every buffer is waiting for the consumer, wait for one to come back
+            transfer.rxBuffer = -1;
+            transfer.buffer = nullptr;
+            rxParked_.push_back(transfer.index);
+            rxParks_++;
+        }
+    }
+
+    // Back to the device before the filled buffer is even queued
+    if (!parked && running_ && transfer.index < activeDepth_) {
+        submitTransfer(transfer);
+    }
+
+    if (!rxQueue_->push(0, 0, reinterpret_cast<const uint8_t*>(&completion), sizeof(completion), arrival)) {
+        returnRxBuffer(completion.buffer);  // Stopping
+    }
+}
+
+void UsbConnection::returnRxBuffer(int buffer) {
+    Transfer* transfer;
+    bool resubmit;
+    {
+        std::lock_guard<std::mutex> lock(rxMutex_);
+        if (rxParked_.empty()) {
+            rxFree_.push_back(buffer);
+            return;
+        }
+        transfer = &transfers_[rxParked_.back()];
+        rxParked_.pop_back();
+        transfer->rxBuffer = buffer;
+        transfer->buffer = rxBuffers_[buffer].data;
+        // Decided under the lock, onIdleTick() raises the depth under it too
+        resubmit = running_ && transfer->index < activeDepth_;
+    }
+    // Retired by an adaptive shrink while parked: keeps the buffer, stays idle
+    if (resubmit) {
+        submitTransfer(*transfer);
+    }
 }
 
 void UsbConnection::submitTransfer(Transfer& transfer) {
@@ -233,15 +773,18 @@ void UsbConnection::submitTransfer(Transfer& transfer) {
         deviceHandle_,
         inEndpoint_,
         transfer.buffer,
-        TRANSFER_SIZE,
+        static_cast<int>(transferSize_),
         transferCallback,
         &transfer,
         0  // No timeout for async reads
     );
 
+    // Counted before the submit, the completion may run first on another thread
+    linkMonitor_.inSubmitted(transfer.completedNs);
     int rc = libusb_submit_transfer(transfer.transfer);
     if (rc != LIBUSB_SUCCESS) {
         LOGE("Failed to submit transfer: %s", libusb_error_name(rc));
+        linkMonitor_.inCompleted(LIBUSB_TRANSFER_ERROR, 0, transferSize_);
         transfer.pending = false;
     } else {
         transfer.pending = true;
@@ -249,40 +792,167 @@ void UsbConnection::submitTransfer(Transfer& transfer) {
 }
 
 void LIBUSB_CALL UsbConnection::transferCallback(libusb_transfer* transfer) {
+    AAP_TRACE_SECTION("USB transfer");
     Transfer* t = static_cast<Transfer*>(transfer->user_data);
     t->pending = false;
+    t->completedNs = UsbLinkMonitor::now();
+    const int inFlight = t->connection->linkMonitor_.inCompleted(
+        transfer->status, transfer->actual_length, t->connection->transferSize_);
 
+    if (transfer->status == LIBUSB_TRANSFER_NO_DEVICE) {
+        t->connection->deviceLost();
+        return;
+    }
     if (!t->connection->running_) {
         return;
     }
 
     if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
-        t->connection->handleTransferComplete(*t, transfer->actual_length);
+        t->connection->retryRound_ = 0;
+        if (t->connection->adaptive_) {
+            t->connection->adaptDepth(transfer->actual_length, inFlight == 0);
+        }
+        if (t->connection->rxQueue_ && transfer->actual_length > 0) {
+            t->connection->completeSwapped(*t, transfer->actual_length);
+            return;
+        }
+        if (!t->connection->handleTransferComplete(*t, transfer->actual_length)) {
+            return; // Resubmitted by releaseSlot()
+        }
     } else if (transfer->status == LIBUSB_TRANSFER_CANCELLED) {
         LOGD("Transfer cancelled");
         return;
     } else {
-        LOGE("Transfer failed: status=%d", transfer->status);
-        // Report error but try to continue
-        std::lock_guard<std::mutex> lock(t->connection->callbackMutex_);
-        if (t->connection->errorCallback_) {
-            t->connection->errorCallback_(transfer->status, "USB transfer failed");
-        }
+        // Resubmitted by the retry timer
+        t->connection->transferFailed(*t, transfer->status);
+        return;
     }
 
-    // Resubmit for next read
-    if (t->connection->running_) {
+    // Resubmit for next read, unless retired by an adaptive shrink
+    if (t->connection->running_ && t->index < t->connection->activeDepth_) {
         t->connection->submitTransfer(*t);
     }
 }
 
-void UsbConnection::handleTransferComplete(Transfer& transfer, int actualLength) {
+void UsbConnection::adaptDepth(int actualLength, bool endpointIdle) {
+    lastCompletionMs_ = monotonicMs();
+
+    if (static_cast<size_t>(actualLength) < transferSize_) {
+        fullStreak_ = 0;
+        return;
+    }
+
+    // Every transfer in flight keeps coming back full: the endpoint is
+    // likely idling between resubmits, add one more. A full transfer that
+    // left nothing in flight means it certainly is, grow without waiting.
+    const int depth = activeDepth_;
+    if (depth >= poolSize_ || idle_.load(std::memory_order_relaxed)) {
+        return;
+    }
+    if (++fullStreak_ < depth * GROW_STREAK_ROUNDS && !endpointIdle) {
+        return;
+    }
+    fullStreak_ = 0;
+
+    Transfer& next = transfers_[depth];
+    if (next.pending || next.held) {
+        return; // Retired slot not back yet
+    }
+    if (rxBuffers_) {
+        std::lock_guard<std::mutex> lock(rxMutex_);
+        if (std::find(rxParked_.begin(), rxParked_.end(), depth) != rxParked_.end()) {
+            return; // Retired while parked, gets the next buffer back
+        }
+        if (next.rxBuffer < 0) {
+            // A buffer of its own, so the spares stay spare
+            const int buffer = allocateRxBuffer();
+            if (buffer < 0) {
+                return;
+            }
+            next.rxBuffer = buffer;
+            next.buffer = rxBuffers_[buffer].data;
+        }
+    } else if (!next.buffer && !allocateBuffer(next)) {
+        return;
+    }
+
+    activeDepth_ = depth + 1;
+    next.completedNs = 0;
+    submitTransfer(next);
+    armShrinkTimer(true);
+    LOGI("Transfer depth increased to %d", depth + 1);
+}
+
+void UsbConnection::shrinkIfIdle() {
+    const int depth = activeDepth_;
+    if (depth <= minDepth_) {
+        armShrinkTimer(false);
+        return;
+    }
+
+    const int64_t now = monotonicMs();
+    if (now - lastCompletionMs_ < IDLE_SHRINK_MS) {
+        return;
+    }
+    lastCompletionMs_ = now;
+
+    // Retire the highest slot; its callback won't resubmit it
+    activeDepth_ = depth - 1;
+    Transfer& last = transfers_[depth - 1];
+    if (last.pending) {
+        libusb_cancel_transfer(last.transfer);
+    }
+    fullStreak_ = 0;
+    LOGI("Transfer depth decreased to %d", depth - 1);
+}
+
+bool UsbConnection::handleTransferComplete(Transfer& transfer, int actualLength) {
     if (actualLength > 0) {
-        // Pass raw data directly to Kotlin for parsing
-        std::lock_guard<std::mutex> lock(callbackMutex_);
-        if (rawDataCallback_) {
-            rawDataCallback_(transfer.buffer, actualLength);
+        const auto callbacks = callbacks_.read();
+        if (callbacks->slot) {
+            if (callbacks->capture) {
+                callbacks->capture->appendData(transfer.buffer, static_cast<size_t>(actualLength));
+            }
+            // Hand the buffer itself to the consumer, resubmit on release
+            transfer.held = true;
+            deliveriesStarted_.fetch_add(1, std::memory_order_relaxed);
+            callbacks->slot(transfer.index, 0, actualLength);
+            deliveriesDone_.fetch_add(1, std::memory_order_relaxed);
+            return false;
         }
+        arrivalNs_ = transfer.completedNs;
+        deliver(*callbacks, transfer.buffer, static_cast<size_t>(actualLength));
+    }
+    return true;
+}
+
+void UsbConnection::deliver(const Callbacks& callbacks, const uint8_t* data, size_t length) {
+    if (callbacks.capture) {
+        callbacks.capture->appendData(data, length);
+    }
+    // Pass raw data directly to Kotlin for parsing
+    if (callbacks.rawData) {
+        deliveriesStarted_.fetch_add(1, std::memory_order_relaxed);
+        callbacks.rawData(data, length);
+        deliveriesDone_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+TransportProgress UsbConnection::progress() const {
+    const UsbLinkMonitor::Stats link = linkMonitor_.getStats();
+    TransportProgress p;
+    p.deliveries = deliveriesDone_.load(std::memory_order_relaxed);
+    p.delivering = deliveriesStarted_.load(std::memory_order_relaxed) != p.deliveries;
+    p.txCompleted = link.transfersOut;
+    p.txPending = static_cast<uint64_t>(std::max(txInFlight_.load(std::memory_order_relaxed), 0));
+    p.rxInFlight = link.inFlight;
+    return p;
+}
+
+void UsbConnection::reportError(int errorCode, const char* message) {
+    const auto callbacks = callbacks_.read();
+    if (callbacks->error) {
+        callbacks->error(errorCode, message);
     }
 }
 
@@ -292,7 +962,12 @@ int UsbConnection::write(const uint8_t* data, size_t length) {
         return -1;
     }
 
-    LOGD("Write: attempting %zu bytes to endpoint 0x%02x", length, outEndpoint_);
+    if (running_) {
+        const TxSegment segment{data, length};
+        return queueWrite(&segment, 1);
+    }
+
+    LOGD_FAST("Write: attempting %zu bytes to endpoint 0x%02x", length, outEndpoint_);
 
     int transferred = 0;
     int rc = libusb_bulk_transfer(
@@ -309,17 +984,211 @@ int UsbConnection::write(const uint8_t* data, size_t length) {
         return -1;
     }
 
-    LOGD("Write completed: %d bytes transferred", transferred);
+    LOGD_FAST("Write completed: %d bytes transferred", transferred);
     return transferred;
 }
 
+bool UsbConnection::allocateTxTransfers() {
+    txFreeCount_ = 0;
+    for (int i = 0; i < NUM_TX_TRANSFERS; i++) {
+        TxTransfer& t = txTransfers_[i];
+        t.transfer = context_->takeTransfer();
+        t.buffer = context_->takeBuffer(TX_TRANSFER_SIZE);
+        if (!t.transfer || !t.buffer) {
+            setError("Failed to allocate TX transfer %d", i);
+            return false;
+        }
+        t.connection = this;
+        t.length = 0;
+        t.pending = false;
+        txFree_[txFreeCount_++] = &t;
+    }
+    return true;
+}
+
+void UsbConnection::freeTxTransfers() {
+    std::lock_guard<std::mutex> lock(txMutex_);
+    for (int i = 0; i < NUM_TX_TRANSFERS; i++) {
+        TxTransfer& t = txTransfers_[i];
+        if (t.transfer) {
+            context_->recycleTransfer(t.transfer);
+            t.transfer = nullptr;
+        }
+        if (t.buffer) {
+            context_->recycleBuffer(t.buffer, TX_TRANSFER_SIZE);
+            t.buffer = nullptr;
+        }
+        t.pending = false;
+    }
+    txFreeCount_ = 0;
+    txStaging_ = nullptr;
+    txInFlight_ = 0;
+}
+
+int UsbConnection::writeSegments(const TxSegment* segments, size_t count) {
+    if (!deviceHandle_) {
+        LOGE("Write failed: device not open");
+        return -1;
+    }
+    if (running_) {
+        return queueWrite(segments, count);
+    }
+    // Handshake, nothing else writes yet
+    return Transport::writeSegments(segments, count);
+}
+
+int UsbConnection::queueWrite(const TxSegment* segments, size_t count) {
+    // Records are TLS ciphertext and must hit the wire in order, so lanes
+    // can't overtake each other here. Instead latency-sensitive records
+    // (control, input, media ACKs) are never held back for coalescing and
+    // always find a free transfer; only bulk uplink waits.
+    const TxSegment* first = segments;
+    while (first < segments + count && first->length == 0) {
+        first++;
+    }
+    const bool bulk = first < segments + count && isBulkUplink(first->data[0]);
+    const int reserved = bulk ? TX_RESERVED_URGENT : 0;
+
+    std::unique_lock<std::mutex> lock(txMutex_);
+
+    size_t queued = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* data = segments[i].data;
+        const size_t length = segments[i].length;
+        size_t copied = 0;
+        while (copied < length) {
+            if (!txStaging_) {
+                // Back-pressure: wait for an OUT transfer to complete
+                const bool available = txAvailable_.wait_for(
+                    lock, std::chrono::milliseconds(WRITE_TIMEOUT_MS),
+                    [this, reserved] { return txFreeCount_ > reserved || !running_; });
+                if (!available || !running_) {
+                    LOGE("Write failed: TX queue %s", running_ ? "full" : "stopped");
+                    return queued > 0 ? static_cast<int>(queued) : -1;
+                }
+                txStaging_ = txFree_[--txFreeCount_];
+                txStaging_->length = 0;
+            }
+
+            const size_t chunk = std::min(length - copied, TX_TRANSFER_SIZE - txStaging_->length);
+            std::memcpy(txStaging_->buffer + txStaging_->length, data + copied, chunk);
+            txStaging_->length += chunk;
+            copied += chunk;
+            queued += chunk;
+
+            if (txStaging_->length == TX_TRANSFER_SIZE && !submitStaging()) {
+                return -1;
+            }
+        }
+    }
+
+    // Idle link or urgent record: send right away. Otherwise the staged
+    // bytes go out with whatever arrives before the in-flight transfer completes.
+    if ((!bulk || txInFlight_ == 0) && !submitStaging()) {
+        return -1;
+    }
+
+    return static_cast<int>(queued);
+}
+
+bool UsbConnection::submitStaging() {
+    TxTransfer* t = txStaging_;
+    if (!t || t->length == 0) {
+        return true;
+    }
+    txStaging_ = nullptr;
+
+    libusb_fill_bulk_transfer(
+        t->transfer,
+        deviceHandle_,
+        outEndpoint_,
+        t->buffer,
+        static_cast<int>(t->length),
+        txTransferCallback,
+        t,
+        WRITE_TIMEOUT_MS
+    );
+
+    int rc = libusb_submit_transfer(t->transfer);
+    if (rc != LIBUSB_SUCCESS) {
+        LOGE("Failed to submit TX transfer: %s", libusb_error_name(rc));
+        txFree_[txFreeCount_++] = t;
+        return false;
+    }
+
+    t->pending = true;
+    txInFlight_++;
+    AAP_TRACE_ASYNC_BEGIN("USB TX", t - txTransfers_);
+    AAP_TRACE_COUNTER("USB TX in flight", txInFlight_);
+    return true;
+}
+
+void LIBUSB_CALL UsbConnection::txTransferCallback(libusb_transfer* transfer) {
+    TxTransfer* t = static_cast<TxTransfer*>(transfer->user_data);
+    UsbConnection* connection = t->connection;
+
+    const bool failed = transfer->status != LIBUSB_TRANSFER_COMPLETED &&
+                        transfer->status != LIBUSB_TRANSFER_CANCELLED;
+    connection->linkMonitor_.outCompleted(transfer->status, transfer->actual_length);
+    if (failed) {
+        LOGE("TX transfer failed: status=%d", transfer->status);
+    } else if (transfer->status == LIBUSB_TRANSFER_COMPLETED &&
+               transfer->actual_length != static_cast<int>(t->length)) {
+        LOGE("TX transfer short: %d of %zu bytes", transfer->actual_length, t->length);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(connection->txMutex_);
+        t->pending = false;
+        connection->txInFlight_--;
+        connection->txFree_[connection->txFreeCount_++] = t;
+        AAP_TRACE_ASYNC_END("USB TX", t - connection->txTransfers_);
+        AAP_TRACE_COUNTER("USB TX in flight", connection->txInFlight_);
+
+        // Flush whatever was coalesced while this transfer was in flight
+        if (connection->running_) {
+            connection->submitStaging();
+        }
+    }
+    connection->txAvailable_.notify_one();
+
+    if (failed) {
+        connection->reportError(transfer->status, "USB write failed");
+    }
+}
+
+void UsbConnection::reapCancelled() {
+    // Wait for the cancellations to be delivered so no transfer is still
+    // owned by the kernel when its buffer is freed. The shared event
+    // thread may deliver them first; libusb serialises the two.
+    for (int attempt = 0; attempt < 10; attempt++) {
+        bool pending = false;
+        for (int i = 0; i < poolSize_ && transfers_ && !pending; i++) {
+            pending = transfers_[i].pending;
+        }
+        {
+            std::lock_guard<std::mutex> lock(txMutex_);
+            pending = pending || txInFlight_ > 0;
+        }
+        if (!pending) {
+            return;
+        }
+
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 10000;
+        libusb_handle_events_timeout_completed(context_->get(), &tv, nullptr);
+    }
+    LOGE("Transfers still pending after cancel");
+}
+
 int UsbConnection::read(uint8_t* buffer, size_t length, int timeoutMs) {
     if (!deviceHandle_) {
         LOGE("Read failed: device not open");
         return -1;
     }
 
-    LOGD("Read: attempting up to %zu bytes from endpoint 0x%02x, timeout=%dms", length, inEndpoint_, timeoutMs);
+    LOGD_FAST("Read: attempting up to %zu bytes from endpoint 0x%02x, timeout=%dms", length, inEndpoint_, timeoutMs);
 
     int transferred = 0;
     int rc = libusb_bulk_transfer(
@@ -332,7 +1201,7 @@ int UsbConnection::read(uint8_t* buffer, size_t length, int timeoutMs) {
     );
 
     if (rc == LIBUSB_ERROR_TIMEOUT) {
-        LOGD("Read timeout after %dms, transferred %d bytes", timeoutMs, transferred);
+        LOGD_FAST("Read timeout after %dms, transferred %d bytes", timeoutMs, transferred);
         return transferred;
     }
 
@@ -341,34 +1210,22 @@ int UsbConnection::read(uint8_t* buffer, size_t length, int timeoutMs) {
         return -1;
     }
 
-    LOGD("Read completed: %d bytes", transferred);
+    LOGD_FAST("Read completed: %d bytes", transferred);
     return transferred;
 }
 
-void UsbConnection::eventLoop() {
-    pthread_setname_np(pthread_self(), "AAP-USB-Event");
-    LOGD("USB event loop started");
-
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = 100000; // 100ms timeout
-
-    while (running_) {
-        int rc = libusb_handle_events_timeout_completed(context_, &tv, nullptr);
-        if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_TIMEOUT) {
-            LOGE("libusb_handle_events error: %s", libusb_error_name(rc));
-            if (rc == LIBUSB_ERROR_NO_DEVICE) {
-                running_ = false;
-                std::lock_guard<std::mutex> lock(callbackMutex_);
-                if (errorCallback_) {
-                    errorCallback_(rc, "USB device disconnected");
-                }
-                break;
-            }
-        }
+void UsbConnection::deviceLost() {
+    // The event thread is shared, so stop this connection's transfers only
+    if (!running_.exchange(false)) {
+        return;
+    }
+    LOGE("USB device disconnected");
+    {
+        std::lock_guard<std::mutex> lock(txMutex_);
     }
+    txAvailable_.notify_all();
 
-    LOGD("USB event loop stopped");
+    reportError(LIBUSB_ERROR_NO_DEVICE, "USB device disconnected");
 }
 
 void UsbConnection::setError(const char* format, ...) {
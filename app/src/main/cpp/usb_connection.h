@@ -1,26 +1,43 @@
 #pragma once
 
+#include "transport.h"
+#include "usb_context.h"
+#include "usb_link_monitor.h"
+#include "message_queue.h"
+#include "rcu_cell.h"
 #include "libusb.h"
-#include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
 #include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
 
 namespace aap {
 
 /**
- * Error callback type.
- * Parameters: error code, error message
+ * Zero-copy slot callback type.
+ * Parameters: transfer slot index, offset into the slot buffer, data length
+ * The slot stays owned by the consumer until releaseSlot() is called.
  */
-using ErrorCallback = std::function<void(int errorCode, const char* message)>;
+using SlotCallback = std::function<void(int slot, size_t offset, size_t length)>;
 
 /**
- * Raw data callback type.
- * Parameters: data pointer, data length
- * Called directly from USB event thread for each USB transfer.
- * Kotlin handles message parsing and decryption.
+ * Bulk IN transfer pool configuration.
  */
-using RawDataCallback = std::function<void(const uint8_t* data, size_t length)>;
+struct TransferConfig {
+    int numTransfers = 4;         // Transfers kept in flight
+    size_t transferSize = 16384;  // Bytes per transfer
+    // Grow the in-flight depth while transfers keep completing full,
+    // shrink it back towards numTransfers when the link goes idle
+    bool adaptive = false;
+    // Spare IN buffers for resubmit-first reading, 0 = off. A completed
+    // transfer swaps its buffer for a spare and goes straight back to the
+    // device, the filled buffer is delivered on the AAP-USB-Rx thread.
+    // Raw data only, such a connection refuses the slot callback.
+    int spareBuffers = 0;
+};
 
 /**
  * USB connection wrapper using libusb for async I/O.
@@ -30,11 +47,14 @@ using RawDataCallback = std::function<void(const uint8_t* data, size_t length)>;
  *
  * This class handles raw USB I/O only - message parsing and TLS
  * decryption are handled in Kotlin for correctness.
+ *
+ * The libusb context and the event thread are the process-wide
+ * UsbContext; a connection only attaches its wrapped device to it.
  */
-class UsbConnection {
+class UsbConnection : public Transport {
 public:
     UsbConnection();
-    ~UsbConnection();
+    ~UsbConnection() override;
 
     // Non-copyable
     UsbConnection(const UsbConnection&) = delete;
@@ -43,50 +63,135 @@ public:
     /**
      * Open the USB device using file descriptor from Android.
      * @param fd File descriptor from UsbDeviceConnection.getFileDescriptor()
+     * @param config Bulk IN transfer pool configuration
      * @return true on success, false on failure
      */
-    bool open(int fd);
+    bool open(int fd, const TransferConfig& config = TransferConfig());
 
     /**
      * Close the USB connection and release resources.
      */
-    void close();
+    void close() override;
 
     /**
      * Check if connection is open.
      */
-    bool isOpen() const { return deviceHandle_ != nullptr; }
+    bool isOpen() const override { return deviceHandle_ != nullptr; }
+
+    bool isReading() const override { return reading_.load(std::memory_order_relaxed); }
 
     /**
      * Set raw data callback.
      * Called for each USB transfer with raw bytes.
      * Kotlin handles message framing and decryption.
+     * Returns once a delivery still running the old callback is done;
+     * must not be called from a callback of this connection.
+     */
+    void setRawDataCallback(RawDataCallback callback) override;
+
+    /**
+     * Set zero-copy slot callback.
+     * When set, it replaces the RawDataCallback: completed transfers are
+     * handed out by slot index and only resubmitted after releaseSlot().
+     * Must be called before startReading(). Refused when the connection
+     * was opened with spare buffers, slots are then not fixed buffers.
+     */
+    void setSlotCallback(SlotCallback callback);
+
+    /**
+     * Capture completed transfers, slot or raw, as they are delivered.
+     */
+    void setCapture(SessionCapture* capture) override;
+
+    /**
+     * Return a slot handed out by the SlotCallback so it can be resubmitted.
+     * Safe to call from any thread.
+     */
+    void releaseSlot(int slot);
+
+    /**
+     * Allocate buffers for every slot of the pool up front.
+     * In adaptive mode buffers are otherwise allocated as the depth grows.
+     * @return false on allocation failure
+     */
+    bool reserveSlotBuffers();
+
+    /**
+     * Transfer buffer backing a slot, valid from open() until close().
+     * nullptr for adaptive slots that were never used, see reserveSlotBuffers().
+     */
+    uint8_t* slotBuffer(int slot) const;
+
+    int slotCount() const { return poolSize_; }
+    size_t slotSize() const { return transferSize_; }
+
+    /**
+     * Check if transfer buffers are usbfs device memory (no kernel copy).
+     */
+    bool usesDeviceMemory() const { return deviceMemory_; }
+
+    /**
+     * Number of transfers currently kept in flight.
+     */
+    int transferDepth() const { return activeDepth_.load(std::memory_order_relaxed); }
+
+    /**
+     * Idle keeps a single IN transfer in flight, the slots above it retire
+     * as they complete; leaving idle restores the configured depth.
+     * Applied on the event thread.
+     */
+    void setIdle(bool idle) override;
+
+    /**
+     * When the data being delivered came off the wire (CLOCK_MONOTONIC ns).
+     * Only valid inside the RawDataCallback, which may run well after the
+     * completion when spare buffers decouple delivery from the endpoint.
+     */
+    uint64_t arrivalNs() const { return arrivalNs_; }
+
+    /**
+     * Link throughput, utilisation and failures since open().
+     * Lock-free, safe to poll from any thread.
      */
-    void setRawDataCallback(RawDataCallback callback);
+    UsbLinkMonitor::Stats getLinkStats() const { return linkMonitor_.getStats(); }
+
+    TransportProgress progress() const override;
 
     /**
      * Set error callback.
      */
-    void setErrorCallback(ErrorCallback callback);
+    void setErrorCallback(ErrorCallback callback) override;
 
     /**
      * Start async reading from USB.
      * Raw data will be delivered via the RawDataCallback.
      */
-    void startReading();
+    void startReading() override;
 
     /**
-     * Stop async reading.
+     * Stop async reading. Returns as soon as the shared event thread has
+     * reaped the cancelled transfers.
      */
-    void stopReading();
+    void stopReading() override;
 
     /**
-     * Write data to USB (synchronous).
+     * Write data to USB.
+     * While reading is running the data is queued on the async TX path
+     * and sent from the event thread; otherwise (handshake) it is a
+     * synchronous bulk transfer.
+     * Safe to call from any thread.
      * @param data Data to write
      * @param length Length of data
-     * @return Number of bytes written, or negative on error
+     * @return Number of bytes written or queued, or negative on error
      */
-    int write(const uint8_t* data, size_t length);
+    int write(const uint8_t* data, size_t length) override;
+
+    /**
+     * While reading, the segments are copied straight into the staging
+     * OUT transfer, spilling into the next one like a single write();
+     * during the handshake they go out as synchronous bulk transfers in turn.
+     */
+    int writeSegments(const TxSegment* segments, size_t count) override;
 
     /**
      * Read data from USB (synchronous, for handshake).
@@ -95,16 +200,16 @@ public:
      * @param timeoutMs Timeout in milliseconds
      * @return Number of bytes read, or negative on error
      */
-    int read(uint8_t* buffer, size_t length, int timeoutMs);
+    int read(uint8_t* buffer, size_t length, int timeoutMs) override;
 
     /**
      * Get the last error message.
      */
-    const char* getLastError() const { return lastError_; }
+    const char* getLastError() const override { return lastError_; }
 
 private:
-    // libusb context and device
-    libusb_context* context_ = nullptr;
+    // Shared libusb context and this connection's device
+    std::shared_ptr<UsbContext> context_;
     libusb_device_handle* deviceHandle_ = nullptr;
 
     // Endpoints (discovered during open)
@@ -113,35 +218,162 @@ private:
     int maxPacketSize_ = 512;
 
     // Async transfer handling
-    static constexpr int NUM_TRANSFERS = 4;  // Number of concurrent transfers
-    static constexpr int TRANSFER_SIZE = 16384;  // 16KB per transfer
+    static constexpr int MAX_TRANSFERS = 32;  // Upper bound for the pool
+    static constexpr size_t MAX_TRANSFER_SIZE = 1024 * 1024;
 
     struct Transfer {
         libusb_transfer* transfer = nullptr;
         uint8_t* buffer = nullptr;
         UsbConnection* connection = nullptr;
-        bool pending = false;
+        int index = 0;
+        bool deviceMemory = false;  // Buffer from libusb_dev_mem_alloc
+        uint64_t completedNs = 0;   // Last completion, for the resubmit gap
+        int rxBuffer = -1;          // Index into rxBuffers_ with spare buffers, -1 while parked
+        bool retry = false;         // Failed, waiting for the retry timer (event thread)
+        std::atomic<bool> pending{false};
+        std::atomic<bool> held{false};  // Owned by the slot consumer
+    };
+    std::unique_ptr<Transfer[]> transfers_;
+    int poolSize_ = 0;
+    size_t transferSize_ = 0;
+    bool deviceMemory_ = false;  // Last buffer allocation used device memory
+    bool loggedMemory_ = false;
+
+    // Transfers with index below the active depth are kept in flight
+    std::atomic<int> activeDepth_{0};
+    int minDepth_ = 0;
+    bool adaptive_ = false;
+
+    // Adaptive depth state, event thread only
+    int fullStreak_ = 0;
+    int64_t lastCompletionMs_ = 0;
+
+    UsbLinkMonitor linkMonitor_;
+
+    // Resubmit-first reading. IN buffers are not tied to a transfer: the
+    // event thread swaps a free one in and queues the filled one to the
+    // AAP-USB-Rx thread, which returns it to rxFree_ once delivered. A
+    // completion finding no free buffer parks its transfer until one is.
+    static constexpr int MAX_SPARE_BUFFERS = 32;
+
+    struct RxBuffer {
+        uint8_t* data = nullptr;
+        bool deviceMemory = false;
+    };
+    // Queued as the message payload
+    struct RxCompletion {
+        int buffer;
+        int length;
+    };
+    std::unique_ptr<RxBuffer[]> rxBuffers_;  // Capacity: pool plus spares
+    int rxCapacity_ = 0;
+    int rxAllocated_ = 0;        // Event thread once reading
+    std::vector<int> rxFree_;    // Guarded by rxMutex_
+    std::vector<int> rxParked_;  // Transfer indices, guarded by rxMutex_
+    std::mutex rxMutex_;
+    std::unique_ptr<SpscMessageQueue> rxQueue_;
+    std::thread rxThread_;
+    uint64_t rxParks_ = 0;       // Guarded by rxMutex_
+    uint64_t arrivalNs_ = 0;     // Delivering thread only, set before each delivery
+    // Bumped around every delivery, watched by progress()
+    std::atomic<uint64_t> deliveriesStarted_{0};
+    std::atomic<uint64_t> deliveriesDone_{0};
+
+    // Async TX path. While one OUT transfer is in flight, further writes
+    // are appended to the staging transfer and go out together.
+    static constexpr int NUM_TX_TRANSFERS = 8;
+    static constexpr size_t TX_TRANSFER_SIZE = 16384;
+
+    struct TxTransfer {
+        libusb_transfer* transfer = nullptr;
+        uint8_t* buffer = nullptr;
+        size_t length = 0;
+        UsbConnection* connection = nullptr;
+        bool pending = false;  // Guarded by txMutex_
     };
-    Transfer transfers_[NUM_TRANSFERS];
+    TxTransfer txTransfers_[NUM_TX_TRANSFERS];
+    TxTransfer* txFree_[NUM_TX_TRANSFERS] = {};
+    int txFreeCount_ = 0;
+    TxTransfer* txStaging_ = nullptr;
+    std::atomic<int> txInFlight_{0};  // Written under txMutex_, read by progress()
+    std::mutex txMutex_;
+    std::condition_variable txAvailable_;
 
-    // Event handling thread
-    std::thread eventThread_;
+    // Between startReading() and stopReading()
+    std::atomic<bool> reading_{false};
+    // Transfers are resubmitted; cleared early when the device goes away
     std::atomic<bool> running_{false};
+    // Adaptive shrink tick, watched by the shared event thread
+    int timerFd_ = -1;
+    bool timerArmed_ = false;  // Event thread only
 
-    // Callbacks
-    RawDataCallback rawDataCallback_;
-    ErrorCallback errorCallback_;
-    std::mutex callbackMutex_;
+    // Failed IN transfers are resubmitted by the retry timer, after a
+    // backoff that grows while they keep failing. Event thread only.
+    int retryTimerFd_ = -1;
+    bool retryArmed_ = false;
+    int retryRound_ = 0;          // Backoff rounds since the last completed transfer
+    bool haltPending_ = false;    // A transfer stalled, clear the halt before resubmitting
+
+    // Idle depth changes, fired once by setIdle() so the event thread applies them
+    int idleTimerFd_ = -1;
+    std::atomic<bool> idle_{false};
+    int64_t lastErrorReportMs_ = 0;
+    int errorsSuppressed_ = 0;
+
+    // Callbacks, read without a lock on every transfer. A setter returns
+    // once no thread can still be running what it replaced.
+    struct Callbacks {
+        RawDataCallback rawData;
+        SlotCallback slot;
+        ErrorCallback error;
+        SessionCapture* capture = nullptr;
+    };
+    RcuCell<Callbacks> callbacks_;
 
     // Error state
     char lastError_[256] = {0};
 
     // Internal methods
     bool findEndpoints();
+    bool allocateTransfers();
+    bool allocateBuffer(Transfer& transfer);
+    uint8_t* allocateMemory(bool& deviceMemory);
+    void freeMemory(uint8_t* buffer, bool deviceMemory);
+    void freeTransfers();
+    int allocateRxBuffer();
+    bool attachRxBuffer(Transfer& transfer);
+    void resetRxBuffers();
+    void startRxThread();
+    void stopRxThread();
+    void rxLoop();
+    // Swap a filled buffer out for a spare, resubmit, then queue it for delivery
+    void completeSwapped(Transfer& transfer, int actualLength);
+    void returnRxBuffer(int buffer);
+    bool allocateTxTransfers();
+    void freeTxTransfers();
+    int queueWrite(const TxSegment* segments, size_t count);
+    bool submitStaging();  // Requires txMutex_
+    static void LIBUSB_CALL txTransferCallback(libusb_transfer* transfer);
+    void reapCancelled();
+    // endpointIdle: the completion left no IN transfer in flight
+    void adaptDepth(int actualLength, bool endpointIdle);
+    void shrinkIfIdle();
     void submitTransfer(Transfer& transfer);
     static void LIBUSB_CALL transferCallback(libusb_transfer* transfer);
-    void handleTransferComplete(Transfer& transfer, int actualLength);
-    void eventLoop();
+    // Returns false if the consumer took ownership of the transfer buffer
+    bool handleTransferComplete(Transfer& transfer, int actualLength);
+    void deliver(const Callbacks& callbacks, const uint8_t* data, size_t length);
+    void reportError(int errorCode, const char* message);
+    bool openTimer(int& fd, void (UsbConnection::*onTick)());
+    void closeTimers();
+    void armShrinkTimer(bool armed);
+    void onShrinkTick();
+    // An IN transfer failed: report it (rate limited) and schedule the retry
+    void transferFailed(Transfer& transfer, int status);
+    void onRetryTick();
+    void onIdleTick();
+    // A transfer came back LIBUSB_TRANSFER_NO_DEVICE
+    void deviceLost();
     void setError(const char* format, ...);
 };
 
@@ -0,0 +1,313 @@
+#include "usb_context.h"
+#include "streaming_memory.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define LOG_TAG "UsbContext"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+constexpr int MAX_EPOLL_EVENTS = 8;
+
+std::shared_ptr<UsbContext> UsbContext::acquire() {
+    static std::mutex mutex;
+    static std::weak_ptr<UsbContext> shared;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<UsbContext> context = shared.lock();
+    if (context) {
+        return context;
+    }
+    context.reset(new UsbContext());
+    if (!context->start()) {
+        return nullptr;
+    }
+    shared = context;
+    return context;
+}
+
+UsbContext::~UsbContext() {
+    stop();
+}
+
+bool UsbContext::start() {
+    // On Android with wrapped file descriptors, we must disable device discovery
+    // since we're using Android's USB subsystem to get the FD
+    int rc = libusb_set_option(nullptr, LIBUSB_OPTION_NO_DEVICE_DISCOVERY);
+    if (rc != LIBUSB_SUCCESS) {
+        LOGE("libusb_set_option(NO_DEVICE_DISCOVERY) failed: %s (continuing anyway)", libusb_error_name(rc));
+    }
+
+    rc = libusb_init(&context_);
+    if (rc != LIBUSB_SUCCESS) {
+        LOGE("libusb_init failed: %s", libusb_error_name(rc));
+        context_ = nullptr;
+        return false;
+    }
+    libusb_set_option(context_, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_WARNING);
+
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (epollFd_ < 0 || wakeFd_ < 0) {
+        LOGE("Event loop fds: %s", strerror(errno));
+        stop();
+        return false;
+    }
+
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = wakeFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeFd_, &event);
+
+    // libusb's own fds (device, internal event and timer), then follow changes
+    const libusb_pollfd** pollfds = libusb_get_pollfds(context_);
+    if (!pollfds) {
+        LOGE("libusb_get_pollfds failed");
+        stop();
+        return false;
+    }
+    for (const libusb_pollfd** it = pollfds; *it; it++) {
+        pollfdAdded((*it)->fd, (*it)->events, this);
+    }
+    libusb_free_pollfds(pollfds);
+    libusb_set_pollfd_notifiers(context_, pollfdAdded, pollfdRemoved, this);
+
+    if (!libusb_pollfds_handle_timeouts(context_)) {
+        LOGI("libusb timeouts not on a pollfd, event loop polls libusb_get_next_timeout()");
+    }
+
+    running_ = true;
+    eventThread_ = std::thread(&UsbContext::eventLoop, this);
+    LOGI("Shared libusb context ready");
+    return true;
+}
+
+void UsbContext::stop() {
+    if (running_.exchange(false)) {
+        const uint64_t one = 1;
+        if (::write(wakeFd_, &one, sizeof(one)) < 0) {
+            LOGE("Event loop wakeup failed: %s", strerror(errno));
+        }
+    }
+    if (eventThread_.joinable()) {
+        eventThread_.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        for (libusb_transfer* transfer : transfers_) {
+            libusb_free_transfer(transfer);
+        }
+        transfers_.clear();
+        for (const auto& buffer : buffers_) {
+            freeStreamingMemory(buffer.first);
+        }
+        buffers_.clear();
+        bytesCached_ = 0;
+    }
+
+    if (context_) {
+        libusb_set_pollfd_notifiers(context_, nullptr, nullptr, nullptr);
+        libusb_exit(context_);
+        context_ = nullptr;
+    }
+    for (int* fd : {&epollFd_, &wakeFd_}) {
+        if (*fd >= 0) {
+            ::close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void LIBUSB_CALL UsbContext::pollfdAdded(int fd, short events, void* userData) {
+    auto* context = static_cast<UsbContext*>(userData);
+    struct epoll_event event = {};
+    if (events & POLLIN) event.events |= EPOLLIN;
+    if (events & POLLOUT) event.events |= EPOLLOUT;
+    event.data.fd = fd;
+    if (epoll_ctl(context->epollFd_, EPOLL_CTL_ADD, fd, &event) != 0 && errno == EEXIST) {
+        epoll_ctl(context->epollFd_, EPOLL_CTL_MOD, fd, &event);
+    }
+}
+
+void LIBUSB_CALL UsbContext::pollfdRemoved(int fd, void* userData) {
+    auto* context = static_cast<UsbContext*>(userData);
+    epoll_ctl(context->epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+bool UsbContext::watch(int fd, std::function<void()> onReady) {
+    std::lock_guard<std::mutex> lock(watchMutex_);
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+        LOGE("watch(%d) failed: %s", fd, strerror(errno));
+        return false;
+    }
+    watchers_.emplace_back(fd, std::move(onReady));
+    return true;
+}
+
+void UsbContext::unwatch(int fd) {
+    std::lock_guard<std::mutex> lock(watchMutex_);
+    auto it = std::find_if(watchers_.begin(), watchers_.end(),
+                           [fd](const std::pair<int, std::function<void()>>& w) { return w.first == fd; });
+    if (it != watchers_.end()) {
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, nullptr);
+        watchers_.erase(it);
+    }
+}
+
+libusb_transfer* UsbContext::takeTransfer() {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        if (!transfers_.empty()) {
+            libusb_transfer* transfer = transfers_.back();
+            transfers_.pop_back();
+            transfersReused_.fetch_add(1, std::memory_order_relaxed);
+            return transfer;
+        }
+    }
+    return libusb_alloc_transfer(0);
+}
+
+void UsbContext::recycleTransfer(libusb_transfer* transfer) {
+    if (!transfer) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        if (transfers_.size() < MAX_CACHED_TRANSFERS) {
+            transfers_.push_back(transfer);
+            return;
+        }
+    }
+    libusb_free_transfer(transfer);
+}
+
+uint8_t* UsbContext::takeBuffer(size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        for (auto it = buffers_.begin(); it != buffers_.end(); ++it) {
+            if (it->second == size) {
+                uint8_t* buffer = it->first;
+                buffers_.erase(it);
+                bytesCached_ -= size;
+                buffersReused_.fetch_add(1, std::memory_order_relaxed);
+                return buffer;
+            }
+        }
+    }
+    return allocateStreamingMemory(size);
+}
+
+void UsbContext::recycleBuffer(uint8_t* buffer, size_t size) {
+    if (!buffer) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(poolMutex_);
+        if (bytesCached_ + size <= MAX_CACHED_BYTES) {
+            buffers_.emplace_back(buffer, size);
+            bytesCached_ += size;
+            return;
+        }
+    }
+    freeStreamingMemory(buffer);
+}
+
+UsbContext::Stats UsbContext::getStats() const {
+    Stats stats = {};
+    stats.attaches = attaches_.load(std::memory_order_relaxed);
+    stats.transfersReused = transfersReused_.load(std::memory_order_relaxed);
+    stats.buffersReused = buffersReused_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(poolMutex_);
+    stats.bytesCached = bytesCached_;
+    return stats;
+}
+
+void UsbContext::eventLoop() {
+    applyThreadPolicy("AAP-USB-Event");
+    LOGD("USB event loop started");
+
+    // Without a libusb timerfd, transfer timeouts bound the wait instead
+    const bool pollTimeouts = !libusb_pollfds_handle_timeouts(context_);
+    struct timeval zero = {0, 0};
+    int lastError = LIBUSB_SUCCESS;
+
+    while (running_) {
+        int timeoutMs = -1;
+        struct timeval next;
+        if (pollTimeouts && libusb_get_next_timeout(context_, &next) == 1) {
+            timeoutMs = static_cast<int>(next.tv_sec * 1000 + (next.tv_usec + 999) / 1000);
+        }
+
+        struct epoll_event events[MAX_EPOLL_EVENTS];
+        const int count = epoll_wait(epollFd_, events, MAX_EPOLL_EVENTS, timeoutMs);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOGE("epoll_wait failed: %s", strerror(errno));
+            break;
+        }
+
+        bool usbReady = count == 0;  // A libusb timeout expired
+        int ready[MAX_EPOLL_EVENTS];
+        int readyCount = 0;
+        for (int i = 0; i < count; i++) {
+            const int fd = events[i].data.fd;
+            if (fd == wakeFd_) {
+                uint64_t value;
+                while (::read(wakeFd_, &value, sizeof(value)) > 0) {
+                }
+            } else if (std::find(ready, ready + readyCount, fd) == ready + readyCount) {
+                ready[readyCount++] = fd;
+            }
+        }
+        if (!running_) {
+            break;
+        }
+
+        // Watched fds first, the rest belong to libusb
+        {
+            std::lock_guard<std::mutex> lock(watchMutex_);
+            for (int i = 0; i < readyCount; i++) {
+                auto it = std::find_if(watchers_.begin(), watchers_.end(),
+                                       [fd = ready[i]](const std::pair<int, std::function<void()>>& w) {
+                                           return w.first == fd;
+                                       });
+                if (it != watchers_.end()) {
+                    it->second();
+                } else {
+                    usbReady = true;
+                }
+            }
+        }
+        if (!usbReady) {
+            continue;
+        }
+
+        // Ready fds only: libusb polls them again without blocking.
+        // Device loss reaches each connection as a transfer status.
+        const int rc = libusb_handle_events_timeout_completed(context_, &zero, nullptr);
+        if (rc != LIBUSB_SUCCESS && rc != LIBUSB_ERROR_TIMEOUT && rc != lastError) {
+            LOGE("libusb_handle_events error: %s", libusb_error_name(rc));
+        }
+        lastError = rc;
+    }
+
+    LOGD("USB event loop stopped");
+}
+
+} // namespace aap
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "libusb.h"
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace aap {
+
+/**
+ * Process-wide libusb context and the event thread that serves it.
+ *
+ * libusb_init, the epoll set over libusb's pollfds and the AAP-USB-Event
+ * thread are set up once; UsbConnections attach their wrapped device to
+ * it and detach it again without tearing any of that down. Transfer
+ * structs and heap transfer buffers are recycled too, so a reconnect
+ * after a cable glitch only wraps the new fd and submits.
+ *
+ * Every transfer callback of every attached device runs on the one
+ * event thread.
+ */
+class UsbContext {
+public:
+    ~UsbContext();
+
+    // Non-copyable
+    UsbContext(const UsbContext&) = delete;
+    UsbContext& operator=(const UsbContext&) = delete;
+
+    /**
+     * The shared context, created on first use. It lives as long as any
+     * holder does; keep one reference to make it outlive connections.
+     * @return nullptr if libusb or the event thread could not be set up
+     */
+    static std::shared_ptr<UsbContext> acquire();
+
+    libusb_context* get() const { return context_; }
+
+    /**
+     * Run onReady on the event thread whenever fd becomes readable.
+     * onReady must drain fd.
+     */
+    bool watch(int fd, std::function<void()> onReady);
+
+    /**
+     * Stop watching fd. Once this returns its callback is not running
+     * and won't run again. Must not be called from the callback itself.
+     */
+    void unwatch(int fd);
+
+    /**
+     * A transfer from the recycled pool, or a fresh one.
+     */
+    libusb_transfer* takeTransfer();
+    void recycleTransfer(libusb_transfer* transfer);
+
+    /**
+     * A streaming memory buffer of exactly size bytes, recycled if one is
+     * cached. Recycled buffers are not zeroed.
+     */
+    uint8_t* takeBuffer(size_t size);
+    void recycleBuffer(uint8_t* buffer, size_t size);
+
+    struct Stats {
+        uint64_t attaches;          // Connections opened on this context
+        uint64_t transfersReused;
+        uint64_t buffersReused;
+        uint64_t bytesCached;       // Idle buffers kept for the next connection
+    };
+    Stats getStats() const;
+
+    // Called by UsbConnection::open()
+    void countAttach() { attaches_.fetch_add(1, std::memory_order_relaxed); }
+
+private:
+    // Cached transfers and buffers beyond these are freed
+    static constexpr size_t MAX_CACHED_TRANSFERS = 64;
+    static constexpr size_t MAX_CACHED_BYTES = 4 * 1024 * 1024;
+
+    UsbContext() = default;
+    bool start();
+    void stop();
+    void eventLoop();
+    static void LIBUSB_CALL pollfdAdded(int fd, short events, void* userData);
+    static void LIBUSB_CALL pollfdRemoved(int fd, void* userData);
+
+    libusb_context* context_ = nullptr;
+    int epollFd_ = -1;
+    int wakeFd_ = -1;
+    std::thread eventThread_;
+    std::atomic<bool> running_{false};
+
+    // Held while a watcher runs, so unwatch() waits it out
+    std::mutex watchMutex_;
+    std::vector<std::pair<int, std::function<void()>>> watchers_;
+
+    mutable std::mutex poolMutex_;
+    std::vector<libusb_transfer*> transfers_;
+    std::vector<std::pair<uint8_t*, size_t>> buffers_;
+    size_t bytesCached_ = 0;  // Guarded by poolMutex_
+
+    std::atomic<uint64_t> attaches_{0};
+    std::atomic<uint64_t> transfersReused_{0};
+    std::atomic<uint64_t> buffersReused_{0};
+};
+
+} // namespace aap
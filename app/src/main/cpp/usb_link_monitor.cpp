@@ -0,0 +1,151 @@
+#include "usb_link_monitor.h"
+#include "libusb.h"
+#include <time.h>
+
+namespace aap {
+
+namespace {
+
+void storeMax(std::atomic<uint64_t>& target, uint64_t value) {
+    uint64_t current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+} // anonymous namespace
+
+uint64_t UsbLinkMonitor::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void UsbLinkMonitor::Direction::reset() {
+    bytes.store(0, std::memory_order_relaxed);
+    transfers.store(0, std::memory_order_relaxed);
+    bytesPerSec.store(0, std::memory_order_relaxed);
+    windowEndNs.store(0, std::memory_order_relaxed);
+    windowStartNs = 0;
+    windowBytes = 0;
+}
+
+void UsbLinkMonitor::Direction::add(int actualLength, uint64_t nowNs) {
+    const uint64_t length = actualLength > 0 ? static_cast<uint64_t>(actualLength) : 0;
+    bytes.fetch_add(length, std::memory_order_relaxed);
+    transfers.fetch_add(1, std::memory_order_relaxed);
+
+    if (windowStartNs == 0) {
+        windowStartNs = nowNs;
+    }
+    windowBytes += length;
+    const uint64_t elapsed = nowNs - windowStartNs;
+    if (elapsed >= RATE_WINDOW_NS) {
+        bytesPerSec.store(windowBytes * 1000000000ULL / elapsed, std::memory_order_relaxed);
+        windowEndNs.store(nowNs, std::memory_order_relaxed);
+        windowStartNs = nowNs;
+        windowBytes = 0;
+    }
+}
+
+void UsbLinkMonitor::reset(int speed) {
+    in_.reset();
+    out_.reset();
+    shortTransfersIn_.store(0, std::memory_order_relaxed);
+    inFlight_.store(0, std::memory_order_relaxed);
+    inFlightSum_.store(0, std::memory_order_relaxed);
+    idleSinceNs_.store(0, std::memory_order_relaxed);
+    endpointIdleNs_.store(0, std::memory_order_relaxed);
+    resubmitGapTotalNs_.store(0, std::memory_order_relaxed);
+    resubmitGapMaxNs_.store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < STATUS_COUNT; i++) {
+        failures_[i].store(0, std::memory_order_relaxed);
+    }
+    retryRounds_.store(0, std::memory_order_relaxed);
+    haltsCleared_.store(0, std::memory_order_relaxed);
+    speed_.store(speed, std::memory_order_relaxed);
+}
+
+void UsbLinkMonitor::inSubmitted(uint64_t completedNs) {
+    const uint64_t nowNs = now();
+    if (inFlight_.fetch_add(1, std::memory_order_relaxed) == 0) {
+        const uint64_t idleSince = idleSinceNs_.exchange(0, std::memory_order_relaxed);
+        if (idleSince != 0 && nowNs > idleSince) {
+            endpointIdleNs_.fetch_add(nowNs - idleSince, std::memory_order_relaxed);
+        }
+    }
+    if (completedNs != 0 && nowNs > completedNs) {
+        const uint64_t gap = nowNs - completedNs;
+        resubmitGapTotalNs_.fetch_add(gap, std::memory_order_relaxed);
+        storeMax(resubmitGapMaxNs_, gap);
+    }
+}
+
+int UsbLinkMonitor::inCompleted(int status, int actualLength, size_t transferSize) {
+    const int inFlight = inFlight_.fetch_sub(1, std::memory_order_relaxed) - 1;
+    // Cancelled transfers are retired, not waiting to be resubmitted
+    if (inFlight == 0 && status != LIBUSB_TRANSFER_CANCELLED) {
+        idleSinceNs_.store(now(), std::memory_order_relaxed);
+    }
+
+    if (status == LIBUSB_TRANSFER_COMPLETED) {
+        in_.add(actualLength, now());
+        inFlightSum_.fetch_add(static_cast<uint64_t>(inFlight + 1), std::memory_order_relaxed);
+        if (static_cast<size_t>(actualLength) < transferSize) {
+            shortTransfersIn_.fetch_add(1, std::memory_order_relaxed);
+        }
+    } else {
+        countStatus(status);
+    }
+    return inFlight;
+}
+
+void UsbLinkMonitor::outCompleted(int status, int actualLength) {
+    if (status == LIBUSB_TRANSFER_COMPLETED) {
+        out_.add(actualLength, now());
+    } else {
+        countStatus(status);
+    }
+}
+
+void UsbLinkMonitor::countStatus(int status) {
+    if (status != LIBUSB_TRANSFER_CANCELLED && status >= 0 && static_cast<size_t>(status) < STATUS_COUNT) {
+        failures_[status].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+UsbLinkMonitor::Stats UsbLinkMonitor::getStats() const {
+    Stats stats = {};
+    const uint64_t nowNs = now();
+    const Direction* directions[2] = {&in_, &out_};
+    uint64_t* rates[2] = {&stats.bytesInPerSec, &stats.bytesOutPerSec};
+    for (int i = 0; i < 2; i++) {
+        // A window that never closed means nothing moved for a while
+        const uint64_t windowEnd = directions[i]->windowEndNs.load(std::memory_order_relaxed);
+        if (windowEnd != 0 && nowNs - windowEnd < 2 * RATE_WINDOW_NS) {
+            *rates[i] = directions[i]->bytesPerSec.load(std::memory_order_relaxed);
+        }
+    }
+
+    stats.bytesIn = in_.bytes.load(std::memory_order_relaxed);
+    stats.bytesOut = out_.bytes.load(std::memory_order_relaxed);
+    stats.transfersIn = in_.transfers.load(std::memory_order_relaxed);
+    stats.transfersOut = out_.transfers.load(std::memory_order_relaxed);
+    stats.shortTransfersIn = shortTransfersIn_.load(std::memory_order_relaxed);
+    const int inFlight = inFlight_.load(std::memory_order_relaxed);
+    stats.inFlight = inFlight > 0 ? static_cast<uint64_t>(inFlight) : 0;
+    if (stats.transfersIn > 0) {
+        stats.inFlightAvgMilli = inFlightSum_.load(std::memory_order_relaxed) * 1000 / stats.transfersIn;
+    }
+    stats.endpointIdleNs = endpointIdleNs_.load(std::memory_order_relaxed);
+    stats.resubmitGapTotalNs = resubmitGapTotalNs_.load(std::memory_order_relaxed);
+    stats.resubmitGapMaxNs = resubmitGapMaxNs_.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < STATUS_COUNT; i++) {
+        stats.failures[i] = failures_[i].load(std::memory_order_relaxed);
+    }
+    stats.retryRounds = retryRounds_.load(std::memory_order_relaxed);
+    stats.haltsCleared = haltsCleared_.load(std::memory_order_relaxed);
+    stats.speed = speed_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+} // namespace aap
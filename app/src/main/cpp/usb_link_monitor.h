@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace aap {
+
+/**
+ * Throughput and utilisation of a USB accessory link, to tell a slow or
+ * flaky link apart from a slow consumer.
+ *
+ * Tracks bytes and transfers per direction, IN transfers in flight, the
+ * time the IN endpoint had nothing submitted (the device may be NAKing
+ * with data waiting), the gap between an IN completion and its resubmit,
+ * failed transfers by libusb_transfer_status and the recovery from them.
+ *
+ * Completions are reported from the libusb event thread; submits may come
+ * from any thread (slot releases). Snapshots are lock-free.
+ */
+class UsbLinkMonitor {
+public:
+    // LIBUSB_TRANSFER_COMPLETED .. LIBUSB_TRANSFER_OVERFLOW
+    static constexpr size_t STATUS_COUNT = 7;
+    // Rates are measured over windows of this length
+    static constexpr uint64_t RATE_WINDOW_NS = 1000000000ULL;
+
+    UsbLinkMonitor() = default;
+
+    // Non-copyable
+    UsbLinkMonitor(const UsbLinkMonitor&) = delete;
+    UsbLinkMonitor& operator=(const UsbLinkMonitor&) = delete;
+
+    /**
+     * Start a new session; counters restart from zero.
+     * @param speed libusb_speed negotiated by the device
+     */
+    void reset(int speed);
+
+    /**
+     * An IN transfer was submitted.
+     * @param completedNs When this transfer last completed, 0 on its first submit
+     */
+    void inSubmitted(uint64_t completedNs);
+
+    /**
+     * An IN transfer came back, whatever its status.
+     * @return IN transfers still in flight; 0 means the endpoint is now idle
+     */
+    int inCompleted(int status, int actualLength, size_t transferSize);
+
+    void outCompleted(int status, int actualLength);
+
+    // Recovery from failed IN transfers
+    void retryScheduled() { retryRounds_.fetch_add(1, std::memory_order_relaxed); }
+    void haltCleared() { haltsCleared_.fetch_add(1, std::memory_order_relaxed); }
+
+    static uint64_t now();
+
+    struct Stats {
+        uint64_t bytesIn;
+        uint64_t bytesOut;
+        uint64_t transfersIn;
+        uint64_t transfersOut;
+        uint64_t shortTransfersIn;     // Came back shorter than the buffer
+        uint64_t bytesInPerSec;        // Over the last full window, 0 once the link goes quiet
+        uint64_t bytesOutPerSec;
+        uint64_t inFlight;             // IN transfers submitted right now
+        uint64_t inFlightAvgMilli;     // Mean in flight seen by each IN completion, x1000
+        uint64_t endpointIdleNs;       // Reading with no IN transfer submitted
+        uint64_t resubmitGapTotalNs;   // IN completion until that transfer is resubmitted
+        uint64_t resubmitGapMaxNs;
+        // By libusb_transfer_status, COMPLETED and CANCELLED stay 0;
+        // IN submits libusb rejected count as ERROR
+        uint64_t failures[STATUS_COUNT];
+        uint64_t retryRounds;          // Backoffs before resubmitting failed IN transfers
+        uint64_t haltsCleared;         // Stalled IN endpoint recovered
+        int speed;                     // libusb_speed
+    };
+    Stats getStats() const;
+
+private:
+    // Each direction: bytes and transfers seen, and the rate window (event thread only)
+    struct Direction {
+        std::atomic<uint64_t> bytes{0};
+        std::atomic<uint64_t> transfers{0};
+        std::atomic<uint64_t> bytesPerSec{0};
+        std::atomic<uint64_t> windowEndNs{0};  // When bytesPerSec was last measured
+        uint64_t windowStartNs = 0;
+        uint64_t windowBytes = 0;
+
+        void reset();
+        void add(int actualLength, uint64_t nowNs);
+    };
+
+    Direction in_;
+    Direction out_;
+    std::atomic<uint64_t> shortTransfersIn_{0};
+
+    std::atomic<int> inFlight_{0};
+    std::atomic<uint64_t> inFlightSum_{0};
+    std::atomic<uint64_t> idleSinceNs_{0};
+    std::atomic<uint64_t> endpointIdleNs_{0};
+    std::atomic<uint64_t> resubmitGapTotalNs_{0};
+    std::atomic<uint64_t> resubmitGapMaxNs_{0};
+    std::atomic<uint64_t> failures_[STATUS_COUNT]{};
+    std::atomic<uint64_t> retryRounds_{0};
+    std::atomic<uint64_t> haltsCleared_{0};
+    std::atomic<int> speed_{0};
+
+    void countStatus(int status);
+};
+
+} // namespace aap
@@ -0,0 +1,691 @@
+#include "video_assembler.h"
+#include <android/log.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#define LOG_TAG "VideoAssembler"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+// Media message types, the first two bytes of a first/complete record
+constexpr uint16_t MSG_MEDIA_DATA = 0x0000;     // Followed by an 8-byte timestamp
+constexpr uint16_t MSG_CODEC_CONFIG = 0x0001;
+constexpr size_t MEDIA_HEADER_SIZE = 10;
+constexpr size_t CONFIG_HEADER_SIZE = 2;
+
+// Record flags as AapVideo sees them (encrypted | first/last bits)
+constexpr uint8_t FLAGS_MIDDLE = 8;
+constexpr uint8_t FLAGS_FIRST = 9;
+constexpr uint8_t FLAGS_LAST = 10;
+constexpr uint8_t FLAGS_COMPLETE = 11;
+
+constexpr uint8_t START_CODE[4] = {0, 0, 0, 1};
+
+inline uint16_t readBe16(const uint8_t* p) {
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+inline uint64_t readBe64(const uint8_t* p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; i++) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+inline bool hasStartCode(const uint8_t* p, size_t available) {
+    return available >= 4 && std::memcmp(p, START_CODE, 4) == 0;
+}
+
+uint64_t steadyUs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+} // anonymous namespace
+
+VideoAssembler::VideoAssembler(VideoCodec codec, size_t maxFrameSize, size_t frameSlots)
+    : codec_(codec)
+    , frameSize_(std::min(std::max<size_t>(maxFrameSize, 1), MAX_FRAME_SIZE))
+    , slotCount_(std::min(std::max<size_t>(frameSlots, 1), FRAME_SLOTS))
+{
+    // The slab is mapped on first use, with a decoder target attached
+    // most frames never need a slot
+    parameterSets_.vps.reserve(MAX_PARAMETER_SET);
+    parameterSets_.sps.reserve(MAX_PARAMETER_SET);
+    parameterSets_.pps.reserve(MAX_PARAMETER_SET);
+}
+
+bool VideoAssembler::isMediaRecord(uint8_t flags, const uint8_t* data, size_t length) {
+    if (flags == FLAGS_FIRST || flags == FLAGS_MIDDLE || flags == FLAGS_LAST) {
+        return true;
+    }
+    if (length < 2) {
+        return false;
+    }
+    const uint16_t type = readBe16(data);
+    return type == MSG_MEDIA_DATA || type == MSG_CODEC_CONFIG;
+}
+
+void VideoAssembler::setFrameTarget(VideoFrameTarget* target) {
+    std::lock_guard<std::mutex> producer(producerMutex_);
+    if (filling_ == FILL_DIRECT) {
+        abandonFill();
+    }
+    target_ = target;
+}
+
+bool VideoAssembler::process(int channel, uint8_t flags, const uint8_t* data, size_t length) {
+    std::lock_guard<std::mutex> producer(producerMutex_);
+    if (idle_) {
+        return processIdle(channel, flags, data, length);
+    }
+
+    switch (flags) {
+        case FLAGS_COMPLETE: {
+            size_t offset;
+            uint64_t timestampUs = 0;
+            bool config = false;
+            // The message type decides the header size; probing offsets can
+            // misread a config record whose second start code sits at 10
+            const uint16_t type = length >= 2 ? readBe16(data) : 0xFFFF;
+            if (type == MSG_CODEC_CONFIG &&
+                hasStartCode(data + CONFIG_HEADER_SIZE, length - CONFIG_HEADER_SIZE)) {
+                offset = CONFIG_HEADER_SIZE;
+                config = true;
+            } else if (type == MSG_MEDIA_DATA && length > MEDIA_HEADER_SIZE &&
+                       hasStartCode(data + MEDIA_HEADER_SIZE, length - MEDIA_HEADER_SIZE)) {
+                offset = MEDIA_HEADER_SIZE;
+                timestampUs = readBe64(data + 2);
+            } else {
+                break;
+            }
+
+            if (!beginFrame(channel, timestampUs) || !append(data + offset, length - offset)) {
+                break;
+            }
+            finishFrame(config);
+            return true;
+        }
+
+        case FLAGS_FIRST: {
+            if (length <= MEDIA_HEADER_SIZE || !hasStartCode(data + MEDIA_HEADER_SIZE, length - MEDIA_HEADER_SIZE)) {
+                break;
+            }
+            if (!beginFrame(channel, readBe64(data + 2)) ||
+                !append(data + MEDIA_HEADER_SIZE, length - MEDIA_HEADER_SIZE)) {
+                break;
+            }
+            return true;
+        }
+
+        case FLAGS_MIDDLE:
+        case FLAGS_LAST: {
+            if (filling_ == NOT_FILLING) {
+                break; // Orphan fragment, first one was dropped
+            }
+            if (channel != fillChannel_) {
+                abandonFill();
+                break;
+            }
+            if (!append(data, length)) {
+                break;
+            }
+            if (flags == FLAGS_LAST) {
+                finishFrame(false);
+            }
+            return true;
+        }
+
+        default:
+            break;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.recordsDropped++;
+    return false;
+}
+
+bool VideoAssembler::beginFrame(int channel, uint64_t timestampUs) {
+    if (filling_ != NOT_FILLING) {
+        LOGD("Starting new fragment while previous incomplete, discarding old data");
+        abandonFill();
+    }
+
+    fillLength_ = 0;
+    fillChannel_ = channel;
+    fillTimestampUs_ = timestampUs;
+    fillArrivalUs_ = steadyUs();
+
+    // Straight into a decoder input buffer, unless older frames are still
+    // queued ahead of this one
+    if (target_ && isQueueEmpty()) {
+        size_t capacity = 0;
+        uint8_t* buffer = target_->dequeueInput(capacity);
+        if (buffer) {
+            filling_ = FILL_DIRECT;
+            fillBuffer_ = buffer;
+            fillCapacity_ = capacity;
+            return true;
+        }
+    }
+
+    const int slot = takeSlot();
+    if (slot < 0) {
+        return false;
+    }
+    filling_ = slot;
+    fillBuffer_ = slots_[slot].buffer;
+    fillCapacity_ = frameSize_;
+    return true;
+}
+
+bool VideoAssembler::isQueueEmpty() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return readyCount_ == 0 && heldCount_ == 0;
+}
+
+int VideoAssembler::takeSlot() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    int slot = -1;
+    for (size_t i = 0; i < slotCount_; i++) {
+        if (slots_[i].state == SlotState::FREE) {
+            slot = static_cast<int>(i);
+            break;
+        }
+    }
+
+    // Decoder is behind: skip ahead to a keyframe
+    if (slot < 0 && readyCount_ > 0) {
+        slot = dropUntilKeyframe();
+    }
+    if (slot < 0) {
+        return -1;
+    }
+
+    if (!slab_ && !allocateSlab()) {
+        return -1;
+    }
+    slots_[slot].state = SlotState::FILLING;
+    return slot;
+}
+
+// Called with mutex_ held, frees the dropped slots and returns one of them
+int VideoAssembler::dropUntilKeyframe() {
+    // Newest queued keyframe behind the head, everything before it goes
+    size_t keyframe = 0;
+    for (size_t i = readyCount_; i-- > 1;) {
+        const int slot = ready_[(readyHead_ + i) % FRAME_SLOTS];
+        if (slots_[slot].info.flags & VideoFrameInfo::FLAG_KEYFRAME) {
+            keyframe = i;
+            break;
+        }
+    }
+    const size_t dropEnd = keyframe > 0 ? keyframe : readyCount_;
+
+    int freed = -1;
+    int kept[FRAME_SLOTS];
+    size_t keptCount = 0;
+    for (size_t i = 0; i < readyCount_; i++) {
+        const int slot = ready_[(readyHead_ + i) % FRAME_SLOTS];
+        if (i >= dropEnd || (slots_[slot].info.flags & VideoFrameInfo::FLAG_CONFIG)) {
+            kept[keptCount++] = slot;
+            continue;
+        }
+        if (freed < 0) {
+            freed = slot;
+        } else {
+            slots_[slot].state = SlotState::FREE;
+        }
+        stats_.framesDropped++;
+    }
+
+    if (freed < 0) {
+        // Nothing but parameter sets ahead of the keyframe, drop the oldest
+        freed = kept[0];
+        std::memmove(kept, kept + 1, --keptCount * sizeof(int));
+        stats_.framesDropped++;
+    }
+    std::memcpy(ready_, kept, keptCount * sizeof(int));
+    readyHead_ = 0;
+    readyCount_ = keptCount;
+
+    if (keyframe == 0) {
+        awaitKeyframe();
+    }
+    return freed;
+}
+
+// Producer only; stats_ needs mutex_, which every caller holds
+void VideoAssembler::awaitKeyframe() {
+    if (!awaitingKeyframe_) {
+        awaitingKeyframe_ = true;
+        keyframeRequested_ = true;
+        stats_.keyframeRequests++;
+    }
+}
+
+void VideoAssembler::setIdle(bool idle) {
+    std::lock_guard<std::mutex> producer(producerMutex_);
+    if (idle == idle_) {
+        return;
+    }
+    idle_ = idle;
+    if (idle) {
+        if (filling_ != NOT_FILLING) {
+            abandonFill();
+        }
+        LOGI("Video stage idle");
+        return;
+    }
+    // Nothing since the cached keyframe was assembled. No request: the
+    // phone starts over with a keyframe once video focus is back.
+    keyframeFilling_ = false;
+    awaitingKeyframe_ = true;
+    LOGI("Video stage resumed");
+    if (target_) {
+        replayLocked();
+    }
+}
+
+bool VideoAssembler::replayKeyframe() {
+    std::lock_guard<std::mutex> producer(producerMutex_);
+    return replayLocked();
+}
+
+bool VideoAssembler::replayLocked() {
+    if (idle_ || keyframeLength_ == 0 || filling_ != NOT_FILLING) {
+        return false;
+    }
+    if (!beginFrame(keyframeChannel_, keyframeInfo_.timestampUs) ||
+        !append(keyframe_.get(), keyframeLength_)) {
+        return false;
+    }
+    finishFrame(false, true);
+    // The live stream went on without the decoder
+    awaitingKeyframe_ = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.keyframesReplayed++;
+    }
+    LOGI("Replayed cached keyframe (%zu bytes)", keyframeLength_);
+    return true;
+}
+
+bool VideoAssembler::processIdle(int channel, uint8_t flags, const uint8_t* data, size_t length) {
+    switch (flags) {
+        case FLAGS_COMPLETE: {
+            const uint16_t type = length >= 2 ? readBe16(data) : 0xFFFF;
+            if (type == MSG_CODEC_CONFIG &&
+                hasStartCode(data + CONFIG_HEADER_SIZE, length - CONFIG_HEADER_SIZE)) {
+                // Only for the parameter set cache
+                int nalType;
+                inspect(data + CONFIG_HEADER_SIZE, length - CONFIG_HEADER_SIZE, nalType);
+                return true;
+            }
+            if (type != MSG_MEDIA_DATA || length <= MEDIA_HEADER_SIZE ||
+                !hasStartCode(data + MEDIA_HEADER_SIZE, length - MEDIA_HEADER_SIZE)) {
+                break;
+            }
+            beginKeyframe(channel, readBe64(data + 2), data + MEDIA_HEADER_SIZE, length - MEDIA_HEADER_SIZE, true);
+            return true;
+        }
+
+        case FLAGS_FIRST: {
+            if (length <= MEDIA_HEADER_SIZE || !hasStartCode(data + MEDIA_HEADER_SIZE, length - MEDIA_HEADER_SIZE)) {
+                break;
+            }
+            beginKeyframe(channel, readBe64(data + 2), data + MEDIA_HEADER_SIZE, length - MEDIA_HEADER_SIZE, false);
+            return true;
+        }
+
+        case FLAGS_MIDDLE:
+        case FLAGS_LAST: {
+            // Fragments of a skipped frame are skipped with it
+            if (!keyframeFilling_ || channel != keyframeChannel_) {
+                return true;
+            }
+            if (keyframeFill_ + length > frameSize_) {
+                keyframeFilling_ = false;
+                break;
+            }
+            std::memcpy(keyframe_.get() + keyframeFill_, data, length);
+            keyframeFill_ += length;
+            if (flags == FLAGS_LAST) {
+                finishKeyframe();
+            }
+            return true;
+        }
+
+        default:
+            break;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.recordsDropped++;
+    return false;
+}
+
+// The first slice is always in the first record, so that decides the frame
+void VideoAssembler::beginKeyframe(int channel, uint64_t timestampUs, const uint8_t* data,
+                                   size_t length, bool complete) {
+    keyframeFilling_ = false;
+    int nalType;
+    const uint32_t frameFlags = inspect(data, length, nalType);
+    if (!(frameFlags & VideoFrameInfo::FLAG_KEYFRAME)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.framesSkippedIdle++;
+        return;
+    }
+
+    if (!keyframe_) {
+        keyframe_.reset(allocateStreamingMemory(frameSize_));
+    }
+    if (!keyframe_ || length > frameSize_) {
+        return;
+    }
+    keyframeLength_ = 0;
+    std::memcpy(keyframe_.get(), data, length);
+    keyframeFill_ = length;
+    keyframeChannel_ = channel;
+    keyframeInfo_ = VideoFrameInfo{};
+    keyframeInfo_.timestampUs = timestampUs;
+    keyframeInfo_.arrivalUs = steadyUs();
+    keyframeInfo_.flags = frameFlags;
+    keyframeInfo_.nalType = nalType;
+    keyframeFilling_ = true;
+    if (complete) {
+        finishKeyframe();
+    }
+}
+
+void VideoAssembler::finishKeyframe() {
+    keyframeFilling_ = false;
+    keyframeLength_ = keyframeFill_;
+    keyframeInfo_.length = static_cast<uint32_t>(keyframeFill_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.keyframesCached++;
+}
+
+// Called with producerMutex_ held, before the frame is handed on
+void VideoAssembler::cacheKeyframe(const VideoFrameInfo& info) {
+    if (!keyframe_) {
+        keyframe_.reset(allocateStreamingMemory(frameSize_));
+    }
+    if (!keyframe_ || fillLength_ > frameSize_) {
+        keyframeLength_ = 0;
+        return;
+    }
+    std::memcpy(keyframe_.get(), fillBuffer_, fillLength_);
+    keyframeLength_ = fillLength_;
+    keyframeChannel_ = fillChannel_;
+    keyframeInfo_ = info;
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats_.keyframesCached++;
+}
+
+void VideoAssembler::skipToKeyframe() {
+    std::lock_guard<std::mutex> producer(producerMutex_);
+    if (filling_ != NOT_FILLING) {
+        abandonFill();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    awaitKeyframe();
+}
+
+bool VideoAssembler::takeKeyframeRequest() {
+    const bool requested = keyframeRequested_;
+    keyframeRequested_ = false;
+    return requested;
+}
+
+bool VideoAssembler::reserveFrameBuffers() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return slab_ || allocateSlab();
+}
+
+bool VideoAssembler::allocateSlab() {
+    // Untouched pages stay unbacked unless the streaming memory options populate them
+    slab_.reset(allocateStreamingMemory(frameSize_ * slotCount_));
+    if (!slab_) {
+        LOGE("Could not allocate %zu frame slots of %zu KB", slotCount_, frameSize_ / 1024);
+        return false;
+    }
+    for (size_t i = 0; i < slotCount_; i++) {
+        slots_[i].buffer = slab_.get() + i * frameSize_;
+    }
+    return true;
+}
+
+void VideoAssembler::abandonFill() {
+    if (filling_ == FILL_DIRECT) {
+        // Zero length hands the input buffer back unused
+        VideoFrameInfo info{};
+        info.nalType = -1;
+        target_->queueInput(info);
+    } else if (filling_ >= 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_[filling_].state = SlotState::FREE;
+    }
+    filling_ = NOT_FILLING;
+}
+
+bool VideoAssembler::append(const uint8_t* data, size_t length) {
+    if (fillLength_ + length > fillCapacity_) {
+        LOGE("Fragment buffer overflow, dropping frame (have=%zu, needed=%zu)", fillLength_, length);
+        abandonFill();
+        return false;
+    }
+    std::memcpy(fillBuffer_ + fillLength_, data, length);
+    fillLength_ += length;
+    return true;
+}
+
+void VideoAssembler::finishFrame(bool config, bool replay) {
+    VideoFrameInfo info{};
+    info.length = static_cast<uint32_t>(fillLength_);
+    info.timestampUs = fillTimestampUs_;
+    info.arrivalUs = fillArrivalUs_;
+    info.flags = inspect(fillBuffer_, fillLength_, info.nalType);
+    if (config) {
+        info.flags |= VideoFrameInfo::FLAG_CONFIG;
+    }
+
+    if (awaitingKeyframe_) {
+        if (info.flags & VideoFrameInfo::FLAG_KEYFRAME) {
+            awaitingKeyframe_ = false;
+            LOGD("Keyframe received, resuming");
+        } else if (!(info.flags & VideoFrameInfo::FLAG_CONFIG)) {
+            // References frames that were dropped
+            abandonFill();
+            std::lock_guard<std::mutex> lock(mutex_);
+            stats_.framesDropped++;
+            return;
+        }
+    }
+
+    if (!replay && (info.flags & VideoFrameInfo::FLAG_KEYFRAME)) {
+        cacheKeyframe(info);
+    }
+
+    const int slot = filling_;
+    filling_ = NOT_FILLING;
+    if (slot == FILL_DIRECT) {
+        target_->queueInput(info);
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.framesAssembled++;
+        stats_.framesDirect++;
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        slots_[slot].info = info;
+        slots_[slot].state = SlotState::READY;
+        ready_[(readyHead_ + readyCount_) % FRAME_SLOTS] = slot;
+        readyCount_++;
+        stats_.framesAssembled++;
+    }
+    frameReady_.notify_one();
+}
+
+// Walks the NAL headers up to the first slice; parameter sets always come first
+uint32_t VideoAssembler::inspect(const uint8_t* frame, size_t length, int& firstNalType) {
+    uint32_t flags = 0;
+    bool sawSlice = false;
+    firstNalType = -1;
+
+    size_t pos = NalScanner::findStartCode(frame, 0, length);
+    while (pos + 3 < length) {
+        const size_t nal = pos + 3;
+        const int type = NalScanner::nalType(codec_, frame[nal]);
+        bool slice;
+        bool keyframe;
+        std::vector<uint8_t>* cache = nullptr;
+        if (codec_ == VideoCodec::H265) {
+            slice = type < 32;
+            keyframe = type >= 16 && type <= 23;       // IRAP
+            if (type == 32) cache = &parameterSets_.vps;
+            if (type == 33) cache = &parameterSets_.sps;
+            if (type == 34) cache = &parameterSets_.pps;
+        } else {
+            slice = type >= 1 && type <= 5;
+            keyframe = type == 5;                      // IDR
+            if (type == 7) cache = &parameterSets_.sps;
+            if (type == 8) cache = &parameterSets_.pps;
+        }
+
+        if (firstNalType < 0) {
+            firstNalType = type;
+        }
+        if (slice) {
+            if (keyframe) {
+                flags |= VideoFrameInfo::FLAG_KEYFRAME;
+            }
+            sawSlice = true;
+            break;
+        }
+
+        // Only non-slice NALs are delimited, the slice data is never scanned
+        const size_t next = NalScanner::findStartCode(frame, nal, length);
+        if (cache) {
+            // Trailing zeros before a 4-byte start code belong to the next NAL
+            size_t end = next;
+            while (end > nal && frame[end - 1] == 0) {
+                end--;
+            }
+            cacheParameterSet(*cache, frame + nal, end - nal);
+        }
+        pos = next;
+    }
+
+    if (!sawSlice && firstNalType >= 0) {
+        flags |= VideoFrameInfo::FLAG_CONFIG;
+    }
+    return flags;
+}
+
+void VideoAssembler::cacheParameterSet(std::vector<uint8_t>& cache, const uint8_t* nal, size_t length) {
+    const size_t size = sizeof(START_CODE) + length;
+    if (size > MAX_PARAMETER_SET) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (cache.size() == size && std::memcmp(cache.data() + sizeof(START_CODE), nal, length) == 0) {
+        return;
+    }
+    cache.resize(size);
+    std::memcpy(cache.data(), START_CODE, sizeof(START_CODE));
+    std::memcpy(cache.data() + sizeof(START_CODE), nal, length);
+    stats_.parameterSetUpdates++;
+    // A keyframe from before no longer decodes against these
+    keyframeLength_ = 0;
+    if (&cache == &parameterSets_.sps) {
+        streamInfoValid_ = SpsParser::parseSps(codec_, nal, length, streamInfo_);
+        if (streamInfoValid_) {
+            LOGI("SPS: profile %d, level %d, %dx%d (coded %dx%d), %.2f fps",
+                 streamInfo_.profile, streamInfo_.level, streamInfo_.width, streamInfo_.height,
+                 streamInfo_.codedWidth, streamInfo_.codedHeight, streamInfo_.frameRate());
+        } else {
+            LOGE("Could not parse SPS (%zu bytes)", length);
+        }
+    } else if (&cache == &parameterSets_.vps) {
+        SpsParser::parseVps(nal, length, streamInfo_);
+    }
+    LOGI("Cached parameter set (%zu bytes)", size);
+}
+
+int VideoAssembler::acquireFrame(VideoFrameInfo& info, int timeoutMs) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto ready = [this] { return readyCount_ > 0 || shutdown_; };
+    if (timeoutMs < 0) {
+        frameReady_.wait(lock, ready);
+    } else if (timeoutMs > 0) {
+        frameReady_.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready);
+    }
+    if (readyCount_ == 0) {
+        return -1;
+    }
+
+    const int slot = ready_[readyHead_];
+    readyHead_ = (readyHead_ + 1) % FRAME_SLOTS;
+    readyCount_--;
+    slots_[slot].state = SlotState::HELD;
+    heldCount_++;
+    info = slots_[slot].info;
+    return slot;
+}
+
+void VideoAssembler::releaseFrame(int slot) {
+    if (slot < 0 || static_cast<size_t>(slot) >= slotCount_) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (slots_[slot].state == SlotState::HELD) {
+        slots_[slot].state = SlotState::FREE;
+        heldCount_--;
+    }
+}
+
+void VideoAssembler::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        shutdown_ = true;
+    }
+    frameReady_.notify_all();
+}
+
+bool VideoAssembler::getParameterSets(ParameterSets& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (parameterSets_.sps.empty() || parameterSets_.pps.empty() ||
+        (codec_ == VideoCodec::H265 && parameterSets_.vps.empty())) {
+        return false;
+    }
+    out = parameterSets_;
+    return true;
+}
+
+bool VideoAssembler::getStreamInfo(VideoStreamInfo& out) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!streamInfoValid_) {
+        return false;
+    }
+    out = streamInfo_;
+    return true;
+}
+
+VideoAssembler::Stats VideoAssembler::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats = stats_;
+    stats.framesQueued = readyCount_;
+    return stats;
+}
+
+} // namespace aap
@@ -0,0 +1,285 @@
+#pragma once
+
+#include "nal_scanner.h"
+#include "sps_parser.h"
+#include "streaming_memory.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace aap {
+
+/**
+ * Metadata for one assembled access unit.
+ */
+struct VideoFrameInfo {
+    static constexpr uint32_t FLAG_KEYFRAME = 0x01;  // Contains an IDR/IRAP slice
+    static constexpr uint32_t FLAG_CONFIG = 0x02;    // Parameter sets only
+
+    uint32_t length;
+    int nalType;            // Type of the first NAL unit
+    uint32_t flags;
+    uint64_t timestampUs;   // From the media data header, 0 for codec config
+    uint64_t arrivalUs;     // CLOCK_MONOTONIC, when the first fragment was received
+};
+
+/**
+ * Decoder that accepts frames assembled in its own input buffers.
+ * Only one input buffer is outstanding at a time.
+ */
+class VideoFrameTarget {
+public:
+    virtual ~VideoFrameTarget() = default;
+
+    /**
+     * Dequeue an input buffer for the next frame without blocking.
+     * @return nullptr if none is free, the frame then goes to a slot
+     */
+    virtual uint8_t* dequeueInput(size_t& capacity) = 0;
+
+    /**
+     * Submit the buffer from dequeueInput(). A zero length returns it unused.
+     */
+    virtual void queueInput(const VideoFrameInfo& info) = 0;
+};
+
+/**
+ * Native video stage: reassembles fragmented video records into
+ * complete Annex-B access units, caches parameter sets and queues the
+ * frames for the decoder.
+ *
+ * With a frame target set, frames are assembled straight into decoder
+ * input buffers. Otherwise, or while the decoder has no free buffer, they
+ * go to slots that are exposed to Kotlin as direct buffers. The slots
+ * share one slab, mapped on first use and only faulted in as frames fill
+ * it, so the frame size and slot count can be fitted to the stream.
+ *
+ * When all slots are busy, queued frames are dropped up to the newest
+ * queued keyframe to bound latency; dropping a single delta frame would
+ * only smear the picture until the next one. Without a queued keyframe
+ * every queued delta frame goes, new ones are discarded until a keyframe
+ * arrives and takeKeyframeRequest() asks for one. Parameter sets are
+ * never dropped.
+ *
+ * The most recent keyframe is copied aside as well, for replayKeyframe()
+ * to hand a decoder coming back to its surface a picture straight away.
+ * While idle, with the projection in the background, nothing is
+ * reassembled or queued: parameter sets are still cached and keyframes
+ * copied aside, every other frame is skipped at its first record.
+ *
+ * process() is called from a single producer thread (AAP-Video, or the
+ * dispatching thread while idle), acquireFrame()/releaseFrame() from a
+ * single consumer (the decoder).
+ */
+class VideoAssembler {
+public:
+    static constexpr size_t MAX_FRAME_SIZE = 524288;  // Matches VideoFrameQueue.MAX_FRAME_SIZE
+    static constexpr size_t FRAME_SLOTS = 16;
+    static constexpr size_t MAX_PARAMETER_SET = 1024;
+
+    /**
+     * @param maxFrameSize Bytes per slot, at most MAX_FRAME_SIZE
+     * @param frameSlots At most FRAME_SLOTS
+     */
+    explicit VideoAssembler(VideoCodec codec = VideoCodec::H264,
+                            size_t maxFrameSize = MAX_FRAME_SIZE, size_t frameSlots = FRAME_SLOTS);
+
+    // Non-copyable
+    VideoAssembler(const VideoAssembler&) = delete;
+    VideoAssembler& operator=(const VideoAssembler&) = delete;
+
+    /**
+     * Assemble frames into a decoder's input buffers, nullptr to stop.
+     * Waits for a record in progress; once it returns the previous target
+     * is no longer used.
+     */
+    void setFrameTarget(VideoFrameTarget* target);
+
+    /**
+     * Check if a decrypted video channel record carries media data,
+     * the records AapVideo.process() used to handle.
+     */
+    static bool isMediaRecord(uint8_t flags, const uint8_t* data, size_t length);
+
+    /**
+     * Feed one decrypted media record.
+     * @return false if the record was malformed and dropped
+     */
+    bool process(int channel, uint8_t flags, const uint8_t* data, size_t length);
+
+    /**
+     * Discard the frame in progress and every delta frame until the next
+     * keyframe, after records were lost upstream. Producer thread only.
+     */
+    void skipToKeyframe();
+
+    /**
+     * Stop or resume assembling frames for the decoder. Idle keeps the
+     * parameter sets and the most recent keyframe only; on resume delta
+     * frames are dropped until the next keyframe. Safe to call from any thread.
+     */
+    void setIdle(bool idle);
+
+    /**
+     * Queue the cached keyframe again, for a decoder that skipped frames
+     * while it had no surface. Delta frames after it are dropped until the
+     * stream's next keyframe. Also done on leaving idle with a frame target
+     * set. Safe to call from any thread.
+     * @return false while idle, mid-frame or with no keyframe cached
+     */
+    bool replayKeyframe();
+
+    /**
+     * Check and clear a keyframe request, raised when frames are being
+     * discarded until a keyframe. Producer thread only, after process().
+     */
+    bool takeKeyframeRequest();
+
+    /**
+     * Wait for the next complete frame.
+     * @param timeoutMs 0 to poll, negative to wait until shutdown()
+     * @return Slot index holding the frame, or -1 if none is ready
+     */
+    int acquireFrame(VideoFrameInfo& info, int timeoutMs);
+
+    /**
+     * Return a slot from acquireFrame() once the decoder consumed it.
+     */
+    void releaseFrame(int slot);
+
+    /**
+     * Wake a consumer blocked in acquireFrame().
+     */
+    void shutdown();
+
+    /**
+     * Allocate every slot buffer, needed before frameBuffer() views are taken.
+     * @return false if a buffer could not be allocated
+     */
+    bool reserveFrameBuffers();
+
+    uint8_t* frameBuffer(int slot) { return slots_[slot].buffer; }
+    size_t frameSize() const { return frameSize_; }
+    size_t slotCount() const { return slotCount_; }
+
+    VideoCodec codec() const { return codec_; }
+
+    /**
+     * Most recent parameter sets, each with a 4-byte start code.
+     * VPS is only used for H.265.
+     */
+    struct ParameterSets {
+        std::vector<uint8_t> vps;
+        std::vector<uint8_t> sps;
+        std::vector<uint8_t> pps;
+    };
+    bool getParameterSets(ParameterSets& out) const;
+
+    /**
+     * Dimensions, profile, level and timing parsed from the latest SPS
+     * (and VPS for H.265).
+     * @return false until an SPS could be parsed
+     */
+    bool getStreamInfo(VideoStreamInfo& out) const;
+
+    struct Stats {
+        uint64_t framesAssembled;
+        uint64_t framesDirect;      // Assembled in a decoder input buffer
+        uint64_t framesDropped;     // Dropped for newer frames, or until a keyframe
+        uint64_t recordsDropped;    // Malformed, orphaned or oversized records
+        uint64_t parameterSetUpdates;
+        uint64_t framesQueued;      // Ready, not yet acquired by the decoder
+        uint64_t keyframeRequests;
+        uint64_t framesSkippedIdle; // Not assembled while idle
+        uint64_t keyframesCached;   // Copied aside for replayKeyframe()
+        uint64_t keyframesReplayed;
+    };
+    Stats getStats() const;
+
+private:
+    enum class SlotState {
+        FREE,
+        FILLING,
+        READY,
+        HELD
+    };
+
+    struct Slot {
+        uint8_t* buffer = nullptr;  // Into slab_
+        SlotState state = SlotState::FREE;
+        VideoFrameInfo info{};
+    };
+
+    // Called with mutex_ held
+    bool allocateSlab();
+    // Called with producerMutex_ held
+    bool processIdle(int channel, uint8_t flags, const uint8_t* data, size_t length);
+    void beginKeyframe(int channel, uint64_t timestampUs, const uint8_t* data, size_t length, bool complete);
+    void finishKeyframe();
+    void cacheKeyframe(const VideoFrameInfo& info);
+    bool replayLocked();
+
+    VideoCodec codec_;
+    const size_t frameSize_;
+    const size_t slotCount_;
+    StreamingBuffer slab_;
+    Slot slots_[FRAME_SLOTS];
+
+    // Ready frames, oldest first
+    int ready_[FRAME_SLOTS];
+    size_t readyHead_ = 0;
+    size_t readyCount_ = 0;
+    size_t heldCount_ = 0;
+
+    // Producer-only fragment state, guarded by producerMutex_ against setFrameTarget()
+    static constexpr int NOT_FILLING = -1;
+    static constexpr int FILL_DIRECT = -2;
+    int filling_ = NOT_FILLING;    // Slot index, or one of the above
+    uint8_t* fillBuffer_ = nullptr;
+    size_t fillCapacity_ = 0;
+    size_t fillLength_ = 0;
+    int fillChannel_ = -1;
+    uint64_t fillTimestampUs_ = 0;
+    uint64_t fillArrivalUs_ = 0;
+    bool awaitingKeyframe_ = false;
+    bool keyframeRequested_ = false;
+
+    // Idle state and the cached keyframe, guarded by producerMutex_. The
+    // keyframe is only valid with a length, a keyframe being copied in or
+    // a parameter set change invalidates it.
+    bool idle_ = false;
+    bool keyframeFilling_ = false;
+    int keyframeChannel_ = -1;
+    size_t keyframeFill_ = 0;
+    size_t keyframeLength_ = 0;
+    VideoFrameInfo keyframeInfo_{};
+    StreamingBuffer keyframe_;
+
+    ParameterSets parameterSets_;
+    VideoStreamInfo streamInfo_;    // Guarded by mutex_, like the sets
+    bool streamInfoValid_ = false;
+
+    VideoFrameTarget* target_ = nullptr;
+    std::mutex producerMutex_;
+    mutable std::mutex mutex_;
+    std::condition_variable frameReady_;
+    bool shutdown_ = false;
+
+    Stats stats_{};
+
+    bool beginFrame(int channel, uint64_t timestampUs);
+    bool isQueueEmpty() const;
+    int takeSlot();
+    int dropUntilKeyframe();
+    void awaitKeyframe();
+    void abandonFill();
+    bool append(const uint8_t* data, size_t length);
+    void finishFrame(bool config, bool replay = false);
+    uint32_t inspect(const uint8_t* frame, size_t length, int& firstNalType);
+    void cacheParameterSet(std::vector<uint8_t>& cache, const uint8_t* nal, size_t length);
+};
+
+} // namespace aap
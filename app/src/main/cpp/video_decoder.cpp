@@ -0,0 +1,717 @@
+#include "video_decoder.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <android/native_window.h>
+#include <media/NdkMediaFormat.h>
+#include <dlfcn.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <vector>
+
+#define LOG_TAG "VideoDecoder"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+// Blocking waits are bounded so stop() is noticed promptly
+constexpr int FRAME_WAIT_MS = 20;
+constexpr int64_t CODEC_WAIT_US = 10000;
+
+// Same as THREAD_PRIORITY_URGENT_DISPLAY used by VideoDecodeThread
+constexpr int DECODE_NICE = -8;
+
+// AMediaCodec_setAsyncNotifyCallback is API 28, minSdk is 21
+using SetAsyncNotifyCallbackFn = media_status_t (*)(AMediaCodec*, AMediaCodecOnAsyncNotifyCallback, void*);
+
+SetAsyncNotifyCallbackFn loadSetAsyncNotifyCallback() {
+    static const SetAsyncNotifyCallbackFn fn = [] {
+        void* lib = dlopen("libmediandk.so", RTLD_NOW);
+        return lib ? reinterpret_cast<SetAsyncNotifyCallbackFn>(
+                dlsym(lib, "AMediaCodec_setAsyncNotifyCallback")) : nullptr;
+    }();
+    return fn;
+}
+
+// AMediaCodec_getName is API 28 too
+using GetNameFn = media_status_t (*)(AMediaCodec*, char**);
+using ReleaseNameFn = void (*)(AMediaCodec*, char*);
+
+struct CodecNameApi {
+    GetNameFn getName = nullptr;
+    ReleaseNameFn releaseName = nullptr;
+};
+
+const CodecNameApi& codecNameApi() {
+    static const CodecNameApi api = [] {
+        CodecNameApi result;
+        void* lib = dlopen("libmediandk.so", RTLD_NOW);
+        if (lib) {
+            result.getName = reinterpret_cast<GetNameFn>(dlsym(lib, "AMediaCodec_getName"));
+            result.releaseName = reinterpret_cast<ReleaseNameFn>(dlsym(lib, "AMediaCodec_releaseName"));
+        }
+        return result;
+    }();
+    return api;
+}
+
+// AMediaCodec_setOutputSurface is API 23
+using SetOutputSurfaceFn = media_status_t (*)(AMediaCodec*, ANativeWindow*);
+
+SetOutputSurfaceFn loadSetOutputSurface() {
+    static const SetOutputSurfaceFn fn = [] {
+        void* lib = dlopen("libmediandk.so", RTLD_NOW);
+        return lib ? reinterpret_cast<SetOutputSurfaceFn>(
+                dlsym(lib, "AMediaCodec_setOutputSurface")) : nullptr;
+    }();
+    return fn;
+}
+
+// AImageReader is API 24, its AIMAGE_FORMAT_PRIVATE for decoder output 26
+using ImageReaderNewFn = media_status_t (*)(int32_t, int32_t, int32_t, int32_t, AImageReader**);
+using ImageReaderGetWindowFn = media_status_t (*)(AImageReader*, ANativeWindow**);
+using ImageReaderDeleteFn = void (*)(AImageReader*);
+
+constexpr int32_t IMAGE_FORMAT_PRIVATE = 0x22;
+// Nothing is ever rendered to the placeholder, one image is plenty
+constexpr int32_t PLACEHOLDER_IMAGES = 1;
+
+struct ImageReaderApi {
+    ImageReaderNewFn create = nullptr;
+    ImageReaderGetWindowFn getWindow = nullptr;
+    ImageReaderDeleteFn destroy = nullptr;
+};
+
+const ImageReaderApi& imageReaderApi() {
+    static const ImageReaderApi api = [] {
+        ImageReaderApi result;
+        void* lib = dlopen("libmediandk.so", RTLD_NOW);
+        if (lib) {
+            result.create = reinterpret_cast<ImageReaderNewFn>(dlsym(lib, "AImageReader_new"));
+            result.getWindow = reinterpret_cast<ImageReaderGetWindowFn>(dlsym(lib, "AImageReader_getWindow"));
+            result.destroy = reinterpret_cast<ImageReaderDeleteFn>(dlsym(lib, "AImageReader_delete"));
+        }
+        return result;
+    }();
+    return api;
+}
+
+// Vendor extensions that turn off output reordering and buffering,
+// only set for the decoders that declare them
+struct VendorLowLatencyKey {
+    const char* key;
+    int32_t value;
+};
+
+struct VendorLowLatency {
+    const char* prefixes[2];
+    VendorLowLatencyKey keys[2];
+};
+
+constexpr VendorLowLatency VENDOR_LOW_LATENCY[] = {
+    {{"OMX.qcom.", "c2.qti."},
+     {{"vendor.qti-ext-dec-picture-order.enable", 1}, {"vendor.qti-ext-dec-low-latency.enable", 1}}},
+    {{"OMX.hisi.", "c2.hisi."},
+     {{"vendor.hisi-ext-low-latency-video-dec.video-scene-for-low-latency-req", 1},
+      {"vendor.hisi-ext-low-latency-video-dec.video-scene-for-low-latency-rdy", -1}}},
+    {{"OMX.Exynos.", "c2.exynos."},
+     {{"vendor.rtc-ext-dec-low-latency.enable", 1}, {nullptr, 0}}},
+    {{"OMX.amlogic.", "c2.amlogic."},
+     {{"vendor.low-latency.enable", 1}, {nullptr, 0}}},
+};
+
+uint64_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+} // anonymous namespace
+
+VideoDecoder::VideoDecoder(VideoAssembler& assembler, VideoCodec codec)
+    : assembler_(assembler)
+    , codec_(codec)
+{
+}
+
+VideoDecoder::~VideoDecoder() {
+    stop();
+}
+
+bool VideoDecoder::start(ANativeWindow* window, int width, int height, bool lowLatency) {
+    if (!window) {
+        return false;
+    }
+    if (parked_.load(std::memory_order_acquire)) {
+        if (resume(window)) {
+            return true;
+        }
+        // Output can't be switched over, start from scratch on the new surface
+        stop();
+    }
+    if (running_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    ANativeWindow_acquire(window);
+    return run(window, width, height, lowLatency);
+}
+
+bool VideoDecoder::prepare(int width, int height, bool lowLatency) {
+    if (running_.load(std::memory_order_acquire) || !loadSetOutputSurface() ||
+        !createPlaceholder(width, height)) {
+        return false;
+    }
+    ANativeWindow_acquire(placeholder_);
+    parked_.store(true, std::memory_order_release);
+    run(placeholder_, width, height, lowLatency);
+    LOGI("Video decoder prepared offscreen");
+    return true;
+}
+
+void VideoDecoder::park() {
+    if (!running_.load(std::memory_order_acquire) || parked_.load(std::memory_order_acquire)) {
+        return;
+    }
+
+    bool parked = false;
+    {
+        std::lock_guard<std::mutex> lock(surfaceMutex_);
+        SetOutputSurfaceFn setOutputSurface = loadSetOutputSurface();
+        if (setOutputSurface && (placeholder_ || createPlaceholder(width_, height_))) {
+            // Output buffers decoded from here on are dropped, not rendered
+            parked_.store(true, std::memory_order_release);
+            assembler_.setFrameTarget(nullptr);
+            if (!mediaCodec_ || setOutputSurface(mediaCodec_, placeholder_) == AMEDIA_OK) {
+                ANativeWindow_acquire(placeholder_);
+                ANativeWindow_release(window_);
+                window_ = placeholder_;
+                parked = true;
+            }
+        }
+    }
+    if (!parked) {
+        LOGI("Output can't be parked, stopping the decoder");
+        stop();
+        return;
+    }
+    LOGI("Video decoder parked");
+}
+
+// A parked decoder back on a surface
+bool VideoDecoder::resume(ANativeWindow* window) {
+    {
+        std::lock_guard<std::mutex> lock(surfaceMutex_);
+        SetOutputSurfaceFn setOutputSurface = loadSetOutputSurface();
+        if (mediaCodec_ && (!setOutputSurface || setOutputSurface(mediaCodec_, window) != AMEDIA_OK)) {
+            LOGE("Could not switch codec output to the new surface");
+            return false;
+        }
+        ANativeWindow_acquire(window);
+        ANativeWindow_release(window_);
+        window_ = window;
+        waitingForKeyframe_.store(true, std::memory_order_relaxed);
+        parked_.store(false, std::memory_order_release);
+        if (!mediaCodec_) {
+            // Configured on this surface once parameter sets arrive
+            LOGI("Video decoder resumed, codec not configured yet");
+            return true;
+        }
+        assembler_.setFrameTarget(this);
+    }
+    const bool replayed = assembler_.replayKeyframe();
+    LOGI("Video decoder resumed, keyframe replayed=%d", replayed);
+    return true;
+}
+
+bool VideoDecoder::createPlaceholder(int width, int height) {
+    const ImageReaderApi& api = imageReaderApi();
+    if (!api.create || !api.getWindow || !api.destroy || width <= 0 || height <= 0) {
+        return false;
+    }
+    AImageReader* reader = nullptr;
+    if (api.create(width, height, IMAGE_FORMAT_PRIVATE, PLACEHOLDER_IMAGES, &reader) != AMEDIA_OK || !reader) {
+        LOGD("No offscreen image reader for %dx%d", width, height);
+        return false;
+    }
+    ANativeWindow* window = nullptr;
+    if (api.getWindow(reader, &window) != AMEDIA_OK || !window) {
+        api.destroy(reader);
+        return false;
+    }
+    placeholderReader_ = reader;
+    placeholder_ = window;
+    return true;
+}
+
+// After the codec and every window reference to the placeholder are gone
+void VideoDecoder::releasePlaceholder() {
+    if (placeholderReader_) {
+        imageReaderApi().destroy(placeholderReader_);
+        placeholderReader_ = nullptr;
+        placeholder_ = nullptr;
+    }
+}
+
+// Takes over the caller's reference to window
+bool VideoDecoder::run(ANativeWindow* window, int width, int height, bool lowLatency) {
+    window_ = window;
+    width_ = width;
+    height_ = height;
+    lowLatency_ = lowLatency;
+    vsyncAligned_ = lowLatency && vsync_.start();
+    {
+        std::lock_guard<std::mutex> lock(latencyMutex_);
+        pendingHead_ = 0;
+        pendingCount_ = 0;
+        latency_ = LatencyStats{};
+    }
+    waitingForKeyframe_.store(true, std::memory_order_relaxed);
+    running_.store(true, std::memory_order_release);
+
+    inputThread_ = std::thread(&VideoDecoder::inputLoop, this);
+    LOGI("Video decoder started: %dx%d, lowLatency=%d, vsync=%d", width, height, lowLatency, vsyncAligned_);
+    return true;
+}
+
+void VideoDecoder::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    // No producer touches codec buffers once this returns
+    assembler_.setFrameTarget(nullptr);
+
+    if (inputThread_.joinable()) inputThread_.join();
+    if (outputThread_.joinable()) outputThread_.join();
+
+    if (mediaCodec_) {
+        // No callbacks arrive once stop returns
+        AMediaCodec_stop(mediaCodec_);
+        AMediaCodec_delete(mediaCodec_);
+        mediaCodec_ = nullptr;
+    }
+    vsync_.stop();
+    vsyncAligned_ = false;
+    {
+        std::lock_guard<std::mutex> lock(inputMutex_);
+        inputHead_ = 0;
+        inputCount_ = 0;
+    }
+    async_ = false;
+    if (window_) {
+        ANativeWindow_release(window_);
+        window_ = nullptr;
+    }
+    releasePlaceholder();
+    parked_.store(false, std::memory_order_release);
+    LOGI("Video decoder stopped");
+}
+
+bool VideoDecoder::configure() {
+    VideoAssembler::ParameterSets sets;
+    if (!assembler_.getParameterSets(sets)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(surfaceMutex_);
+
+    const bool hevc = codec_ == VideoCodec::H265;
+    const char* mime = hevc ? "video/hevc" : "video/avc";
+    AMediaCodec* codec = AMediaCodec_createDecoderByType(mime);
+    if (!codec) {
+        LOGE("No decoder for %s", mime);
+        codecErrors_++;
+        return false;
+    }
+
+    // The SPS has the exact picture size, and its level bounds the input
+    // buffers; without it the negotiated size and the frame slot size
+    int width = width_;
+    int height = height_;
+    size_t maxInputSize = assembler_.frameSize();
+    VideoStreamInfo info;
+    if (assembler_.getStreamInfo(info)) {
+        width = info.width;
+        height = info.height;
+        maxInputSize = std::min(maxInputSize, info.maxFrameBytes());
+    }
+
+    AMediaFormat* format = AMediaFormat_new();
+    AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, mime);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_WIDTH, width);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_HEIGHT, height);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_MAX_INPUT_SIZE, static_cast<int32_t>(maxInputSize));
+    if (info.frameRate() > 0) {
+        AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_FRAME_RATE, static_cast<int32_t>(info.frameRate() + 0.5));
+    }
+
+    // Same low latency hints as VideoDecodeThread, ignored where unsupported
+    AMediaFormat_setInt32(format, "low-latency", 1);
+    AMediaFormat_setInt32(format, "priority", 0);
+    AMediaFormat_setInt32(format, "operating-rate", 32767);
+    if (lowLatency_) {
+        applyVendorLowLatency(codec, format);
+    }
+
+    if (hevc) {
+        // H.265 takes VPS, SPS and PPS together as csd-0
+        std::vector<uint8_t> csd(sets.vps);
+        csd.insert(csd.end(), sets.sps.begin(), sets.sps.end());
+        csd.insert(csd.end(), sets.pps.begin(), sets.pps.end());
+        AMediaFormat_setBuffer(format, "csd-0", csd.data(), csd.size());
+    } else {
+        AMediaFormat_setBuffer(format, "csd-0", sets.sps.data(), sets.sps.size());
+        AMediaFormat_setBuffer(format, "csd-1", sets.pps.data(), sets.pps.size());
+    }
+
+    async_ = enableAsync(codec);
+    media_status_t status = AMediaCodec_configure(codec, format, window_, nullptr, 0);
+    AMediaFormat_delete(format);
+    if (status == AMEDIA_OK) {
+        status = AMediaCodec_start(codec);
+    }
+    if (status != AMEDIA_OK) {
+        LOGE("Failed to start %s decoder (%d)", mime, status);
+        AMediaCodec_delete(codec);
+        async_ = false;
+        codecErrors_++;
+        return false;
+    }
+
+    mediaCodec_ = codec;
+    if (!async_) {
+        outputThread_ = std::thread(&VideoDecoder::outputLoop, this);
+    }
+    const bool parked = parked_.load(std::memory_order_acquire);
+    if (!parked) {
+        assembler_.setFrameTarget(this);
+    }
+    LOGI("Codec configured: %s %dx%d, max input %zu KB, SPS %zu bytes, PPS %zu bytes, async=%d, parked=%d",
+         mime, width, height, maxInputSize / 1024, sets.sps.size(), sets.pps.size(), async_, parked);
+    return true;
+}
+
+void VideoDecoder::inputLoop() {
+    applyThreadPolicy("AAP-Decode");
+    setpriority(PRIO_PROCESS, 0, DECODE_NICE);
+
+    // Frames that arrive while the codec is busy or not configured yet
+    while (running_.load(std::memory_order_acquire)) {
+        VideoFrameInfo info{};
+        const int slot = assembler_.acquireFrame(info, FRAME_WAIT_MS);
+
+        if (!mediaCodec_ && !configure()) {
+            if (slot >= 0) {
+                framesSkipped_++;
+                assembler_.releaseFrame(slot);
+            }
+            continue;
+        }
+        if (slot < 0) {
+            continue;
+        }
+        if (parked_.load(std::memory_order_acquire)) {
+            // Replayed from the keyframe cache once back on a surface
+            framesSkipped_++;
+            assembler_.releaseFrame(slot);
+            continue;
+        }
+
+        ssize_t index = -1;
+        while (running_.load(std::memory_order_acquire)) {
+            index = takeInput(CODEC_WAIT_US);
+            if (index >= 0) break;
+        }
+        if (index < 0) {
+            assembler_.releaseFrame(slot);
+            break;
+        }
+
+        size_t capacity = 0;
+        uint8_t* buffer = AMediaCodec_getInputBuffer(mediaCodec_, static_cast<size_t>(index), &capacity);
+        if (buffer && info.length <= capacity) {
+            std::memcpy(buffer, assembler_.frameBuffer(slot), info.length);
+            framesCopied_++;
+        } else {
+            LOGE("Frame of %u bytes does not fit input buffer (%zu)", info.length, capacity);
+            info.length = 0;
+        }
+        assembler_.releaseFrame(slot);
+        submit(static_cast<size_t>(index), info);
+    }
+}
+
+void VideoDecoder::outputLoop() {
+    applyThreadPolicy("AAP-Render");
+    setpriority(PRIO_PROCESS, 0, DECODE_NICE);
+
+    AMediaCodecBufferInfo info;
+    while (running_.load(std::memory_order_acquire)) {
+        const ssize_t index = AMediaCodec_dequeueOutputBuffer(mediaCodec_, &info, CODEC_WAIT_US);
+        if (index >= 0) {
+            render(mediaCodec_, static_cast<size_t>(index), info);
+        } else if (index == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            LOGD("Output format changed");
+        }
+    }
+}
+
+bool VideoDecoder::enableAsync(AMediaCodec* codec) {
+    SetAsyncNotifyCallbackFn setCallback = loadSetAsyncNotifyCallback();
+    if (!setCallback) {
+        return false;
+    }
+
+    AMediaCodecOnAsyncNotifyCallback callback;
+    callback.onAsyncInputAvailable = &VideoDecoder::onInputAvailable;
+    callback.onAsyncOutputAvailable = &VideoDecoder::onOutputAvailable;
+    callback.onAsyncFormatChanged = &VideoDecoder::onFormatChanged;
+    callback.onAsyncError = &VideoDecoder::onError;
+    return setCallback(codec, callback, this) == AMEDIA_OK;
+}
+
+// Next free input buffer, from the codec or the callback queue
+ssize_t VideoDecoder::takeInput(int64_t timeoutUs) {
+    if (!async_) {
+        return AMediaCodec_dequeueInputBuffer(mediaCodec_, timeoutUs);
+    }
+
+    std::unique_lock<std::mutex> lock(inputMutex_);
+    if (inputCount_ == 0 && timeoutUs > 0) {
+        inputAvailable_.wait_for(lock, std::chrono::microseconds(timeoutUs),
+                                 [this] { return inputCount_ > 0; });
+    }
+    if (inputCount_ == 0) {
+        return -1;
+    }
+    const int32_t index = inputs_[inputHead_];
+    inputHead_ = (inputHead_ + 1) % MAX_INPUT_BUFFERS;
+    inputCount_--;
+    return index;
+}
+
+void VideoDecoder::onInputAvailable(AMediaCodec* codec, void* userdata, int32_t index) {
+    auto* self = static_cast<VideoDecoder*>(userdata);
+    {
+        std::lock_guard<std::mutex> lock(self->inputMutex_);
+        if (self->inputCount_ == MAX_INPUT_BUFFERS) {
+            LOGE("Input buffer queue full, dropping index %d", index);
+            return;
+        }
+        self->inputs_[(self->inputHead_ + self->inputCount_) % MAX_INPUT_BUFFERS] = index;
+        self->inputCount_++;
+    }
+    self->inputAvailable_.notify_one();
+}
+
+void VideoDecoder::onOutputAvailable(AMediaCodec* codec, void* userdata, int32_t index,
+                                     AMediaCodecBufferInfo* info) {
+    static_cast<VideoDecoder*>(userdata)->render(codec, static_cast<size_t>(index), *info);
+}
+
+void VideoDecoder::onFormatChanged(AMediaCodec* codec, void* userdata, AMediaFormat* format) {
+    LOGD("Output format changed");
+    // The callback owns the format copy
+    AMediaFormat_delete(format);
+}
+
+void VideoDecoder::onError(AMediaCodec* codec, void* userdata, media_status_t error,
+                           int32_t actionCode, const char* detail) {
+    auto* self = static_cast<VideoDecoder*>(userdata);
+    LOGE("Codec error %d (action %d): %s", error, actionCode, detail ? detail : "");
+    self->codecErrors_++;
+    self->waitingForKeyframe_.store(true, std::memory_order_relaxed);
+}
+
+uint8_t* VideoDecoder::dequeueInput(size_t& capacity) {
+    const ssize_t index = takeInput(0);
+    if (index < 0) {
+        return nullptr;
+    }
+    uint8_t* buffer = AMediaCodec_getInputBuffer(mediaCodec_, static_cast<size_t>(index), &capacity);
+    if (!buffer) {
+        AMediaCodec_queueInputBuffer(mediaCodec_, static_cast<size_t>(index), 0, 0, 0, 0);
+        return nullptr;
+    }
+    directIndex_ = index;
+    return buffer;
+}
+
+void VideoDecoder::queueInput(const VideoFrameInfo& info) {
+    if (directIndex_ < 0) {
+        return;
+    }
+    const size_t index = static_cast<size_t>(directIndex_);
+    directIndex_ = -1;
+    submit(index, info);
+}
+
+void VideoDecoder::submit(size_t index, const VideoFrameInfo& info) {
+    const bool config = (info.flags & VideoFrameInfo::FLAG_CONFIG) != 0;
+    const bool keyframe = (info.flags & VideoFrameInfo::FLAG_KEYFRAME) != 0;
+
+    size_t length = info.length;
+    uint32_t flags = config ? AMEDIACODEC_BUFFER_FLAG_CODEC_CONFIG : 0;
+    if (length > 0 && !config && waitingForKeyframe_.load(std::memory_order_relaxed)) {
+        if (keyframe) {
+            waitingForKeyframe_.store(false, std::memory_order_relaxed);
+            LOGI("Keyframe received, decoding");
+        } else {
+            // Can't decode without a reference frame, return the buffer empty
+            length = 0;
+            flags = 0;
+            framesSkipped_++;
+        }
+    }
+
+    // The arrival time comes back with the output buffer, for the latency spans
+    const uint64_t queuedUs = nowUs();
+    const uint64_t ptsUs = info.arrivalUs ? info.arrivalUs : queuedUs;
+    const media_status_t status = AMediaCodec_queueInputBuffer(mediaCodec_, index, 0, length, ptsUs, flags);
+    if (status != AMEDIA_OK) {
+        LOGE("queueInputBuffer failed (%d), waiting for keyframe", status);
+        codecErrors_++;
+        waitingForKeyframe_.store(true, std::memory_order_relaxed);
+    } else if (length > 0) {
+        framesQueued_++;
+        if (!config) {
+            newestQueuedUs_.store(ptsUs, std::memory_order_relaxed);
+            trackQueued(ptsUs, queuedUs, info.timestampUs);
+            if (stages_) {
+                (*stages_)[PipelineLatency::DECODE_FEED].record((queuedUs - ptsUs) * 1000);
+            }
+        }
+    }
+}
+
+void VideoDecoder::applyVendorLowLatency(AMediaCodec* codec, AMediaFormat* format) {
+    const CodecNameApi& api = codecNameApi();
+    char* name = nullptr;
+    if (!api.getName || api.getName(codec, &name) != AMEDIA_OK || !name) {
+        LOGD("Codec name not available, no vendor low latency keys");
+        return;
+    }
+
+    for (const VendorLowLatency& vendor : VENDOR_LOW_LATENCY) {
+        for (const char* prefix : vendor.prefixes) {
+            if (std::strncmp(name, prefix, std::strlen(prefix)) != 0) {
+                continue;
+            }
+            for (const VendorLowLatencyKey& key : vendor.keys) {
+                if (key.key) {
+                    AMediaFormat_setInt32(format, key.key, key.value);
+                }
+            }
+            LOGI("Vendor low latency keys set for %s", name);
+        }
+    }
+    if (api.releaseName) {
+        api.releaseName(codec, name);
+    }
+}
+
+// Called from AAP-Render or the codec's callback thread
+void VideoDecoder::render(AMediaCodec* codec, size_t index, const AMediaCodecBufferInfo& info) {
+    const uint64_t decodedUs = nowUs();
+    const uint64_t ptsUs = static_cast<uint64_t>(info.presentationTimeUs);
+    PendingFrame frame{};
+    const bool tracked = takePending(ptsUs, frame);
+
+    // Held until audio catches up, when there is audio to follow
+    int64_t presentNs = static_cast<int64_t>(decodedUs) * 1000;
+    bool scheduled = false;
+    if (clock_ && tracked && frame.timestampUs != 0) {
+        presentNs = clock_->schedule(frame.timestampUs, presentNs);
+        scheduled = presentNs > static_cast<int64_t>(decodedUs) * 1000;
+    }
+
+    // Frames held for audio are early by design, never late
+    const uint64_t budgetUs = lateBudgetUs_.load(std::memory_order_relaxed);
+    const uint64_t newestUs = newestQueuedUs_.load(std::memory_order_relaxed);
+    const bool late = budgetUs != 0 && !scheduled && newestUs > ptsUs + budgetUs;
+
+    uint64_t presentUs = decodedUs;
+    if (parked_.load(std::memory_order_acquire)) {
+        // Decoded before parking, nowhere to show it
+        AMediaCodec_releaseOutputBuffer(codec, index, false);
+    } else if (late) {
+        // Showing it would only delay the frames behind it
+        AMediaCodec_releaseOutputBuffer(codec, index, false);
+        framesLate_++;
+        return;
+    } else if (vsyncAligned_) {
+        // Display on the next vsync, a late frame then replaces an older one
+        presentNs = vsync_.nextVsync(presentNs);
+        AMediaCodec_releaseOutputBufferAtTime(codec, index, presentNs);
+        presentUs = static_cast<uint64_t>(presentNs / 1000);
+    } else if (scheduled) {
+        AMediaCodec_releaseOutputBufferAtTime(codec, index, presentNs);
+        presentUs = static_cast<uint64_t>(presentNs / 1000);
+    } else {
+        // Render immediately, lowest latency for a live stream
+        AMediaCodec_releaseOutputBuffer(codec, index, true);
+    }
+    framesRendered_++;
+
+    if (!tracked) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(latencyMutex_);
+    latency_.frames++;
+    latency_.queueLastUs = frame.queuedUs - frame.ptsUs;
+    latency_.decodeLastUs = decodedUs - frame.queuedUs;
+    latency_.presentLastUs = presentUs > decodedUs ? presentUs - decodedUs : 0;
+    latency_.queueTotalUs += latency_.queueLastUs;
+    latency_.decodeTotalUs += latency_.decodeLastUs;
+    latency_.presentTotalUs += latency_.presentLastUs;
+}
+
+// Find the queued frame an output buffer belongs to
+bool VideoDecoder::takePending(uint64_t ptsUs, PendingFrame& frame) {
+    std::lock_guard<std::mutex> lock(latencyMutex_);
+    // Frames ahead of this one were dropped by the codec, forget them
+    while (pendingCount_ > 0 && pending_[pendingHead_].ptsUs <= ptsUs) {
+        frame = pending_[pendingHead_];
+        pendingHead_ = (pendingHead_ + 1) % MAX_PENDING_FRAMES;
+        pendingCount_--;
+        if (frame.ptsUs == ptsUs) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void VideoDecoder::trackQueued(uint64_t ptsUs, uint64_t queuedUs, uint64_t timestampUs) {
+    std::lock_guard<std::mutex> lock(latencyMutex_);
+    if (pendingCount_ == MAX_PENDING_FRAMES) {
+        // Codec holding more frames than expected, give up on the oldest
+        pendingHead_ = (pendingHead_ + 1) % MAX_PENDING_FRAMES;
+        pendingCount_--;
+    }
+    pending_[(pendingHead_ + pendingCount_) % MAX_PENDING_FRAMES] = PendingFrame{ptsUs, queuedUs, timestampUs};
+    pendingCount_++;
+}
+
+VideoDecoder::Stats VideoDecoder::getStats() const {
+    Stats stats;
+    stats.framesQueued = framesQueued_.load(std::memory_order_relaxed);
+    stats.framesCopied = framesCopied_.load(std::memory_order_relaxed);
+    stats.framesSkipped = framesSkipped_.load(std::memory_order_relaxed);
+    stats.framesRendered = framesRendered_.load(std::memory_order_relaxed);
+    stats.codecErrors = codecErrors_.load(std::memory_order_relaxed);
+    stats.framesLate = framesLate_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+VideoDecoder::LatencyStats VideoDecoder::getLatencyStats() const {
+    std::lock_guard<std::mutex> lock(latencyMutex_);
+    return latency_;
+}
+
+} // namespace aap
@@ -0,0 +1,232 @@
+#pragma once
+
+#include "latency_histogram.h"
+#include "media_clock.h"
+#include "video_assembler.h"
+#include "vsync_clock.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <media/NdkMediaCodec.h>
+
+struct ANativeWindow;
+struct AImageReader;
+
+namespace aap {
+
+/**
+ * Hardware video decoder on the NDK AMediaCodec API.
+ *
+ * Attaches to a VideoAssembler as its frame target, so access units are
+ * reassembled directly in dequeued codec input buffers. Frames that found
+ * no free input buffer wait in the assembler's slots (drop-oldest) and
+ * are copied in by the AAP-Decode thread.
+ *
+ * On API 28+ the codec runs in async mode: input buffer callbacks and
+ * frame arrival wake AAP-Decode directly, and output buffers are rendered
+ * from the codec's callback thread. Older releases block in
+ * dequeueInputBuffer, with AAP-Render draining output buffers.
+ *
+ * The codec is configured from the assembler's parameter set cache as
+ * soon as SPS/PPS have been seen, then frames are skipped until the
+ * first keyframe.
+ *
+ * In low latency mode the vendor low latency keys of known decoders are
+ * set too, and output buffers are released for the next display vsync
+ * instead of whenever SurfaceFlinger picks them up. Each frame's USB
+ * arrival time is passed through the codec as its presentation time, so
+ * the time spent queued, decoding and waiting for display can be told
+ * apart in getLatencyStats().
+ *
+ * With a MediaClock set, each frame's media timestamp is kept alongside
+ * and its output buffer is released for the time audio reaches it, on the
+ * following vsync in low latency mode.
+ *
+ * An output buffer that arrived more than the late frame budget before
+ * the newest frame queued to the codec is released without rendering:
+ * after a hiccup the picture jumps to the present instead of playing the
+ * backlog and staying behind. Every frame is still decoded, so the
+ * references of the frames after it are intact.
+ *
+ * The codec outlives the surface: park() moves its output to an offscreen
+ * placeholder window and skips frames, start() with the next surface
+ * switches the output back and replays the assembler's cached keyframe,
+ * so the picture is back one decode after the surface is. prepare() starts
+ * parked, configuring the codec as soon as the handshake brought parameter
+ * sets. The placeholder needs API 26 and switching outputs API 23, without
+ * them park() stops the decoder and prepare() does nothing.
+ */
+class VideoDecoder : public VideoFrameTarget {
+public:
+    // Six frames at 30 fps, well above what a decoder holds in steady state
+    static constexpr uint64_t DEFAULT_LATE_BUDGET_US = 200000;
+
+    explicit VideoDecoder(VideoAssembler& assembler, VideoCodec codec = VideoCodec::H264);
+    ~VideoDecoder() override;
+
+    // Non-copyable
+    VideoDecoder(const VideoDecoder&) = delete;
+    VideoDecoder& operator=(const VideoDecoder&) = delete;
+
+    /**
+     * Start decoding to a window.
+     * @param window Output surface; the decoder takes its own reference
+     * @param lowLatency Set vendor low latency keys and render on vsync
+     * @return false if already running
+     */
+    bool start(ANativeWindow* window, int width, int height, bool lowLatency = false);
+
+    /**
+     * Start parked, with the codec configured before any surface exists.
+     * @return false if already running or no placeholder window is available
+     */
+    bool prepare(int width, int height, bool lowLatency = false);
+
+    /**
+     * Let go of the surface but keep the codec, until start() brings a new one.
+     */
+    void park();
+
+    /**
+     * Detach from the assembler, stop the threads and release the codec.
+     */
+    void stop();
+
+    bool isRunning() const { return running_.load(std::memory_order_acquire); }
+    bool isParked() const { return parked_.load(std::memory_order_acquire); }
+
+    /**
+     * Record the DECODE_FEED stage. Must be called before start().
+     */
+    void setLatency(PipelineLatency* latency) { stages_ = latency; }
+
+    /**
+     * Schedule frames against clock, nullptr to render them as decoded.
+     * Must be called before start().
+     */
+    void setClock(MediaClock* clock) { clock_ = clock; }
+
+    /**
+     * Largest lag behind the newest queued frame a frame is still shown
+     * at, 0 to render every frame. May be called at any time.
+     */
+    void setLateFrameBudget(uint64_t budgetUs) { lateBudgetUs_.store(budgetUs, std::memory_order_relaxed); }
+
+    /**
+     * Check if the codec callbacks are used, false before API 28.
+     */
+    bool isAsync() const { return async_; }
+
+    // VideoFrameTarget, called from the assembler's producer thread
+    uint8_t* dequeueInput(size_t& capacity) override;
+    void queueInput(const VideoFrameInfo& info) override;
+
+    struct Stats {
+        uint64_t framesQueued;      // Submitted to the codec
+        uint64_t framesCopied;      // Of those, copied in from an assembler slot
+        uint64_t framesSkipped;     // Before configuration, while parked or waiting for a keyframe
+        uint64_t framesRendered;
+        uint64_t codecErrors;
+        uint64_t framesLate;        // Decoded, not rendered, too far behind the newest frame
+    };
+    Stats getStats() const;
+
+    /**
+     * Per-frame latency spans: USB arrival -> queued to the codec ->
+     * decoded -> presented. Totals let callers average over an interval.
+     */
+    struct LatencyStats {
+        uint64_t frames;
+        uint64_t queueTotalUs;      // Arrival until queued to the codec
+        uint64_t decodeTotalUs;     // Queued until the output buffer is available
+        uint64_t presentTotalUs;    // Output until the vsync it was released for
+        uint64_t queueLastUs;
+        uint64_t decodeLastUs;
+        uint64_t presentLastUs;
+    };
+    LatencyStats getLatencyStats() const;
+
+private:
+    VideoAssembler& assembler_;
+    VideoCodec codec_;
+    AMediaCodec* mediaCodec_ = nullptr;
+    ANativeWindow* window_ = nullptr;       // The surface, or placeholder_ while parked
+    AImageReader* placeholderReader_ = nullptr;
+    ANativeWindow* placeholder_ = nullptr;  // Owned by placeholderReader_
+    // Held to change window_, or mediaCodec_ and the frame target in configure()
+    std::mutex surfaceMutex_;
+    std::atomic<bool> parked_{false};
+    int width_ = 0;
+    int height_ = 0;
+    bool lowLatency_ = false;
+    bool vsyncAligned_ = false;
+    VsyncClock vsync_;
+
+    std::thread inputThread_;
+    std::thread outputThread_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> waitingForKeyframe_{true};
+
+    // Producer side only
+    ssize_t directIndex_ = -1;
+
+    // Async mode: input buffers announced by the codec, not yet taken
+    static constexpr size_t MAX_INPUT_BUFFERS = 64;
+    bool async_ = false;
+    std::mutex inputMutex_;
+    std::condition_variable inputAvailable_;
+    int32_t inputs_[MAX_INPUT_BUFFERS];
+    size_t inputHead_ = 0;
+    size_t inputCount_ = 0;
+
+    std::atomic<uint64_t> framesQueued_{0};
+    std::atomic<uint64_t> framesCopied_{0};
+    std::atomic<uint64_t> framesSkipped_{0};
+    std::atomic<uint64_t> framesRendered_{0};
+    std::atomic<uint64_t> codecErrors_{0};
+    std::atomic<uint64_t> framesLate_{0};
+    std::atomic<uint64_t> lateBudgetUs_{DEFAULT_LATE_BUDGET_US};
+    // Presentation time of the last frame queued, the present for late frames
+    std::atomic<uint64_t> newestQueuedUs_{0};
+    PipelineLatency* stages_ = nullptr;
+    MediaClock* clock_ = nullptr;
+
+    // Frames in the codec, by presentation time (their arrival time)
+    struct PendingFrame {
+        uint64_t ptsUs;
+        uint64_t queuedUs;
+        uint64_t timestampUs;   // Media timestamp, for the clock
+    };
+    static constexpr size_t MAX_PENDING_FRAMES = 32;
+    mutable std::mutex latencyMutex_;
+    PendingFrame pending_[MAX_PENDING_FRAMES];
+    size_t pendingHead_ = 0;
+    size_t pendingCount_ = 0;
+    LatencyStats latency_{};
+
+    bool run(ANativeWindow* window, int width, int height, bool lowLatency);
+    bool resume(ANativeWindow* window);
+    bool createPlaceholder(int width, int height);
+    void releasePlaceholder();
+    void inputLoop();
+    void outputLoop();
+    bool configure();
+    bool enableAsync(AMediaCodec* codec);
+    ssize_t takeInput(int64_t timeoutUs);
+    void submit(size_t index, const VideoFrameInfo& info);
+    void applyVendorLowLatency(AMediaCodec* codec, AMediaFormat* format);
+    void render(AMediaCodec* codec, size_t index, const AMediaCodecBufferInfo& info);
+    void trackQueued(uint64_t ptsUs, uint64_t queuedUs, uint64_t timestampUs);
+    bool takePending(uint64_t ptsUs, PendingFrame& frame);
+
+    // AMediaCodecOnAsyncNotifyCallback
+    static void onInputAvailable(AMediaCodec* codec, void* userdata, int32_t index);
+    static void onOutputAvailable(AMediaCodec* codec, void* userdata, int32_t index,
+                                  AMediaCodecBufferInfo* info);
+    static void onFormatChanged(AMediaCodec* codec, void* userdata, AMediaFormat* format);
+    static void onError(AMediaCodec* codec, void* userdata, media_status_t error, int32_t actionCode,
+                        const char* detail);
+};
+
+} // namespace aap
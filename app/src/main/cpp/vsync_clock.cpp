@@ -0,0 +1,146 @@
+#include "vsync_clock.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <android/looper.h>
+#include <dlfcn.h>
+#include <pthread.h>
+
+#define LOG_TAG "VsyncClock"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+struct AChoreographer;
+using FrameCallback = void (*)(long frameTimeNanos, void* data);
+using FrameCallback64 = void (*)(int64_t frameTimeNanos, void* data);
+
+// Resolved at runtime: AChoreographer is API 24, the 64-bit callback API 29
+struct ChoreographerApi {
+    AChoreographer* (*getInstance)() = nullptr;
+    void (*postFrameCallback)(AChoreographer*, FrameCallback, void*) = nullptr;
+    void (*postFrameCallback64)(AChoreographer*, FrameCallback64, void*) = nullptr;
+};
+
+const ChoreographerApi& choreographerApi() {
+    static const ChoreographerApi api = [] {
+        ChoreographerApi result;
+        void* lib = dlopen("libandroid.so", RTLD_NOW);
+        if (lib) {
+            result.getInstance = reinterpret_cast<AChoreographer* (*)()>(
+                    dlsym(lib, "AChoreographer_getInstance"));
+            result.postFrameCallback = reinterpret_cast<void (*)(AChoreographer*, FrameCallback, void*)>(
+                    dlsym(lib, "AChoreographer_postFrameCallback"));
+            result.postFrameCallback64 = reinterpret_cast<void (*)(AChoreographer*, FrameCallback64, void*)>(
+                    dlsym(lib, "AChoreographer_postFrameCallback64"));
+        }
+        return result;
+    }();
+    return api;
+}
+
+// Bounds for a plausible refresh interval, 24Hz to 240Hz
+constexpr int64_t MIN_PERIOD_NS = 4000000;
+constexpr int64_t MAX_PERIOD_NS = 42000000;
+
+} // anonymous namespace
+
+VsyncClock::~VsyncClock() {
+    stop();
+}
+
+bool VsyncClock::start() {
+    const ChoreographerApi& api = choreographerApi();
+    if (!api.getInstance || (!api.postFrameCallback && !api.postFrameCallback64)) {
+        LOGD("AChoreographer not available");
+        return false;
+    }
+    if (running_.exchange(true)) {
+        return true;
+    }
+    thread_ = std::thread(&VsyncClock::run, this);
+    return true;
+}
+
+void VsyncClock::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    ALooper* looper = looper_.load(std::memory_order_acquire);
+    if (looper) {
+        ALooper_wake(looper);
+    }
+    if (thread_.joinable()) thread_.join();
+    lastVsyncNs_.store(0, std::memory_order_relaxed);
+}
+
+void VsyncClock::run() {
+    applyThreadPolicy("AAP-Vsync");
+
+    // AChoreographer delivers callbacks on the looper of the calling thread
+    ALooper* looper = ALooper_prepare(0);
+    looper_.store(looper, std::memory_order_release);
+    postCallback();
+
+    while (running_.load(std::memory_order_acquire)) {
+        ALooper_pollOnce(-1, nullptr, nullptr, nullptr);
+    }
+    looper_.store(nullptr, std::memory_order_release);
+}
+
+void VsyncClock::postCallback() {
+    const ChoreographerApi& api = choreographerApi();
+    AChoreographer* choreographer = api.getInstance();
+    if (!choreographer) {
+        LOGE("No choreographer for this thread");
+        return;
+    }
+    // The 32-bit callback truncates frame times on 32-bit ABIs
+    if (api.postFrameCallback64) {
+        api.postFrameCallback64(choreographer, &VsyncClock::onFrame64, this);
+    } else {
+        api.postFrameCallback(choreographer, &VsyncClock::onFrame, this);
+    }
+}
+
+void VsyncClock::onFrame(long frameTimeNanos, void* data) {
+    static_cast<VsyncClock*>(data)->onVsync(static_cast<int64_t>(frameTimeNanos));
+}
+
+void VsyncClock::onFrame64(int64_t frameTimeNanos, void* data) {
+    static_cast<VsyncClock*>(data)->onVsync(frameTimeNanos);
+}
+
+void VsyncClock::onVsync(int64_t frameTimeNs) {
+    const int64_t last = lastVsyncNs_.load(std::memory_order_relaxed);
+    if (last > 0) {
+        const int64_t delta = frameTimeNs - last;
+        if (delta >= MIN_PERIOD_NS && delta <= MAX_PERIOD_NS) {
+            // Smooth out scheduling noise, 1/8 weight for the new sample
+            const int64_t period = periodNs_.load(std::memory_order_relaxed);
+            periodNs_.store(period + (delta - period) / 8, std::memory_order_relaxed);
+        }
+    }
+    lastVsyncNs_.store(frameTimeNs, std::memory_order_relaxed);
+
+    if (running_.load(std::memory_order_acquire)) {
+        postCallback();
+    }
+}
+
+int64_t VsyncClock::nextVsync(int64_t timeNs) const {
+    const int64_t last = lastVsyncNs_.load(std::memory_order_relaxed);
+    const int64_t period = periodNs_.load(std::memory_order_relaxed);
+    if (last == 0 || period <= 0) {
+        return timeNs;
+    }
+    if (timeNs <= last) {
+        return last;
+    }
+    const int64_t periods = (timeNs - last + period - 1) / period;
+    return last + periods * period;
+}
+
+} // namespace aap
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+struct ALooper;
+
+namespace aap {
+
+/**
+ * Tracks display vsync with AChoreographer on its own looper thread
+ * (AAP-Vsync), so output buffers can be released for a specific frame.
+ *
+ * AChoreographer needs API 24; on older releases start() fails and
+ * callers render immediately instead.
+ */
+class VsyncClock {
+public:
+    VsyncClock() = default;
+    ~VsyncClock();
+
+    // Non-copyable
+    VsyncClock(const VsyncClock&) = delete;
+    VsyncClock& operator=(const VsyncClock&) = delete;
+
+    /**
+     * @return false if AChoreographer isn't available
+     */
+    bool start();
+    void stop();
+
+    /**
+     * First vsync at or after timeNs (CLOCK_MONOTONIC), or timeNs if
+     * no vsync has been seen yet.
+     */
+    int64_t nextVsync(int64_t timeNs) const;
+
+    int64_t periodNs() const { return periodNs_.load(std::memory_order_relaxed); }
+
+private:
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    std::atomic<ALooper*> looper_{nullptr};
+    std::atomic<int64_t> lastVsyncNs_{0};
+    std::atomic<int64_t> periodNs_{16666667};
+
+    void run();
+    void postCallback();
+    void onVsync(int64_t frameTimeNs);
+
+    static void onFrame(long frameTimeNanos, void* data);
+    static void onFrame64(int64_t frameTimeNanos, void* data);
+};
+
+} // namespace aap
@@ -0,0 +1,234 @@
+#include "work_stealing_pool.h"
+#include "futex.h"
+#include "thread_policy.h"
+#include <android/log.h>
+#include <algorithm>
+
+#define LOG_TAG "WorkStealingPool"
+#define LOGD(...) __android_log_print(ANDROID_LOG_DEBUG, LOG_TAG, __VA_ARGS__)
+#define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
+
+namespace aap {
+
+namespace {
+
+// Rounds of looking for work before a worker parks
+constexpr int SPIN_ROUNDS = 64;
+
+size_t roundUpPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+} // anonymous namespace
+
+WorkDeque::WorkDeque(size_t capacity)
+    : tasks_(new std::atomic<PoolTask*>[roundUpPowerOfTwo(std::max<size_t>(capacity, 1))])
+    , mask_(static_cast<int64_t>(roundUpPowerOfTwo(std::max<size_t>(capacity, 1))) - 1)
+{
+    for (int64_t i = 0; i <= mask_; i++) {
+        tasks_[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+bool WorkDeque::push(PoolTask* task) {
+    const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    const int64_t top = top_.load(std::memory_order_acquire);
+    if (bottom - top > mask_) {
+        return false;
+    }
+    tasks_[bottom & mask_].store(task, std::memory_order_relaxed);
+    // Publishes the task before the new bottom, for stealers
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+}
+
+PoolTask* WorkDeque::pop() {
+    const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(bottom, std::memory_order_relaxed);
+    // The lowered bottom must be visible before top is read: a stealer
+    // either sees it and backs off, or wins the last task's CAS below
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+    if (top > bottom) {
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    PoolTask* task = tasks_[bottom & mask_].load(std::memory_order_relaxed);
+    if (top == bottom) {
+        // Last task, race the stealers for it
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            task = nullptr;
+        }
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+PoolTask* WorkDeque::steal() {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom) {
+        return nullptr;
+    }
+
+    PoolTask* task = tasks_[top & mask_].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+        return nullptr; // Lost to the owner or another stealer
+    }
+    return task;
+}
+
+bool WorkDeque::empty() const {
+    return top_.load(std::memory_order_acquire) >= bottom_.load(std::memory_order_acquire);
+}
+
+WorkStealingPool::WorkStealingPool(size_t workers, size_t injectors, size_t maxTasks, const char* threadName)
+    : threadName_(threadName)
+{
+    const size_t count = std::min(std::max<size_t>(workers, 1), MAX_WORKERS);
+    for (size_t i = 0; i < count; i++) {
+        workers_.push_back(std::make_unique<Worker>(maxTasks));
+    }
+    for (size_t i = 0; i < injectors; i++) {
+        injectors_.push_back(std::make_unique<WorkDeque>(maxTasks));
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    stop();
+}
+
+void WorkStealingPool::setCpuShare(int share, int shares) {
+    cpuShare_ = share;
+    cpuShares_ = shares;
+}
+
+void WorkStealingPool::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    for (size_t i = 0; i < workers_.size(); i++) {
+        workers_[i]->thread = std::thread(&WorkStealingPool::workerLoop, this, i);
+    }
+    LOGD("%s pool started, %zu workers", threadName_, workers_.size());
+}
+
+void WorkStealingPool::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    wakeSeq_.fetch_add(1, std::memory_order_release);
+    futexWake(wakeSeq_);
+    for (auto& worker : workers_) {
+        if (worker->thread.joinable()) {
+            worker->thread.join();
+        }
+    }
+    LOGD("%s pool stopped", threadName_);
+}
+
+void WorkStealingPool::submit(size_t injector, PoolTask* task) {
+    if (injector >= injectors_.size() || !injectors_[injector]->push(task)) {
+        LOGE("submit: injector %zu rejected a task, more than maxTasks queued", injector);
+        return;
+    }
+
+    // Pairs with the fence in workerLoop(): either a parking worker sees
+    // the task, or this sees it counted as a sleeper
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) > 0) {
+        wakeSeq_.fetch_add(1, std::memory_order_release);
+        futexWake(wakeSeq_, 1);
+    }
+}
+
+PoolTask* WorkStealingPool::find(size_t index, bool yielded) {
+    WorkDeque& own = workers_[index]->deque;
+    // A task that just yielded waits until what is queued elsewhere is taken
+    if (!yielded) {
+        if (PoolTask* task = own.pop()) {
+            return task;
+        }
+    }
+
+    const size_t injectors = injectors_.size();
+    for (size_t i = 0; i < injectors; i++) {
+        if (PoolTask* task = injectors_[(index + i) % injectors]->steal()) {
+            return task;
+        }
+    }
+    const size_t workers = workers_.size();
+    for (size_t i = 1; i < workers; i++) {
+        if (PoolTask* task = workers_[(index + i) % workers]->deque.steal()) {
+            return task;
+        }
+    }
+    return yielded ? own.pop() : nullptr;
+}
+
+bool WorkStealingPool::hasWork() const {
+    for (const auto& injector : injectors_) {
+        if (!injector->empty()) {
+            return true;
+        }
+    }
+    for (const auto& worker : workers_) {
+        if (!worker->deque.empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(size_t index) {
+    applyThreadPolicy(threadName_, cpuShare_, cpuShares_);
+
+    WorkDeque& own = workers_[index]->deque;
+    bool yielded = false;
+    int idleRounds = 0;
+    while (true) {
+        if (PoolTask* task = find(index, yielded)) {
+            idleRounds = 0;
+            yielded = false;
+            // The deque only fills up if a task is queued twice; run it
+            // again rather than lose it
+            while (task->run()) {
+                if (own.push(task)) {
+                    yielded = true;
+                    break;
+                }
+            }
+            continue;
+        }
+        yielded = false;
+
+        // Whatever was queued when stop() was called has been run
+        if (!running_.load(std::memory_order_acquire)) {
+            break;
+        }
+        if (++idleRounds < SPIN_ROUNDS) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        sleepers_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const uint32_t seq = wakeSeq_.load(std::memory_order_acquire);
+        if (!hasWork() && running_.load(std::memory_order_acquire)) {
+            futexWait(wakeSeq_, seq);
+        }
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        idleRounds = 0;
+    }
+}
+
+} // namespace aap
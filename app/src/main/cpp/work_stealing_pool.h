@@ -0,0 +1,140 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace aap {
+
+/**
+ * Unit of work for WorkStealingPool. A task is queued at most once at a
+ * time: it is submitted again only after run() returned false, or by
+ * returning true from run().
+ */
+class PoolTask {
+public:
+    virtual ~PoolTask() = default;
+
+    /**
+     * Run on a pool worker.
+     * @return true to be queued again behind the work already waiting
+     */
+    virtual bool run() = 0;
+};
+
+/**
+ * Chase-Lev work-stealing deque of task pointers with a fixed capacity.
+ * The owner pushes and pops at the bottom, any thread steals from the top.
+ * Pushes must be ordered with each other, not necessarily on one thread.
+ */
+class WorkDeque {
+public:
+    /**
+     * @param capacity Tasks queued at once, rounded up to a power of two
+     */
+    explicit WorkDeque(size_t capacity);
+
+    // Non-copyable
+    WorkDeque(const WorkDeque&) = delete;
+    WorkDeque& operator=(const WorkDeque&) = delete;
+
+    /**
+     * Owner side.
+     * @return false if the deque is full
+     */
+    bool push(PoolTask* task);
+
+    /**
+     * Owner side: newest task first.
+     */
+    PoolTask* pop();
+
+    /**
+     * Any thread: oldest task first. May return null while a task is
+     * queued if another thread took it at the same time.
+     */
+    PoolTask* steal();
+
+    bool empty() const;
+
+private:
+    std::unique_ptr<std::atomic<PoolTask*>[]> tasks_;
+    const int64_t mask_;
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+};
+
+/**
+ * Small pool of threads sharing work through per-worker WorkDeques.
+ *
+ * Producers outside the pool submit into injectors, one WorkDeque per
+ * producer that workers steal from; a task that yields goes back onto
+ * its worker's own deque, where idle workers steal it in turn. Workers
+ * with nothing to do park on a futex after a short spin.
+ */
+class WorkStealingPool {
+public:
+    static constexpr size_t MAX_WORKERS = 8;
+
+    /**
+     * @param workers Threads, clamped to 1..MAX_WORKERS
+     * @param injectors Producers, each with its own submit() index
+     * @param maxTasks Tasks that may be queued at once across the pool
+     * @param threadName Every worker's name and thread policy
+     */
+    WorkStealingPool(size_t workers, size_t injectors, size_t maxTasks, const char* threadName);
+    ~WorkStealingPool();
+
+    // Non-copyable
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    /**
+     * Run the workers on share of shares slices of their CPUs, see
+     * applyThreadPolicy(). Must be called before start().
+     */
+    void setCpuShare(int share, int shares);
+
+    void start();
+
+    /**
+     * Run what is still queued, then stop the workers. Producers must
+     * have stopped submitting.
+     */
+    void stop();
+
+    /**
+     * Queue a task. Calls for one injector must be ordered with each
+     * other, as if from a single producer thread.
+     */
+    void submit(size_t injector, PoolTask* task);
+
+    size_t workerCount() const { return workers_.size(); }
+
+private:
+    struct Worker {
+        explicit Worker(size_t capacity) : deque(capacity) {}
+        WorkDeque deque;
+        std::thread thread;
+    };
+
+    const char* const threadName_;
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::unique_ptr<WorkDeque>> injectors_;
+    int cpuShare_ = 0;
+    int cpuShares_ = 1;
+
+    std::atomic<bool> running_{false};
+    // Workers park on wakeSeq_, submit() only wakes when one sleeps
+    alignas(64) std::atomic<uint32_t> wakeSeq_{0};
+    std::atomic<uint32_t> sleepers_{0};
+
+    void workerLoop(size_t index);
+    PoolTask* find(size_t index, bool yielded);
+    bool hasWork() const;
+};
+
+} // namespace aap
@@ -6,6 +6,7 @@ import info.anodsplace.headunit.utils.AppLog
 import android.app.NotificationChannel
 import android.app.NotificationManager
 import android.os.Build
+import info.anodsplace.headunit.connection.DeviceCalibration
 import org.conscrypt.Conscrypt
 import java.io.File
 import java.security.Security
@@ -32,6 +33,9 @@ class App : Application() {
         } else {
             registerReceiver(AapBroadcastReceiver(), AapBroadcastReceiver.filter)
         }
+
+        // First launch or a new OS build: tune the pipeline to this device
+        DeviceCalibration(component.settings).runIfNeeded()
     }
 
     companion object {
@@ -2,10 +2,15 @@ package info.anodsplace.headunit
 
 import android.app.Application
 import android.media.AudioManager
+import android.os.Handler
+import android.os.Looper
 import androidx.localbroadcastmanager.content.LocalBroadcastManager
 import info.anodsplace.headunit.aap.AapTransport
+import info.anodsplace.headunit.contract.DisconnectIntent
 import info.anodsplace.headunit.decoder.AudioDecoder
+import info.anodsplace.headunit.decoder.MemoryProfile
 import info.anodsplace.headunit.decoder.VideoDecoderController
+import info.anodsplace.headunit.utils.AppLog
 import info.anodsplace.headunit.utils.Settings
 
 class AppComponent(private val app: App) {
@@ -26,16 +31,65 @@ class AppComponent(private val app: App) {
         }
 
     val settings = Settings(app)
-    val videoDecoderController = VideoDecoderController()
+    val videoDecoderController = VideoDecoderController { MemoryProfile.forSettings(settings) }
     val audioDecoder = AudioDecoder()
 
-    fun resetTransport() {
-        _transport?.quit()
+    private val mainHandler = Handler(Looper.getMainLooper())
+    private val mediaTeardown = Runnable { stopMedia("reconnect window expired") }
+
+    /**
+     * Media kept for a reconnect by [holdMedia], until [resumeMedia] or [stopMedia].
+     */
+    @Volatile var isHoldingMedia = false
+        private set
+
+    fun resetTransport(holdMedia: Boolean = false) {
+        _transport?.quit(holdMedia)
         _transport = null
     }
 
+    /**
+     * The transport went away mid-session, e.g. a cable bump. Decoders, audio
+     * tracks and the projection activity are torn down only if no connection
+     * resumes them within [RECONNECT_WINDOW_MS], so projection comes back
+     * with the next IDR instead of restarting the whole pipeline.
+     */
+    fun holdMedia() {
+        if (!isHoldingMedia) {
+            AppLog.i { "Holding media for ${RECONNECT_WINDOW_MS}ms for a reconnect" }
+        }
+        isHoldingMedia = true
+        mainHandler.removeCallbacks(mediaTeardown)
+        mainHandler.postDelayed(mediaTeardown, RECONNECT_WINDOW_MS)
+    }
+
+    /**
+     * A new transport took over the held media.
+     */
+    fun resumeMedia() {
+        mainHandler.removeCallbacks(mediaTeardown)
+        if (isHoldingMedia) {
+            isHoldingMedia = false
+            AppLog.i { "Reconnected, media kept" }
+        }
+    }
+
+    fun stopMedia(reason: String) {
+        mainHandler.removeCallbacks(mediaTeardown)
+        isHoldingMedia = false
+        // Use LocalBroadcastManager for reliability
+        localBroadcastManager.sendBroadcast(DisconnectIntent())
+        audioDecoder.stop()
+        videoDecoderController.stop(reason)
+    }
+
     private val audioManager: AudioManager
         get() = app.getSystemService(Application.AUDIO_SERVICE) as AudioManager
 
     val localBroadcastManager = LocalBroadcastManager.getInstance(app)
+
+    companion object {
+        // Re-enumeration, accessory mode and a resumed handshake fit in this
+        const val RECONNECT_WINDOW_MS = 5000L
+    }
 }
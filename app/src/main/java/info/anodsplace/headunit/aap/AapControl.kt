@@ -83,7 +83,8 @@ internal class AapControlMedia (
 
     private fun mediaSinkStopRequest(channel: Int): Int {
         AppLog.i { "Media Sink Stop Request: " + Channel.name(channel) }
-        if (Channel.isAudio(channel)) {
+        // Played natively, the channel has no track on AapAudio
+        if (Channel.isAudio(channel) && !aapTransport.stopAudioOutput(channel)) {
             aapAudio.stopAudio(channel)
         }
         return 0
@@ -105,8 +106,11 @@ internal class AapControlMedia (
             aapTransport.send(AapMessage(Channel.ID_MIC, Media.MediaMsgType.MICRESPONSE_VALUE, response))
             AppLog.i { "Mic opened, session ID: $sessionId" }
             
-            micRecorder.start()
+            if (!aapTransport.startMic()) {
+                micRecorder.start()
+            }
         } else {
+            aapTransport.stopMic()
             micRecorder.stop()
             AppLog.i { "Mic closed" }
         }
@@ -228,6 +232,10 @@ internal class AapControlService(
 
     private fun pingRequest(request: Control.PingRequest, channel: Int): Int {
         AppLog.i { "Ping Request: ${request.timestamp}" }
+        if (aapTransport.nativeKeepalive) {
+            // Already answered natively, right after it was decrypted
+            return 0
+        }
 
         // Channel Open Response
         val response = Control.PingResponse.newBuilder()
@@ -8,12 +8,24 @@ import info.anodsplace.headunit.aap.protocol.MsgType
 import info.anodsplace.headunit.utils.bytesToHex
 
 open class AapMessage(
-        internal val channel: Int,
-        internal val flags: Byte,
-        internal val type: Int,
+        channel: Int,
+        flags: Byte,
+        type: Int,
         internal val dataOffset: Int,
-        internal val size: Int,
-        val data: ByteArray) {
+        size: Int,
+        data: ByteArray) {
+
+    // Only reassigned when a recycled incoming message moves to the next record
+    internal var channel = channel
+        private set
+    internal var flags = flags
+        private set
+    internal var type = type
+        private set
+    internal var size = size
+        private set
+    var data = data
+        private set
 
     constructor(channel: Int, type: Int, proto: MessageLite, buf: ByteArray = ByteArray(size(proto)))
             : this(channel, flags(channel, type), type, HEADER_SIZE + MsgType.SIZE, size(proto), buf) {
@@ -38,6 +50,17 @@ open class AapMessage(
         return builder
     }
 
+    /**
+     * Point this message at another record, see AapMessageIncoming.recycle().
+     */
+    protected fun reuse(channel: Int, flags: Byte, type: Int, size: Int, data: ByteArray) {
+        this.channel = channel
+        this.flags = flags
+        this.type = type
+        this.size = size
+        this.data = data
+    }
+
     private fun toByteArray(msg: MessageLite, data: ByteArray, offset: Int, length: Int) {
         val output = CodedOutputStream.newInstance(data, offset, length)
         msg.writeTo(output)
@@ -4,7 +4,23 @@ import info.anodsplace.headunit.aap.protocol.Channel
 import info.anodsplace.headunit.aap.protocol.MsgType
 import info.anodsplace.headunit.utils.AppLog
 
-internal class AapMessageIncoming(header: EncryptedHeader, data: ByteArray) : AapMessage(header.chan, header.flags.toByte(), Utils.bytesToInt(data, 0, true), calcOffset(), data.size, data) {
+internal class AapMessageIncoming(channel: Int, flags: Byte, type: Int, size: Int, data: ByteArray) : AapMessage(channel, flags, type, calcOffset(), size, data) {
+
+    constructor(header: EncryptedHeader, data: ByteArray) : this(header.chan, header.flags.toByte(), Utils.bytesToInt(data, 0, true), data.size, data)
+
+    /**
+     * Reuse this message for the next record, instead of allocating one per
+     * record: a thread that delivers records one at a time keeps a single
+     * message from recycled(). Handlers run before the next record arrives
+     * and must not keep the message or its data, which may be larger than
+     * size. The payload is still only parsed by the handler that needs it.
+     * @param type msg_type, as read natively; -1 if the record has none
+     */
+    fun recycle(channel: Int, flags: Int, type: Int, data: ByteArray, length: Int): AapMessageIncoming {
+        reuse(channel, flags.toByte(), type, length, data)
+        return this
+    }
+
     internal class EncryptedHeader {
         var chan: Int = 0
         var flags: Int = 0
@@ -26,7 +42,23 @@ internal class AapMessageIncoming(header: EncryptedHeader, data: ByteArray) : Aa
 
     }
 
+    /**
+     * A recycled message per channel, for records that one thread at a time
+     * delivers per channel while channels may be delivered concurrently.
+     * Unknown channel ids share one.
+     */
+    internal class ChannelMessages {
+        private val messages = Array(CHANNELS + 1) { recycled() }
+
+        fun recycle(channel: Int, flags: Int, type: Int, data: ByteArray, length: Int): AapMessageIncoming {
+            val index = if (channel in 0 until CHANNELS) channel else CHANNELS
+            return messages[index].recycle(channel, flags, type, data, length)
+        }
+    }
+
     companion object {
+        private const val CHANNELS = Channel.ID_PHONE + 1
+
         fun decrypt(header: EncryptedHeader, offset: Int, buf: ByteArray, ssl: AapSsl): AapMessage? {
             if (header.flags and 0x08 != 0x08) {
                 AppLog.e { "WRONG FLAG: enc_len: ${header.enc_len}  chan: ${header.chan} ${Channel.name(header.chan)} flags: 0x${header.flags.toString(16)}  msg_type: 0x${header.msg_type.toString(16)} ${MsgType.name(header.msg_type, header.chan)}" }
@@ -41,6 +73,22 @@ internal class AapMessageIncoming(header: EncryptedHeader, data: ByteArray) : Aa
             return msg
         }
 
+        /**
+         * An empty message for recycle().
+         */
+        fun recycled(): AapMessageIncoming {
+            return AapMessageIncoming(0, 0, -1, 0, EMPTY)
+        }
+
+        /**
+         * msg_type of a record read into a reused buffer, -1 if it has none.
+         */
+        fun msgType(data: ByteArray, length: Int): Int {
+            return if (length >= MsgType.SIZE) Utils.bytesToInt(data, 0, true) else -1
+        }
+
+        private val EMPTY = ByteArray(0)
+
         fun calcOffset(): Int {
             return 2
         }
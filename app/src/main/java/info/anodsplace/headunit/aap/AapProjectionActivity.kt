@@ -12,7 +12,6 @@ import android.view.SurfaceHolder
 
 import info.anodsplace.headunit.App
 import info.anodsplace.headunit.aap.protocol.messages.TouchEvent
-import info.anodsplace.headunit.aap.protocol.messages.VideoFocusEvent
 import info.anodsplace.headunit.app.SurfaceActivity
 import info.anodsplace.headunit.utils.AppLog
 import info.anodsplace.headunit.utils.IntentFilters
@@ -22,6 +21,8 @@ class AapProjectionActivity : SurfaceActivity(), SurfaceHolder.Callback {
     // Pre-allocated list for touch pointer data - avoids GC on every touch event
     // Max 10 pointers is more than enough for any multi-touch scenario
     private val pointerDataPool = ArrayList<Triple<Int, Int, Int>>(10)
+    // (id, x, y) per pointer for the native touch fast path
+    private val pointerValues = IntArray(30)
 
     private val disconnectReceiver = object : BroadcastReceiver() {
         override fun onReceive(context: Context, intent: Intent) {
@@ -76,11 +77,11 @@ class AapProjectionActivity : SurfaceActivity(), SurfaceHolder.Callback {
     }
 
     override fun surfaceChanged(holder: SurfaceHolder, format: Int, width: Int, height: Int) {
-        transport.send(VideoFocusEvent(gain = true, unsolicited = false))
+        transport.setVideoFocus(true)
     }
 
     override fun surfaceDestroyed(holder: SurfaceHolder) {
-        transport.send(VideoFocusEvent(gain = false, unsolicited = false))
+        transport.setVideoFocus(false)
     }
 
     private fun sendTouchEvent(event: MotionEvent) {
@@ -105,14 +106,27 @@ class AapProjectionActivity : SurfaceActivity(), SurfaceHolder.Callback {
         val scaleX = screen.width.toFloat() / viewWidth
         val scaleY = screen.height.toFloat() / viewHeight
 
-        // Reuse pre-allocated list to avoid GC pressure on Android 4.3
-        pointerDataPool.clear()
-        repeat(event.pointerCount) { pointerIndex ->
-            val pointerId = event.getPointerId(pointerIndex)
+        val pointerCount = minOf(event.pointerCount, pointerValues.size / 3)
+        repeat(pointerCount) { pointerIndex ->
             val x = (event.getX(pointerIndex) * scaleX).toInt()
             val y = (event.getY(pointerIndex) * scaleY).toInt()
             if (x < 0 || x >= 65535 || y < 0 || y >= 65535) return
-            pointerDataPool.add(Triple(pointerId, x, y))
+            pointerValues[pointerIndex * 3] = event.getPointerId(pointerIndex)
+            pointerValues[pointerIndex * 3 + 1] = x
+            pointerValues[pointerIndex * 3 + 2] = y
+        }
+
+        // Native fast path: stamped with the event's own time, not when it is handled
+        val eventTimeNs = if (Build.VERSION.SDK_INT >= 34) event.eventTimeNanos else event.eventTime * 1000000L
+        if (transport.sendTouch(eventTimeNs, action, event.actionIndex, pointerCount, pointerValues)) {
+            return
+        }
+
+        // Reuse pre-allocated list to avoid GC pressure on Android 4.3
+        pointerDataPool.clear()
+        repeat(pointerCount) { pointerIndex ->
+            pointerDataPool.add(Triple(pointerValues[pointerIndex * 3], pointerValues[pointerIndex * 3 + 1],
+                pointerValues[pointerIndex * 3 + 2]))
         }
 
         transport.send(TouchEvent(ts, action, event.actionIndex, pointerDataPool))
@@ -2,6 +2,7 @@ package info.anodsplace.headunit.aap
 
 import android.content.Context
 import info.anodsplace.headunit.connection.AccessoryConnection
+import info.anodsplace.headunit.decoder.MemoryProfile
 import info.anodsplace.headunit.decoder.MicRecorder
 import info.anodsplace.headunit.utils.AppLog
 import info.anodsplace.headunit.utils.Settings
@@ -27,13 +28,14 @@ internal interface AapRead {
     }
 
     object Factory {
-        fun create(connection: AccessoryConnection, transport: AapTransport, recorder: MicRecorder, aapAudio: AapAudio, aapVideo: AapVideo, settings: Settings, context: Context): AapRead {
+        fun create(connection: AccessoryConnection, ssl: AapSsl, transport: AapTransport, recorder: MicRecorder, aapAudio: AapAudio, aapVideo: AapVideo, settings: Settings, context: Context): AapRead {
             val handler = AapMessageHandlerImpl(transport, recorder, aapAudio, aapVideo, settings, context)
 
             return if (connection.isSingleMessage)
-                AapReadSingleMessage(connection, AapSsl.INSTANCE, handler)
+                AapReadSingleMessage(connection, ssl, handler)
             else
-                AapReadMultipleMessages(connection, AapSsl.INSTANCE, handler)
+                AapReadMultipleMessages(connection, ssl, handler,
+                        readBufferSize = MemoryProfile.forSettings(settings).readBufferSize)
         }
     }
 }
@@ -11,11 +11,13 @@ import java.nio.ByteBuffer
 internal class AapReadMultipleMessages(
         connection: AccessoryConnection,
         ssl: AapSsl,
-        handler: AapMessageHandler)
+        handler: AapMessageHandler,
+        readBufferSize: Int = Messages.DEF_BUFFER_LENGTH)
     : AapRead.Base(connection, ssl, handler) {
 
-    private val fifo = ByteBuffer.allocate(Messages.DEF_BUFFER_LENGTH * 2)
-    private val recv_buffer = ByteArray(Messages.DEF_BUFFER_LENGTH)
+    // Room for a full read behind the largest partial record
+    private val fifo = ByteBuffer.allocate(maxOf(readBufferSize * 2, readBufferSize + MAX_RECORD_SIZE))
+    private val recv_buffer = ByteArray(readBufferSize)
     private val recv_header = AapMessageIncoming.EncryptedHeader()
     private val msg_buffer = ByteArray(65535) // unsigned short max
     
@@ -27,6 +29,8 @@ internal class AapReadMultipleMessages(
         private const val MAX_CONSECUTIVE_ERRORS = 20
         private const val INITIAL_RETRY_DELAY_MS = 200L
         private const val MAX_RETRY_DELAY_MS = 2000L
+        // Header, first fragment total size and an unsigned short payload
+        private const val MAX_RECORD_SIZE = 4 + 4 + 65535
     }
 
     override fun doRead(connection: AccessoryConnection): Int {
@@ -11,17 +11,20 @@ import android.os.Build
 import android.os.IBinder
 import androidx.core.app.NotificationCompat
 import android.widget.Toast
+import java.io.File
 import info.anodsplace.headunit.App
 import info.anodsplace.headunit.R
 import info.anodsplace.headunit.aap.protocol.messages.NightModeEvent
 import info.anodsplace.headunit.connection.AccessoryConnection
+import info.anodsplace.headunit.connection.NativeSocketAccessoryConnection
+import info.anodsplace.headunit.connection.NativeUsbAccessoryConnection
 import info.anodsplace.headunit.connection.SocketAccessoryConnection
 import info.anodsplace.headunit.connection.UsbAccessoryConnection
 import info.anodsplace.headunit.connection.UsbReceiver
 import info.anodsplace.headunit.contract.ConnectedIntent
+import info.anodsplace.headunit.decoder.MemoryProfile
 import info.anodsplace.headunit.location.GpsLocationService
 import info.anodsplace.headunit.utils.*
-import info.anodsplace.headunit.contract.DisconnectIntent
 import info.anodsplace.headunit.contract.LocationUpdateIntent
 
 
@@ -31,6 +34,8 @@ class AapService : Service(), UsbReceiver.Listener, AccessoryConnection.Listener
     private var accessoryConnection: AccessoryConnection? = null
     private lateinit var usbReceiver: UsbReceiver
     private lateinit var nightModeReceiver: BroadcastReceiver
+    // Stopping because the running device was detached, not on purpose
+    private var deviceDetached = false
 
     override fun onBind(intent: Intent): IBinder? {
         return null
@@ -59,7 +64,8 @@ class AapService : Service(), UsbReceiver.Listener, AccessoryConnection.Listener
 
     override fun onDestroy() {
         super.onDestroy()
-        onDisconnect()
+        // A detached device may be plugged back in, otherwise the service was stopped on purpose
+        onDisconnect(holdMedia = deviceDetached)
         stopService(GpsLocationService.intent(this))
         unregisterReceiver(nightModeReceiver)
         unregisterReceiver(usbReceiver)
@@ -99,35 +105,75 @@ class AapService : Service(), UsbReceiver.Listener, AccessoryConnection.Listener
 
     override fun onConnectionResult(success: Boolean) {
         if (success) {
-            reset()
-            if (App.provide(this).transport.start(accessoryConnection!!)) {
+            // Media held from a lost connection carries over to this one
+            val component = App.provide(this)
+            reset(holdMedia = component.isHoldingMedia)
+            if (component.transport.start(accessoryConnection!!)) {
+                component.resumeMedia()
                 sendBroadcast(ConnectedIntent())
+            } else {
+                fallBackToLegacy()
             }
-        } else {
+        } else if (!fallBackToLegacy()) {
             AppLog.e { "Cannot connect to device" }
             Toast.makeText(this, "Cannot connect to the device", Toast.LENGTH_SHORT).show()
             stopSelf()
         }
     }
 
-    private fun onDisconnect() {
-        App.provide(this).localBroadcastManager.sendBroadcast(DisconnectIntent())
-        reset()
+    /**
+     * A native connection couldn't connect or start the session: retry on
+     * the Android USB API or a Java socket, once.
+     * @return false if the connection wasn't native
+     */
+    private fun fallBackToLegacy(): Boolean {
+        val connection = when (val native = accessoryConnection) {
+            is NativeUsbAccessoryConnection -> {
+                AppLog.e { "Native USB failed, falling back to the Android USB API" }
+                native.disconnect()
+                UsbAccessoryConnection(getSystemService(Context.USB_SERVICE) as UsbManager, native.device)
+            }
+            is NativeSocketAccessoryConnection -> {
+                AppLog.e { "Native socket failed, falling back to a Java socket" }
+                native.disconnect()
+                SocketAccessoryConnection(native.ip)
+            }
+            else -> return false
+        }
+        accessoryConnection = connection
+        connection.connect(this)
+        return true
+    }
+
+    private fun onDisconnect(holdMedia: Boolean) {
+        reset(holdMedia)
         accessoryConnection?.disconnect()
         accessoryConnection = null
     }
 
-    private fun reset() {
-        App.provide(this).resetTransport()
-        App.provide(this).audioDecoder.stop()
-        App.provide(this).videoDecoderController.stop("AapService::reset")
+    /**
+     * @param holdMedia Keep the media for a reconnect, see [AppComponent.holdMedia];
+     *   otherwise the disconnect broadcast and decoder teardown follow at once
+     */
+    private fun reset(holdMedia: Boolean) {
+        val component = App.provide(this)
+        // quit() holds or stops the media itself
+        component.resetTransport(holdMedia)
+        if (!holdMedia && component.isHoldingMedia) {
+            // Held by a transport lost earlier
+            component.stopMedia("AapService::reset")
+        }
     }
 
     override fun onUsbDetach(device: UsbDevice) {
-        if (accessoryConnection is UsbAccessoryConnection) {
-            if ((accessoryConnection as UsbAccessoryConnection).isDeviceRunning(device)) {
-                stopSelf()
-            }
+        val running = when (val connection = accessoryConnection) {
+            is UsbAccessoryConnection -> connection.isDeviceRunning(device)
+            is NativeUsbAccessoryConnection -> connection.isDeviceRunning(device)
+            else -> false
+        }
+        if (running) {
+            deviceDetached = true
+            stopSelf()
         }
     }
 
@@ -162,6 +208,10 @@ class AapService : Service(), UsbReceiver.Listener, AccessoryConnection.Listener
         private const val TYPE_WIFI = 2
         private const val EXTRA_CONNECTION_TYPE = "extra_connection_type"
         private const val EXTRA_IP = "extra_ip"
+        // Last stall snapshot of the native pipeline, in private storage
+        private const val STALL_SNAPSHOT_FILE = "stall_snapshot.txt"
+        // Native stats, republished while connected, see NativeStatsFile
+        const val NATIVE_STATS_FILE = "native_stats.bin"
 
         fun createIntent(device: UsbDevice, context: Context): Intent {
             val intent = Intent(context, AapService::class.java)
@@ -187,10 +237,59 @@ class AapService : Service(), UsbReceiver.Listener, AccessoryConnection.Listener
                     return null
                 }
                 val usbManager = context.getSystemService(Context.USB_SERVICE) as UsbManager
-                return UsbAccessoryConnection(usbManager, device)
+                val settings = App.provide(context).settings
+                if (!settings.nativeUsb) {
+                    return UsbAccessoryConnection(usbManager, device)
+                }
+                val features = settings.nativeFeatures
+                return NativeUsbAccessoryConnection(usbManager, device,
+                        useNativeFraming = Settings.NATIVE_FRAMING in features,
+                        useShadowFraming = Settings.NATIVE_SHADOW_FRAMING in features,
+                        useZeroCopy = Settings.NATIVE_ZERO_COPY in features,
+                        useNativeDispatcher = Settings.NATIVE_DISPATCHER in features,
+                        useParallelDecrypt = Settings.NATIVE_PARALLEL_DECRYPT in features,
+                        useQualityGovernor = Settings.NATIVE_QUALITY_GOVERNOR in features,
+                        useNativeVideo = Settings.NATIVE_VIDEO in features,
+                        useLowLatencyVideo = Settings.NATIVE_LOW_LATENCY_VIDEO in features,
+                        useNativeAudio = Settings.NATIVE_AUDIO in features,
+                        useAudioMixer = Settings.NATIVE_AUDIO_MIXER in features,
+                        useAvSync = Settings.NATIVE_AV_SYNC in features,
+                        useMediaAckBatching = Settings.NATIVE_MEDIA_ACK_BATCHING in features,
+                        useAckFlowControl = Settings.NATIVE_ACK_FLOW_CONTROL in features,
+                        useNativeKeepalive = Settings.NATIVE_KEEPALIVE in features,
+                        useBatchedControl = Settings.NATIVE_BATCHED_CONTROL in features,
+                        useSharedControlRing = Settings.NATIVE_CONTROL_RING in features,
+                        useSensorBatching = Settings.NATIVE_SENSOR_BATCHING in features,
+                        useTouchFastPath = Settings.NATIVE_TOUCH_FAST_PATH in features,
+                        useResubmitFirst = Settings.NATIVE_RESUBMIT_FIRST in features,
+                        useLockedBuffers = Settings.NATIVE_LOCKED_BUFFERS in features,
+                        useTracing = Settings.NATIVE_TRACING in features,
+                        useFastLog = Settings.NATIVE_FAST_LOG in features,
+                        usePrewarm = Settings.NATIVE_PREWARM in features,
+                        stallSnapshotPath = if (Settings.NATIVE_STALL_SNAPSHOT in features)
+                                File(context.filesDir, STALL_SNAPSHOT_FILE).path else null,
+                        statsPath = if (Settings.NATIVE_STATS in features)
+                                File(context.filesDir, NATIVE_STATS_FILE).path else null,
+                        dispatchQueues = settings.dispatchQueues,
+                        memoryProfile = MemoryProfile.forSettings(settings),
+                        numTransfers = settings.usbTransfers,
+                        transferSize = settings.usbTransferSize,
+                        decryptWorkers = settings.decryptWorkers)
             } else if (connectionType == TYPE_WIFI) {
                 val ip = intent?.getStringExtra(EXTRA_IP) ?: ""
-                return SocketAccessoryConnection(ip)
+                val settings = App.provide(context).settings
+                if (!settings.nativeSocket) {
+                    return SocketAccessoryConnection(ip)
+                }
+                val features = settings.nativeFeatures
+                return NativeSocketAccessoryConnection(ip, dispatchQueues = settings.dispatchQueues,
+                        useNativeKeepalive = Settings.NATIVE_KEEPALIVE in features,
+                        useQualityGovernor = Settings.NATIVE_QUALITY_GOVERNOR in features,
+                        stallSnapshotPath = if (Settings.NATIVE_STALL_SNAPSHOT in features)
+                                File(context.filesDir, STALL_SNAPSHOT_FILE).path else null,
+                        statsPath = if (Settings.NATIVE_STATS in features)
+                                File(context.filesDir, NATIVE_STATS_FILE).path else null,
+                        memoryProfile = MemoryProfile.forSettings(settings))
             }
 
             return null
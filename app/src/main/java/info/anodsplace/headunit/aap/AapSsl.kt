@@ -1,12 +1,46 @@
 package info.anodsplace.headunit.aap
 
+import java.nio.ByteBuffer
+
 internal interface AapSsl { // TODO replace this
     fun prepare()
     fun handshakeRead(): ByteArray
     fun handshakeWrite(handshakeData: ByteArray)
     fun decrypt(start: Int, length: Int, buffer: ByteArray): ByteArray
+    fun decrypt(start: Int, length: Int, buffer: ByteArray, out: ByteBuffer): Int
     fun encrypt(offset: Int, length: Int, buffer: ByteArray): ByteArray
 
+    /**
+     * @return true once the handshake loop got the phone's Finished
+     */
+    fun isHandshakeComplete(): Boolean
+
+    /**
+     * Call once the handshake is complete.
+     * @return true if the previous session was resumed instead of negotiated
+     */
+    fun completeHandshake(): Boolean = false
+
+    /**
+     * Traffic key for records received from the phone, once the handshake is done.
+     * @return null if the implementation cannot export its keys
+     */
+    fun exportReadKeys(): TlsRecordKeys? = null
+
+    /**
+     * Traffic key for records sent to the phone. Once exported the caller
+     * encrypts every later record itself, [encrypt] must not be used again.
+     * @return null if the implementation cannot export its keys
+     */
+    fun exportWriteKeys(): TlsRecordKeys? = null
+
+    /**
+     * TLS 1.2 AES-GCM key material for one direction.
+     * @param salt 4-byte implicit nonce (write IV)
+     * @param sequence Sequence number of the next record
+     */
+    class TlsRecordKeys(val key: ByteArray, val salt: ByteArray, val sequence: Long)
+
     companion object {
         val INSTANCE: AapSsl = AapSslImpl
     }
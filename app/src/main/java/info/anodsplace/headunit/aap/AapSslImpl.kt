@@ -7,20 +7,31 @@ import javax.net.ssl.SSLEngine
 import javax.net.ssl.SSLEngineResult
 
 object AapSslImpl: AapSsl {
+    // The client session cache is keyed by peer, and an engine without one
+    // never resumes. The phone has no host name, so every phone shares this
+    // key: a phone that doesn't know the offered session does a full handshake.
+    private const val PEER_HOST = "android-auto"
+    private const val PEER_PORT = 5277
+    private const val SESSION_TIMEOUT_SECONDS = 24 * 60 * 60
+
     private val sslContext: SSLContext by lazy { createSslContext() }
     private var sslEngine: SSLEngine? = null
     private var txBuffer: ByteBuffer? = null
     private var rxBuffer: ByteBuffer? = null
+    private var lastSessionId: ByteArray? = null
 
     private fun createSslContext(): SSLContext {
         // With Conscrypt installed, TLSv1.2 should be available on all Android versions
         val context = SSLContext.getInstance("TLSv1.2")
         context.init(arrayOf(SingleKeyKeyManager), arrayOf(NoCheckTrustManager), null)
+        context.clientSessionContext.sessionTimeout = SESSION_TIMEOUT_SECONDS
         return context
     }
 
     override fun prepare() {
-        val newSslEngine = sslContext.createSSLEngine()
+        // Offers the cached session (ID or ticket) from the last connection, so a
+        // reconnect can skip the key exchange and the phone's certificate
+        val newSslEngine = sslContext.createSSLEngine(PEER_HOST, PEER_PORT)
         newSslEngine.useClientMode = true
 
         // Enable TLSv1.2 (required by modern Android Auto)
@@ -70,12 +81,21 @@ object AapSslImpl: AapSsl {
         }
     }
 
-    fun isHandshakeComplete(): Boolean {
+    override fun isHandshakeComplete(): Boolean {
         val status = sslEngine?.handshakeStatus
         return status == javax.net.ssl.SSLEngineResult.HandshakeStatus.FINISHED ||
                status == javax.net.ssl.SSLEngineResult.HandshakeStatus.NOT_HANDSHAKING
     }
 
+    // A resumed session is no different for native decrypt: the engine keeps
+    // its traffic keys either way, see exportReadKeys()
+    override fun completeHandshake(): Boolean {
+        val id = sslEngine?.session?.id ?: return false
+        val resumed = id.isNotEmpty() && lastSessionId?.contentEquals(id) == true
+        lastSessionId = id
+        return resumed
+    }
+
     override fun handshakeRead(): ByteArray {
         require(sslEngine != null) { "SSL Engine not initialized - prepare() was not called" }
         val engine = sslEngine!!
@@ -150,6 +170,19 @@ object AapSslImpl: AapSsl {
         return resultBuffer
     }
 
+    /**
+     * Decrypt straight into a caller-owned buffer, no plaintext allocation.
+     * @return Number of plaintext bytes written from the start of out
+     */
+    override fun decrypt(start: Int, length: Int, buffer: ByteArray, out: ByteBuffer): Int {
+        require(sslEngine != null) { "SSL Engine not initialized - prepare() was not called" }
+        out.clear()
+        val encrypted = ByteBuffer.wrap(buffer, start, length)
+        val result = sslEngine!!.unwrap(encrypted, out)
+        runDelegatedTasks(result, sslEngine!!)
+        return result.bytesProduced()
+    }
+
     override fun encrypt(offset: Int, length: Int, buffer: ByteArray): ByteArray {
         require(sslEngine != null) { "SSL Engine not initialized - prepare() was not called" }
         txBuffer!!.clear()
@@ -161,4 +194,15 @@ object AapSslImpl: AapSsl {
         txBuffer!!.get(resultBuffer, offset, result.bytesProduced())
         return resultBuffer
     }
+
+    /**
+     * SSLEngine gives no access to the negotiated traffic keys, and Conscrypt's
+     * exportKeyingMaterial() is an RFC 5705 exporter that cannot reproduce the
+     * key block, so records keep going through unwrap(). [AapTlsClient]
+     * exports them instead, see Settings.exportableTls.
+     */
+    override fun exportReadKeys(): AapSsl.TlsRecordKeys? = null
+
+    // Same for the write direction, records keep going through wrap()
+    override fun exportWriteKeys(): AapSsl.TlsRecordKeys? = null
 }
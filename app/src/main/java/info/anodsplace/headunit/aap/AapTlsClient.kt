@@ -0,0 +1,551 @@
+package info.anodsplace.headunit.aap
+
+import info.anodsplace.headunit.utils.AppLog
+import java.io.ByteArrayInputStream
+import java.io.ByteArrayOutputStream
+import java.math.BigInteger
+import java.nio.ByteBuffer
+import java.security.KeyFactory
+import java.security.KeyPair
+import java.security.KeyPairGenerator
+import java.security.MessageDigest
+import java.security.PublicKey
+import java.security.SecureRandom
+import java.security.Signature
+import java.security.cert.CertificateFactory
+import java.security.interfaces.ECPublicKey
+import java.security.spec.ECGenParameterSpec
+import java.security.spec.ECPoint
+import java.security.spec.ECPublicKeySpec
+import javax.crypto.Cipher
+import javax.crypto.KeyAgreement
+import javax.crypto.Mac
+import javax.crypto.spec.GCMParameterSpec
+import javax.crypto.spec.SecretKeySpec
+import javax.net.ssl.SSLException
+
+/**
+ * TLS 1.2 client that runs the record layer itself, so the traffic keys can
+ * be exported to the native stages (SSLEngine keeps them to itself, see
+ * [AapSslImpl.exportReadKeys]). Primitives come from JCA; only the AES-GCM
+ * suites the phone negotiates with [AapSslImpl] are offered, and the phone's
+ * certificate is not checked, same as [NoCheckTrustManager].
+ *
+ * Follows the transport's handshake loop: [handshakeRead] returns the next
+ * flight, [handshakeWrite] takes the phone's reply to it. Sessions are never
+ * resumed, every connection does the full key exchange.
+ */
+internal class AapTlsClient : AapSsl {
+
+    private enum class State { START, WAIT_SERVER_HELLO_DONE, SEND_CLIENT_FLIGHT, WAIT_SERVER_FINISHED, DONE, FAILED }
+
+    private class Suite(val id: Int, val ecdhe: Boolean, val keyLength: Int, val sha384: Boolean) {
+        val digest get() = if (sha384) "SHA-384" else "SHA-256"
+        val mac get() = if (sha384) "HmacSHA384" else "HmacSHA256"
+    }
+
+    private class Direction(val rawKey: ByteArray, val salt: ByteArray) {
+        val key = SecretKeySpec(rawKey, "AES")
+        var sequence = 0L
+    }
+
+    private val random = SecureRandom()
+    private var state = State.START
+    private val transcript = ByteArrayOutputStream()
+    private var records = ByteArray(0)
+    private var handshakeMessages = ByteArray(0)
+    private val clientRandom = ByteArray(RANDOM_SIZE)
+    private var serverRandom = ByteArray(0)
+    private var suite: Suite? = null
+    private var extendedMasterSecret = false
+    private var peerKey: PublicKey? = null
+    private var curve = 0
+    private var serverPoint = ByteArray(0)
+    private var certificateAlgorithm = -1
+    private var masterSecret = ByteArray(0)
+    private var read: Direction? = null
+    private var write: Direction? = null
+    private var pendingRead: Direction? = null
+    private val readCipher: Cipher by lazy { Cipher.getInstance(GCM) }
+    private val writeCipher: Cipher by lazy { Cipher.getInstance(GCM) }
+
+    override fun prepare() {
+        state = State.START
+        transcript.reset()
+        records = ByteArray(0)
+        handshakeMessages = ByteArray(0)
+        random.nextBytes(clientRandom)
+        serverRandom = ByteArray(0)
+        suite = null
+        extendedMasterSecret = false
+        peerKey = null
+        curve = 0
+        serverPoint = ByteArray(0)
+        certificateAlgorithm = -1
+        read = null
+        write = null
+        pendingRead = null
+    }
+
+    override fun handshakeRead(): ByteArray {
+        return try {
+            when (state) {
+                State.START -> {
+                    state = State.WAIT_SERVER_HELLO_DONE
+                    record(CONTENT_HANDSHAKE, handshakeMessage(CLIENT_HELLO, clientHello()))
+                }
+                State.SEND_CLIENT_FLIGHT -> {
+                    state = State.WAIT_SERVER_FINISHED
+                    clientFlight()
+                }
+                else -> ByteArray(0)
+            }
+        } catch (e: Exception) {
+            fail(e)
+            ByteArray(0)
+        }
+    }
+
+    override fun handshakeWrite(handshakeData: ByteArray) {
+        if (state == State.DONE || state == State.FAILED) return
+        try {
+            records += handshakeData
+            var offset = 0
+            while (state != State.DONE && records.size - offset >= RECORD_HEADER_SIZE) {
+                val length = uint16(records, offset + 3)
+                if (records.size - offset < RECORD_HEADER_SIZE + length) break
+                val type = records[offset].toInt() and 0xFF
+                var fragment = records.copyOfRange(offset + RECORD_HEADER_SIZE, offset + RECORD_HEADER_SIZE + length)
+                offset += RECORD_HEADER_SIZE + length
+                read?.let { fragment = openRecord(it, type, fragment, 0, fragment.size) }
+                when (type) {
+                    CONTENT_CHANGE_CIPHER_SPEC -> {
+                        read = pendingRead ?: throw SSLException("Unexpected ChangeCipherSpec")
+                    }
+                    CONTENT_ALERT -> throw SSLException("Alert from phone: ${fragment.joinToString(" ") { (it.toInt() and 0xFF).toString() }}")
+                    CONTENT_HANDSHAKE -> {
+                        handshakeMessages += fragment
+                        processHandshakeMessages()
+                    }
+                    else -> throw SSLException("Unexpected record type $type during handshake")
+                }
+            }
+            records = records.copyOfRange(offset, records.size)
+        } catch (e: Exception) {
+            // Malformed records too, the handshake fails instead of the transport thread
+            fail(e)
+        }
+    }
+
+    override fun isHandshakeComplete() = state == State.DONE
+
+    override fun decrypt(start: Int, length: Int, buffer: ByteArray): ByteArray {
+        val out = ByteBuffer.allocate(length)
+        val produced = decrypt(start, length, buffer, out)
+        return out.array().copyOf(produced)
+    }
+
+    /**
+     * Every application data record in the range, like SSLEngine.unwrap()
+     * the plaintext is left between the start and the position of out.
+     */
+    override fun decrypt(start: Int, length: Int, buffer: ByteArray, out: ByteBuffer): Int {
+        val direction = read ?: throw SSLException("Handshake not complete")
+        out.clear()
+        var offset = start
+        val end = start + length
+        while (end - offset >= RECORD_HEADER_SIZE) {
+            val type = buffer[offset].toInt() and 0xFF
+            val fragment = uint16(buffer, offset + 3)
+            if (end - offset - RECORD_HEADER_SIZE < fragment) throw SSLException("Truncated record")
+            if (type != CONTENT_APPLICATION_DATA) throw SSLException("Unexpected record type $type")
+            openRecord(direction, type, buffer, offset + RECORD_HEADER_SIZE, fragment, out)
+            offset += RECORD_HEADER_SIZE + fragment
+        }
+        return out.position()
+    }
+
+    override fun encrypt(offset: Int, length: Int, buffer: ByteArray): ByteArray {
+        val direction = write ?: throw SSLException("Handshake not complete")
+        val records = (length + MAX_FRAGMENT - 1) / MAX_FRAGMENT
+        val result = ByteArray(offset + length + records * RECORD_OVERHEAD)
+        var input = offset
+        var output = offset
+        while (input < offset + length) {
+            val fragment = minOf(MAX_FRAGMENT, offset + length - input)
+            output += sealRecord(direction, CONTENT_APPLICATION_DATA, buffer, input, fragment, result, output)
+            input += fragment
+        }
+        return result
+    }
+
+    override fun exportReadKeys(): AapSsl.TlsRecordKeys? {
+        val direction = read ?: return null
+        return AapSsl.TlsRecordKeys(direction.rawKey.copyOf(), direction.salt.copyOf(), direction.sequence)
+    }
+
+    /**
+     * The write direction is kept: if the native layer rejects the key,
+     * [encrypt] carries on from the same sequence number.
+     */
+    override fun exportWriteKeys(): AapSsl.TlsRecordKeys? {
+        val direction = write ?: return null
+        return AapSsl.TlsRecordKeys(direction.rawKey.copyOf(), direction.salt.copyOf(), direction.sequence)
+    }
+
+    private fun fail(e: Exception) {
+        AppLog.e(e) { "TLS handshake failed in $state" }
+        state = State.FAILED
+    }
+
+    private fun clientHello(): ByteArray {
+        val extensions = ByteArrayOutputStream()
+        extensions.extension(EXT_SUPPORTED_GROUPS, vector16(uint16s(CURVE_SECP256R1, CURVE_SECP384R1)))
+        extensions.extension(EXT_EC_POINT_FORMATS, vector8(byteArrayOf(0)))
+        extensions.extension(EXT_SIGNATURE_ALGORITHMS, vector16(uint16s(*SIGNATURE_ALGORITHMS)))
+        extensions.extension(EXT_EXTENDED_MASTER_SECRET, ByteArray(0))
+        extensions.extension(EXT_RENEGOTIATION_INFO, vector8(ByteArray(0)))
+
+        val hello = ByteArrayOutputStream()
+        hello.write(VERSION)
+        hello.write(clientRandom)
+        hello.write(vector8(ByteArray(0)))
+        hello.write(vector16(uint16s(*SUITES.map { it.id }.toIntArray())))
+        hello.write(vector8(byteArrayOf(0)))
+        hello.write(vector16(extensions.toByteArray()))
+        return hello.toByteArray()
+    }
+
+    private fun processHandshakeMessages() {
+        var offset = 0
+        while (handshakeMessages.size - offset >= HANDSHAKE_HEADER_SIZE) {
+            val length = uint24(handshakeMessages, offset + 1)
+            if (handshakeMessages.size - offset < HANDSHAKE_HEADER_SIZE + length) break
+            val type = handshakeMessages[offset].toInt() and 0xFF
+            val message = handshakeMessages.copyOfRange(offset, offset + HANDSHAKE_HEADER_SIZE + length)
+            offset += message.size
+            handleHandshake(type, message.copyOfRange(HANDSHAKE_HEADER_SIZE, message.size), message)
+        }
+        handshakeMessages = handshakeMessages.copyOfRange(offset, handshakeMessages.size)
+    }
+
+    private fun handleHandshake(type: Int, body: ByteArray, message: ByteArray) {
+        if (type == FINISHED) {
+            if (state != State.WAIT_SERVER_FINISHED || read == null) throw SSLException("Unexpected Finished")
+            val expected = prf(masterSecret, "server finished", transcriptHash(), FINISHED_SIZE)
+            if (!MessageDigest.isEqual(expected, body)) throw SSLException("Phone Finished does not verify")
+            transcript.write(message)
+            state = State.DONE
+            return
+        }
+        if (state != State.WAIT_SERVER_HELLO_DONE) throw SSLException("Unexpected handshake message $type in $state")
+        transcript.write(message)
+        when (type) {
+            SERVER_HELLO -> serverHello(body)
+            CERTIFICATE -> {
+                // certificate_list, then the phone's own certificate first
+                val length = uint24(body, 3)
+                val certificate = CertificateFactory.getInstance("X.509")
+                        .generateCertificate(ByteArrayInputStream(body, 6, length))
+                peerKey = certificate.publicKey
+            }
+            SERVER_KEY_EXCHANGE -> serverKeyExchange(body)
+            CERTIFICATE_REQUEST -> {
+                val types = body[0].toInt() and 0xFF
+                val algorithms = uint16(body, 1 + types)
+                certificateAlgorithm = SIGNATURE_ALGORITHMS.firstOrNull { algorithm ->
+                    (0 until algorithms step 2).any { uint16(body, 3 + types + it) == algorithm }
+                } ?: throw SSLException("No common certificate signature algorithm")
+            }
+            SERVER_HELLO_DONE -> state = State.SEND_CLIENT_FLIGHT
+            else -> throw SSLException("Unexpected handshake message $type")
+        }
+    }
+
+    private fun serverHello(body: ByteArray) {
+        serverRandom = body.copyOfRange(2, 2 + RANDOM_SIZE)
+        var offset = 2 + RANDOM_SIZE
+        offset += 1 + (body[offset].toInt() and 0xFF)
+        val id = uint16(body, offset)
+        suite = SUITES.firstOrNull { it.id == id } ?: throw SSLException("Phone chose cipher suite 0x${id.toString(16)}")
+        offset += 3
+        if (offset < body.size) {
+            val end = offset + 2 + uint16(body, offset)
+            offset += 2
+            while (offset < end) {
+                if (uint16(body, offset) == EXT_EXTENDED_MASTER_SECRET) extendedMasterSecret = true
+                offset += 4 + uint16(body, offset + 2)
+            }
+        }
+        AppLog.i { "TLS cipher suite 0x${id.toString(16)}, extended master secret: $extendedMasterSecret" }
+    }
+
+    private fun serverKeyExchange(body: ByteArray) {
+        if (body[0].toInt() != NAMED_CURVE) throw SSLException("Unsupported ECDHE curve type ${body[0]}")
+        curve = uint16(body, 1)
+        val pointLength = body[3].toInt() and 0xFF
+        serverPoint = body.copyOfRange(4, 4 + pointLength)
+        val params = 4 + pointLength
+        val algorithm = uint16(body, params)
+        val signatureLength = uint16(body, params + 2)
+
+        val verifier = Signature.getInstance(signatureName(algorithm))
+        verifier.initVerify(peerKey ?: throw SSLException("ServerKeyExchange before Certificate"))
+        verifier.update(clientRandom)
+        verifier.update(serverRandom)
+        verifier.update(body, 0, params)
+        if (!verifier.verify(body, params + 4, signatureLength)) throw SSLException("ServerKeyExchange signature does not verify")
+    }
+
+    private fun clientFlight(): ByteArray {
+        val suite = this.suite ?: throw SSLException("No ServerHello")
+        val peerKey = this.peerKey ?: throw SSLException("No phone certificate")
+        val flight = ByteArrayOutputStream()
+        val alias = SingleKeyKeyManager.chooseEngineClientAlias(null, null, null)
+
+        if (certificateAlgorithm >= 0) {
+            val chain = ByteArrayOutputStream()
+            SingleKeyKeyManager.getCertificateChain(alias).forEach { chain.write(vector24(it.encoded)) }
+            flight.write(record(CONTENT_HANDSHAKE, handshakeMessage(CERTIFICATE, vector24(chain.toByteArray()))))
+        }
+
+        val preMasterSecret: ByteArray
+        if (suite.ecdhe) {
+            val keyPair = ecKeyPair()
+            val ownKey = keyPair.public as ECPublicKey
+            val size = (ownKey.params.curve.field.fieldSize + 7) / 8
+            if (serverPoint.size != 1 + 2 * size || serverPoint[0].toInt() != 4) throw SSLException("Unsupported ECDHE point")
+            val point = ECPoint(BigInteger(1, serverPoint.copyOfRange(1, 1 + size)), BigInteger(1, serverPoint.copyOfRange(1 + size, serverPoint.size)))
+            val agreement = KeyAgreement.getInstance("ECDH")
+            agreement.init(keyPair.private)
+            agreement.doPhase(KeyFactory.getInstance("EC").generatePublic(ECPublicKeySpec(point, ownKey.params)), true)
+            preMasterSecret = agreement.generateSecret()
+            val encoded = byteArrayOf(4) + unsigned(ownKey.w.affineX, size) + unsigned(ownKey.w.affineY, size)
+            flight.write(record(CONTENT_HANDSHAKE, handshakeMessage(CLIENT_KEY_EXCHANGE, vector8(encoded))))
+        } else {
+            preMasterSecret = ByteArray(PRE_MASTER_SECRET_SIZE)
+            random.nextBytes(preMasterSecret)
+            VERSION.copyInto(preMasterSecret)
+            val rsa = Cipher.getInstance("RSA/ECB/PKCS1Padding")
+            rsa.init(Cipher.ENCRYPT_MODE, peerKey)
+            flight.write(record(CONTENT_HANDSHAKE, handshakeMessage(CLIENT_KEY_EXCHANGE, vector16(rsa.doFinal(preMasterSecret)))))
+        }
+
+        masterSecret = if (extendedMasterSecret)
+            prf(preMasterSecret, "extended master secret", transcriptHash(), MASTER_SECRET_SIZE)
+        else
+            prf(preMasterSecret, "master secret", clientRandom + serverRandom, MASTER_SECRET_SIZE)
+
+        if (certificateAlgorithm >= 0) {
+            val signer = Signature.getInstance(signatureName(certificateAlgorithm))
+            signer.initSign(SingleKeyKeyManager.getPrivateKey(alias))
+            signer.update(transcript.toByteArray())
+            val verify = uint16s(certificateAlgorithm) + vector16(signer.sign())
+            flight.write(record(CONTENT_HANDSHAKE, handshakeMessage(CERTIFICATE_VERIFY, verify)))
+        }
+
+        // client_write_key, server_write_key, client_write_IV, server_write_IV
+        val length = suite.keyLength
+        val keyBlock = prf(masterSecret, "key expansion", serverRandom + clientRandom, 2 * length + 2 * SALT_SIZE)
+        val clientWrite = Direction(keyBlock.copyOfRange(0, length), keyBlock.copyOfRange(2 * length, 2 * length + SALT_SIZE))
+        pendingRead = Direction(keyBlock.copyOfRange(length, 2 * length), keyBlock.copyOfRange(2 * length + SALT_SIZE, keyBlock.size))
+        keyBlock.fill(0)
+
+        flight.write(record(CONTENT_CHANGE_CIPHER_SPEC, byteArrayOf(1)))
+        val finished = handshakeMessage(FINISHED, prf(masterSecret, "client finished", transcriptHash(), FINISHED_SIZE))
+        val sealed = ByteArray(finished.size + RECORD_OVERHEAD)
+        sealRecord(clientWrite, CONTENT_HANDSHAKE, finished, 0, finished.size, sealed, 0)
+        flight.write(sealed)
+        write = clientWrite
+        return flight.toByteArray()
+    }
+
+    private fun ecKeyPair(): KeyPair {
+        val name = when (curve) {
+            CURVE_SECP256R1 -> "secp256r1"
+            CURVE_SECP384R1 -> "secp384r1"
+            else -> throw SSLException("Phone chose curve $curve")
+        }
+        val generator = KeyPairGenerator.getInstance("EC")
+        generator.initialize(ECGenParameterSpec(name), random)
+        return generator.generateKeyPair()
+    }
+
+    /**
+     * Seal one record at result[offset], the explicit nonce is the sequence number.
+     * @return Record size
+     */
+    private fun sealRecord(direction: Direction, type: Int, input: ByteArray, inputOffset: Int, length: Int, result: ByteArray, offset: Int): Int {
+        val sequence = direction.sequence++
+        result[offset] = type.toByte()
+        VERSION.copyInto(result, offset + 1)
+        putUint16(result, offset + 3, EXPLICIT_NONCE_SIZE + length + TAG_SIZE)
+        putUint64(result, offset + RECORD_HEADER_SIZE, sequence)
+        writeCipher.init(Cipher.ENCRYPT_MODE, direction.key, GCMParameterSpec(TAG_SIZE * 8, nonce(direction, result, offset + RECORD_HEADER_SIZE)))
+        writeCipher.updateAAD(additionalData(sequence, type, length))
+        writeCipher.doFinal(input, inputOffset, length, result, offset + RECORD_HEADER_SIZE + EXPLICIT_NONCE_SIZE)
+        return RECORD_OVERHEAD + length
+    }
+
+    private fun openRecord(direction: Direction, type: Int, fragment: ByteArray, offset: Int, length: Int): ByteArray {
+        val out = ByteBuffer.allocate(maxOf(0, length - EXPLICIT_NONCE_SIZE - TAG_SIZE))
+        openRecord(direction, type, fragment, offset, length, out)
+        return out.array()
+    }
+
+    private fun openRecord(direction: Direction, type: Int, fragment: ByteArray, offset: Int, length: Int, out: ByteBuffer) {
+        val plaintext = length - EXPLICIT_NONCE_SIZE - TAG_SIZE
+        if (plaintext < 0) throw SSLException("Record too short")
+        val sequence = direction.sequence++
+        readCipher.init(Cipher.DECRYPT_MODE, direction.key, GCMParameterSpec(TAG_SIZE * 8, nonce(direction, fragment, offset)))
+        readCipher.updateAAD(additionalData(sequence, type, plaintext))
+        readCipher.doFinal(ByteBuffer.wrap(fragment, offset + EXPLICIT_NONCE_SIZE, plaintext + TAG_SIZE), out)
+    }
+
+    private fun nonce(direction: Direction, explicit: ByteArray, offset: Int): ByteArray {
+        val nonce = ByteArray(SALT_SIZE + EXPLICIT_NONCE_SIZE)
+        direction.salt.copyInto(nonce)
+        explicit.copyInto(nonce, SALT_SIZE, offset, offset + EXPLICIT_NONCE_SIZE)
+        return nonce
+    }
+
+    // seq_num + type + version + length, RFC 5246 6.2.3.3
+    private fun additionalData(sequence: Long, type: Int, length: Int): ByteArray {
+        val aad = ByteArray(13)
+        putUint64(aad, 0, sequence)
+        aad[8] = type.toByte()
+        VERSION.copyInto(aad, 9)
+        putUint16(aad, 11, length)
+        return aad
+    }
+
+    private fun handshakeMessage(type: Int, body: ByteArray): ByteArray {
+        val message = byteArrayOf(type.toByte()) + vector24(body)
+        transcript.write(message)
+        return message
+    }
+
+    private fun record(type: Int, fragment: ByteArray): ByteArray {
+        return byteArrayOf(type.toByte()) + VERSION + vector16(fragment)
+    }
+
+    private fun transcriptHash(): ByteArray {
+        return MessageDigest.getInstance(suite!!.digest).digest(transcript.toByteArray())
+    }
+
+    // P_hash of the suite's PRF hash, RFC 5246 5
+    private fun prf(secret: ByteArray, label: String, seed: ByteArray, length: Int): ByteArray {
+        val mac = Mac.getInstance(suite!!.mac)
+        mac.init(SecretKeySpec(secret, mac.algorithm))
+        val labelSeed = label.toByteArray(Charsets.US_ASCII) + seed
+        val result = ByteArrayOutputStream()
+        var a = labelSeed
+        while (result.size() < length) {
+            a = mac.doFinal(a)
+            mac.update(a)
+            result.write(mac.doFinal(labelSeed))
+        }
+        return result.toByteArray().copyOf(length)
+    }
+
+    private fun signatureName(algorithm: Int) = when (algorithm) {
+        RSA_PKCS1_SHA256 -> "SHA256withRSA"
+        RSA_PKCS1_SHA384 -> "SHA384withRSA"
+        RSA_PKCS1_SHA512 -> "SHA512withRSA"
+        else -> throw SSLException("Unsupported signature algorithm 0x${algorithm.toString(16)}")
+    }
+
+    companion object {
+        private const val GCM = "AES/GCM/NoPadding"
+        private val VERSION = byteArrayOf(3, 3)
+
+        private const val CONTENT_CHANGE_CIPHER_SPEC = 20
+        private const val CONTENT_ALERT = 21
+        private const val CONTENT_HANDSHAKE = 22
+        private const val CONTENT_APPLICATION_DATA = 23
+
+        private const val CLIENT_HELLO = 1
+        private const val SERVER_HELLO = 2
+        private const val CERTIFICATE = 11
+        private const val SERVER_KEY_EXCHANGE = 12
+        private const val CERTIFICATE_REQUEST = 13
+        private const val SERVER_HELLO_DONE = 14
+        private const val CERTIFICATE_VERIFY = 15
+        private const val CLIENT_KEY_EXCHANGE = 16
+        private const val FINISHED = 20
+
+        private const val EXT_SUPPORTED_GROUPS = 10
+        private const val EXT_EC_POINT_FORMATS = 11
+        private const val EXT_SIGNATURE_ALGORITHMS = 13
+        private const val EXT_EXTENDED_MASTER_SECRET = 23
+        private const val EXT_RENEGOTIATION_INFO = 0xFF01
+
+        private const val NAMED_CURVE = 3
+        private const val CURVE_SECP256R1 = 23
+        private const val CURVE_SECP384R1 = 24
+        private const val RSA_PKCS1_SHA256 = 0x0401
+        private const val RSA_PKCS1_SHA384 = 0x0501
+        private const val RSA_PKCS1_SHA512 = 0x0601
+        private val SIGNATURE_ALGORITHMS = intArrayOf(RSA_PKCS1_SHA256, RSA_PKCS1_SHA384, RSA_PKCS1_SHA512)
+
+        // Same order as AapSslImpl prefers them
+        private val SUITES = listOf(
+                Suite(0xC02F, ecdhe = true, keyLength = 16, sha384 = false),  // TLS_ECDHE_RSA_WITH_AES_128_GCM_SHA256
+                Suite(0xC030, ecdhe = true, keyLength = 32, sha384 = true),   // TLS_ECDHE_RSA_WITH_AES_256_GCM_SHA384
+                Suite(0x009C, ecdhe = false, keyLength = 16, sha384 = false), // TLS_RSA_WITH_AES_128_GCM_SHA256
+                Suite(0x009D, ecdhe = false, keyLength = 32, sha384 = true))  // TLS_RSA_WITH_AES_256_GCM_SHA384
+
+        private const val RANDOM_SIZE = 32
+        private const val PRE_MASTER_SECRET_SIZE = 48
+        private const val MASTER_SECRET_SIZE = 48
+        private const val FINISHED_SIZE = 12
+        private const val RECORD_HEADER_SIZE = 5
+        private const val HANDSHAKE_HEADER_SIZE = 4
+        private const val SALT_SIZE = 4
+        private const val EXPLICIT_NONCE_SIZE = 8
+        private const val TAG_SIZE = 16
+        private const val RECORD_OVERHEAD = RECORD_HEADER_SIZE + EXPLICIT_NONCE_SIZE + TAG_SIZE
+        private const val MAX_FRAGMENT = 16384
+
+        private fun uint16(buffer: ByteArray, offset: Int) =
+                ((buffer[offset].toInt() and 0xFF) shl 8) or (buffer[offset + 1].toInt() and 0xFF)
+
+        private fun uint24(buffer: ByteArray, offset: Int) =
+                ((buffer[offset].toInt() and 0xFF) shl 16) or uint16(buffer, offset + 1)
+
+        private fun putUint16(buffer: ByteArray, offset: Int, value: Int) {
+            buffer[offset] = (value shr 8).toByte()
+            buffer[offset + 1] = value.toByte()
+        }
+
+        private fun putUint64(buffer: ByteArray, offset: Int, value: Long) {
+            for (i in 0 until 8) {
+                buffer[offset + i] = (value shr (56 - 8 * i)).toByte()
+            }
+        }
+
+        private fun uint16s(vararg values: Int): ByteArray {
+            val bytes = ByteArray(values.size * 2)
+            values.forEachIndexed { i, value -> putUint16(bytes, 2 * i, value) }
+            return bytes
+        }
+
+        private fun vector8(data: ByteArray) = byteArrayOf(data.size.toByte()) + data
+
+        private fun vector16(data: ByteArray) = uint16s(data.size) + data
+
+        private fun vector24(data: ByteArray) = byteArrayOf((data.size shr 16).toByte()) + uint16s(data.size and 0xFFFF) + data
+
+        private fun ByteArrayOutputStream.extension(type: Int, data: ByteArray) {
+            write(uint16s(type))
+            write(vector16(data))
+        }
+
+        // Big-endian, left-padded to size: BigInteger adds a sign byte or drops leading zeros
+        private fun unsigned(value: BigInteger, size: Int): ByteArray {
+            val bytes = value.toByteArray()
+            return if (bytes.size >= size) bytes.copyOfRange(bytes.size - size, bytes.size)
+            else ByteArray(size - bytes.size) + bytes
+        }
+    }
+}
@@ -14,14 +14,19 @@ import info.anodsplace.headunit.aap.protocol.proto.Input
 import info.anodsplace.headunit.aap.protocol.proto.Sensors
 import info.anodsplace.headunit.connection.AccessoryConnection
 import info.anodsplace.headunit.connection.AccessoryConnection.Companion.CONNECT_TIMEOUT
+import info.anodsplace.headunit.connection.MessageStreamConnection
+import info.anodsplace.headunit.connection.NativeSocketAccessoryConnection
+import info.anodsplace.headunit.connection.NativeUsbAccessoryConnection
 import info.anodsplace.headunit.connection.UsbAccessoryConnection
-import info.anodsplace.headunit.contract.DisconnectIntent
 import info.anodsplace.headunit.contract.ProjectionActivityRequest
 import info.anodsplace.headunit.decoder.AudioDecoder
+import info.anodsplace.headunit.decoder.MemoryProfile
 import info.anodsplace.headunit.decoder.MicRecorder
+import info.anodsplace.headunit.decoder.VideoCalibration
 import info.anodsplace.headunit.decoder.VideoFrameQueue
 import info.anodsplace.headunit.utils.*
 import java.util.*
+import java.util.concurrent.ConcurrentLinkedQueue
 
 class AapTransport(
         audioDecoder: AudioDecoder,
@@ -37,18 +42,30 @@ class AapTransport(
     private val micRecorder: MicRecorder = MicRecorder(settings.micSampleRate, context)
     private val sessionIds = SparseIntArray(4)
     private val startedSensors = HashSet<Int>(4)
-    private val ssl: AapSsl = AapSsl.INSTANCE
+    private val ssl: AapSsl = if (settings.exportableTls) AapTlsClient() else AapSsl.INSTANCE
     private val keyCodes = settings.keyCodes.entries.associateTo(mutableMapOf()) {
         it.value to it.key
     }
     private val modeManager: UiModeManager =  context.getSystemService(UI_MODE_SERVICE) as UiModeManager
     private var connection: AccessoryConnection? = null
-    private var usbConnection: UsbAccessoryConnection? = null
+    private var usbConnection: MessageStreamConnection? = null
     private var aapRead: AapRead? = null
     private var messageHandler: AapMessageHandler? = null
     private var handler: Handler? = null
     private val pendingMessages = mutableListOf<AapMessage>()
+    private val urgentMessages = ConcurrentLinkedQueue<AapMessage>()
+    // Held across encrypt and write: touch records are written from AAP-Input too
+    private val sendLock = Any()
+    // Outgoing records are encrypted natively by usbConnection, guarded by sendLock
+    private var nativeEncrypt = false
+    // Pings are answered natively, AapControl must not reply to them as well
+    @Volatile internal var nativeKeepalive = false
+        private set
     private var useUsbPolling = false
+    // The video pipeline runs on usbConnection's native video stage
+    private var nativeVideo = false
+    // quit() runs more than once on the way out, one calibration sample per session
+    private var calibrationRecorded = false
 
     val isAlive: Boolean
         get() = pollThread.isAlive
@@ -75,6 +92,13 @@ class AapTransport(
                 this.sendEncryptedMessage(msg.obj as ByteArray, size)
                 true
             }
+            MSG_SEND_URGENT -> {
+                while (true) {
+                    val message = urgentMessages.poll() ?: break
+                    this.sendEncryptedMessage(message.data, message.size)
+                }
+                true
+            }
             MSG_POLL -> {
                 pollCount++
                 if (pollCount <= 10) {
@@ -98,7 +122,7 @@ class AapTransport(
                         AppLog.e { "Early poll failure (poll #$pollCount) - USB may need more time to stabilize" }
                     }
                     AppLog.e { "Poll returned error after $pollCount polls, quitting transport" }
-                    this.quit()
+                    this.quit(holdMedia = true)
                 }
                 true
             }
@@ -107,36 +131,58 @@ class AapTransport(
     }
 
     private fun sendEncryptedMessage(data: ByteArray, length: Int) {
-        // Encrypt from data[4] onwards
-        val encryptedData = ssl.encrypt(AapMessage.HEADER_SIZE, length - AapMessage.HEADER_SIZE, data)
-
-        // Copy data[0->4] into buffer. 3, 4 are length.
-        encryptedData[0] = data[0]
-        encryptedData[1] = data[1]
-        Utils.intToBytes(encryptedData.size - AapMessage.HEADER_SIZE, 2, encryptedData)
-
-        // Write 4 bytes of header and the encrypted data
-        val size = connection!!.write(encryptedData)
-        AppLog.d { "Sent size: $size" }
+        synchronized(sendLock) {
+            if (nativeEncrypt) {
+                // Sealed straight into a reused native record, nothing allocated here
+                val size = usbConnection?.sendRecord(data, length) ?: return
+                AppLog.d { "Sent size: $size" }
+                return
+            }
+            val connection = this.connection ?: return
+            // Encrypt from data[4] onwards
+            val encryptedData = ssl.encrypt(AapMessage.HEADER_SIZE, length - AapMessage.HEADER_SIZE, data)
+
+            // Copy data[0->4] into buffer. 3, 4 are length.
+            encryptedData[0] = data[0]
+            encryptedData[1] = data[1]
+            Utils.intToBytes(encryptedData.size - AapMessage.HEADER_SIZE, 2, encryptedData)
+
+            // Write 4 bytes of header and the encrypted data
+            val size = connection.write(encryptedData)
+            AppLog.d { "Sent size: $size" }
+        }
     }
 
-    internal fun quit() {
+    /**
+     * @param holdMedia The transport was lost mid-session: keep the decoders,
+     *   audio tracks and projection for a reconnect, see [AppComponent.holdMedia]
+     */
+    internal fun quit(holdMedia: Boolean = false) {
         AppLog.i { "Transport quit - cleaning up" }
 
         // Step 1: Immediately clear callbacks to prevent new messages during cleanup
         // This MUST happen first to avoid race conditions
         micRecorder.listener = null
+        App.provide(context).videoDecoderController.onKeyframeNeeded = null
         if (useUsbPolling) {
             usbConnection?.let { conn ->
                 conn.onAudioMessage = null
                 conn.onVideoMessage = null
                 conn.onControlMessage = null
                 conn.onDisconnect = null
+                (conn as? NativeUsbAccessoryConnection)?.onSensorBatch = null
+                (conn as? NativeUsbAccessoryConnection)?.onInputRecord = null
+                (conn as? NativeUsbAccessoryConnection)?.onVideoMediaConsumed = null
+                (conn as? NativeUsbAccessoryConnection)?.onVideoKeyframeNeeded = null
+                (conn as? NativeUsbAccessoryConnection)?.onAudioMediaConsumed = null
+                (conn as? NativeUsbAccessoryConnection)?.onMediaAck = null
+                (conn as? NativeUsbAccessoryConnection)?.onMicRecord = null
             }
         }
 
         // Step 2: Stop USB reading (stops poll thread)
         if (useUsbPolling) {
+            stopMic()
             usbConnection?.stopReading()
         }
 
@@ -152,22 +198,49 @@ class AapTransport(
         synchronized(pendingMessages) {
             pendingMessages.clear()
         }
+        urgentMessages.clear()
 
         // Step 6: Reset video state (safe now that callbacks are cleared)
         aapVideo.reset()
 
         // Step 7: Clean up USB connection references
         if (useUsbPolling) {
-            usbConnection = null
+            synchronized(sendLock) {
+                nativeEncrypt = false
+                nativeKeepalive = false
+                usbConnection = null
+            }
             useUsbPolling = false
         }
 
-        // Step 8: Notify that we're disconnecting - use LocalBroadcastManager for reliability
-        App.provide(context).localBroadcastManager.sendBroadcast(DisconnectIntent())
+        // Report what the pipeline held before the decoder releases its queue
+        val nativeSession = connection is NativeUsbAccessoryConnection || connection is NativeSocketAccessoryConnection
+        AppLog.i { MemoryProfile.report(App.provide(context).videoDecoderController.getFrameQueue(), nativeSession) }
+
+        // Record how this session decoded before the decoder's stats go away
+        if (settings.adaptiveVideo && !calibrationRecorded) {
+            calibrationRecorded = true
+            App.provide(context).videoDecoderController.getStats()?.let {
+                VideoCalibration(settings).record(settings.resolution, it)
+            }
+        }
 
-        // Step 9: Stop decoders (must be after video reset)
-        App.provide(context).audioDecoder.stop()
-        App.provide(context).videoDecoderController.stop("AapTransport::quit")
+        // The native video stage closes with the connection, its pipeline can't be held
+        if (nativeVideo) {
+            nativeVideo = false
+            val controller = App.provide(context).videoDecoderController
+            controller.stop("native video stage closed")
+            controller.setNativeSource(null)
+            controller.setNativeDecoder(null)
+        }
+
+        // Step 8: Notify that we're disconnecting and stop decoders (must be after
+        // video reset), or leave both to the reconnect window
+        if (holdMedia) {
+            App.provide(context).holdMedia()
+        } else {
+            App.provide(context).stopMedia("AapTransport::quit")
+        }
 
         AppLog.i { "Transport cleanup complete" }
     }
@@ -185,8 +258,10 @@ class AapTransport(
 
         // USB connection needs time to stabilize after handshake
         // Without this delay, early poll reads may fail and critical setup messages can be lost
-        // Older Android versions (especially 4.3) need longer stabilization time
+        // Older Android versions (especially 4.3) need longer stabilization time.
+        // A pre-warmed native connection submits its reads before anything is sent.
         val stabilizationDelay = when {
+            isPrewarmed(connection) -> 0L
             android.os.Build.VERSION.SDK_INT < android.os.Build.VERSION_CODES.KITKAT -> {
                 AppLog.i { "Android 4.3: waiting 1000ms for USB to stabilize..." }
                 1000L
@@ -200,13 +275,15 @@ class AapTransport(
                 200L
             }
         }
-        Thread.sleep(stabilizationDelay)
+        if (stabilizationDelay > 0) {
+            Thread.sleep(stabilizationDelay)
+        }
 
         this.connection = connection
         pollCount = 0
 
-        // Check if this is a USB connection with polling
-        if (connection is UsbAccessoryConnection) {
+        // USB and native socket connections deliver messages through callbacks
+        if (connection is MessageStreamConnection) {
             return startUsbPolling(connection)
         }
 
@@ -214,7 +291,7 @@ class AapTransport(
         return startLegacyPoll(connection)
     }
 
-    private fun startUsbPolling(connection: UsbAccessoryConnection): Boolean {
+    private fun startUsbPolling(connection: MessageStreamConnection): Boolean {
         AppLog.i { "Starting USB polling transport" }
         useUsbPolling = true
         usbConnection = connection
@@ -223,7 +300,11 @@ class AapTransport(
         messageHandler = AapMessageHandlerImpl(this, micRecorder, aapAudio, aapVideo, settings, context)
         
         // Set SSL for decryption
-        connection.ssl = ssl
+        when (connection) {
+            is UsbAccessoryConnection -> connection.ssl = ssl
+            is NativeUsbAccessoryConnection -> connection.ssl = ssl
+            is NativeSocketAccessoryConnection -> connection.ssl = ssl
+        }
         
         // Set up message callbacks - all callbacks route to the same handler
         // Native layer already prioritizes audio over video over control
@@ -253,7 +334,22 @@ class AapTransport(
         
         connection.onDisconnect = {
             AppLog.i { "Native USB disconnected" }
-            quit()
+            quit(holdMedia = true)
+        }
+
+        if (connection is NativeUsbAccessoryConnection) {
+            connection.onSensorBatch = { data, length -> sendSensorBatch(data, length) }
+            // Written straight from AAP-Input, ahead of anything on the handler
+            connection.onInputRecord = { data, length -> sendEncryptedMessage(data, length) }
+            // Native video stage: media records never reach the handler, ACK them here
+            connection.onVideoMediaConsumed = { channel -> sendMediaAck(channel) }
+            connection.onVideoKeyframeNeeded = { requestKeyframe() }
+            // Native audio output, the same for PCM played without the handler
+            connection.onAudioMediaConsumed = { channel -> sendMediaAck(channel) }
+            // Media ACK batching: only called for ACKs native keepalive didn't write itself
+            connection.onMediaAck = { channel, count -> sendMediaAck(channel, count) }
+            // Native mic input, see startMic()
+            connection.onMicRecord = { data, length -> sendMicRecord(data, length) }
         }
         
         // Start the poll thread for sending messages
@@ -263,9 +359,39 @@ class AapTransport(
 
         // Start USB polling
         AppLog.i { "Calling startReading() on USB connection..." }
-        connection.startReading()
+        if (!connection.startReading()) {
+            AppLog.e { "startReading() failed, dropping the session" }
+            quit(holdMedia = true)
+            return false
+        }
         AppLog.i { "startReading() returned, USB polling should be running now" }
 
+        // Under sendLock: no record is mid-encrypt while the write sequence is exported
+        synchronized(sendLock) {
+            nativeEncrypt = connection.enableNativeEncrypt()
+        }
+        if (nativeEncrypt && connection.enableNativeKeepalive()) {
+            // Sessions started before this still get their ACKs natively
+            synchronized(sessionIds) {
+                for (i in 0 until sessionIds.size()) {
+                    connection.setMediaSessionId(sessionIds.keyAt(i), sessionIds.valueAt(i))
+                }
+            }
+            nativeKeepalive = true
+        }
+
+        // Native video stage: frames are read from it, or decoded on it natively
+        if (connection is NativeUsbAccessoryConnection && connection.videoFrameSource != null) {
+            val controller = App.provide(context).videoDecoderController
+            // A pipeline held from the last session doesn't read this stage, restart it below
+            controller.stop("native video stage")
+            controller.setNativeSource(connection.videoFrameSource)
+            controller.setNativeDecoder(connection.videoDecoder)
+            nativeVideo = true
+        }
+
+        App.provide(context).videoDecoderController.onKeyframeNeeded = { requestKeyframe() }
+
         // Restart video decoder if surface is still available from previous connection
         App.provide(context).videoDecoderController.restartIfSurfaceAvailable()
 
@@ -277,7 +403,7 @@ class AapTransport(
         AppLog.i { "Starting legacy poll-based transport" }
         useUsbPolling = false
         
-        aapRead = AapRead.Factory.create(connection, this, micRecorder, aapAudio, aapVideo, settings, context)
+        aapRead = AapRead.Factory.create(connection, ssl, this, micRecorder, aapAudio, aapVideo, settings, context)
 
         pollThread.start()
         handler = Handler(pollThread.looper, this)
@@ -285,6 +411,8 @@ class AapTransport(
         flushPendingMessages()
         handler!!.sendEmptyMessage(MSG_POLL)
         
+        App.provide(context).videoDecoderController.onKeyframeNeeded = { requestKeyframe() }
+
         // Restart video decoder if surface is still available from previous connection
         // This handles the case where activity stayed open during reconnection
         App.provide(context).videoDecoderController.restartIfSurfaceAvailable()
@@ -293,12 +421,21 @@ class AapTransport(
         return true
     }
 
+    private fun isPrewarmed(connection: AccessoryConnection): Boolean {
+        return connection is MessageStreamConnection && connection.isPrewarmed
+    }
+
     private fun handshake(connection: AccessoryConnection): Boolean {
         val buffer = ByteArray(Messages.DEF_BUFFER_LENGTH)
 
-        // Give the phone time to initialize Android Auto after accessory mode switch
-        AppLog.i { "Waiting for phone to initialize..." }
-        Thread.sleep(500)
+        // Pre-warmed connections wait on the transfers instead: the version
+        // request write blocks until the phone takes it, up to CONNECT_TIMEOUT
+        val prewarmed = isPrewarmed(connection)
+        if (!prewarmed) {
+            // Give the phone time to initialize Android Auto after accessory mode switch
+            AppLog.i { "Waiting for phone to initialize..." }
+            Thread.sleep(500)
+        }
 
         // Version request with retry
         AppLog.i { "Sending version request..." }
@@ -312,7 +449,9 @@ class AapTransport(
                 break
             }
             AppLog.e { "Version request attempt $attempt failed: ret=$ret" }
-            Thread.sleep(500) // Wait before retry
+            if (!prewarmed) {
+                Thread.sleep(500) // Wait before retry
+            }
         }
 
         if (ret < 0) {
@@ -377,10 +516,11 @@ class AapTransport(
         }
 
         // Verify handshake actually completed
-        if (ssl is AapSslImpl && !ssl.isHandshakeComplete()) {
-            AppLog.e { "SSL handshake did NOT complete properly - engine still in handshake state" }
+        if (!ssl.isHandshakeComplete()) {
+            AppLog.e { "SSL handshake did NOT complete properly - still in handshake state" }
             return false
         }
+        AppLog.i { if (ssl.completeHandshake()) "TLS session resumed" else "TLS session negotiated" }
 
         // Status = OK
         // byte ac_buf [] = {0, 3, 0, 4, 0, 4, 8, 0};
@@ -431,9 +571,51 @@ class AapTransport(
         send(KeyCodeEvent(ts, aapKeyCode, isPress))
     }
 
+    /**
+     * Send a touch sample through the native fast path when the connection has one.
+     * @param pointers pointerCount (id, x, y) triples in phone screen coordinates
+     * @return false if there is no fast path; send a TouchEvent instead
+     */
+    fun sendTouch(timestampNs: Long, action: Input.TouchEvent.PointerAction, actionIndex: Int,
+                  pointerCount: Int, pointers: IntArray): Boolean {
+        val native = usbConnection as? NativeUsbAccessoryConnection ?: return false
+        return native.submitTouch(timestampNs, action.number, actionIndex, pointerCount, pointers)
+    }
+
+    /**
+     * Capture the microphone natively when the connection can and the
+     * Microphone native feature is on, the records then arrive through
+     * sendMicRecord().
+     * @return false if there is no native mic; start MicRecorder instead
+     */
+    fun startMic(): Boolean {
+        if (!settings.hasNativeFeature(Settings.NATIVE_MIC)) return false
+        val native = usbConnection as? NativeUsbAccessoryConnection ?: return false
+        return native.startMic(settings.micSampleRate)
+    }
+
+    fun stopMic() {
+        (usbConnection as? NativeUsbAccessoryConnection)?.stopMic()
+    }
+
+    /**
+     * Stop and flush native playback of an audio channel.
+     * @return false if audio isn't played natively, stop it on AapAudio instead
+     */
+    internal fun stopAudioOutput(channel: Int): Boolean {
+        val native = usbConnection as? NativeUsbAccessoryConnection ?: return false
+        if (!native.nativeAudio) return false
+        native.stopAudioOutput(channel)
+        return true
+    }
+
     fun send(sensor: SensorEvent): Boolean {
         return if (startedSensors.contains(sensor.sensorType)) {
-            send(sensor as AapMessage)
+            // Coalesced natively when enabled, sent later by sendSensorBatch()
+            val native = usbConnection as? NativeUsbAccessoryConnection
+            if (native?.submitSensor(sensor.sensorType, sensor) != true) {
+                send(sensor as AapMessage)
+            }
             true
         } else {
             AppLog.e { "Sensor " + sensor.sensorType + " is not started yet" }
@@ -453,8 +635,16 @@ class AapTransport(
             }
         } else {
             AppLog.d { message.toString() }
-            val msg = h.obtainMessage(MSG_SEND, 0, message.size, message.data)
-            h.sendMessage(msg)
+            if (message.channel == Channel.ID_MIC) {
+                val msg = h.obtainMessage(MSG_SEND, 0, message.size, message.data)
+                h.sendMessage(msg)
+            } else {
+                // Encrypted records must go out in the order they are encrypted,
+                // so control, input and ACKs overtake queued mic audio here,
+                // before encryption, not in the USB layer
+                urgentMessages.add(message)
+                h.sendMessageAtFrontOfQueue(h.obtainMessage(MSG_SEND_URGENT))
+            }
         }
     }
 
@@ -472,16 +662,39 @@ class AapTransport(
         }
     }
 
+    /**
+     * Tell the phone whether the projection is on screen. In the background
+     * the connection idles its video pipeline until focus is back.
+     */
+    internal fun setVideoFocus(gain: Boolean) {
+        send(VideoFocusEvent(gain = gain, unsolicited = false))
+        (connection as? MessageStreamConnection)?.setIdle(!gain)
+    }
+
     internal fun gainVideoFocus() {
         context.sendBroadcast(ProjectionActivityRequest())
     }
 
-    internal fun sendMediaAck(channel: Int) {
-        send(MediaAck(channel, sessionIds.get(channel)))
+    /**
+     * Re-send video focus, the phone then restarts the stream with an IDR.
+     */
+    internal fun requestKeyframe() {
+        AppLog.i { "Requesting video keyframe" }
+        send(VideoFocusEvent(gain = true, unsolicited = true))
+    }
+
+    internal fun sendMediaAck(channel: Int, count: Int = 1) {
+        val sessionId = synchronized(sessionIds) { sessionIds.get(channel) }
+        send(MediaAck(channel, sessionId, count))
     }
 
     internal fun setSessionId(channel: Int, sessionId: Int) {
-        sessionIds.put(channel, sessionId)
+        synchronized(sessionIds) {
+            sessionIds.put(channel, sessionId)
+        }
+        if (nativeKeepalive) {
+            usbConnection?.setMediaSessionId(channel, sessionId)
+        }
     }
 
     override fun onMicDataAvailable(mic_buf: ByteArray, mic_audio_len: Int) {
@@ -492,13 +705,32 @@ class AapTransport(
             data[1] = 0x0b
             Utils.putTime(2, data, SystemClock.elapsedRealtime())
             System.arraycopy(mic_buf, 0, data, 10, mic_audio_len)
-            send(AapMessage(Channel.ID_MIC, 0x0b.toByte(), -1, 2, length, data))
+            sendMicRecord(data, length)
         }
     }
 
+    /**
+     * Send a mic record already framed like onMicDataAvailable() does,
+     * e.g. by the native mic input.
+     */
+    internal fun sendMicRecord(data: ByteArray, length: Int) {
+        send(AapMessage(Channel.ID_MIC, 0x0b.toByte(), -1, 2, length, data))
+    }
+
+    /**
+     * Send a coalesced SENSOR_EVENT record from the native sensor aggregator.
+     * Telemetry is latency tolerant, so it queues behind control and input
+     * like mic audio does.
+     */
+    private fun sendSensorBatch(data: ByteArray, length: Int) {
+        val h = handler ?: return
+        h.sendMessage(h.obtainMessage(MSG_SEND, 0, length, data))
+    }
+
     companion object {
         private const val MSG_POLL = 1
         private const val MSG_SEND = 2
+        private const val MSG_SEND_URGENT = 3
     }
 }
 
@@ -37,4 +37,8 @@ object Channel {
     fun isAudio(chan: Int): Boolean {
         return chan == ID_AUD || chan == ID_AU1 || chan == ID_AU2
     }
+
+    fun isVideo(chan: Int): Boolean {
+        return chan == ID_VID
+    }
 }
\ No newline at end of file
@@ -28,6 +28,25 @@ class Screen(val width: Int, val height: Int, val baseDpi: Int) {
             }
         }
 
+        /**
+         * The resolution steps below resolutionType in [allResolutions],
+         * never below 800x480.
+         */
+        fun stepDown(
+            resolutionType: Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType,
+            steps: Int
+        ): Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType {
+            val index = allResolutions.indexOf(forResolution(resolutionType))
+            val target = allResolutions[(index - steps).coerceIn(0, index)]
+            return forDisplaySize(target.width, target.height)
+        }
+
+        /**
+         * How many resolutions there are below resolutionType.
+         */
+        fun stepsBelow(resolutionType: Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType): Int =
+            allResolutions.indexOf(forResolution(resolutionType))
+
         /**
          * Find the best resolution for the given display dimensions.
          * Picks the largest resolution that fits within the display, or the smallest if none fit.
@@ -5,17 +5,18 @@ import info.anodsplace.headunit.aap.AapMessage
 import info.anodsplace.headunit.aap.protocol.proto.Media
 
 
-class MediaAck(channel: Int, sessionId: Int)
-    : AapMessage(channel, Media.MediaMsgType.ACK_VALUE, makeProto(sessionId), ackBuf) {
+class MediaAck(channel: Int, sessionId: Int, count: Int = 1)
+    : AapMessage(channel, Media.MediaMsgType.ACK_VALUE, makeProto(sessionId, count), ackBuf) {
     companion object {
 
         private val mediaAck = Media.Ack.newBuilder()
         private val ackBuf = ByteArray(20)
 
-        private fun makeProto(sessionId: Int): MessageLite {
+        private fun makeProto(sessionId: Int, count: Int): MessageLite {
             mediaAck.clear()
             mediaAck.sessionId = sessionId
-            mediaAck.ack = 1
+            // One ACK may cover several records
+            mediaAck.ack = count
             // TODO: check creation of new object can be avoided
             return mediaAck.build()
         }
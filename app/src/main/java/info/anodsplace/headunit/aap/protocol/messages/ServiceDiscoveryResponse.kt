@@ -9,6 +9,7 @@ import info.anodsplace.headunit.aap.protocol.Screen
 import info.anodsplace.headunit.aap.protocol.proto.Control
 import info.anodsplace.headunit.aap.protocol.proto.Media
 import info.anodsplace.headunit.aap.protocol.proto.Sensors
+import info.anodsplace.headunit.decoder.VideoCalibration
 import info.anodsplace.headunit.utils.AppLog
 import info.anodsplace.headunit.utils.Settings
 import info.anodsplace.headunit.view.AspectRatioCalculator
@@ -20,8 +21,9 @@ class ServiceDiscoveryResponse(settings: Settings, @Suppress("UNUSED_PARAMETER")
         private fun makeProto(settings: Settings, displayWidth: Int, displayHeight: Int): MessageLite {
             val services = mutableListOf<Control.Service>()
 
-            // Use the user's selected resolution from settings
-            val resolution = settings.resolution
+            // Use the user's selected resolution from settings, or the
+            // sustainable step below it this device was calibrated to
+            val resolution = VideoCalibration(settings).offeredResolution()
             val screen = Screen.forResolution(resolution)
             
             // Calculate letterbox margins and adjusted DPI if aspect ratio preservation is enabled
@@ -0,0 +1,92 @@
+package info.anodsplace.headunit.connection
+
+import android.os.Build
+import info.anodsplace.headunit.decoder.DecoderProbe
+import info.anodsplace.headunit.utils.AppLog
+import info.anodsplace.headunit.utils.Settings
+
+/**
+ * Tunes the pipeline to this device once: on first launch, and again after
+ * an OS update changes the build fingerprint.
+ *
+ * NativeUsb.calibrate() measures copy, decrypt and receive path throughput
+ * and the core layout and picks the USB transfer depth and size, the
+ * decrypt and dispatch worker counts and the video queue depth from them;
+ * DecoderProbe finds the largest resolution the decoder keeps up with.
+ * The results are kept in Settings, where they are the defaults a setting
+ * of the user's own still overrides, and apply from the next connection;
+ * the transfer and decrypt values only to native USB, see Settings.nativeUsb.
+ */
+class DeviceCalibration(private val settings: Settings) {
+
+    /**
+     * Native pipeline parameters and video limit, 0 (or null) for the default.
+     */
+    class Tuning(
+        val usbTransfers: Int = 0,
+        val usbTransferSize: Int = 0,
+        val decryptWorkers: Int = 0,
+        val poolWorkers: Int = 0,
+        val videoQueueSlots: Int = 0,
+        val videoQueueBytes: Int = 0,
+        val maxResolution: Int? = null
+    ) {
+        override fun toString(): String =
+            "$usbTransfers x $usbTransferSize B transfers, $decryptWorkers decrypt workers, " +
+                "$poolWorkers pool workers, video queue $videoQueueSlots/$videoQueueBytes B, max resolution $maxResolution"
+    }
+
+    val isNeeded: Boolean
+        get() = settings.calibrationBuild != Build.FINGERPRINT
+
+    /**
+     * Calibrate on a background thread, unless this build already was.
+     */
+    fun runIfNeeded() {
+        if (!isNeeded) {
+            return
+        }
+        Thread({ run() }, THREAD_NAME).start()
+    }
+
+    /**
+     * Calibrate on the calling thread, a few seconds with the decode probe; not on the main thread.
+     */
+    fun run(): Tuning? {
+        val measured = NativeUsb.calibrate()
+        if (measured == null) {
+            AppLog.e { "Calibration failed, keeping the defaults" }
+            return null
+        }
+        val tuning = Tuning(
+            usbTransfers = measured[TUNED_TRANSFERS].toInt(),
+            usbTransferSize = measured[TUNED_TRANSFER_SIZE].toInt(),
+            decryptWorkers = measured[TUNED_DECRYPT_WORKERS].toInt(),
+            poolWorkers = measured[TUNED_POOL_WORKERS].toInt(),
+            videoQueueSlots = measured[TUNED_VIDEO_SLOTS].toInt(),
+            videoQueueBytes = measured[TUNED_VIDEO_BYTES].toInt(),
+            maxResolution = DecoderProbe.maxResolution()?.number
+        )
+        AppLog.i {
+            "Calibrated: copy ${measured[COPY_MBPS]} MB/s, decrypt ${measured[DECRYPT_MBPS]} MB/s, " +
+                "receive ${measured[PIPELINE_MBPS]} MB/s on ${measured[CPUS]} CPUs; $tuning"
+        }
+        settings.setCalibration(Build.FINGERPRINT, tuning)
+        return tuning
+    }
+
+    companion object {
+        private const val THREAD_NAME = "Calibration"
+        // Indices into NativeUsb.calibrate()
+        private const val COPY_MBPS = 0
+        private const val DECRYPT_MBPS = 1
+        private const val PIPELINE_MBPS = 2
+        private const val CPUS = 3
+        private const val TUNED_TRANSFERS = 6
+        private const val TUNED_TRANSFER_SIZE = 7
+        private const val TUNED_DECRYPT_WORKERS = 8
+        private const val TUNED_POOL_WORKERS = 9
+        private const val TUNED_VIDEO_SLOTS = 10
+        private const val TUNED_VIDEO_BYTES = 11
+    }
+}
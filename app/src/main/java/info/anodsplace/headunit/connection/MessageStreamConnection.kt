@@ -0,0 +1,56 @@
+package info.anodsplace.headunit.connection
+
+import info.anodsplace.headunit.aap.AapMessage
+
+/**
+ * Connection that reads and decrypts records itself once the handshake is
+ * done, delivering messages through callbacks instead of AapRead polling.
+ */
+interface MessageStreamConnection : AccessoryConnection {
+    var onAudioMessage: ((AapMessage) -> Unit)?
+    var onVideoMessage: ((AapMessage) -> Unit)?
+    var onControlMessage: ((AapMessage) -> Unit)?
+    var onDisconnect: (() -> Unit)?
+
+    /**
+     * True once the native read path is set up before the handshake: reads
+     * and writes then wait on the transfers themselves, no settle delays needed.
+     */
+    val isPrewarmed: Boolean
+        get() = false
+
+    /**
+     * Encrypt outgoing records natively from now on, with the write keys of
+     * the finished handshake. Call it with no record being encrypted elsewhere.
+     * @return true if every record must then go through [sendRecord]
+     */
+    fun enableNativeEncrypt(): Boolean = false
+
+    /**
+     * Encrypt and write one message: data holds the 4-byte AAP header, then the plaintext.
+     * @return Bytes written, or negative on error
+     */
+    fun sendRecord(data: ByteArray, length: Int): Int = -1
+
+    /**
+     * Answer pings natively from now on, after [enableNativeEncrypt].
+     * @return true if Kotlin must no longer reply to ping requests
+     */
+    fun enableNativeKeepalive(): Boolean = false
+
+    /**
+     * Session a media channel's natively sent ACKs refer to.
+     */
+    fun setMediaSessionId(channel: Int, sessionId: Int) {}
+
+    /**
+     * Projection went to the background, or came back: see [NativeUsb.setIdle].
+     */
+    fun setIdle(idle: Boolean) {}
+
+    /**
+     * @return false if reading couldn't start, the session has to be dropped
+     */
+    fun startReading(): Boolean
+    fun stopReading()
+}
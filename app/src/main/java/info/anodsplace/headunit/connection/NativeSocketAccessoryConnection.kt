@@ -0,0 +1,314 @@
+package info.anodsplace.headunit.connection
+
+import android.os.ParcelFileDescriptor
+import info.anodsplace.headunit.aap.AapMessage
+import info.anodsplace.headunit.aap.AapMessageIncoming
+import info.anodsplace.headunit.aap.AapSsl
+import info.anodsplace.headunit.aap.protocol.Channel
+import info.anodsplace.headunit.decoder.MemoryProfile
+import info.anodsplace.headunit.utils.AppLog
+import java.io.IOException
+import java.io.InputStream
+import java.io.OutputStream
+import java.net.InetSocketAddress
+import java.net.Socket
+import java.nio.ByteBuffer
+
+/**
+ * Wireless (TCP) connection on the native engine.
+ *
+ * The handshake runs over the Java socket streams. startReading() then
+ * hands the socket to the native TcpConnection: one epoll event thread
+ * feeds the same framer, decryption and AAP-Audio/AAP-Video/AAP-Control/AAP-Background
+ * dispatcher as NativeUsbAccessoryConnection, replacing the blocking
+ * AapReadMultipleMessages loop that SocketAccessoryConnection relies on.
+ *
+ * useNativeKeepalive answers ping requests natively once outgoing records
+ * are encrypted natively, as on USB. memoryProfile sizes the native pools.
+ * useQualityGovernor sheds background records when the device runs hot or
+ * the pipeline falls behind, see NativeUsb.setQualityGovernorEnabled().
+ * stallSnapshotPath enables the stall watchdog, which writes a diagnostic
+ * snapshot there when a native thread stops making progress. statsPath
+ * publishes the native stats there for NativeStatsFile readers.
+ */
+class NativeSocketAccessoryConnection(
+    val ip: String,
+    private val port: Int = DEFAULT_PORT,
+    private val dispatchQueues: NativeUsb.DispatchQueues? = null,
+    private val useNativeKeepalive: Boolean = false,
+    private val useQualityGovernor: Boolean = false,
+    private val stallSnapshotPath: String? = null,
+    private val statsPath: String? = null,
+    private val memoryProfile: MemoryProfile = MemoryProfile.STANDARD
+) : MessageStreamConnection {
+
+    private val socket = Socket()
+    // Unbuffered: a buffered stream could swallow records meant for the native reader
+    private var inputStream: InputStream? = null
+    private var outputStream: OutputStream? = null
+    private var nativeHandle: Long = 0
+    private val callbacks = NativeUsb.Callbacks()
+
+    override var onAudioMessage: ((AapMessage) -> Unit)? = null
+    override var onVideoMessage: ((AapMessage) -> Unit)? = null
+    override var onControlMessage: ((AapMessage) -> Unit)? = null
+    override var onDisconnect: (() -> Unit)? = null
+
+    // SSL for decryption (set by AapTransport after handshake)
+    internal var ssl: AapSsl? = null
+    // Outgoing records are encrypted natively, see enableNativeEncrypt()
+    private var nativeEncrypt = false
+    // Pings are answered natively, see enableNativeKeepalive()
+    private var nativeKeepalive = false
+
+    // Decrypt target for the native dispatcher, read directly by native code
+    private var plaintextBuffer: ByteBuffer? = null
+
+    // Dispatched records, a channel is delivered by one native thread at a time
+    private val dispatchedMessages = AapMessageIncoming.ChannelMessages()
+
+    override val isSingleMessage: Boolean = true
+
+    override val isConnected: Boolean
+        get() = socket.isConnected
+
+    override fun connect(listener: AccessoryConnection.Listener) {
+        Thread({
+            try {
+                socket.tcpNoDelay = true
+                socket.reuseAddress = true
+                // Before connect, so the window scale is negotiated for it
+                socket.receiveBufferSize = RECEIVE_BUFFER_SIZE
+                socket.connect(InetSocketAddress(ip, port), CONNECT_TIMEOUT_MS)
+                synchronized(this) {
+                    inputStream = socket.getInputStream()
+                    outputStream = socket.getOutputStream()
+                }
+                listener.onConnectionResult(socket.isConnected)
+            } catch (e: IOException) {
+                AppLog.e(e)
+                listener.onConnectionResult(false)
+            }
+        }, "socket_connect").start()
+    }
+
+    private fun setupCallbacks() {
+        callbacks.decryptRecordCallback = { channel, flags, data, length ->
+            decryptRecord(channel, flags, data, length)
+        }
+        callbacks.audioRecordCallback = { channel, flags, msgType, data, length ->
+            onAudioMessage?.invoke(dispatchedMessages.recycle(channel, flags, msgType, data, length))
+        }
+        callbacks.videoRecordCallback = { channel, flags, msgType, data, length ->
+            onVideoMessage?.invoke(dispatchedMessages.recycle(channel, flags, msgType, data, length))
+        }
+        callbacks.controlRecordCallback = { channel, flags, msgType, data, length ->
+            onControlMessage?.invoke(dispatchedMessages.recycle(channel, flags, msgType, data, length))
+        }
+        callbacks.backgroundRecordCallback = { channel, flags, msgType, data, length ->
+            onControlMessage?.invoke(dispatchedMessages.recycle(channel, flags, msgType, data, length))
+        }
+        callbacks.errorCallback = { errorCode, message ->
+            AppLog.e { "Socket error $errorCode: $message" }
+            if (errorCode == -4) { // TcpConnection::ERROR_DISCONNECTED
+                onDisconnect?.invoke()
+            }
+        }
+    }
+
+    /**
+     * Decrypt a record for the native dispatcher (TCP event thread, record order).
+     * @return Plaintext length in plaintextBuffer, or -1 to drop the record
+     */
+    private fun decryptRecord(channel: Int, flags: Int, data: ByteArray, length: Int): Int {
+        val currentSsl = ssl
+        val out = plaintextBuffer
+        if (currentSsl == null || out == null) {
+            AppLog.e { "SSL not set, cannot process data" }
+            return -1
+        }
+        if (flags and 0x08 != 0x08) {
+            AppLog.e { "WRONG FLAG: enc_len: $length chan: $channel ${Channel.name(channel)} flags: 0x${flags.toString(16)}" }
+            return -1
+        }
+        return try {
+            currentSsl.decrypt(0, length, data, out)
+        } catch (e: Exception) {
+            AppLog.e(e) { "Error decrypting message on channel $channel" }
+            -1
+        }
+    }
+
+    /**
+     * Hand the socket to the native engine, after the handshake.
+     */
+    override fun startReading(): Boolean {
+        synchronized(this) {
+            if (nativeHandle != 0L) {
+                return true
+            }
+            if (!socket.isConnected) {
+                AppLog.e { "Cannot start reading: not connected" }
+                return false
+            }
+
+            // The duplicate shares the connection, the Java socket stays open until disconnect
+            val fd = ParcelFileDescriptor.fromSocket(socket).detachFd()
+            memoryProfile.applyNative()
+            val handle = NativeUsb.openSocket(fd, RECEIVE_BUFFER_SIZE)
+            if (handle == 0L) {
+                AppLog.e { "Failed to open native socket" }
+                return false
+            }
+
+            setupCallbacks()
+            NativeUsb.setCallbacks(handle, callbacks)
+            NativeUsb.setFramingEnabled(handle, true)
+            val out = ByteBuffer.allocateDirect(PLAINTEXT_BUFFER_SIZE)
+            if (!NativeUsb.setDispatchEnabled(handle, out, queues = dispatchQueues)) {
+                AppLog.e { "Native dispatch unavailable, closing native socket" }
+                NativeUsb.close(handle)
+                return false
+            }
+            plaintextBuffer = out
+            val keys = ssl?.exportReadKeys()
+            val nativeDecrypt = keys != null && NativeUsb.setReadKey(handle, keys.key, keys.salt, keys.sequence)
+            if (useQualityGovernor) {
+                NativeUsb.setQualityGovernorEnabled(handle)
+            }
+            if (stallSnapshotPath != null && !NativeUsb.setStallWatchdogEnabled(handle, stallSnapshotPath)) {
+                AppLog.e { "Failed to start the stall watchdog on $stallSnapshotPath" }
+            }
+            if (statsPath != null && !NativeUsb.setStatsExportEnabled(handle, statsPath)) {
+                AppLog.e { "Failed to export stats to $statsPath" }
+            }
+
+            nativeHandle = handle
+            NativeUsb.startReading(handle)
+            AppLog.i { "Native socket reading started, handle=$handle, nativeDecrypt=$nativeDecrypt" }
+            return true
+        }
+    }
+
+    override fun stopReading() {
+        synchronized(this) {
+            if (nativeHandle != 0L) {
+                NativeUsb.stopReading(nativeHandle)
+            }
+        }
+    }
+
+    override fun disconnect() {
+        synchronized(this) {
+            if (nativeHandle != 0L) {
+                AppLog.i { "Disconnecting native socket" }
+                NativeUsb.stopReading(nativeHandle)
+                NativeUsb.close(nativeHandle)
+                nativeHandle = 0
+                nativeEncrypt = false
+                nativeKeepalive = false
+            }
+            plaintextBuffer = null
+
+            inputStream = null
+            outputStream = null
+            if (socket.isConnected) {
+                try {
+                    socket.close()
+                } catch (e: IOException) {
+                    AppLog.e(e)
+                }
+            }
+        }
+    }
+
+    /**
+     * Write to the socket: Java stream during the handshake, native after startReading().
+     */
+    override fun enableNativeEncrypt(): Boolean {
+        synchronized(this) {
+            if (nativeHandle == 0L) return false
+            val keys = ssl?.exportWriteKeys() ?: return false
+            nativeEncrypt = NativeUsb.setWriteKey(nativeHandle, keys.key, keys.salt, keys.sequence)
+            AppLog.i { "Native encryption: $nativeEncrypt" }
+            return nativeEncrypt
+        }
+    }
+
+    override fun sendRecord(data: ByteArray, length: Int): Int {
+        synchronized(this) {
+            if (nativeHandle == 0L || !nativeEncrypt) return -1
+            return NativeUsb.sendRecord(nativeHandle, data, length)
+        }
+    }
+
+    override fun enableNativeKeepalive(): Boolean {
+        synchronized(this) {
+            if (nativeHandle == 0L || !nativeEncrypt || !useNativeKeepalive) return false
+            nativeKeepalive = NativeUsb.setNativeKeepalive(nativeHandle)
+            AppLog.i { "Native keepalive: $nativeKeepalive" }
+            return nativeKeepalive
+        }
+    }
+
+    override fun setMediaSessionId(channel: Int, sessionId: Int) {
+        synchronized(this) {
+            if (nativeHandle != 0L && nativeKeepalive) {
+                NativeUsb.setMediaSessionId(nativeHandle, channel, sessionId)
+            }
+        }
+    }
+
+    override fun setIdle(idle: Boolean) {
+        synchronized(this) {
+            if (nativeHandle != 0L) {
+                NativeUsb.setIdle(nativeHandle, idle)
+            }
+        }
+    }
+
+    override fun write(buf: ByteArray, offset: Int, length: Int, timeout: Int): Int {
+        synchronized(this) {
+            if (nativeHandle != 0L) {
+                return NativeUsb.write(nativeHandle, buf, offset, length)
+            }
+            val stream = outputStream ?: return -1
+            return try {
+                stream.write(buf, offset, length)
+                stream.flush()
+                length
+            } catch (e: IOException) {
+                AppLog.e(e)
+                -1
+            }
+        }
+    }
+
+    /**
+     * Synchronous read for the handshake phase.
+     * After startReading(), data comes via the native dispatcher instead.
+     */
+    override fun read(buf: ByteArray, offset: Int, length: Int, timeout: Int): Int {
+        val stream = synchronized(this) {
+            if (nativeHandle != 0L) {
+                AppLog.e { "Cannot read: the native reader owns the socket" }
+                return -1
+            }
+            inputStream
+        } ?: return -1
+        return try {
+            socket.soTimeout = timeout
+            stream.read(buf, offset, length)
+        } catch (e: IOException) {
+            -1
+        }
+    }
+
+    private companion object {
+        const val DEFAULT_PORT = 5277
+        const val CONNECT_TIMEOUT_MS = 3000
+        const val RECEIVE_BUFFER_SIZE = 512 * 1024
+        // Largest plaintext of a single AAP record
+        const val PLAINTEXT_BUFFER_SIZE = 65536
+    }
+}
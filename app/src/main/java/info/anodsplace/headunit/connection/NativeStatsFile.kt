@@ -0,0 +1,145 @@
+package info.anodsplace.headunit.connection
+
+import android.os.Build
+import java.io.File
+import java.io.RandomAccessFile
+import java.lang.invoke.VarHandle
+import java.nio.ByteOrder
+import java.nio.MappedByteBuffer
+import java.nio.channels.FileChannel
+
+/**
+ * Reader of the stats file NativeUsb.setStatsExportEnabled() publishes.
+ *
+ * The file is mapped once, and read() copies a consistent set of values
+ * out of it under the file's seqlock: no JNI call and no lock the native
+ * pipeline holds, so it may be called at any rate from any thread. The
+ * layout of each section is described in stats_export.h.
+ */
+class NativeStatsFile private constructor(private val buffer: MappedByteBuffer) {
+
+    /**
+     * One publish. A section is null while its stage isn't running.
+     */
+    class Snapshot(
+        val values: LongArray,
+        val present: Int,
+        val publishedNs: Long,
+        val publishes: Long,
+        private val sections: IntArray
+    ) {
+        fun section(section: Int): LongArray? {
+            if (section >= sections.size / 2 || present and (1 shl section) == 0) {
+                return null
+            }
+            val offset = sections[section * 2]
+            return values.copyOfRange(offset, offset + sections[section * 2 + 1])
+        }
+
+        /**
+         * Latency of one PipelineLatency stage: [count, mean, p50, p90, p99, p99.9, max] in ns.
+         */
+        fun latencyStage(stage: Int): LongArray? {
+            val latency = section(SECTION_LATENCY) ?: return null
+            val start = stage * LATENCY_FIELDS
+            return if (start + LATENCY_FIELDS <= latency.size) latency.copyOfRange(start, start + LATENCY_FIELDS) else null
+        }
+    }
+
+    private val headerSize = buffer.getInt(OFFSET_HEADER_SIZE)
+    private val valueCount = buffer.getInt(OFFSET_VALUE_COUNT)
+    private val sections = IntArray(buffer.getInt(OFFSET_SECTION_COUNT) * 2) {
+        buffer.getInt(OFFSET_SECTIONS + it * 4)
+    }
+    // Below API 33 there is no load fence; a volatile read keeps ART from
+    // moving the value loads across the sequence checks
+    @Volatile
+    private var fence = 0
+
+    /**
+     * @return the last publish, or null before the first one or if the
+     *         writer kept it busy for every retry
+     */
+    fun read(): Snapshot? {
+        val values = LongArray(valueCount)
+        for (attempt in 0 until MAX_RETRIES) {
+            val before = buffer.getLong(OFFSET_SEQUENCE)
+            if (before == 0L) {
+                return null
+            }
+            if (before and 1L != 0L) {
+                continue
+            }
+            loadFence()
+            for (i in 0 until valueCount) {
+                values[i] = buffer.getLong(headerSize + i * 8)
+            }
+            val present = buffer.getInt(OFFSET_PRESENT)
+            val publishedNs = buffer.getLong(OFFSET_PUBLISHED_NS)
+            val publishes = buffer.getLong(OFFSET_PUBLISHES)
+            loadFence()
+            if (buffer.getLong(OFFSET_SEQUENCE) == before) {
+                return Snapshot(values, present, publishedNs, publishes, sections)
+            }
+        }
+        return null
+    }
+
+    private fun loadFence(): Int {
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.TIRAMISU) {
+            VarHandle.loadLoadFence()
+            return 0
+        }
+        return fence
+    }
+
+    companion object {
+        // StatsLayout::Section
+        const val SECTION_TRANSPORT = 0
+        const val SECTION_LINK = 1
+        const val SECTION_LATENCY = 2
+        const val SECTION_LANES = 3
+        const val SECTION_VIDEO = 4
+        const val SECTION_POOL = 5
+
+        // Values per lane in SECTION_LANES, lanes in audio, video, control, background order
+        const val LANE_FIELDS = 9
+        private const val LATENCY_FIELDS = 7
+
+        private const val MAGIC = 0x53504141
+        private const val VERSION = 1
+        private const val MAX_RETRIES = 8
+
+        // StatsExportHeader
+        private const val OFFSET_MAGIC = 0
+        private const val OFFSET_VERSION = 4
+        private const val OFFSET_HEADER_SIZE = 8
+        private const val OFFSET_VALUE_COUNT = 12
+        private const val OFFSET_SEQUENCE = 16
+        private const val OFFSET_PUBLISHED_NS = 24
+        private const val OFFSET_PUBLISHES = 32
+        private const val OFFSET_PRESENT = 40
+        private const val OFFSET_SECTION_COUNT = 44
+        private const val OFFSET_SECTIONS = 48
+
+        /**
+         * Map a stats file.
+         * @return null if it doesn't exist yet or isn't a stats file this reader knows
+         */
+        fun open(path: String): NativeStatsFile? {
+            val file = File(path)
+            if (!file.exists()) {
+                return null
+            }
+            val buffer = RandomAccessFile(file, "r").use {
+                it.channel.map(FileChannel.MapMode.READ_ONLY, 0, it.length())
+            }
+            buffer.order(ByteOrder.nativeOrder())
+            if (buffer.capacity() < OFFSET_SECTIONS || buffer.getInt(OFFSET_MAGIC) != MAGIC ||
+                    buffer.getInt(OFFSET_VERSION) < VERSION) {
+                return null
+            }
+            return NativeStatsFile(buffer)
+        }
+    }
+}
@@ -1,6 +1,8 @@
 package info.anodsplace.headunit.connection
 
+import android.view.Surface
 import info.anodsplace.headunit.utils.AppLog
+import java.nio.ByteBuffer
 
 /**
  * JNI bindings for native USB communication via libusb.
@@ -20,24 +22,117 @@ object NativeUsb {
         }
     }
 
-    // Callbacks - set by NativeUsbAccessoryConnection
+    /** Default bulk IN transfer pool, matches the native TransferConfig */
+    const val DEFAULT_NUM_TRANSFERS = 4
+    const val DEFAULT_TRANSFER_SIZE = 16384
+    const val DEFAULT_SPARE_BUFFERS = 4
 
-    /**
-     * Raw data callback - receives raw USB bytes for parsing in Kotlin.
-     * Messages are delivered from the USB event thread sequentially.
-     */
-    @Volatile
-    var rawDataCallback: ((data: ByteArray, length: Int) -> Unit)? = null
+    /** Video frame flags from pollVideoFrame(), match the native VideoFrameInfo */
+    const val VIDEO_FRAME_KEYFRAME = 0x01
+    const val VIDEO_FRAME_CONFIG = 0x02
 
-    /**
-     * Error callback - receives USB error notifications.
-     */
-    @Volatile
-    var errorCallback: ((errorCode: Int, message: String) -> Unit)? = null
+    /** Control batch layout from getControlBatchBuffer(), matches the native RecordBatch */
+    const val CONTROL_BATCH_MAX_RECORDS = 64
+    const val CONTROL_BATCH_DESCRIPTOR_SIZE = 16
+
+    /** Control ring record layout from setControlRingEnabled(), matches the native SharedRecordRing */
+    const val CONTROL_RING_HEADER_SIZE = 8
+    const val CONTROL_RING_ALIGNMENT = 8
+    const val CONTROL_RING_PADDING = -1
+
+    /** Scheduling policies for setThreadPolicy(), match the native ThreadPolicy */
+    const val THREAD_POLICY_UNCHANGED = -1
+    const val THREAD_POLICY_OTHER = 0
+    const val THREAD_POLICY_FIFO = 1
+    const val THREAD_POLICY_RR = 2
+
+    /** Full queue policies for QueueConfig, match the native DropPolicy */
+    const val QUEUE_POLICY_DEFAULT = -1
+    const val QUEUE_POLICY_DROP_NEWEST = 0
+    const val QUEUE_POLICY_BLOCK = 1
+    const val QUEUE_POLICY_NEVER_DROP = 2
+
+    /** Ints per record in reportShadowRecords(), match the native ShadowFramer */
+    const val SHADOW_RECORD_FIELDS = 4
+    const val SHADOW_NOT_DECRYPTED = -1
+
+    /** Audio streams for LoadProfile, match the native LoadConfig */
+    const val LOAD_AUDIO_MEDIA = 1
+    const val LOAD_AUDIO_GUIDANCE = 2
+    const val LOAD_AUDIO_SYSTEM = 4
+
+    /** Pipeline stages in getStats(), match the native PipelineLatency */
+    const val STATS_STAGE_FRAME = 0
+    const val STATS_STAGE_DECRYPT = 1
+    const val STATS_STAGE_QUEUE_WAIT = 2
+    const val STATS_STAGE_CALLBACK = 3
+    const val STATS_STAGE_DECODE_FEED = 4
+    const val STATS_STAGE_COUNT = 5
+
+    /** Fields of each stage in getStats(), all latencies in ns */
+    const val STATS_FIELD_COUNT = 0
+    const val STATS_FIELD_MEAN = 1
+    const val STATS_FIELD_P50 = 2
+    const val STATS_FIELD_P90 = 3
+    const val STATS_FIELD_P99 = 4
+    const val STATS_FIELD_P999 = 5
+    const val STATS_FIELD_MAX = 6
+    const val STATS_FIELDS_PER_STAGE = 7
 
     // Native methods
     @JvmStatic
-    private external fun nativeOpen(fileDescriptor: Int): Long
+    private external fun nativeOpen(
+        fileDescriptor: Int,
+        numTransfers: Int,
+        transferSize: Int,
+        adaptive: Boolean,
+        spareBuffers: Int
+    ): Long
+
+    @JvmStatic
+    private external fun nativeGetLinkStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeOpenSocket(fileDescriptor: Int, receiveBufferSize: Int): Long
+
+    @JvmStatic
+    private external fun nativeGetSocketStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeOpenReplay(path: String, speed: Double): Long
+
+    @JvmStatic
+    private external fun nativeLoadReplayReadKey(handle: Long): Boolean
+
+    @JvmStatic
+    private external fun nativeGetReplayStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeOpenLoadGenerator(profile: IntArray, seconds: Double, speed: Double): Long
+
+    @JvmStatic
+    private external fun nativeGetLoadGeneratorStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeCalibrate(seconds: Double): LongArray?
+
+    @JvmStatic
+    private external fun nativeStartCapture(handle: Long, path: String): Boolean
+
+    @JvmStatic
+    private external fun nativeStopCapture(handle: Long)
+
+    @JvmStatic
+    private external fun nativeGetCaptureStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeGetStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetCallbacks(handle: Long, callbacks: Callbacks?)
+
+    @JvmStatic
+    private external fun nativeSetCoreShares(shares: Int)
 
     @JvmStatic
     private external fun nativeClose(handle: Long)
@@ -49,10 +144,215 @@ object NativeUsb {
     private external fun nativeStopReading(handle: Long)
 
     @JvmStatic
-    private external fun nativeWrite(handle: Long, data: ByteArray, length: Int): Int
+    private external fun nativeSetFramingEnabled(handle: Long, enabled: Boolean)
+
+    @JvmStatic
+    private external fun nativeSetShadowFramingEnabled(handle: Long): Boolean
+
+    @JvmStatic
+    private external fun nativeReportShadowRecords(handle: Long, records: IntArray, count: Int, parseNs: Long, decryptNs: Long)
+
+    @JvmStatic
+    private external fun nativeGetShadowFramingStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetDispatchEnabled(handle: Long, plaintextBuffer: ByteBuffer, controlBatchLatencyUs: Int, queueConfig: IntArray?): Boolean
+
+    @JvmStatic
+    private external fun nativeGetControlBatchBuffer(handle: Long): ByteBuffer?
+
+    @JvmStatic
+    private external fun nativeSetReadKey(handle: Long, key: ByteArray, salt: ByteArray, sequence: Long): Boolean
+
+    @JvmStatic
+    private external fun nativeSetWriteKey(handle: Long, key: ByteArray, salt: ByteArray, sequence: Long): Boolean
+
+    @JvmStatic
+    private external fun nativeSendRecord(handle: Long, data: ByteArray, length: Int): Int
+
+    @JvmStatic
+    private external fun nativeSetNativeKeepalive(handle: Long): Boolean
+
+    @JvmStatic
+    private external fun nativeSetMediaSessionId(handle: Long, channel: Int, sessionId: Int)
+
+    @JvmStatic
+    private external fun nativeGetKeepaliveStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetParallelDecryptEnabled(handle: Long, workers: Int): Boolean
+
+    @JvmStatic
+    private external fun nativeGetRecordPoolStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetQualityGovernorEnabled(handle: Long, intervalMs: Int): Boolean
+
+    @JvmStatic
+    private external fun nativeGetQualityGovernorStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetStallWatchdogEnabled(handle: Long, path: String, thresholdMs: Int): Boolean
+
+    @JvmStatic
+    private external fun nativeGetStallWatchdogStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetStatsExportEnabled(handle: Long, path: String, intervalMs: Int): Boolean
+
+    @JvmStatic
+    private external fun nativeGetThermalResolutionSteps(): Int
+
+    @JvmStatic
+    private external fun nativeSetMediaAckBatching(handle: Long, threshold: Int, tickMs: Int, flowControl: Boolean): Boolean
+
+    @JvmStatic
+    private external fun nativeGetMediaAckStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetSensorBatching(handle: Long, windowMs: Int): Boolean
+
+    @JvmStatic
+    private external fun nativeSubmitSensor(handle: Long, sensorType: Int, data: ByteArray, offset: Int, length: Int): Boolean
+
+    @JvmStatic
+    private external fun nativeGetSensorBatchStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetTouchInputEnabled(handle: Long): Boolean
+
+    @JvmStatic
+    private external fun nativeSubmitTouch(handle: Long, timestampNs: Long, action: Int, actionIndex: Int,
+                                           pointerCount: Int, pointers: IntArray): Boolean
+
+    @JvmStatic
+    private external fun nativeGetTouchInputStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetControlRingEnabled(handle: Long, capacity: Int): ByteBuffer?
+
+    @JvmStatic
+    private external fun nativeAwaitControlRing(handle: Long, readPosition: Long, timeoutMs: Int): Long
+
+    @JvmStatic
+    private external fun nativeGetControlRingStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeStartMic(handle: Long, sampleRate: Int): Boolean
+
+    @JvmStatic
+    private external fun nativeStopMic(handle: Long)
+
+    @JvmStatic
+    private external fun nativeGetMicStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetAudioOutputEnabled(handle: Long, mixed: Boolean): Boolean
+
+    @JvmStatic
+    private external fun nativeSetAudioOutputGain(handle: Long, channel: Int, gain: Float): Boolean
+
+    @JvmStatic
+    private external fun nativeStopAudioOutput(handle: Long, channel: Int)
+
+    @JvmStatic
+    private external fun nativeGetAudioOutputStats(handle: Long, channel: Int): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetVideoStageEnabled(handle: Long, hevc: Boolean): Boolean
+
+    @JvmStatic
+    private external fun nativeSetIdle(handle: Long, idle: Boolean)
+
+    @JvmStatic
+    private external fun nativeGetVideoFrameBuffers(handle: Long): Array<ByteBuffer>?
+
+    @JvmStatic
+    private external fun nativePollVideoFrame(handle: Long, info: IntArray, timeoutMs: Int): Int
+
+    @JvmStatic
+    private external fun nativeReleaseVideoFrame(handle: Long, slot: Int)
+
+    @JvmStatic
+    private external fun nativeGetVideoStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeGetVideoParameterSets(handle: Long): Array<ByteArray>?
+
+    @JvmStatic
+    private external fun nativeStartVideoDecoder(handle: Long, surface: Surface, width: Int, height: Int, lowLatency: Boolean, avSync: Boolean): Boolean
+
+    @JvmStatic
+    private external fun nativePrepareVideoDecoder(handle: Long, width: Int, height: Int, lowLatency: Boolean, avSync: Boolean): Boolean
+
+    @JvmStatic
+    private external fun nativeParkVideoDecoder(handle: Long)
+
+    @JvmStatic
+    private external fun nativeStopVideoDecoder(handle: Long)
+
+    @JvmStatic
+    private external fun nativeSetVideoLateFrameBudget(handle: Long, budgetMs: Int): Boolean
+
+    @JvmStatic
+    private external fun nativeGetVideoDecoderStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeGetVideoLatencyStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeGetAvSyncStats(handle: Long): LongArray?
+
+    @JvmStatic
+    private external fun nativeScanNalUnits(data: ByteArray, offset: Int, length: Int, hevc: Boolean, units: IntArray): Int
+
+    @JvmStatic
+    private external fun nativeParseSps(data: ByteArray, hevc: Boolean): IntArray?
+
+    @JvmStatic
+    private external fun nativeSetThreadPolicy(name: String, policy: Int, priority: Int, cpuMask: Long): Boolean
+
+    @JvmStatic
+    private external fun nativeGetCpuTopology(): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetTracingEnabled(enabled: Boolean): Boolean
+
+    @JvmStatic
+    private external fun nativeSetFastLog(priority: Int, path: String?): Boolean
+
+    @JvmStatic
+    private external fun nativeGetFastLogStats(): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetStreamingMemoryOptions(populate: Boolean, hugePages: Boolean, lock: Boolean)
+
+    @JvmStatic
+    private external fun nativeGetStreamingMemoryStats(): LongArray?
+
+    @JvmStatic
+    private external fun nativeSetMemoryProfile(lean: Boolean, width: Int, height: Int, fps: Int, bitrateKbps: Int)
+
+    @JvmStatic
+    private external fun nativeSetZeroCopyEnabled(handle: Long, enabled: Boolean)
+
+    @JvmStatic
+    private external fun nativeGetSlotBuffers(handle: Long): Array<ByteBuffer>?
+
+    @JvmStatic
+    private external fun nativeReleaseSlot(handle: Long, slot: Int)
+
+    @JvmStatic
+    private external fun nativeWrite(handle: Long, data: ByteArray, offset: Int, length: Int): Int
+
+    @JvmStatic
+    private external fun nativeWriteBuffer(handle: Long, buffer: ByteBuffer, offset: Int, length: Int): Int
+
+    @JvmStatic
+    private external fun nativeRead(handle: Long, data: ByteArray, offset: Int, length: Int, timeoutMs: Int): Int
 
     @JvmStatic
-    private external fun nativeRead(handle: Long, data: ByteArray, length: Int, timeoutMs: Int): Int
+    private external fun nativeReadBuffer(handle: Long, buffer: ByteBuffer, offset: Int, length: Int, timeoutMs: Int): Int
 
     @JvmStatic
     private external fun nativeIsOpen(handle: Long): Boolean
@@ -60,10 +360,195 @@ object NativeUsb {
     /**
      * Open a USB device using the file descriptor from Android's UsbDeviceConnection.
      * @param fileDescriptor The file descriptor from UsbDeviceConnection.fileDescriptor
+     * @param numTransfers Bulk IN transfers kept in flight
+     * @param transferSize Bytes per bulk IN transfer
+     * @param adaptive Grow the in-flight depth under sustained load, shrink it when idle
+     * @param spareBuffers Resubmit-first reading when above 0: a completed transfer takes
+     *                     one of these and goes straight back to the device, the filled
+     *                     buffer is delivered on a native thread. Not with zero-copy slots.
+     * @return A handle to the native connection, or 0 on failure
+     */
+    fun open(
+        fileDescriptor: Int,
+        numTransfers: Int = DEFAULT_NUM_TRANSFERS,
+        transferSize: Int = DEFAULT_TRANSFER_SIZE,
+        adaptive: Boolean = false,
+        spareBuffers: Int = 0
+    ): Long {
+        return nativeOpen(fileDescriptor, numTransfers, transferSize, adaptive, spareBuffers)
+    }
+
+    /**
+     * Get USB link statistics, to tell a saturated or failing link from a
+     * slow consumer. Rates cover the last second and drop to 0 once the
+     * link has been quiet for two.
+     * @param handle The handle returned from open()
+     * @return [libusb speed (1 low .. 5 super plus, 0 unknown), bytes in, bytes out,
+     *         transfers in, transfers out, short IN transfers, bytes/s in, bytes/s out,
+     *         IN transfers in flight, mean in flight per completion x1000,
+     *         ns the IN endpoint had nothing submitted, total ns from IN completion to resubmit,
+     *         longest resubmit gap ns], followed by failed transfers indexed by
+     *         libusb_transfer_status (1 error, 2 timed out, 4 stall, 5 no device, 6 overflow),
+     *         then [backoff rounds before resubmitting failed IN transfers, IN endpoint
+     *         halts cleared]; null for a socket
+     */
+    fun getLinkStats(handle: Long): LongArray? {
+        return nativeGetLinkStats(handle)
+    }
+
+    /**
+     * Open a connected TCP socket (wireless Android Auto). The handle works
+     * with every call below except the zero-copy slot ones, which are USB only.
+     * @param fileDescriptor Detached socket descriptor, owned by native code from now on
+     * @param receiveBufferSize SO_RCVBUF in bytes, 0 for the default
      * @return A handle to the native connection, or 0 on failure
      */
-    fun open(fileDescriptor: Int): Long {
-        return nativeOpen(fileDescriptor)
+    fun openSocket(fileDescriptor: Int, receiveBufferSize: Int = 0): Long {
+        return nativeOpenSocket(fileDescriptor, receiveBufferSize)
+    }
+
+    /**
+     * Get socket statistics.
+     * @param handle The handle returned from openSocket()
+     * @return [bytes received, bytes sent, writes queued, largest TX backlog], or null
+     */
+    fun getSocketStats(handle: Long): LongArray? {
+        return nativeGetSocketStats(handle)
+    }
+
+    /**
+     * Open a capture written by startCapture() for replay. Set up framing,
+     * dispatch and loadReplayReadKey() as for a live connection, then
+     * startReading() feeds the captured bytes through the same native
+     * pipeline. Writes are discarded, and the end of the capture is
+     * reported to errorCallback as a disconnect (-4).
+     * @param path Capture file
+     * @param speed 1.0 for the recorded pace, 2.0 for twice as fast, 0 as fast as possible
+     * @return A handle to the replay, or 0 on failure
+     */
+    fun openReplay(path: String, speed: Double = 0.0): Long {
+        return nativeOpenReplay(path, speed)
+    }
+
+    /**
+     * Decrypt the replayed records natively with the read key in the capture,
+     * or a load generator's records with its test key.
+     * Requires native dispatch. Must be called before startReading().
+     * @param handle The handle returned from openReplay() or openLoadGenerator()
+     * @return false if the capture has no read key, or the generator doesn't encrypt
+     */
+    fun loadReplayReadKey(handle: Long): Boolean {
+        return nativeLoadReplayReadKey(handle)
+    }
+
+    /**
+     * Get replay statistics.
+     * @param handle The handle returned from openReplay()
+     * @return [reads replayed, bytes replayed, elapsed ns, largest lag behind the recorded pace ns], or null
+     */
+    fun getReplayStats(handle: Long): LongArray? {
+        return nativeGetReplayStats(handle)
+    }
+
+    /**
+     * Open a synthetic phone: a stream of valid AAP records, H.264 video
+     * with its codec config, PCM audio, pings and playback metadata, at the
+     * rates in profile. Set it up like openReplay(); with profile.encrypt the
+     * records are TLS encrypted under a test key for loadReplayReadKey().
+     * Writes are discarded, and the end of the stream is reported to
+     * errorCallback as a disconnect (-4).
+     * @param seconds Stream time to generate, 0 until stopReading()
+     * @param speed 1.0 for real time, 2.0 for twice as fast, 0 as fast as possible
+     * @return A handle to the generator, or 0 if the profile can't be generated
+     */
+    fun openLoadGenerator(profile: LoadProfile = LoadProfile(), seconds: Double = 10.0, speed: Double = 1.0): Long {
+        return nativeOpenLoadGenerator(profile.pack(), seconds, speed)
+    }
+
+    /**
+     * Get load generator statistics.
+     * @param handle The handle returned from openLoadGenerator()
+     * @return [bytes generated, transfers, records, video frames, keyframes, audio frames,
+     *          pings, metadata, stream ns, elapsed ns, largest lag behind real time ns], or null
+     */
+    fun getLoadGeneratorStats(handle: Long): LongArray? {
+        return nativeGetLoadGeneratorStats(handle)
+    }
+
+    /**
+     * Measure this device's native pipeline and pick its parameters, see
+     * DeviceCalibration. Runs synthetic sessions through framing, decryption
+     * and dispatch on the calling thread for a second or two: call it off
+     * the main thread, with no connection open.
+     * @param seconds Stream time per synthetic session, 0 for the default
+     * @return [copy MB/s, decrypt MB/s, receive path MB/s, CPUs, big cores, hardware AES,
+     *          IN transfers, transfer size, decrypt workers, pool workers,
+     *          video queue slots, video queue bytes], tuned values 0 for the default; or null
+     */
+    fun calibrate(seconds: Double = 0.0): LongArray? {
+        return nativeCalibrate(seconds)
+    }
+
+    /**
+     * Write every read from the phone to a capture file, for openReplay().
+     * Call it before setReadKey() so the capture holds the read key, which
+     * also means the capture decrypts the session: keep it in private storage.
+     * The handshake is not captured.
+     * @param handle The handle returned from open() or openSocket()
+     * @param path Capture file, created or truncated
+     * @return false if the file can't be created
+     */
+    fun startCapture(handle: Long, path: String): Boolean {
+        return nativeStartCapture(handle, path)
+    }
+
+    /**
+     * Stop capturing and trim the capture file. Also done by close().
+     * @param handle The handle returned from open() or openSocket()
+     */
+    fun stopCapture(handle: Long) {
+        nativeStopCapture(handle)
+    }
+
+    /**
+     * Get capture statistics.
+     * @param handle The handle returned from open() or openSocket()
+     * @return [bytes captured, entries, file size, entries lost], or null
+     */
+    fun getCaptureStats(handle: Long): LongArray? {
+        return nativeGetCaptureStats(handle)
+    }
+
+    /**
+     * Get the latency distribution of every native stage since open():
+     * framing from transfer arrival, decryption, dispatcher queue wait,
+     * dispatcher callbacks and video frames waiting for the codec.
+     * Percentiles are within 12.5% of the true value.
+     * @param handle The handle returned from open() or openSocket()
+     * @return STATS_FIELDS_PER_STAGE values for each of the STATS_STAGE_ stages in order,
+     *         e.g. [stage * STATS_FIELDS_PER_STAGE + STATS_FIELD_P99], or null
+     */
+    fun getStats(handle: Long): LongArray? {
+        return nativeGetStats(handle)
+    }
+
+    /**
+     * Route every upcall of this connection to callbacks. Must be called
+     * before startReading(); the reference is dropped by close().
+     * @param handle The handle returned from open(), openSocket() or openReplay()
+     */
+    fun setCallbacks(handle: Long, callbacks: Callbacks?) {
+        nativeSetCallbacks(handle, callbacks)
+    }
+
+    /**
+     * Split the CPUs between this many concurrent connections, so each
+     * one's dispatcher and decrypt threads run on cores of their own.
+     * Applies to connections opened afterwards. 1 (the default) shares
+     * every core between all connections.
+     */
+    fun setCoreShares(shares: Int) {
+        nativeSetCoreShares(shares)
     }
 
     /**
@@ -92,59 +577,1181 @@ object NativeUsb {
     }
 
     /**
-     * Write data to USB.
+     * Enable native AAP record framing.
+     * When enabled, data is delivered via onRecord instead of onRawData.
+     * Must be called before startReading().
      * @param handle The handle returned from open()
-     * @param data The data to write
-     * @param length The number of bytes to write
-     * @return The number of bytes written, or negative on error
+     * @param enabled true to frame records natively
      */
-    fun write(handle: Long, data: ByteArray, length: Int): Int {
-        return nativeWrite(handle, data, length)
+    fun setFramingEnabled(handle: Long, enabled: Boolean) {
+        nativeSetFramingEnabled(handle, enabled)
     }
 
     /**
-     * Check if the connection is open.
+     * Run the native framer in the shadow of Kotlin parsing, to compare the
+     * two before native framing is rolled out. Each transfer is framed
+     * natively just before onRawData or onSlotData gets it and nothing is
+     * delivered; report what Kotlin parsed from it with reportShadowRecords()
+     * before returning. setReadKey() then has the shadow decrypt too.
+     * Requires framing disabled. Must be called before setZeroCopyEnabled()
+     * and startReading().
      * @param handle The handle returned from open()
-     * @return true if open, false otherwise
+     * @return false if native framing is enabled
      */
-    fun isOpen(handle: Long): Boolean {
-        return nativeIsOpen(handle)
+    fun setShadowFramingEnabled(handle: Long): Boolean {
+        return nativeSetShadowFramingEnabled(handle)
     }
 
     /**
-     * Read data from USB synchronously (for handshake).
-     * @param handle The handle returned from open()
-     * @param data The buffer to read into
-     * @param length The maximum number of bytes to read
-     * @param timeoutMs The timeout in milliseconds
-     * @return The number of bytes read, or negative on error
+     * Records Kotlin parsed from the transfer being delivered, to check
+     * against the shadow framer. Call it from onRawData or onSlotData.
+     * @param records SHADOW_RECORD_FIELDS ints per record: channel, flags,
+     *                encrypted length, 1 or 0 if it decrypted or failed, -1 if not decrypted
+     * @param parseNs Time Kotlin took to frame the transfer
+     * @param decryptNs Time Kotlin took to decrypt its records
      */
-    fun read(handle: Long, data: ByteArray, length: Int, timeoutMs: Int): Int {
-        return nativeRead(handle, data, length, timeoutMs)
+    fun reportShadowRecords(handle: Long, records: IntArray, count: Int, parseNs: Long, decryptNs: Long) {
+        nativeReportShadowRecords(handle, records, count, parseNs, decryptNs)
     }
 
-    // Callbacks from native code (called on native threads)
-
     /**
-     * Raw data callback - called with raw USB bytes.
-     * Kotlin handles all message parsing and TLS decryption.
+     * Get shadow framing statistics. Times are totals, divide by the record counts.
+     * @param handle The handle returned from open()
+     * @return [transfers, bytes, native records, Kotlin records, matched, mismatched,
+     *          native only, Kotlin only, decrypt mismatches, native decrypts, Kotlin decrypts,
+     *          native frame ns, native decrypt ns, Kotlin parse ns, Kotlin decrypt ns], or null
      */
-    @JvmStatic
-    fun onRawData(data: ByteArray, length: Int) {
-        try {
-            rawDataCallback?.invoke(data, length)
-        } catch (e: Exception) {
-            AppLog.e(e) { "Error in raw data callback" }
-        }
+    fun getShadowFramingStats(handle: Long): LongArray? {
+        return nativeGetShadowFramingStats(handle)
     }
 
-    @JvmStatic
-    fun onError(errorCode: Int, message: String) {
-        AppLog.e { "Native USB error $errorCode: $message" }
-        try {
-            errorCallback?.invoke(errorCode, message)
-        } catch (e: Exception) {
-            AppLog.e(e) { "Error in error callback" }
+    /**
+     * Route natively framed records through the native ChannelDispatcher.
+     * Requires framing to be enabled. Must be called before startReading().
+     * @param handle The handle returned from open()
+     * @param plaintextBuffer Direct buffer that onDecryptRecord decrypts into
+     * @param controlBatchLatencyUs Deliver control records in batches through
+     *        controlBatchCallback, holding a record at most this long; negative
+     *        for one controlRecordCallback per record
+     * @param queues Dispatcher queue limits, null for the native defaults;
+     *        only the first call on a handle creates the dispatcher
+     * @return true if the dispatcher was started
+     */
+    fun setDispatchEnabled(handle: Long, plaintextBuffer: ByteBuffer, controlBatchLatencyUs: Int = -1,
+                           queues: DispatchQueues? = null): Boolean {
+        return nativeSetDispatchEnabled(handle, plaintextBuffer, controlBatchLatencyUs, queues?.pack())
+    }
+
+    /**
+     * Get a direct view of the native control batch buffer.
+     * It starts with CONTROL_BATCH_MAX_RECORDS descriptors of four native
+     * order ints: channel, flags, payload offset and payload length.
+     * The view stays valid until close().
+     * @param handle The handle returned from open()
+     * @return The batch buffer, or null if control batching is disabled
+     */
+    fun getControlBatchBuffer(handle: Long): ByteBuffer? {
+        return nativeGetControlBatchBuffer(handle)
+    }
+
+    /**
+     * Decrypt TLS 1.2 AES-GCM records natively instead of calling onDecryptRecord.
+     * Requires native dispatch, or shadow framing: the shadow then decrypts
+     * each record too, Kotlin still gets them encrypted. Must be called before startReading().
+     * @param handle The handle returned from open()
+     * @param key 16 or 32 byte AES key
+     * @param salt 4-byte implicit nonce
+     * @param sequence Sequence number of the next record from the phone
+     * @return true if native decryption is enabled
+     */
+    fun setReadKey(handle: Long, key: ByteArray, salt: ByteArray, sequence: Long): Boolean {
+        return nativeSetReadKey(handle, key, salt, sequence)
+    }
+
+    /**
+     * Encrypt outgoing records natively with [sendRecord]. Once enabled every
+     * record must go through it, the SSLEngine's write sequence is left behind.
+     * @param handle The handle returned from open() or openSocket()
+     * @param key 16 or 32 byte AES key
+     * @param salt 4-byte implicit nonce
+     * @param sequence Sequence number of the next record to the phone
+     * @return true if native encryption is enabled
+     */
+    fun setWriteKey(handle: Long, key: ByteArray, salt: ByteArray, sequence: Long): Boolean {
+        return nativeSetWriteKey(handle, key, salt, sequence)
+    }
+
+    /**
+     * Encrypt one message into a preallocated record and queue it, no allocation.
+     * Plaintext over 16 KiB is sent as FIRST/LAST fragments, a record each.
+     * Requires setWriteKey().
+     * @param handle The handle returned from open() or openSocket()
+     * @param data 4-byte AAP header (channel, flags, length filled in natively), then the plaintext
+     * @param length Header plus plaintext, at most 1 MiB of plaintext
+     * @return Bytes written (header plus record), or negative on error
+     */
+    fun sendRecord(handle: Long, data: ByteArray, length: Int): Int {
+        return nativeSendRecord(handle, data, length)
+    }
+
+    /**
+     * Answer ping requests natively, right after they are decrypted on the
+     * USB thread, and write batched media ACKs natively once their channel's
+     * session is known. Kotlin still receives the pings and must not reply.
+     * Requires setWriteKey().
+     * @param handle The handle returned from open() or openSocket()
+     * @return true if pings are answered natively
+     */
+    fun setNativeKeepalive(handle: Long): Boolean {
+        return nativeSetNativeKeepalive(handle)
+    }
+
+    /**
+     * Register the session a media channel's native ACKs refer to.
+     * Ignored before setNativeKeepalive().
+     * @param handle The handle returned from open() or openSocket()
+     */
+    fun setMediaSessionId(handle: Long, channel: Int, sessionId: Int) {
+        nativeSetMediaSessionId(handle, channel, sessionId)
+    }
+
+    /**
+     * Get native keepalive statistics.
+     * @param handle The handle returned from open() or openSocket()
+     * @return [pings answered, media ACKs sent, ACKs left to Kotlin without a session,
+     *   failed writes, longest ping turnaround ns], or null before setNativeKeepalive()
+     */
+    fun getKeepaliveStats(handle: Long): LongArray? {
+        return nativeGetKeepaliveStats(handle)
+    }
+
+    /**
+     * Decrypt large video records on native worker threads.
+     * Records are re-ordered per channel before dispatch.
+     * Requires setReadKey(). Must be called before startReading().
+     * @param handle The handle returned from open()
+     * @param workers Worker threads, 0 to size the pool from the core count
+     * @return true if the worker pool is running
+     */
+    fun setParallelDecryptEnabled(handle: Long, workers: Int = 0): Boolean {
+        return nativeSetParallelDecryptEnabled(handle, workers)
+    }
+
+    /**
+     * Get occupancy of the native record slab pool used by parallel decryption.
+     * @return [size, slabs, inUse, highWater] for the 256 B, 4 KB and 64 KB classes,
+     *         then [promotions, exhausted], or null before setParallelDecryptEnabled()
+     */
+    fun getRecordPoolStats(handle: Long): LongArray? {
+        return nativeGetRecordPoolStats(handle)
+    }
+
+    /**
+     * Throttle the pipeline on thermal status and load. Once per interval the
+     * native governor reads the thermal status and samples the video queue,
+     * background queue waits and decode time; under pressure a full
+     * background queue drops records instead of holding up the read thread,
+     * and hotter still the decrypt pool runs on fewer workers.
+     * Requires native dispatch, call it after setParallelDecryptEnabled().
+     * @param handle The handle returned from open()
+     * @param intervalMs Time between samples, 0 for the default of a second
+     * @return true if the governor is running
+     */
+    fun setQualityGovernorEnabled(handle: Long, intervalMs: Int = 0): Boolean {
+        return nativeSetQualityGovernorEnabled(handle, intervalMs)
+    }
+
+    /**
+     * Get the quality governor's state, levels 0 (nominal) to 3 (critical).
+     * @return [level, max level, level changes, thermal status (AThermalStatus, -1 unknown),
+     *          thermal source (0 none, 1 thermal API, 2 sysfs), load level,
+     *          video queue fill %, decode avg us, samples], or null before setQualityGovernorEnabled()
+     */
+    fun getQualityGovernorStats(handle: Long): LongArray? {
+        return nativeGetQualityGovernorStats(handle)
+    }
+
+    /**
+     * Watch the native pipeline threads for stalls. The AAP-Watchdog thread
+     * samples the heartbeats of the read and write paths, each dispatcher
+     * lane and the decode feeder; one that makes no progress for thresholdMs
+     * with work pending writes a text snapshot to path: every heartbeat,
+     * queue depths, transfers in flight, when each latency stage last saw a
+     * record, and the state of every thread. The file is mapped up front
+     * and holds the last snapshot, so it survives the process being killed.
+     * Call it after setDispatchEnabled() to include the dispatcher lanes.
+     * @param handle The handle returned from open()
+     * @param path Snapshot file, created or truncated
+     * @param thresholdMs Time without progress that counts as a stall
+     * @return true if the watchdog is running
+     */
+    fun setStallWatchdogEnabled(handle: Long, path: String, thresholdMs: Int = 2000): Boolean {
+        return nativeSetStallWatchdogEnabled(handle, path, thresholdMs)
+    }
+
+    /**
+     * Get the stall watchdog's counters.
+     * @return [checks, stalls (snapshots written), stalled now, longest stall ms,
+     *          index of the last stalled heartbeat or -1], or null before setStallWatchdogEnabled()
+     */
+    fun getStallWatchdogStats(handle: Long): LongArray? {
+        return nativeGetStallWatchdogStats(handle)
+    }
+
+    /**
+     * Publish the native stats to a memory-mapped file once per interval:
+     * transport progress, USB link stats, the per-stage latency histograms,
+     * dispatcher lane depths and drops, video assembly and decode, and
+     * record pool occupancy, in a fixed, versioned layout. Readers map it
+     * with NativeStatsFile, or any process that can open it, and poll at
+     * their own rate without a JNI call.
+     * Call it after setDispatchEnabled() to include the dispatcher and pool.
+     * @param handle The handle returned from open()
+     * @param path Stats file, created or truncated
+     * @param intervalMs Time between publishes, 0 for the default of 250 ms
+     * @return true if the stats are being published
+     */
+    fun setStatsExportEnabled(handle: Long, path: String, intervalMs: Int = 0): Boolean {
+        return nativeSetStatsExportEnabled(handle, path, intervalMs)
+    }
+
+    /**
+     * How many resolutions below the selected one to offer for the device's
+     * thermal status right now: 1 when severe, 2 when critical or worse.
+     */
+    fun thermalResolutionSteps(): Int {
+        return nativeGetThermalResolutionSteps()
+    }
+
+    /**
+     * Coalesce the media ACKs of records consumed by the native audio and
+     * video stages: mediaAckCallback is called once a channel has threshold
+     * records pending, or at most tickMs after the first one.
+     * Requires native dispatch. Must be called before startReading().
+     * @param handle The handle returned from open()
+     * @param threshold Records per ACK, 0 for the default
+     * @param tickMs Longest an ACK is held back, 0 for the default
+     * @param flowControl Withhold a channel's ACKs while its dispatcher queue
+     *   is above its high-water mark, for up to 200 ms at a time
+     * @return true if batching is enabled
+     */
+    fun setMediaAckBatching(handle: Long, threshold: Int = 0, tickMs: Int = 0, flowControl: Boolean = false): Boolean {
+        return nativeSetMediaAckBatching(handle, threshold, tickMs, flowControl)
+    }
+
+    /**
+     * Get media ACK batching statistics.
+     * @param handle The handle returned from open()
+     * @return [ACKs sent, records acknowledged, threshold flushes, largest batch,
+     *   flow control holds, holds released by timeout, total ns held], or null
+     */
+    fun getMediaAckStats(handle: Long): LongArray? {
+        return nativeGetMediaAckStats(handle)
+    }
+
+    /**
+     * Coalesce sensor updates: submitSensor() keeps the latest update per
+     * sensor type and sensorBatchCallback gets one SENSOR_EVENT record with
+     * everything pending, windowMs after the first update.
+     * @param handle The handle returned from open()
+     * @param windowMs Longest an update is held back, 0 for the default
+     * @return true if batching is enabled
+     */
+    fun setSensorBatching(handle: Long, windowMs: Int = 0): Boolean {
+        return nativeSetSensorBatching(handle, windowMs)
+    }
+
+    /**
+     * Queue a sensor update, replacing a pending one of the same type.
+     * @param data Serialized SensorBatch for sensorType
+     * @return false if batching is disabled or the update is too large; send it directly
+     */
+    fun submitSensor(handle: Long, sensorType: Int, data: ByteArray, offset: Int, length: Int): Boolean {
+        return nativeSubmitSensor(handle, sensorType, data, offset, length)
+    }
+
+    /**
+     * Get sensor batching statistics.
+     * @param handle The handle returned from open()
+     * @return [updates submitted, updates superseded, records sent, most updates in a record], or null
+     */
+    fun getSensorBatchStats(handle: Long): LongArray? {
+        return nativeGetSensorBatchStats(handle)
+    }
+
+    /**
+     * Start the touch input fast path: submitTouch() samples are encoded on
+     * AAP-Input and handed to inputRecordCallback, consecutive MOVE samples
+     * coalesced while a write is in progress.
+     * @param handle The handle returned from open()
+     * @return true if the fast path is running
+     */
+    fun setTouchInputEnabled(handle: Long): Boolean {
+        return nativeSetTouchInputEnabled(handle)
+    }
+
+    /**
+     * Queue a touch sample, lock-free. Call from one thread at a time.
+     * @param timestampNs CLOCK_MONOTONIC time of the sample, 0 to stamp it on submit
+     * @param action TouchEvent.PointerAction value
+     * @param pointers pointerCount (id, x, y) triples in phone screen coordinates
+     * @return false if the fast path is off or its queue is full
+     */
+    fun submitTouch(handle: Long, timestampNs: Long, action: Int, actionIndex: Int,
+                    pointerCount: Int, pointers: IntArray): Boolean {
+        return nativeSubmitTouch(handle, timestampNs, action, actionIndex, pointerCount, pointers)
+    }
+
+    /**
+     * Get touch input fast path statistics.
+     * @param handle The handle returned from open()
+     * @return [samples submitted, MOVEs coalesced, records sent, samples dropped], or null
+     */
+    fun getTouchInputStats(handle: Long): LongArray? {
+        return nativeGetTouchInputStats(handle)
+    }
+
+    /**
+     * Publish control records into a ring shared with Kotlin instead of
+     * calling controlRecordCallback. A Kotlin thread drains it with
+     * awaitControlRing(), so AAP-Control never runs Kotlin code.
+     * Records are [int length, byte channel, byte flags, 2 reserved, payload]
+     * padded to CONTROL_RING_ALIGNMENT; a CONTROL_RING_PADDING length skips
+     * to the start of the ring.
+     * Requires native dispatch. Must be called before startReading().
+     * @param handle The handle returned from open()
+     * @param capacity Ring size in bytes, rounded up to a power of two, 0 for the default
+     * @return Native order view of the ring, valid until close(), or null
+     */
+    fun setControlRingEnabled(handle: Long, capacity: Int = 0): ByteBuffer? {
+        return nativeSetControlRingEnabled(handle, capacity)
+    }
+
+    /**
+     * Return everything before readPosition to the control ring and wait
+     * for records past it. Position p is at offset p and (capacity - 1).
+     * Call from a single thread, and stop calling before close().
+     * @param handle The handle returned from open()
+     * @param readPosition Position after the last record consumed
+     * @param timeoutMs Longest wait when the ring is empty
+     * @return Write position, readPosition on timeout, or -1 once closed
+     */
+    fun awaitControlRing(handle: Long, readPosition: Long, timeoutMs: Int): Long {
+        return nativeAwaitControlRing(handle, readPosition, timeoutMs)
+    }
+
+    /**
+     * Get control ring statistics.
+     * @param handle The handle returned from open()
+     * @return [records published, bytes published, producer waits, records rejected], or null
+     */
+    fun getControlRingStats(handle: Long): LongArray? {
+        return nativeGetControlRingStats(handle)
+    }
+
+    /**
+     * Capture the microphone natively through AAudio, in place of MicRecorder.
+     * Records are framed natively and delivered to micRecordCallback.
+     * Needs the RECORD_AUDIO permission and API 28+.
+     * @param handle The handle returned from open()
+     * @param sampleRate Mic sample rate, mono 16-bit
+     * @return true if capture started, false to fall back to MicRecorder
+     */
+    fun startMic(handle: Long, sampleRate: Int): Boolean {
+        return nativeStartMic(handle, sampleRate)
+    }
+
+    /**
+     * Stop native mic capture.
+     * @param handle The handle returned from open()
+     */
+    fun stopMic(handle: Long) {
+        nativeStopMic(handle)
+    }
+
+    /**
+     * Get native mic statistics.
+     * @param handle The handle returned from open()
+     * @return [bytes captured, bytes dropped, records sent, reopens, frames per burst,
+     *          capture rate], or null
+     */
+    fun getMicStats(handle: Long): LongArray? {
+        return nativeGetMicStats(handle)
+    }
+
+    /**
+     * Play audio channel PCM natively, AAudio on API 28+ and OpenSL ES before.
+     * Media records no longer reach audioRecordCallback, audioMediaCallback
+     * is called instead. Requires native dispatch. Must be called before startReading().
+     * @param handle The handle returned from open()
+     * @param mixed Mix all channels natively into one 48 kHz stereo stream,
+     *              ducking media under guidance, instead of a stream each
+     * @return true if native audio output is enabled
+     */
+    fun setAudioOutputEnabled(handle: Long, mixed: Boolean = false): Boolean {
+        return nativeSetAudioOutputEnabled(handle, mixed)
+    }
+
+    /**
+     * Set the volume of one channel in the native mixer, ramped over 20 ms.
+     * @param handle The handle returned from open()
+     * @param channel Audio channel id
+     * @param gain Linear gain, 1.0 for unity
+     * @return false if the output is not mixed
+     */
+    fun setAudioOutputGain(handle: Long, channel: Int, gain: Float): Boolean {
+        return nativeSetAudioOutputGain(handle, channel, gain)
+    }
+
+    /**
+     * Stop and flush the native stream of an audio channel, e.g. on a stop
+     * indication. The stream is reopened by the next media record.
+     * @param handle The handle returned from open()
+     * @param channel Audio channel id
+     */
+    fun stopAudioOutput(handle: Long, channel: Int) {
+        nativeStopAudioOutput(handle, channel)
+    }
+
+    /**
+     * Get native audio output statistics for a channel.
+     * @param handle The handle returned from open()
+     * @param channel Audio channel id
+     * @return [bytes written, bytes dropped, underruns, frames played, frames per burst,
+     *          buffer frames, backend, jitter buffer fill ms, target ms, jitter us,
+     *          drift correction ppm, times media was ducked (mixed only)],
+     *          or null if the channel has no stream yet
+     */
+    fun getAudioOutputStats(handle: Long, channel: Int): LongArray? {
+        return nativeGetAudioOutputStats(handle, channel)
+    }
+
+    /**
+     * Reassemble video media natively into decoder-ready frames.
+     * Media records no longer reach videoRecordCallback, videoMediaCallback
+     * is called instead. Requires native dispatch. Must be called before startReading().
+     * @param handle The handle returned from open()
+     * @param hevc true for an H.265 stream, false for H.264
+     * @return true if the video stage is enabled
+     */
+    fun setVideoStageEnabled(handle: Long, hevc: Boolean = false): Boolean {
+        return nativeSetVideoStageEnabled(handle, hevc)
+    }
+
+    /**
+     * Idle the pipeline while projection is in the background: video records
+     * bypass the video worker, which stays parked, and are only screened for
+     * the latest parameter sets and keyframe; USB keeps a single IN transfer
+     * in flight. Leaving idle restores both and waits for the next keyframe.
+     * @param handle The handle returned from open()
+     */
+    fun setIdle(handle: Long, idle: Boolean) {
+        nativeSetIdle(handle, idle)
+    }
+
+    /**
+     * Get direct buffer views of the native video frame slots.
+     * Views stay valid until close() is called.
+     * @param handle The handle returned from open()
+     * @return One buffer per slot, or null if the video stage is disabled
+     */
+    fun getVideoFrameBuffers(handle: Long): Array<ByteBuffer>? {
+        return nativeGetVideoFrameBuffers(handle)
+    }
+
+    /**
+     * Take the next assembled video frame.
+     * @param handle The handle returned from open()
+     * @param info Receives [length, first NAL type, VIDEO_FRAME_* flags]
+     * @param timeoutMs 0 to poll, negative to wait until close()
+     * @return Slot index of the frame, or -1 if none is ready
+     */
+    fun pollVideoFrame(handle: Long, info: IntArray, timeoutMs: Int = 0): Int {
+        return nativePollVideoFrame(handle, info, timeoutMs)
+    }
+
+    /**
+     * Return a slot from pollVideoFrame() once its data was consumed.
+     * @param handle The handle returned from open()
+     * @param slot The slot index from pollVideoFrame()
+     */
+    fun releaseVideoFrame(handle: Long, slot: Int) {
+        nativeReleaseVideoFrame(handle, slot)
+    }
+
+    /**
+     * Get video stage statistics.
+     * @param handle The handle returned from open()
+     * @return [assembled, dropped, records dropped, parameter set updates, queued, direct,
+     *          keyframe requests, frames skipped while idle, keyframes cached, keyframes replayed], or null
+     */
+    fun getVideoStats(handle: Long): LongArray? {
+        return nativeGetVideoStats(handle)
+    }
+
+    /**
+     * Get the most recent parameter sets, each with a start code.
+     * @param handle The handle returned from open()
+     * @return [SPS, PPS] for H.264, [VPS, SPS, PPS] for H.265, or null if not seen yet
+     */
+    fun getVideoParameterSets(handle: Long): Array<ByteArray>? {
+        return nativeGetVideoParameterSets(handle)
+    }
+
+    /**
+     * Decode the native video stage's frames with AMediaCodec.
+     * Frames are assembled straight into codec input buffers and never
+     * reach Kotlin; pollVideoFrame() must not be used meanwhile.
+     * Requires setVideoStageEnabled().
+     * @param handle The handle returned from open()
+     * @param surface Output surface
+     * @param width Video width in pixels
+     * @param height Video height in pixels
+     * @param lowLatency Set vendor low latency codec keys and release frames on vsync
+     * @param avSync Hold each frame until the native audio output reaches its
+     *               timestamp; needs setAudioOutputEnabled(), see getAvSyncStats()
+     * @return true if the decoder was started
+     */
+    fun startVideoDecoder(handle: Long, surface: Surface, width: Int, height: Int,
+                          lowLatency: Boolean = false, avSync: Boolean = false): Boolean {
+        return nativeStartVideoDecoder(handle, surface, width, height, lowLatency, avSync)
+    }
+
+    /**
+     * Start the native decoder parked, before there is a surface: the codec
+     * is configured from the first parameter sets, and startVideoDecoder()
+     * later only switches its output over. Requires setVideoStageEnabled().
+     * @param handle The handle returned from open()
+     * @return false if the device can't decode offscreen (before API 26)
+     */
+    fun prepareVideoDecoder(handle: Long, width: Int, height: Int,
+                            lowLatency: Boolean = false, avSync: Boolean = false): Boolean {
+        return nativePrepareVideoDecoder(handle, width, height, lowLatency, avSync)
+    }
+
+    /**
+     * Release the surface but keep the codec configured. The next
+     * startVideoDecoder() resumes with the cached keyframe, or stops and
+     * starts over where the output can't be switched.
+     * @param handle The handle returned from open()
+     */
+    fun parkVideoDecoder(handle: Long) {
+        nativeParkVideoDecoder(handle)
+    }
+
+    /**
+     * Skip rendering decoded frames that arrived more than budgetMs before
+     * the newest frame queued to the codec, so a backlog after a stall is
+     * dropped rather than played. They are still decoded. 200 ms by default.
+     * Requires startVideoDecoder() or prepareVideoDecoder().
+     * @param handle The handle returned from open()
+     * @param budgetMs Largest lag still rendered, 0 to render every frame
+     * @return false without a native decoder
+     */
+    fun setVideoLateFrameBudget(handle: Long, budgetMs: Int): Boolean {
+        return nativeSetVideoLateFrameBudget(handle, budgetMs)
+    }
+
+    /**
+     * Stop the native decoder and release its codec and surface.
+     * @param handle The handle returned from open()
+     */
+    fun stopVideoDecoder(handle: Long) {
+        nativeStopVideoDecoder(handle)
+    }
+
+    /**
+     * Get native decoder statistics.
+     * @param handle The handle returned from open()
+     * @return [queued, copied from slots, skipped, rendered, codec errors, late], or null
+     */
+    fun getVideoDecoderStats(handle: Long): LongArray? {
+        return nativeGetVideoDecoderStats(handle)
+    }
+
+    /**
+     * Get per-frame latency of the native decoder, in microseconds.
+     * Spans run from USB arrival to queued, queued to decoded and decoded
+     * to the vsync the frame was released for.
+     * @param handle The handle returned from open()
+     * @return [frames, queue total, decode total, present total,
+     *          queue last, decode last, present last], or null
+     */
+    fun getVideoLatencyStats(handle: Long): LongArray? {
+        return nativeGetVideoLatencyStats(handle)
+    }
+
+    /**
+     * Get A/V sync statistics of the native decoder. Frames are held for
+     * audio by up to 250 ms, late ones are shown at once, and without
+     * native audio playing they free-run.
+     * @param handle The handle returned from open()
+     * @return [held for audio, late, free-running, last lead of video over audio in us], or null
+     */
+    fun getAvSyncStats(handle: Long): LongArray? {
+        return nativeGetAvSyncStats(handle)
+    }
+
+    /**
+     * Find all NAL units of an Annex-B buffer in one pass.
+     * Uses the NEON start code scanner where available.
+     * @param data Buffer holding the access unit
+     * @param offset Start of the access unit in data
+     * @param length Length of the access unit
+     * @param hevc true to decode H.265 NAL types, false for H.264
+     * @param units Receives [offset, length, type] per unit, up to 32 units
+     * @return Number of units found
+     */
+    fun scanNalUnits(data: ByteArray, offset: Int, length: Int, hevc: Boolean, units: IntArray): Int {
+        return nativeScanNalUnits(data, offset, length, hevc, units)
+    }
+
+    /**
+     * Parse an SPS NAL unit, with or without its start code.
+     * @param hevc true for an H.265 SPS, false for H.264
+     * @return [width, height, profile, level, max frame bytes, frame rate x1000 or 0],
+     *         width and height after cropping, or null if it doesn't parse
+     */
+    fun parseSps(data: ByteArray, hevc: Boolean = false): IntArray? {
+        return nativeParseSps(data, hevc)
+    }
+
+    /**
+     * Set scheduling and CPU placement for a named native thread
+     * ("AAP-USB-Event", "AAP-TCP-Event", "AAP-Audio", "AAP-Video", "AAP-Control",
+     * "AAP-Background", "AAP-Worker", "AAP-Decrypt", "AAP-Ack", "AAP-Mic", "AAP-Sensor", "AAP-Input",
+     * "AAP-Decode", "AAP-Render", "AAP-Vsync", "AAP-Governor", "AAP-Watchdog", "AAP-Stats").
+     * Applies to threads started afterwards, so call it before startReading().
+     * By default AAP-Audio runs SCHED_FIFO and the event threads and AAP-Input
+     * at nice -16, all on the big cores, and AAP-Background, AAP-Governor,
+     * AAP-Watchdog and AAP-Stats at nice 10 on the little cores.
+     * @param policy One of the THREAD_POLICY_ constants
+     * @param priority Nice value for THREAD_POLICY_OTHER, real-time priority otherwise (0 = highest)
+     * @param cpuMask CPUs the thread may run on, 0 leaves the affinity alone; see getCpuTopology()
+     * @return false if the policy or priority is out of range
+     */
+    fun setThreadPolicy(name: String, policy: Int, priority: Int = 0, cpuMask: Long = 0): Boolean {
+        return nativeSetThreadPolicy(name, policy, priority, cpuMask)
+    }
+
+    /**
+     * Get the CPU clusters as detected from /sys/devices/system/cpu.
+     * @return [cpuCount, bigCoreMask, littleCoreMask]; both masks cover every CPU on a homogeneous SoC
+     */
+    fun getCpuTopology(): LongArray? {
+        return nativeGetCpuTopology()
+    }
+
+    /**
+     * Emit native trace sections and counters (USB transfers, framing,
+     * decryption, dispatch, queue depths) into system traces, to line them
+     * up with SurfaceFlinger and MediaCodec in Perfetto. Off by default;
+     * sections need API 23, counters and USB TX spans API 29.
+     * @return false if tracing isn't available on this device
+     */
+    fun setTracingEnabled(enabled: Boolean): Boolean {
+        return nativeSetTracingEnabled(enabled)
+    }
+
+    /**
+     * Record the per-packet native debug logs (reads, writes) into per-thread
+     * binary rings that a background thread formats, instead of logging each
+     * one synchronously from the I/O threads. Off by default; debug points
+     * are compiled out of builds with a higher AAP_LOG_MIN_PRIORITY.
+     * @param priority Lowest android.util.Log priority recorded, Log.ASSERT + 1 turns it off
+     * @param path File to append the entries to, null for logcat
+     * @return false if the file could not be opened; entries go to logcat then
+     */
+    fun setFastLogging(priority: Int, path: String? = null): Boolean {
+        return nativeSetFastLog(priority, path)
+    }
+
+    /**
+     * Get fast log totals, after flushing what is pending.
+     * @return [written, dropped, threads]
+     */
+    fun getFastLogStats(): LongArray? {
+        return nativeGetFastLogStats()
+    }
+
+    /**
+     * Set how the streaming buffers (rings, queue arenas, record pool, video
+     * frame slots, heap transfer buffers) are backed. Applies to buffers
+     * allocated afterwards, so call it before open(). All off by default.
+     * @param populate Fault the pages in at allocation
+     * @param hugePages Advise transparent huge pages on buffers of 2 MB and up
+     * @param lock mlock the pages; may fail under RLIMIT_MEMLOCK, see getStreamingMemoryStats()
+     */
+    fun setStreamingMemoryOptions(populate: Boolean, hugePages: Boolean, lock: Boolean) {
+        nativeSetStreamingMemoryOptions(populate, hugePages, lock)
+    }
+
+    /**
+     * Get streaming buffer memory totals. bytesResident walks every live
+     * buffer, poll it rather than calling it per frame.
+     * @return [bytesMapped, bytesLocked, bytesHugeAdvised, lockFailures, bytesResident]
+     */
+    fun getStreamingMemoryStats(): LongArray? {
+        return nativeGetStreamingMemoryStats()
+    }
+
+    /**
+     * Size the native pools (video frame slots, dispatcher queues, record
+     * pool) created afterwards, so call it before open(). The lean profile
+     * fits them to the video stream the phone will send; the standard one
+     * covers anything up to 4K.
+     * @param bitrateKbps 0 to estimate it from the resolution and frame rate
+     */
+    fun setMemoryProfile(lean: Boolean, width: Int, height: Int, fps: Int, bitrateKbps: Int = 0) {
+        nativeSetMemoryProfile(lean, width, height, fps, bitrateKbps)
+    }
+
+    /**
+     * Enable zero-copy delivery of raw transfers via onSlotData.
+     * Must be called before startReading().
+     * @param handle The handle returned from open()
+     * @param enabled true to deliver transfer slots instead of copied arrays
+     */
+    fun setZeroCopyEnabled(handle: Long, enabled: Boolean) {
+        nativeSetZeroCopyEnabled(handle, enabled)
+    }
+
+    /**
+     * Get direct buffer views of the native transfer slots.
+     * Views stay valid until close() is called.
+     * @param handle The handle returned from open()
+     * @return One buffer per slot, or null on failure
+     */
+    fun getSlotBuffers(handle: Long): Array<ByteBuffer>? {
+        return nativeGetSlotBuffers(handle)
+    }
+
+    /**
+     * Return a slot received in onSlotData so it can be resubmitted.
+     * @param handle The handle returned from open()
+     * @param slot The slot index from onSlotData
+     */
+    fun releaseSlot(handle: Long, slot: Int) {
+        nativeReleaseSlot(handle, slot)
+    }
+
+    /**
+     * Write data to USB.
+     * After startReading() the data is queued and sent asynchronously;
+     * transfer failures are then reported through errorCallback.
+     * Short writes while reading pin the array instead of copying it.
+     * @param handle The handle returned from open()
+     * @param data The data to write
+     * @param offset Start of the bytes to write in data
+     * @param length The number of bytes to write
+     * @return The number of bytes written or queued, or negative on error
+     */
+    fun write(handle: Long, data: ByteArray, offset: Int, length: Int): Int {
+        return nativeWrite(handle, data, offset, length)
+    }
+
+    fun write(handle: Long, data: ByteArray, length: Int): Int {
+        return nativeWrite(handle, data, 0, length)
+    }
+
+    /**
+     * Write from a direct ByteBuffer without any JNI copy.
+     * Position and limit are ignored, offset is from the start of the buffer.
+     * @return The number of bytes written or queued, or negative on error
+     */
+    fun write(handle: Long, buffer: ByteBuffer, offset: Int, length: Int): Int {
+        return nativeWriteBuffer(handle, buffer, offset, length)
+    }
+
+    /**
+     * Check if the connection is open.
+     * @param handle The handle returned from open()
+     * @return true if open, false otherwise
+     */
+    fun isOpen(handle: Long): Boolean {
+        return nativeIsOpen(handle)
+    }
+
+    /**
+     * Read data from USB synchronously (for handshake).
+     * @param handle The handle returned from open()
+     * @param data The buffer to read into
+     * @param offset Where in data the bytes go
+     * @param length The maximum number of bytes to read
+     * @param timeoutMs The timeout in milliseconds
+     * @return The number of bytes read, or negative on error
+     */
+    fun read(handle: Long, data: ByteArray, offset: Int, length: Int, timeoutMs: Int): Int {
+        return nativeRead(handle, data, offset, length, timeoutMs)
+    }
+
+    fun read(handle: Long, data: ByteArray, length: Int, timeoutMs: Int): Int {
+        return nativeRead(handle, data, 0, length, timeoutMs)
+    }
+
+    /**
+     * Read synchronously into a direct ByteBuffer, see read().
+     * Position and limit are ignored, offset is from the start of the buffer.
+     */
+    fun read(handle: Long, buffer: ByteBuffer, offset: Int, length: Int, timeoutMs: Int): Int {
+        return nativeReadBuffer(handle, buffer, offset, length, timeoutMs)
+    }
+
+    /**
+     * Limits of one native dispatcher queue, 0 keeps the native default.
+     * @param slots Records queued at once
+     * @param bytes Payload bytes queued at once, at least 128 KiB
+     * @param policy One of QUEUE_POLICY_*: what dispatch does when it is full
+     * @param blockTimeoutUs Longest QUEUE_POLICY_BLOCK waits for room
+     */
+    class QueueConfig(
+        val slots: Int = 0,
+        val bytes: Int = 0,
+        val policy: Int = QUEUE_POLICY_DEFAULT,
+        val blockTimeoutUs: Int = 0
+    )
+
+    /**
+     * What openLoadGenerator() streams.
+     * @param videoKbps 0 for no video
+     * @param keyframeInterval Frames from one IDR to the next
+     * @param keyframeScale Size of an IDR in P frames
+     * @param maxNalSize Slices per frame are cut to this size, 0 for one slice
+     * @param audioStreams LOAD_AUDIO_* flags
+     * @param metadataHz Playback metadata on the media playback channel, 0 for none
+     * @param albumArtBytes Cover art carried by each metadata message
+     * @param maxRecordPayload Longer messages are fragmented, 0 for the TLS maximum
+     * @param transferSize Bytes per rawDataCallback, 0 for 16 KiB
+     */
+    class LoadProfile(
+        val width: Int = 1280,
+        val height: Int = 720,
+        val fps: Int = 30,
+        val videoKbps: Int = 6000,
+        val keyframeInterval: Int = 60,
+        val keyframeScale: Int = 8,
+        val maxNalSize: Int = 0,
+        val audioStreams: Int = LOAD_AUDIO_MEDIA,
+        val audioFrameMs: Int = 20,
+        val pingHz: Int = 1,
+        val metadataHz: Int = 0,
+        val albumArtBytes: Int = 0,
+        val maxRecordPayload: Int = 0,
+        val transferSize: Int = 0,
+        val encrypt: Boolean = true,
+        val seed: Int = 1
+    ) {
+        // Layout read by the native loadConfig()
+        internal fun pack(): IntArray = intArrayOf(
+            width, height, fps, videoKbps, keyframeInterval, keyframeScale, maxNalSize,
+            audioStreams, audioFrameMs, pingHz, metadataHz, albumArtBytes,
+            maxRecordPayload, transferSize, if (encrypt) 1 else 0, seed
+        )
+    }
+
+    /**
+     * Queue limits per priority. By default audio and video drop the newest
+     * record when full, control waits for room, never dropping, and metadata
+     * (background) waits up to 20 ms before dropping.
+     * @param poolWorkers Above 0, video, control and metadata channels run on
+     *        this many AAP-Worker threads instead of a thread per priority:
+     *        each channel keeps its order but gets its own queue, sharing its
+     *        priority's bytes, and callbacks of one priority may run at the
+     *        same time for different channels. Control batching is then off
+     */
+    class DispatchQueues(
+        val audio: QueueConfig = QueueConfig(),
+        val video: QueueConfig = QueueConfig(),
+        val control: QueueConfig = QueueConfig(),
+        val background: QueueConfig = QueueConfig(),
+        val poolWorkers: Int = 0
+    ) {
+        // Layout read by the native dispatcherConfig()
+        internal fun pack(): IntArray = intArrayOf(
+            audio.slots, audio.bytes, audio.policy, audio.blockTimeoutUs,
+            video.slots, video.bytes, video.policy, video.blockTimeoutUs,
+            control.slots, control.bytes, control.policy, control.blockTimeoutUs,
+            background.slots, background.bytes, background.policy, background.blockTimeoutUs,
+            poolWorkers
+        )
+    }
+
+    /**
+     * Upcall targets of one native connection, registered with setCallbacks().
+     * Each connection has its own, so several devices can run side by side
+     * without sharing a callback. Set the fields before startReading().
+     */
+    class Callbacks {
+
+        /**
+         * Raw data callback - receives raw USB bytes for parsing in Kotlin.
+         * Messages are delivered from the USB event thread sequentially.
+         */
+        @Volatile
+        var rawDataCallback: ((data: ByteArray, length: Int) -> Unit)? = null
+
+        /**
+         * Record callback - receives complete AAP records framed natively.
+         * The data array is reused by the native layer and only valid during the call.
+         */
+        @Volatile
+        var recordCallback: ((channel: Int, flags: Int, totalLength: Int, data: ByteArray, length: Int) -> Unit)? = null
+
+        /**
+         * Slot callback - receives raw USB bytes as a range of a native transfer slot.
+         * The slot must be returned with releaseSlot() once its bytes are consumed.
+         */
+        @Volatile
+        var slotDataCallback: ((slot: Int, offset: Int, length: Int) -> Unit)? = null
+
+        /**
+         * Decrypt callback - native dispatch mode only.
+         * Called on the USB event thread in record order; decrypts into the
+         * plaintext buffer passed to setDispatchEnabled() and returns its length,
+         * or a negative value to drop the record.
+         */
+        @Volatile
+        var decryptRecordCallback: ((channel: Int, flags: Int, data: ByteArray, length: Int) -> Int)? = null
+
+        /**
+         * Dispatched record callbacks - native dispatch mode only.
+         * Called with decrypted records on the AAP-Audio, AAP-Video and AAP-Control threads,
+         * and with metadata channel records (ID_MPB, ID_NAV, ID_NOTI) on AAP-Background;
+         * all but audio on AAP-Worker threads with DispatchQueues.poolWorkers, where one
+         * channel is delivered by one thread at a time but channels may be concurrent.
+         * msgType is read natively, -1 for a record too short to carry one. data is
+         * reused for the channel's next record once the callback returns.
+         */
+        @Volatile
+        var audioRecordCallback: ((channel: Int, flags: Int, msgType: Int, data: ByteArray, length: Int) -> Unit)? = null
+        @Volatile
+        var videoRecordCallback: ((channel: Int, flags: Int, msgType: Int, data: ByteArray, length: Int) -> Unit)? = null
+        @Volatile
+        var controlRecordCallback: ((channel: Int, flags: Int, msgType: Int, data: ByteArray, length: Int) -> Unit)? = null
+        @Volatile
+        var backgroundRecordCallback: ((channel: Int, flags: Int, msgType: Int, data: ByteArray, length: Int) -> Unit)? = null
+
+        /**
+         * Control batch callback - batched control delivery only.
+         * Called on AAP-Control with the number of records packed into the
+         * buffer from getControlBatchBuffer(), replaces controlRecordCallback
+         * except for records too large for a batch. The buffer is reused once
+         * the callback returns.
+         */
+        @Volatile
+        var controlBatchCallback: ((count: Int) -> Unit)? = null
+
+        /**
+         * Audio media callback - native audio output only.
+         * Called on AAP-Audio once per PCM record played natively, so the
+         * media ACK can still be sent.
+         */
+        @Volatile
+        var audioMediaCallback: ((channel: Int) -> Unit)? = null
+
+        /**
+         * Coalesced media ACK callback - media ACK batching only.
+         * Called on a dispatcher thread or AAP-Ack with the number of media
+         * records to acknowledge, replaces audioMediaCallback and videoMediaCallback.
+         */
+        @Volatile
+        var mediaAckCallback: ((channel: Int, count: Int) -> Unit)? = null
+
+        /**
+         * Mic record callback - native mic input only.
+         * Called on AAP-Mic with one framed ID_MIC record to encrypt and send.
+         * The array is not reused.
+         */
+        @Volatile
+        var micRecordCallback: ((data: ByteArray, length: Int) -> Unit)? = null
+
+        /**
+         * Sensor batch callback - sensor batching only.
+         * Called on AAP-Sensor with one plaintext SENSOR_EVENT record to encrypt
+         * and send. The array is not reused.
+         */
+        @Volatile
+        var sensorBatchCallback: ((data: ByteArray, length: Int) -> Unit)? = null
+
+        /**
+         * Input record callback - touch input fast path only.
+         * Called on AAP-Input with one plaintext touch record, to encrypt and
+         * write before returning. The array is reused, do not retain it.
+         */
+        @Volatile
+        var inputRecordCallback: ((data: ByteArray, length: Int) -> Unit)? = null
+
+        /**
+         * Video media callback - native video stage only.
+         * Called on AAP-Video once per media record consumed natively, so the
+         * media ACK can still be sent.
+         */
+        @Volatile
+        var videoMediaCallback: ((channel: Int) -> Unit)? = null
+
+        /**
+         * Keyframe callback - native video stage only.
+         * Called on AAP-Video when frames are dropped until the next keyframe,
+         * after a full queue or a lost record.
+         */
+        @Volatile
+        var videoKeyframeCallback: ((channel: Int) -> Unit)? = null
+
+        /**
+         * Error callback - receives USB error notifications.
+         */
+        @Volatile
+        var errorCallback: ((errorCode: Int, message: String) -> Unit)? = null
+
+        // Upcalls from native code (called on native threads)
+
+        /**
+         * Raw data callback - called with raw USB bytes.
+         * Kotlin handles all message parsing and TLS decryption.
+         */
+        fun onRawData(data: ByteArray, length: Int) {
+            try {
+                rawDataCallback?.invoke(data, length)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in raw data callback" }
+            }
+        }
+
+        /**
+         * Record callback - called with one complete AAP record.
+         * Header and first fragment total length are already decoded.
+         */
+        fun onRecord(channel: Int, flags: Int, totalLength: Int, data: ByteArray, length: Int) {
+            try {
+                recordCallback?.invoke(channel, flags, totalLength, data, length)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in record callback" }
+            }
+        }
+
+        /**
+         * Slot callback - called when a transfer slot holds new raw USB bytes.
+         */
+        fun onSlotData(slot: Int, offset: Int, length: Int) {
+            try {
+                slotDataCallback?.invoke(slot, offset, length)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in slot data callback" }
+            }
+        }
+
+        fun onDecryptRecord(channel: Int, flags: Int, data: ByteArray, length: Int): Int {
+            return try {
+                decryptRecordCallback?.invoke(channel, flags, data, length) ?: -1
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in decrypt record callback" }
+                -1
+            }
+        }
+
+        fun onAudioRecord(channel: Int, flags: Int, msgType: Int, data: ByteArray, length: Int) {
+            try {
+                audioRecordCallback?.invoke(channel, flags, msgType, data, length)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in audio record callback" }
+            }
+        }
+
+        fun onVideoRecord(channel: Int, flags: Int, msgType: Int, data: ByteArray, length: Int) {
+            try {
+                videoRecordCallback?.invoke(channel, flags, msgType, data, length)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in video record callback" }
+            }
+        }
+
+        fun onAudioMediaConsumed(channel: Int) {
+            try {
+                audioMediaCallback?.invoke(channel)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in audio media callback" }
+            }
+        }
+
+        fun onMicRecord(data: ByteArray, length: Int) {
+            try {
+                micRecordCallback?.invoke(data, length)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in mic record callback" }
+            }
+        }
+
+        fun onSensorBatch(data: ByteArray, length: Int) {
+            try {
+                sensorBatchCallback?.invoke(data, length)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in sensor batch callback" }
+            }
+        }
+
+        fun onInputRecord(data: ByteArray, length: Int) {
+            try {
+                inputRecordCallback?.invoke(data, length)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in input record callback" }
+            }
+        }
+
+        fun onMediaAck(channel: Int, count: Int) {
+            try {
+                mediaAckCallback?.invoke(channel, count)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in media ACK callback" }
+            }
+        }
+
+        fun onVideoMediaConsumed(channel: Int) {
+            try {
+                videoMediaCallback?.invoke(channel)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in video media callback" }
+            }
+        }
+
+        fun onVideoKeyframeNeeded(channel: Int) {
+            try {
+                videoKeyframeCallback?.invoke(channel)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in video keyframe callback" }
+            }
+        }
+
+        fun onControlRecord(channel: Int, flags: Int, msgType: Int, data: ByteArray, length: Int) {
+            try {
+                controlRecordCallback?.invoke(channel, flags, msgType, data, length)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in control record callback" }
+            }
+        }
+
+        fun onBackgroundRecord(channel: Int, flags: Int, msgType: Int, data: ByteArray, length: Int) {
+            try {
+                backgroundRecordCallback?.invoke(channel, flags, msgType, data, length)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in background record callback" }
+            }
+        }
+
+        fun onControlBatch(count: Int) {
+            try {
+                controlBatchCallback?.invoke(count)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in control batch callback" }
+            }
+        }
+
+        fun onError(errorCode: Int, message: String) {
+            AppLog.e { "Native USB error $errorCode: $message" }
+            try {
+                errorCallback?.invoke(errorCode, message)
+            } catch (e: Exception) {
+                AppLog.e(e) { "Error in error callback" }
+            }
         }
     }
 }
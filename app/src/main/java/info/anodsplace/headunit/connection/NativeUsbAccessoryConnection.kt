@@ -3,16 +3,22 @@ package info.anodsplace.headunit.connection
 import android.hardware.usb.UsbDevice
 import android.hardware.usb.UsbDeviceConnection
 import android.hardware.usb.UsbManager
+import android.util.Log
 import info.anodsplace.headunit.aap.AapMessageIncoming
 import info.anodsplace.headunit.aap.AapSsl
 import info.anodsplace.headunit.aap.AapMessage
 import info.anodsplace.headunit.aap.Utils
 import info.anodsplace.headunit.aap.protocol.Channel
 import info.anodsplace.headunit.aap.protocol.messages.Messages
+import info.anodsplace.headunit.decoder.MemoryProfile
+import info.anodsplace.headunit.decoder.NativeVideoDecoder
+import info.anodsplace.headunit.decoder.NativeVideoFrameSource
+import info.anodsplace.headunit.decoder.VideoFrameSource
 import info.anodsplace.headunit.utils.AppLog
 import info.anodsplace.headunit.utils.MessageDispatcher
 import java.nio.BufferUnderflowException
 import java.nio.ByteBuffer
+import java.nio.ByteOrder
 
 /**
  * USB connection using native libusb for high-performance async I/O.
@@ -22,20 +28,141 @@ import java.nio.ByteBuffer
  * - Dispatches messages by priority (audio > video > control)
  * - Delivers messages via callbacks instead of polling
  *
- * The native layer parses message headers and routes by channel type.
- * Kotlin handles TLS decryption and message processing.
+ * The native layer frames complete AAP records (useNativeFraming) and
+ * Kotlin handles TLS decryption and message processing. Without native
+ * framing, useZeroCopy reads raw transfers through direct buffer views
+ * of the native transfer slots instead of a copied ByteArray.
+ * useShadowFraming runs the native framer on the same transfers without
+ * native framing, and the native decrypt too when the read key exports,
+ * checking them against the Kotlin parser record by record, see
+ * NativeUsb.getShadowFramingStats().
+ *
+ * With useNativeDispatcher, records are decrypted on the USB thread into a
+ * direct plaintext buffer and then delivered on the native AAP-Audio,
+ * AAP-Video, AAP-Control and AAP-Background (metadata channels) threads,
+ * replacing the Kotlin MessageDispatcher.
+ * When the SSL implementation exports its read key, records are decrypted
+ * natively instead, and useParallelDecrypt spreads large video records
+ * over a small pool of native decrypt workers, decryptWorkers of them or
+ * one per spare core for 0. useQualityGovernor throttles
+ * that pool and sheds background records when the device runs hot or the
+ * pipeline falls behind, see NativeUsb.setQualityGovernorEnabled().
+ *
+ * useNativeVideo also reassembles video media natively: frames are read
+ * from videoFrameSource, or decoded natively through videoDecoder, and
+ * Kotlin only sees onVideoMediaConsumed, to ACK. useLowLatencyVideo starts
+ * that decoder in low latency mode, rendering on vsync.
+ *
+ * useNativeAudio plays audio channel PCM natively from AAP-Audio, Kotlin
+ * only sees onAudioMediaConsumed, to ACK. useAudioMixer plays all the
+ * channels through one mixed stream instead, ducking media under guidance.
+ * With both native stages,
+ * useAvSync holds decoded frames until the audio being heard reaches
+ * their timestamp. With useMediaAckBatching those
+ * per-record calls are coalesced natively into onMediaAck.
+ * useAckFlowControl then withholds a channel's ACKs while its native queue
+ * is filling up, so the phone backs off instead of records being dropped.
+ *
+ * useNativeKeepalive answers ping requests natively, right after decrypt
+ * on the USB thread, once outgoing records are encrypted natively. Batched
+ * media ACKs are then written natively too, so neither waits on the JVM.
+ *
+ * useBatchedControl packs control records into one native buffer and
+ * delivers them with a single upcall per batch instead of one each.
+ * useSharedControlRing goes further: control records are published into a
+ * ring shared with Kotlin and drained by the AAP-ControlRing thread, so no
+ * Kotlin code runs on the native threads for control traffic.
+ *
+ * startMic() captures the microphone natively, onMicRecord then gets
+ * framed ID_MIC records for AapTransport.sendMicRecord().
+ *
+ * useSensorBatching coalesces sensor updates natively: submitSensor()
+ * keeps the latest per sensor type and onSensorBatch gets one record per
+ * window, for AapTransport to send on its low priority lane.
+ *
+ * useTouchFastPath takes touch input off the transport's handler: samples
+ * from submitTouch() are encoded natively on AAP-Input and onInputRecord
+ * writes each record at once, coalescing MOVE samples while one is written.
+ *
+ * useResubmitFirst keeps the bulk IN endpoint fed however slow the
+ * consumer: a completed transfer swaps in a spare buffer and is resubmitted
+ * at once, the filled one is delivered from the native AAP-USB-Rx thread.
+ * It has no effect with useZeroCopy, whose slots are the transfer buffers.
+ *
+ * useLockedBuffers backs the native streaming buffers with pre-faulted,
+ * mlock'd memory (huge pages where large enough), so a session never
+ * page faults and the buffers survive memory pressure.
+ *
+ * useTracing emits native trace sections and counters for Perfetto or
+ * systrace, see NativeUsb.setTracingEnabled().
+ *
+ * useFastLog records the native per-packet debug logs through the
+ * background binary logger, see NativeUsb.setFastLogging().
+ *
+ * usePrewarm opens the native connection as soon as the accessory is
+ * connected: the handshake then runs on native synchronous transfers
+ * while AAP-Prewarm sets up the framing, dispatch and media stages, so
+ * startReading() only has to hand over the keys. AapTransport also skips
+ * its settle delays for a pre-warmed connection.
+ *
+ * memoryProfile sizes the native frame slots, dispatcher queues and record
+ * pool, see MemoryProfile. numTransfers and transferSize are the bulk IN
+ * transfers kept in flight, Settings.usbTransfers and usbTransferSize as
+ * DeviceCalibration tuned them.
+ *
+ * capturePath records every read from the phone, and the read key when
+ * records are decrypted natively, for NativeUsb.openReplay(). The key
+ * decrypts the whole session, so keep the file in private storage.
+ * stallSnapshotPath enables the stall watchdog, which writes a diagnostic
+ * snapshot there when a native thread stops making progress. statsPath
+ * publishes the native stats there for NativeStatsFile readers.
  */
 class NativeUsbAccessoryConnection(
     private val usbMgr: UsbManager,
-    private val device: UsbDevice
-) : AccessoryConnection {
+    val device: UsbDevice,
+    private val useNativeFraming: Boolean = true,
+    private val useShadowFraming: Boolean = false,
+    private val useZeroCopy: Boolean = false,
+    private val useNativeDispatcher: Boolean = false,
+    private val useParallelDecrypt: Boolean = false,
+    private val useQualityGovernor: Boolean = false,
+    private val useNativeVideo: Boolean = false,
+    private val useLowLatencyVideo: Boolean = false,
+    private val useNativeAudio: Boolean = false,
+    private val useAudioMixer: Boolean = false,
+    private val useAvSync: Boolean = false,
+    private val useMediaAckBatching: Boolean = false,
+    private val useAckFlowControl: Boolean = false,
+    private val useNativeKeepalive: Boolean = false,
+    private val useBatchedControl: Boolean = false,
+    private val useSharedControlRing: Boolean = false,
+    private val useSensorBatching: Boolean = false,
+    private val useTouchFastPath: Boolean = false,
+    private val useResubmitFirst: Boolean = false,
+    private val useLockedBuffers: Boolean = false,
+    private val useTracing: Boolean = false,
+    private val useFastLog: Boolean = false,
+    private val usePrewarm: Boolean = false,
+    private val capturePath: String? = null,
+    private val stallSnapshotPath: String? = null,
+    private val statsPath: String? = null,
+    private val dispatchQueues: NativeUsb.DispatchQueues? = null,
+    private val memoryProfile: MemoryProfile = MemoryProfile.STANDARD,
+    private val numTransfers: Int = NativeUsb.DEFAULT_NUM_TRANSFERS,
+    private val transferSize: Int = NativeUsb.DEFAULT_TRANSFER_SIZE,
+    private val decryptWorkers: Int = 0
+) : MessageStreamConnection {
 
     private var usbDeviceConnection: UsbDeviceConnection? = null
     private var usbInterface: android.hardware.usb.UsbInterface? = null
     private var inEndpoint: android.hardware.usb.UsbEndpoint? = null
     private var outEndpoint: android.hardware.usb.UsbEndpoint? = null
-    private var nativeHandle: Long = 0
+    @Volatile private var nativeHandle: Long = 0
+    // usePrewarm: configures the stages while the handshake runs, joined by startReading()
+    private var prewarmThread: Thread? = null
     private var useNativeForIO = false  // Start with Android API for handshake
+    // Upcalls of this connection's native handle only, see setupCallbacks()
+    private val callbacks = NativeUsb.Callbacks()
 
     // Message dispatcher for decoupled processing
     private val dispatcher = MessageDispatcher()
@@ -43,32 +170,111 @@ class NativeUsbAccessoryConnection(
     // Message handler callbacks (set by AapTransport)
     // Video and Audio bypass dispatcher for lowest latency - they're time-critical
     // Control goes through dispatcher since it's less latency-sensitive
-    var onAudioMessage: ((AapMessage) -> Unit)? = null  // Called directly for low latency
-    var onVideoMessage: ((AapMessage) -> Unit)? = null  // Called directly, not through dispatcher
-    var onControlMessage: ((AapMessage) -> Unit)? = null
+    override var onAudioMessage: ((AapMessage) -> Unit)? = null  // Called directly for low latency
+    override var onVideoMessage: ((AapMessage) -> Unit)? = null  // Called directly, not through dispatcher
+    override var onControlMessage: ((AapMessage) -> Unit)? = null
         set(value) {
             field = value
             dispatcher.setCallback(MessageDispatcher.Type.CONTROL, value)
         }
-    var onDisconnect: (() -> Unit)? = null
+    override var onDisconnect: (() -> Unit)? = null
+    // Native audio output only: one call per PCM record, replaces onAudioMessage for media
+    var onAudioMediaConsumed: ((channel: Int) -> Unit)? = null
+    // Native mic input only: one framed ID_MIC record, see AapTransport.sendMicRecord()
+    var onMicRecord: ((data: ByteArray, length: Int) -> Unit)? = null
+    // Sensor batching only: one plaintext SENSOR_EVENT record per window
+    var onSensorBatch: ((data: ByteArray, length: Int) -> Unit)? = null
+    // Touch fast path only: one plaintext touch record, to encrypt and write before returning
+    var onInputRecord: ((data: ByteArray, length: Int) -> Unit)? = null
+    // Media ACK batching only: one call per coalesced ACK, replaces the two above
+    var onMediaAck: ((channel: Int, count: Int) -> Unit)? = null
+    // Native video stage only: one call per media record, replaces onVideoMessage for media
+    var onVideoMediaConsumed: ((channel: Int) -> Unit)? = null
+    // Native video stage only: frames are dropped until a keyframe, ask the phone for one
+    var onVideoKeyframeNeeded: ((channel: Int) -> Unit)? = null
+
+    /**
+     * Decoder frame source when the native video stage is active, null otherwise.
+     */
+    @Volatile var videoFrameSource: VideoFrameSource? = null
+        private set
+
+    /**
+     * AMediaCodec decoder for the native video stage, null when inactive.
+     */
+    @Volatile var videoDecoder: NativeVideoDecoder? = null
+        private set
+
+    /**
+     * True when audio PCM is played natively.
+     */
+    @Volatile var nativeAudio = false
+        private set
+
+    /**
+     * True when sensor updates are coalesced natively, see submitSensor().
+     */
+    @Volatile var sensorBatching = false
+        private set
+
+    /**
+     * True when touch input goes through the native fast path, see submitTouch().
+     */
+    @Volatile var touchFastPath = false
+        private set
 
     // SSL for decryption
     internal var ssl: AapSsl? = null
+    // Outgoing records are encrypted natively, see enableNativeEncrypt()
+    private var nativeEncrypt = false
+    // Pings are answered natively, see enableNativeKeepalive()
+    private var nativeKeepalive = false
 
-    // Message parsing buffers (similar to AapReadMultipleMessages)
-    private val fifo = ByteBuffer.allocate(Messages.DEF_BUFFER_LENGTH * 2)
+    // Message parsing buffers (similar to AapReadMultipleMessages), only
+    // allocated when records are framed in Kotlin
+    private val fifo by lazy { ByteBuffer.allocate(Messages.DEF_BUFFER_LENGTH * 2) }
     private val recvHeader = AapMessageIncoming.EncryptedHeader()
-    private val msgBuffer = ByteArray(65535)
+    private val msgBuffer by lazy { ByteArray(65535) }
+
+    // Shadow framing: what handleRawData() parsed from the transfer, reported natively
+    private var shadowFraming = false
+    private var shadowRecords = IntArray(NativeUsb.SHADOW_RECORD_FIELDS * 64)
+    private var shadowDecryptNs = 0L
+
+    // Direct views of the native transfer slots (zero-copy mode)
+    private var slotBuffers: Array<ByteBuffer>? = null
+
+    // Decrypt target for native dispatch mode, read directly by native code
+    private var plaintextBuffer: ByteBuffer? = null
+    private var nativeDispatch = false
+    // Native control batches, read on AAP-Control only
+    private var controlBatchBuffer: ByteBuffer? = null
+    // Shared control ring, read on controlRingThread only
+    private var controlRing: ByteBuffer? = null
+    private var controlRingThread: Thread? = null
+    @Volatile private var controlRingRunning = false
+
+    // Dispatched records, a channel is delivered by one native thread at a
+    // time; control batches and the ring have a thread each
+    private val dispatchedMessages = AapMessageIncoming.ChannelMessages()
+    private val controlBatchMessage = AapMessageIncoming.recycled()
+    private val controlRingMessage = AapMessageIncoming.recycled()
+    // Payloads copied out of a control batch or the ring, allocated on first use
+    private var controlPayload = ByteArray(0)
+    private var controlRingPayload = ByteArray(0)
 
     fun isDeviceRunning(device: UsbDevice): Boolean {
         synchronized(this) {
-            if (nativeHandle == 0L) return false
+            if (usbDeviceConnection == null) return false
             return this.device.uniqueName == device.uniqueName
         }
     }
 
     override val isSingleMessage: Boolean = false
 
+    override val isPrewarmed: Boolean
+        get() = nativeHandle != 0L
+
     override val isConnected: Boolean
         get() = synchronized(this) {
             usbDeviceConnection != null
@@ -130,6 +336,10 @@ class NativeUsbAccessoryConnection(
                 // Set up callbacks for later native use
                 setupCallbacks()
 
+                if (usePrewarm) {
+                    prewarm(connection)
+                }
+
             } catch (e: Exception) {
                 connection.close()
                 throw if (e is UsbOpenException) e else UsbOpenException(e.message ?: "Unknown error")
@@ -139,11 +349,60 @@ class NativeUsbAccessoryConnection(
 
     private fun setupCallbacks() {
         // Native layer sends raw USB data, we parse it here
-        NativeUsb.rawDataCallback = { data, length ->
-            handleRawData(data, length)
+        callbacks.rawDataCallback = { data, length ->
+            handleRawData(ByteBuffer.wrap(data, 0, length))
         }
 
-        NativeUsb.errorCallback = { errorCode, message ->
+        callbacks.slotDataCallback = { slot, offset, length ->
+            handleSlotData(slot, offset, length)
+        }
+
+        // Native framer sends whole records, no FIFO needed
+        callbacks.recordCallback = { channel, flags, _, data, length ->
+            handleRecord(channel, flags, data, length)
+        }
+
+        callbacks.decryptRecordCallback = { channel, flags, data, length ->
+            decryptRecord(channel, flags, data, length)
+        }
+        callbacks.audioRecordCallback = { channel, flags, msgType, data, length ->
+            onAudioMessage?.invoke(dispatchedMessages.recycle(channel, flags, msgType, data, length))
+        }
+        callbacks.videoRecordCallback = { channel, flags, msgType, data, length ->
+            onVideoMessage?.invoke(dispatchedMessages.recycle(channel, flags, msgType, data, length))
+        }
+        callbacks.controlRecordCallback = { channel, flags, msgType, data, length ->
+            onControlMessage?.invoke(dispatchedMessages.recycle(channel, flags, msgType, data, length))
+        }
+        callbacks.backgroundRecordCallback = { channel, flags, msgType, data, length ->
+            onControlMessage?.invoke(dispatchedMessages.recycle(channel, flags, msgType, data, length))
+        }
+        callbacks.controlBatchCallback = { count ->
+            deliverControlBatch(count)
+        }
+        callbacks.audioMediaCallback = { channel ->
+            onAudioMediaConsumed?.invoke(channel)
+        }
+        callbacks.videoMediaCallback = { channel ->
+            onVideoMediaConsumed?.invoke(channel)
+        }
+        callbacks.mediaAckCallback = { channel, count ->
+            onMediaAck?.invoke(channel, count)
+        }
+        callbacks.micRecordCallback = { data, length ->
+            onMicRecord?.invoke(data, length)
+        }
+        callbacks.sensorBatchCallback = { data, length ->
+            onSensorBatch?.invoke(data, length)
+        }
+        callbacks.inputRecordCallback = { data, length ->
+            onInputRecord?.invoke(data, length)
+        }
+        callbacks.videoKeyframeCallback = { channel ->
+            onVideoKeyframeNeeded?.invoke(channel)
+        }
+
+        callbacks.errorCallback = { errorCode, message ->
             AppLog.e { "USB error $errorCode: $message" }
             if (errorCode == -4) { // LIBUSB_ERROR_NO_DEVICE
                 onDisconnect?.invoke()
@@ -168,7 +427,8 @@ class NativeUsbAccessoryConnection(
      * CRITICAL: Decryption and dispatch happen OUTSIDE the synchronized block
      * to prevent blocking USB data delivery. Only FIFO buffer operations are locked.
      */
-    private fun handleRawData(data: ByteArray, length: Int) {
+    private fun handleRawData(data: ByteBuffer) {
+        val length = data.remaining()
         val currentSsl = ssl
         if (currentSsl == null) {
             AppLog.e { "SSL not set, cannot process data" }
@@ -177,6 +437,7 @@ class NativeUsbAccessoryConnection(
 
         // Collect encrypted payloads inside the lock, decrypt outside
         val pendingMessages = mutableListOf<PendingMessage>()
+        val parseStart = if (shadowFraming) System.nanoTime() else 0L
 
         synchronized(fifo) {
             // Add new data to FIFO buffer
@@ -192,7 +453,7 @@ class NativeUsbAccessoryConnection(
                     return
                 }
             } else {
-                fifo.put(data, 0, length)
+                fifo.put(data)
                 fifo.flip()
             }
 
@@ -254,48 +515,335 @@ class NativeUsbAccessoryConnection(
             fifo.compact()
         }
 
+        val parseNs = if (shadowFraming) System.nanoTime() - parseStart else 0L
+
         // OUTSIDE THE LOCK: Decrypt and dispatch all messages
         // TLS decryption must still be sequential, but we're not blocking FIFO access
-        // Use a local header to avoid conflicts with concurrent USB callbacks
-        val decryptHeader = AapMessageIncoming.EncryptedHeader()
-        for (pending in pendingMessages) {
-            try {
-                // Set up header for decrypt (using local copy to avoid race with synchronized block)
-                decryptHeader.chan = pending.channel
-                decryptHeader.flags = pending.flags
-                decryptHeader.enc_len = pending.encLen
-
-                val msg = AapMessageIncoming.decrypt(decryptHeader, 0, pending.encryptedData, currentSsl)
-                if (msg != null) {
-                    // Dispatch based on channel type
-                    // Video and Audio bypass dispatcher for lowest latency
-                    when {
-                        isVideoChannel(pending.channel) -> {
-                            onVideoMessage?.invoke(msg)
-                        }
-                        isAudioChannel(pending.channel) -> {
-                            // Direct callback for audio - no queue overhead
-                            onAudioMessage?.invoke(msg)
-                        }
-                        else -> dispatcher.dispatch(MessageDispatcher.Type.CONTROL, pending.channel, msg)
+        if (!shadowFraming) {
+            for (pending in pendingMessages) {
+                decryptAndDispatch(currentSsl, pending.channel, pending.flags, pending.encryptedData, pending.encLen)
+            }
+            return
+        }
+
+        val fields = NativeUsb.SHADOW_RECORD_FIELDS
+        if (shadowRecords.size < pendingMessages.size * fields) {
+            shadowRecords = IntArray(pendingMessages.size * fields * 2)
+        }
+        val records = shadowRecords
+        shadowDecryptNs = 0L
+        pendingMessages.forEachIndexed { i, pending ->
+            val decrypted = decryptAndDispatch(currentSsl, pending.channel, pending.flags, pending.encryptedData, pending.encLen)
+            records[i * fields] = pending.channel
+            records[i * fields + 1] = pending.flags
+            records[i * fields + 2] = pending.encLen
+            records[i * fields + 3] = if (decrypted) 1 else 0
+        }
+        NativeUsb.reportShadowRecords(nativeHandle, records, pendingMessages.size, parseNs, shadowDecryptNs)
+    }
+
+    /**
+     * Handle a raw transfer delivered as a native slot (zero-copy mode).
+     * The slot is resubmitted to USB as soon as its bytes are in the FIFO.
+     */
+    private fun handleSlotData(slot: Int, offset: Int, length: Int) {
+        val view = slotBuffers?.getOrNull(slot)
+        try {
+            if (view == null) {
+                AppLog.e { "Unknown transfer slot $slot" }
+                return
+            }
+            view.clear()
+            view.limit(offset + length)
+            view.position(offset)
+            handleRawData(view)
+        } finally {
+            NativeUsb.releaseSlot(nativeHandle, slot)
+        }
+    }
+
+    /**
+     * Handle one complete record framed by the native layer.
+     * Called on the USB event thread; data is reused after return.
+     */
+    private fun handleRecord(channel: Int, flags: Int, data: ByteArray, length: Int) {
+        val currentSsl = ssl
+        if (currentSsl == null) {
+            AppLog.e { "SSL not set, cannot process data" }
+            return
+        }
+        decryptAndDispatch(currentSsl, channel, flags, data, length)
+    }
+
+    // Only touched from the USB event thread
+    private val decryptHeader = AapMessageIncoming.EncryptedHeader()
+
+    /**
+     * @return false if the record didn't decrypt
+     */
+    private fun decryptAndDispatch(currentSsl: AapSsl, channel: Int, flags: Int, data: ByteArray, length: Int): Boolean {
+        var decrypted = false
+        try {
+            decryptHeader.chan = channel
+            decryptHeader.flags = flags
+            decryptHeader.enc_len = length
+
+            val decryptStart = if (shadowFraming) System.nanoTime() else 0L
+            val msg = AapMessageIncoming.decrypt(decryptHeader, 0, data, currentSsl)
+            if (shadowFraming) {
+                shadowDecryptNs += System.nanoTime() - decryptStart
+            }
+            decrypted = msg != null
+            if (msg != null) {
+                // Dispatch based on channel type
+                // Video and Audio bypass dispatcher for lowest latency
+                when {
+                    Channel.isVideo(channel) -> {
+                        onVideoMessage?.invoke(msg)
                     }
-                } else {
-                    AppLog.e { "Decrypt failed: chan=${pending.channel} ${Channel.name(pending.channel)} flags=${pending.flags.toString(16)} enc_len=${pending.encLen}" }
+                    Channel.isAudio(channel) -> {
+                        // Direct callback for audio - no queue overhead
+                        onAudioMessage?.invoke(msg)
+                    }
+                    else -> dispatcher.dispatch(MessageDispatcher.Type.CONTROL, channel, msg)
                 }
-            } catch (e: Exception) {
-                AppLog.e(e) { "Error decrypting message on channel ${pending.channel}" }
+            } else {
+                AppLog.e { "Decrypt failed: chan=$channel ${Channel.name(channel)} flags=${flags.toString(16)} enc_len=$length" }
             }
+        } catch (e: Exception) {
+            AppLog.e(e) { "Error decrypting message on channel $channel" }
         }
+        return decrypted
     }
 
-    private fun isAudioChannel(channel: Int): Boolean {
-        // Audio channels: 4 (media audio output), 5 (speech audio), 6 (system audio)
-        return channel in 4..6
+    /**
+     * Decrypt a record for the native dispatcher (USB event thread, record order).
+     * @return Plaintext length in plaintextBuffer, or -1 to drop the record
+     */
+    private fun decryptRecord(channel: Int, flags: Int, data: ByteArray, length: Int): Int {
+        val currentSsl = ssl
+        val out = plaintextBuffer
+        if (currentSsl == null || out == null) {
+            AppLog.e { "SSL not set, cannot process data" }
+            return -1
+        }
+        if (flags and 0x08 != 0x08) {
+            AppLog.e { "WRONG FLAG: enc_len: $length chan: $channel ${Channel.name(channel)} flags: 0x${flags.toString(16)}" }
+            return -1
+        }
+        return try {
+            currentSsl.decrypt(0, length, data, out)
+        } catch (e: Exception) {
+            AppLog.e(e) { "Error decrypting message on channel $channel" }
+            -1
+        }
     }
 
-    private fun isVideoChannel(channel: Int): Boolean {
-        // Video channel: 2
-        return channel == 2
+    /**
+     * Split a native control batch into messages (AAP-Control thread).
+     * Payloads are copied out: the buffer is refilled once this returns.
+     */
+    private fun deliverControlBatch(count: Int) {
+        val batch = controlBatchBuffer ?: return
+        for (i in 0 until count) {
+            val descriptor = i * NativeUsb.CONTROL_BATCH_DESCRIPTOR_SIZE
+            val channel = batch.getInt(descriptor)
+            val flags = batch.getInt(descriptor + 4)
+            val offset = batch.getInt(descriptor + 8)
+            val length = batch.getInt(descriptor + 12)
+            if (controlPayload.size < length) {
+                controlPayload = ByteArray(maxOf(length, PLAINTEXT_BUFFER_SIZE))
+            }
+            val data = controlPayload
+            batch.position(offset)
+            batch.get(data, 0, length)
+            val msgType = AapMessageIncoming.msgType(data, length)
+            onControlMessage?.invoke(controlBatchMessage.recycle(channel, flags, msgType, data, length))
+        }
+    }
+
+    /**
+     * Drain the shared control ring until the connection closes (controlRingThread).
+     */
+    private fun controlRingLoop(handle: Long, ring: ByteBuffer) {
+        val mask = ring.capacity() - 1L
+        var position = 0L
+        while (controlRingRunning) {
+            val head = NativeUsb.awaitControlRing(handle, position, CONTROL_RING_WAIT_MS)
+            if (head < 0) {
+                break
+            }
+            while (position < head) {
+                val offset = (position and mask).toInt()
+                val length = ring.getInt(offset)
+                if (length == NativeUsb.CONTROL_RING_PADDING) {
+                    position += ring.capacity() - offset
+                    continue
+                }
+                val channel = ring.get(offset + 4).toInt() and 0xFF
+                val flags = ring.get(offset + 5).toInt() and 0xFF
+                if (controlRingPayload.size < length) {
+                    controlRingPayload = ByteArray(maxOf(length, PLAINTEXT_BUFFER_SIZE))
+                }
+                val data = controlRingPayload
+                ring.position(offset + NativeUsb.CONTROL_RING_HEADER_SIZE)
+                ring.get(data, 0, length)
+                val alignment = NativeUsb.CONTROL_RING_ALIGNMENT
+                position += (NativeUsb.CONTROL_RING_HEADER_SIZE + length + alignment - 1) and (alignment - 1).inv()
+                try {
+                    val msgType = AapMessageIncoming.msgType(data, length)
+                    onControlMessage?.invoke(controlRingMessage.recycle(channel, flags, msgType, data, length))
+                } catch (e: Exception) {
+                    AppLog.e(e) { "Error handling control message on channel $channel" }
+                }
+            }
+        }
+    }
+
+    private fun stopControlRing() {
+        controlRingRunning = false
+        try {
+            controlRingThread?.join(1000)
+        } catch (e: InterruptedException) {
+            // Ignore
+        }
+        controlRingThread = null
+    }
+
+    /**
+     * Open the native connection: libusb context, wrapped device, transfer
+     * pools and the event loop fds. Reads aren't submitted until startReading().
+     */
+    private fun openNative(conn: UsbDeviceConnection): Boolean {
+        val fd = conn.fileDescriptor
+        if (fd < 0) {
+            AppLog.e { "Invalid file descriptor: $fd" }
+            return false
+        }
+
+        AppLog.i { "Initializing native USB with fd=$fd" }
+        NativeUsb.setStreamingMemoryOptions(useLockedBuffers, useLockedBuffers, useLockedBuffers)
+        memoryProfile.applyNative()
+        NativeUsb.setTracingEnabled(useTracing)
+        NativeUsb.setFastLogging(if (useFastLog) Log.DEBUG else Log.ASSERT + 1)
+        val spareBuffers = if (useResubmitFirst && !useZeroCopy) NativeUsb.DEFAULT_SPARE_BUFFERS else 0
+        val handle = NativeUsb.open(fd, numTransfers, transferSize, spareBuffers = spareBuffers)
+        if (handle == 0L) {
+            AppLog.e { "Failed to open native USB" }
+            return false
+        }
+        nativeHandle = handle
+        NativeUsb.setCallbacks(handle, callbacks)
+        useNativeForIO = true
+        if (capturePath != null && !NativeUsb.startCapture(handle, capturePath)) {
+            AppLog.e { "Failed to start capture to $capturePath" }
+        }
+        return true
+    }
+
+    /**
+     * Set up the native stages that don't need the session keys: framing,
+     * dispatcher threads and queues, video, audio, sensor and touch stages.
+     * Nothing flows through them before startReading(), so with usePrewarm
+     * this runs on AAP-Prewarm while the handshake is still going.
+     */
+    private fun configureStages(handle: Long) {
+        NativeUsb.setFramingEnabled(handle, useNativeFraming)
+        if (!useNativeFraming && useShadowFraming) {
+            shadowFraming = NativeUsb.setShadowFramingEnabled(handle)
+        }
+        if (!useNativeFraming && useZeroCopy) {
+            slotBuffers = NativeUsb.getSlotBuffers(handle)
+            NativeUsb.setZeroCopyEnabled(handle, slotBuffers != null)
+        }
+        if (useNativeFraming && useNativeDispatcher) {
+            val out = ByteBuffer.allocateDirect(PLAINTEXT_BUFFER_SIZE)
+            // The worker pool delivers control records one by one
+            val batched = useBatchedControl && (dispatchQueues?.poolWorkers ?: 0) == 0
+            val batchLatencyUs = if (batched) CONTROL_BATCH_LATENCY_US else -1
+            nativeDispatch = NativeUsb.setDispatchEnabled(handle, out, batchLatencyUs, dispatchQueues)
+            plaintextBuffer = if (nativeDispatch) out else null
+            if (nativeDispatch && batched) {
+                controlBatchBuffer = NativeUsb.getControlBatchBuffer(handle)
+                    ?.order(ByteOrder.nativeOrder())
+            }
+        }
+        if (nativeDispatch && useSharedControlRing) {
+            controlRing = NativeUsb.setControlRingEnabled(handle)?.order(ByteOrder.nativeOrder())
+        }
+        if (nativeDispatch && useNativeVideo && NativeUsb.setVideoStageEnabled(handle)) {
+            videoFrameSource = NativeVideoFrameSource(handle)
+            videoDecoder = NativeVideoDecoder(handle, lowLatency = useLowLatencyVideo,
+                avSync = useAvSync && useNativeAudio)
+        }
+        if (nativeDispatch && useNativeAudio) {
+            nativeAudio = NativeUsb.setAudioOutputEnabled(handle, mixed = useAudioMixer)
+        }
+        // Only records consumed by a native media stage are ACKed natively
+        if (useMediaAckBatching) {
+            if (videoFrameSource != null || nativeAudio) {
+                NativeUsb.setMediaAckBatching(handle, flowControl = useAckFlowControl)
+            } else {
+                AppLog.w { "Media ACK batching needs the native video or audio stage, ACKs stay per record" }
+            }
+        }
+        if (useSensorBatching) {
+            sensorBatching = NativeUsb.setSensorBatching(handle)
+        }
+        if (useTouchFastPath) {
+            touchFastPath = NativeUsb.setTouchInputEnabled(handle)
+        }
+    }
+
+    /**
+     * Hand the read keys from the finished handshake to the native layer.
+     */
+    private fun configureDecrypt(handle: Long) {
+        var nativeDecrypt = false
+        if (nativeDispatch || shadowFraming) {
+            val keys = ssl?.exportReadKeys()
+            if (keys != null) {
+                nativeDecrypt = NativeUsb.setReadKey(handle, keys.key, keys.salt, keys.sequence) && nativeDispatch
+            }
+        }
+        if (nativeDecrypt && useParallelDecrypt) {
+            NativeUsb.setParallelDecryptEnabled(handle, decryptWorkers)
+        }
+        if (nativeDispatch && useQualityGovernor) {
+            NativeUsb.setQualityGovernorEnabled(handle)
+        }
+        if (stallSnapshotPath != null && !NativeUsb.setStallWatchdogEnabled(handle, stallSnapshotPath)) {
+            AppLog.e { "Failed to start the stall watchdog on $stallSnapshotPath" }
+        }
+        if (statsPath != null && !NativeUsb.setStatsExportEnabled(handle, statsPath)) {
+            AppLog.e { "Failed to export stats to $statsPath" }
+        }
+        AppLog.i { "Native USB initialized, handle=$handle, nativeFraming=$useNativeFraming, zeroCopy=${slotBuffers != null}, nativeDispatch=$nativeDispatch, nativeDecrypt=$nativeDecrypt, shadowFraming=$shadowFraming, nativeVideo=${videoFrameSource != null}, nativeAudio=$nativeAudio" }
+    }
+
+    /**
+     * Open the native connection right after connect, so the handshake runs
+     * on the native read path and the stages are configured in parallel.
+     * Falls back to the Android API for the handshake if it can't be opened.
+     */
+    private fun prewarm(conn: UsbDeviceConnection) {
+        if (!openNative(conn)) {
+            return
+        }
+        val handle = nativeHandle
+        prewarmThread = Thread({
+            configureStages(handle)
+        }, "AAP-Prewarm").also { it.start() }
+    }
+
+    private fun awaitPrewarm() {
+        val thread = prewarmThread ?: return
+        prewarmThread = null
+        try {
+            thread.join()
+        } catch (e: InterruptedException) {
+            Thread.currentThread().interrupt()
+        }
     }
 
     /**
@@ -303,12 +851,12 @@ class NativeUsbAccessoryConnection(
      * Call this after connection is established and SSL is set up.
      * This switches from Android API to native libusb for I/O.
      */
-    fun startReading() {
+    override fun startReading(): Boolean {
         synchronized(this) {
             val conn = usbDeviceConnection
             if (conn == null) {
                 AppLog.e { "Cannot start reading: not connected" }
-                return
+                return false
             }
 
             // Clear the FIFO buffer for a clean start
@@ -316,37 +864,92 @@ class NativeUsbAccessoryConnection(
                 fifo.clear()
             }
 
-            // Initialize native USB if not already done
+            // Initialize native USB unless it was pre-warmed during the handshake
             if (nativeHandle == 0L) {
-                val fd = conn.fileDescriptor
-                if (fd < 0) {
-                    AppLog.e { "Invalid file descriptor: $fd" }
-                    return
+                if (!openNative(conn)) {
+                    return false
                 }
+                configureStages(nativeHandle)
+            }
+            awaitPrewarm()
+            configureDecrypt(nativeHandle)
 
-                AppLog.i { "Initializing native USB with fd=$fd" }
-                val handle = NativeUsb.open(fd)
-                if (handle == 0L) {
-                    AppLog.e { "Failed to open native USB" }
-                    return
-                }
-                nativeHandle = handle
-                useNativeForIO = true
-                AppLog.i { "Native USB initialized, handle=$handle" }
+            // Start message dispatcher threads (native dispatcher has its own)
+            if (!nativeDispatch) {
+                dispatcher.start()
             }
 
-            // Start message dispatcher threads
-            dispatcher.start()
+            val ring = controlRing
+            if (ring != null) {
+                val handle = nativeHandle
+                controlRingRunning = true
+                controlRingThread = Thread({
+                    controlRingLoop(handle, ring)
+                }, "AAP-ControlRing").also { it.start() }
+            }
 
             NativeUsb.startReading(nativeHandle)
             AppLog.i { "Native USB reading started" }
+            return true
+        }
+    }
+
+    /**
+     * Queue a sensor update for the next batched record.
+     * @return false if sensor batching is off or can't take it; send the message directly
+     */
+    fun submitSensor(sensorType: Int, message: AapMessage): Boolean {
+        synchronized(this) {
+            return nativeHandle != 0L && sensorBatching &&
+                NativeUsb.submitSensor(nativeHandle, sensorType, message.data,
+                    message.dataOffset, message.size - message.dataOffset)
+        }
+    }
+
+    /**
+     * Queue a touch sample for the native fast path. Lock-free, so not
+     * synchronized like the rest: call from the UI thread only.
+     * @return false if the fast path is off or full; send a TouchEvent instead
+     */
+    fun submitTouch(timestampNs: Long, action: Int, actionIndex: Int, pointerCount: Int, pointers: IntArray): Boolean {
+        val handle = nativeHandle
+        return handle != 0L && touchFastPath &&
+            NativeUsb.submitTouch(handle, timestampNs, action, actionIndex, pointerCount, pointers)
+    }
+
+    /**
+     * Capture the microphone natively, records go to onMicRecord.
+     * @return false if unavailable, MicRecorder has to be used instead
+     */
+    fun startMic(sampleRate: Int): Boolean {
+        synchronized(this) {
+            return nativeHandle != 0L && NativeUsb.startMic(nativeHandle, sampleRate)
+        }
+    }
+
+    fun stopMic() {
+        synchronized(this) {
+            if (nativeHandle != 0L) {
+                NativeUsb.stopMic(nativeHandle)
+            }
+        }
+    }
+
+    /**
+     * Stop and flush native playback of an audio channel, no-op unless nativeAudio.
+     */
+    fun stopAudioOutput(channel: Int) {
+        synchronized(this) {
+            if (nativeHandle != 0L && nativeAudio) {
+                NativeUsb.stopAudioOutput(nativeHandle, channel)
+            }
         }
     }
 
     /**
      * Stop reading from USB.
      */
-    fun stopReading() {
+    override fun stopReading() {
         synchronized(this) {
             if (nativeHandle != 0L) {
                 NativeUsb.stopReading(nativeHandle)
@@ -357,18 +960,29 @@ class NativeUsbAccessoryConnection(
     }
 
     override fun disconnect() {
+        // The ring thread may be writing a reply, which takes the lock
+        stopControlRing()
         synchronized(this) {
+            awaitPrewarm()
             // Stop native USB if active
             if (nativeHandle != 0L) {
                 AppLog.i { "Disconnecting native USB" }
                 NativeUsb.stopReading(nativeHandle)
                 NativeUsb.close(nativeHandle)
                 nativeHandle = 0
+                nativeEncrypt = false
+                nativeKeepalive = false
             }
-
-            // Clear callbacks
-            NativeUsb.rawDataCallback = null
-            NativeUsb.errorCallback = null
+            slotBuffers = null
+            videoFrameSource = null
+            videoDecoder = null
+            nativeAudio = false
+            sensorBatching = false
+            touchFastPath = false
+            plaintextBuffer = null
+            controlBatchBuffer = null
+            controlRing = null
+            nativeDispatch = false
 
             // Release Android USB resources
             val conn = usbDeviceConnection
@@ -391,6 +1005,48 @@ class NativeUsbAccessoryConnection(
      * Write data to USB.
      * Uses Android API during handshake, native USB after startReading().
      */
+    override fun enableNativeEncrypt(): Boolean {
+        synchronized(this) {
+            if (nativeHandle == 0L || !useNativeForIO) return false
+            val keys = ssl?.exportWriteKeys() ?: return false
+            nativeEncrypt = NativeUsb.setWriteKey(nativeHandle, keys.key, keys.salt, keys.sequence)
+            AppLog.i { "Native encryption: $nativeEncrypt" }
+            return nativeEncrypt
+        }
+    }
+
+    override fun sendRecord(data: ByteArray, length: Int): Int {
+        synchronized(this) {
+            if (nativeHandle == 0L || !nativeEncrypt) return -1
+            return NativeUsb.sendRecord(nativeHandle, data, length)
+        }
+    }
+
+    override fun enableNativeKeepalive(): Boolean {
+        synchronized(this) {
+            if (nativeHandle == 0L || !nativeEncrypt || !useNativeKeepalive) return false
+            nativeKeepalive = NativeUsb.setNativeKeepalive(nativeHandle)
+            AppLog.i { "Native keepalive: $nativeKeepalive" }
+            return nativeKeepalive
+        }
+    }
+
+    override fun setMediaSessionId(channel: Int, sessionId: Int) {
+        synchronized(this) {
+            if (nativeHandle != 0L && nativeKeepalive) {
+                NativeUsb.setMediaSessionId(nativeHandle, channel, sessionId)
+            }
+        }
+    }
+
+    override fun setIdle(idle: Boolean) {
+        synchronized(this) {
+            if (nativeHandle != 0L) {
+                NativeUsb.setIdle(nativeHandle, idle)
+            }
+        }
+    }
+
     override fun write(buf: ByteArray, offset: Int, length: Int, timeout: Int): Int {
         synchronized(this) {
             val conn = usbDeviceConnection
@@ -400,13 +1056,8 @@ class NativeUsbAccessoryConnection(
             }
 
             return if (useNativeForIO && nativeHandle != 0L) {
-                // Use native USB for streaming
-                if (offset == 0) {
-                    NativeUsb.write(nativeHandle, buf, length)
-                } else {
-                    val data = buf.copyOfRange(offset, offset + length)
-                    NativeUsb.write(nativeHandle, data, length)
-                }
+                // Use native USB for streaming, the offset is applied natively
+                NativeUsb.write(nativeHandle, buf, offset, length)
             } else {
                 // Use Android API for handshake
                 try {
@@ -433,16 +1084,7 @@ class NativeUsbAccessoryConnection(
 
             return if (useNativeForIO && nativeHandle != 0L) {
                 // Use native USB
-                if (offset == 0) {
-                    NativeUsb.read(nativeHandle, buf, length, timeout)
-                } else {
-                    val temp = ByteArray(length)
-                    val result = NativeUsb.read(nativeHandle, temp, length, timeout)
-                    if (result > 0) {
-                        System.arraycopy(temp, 0, buf, offset, result)
-                    }
-                    result
-                }
+                NativeUsb.read(nativeHandle, buf, offset, length, timeout)
             } else {
                 // Use Android API for handshake
                 try {
@@ -456,4 +1098,13 @@ class NativeUsbAccessoryConnection(
     }
 
     private class UsbOpenException(message: String) : Exception(message)
+
+    private companion object {
+        // Largest plaintext of a single AAP record
+        const val PLAINTEXT_BUFFER_SIZE = 65536
+        // Longest a control record waits for the rest of its batch
+        const val CONTROL_BATCH_LATENCY_US = 2000
+        // Control ring thread re-checks for disconnect at least this often
+        const val CONTROL_RING_WAIT_MS = 100
+    }
 }
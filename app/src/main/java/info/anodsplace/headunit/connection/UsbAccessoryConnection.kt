@@ -35,7 +35,7 @@ import java.nio.ByteBuffer
 class UsbAccessoryConnection(
     private val usbMgr: UsbManager,
     private val device: UsbDevice
-) : AccessoryConnection {
+) : MessageStreamConnection {
 
     private var usbDeviceConnection: UsbDeviceConnection? = null
     private var usbInterface: UsbInterface? = null
@@ -50,14 +50,14 @@ class UsbAccessoryConnection(
     private val dispatcher = MessageDispatcher()
 
     // Message handler callbacks (set by AapTransport)
-    var onAudioMessage: ((AapMessage) -> Unit)? = null
-    var onVideoMessage: ((AapMessage) -> Unit)? = null
-    var onControlMessage: ((AapMessage) -> Unit)? = null
+    override var onAudioMessage: ((AapMessage) -> Unit)? = null
+    override var onVideoMessage: ((AapMessage) -> Unit)? = null
+    override var onControlMessage: ((AapMessage) -> Unit)? = null
         set(value) {
             field = value
             dispatcher.setCallback(MessageDispatcher.Type.CONTROL, value)
         }
-    var onDisconnect: (() -> Unit)? = null
+    override var onDisconnect: (() -> Unit)? = null
 
     // SSL for decryption (set by AapTransport after handshake)
     internal var ssl: AapSsl? = null
@@ -152,12 +152,12 @@ class UsbAccessoryConnection(
      * Start polling USB for data.
      * Call this after handshake is complete and SSL is set up.
      */
-    fun startReading() {
+    override fun startReading(): Boolean {
         synchronized(this) {
-            if (running) return
+            if (running) return true
             if (usbDeviceConnection == null) {
                 AppLog.e { "Cannot start reading: not connected" }
-                return
+                return false
             }
 
             // Clear FIFO for clean start
@@ -175,6 +175,7 @@ class UsbAccessoryConnection(
                 pollLoop()
                 AppLog.i { "USB poll thread stopped" }
             }, "AAP-USB-Poll").also { it.start() }
+            return true
         }
     }
 
@@ -334,8 +335,8 @@ class UsbAccessoryConnection(
                 val msg = AapMessageIncoming.decrypt(decryptHeader, 0, pending.encryptedData, currentSsl)
                 if (msg != null) {
                     when {
-                        isVideoChannel(pending.channel) -> onVideoMessage?.invoke(msg)
-                        isAudioChannel(pending.channel) -> onAudioMessage?.invoke(msg)
+                        Channel.isVideo(pending.channel) -> onVideoMessage?.invoke(msg)
+                        Channel.isAudio(pending.channel) -> onAudioMessage?.invoke(msg)
                         else -> dispatcher.dispatch(MessageDispatcher.Type.CONTROL, pending.channel, msg)
                     }
                 } else {
@@ -347,10 +348,7 @@ class UsbAccessoryConnection(
         }
     }
 
-    private fun isAudioChannel(channel: Int) = channel in 4..6
-    private fun isVideoChannel(channel: Int) = channel == 2
-
-    fun stopReading() {
+    override fun stopReading() {
         running = false
         pollThread?.interrupt()
         try {
@@ -0,0 +1,305 @@
+package info.anodsplace.headunit.decoder
+
+import android.media.Image
+import android.media.MediaCodec
+import android.media.MediaCodecInfo
+import android.media.MediaCodecList
+import android.media.MediaFormat
+import android.os.Build
+import android.os.SystemClock
+import info.anodsplace.headunit.aap.protocol.Screen
+import info.anodsplace.headunit.aap.protocol.proto.Control
+import info.anodsplace.headunit.utils.AppLog
+import java.nio.ByteBuffer
+import kotlin.random.Random
+
+/**
+ * What the H.264 decoders of this device can keep up with, for DeviceCalibration.
+ *
+ * Each resolution is timed on a real decode: the device's H.264 encoder
+ * makes a short synthetic clip at that size, one keyframe and P frames
+ * like a projection stream, and each decoder decodes it as fast as it
+ * can. A size the encoder can't make falls back to the frame rates the
+ * vendor measured (API 23+) or the advertised size and rate limits.
+ * Hardware decoders are preferred, software ones only count when there
+ * is no hardware decoder at all.
+ */
+object DecoderProbe {
+
+    // One access unit per frame, the codec config (SPS and PPS) apart
+    private class Clip(val width: Int, val height: Int, val config: ByteArray, val frames: List<ByteArray>) {
+        val maxFrameSize = frames.maxOf { it.size }
+    }
+
+    /**
+     * The largest resolution a decoder sustains at fps, or null if there is no H.264 decoder.
+     * Takes a few seconds, not on the main thread.
+     */
+    fun maxResolution(fps: Int = FPS): Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType? {
+        val codecs = try {
+            MediaCodecList(MediaCodecList.REGULAR_CODECS).codecInfos.filter { info ->
+                info.supportedTypes.any { it.equals(MediaFormat.MIMETYPE_VIDEO_AVC, ignoreCase = true) }
+            }
+        } catch (e: RuntimeException) {
+            AppLog.e(e)
+            return null
+        }
+        val decoders = codecs.filterNot { it.isEncoder }
+        val hardware = decoders.filterNot { isSoftwareOnly(it) }
+        val candidates = hardware.ifEmpty { decoders }
+        val encoders = codecs.filter { it.isEncoder }.sortedBy { isSoftwareOnly(it) }
+
+        val largest = Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType.VIDEO_3840x2160
+        for (steps in 0..Screen.stepsBelow(largest)) {
+            val resolution = Screen.stepDown(largest, steps)
+            val screen = Screen.forResolution(resolution)
+            val sized = candidates.filter { isSizeSupported(it, screen.width, screen.height) }
+            if (sized.isEmpty()) {
+                continue
+            }
+            val clip = encoders.firstNotNullOfOrNull { encodeClip(it, screen.width, screen.height, fps) }
+            val decoder = sized.firstOrNull { info ->
+                if (clip == null) {
+                    return@firstOrNull sustains(info, screen.width, screen.height, fps)
+                }
+                val decoded = decodeRate(info, clip)
+                AppLog.i { "Decoder probe: ${info.name} decodes $resolution at ${decoded?.let { "%.1f".format(it) }} fps" }
+                decoded != null && decoded >= fps * HEADROOM
+            }
+            if (decoder != null) {
+                AppLog.i { "Decoder probe: ${decoder.name} sustains $resolution at $fps fps${if (clip == null) " (advertised)" else ""}" }
+                return resolution
+            }
+        }
+        return null
+    }
+
+    /**
+     * Encode CLIP_FRAMES synthetic frames, null if this encoder can't.
+     */
+    private fun encodeClip(info: MediaCodecInfo, width: Int, height: Int, fps: Int): Clip? {
+        if (!isSizeSupported(info, width, height)) {
+            return null
+        }
+        val format = MediaFormat.createVideoFormat(MediaFormat.MIMETYPE_VIDEO_AVC, width, height).apply {
+            setInteger(MediaFormat.KEY_COLOR_FORMAT, MediaCodecInfo.CodecCapabilities.COLOR_FormatYUV420Flexible)
+            setInteger(MediaFormat.KEY_BIT_RATE, width * height * fps / BITS_PER_PIXEL_DIVISOR)
+            setInteger(MediaFormat.KEY_FRAME_RATE, fps)
+            // Longer than the clip, so only its first frame is a keyframe
+            setInteger(MediaFormat.KEY_I_FRAME_INTERVAL, CLIP_FRAMES / fps + 1)
+        }
+        val codec = try {
+            MediaCodec.createByCodecName(info.name)
+        } catch (e: Exception) {
+            return null
+        }
+        try {
+            codec.configure(format, null, null, MediaCodec.CONFIGURE_FLAG_ENCODE)
+            codec.start()
+
+            val pattern = Random(width).nextBytes(width + PATTERN_PERIOD)
+            val bufferInfo = MediaCodec.BufferInfo()
+            val frames = ArrayList<ByteArray>(CLIP_FRAMES)
+            var config: ByteArray? = null
+            var queued = 0
+            val deadline = SystemClock.elapsedRealtime() + CODEC_TIMEOUT_MS
+            while (SystemClock.elapsedRealtime() < deadline) {
+                if (queued <= CLIP_FRAMES) {
+                    val index = codec.dequeueInputBuffer(DEQUEUE_TIMEOUT_US)
+                    if (index >= 0) {
+                        val presentationUs = queued * 1_000_000L / fps
+                        if (queued == CLIP_FRAMES) {
+                            codec.queueInputBuffer(index, 0, 0, presentationUs, MediaCodec.BUFFER_FLAG_END_OF_STREAM)
+                        } else {
+                            val image = codec.getInputImage(index) ?: return null
+                            fillFrame(image, pattern, queued)
+                            codec.queueInputBuffer(index, 0, width * height * 3 / 2, presentationUs, 0)
+                        }
+                        queued++
+                    }
+                }
+                val index = codec.dequeueOutputBuffer(bufferInfo, DEQUEUE_TIMEOUT_US)
+                if (index < 0) {
+                    continue
+                }
+                val buffer = codec.getOutputBuffer(index)
+                if (buffer != null && bufferInfo.size > 0) {
+                    val bytes = ByteArray(bufferInfo.size)
+                    buffer.position(bufferInfo.offset)
+                    buffer.get(bytes)
+                    if (bufferInfo.flags and MediaCodec.BUFFER_FLAG_CODEC_CONFIG != 0) {
+                        config = bytes
+                    } else {
+                        frames.add(bytes)
+                    }
+                }
+                codec.releaseOutputBuffer(index, false)
+                if (bufferInfo.flags and MediaCodec.BUFFER_FLAG_END_OF_STREAM != 0) {
+                    break
+                }
+            }
+            return if (config != null && frames.size >= MIN_CLIP_FRAMES) Clip(width, height, config, frames) else null
+        } catch (e: Exception) {
+            AppLog.e { "Decoder probe: ${info.name} can't encode ${width}x$height: ${e.message}" }
+            return null
+        } finally {
+            codec.release()
+        }
+    }
+
+    /**
+     * A noise pattern scrolling a few pixels a frame, grey chroma. Noise keeps
+     * the encoder at its bitrate, as camera-like projection content would.
+     */
+    private fun fillFrame(image: Image, pattern: ByteArray, frame: Int) {
+        val luma = image.planes[0]
+        val lumaBuffer = luma.buffer
+        for (y in 0 until image.height) {
+            lumaBuffer.position(y * luma.rowStride)
+            lumaBuffer.put(pattern, (y * ROW_SHIFT + frame * FRAME_SHIFT) % PATTERN_PERIOD, image.width)
+        }
+        for (plane in 1..2) {
+            val chroma = image.planes[plane]
+            val chromaBuffer = chroma.buffer
+            val grey = ByteArray((image.width / 2 - 1) * chroma.pixelStride + 1) { 128.toByte() }
+            for (y in 0 until image.height / 2) {
+                val position = y * chroma.rowStride
+                chromaBuffer.position(position)
+                chromaBuffer.put(grey, 0, minOf(grey.size, chromaBuffer.capacity() - position))
+            }
+        }
+    }
+
+    /**
+     * Frames per second this decoder gets through the clip, first to last
+     * decoded frame, or null if it can't decode it.
+     */
+    private fun decodeRate(info: MediaCodecInfo, clip: Clip): Double? {
+        val codec = try {
+            MediaCodec.createByCodecName(info.name)
+        } catch (e: Exception) {
+            return null
+        }
+        try {
+            val format = MediaFormat.createVideoFormat(MediaFormat.MIMETYPE_VIDEO_AVC, clip.width, clip.height)
+            format.setInteger(MediaFormat.KEY_MAX_INPUT_SIZE, maxOf(clip.maxFrameSize, clip.config.size))
+            if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.M) {
+                // As VideoDecodeThread configures it
+                format.setInteger(MediaFormat.KEY_PRIORITY, 0)
+                format.setInteger(MediaFormat.KEY_OPERATING_RATE, Short.MAX_VALUE.toInt())
+            }
+            codec.configure(format, null, null, 0)
+            codec.start()
+
+            val bufferInfo = MediaCodec.BufferInfo()
+            // The codec config goes first, then every frame and the end of stream
+            var queued = -1
+            var decoded = 0
+            var firstDecodedNs = 0L
+            var lastDecodedNs = 0L
+            val deadline = SystemClock.elapsedRealtime() + CODEC_TIMEOUT_MS
+            while (SystemClock.elapsedRealtime() < deadline) {
+                if (queued <= clip.frames.size) {
+                    val index = codec.dequeueInputBuffer(DEQUEUE_TIMEOUT_US)
+                    if (index >= 0) {
+                        when {
+                            queued < 0 -> queueInput(codec, index, clip.config, 0, MediaCodec.BUFFER_FLAG_CODEC_CONFIG)
+                            queued < clip.frames.size -> queueInput(codec, index, clip.frames[queued], queued * FRAME_US, 0)
+                            else -> codec.queueInputBuffer(index, 0, 0, queued * FRAME_US, MediaCodec.BUFFER_FLAG_END_OF_STREAM)
+                        }
+                        queued++
+                    }
+                }
+                val index = codec.dequeueOutputBuffer(bufferInfo, DEQUEUE_TIMEOUT_US)
+                if (index < 0) {
+                    continue
+                }
+                if (bufferInfo.size > 0) {
+                    lastDecodedNs = System.nanoTime()
+                    if (decoded == 0) {
+                        firstDecodedNs = lastDecodedNs
+                    }
+                    decoded++
+                }
+                codec.releaseOutputBuffer(index, false)
+                if (bufferInfo.flags and MediaCodec.BUFFER_FLAG_END_OF_STREAM != 0) {
+                    break
+                }
+            }
+            if (decoded < MIN_CLIP_FRAMES || lastDecodedNs <= firstDecodedNs) {
+                return null
+            }
+            return (decoded - 1) * 1e9 / (lastDecodedNs - firstDecodedNs)
+        } catch (e: Exception) {
+            AppLog.e { "Decoder probe: ${info.name} can't decode ${clip.width}x${clip.height}: ${e.message}" }
+            return null
+        } finally {
+            codec.release()
+        }
+    }
+
+    private fun queueInput(codec: MediaCodec, index: Int, data: ByteArray, presentationUs: Long, flags: Int) {
+        val buffer: ByteBuffer = codec.getInputBuffer(index) ?: return
+        buffer.clear()
+        buffer.put(data)
+        codec.queueInputBuffer(index, 0, data.size, presentationUs, flags)
+    }
+
+    private fun isSizeSupported(info: MediaCodecInfo, width: Int, height: Int): Boolean {
+        val video = try {
+            info.getCapabilitiesForType(MediaFormat.MIMETYPE_VIDEO_AVC).videoCapabilities
+        } catch (e: IllegalArgumentException) {
+            null
+        } ?: return false
+        return video.isSizeSupported(width, height)
+    }
+
+    // Advertised capabilities, for a size no encoder can make a clip of
+    private fun sustains(info: MediaCodecInfo, width: Int, height: Int, fps: Int): Boolean {
+        val video = try {
+            info.getCapabilitiesForType(MediaFormat.MIMETYPE_VIDEO_AVC).videoCapabilities
+        } catch (e: IllegalArgumentException) {
+            null
+        } ?: return false
+        if (!video.isSizeSupported(width, height)) {
+            return false
+        }
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.M) {
+            // Measured rates, the low end is what the codec reaches under load
+            val measured = try {
+                video.getAchievableFrameRatesFor(width, height)
+            } catch (e: IllegalArgumentException) {
+                null
+            }
+            if (measured != null) {
+                return measured.lower >= fps
+            }
+        }
+        return video.areSizeAndRateSupported(width, height, fps.toDouble())
+    }
+
+    private fun isSoftwareOnly(info: MediaCodecInfo): Boolean {
+        if (Build.VERSION.SDK_INT >= Build.VERSION_CODES.Q) {
+            return info.isSoftwareOnly
+        }
+        val name = info.name.lowercase()
+        return name.startsWith("omx.google.") || name.startsWith("c2.android.")
+    }
+
+    // The only rate ServiceDiscoveryResponse offers
+    private const val FPS = 30
+    // Decoding has to leave room for rendering and the rest of the session
+    private const val HEADROOM = 1.25
+    // Two seconds of video at FPS, a clip that decodes in fewer frames is too short to time
+    private const val CLIP_FRAMES = 60
+    private const val MIN_CLIP_FRAMES = 30
+    private const val FRAME_US = 1_000_000L / FPS
+    // About 0.125 bits per pixel, what a phone streams at
+    private const val BITS_PER_PIXEL_DIVISOR = 8
+    private const val PATTERN_PERIOD = 256
+    private const val ROW_SHIFT = 31
+    private const val FRAME_SHIFT = 4
+    private const val DEQUEUE_TIMEOUT_US = 10_000L
+    // Per clip, encode or decode
+    private const val CODEC_TIMEOUT_MS = 10_000L
+}
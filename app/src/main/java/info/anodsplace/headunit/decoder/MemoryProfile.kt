@@ -0,0 +1,96 @@
+package info.anodsplace.headunit.decoder
+
+import info.anodsplace.headunit.aap.protocol.Screen
+import info.anodsplace.headunit.aap.protocol.messages.Messages
+import info.anodsplace.headunit.connection.NativeUsb
+import info.anodsplace.headunit.utils.Settings
+
+/**
+ * Buffer sizes for the video and read paths: standard, or fitted to the
+ * stream the next session negotiates for head units with little RAM.
+ *
+ * The phone doesn't report a bitrate, so the lean sizes estimate one from
+ * the offered resolution and frame rate, the same way the native
+ * MemoryProfile::leanFor() sizes its pools, so a frame that fits one
+ * reassembly path fits the other.
+ */
+class MemoryProfile private constructor(
+    val lean: Boolean,
+    val width: Int,
+    val height: Int,
+    val fps: Int,
+    val maxFrameSize: Int,
+    val frameQueueCapacity: Int,
+    val readBufferSize: Int
+) {
+
+    /**
+     * Size the native pools created afterwards to this profile.
+     */
+    fun applyNative() {
+        NativeUsb.setMemoryProfile(lean, width, height, fps)
+    }
+
+    override fun toString(): String =
+        if (lean) "lean ${width}x$height@$fps: $frameQueueCapacity frames of ${maxFrameSize / 1024} KB"
+        else "standard"
+
+    companion object {
+        // The only rate ServiceDiscoveryResponse offers
+        private const val FPS = 30
+        // Estimates shared with memory_profile.cpp
+        private const val BITS_PER_PIXEL_X10 = 2
+        private const val KEYFRAME_RATIO = 4
+        private const val KEYFRAME_AVERAGE_FRAMES = 8
+        private const val MIN_FRAME_SIZE = 64 * 1024
+        private const val FRAME_ALIGNMENT = 16 * 1024
+        private const val MIN_FRAME_SLOTS = 4
+        // A few bulk transfers per read; the fifo still holds the largest record
+        private const val LEAN_READ_BUFFER = 16384
+
+        val STANDARD = MemoryProfile(
+            lean = false, width = 0, height = 0, fps = FPS,
+            maxFrameSize = VideoFrameQueue.MAX_FRAME_SIZE,
+            frameQueueCapacity = 30,  // ~500ms at 60fps, absorbs USB jitter
+            readBufferSize = Messages.DEF_BUFFER_LENGTH
+        )
+
+        fun forSettings(settings: Settings): MemoryProfile {
+            if (!settings.memoryLean) {
+                return STANDARD
+            }
+            val screen = Screen.forResolution(VideoCalibration(settings).offeredResolution())
+            return lean(screen.width, screen.height, FPS)
+        }
+
+        fun lean(width: Int, height: Int, fps: Int): MemoryProfile {
+            val rate = fps.coerceAtLeast(1)
+            val bytesPerSecond = width.toLong() * height * rate * BITS_PER_PIXEL_X10 / 10 / 8
+            val picture = width.toLong() * height * 3 / 2
+            val frame = maxOf(picture / KEYFRAME_RATIO, bytesPerSecond / rate * KEYFRAME_AVERAGE_FRAMES)
+            val aligned = (frame + FRAME_ALIGNMENT - 1) / FRAME_ALIGNMENT * FRAME_ALIGNMENT
+            return MemoryProfile(
+                lean = true, width = width, height = height, fps = rate,
+                maxFrameSize = aligned.coerceIn(MIN_FRAME_SIZE.toLong(), VideoFrameQueue.MAX_FRAME_SIZE.toLong()).toInt(),
+                // The ring keeps one slot empty
+                frameQueueCapacity = maxOf(rate / 4, MIN_FRAME_SLOTS) + 1,
+                readBufferSize = LEAN_READ_BUFFER
+            )
+        }
+
+        /**
+         * Memory the pipeline holds: the Kotlin frame queue, and what the
+         * native streaming buffers actually have resident.
+         * @param native The session ran on a native connection
+         */
+        fun report(frameQueue: VideoFrameQueue?, native: Boolean): String {
+            val queueBytes = frameQueue?.allocatedBytes ?: 0L
+            val stats = if (native) NativeUsb.getStreamingMemoryStats() else null
+            if (stats == null || stats.size < 5) {
+                return "Pipeline memory: frame queue ${queueBytes / 1024} KB"
+            }
+            return "Pipeline memory: ${(queueBytes + stats[4]) / 1024} KB resident " +
+                "(frame queue ${queueBytes / 1024} KB, native ${stats[4] / 1024} of ${stats[0] / 1024} KB mapped)"
+        }
+    }
+}
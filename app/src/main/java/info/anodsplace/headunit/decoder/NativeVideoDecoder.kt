@@ -0,0 +1,92 @@
+package info.anodsplace.headunit.decoder
+
+import android.view.Surface
+import info.anodsplace.headunit.connection.NativeUsb
+
+/**
+ * Video decode pipeline running entirely in native code.
+ *
+ * The native video stage assembles frames straight into AMediaCodec
+ * input buffers, replacing VideoFrameQueue and VideoDecodeThread.
+ *
+ * @param handle Native connection handle with the video stage enabled
+ * @param lowLatency Use vendor low latency codec keys and vsync aligned rendering
+ * @param avSync Schedule frames against the native audio output's clock
+ * @param lateFrameBudgetMs Frames further behind the newest one are decoded
+ *        but not shown, see NativeUsb.setVideoLateFrameBudget()
+ */
+class NativeVideoDecoder(
+    private val handle: Long,
+    private val lowLatency: Boolean = false,
+    private val avSync: Boolean = false,
+    private val lateFrameBudgetMs: Int = VideoDecodeThread.DEFAULT_LATE_FRAME_BUDGET_MS
+) {
+
+    /**
+     * Start decoding to a surface, resuming a parked or prepared decoder.
+     * @return true if the native decoder is running
+     */
+    fun start(surface: Surface, width: Int, height: Int): Boolean =
+        NativeUsb.startVideoDecoder(handle, surface, width, height, lowLatency, avSync) &&
+            NativeUsb.setVideoLateFrameBudget(handle, lateFrameBudgetMs)
+
+    /**
+     * Configure the codec before the first surface, see NativeUsb.prepareVideoDecoder().
+     */
+    fun prepare(width: Int, height: Int): Boolean =
+        NativeUsb.prepareVideoDecoder(handle, width, height, lowLatency, avSync) &&
+            NativeUsb.setVideoLateFrameBudget(handle, lateFrameBudgetMs)
+
+    /**
+     * Keep the codec warm while there is no surface.
+     */
+    fun park() {
+        NativeUsb.parkVideoDecoder(handle)
+    }
+
+    fun stop() {
+        NativeUsb.stopVideoDecoder(handle)
+    }
+
+    /**
+     * Get current performance statistics.
+     */
+    fun getStats(): VideoStats {
+        val decoder = NativeUsb.getVideoDecoderStats(handle)
+        val stage = NativeUsb.getVideoStats(handle)
+        return VideoStats(
+            framesDecoded = decoder?.get(STAT_QUEUED) ?: 0L,
+            framesDropped = (stage?.get(STAT_STAGE_DROPPED) ?: 0L) + (decoder?.get(STAT_SKIPPED) ?: 0L),
+            queueDepth = stage?.get(STAT_STAGE_QUEUED)?.toInt() ?: 0,
+            latency = getLatency(),
+            framesLate = decoder?.get(STAT_LATE) ?: 0L
+        )
+    }
+
+    private fun getLatency(): FrameLatency? {
+        val latency = NativeUsb.getVideoLatencyStats(handle) ?: return null
+        val frames = latency[LATENCY_FRAMES]
+        if (frames == 0L) return null
+        return FrameLatency(
+            frames = frames,
+            queueUs = latency[LATENCY_QUEUE_TOTAL] / frames,
+            decodeUs = latency[LATENCY_DECODE_TOTAL] / frames,
+            presentUs = latency[LATENCY_PRESENT_TOTAL] / frames
+        )
+    }
+
+    companion object {
+        // Indices into NativeUsb.getVideoDecoderStats()
+        private const val STAT_QUEUED = 0
+        private const val STAT_SKIPPED = 2
+        private const val STAT_LATE = 5
+        // Indices into NativeUsb.getVideoStats()
+        private const val STAT_STAGE_DROPPED = 1
+        private const val STAT_STAGE_QUEUED = 4
+        // Indices into NativeUsb.getVideoLatencyStats()
+        private const val LATENCY_FRAMES = 0
+        private const val LATENCY_QUEUE_TOTAL = 1
+        private const val LATENCY_DECODE_TOTAL = 2
+        private const val LATENCY_PRESENT_TOTAL = 3
+    }
+}
@@ -0,0 +1,59 @@
+package info.anodsplace.headunit.decoder
+
+import info.anodsplace.headunit.connection.NativeUsb
+import java.nio.ByteBuffer
+
+/**
+ * Frames assembled by the native video stage.
+ *
+ * Reads the native frame slots through direct buffer views, replacing
+ * AapVideo and the VideoFrameQueue copies. Codec config records are
+ * cached natively and exposed through parameterSets() instead.
+ *
+ * @param handle Native connection handle with the video stage enabled
+ */
+class NativeVideoFrameSource(private val handle: Long) : VideoFrameSource {
+
+    private var frameBuffers: Array<ByteBuffer>? = null
+
+    // [length, first NAL type, flags], reused for every poll
+    private val info = IntArray(3)
+
+    override val droppedFrames: Long
+        get() = NativeUsb.getVideoStats(handle)?.get(STAT_DROPPED) ?: 0L
+
+    override fun poll(outBuffer: ByteArray): Int {
+        val buffers = frameBuffers ?: NativeUsb.getVideoFrameBuffers(handle)?.also { frameBuffers = it }
+            ?: return -1
+
+        while (true) {
+            val slot = NativeUsb.pollVideoFrame(handle, info)
+            if (slot < 0) {
+                return -1
+            }
+
+            try {
+                if (info[2] and NativeUsb.VIDEO_FRAME_CONFIG != 0) {
+                    continue // Already cached natively
+                }
+                val length = minOf(info[0], outBuffer.size)
+                val buffer = buffers[slot]
+                buffer.clear()
+                buffer.get(outBuffer, 0, length)
+                return length
+            } finally {
+                NativeUsb.releaseVideoFrame(handle, slot)
+            }
+        }
+    }
+
+    override fun size(): Int = NativeUsb.getVideoStats(handle)?.get(STAT_QUEUED)?.toInt() ?: 0
+
+    override fun parameterSets(): Array<ByteArray>? = NativeUsb.getVideoParameterSets(handle)
+
+    companion object {
+        // Indices into NativeUsb.getVideoStats()
+        private const val STAT_DROPPED = 1
+        private const val STAT_QUEUED = 4
+    }
+}
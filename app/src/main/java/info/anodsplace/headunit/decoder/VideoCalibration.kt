@@ -0,0 +1,114 @@
+package info.anodsplace.headunit.decoder
+
+import info.anodsplace.headunit.aap.protocol.Screen
+import info.anodsplace.headunit.aap.protocol.proto.Control
+import info.anodsplace.headunit.connection.NativeUsb
+import info.anodsplace.headunit.utils.AppLog
+import info.anodsplace.headunit.utils.Settings
+
+/**
+ * Picks the video resolution this device can sustain, per selected resolution.
+ *
+ * Each session's decode statistics are recorded when the transport quits.
+ * A session that dropped frames or kept frames waiting for the codec longer
+ * than a frame interval steps the next session one resolution down; a run of
+ * sessions with headroom to spare steps it back up, never above the one
+ * selected in settings. The step is read at service discovery, so a change
+ * takes effect on the next connection.
+ *
+ * Nothing above the largest resolution DeviceCalibration found the decoder
+ * sustains is offered.
+ *
+ * A device that is hot at service discovery is offered less on top, one
+ * resolution down when the thermal status is severe and two when critical,
+ * see NativeUsb.thermalResolutionSteps().
+ */
+class VideoCalibration(private val settings: Settings) {
+
+    /**
+     * The resolution to offer the phone for the selected one.
+     */
+    fun resolutionFor(
+        selected: Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType
+    ): Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType {
+        val step = settings.getVideoStep(selected).coerceIn(0, Screen.stepsBelow(selected))
+        val resolution = Screen.stepDown(selected, step)
+        if (step > 0) {
+            AppLog.i { "Adaptive video: $resolution, $step below $selected" }
+        }
+        return resolution
+    }
+
+    /**
+     * The resolution the next session offers, as ServiceDiscoveryResponse builds it.
+     */
+    fun offeredResolution(): Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType {
+        val resolution = cappedToDecoder(
+            if (settings.adaptiveVideo) resolutionFor(settings.resolution) else settings.resolution
+        )
+        val thermalSteps = NativeUsb.thermalResolutionSteps()
+        if (thermalSteps == 0) {
+            return resolution
+        }
+        AppLog.w { "Thermal throttling: offering $thermalSteps below $resolution" }
+        return Screen.stepDown(resolution, thermalSteps)
+    }
+
+    /**
+     * No more than DeviceCalibration found the decoder keeps up with.
+     */
+    private fun cappedToDecoder(
+        resolution: Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType
+    ): Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType {
+        val max = settings.maxVideoResolution ?: return resolution
+        val excess = Screen.stepsBelow(resolution) - Screen.stepsBelow(max)
+        if (excess <= 0) {
+            return resolution
+        }
+        AppLog.i { "Decoder probe: offering $max instead of $resolution" }
+        return Screen.stepDown(resolution, excess)
+    }
+
+    /**
+     * Record how the session that offered resolutionFor(selected) decoded.
+     */
+    fun record(
+        selected: Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType,
+        stats: VideoStats
+    ) {
+        if (stats.framesDecoded < MIN_FRAMES) {
+            return
+        }
+        val step = settings.getVideoStep(selected)
+        val good = settings.getVideoGoodSessions(selected)
+        // Only the native decoder knows how long frames wait for the codec
+        val queueUs = stats.latency?.queueUs
+
+        val overloaded = stats.dropRate > MAX_DROP_RATE || (queueUs != null && queueUs > FRAME_INTERVAL_US)
+        val comfortable = stats.dropRate < GOOD_DROP_RATE && (queueUs == null || queueUs < FRAME_INTERVAL_US / 4)
+
+        when {
+            overloaded && step < Screen.stepsBelow(selected) -> {
+                AppLog.w { "Adaptive video: drop rate ${stats.dropRate}, queue ${queueUs}us, stepping down" }
+                settings.setVideoCalibration(selected, step + 1, 0)
+            }
+            comfortable && step > 0 && good + 1 >= GOOD_SESSIONS_TO_STEP_UP -> {
+                AppLog.i { "Adaptive video: $GOOD_SESSIONS_TO_STEP_UP good sessions, stepping up" }
+                settings.setVideoCalibration(selected, step - 1, 0)
+            }
+            comfortable && step > 0 -> settings.setVideoCalibration(selected, step, good + 1)
+            else -> settings.setVideoCalibration(selected, step, 0)
+        }
+    }
+
+    companion object {
+        // Sessions shorter than this say nothing about the decoder, ~10 s at 30 fps
+        private const val MIN_FRAMES = 300L
+        // See VideoStats.dropRate
+        private const val MAX_DROP_RATE = 0.05f
+        private const val GOOD_DROP_RATE = 0.005f
+        private const val GOOD_SESSIONS_TO_STEP_UP = 3
+        // Service discovery always asks for 30 fps
+        private const val FRAME_INTERVAL_US = 1_000_000L / 30
+    }
+}
@@ -10,27 +10,37 @@ import android.view.Surface
 
 import java.nio.ByteBuffer
 
+import info.anodsplace.headunit.connection.NativeUsb
 import info.anodsplace.headunit.utils.AppLog
 
 /**
  * Dedicated thread for video decoding using MediaCodec.
  *
- * Pulls frames from VideoFrameQueue and feeds them to the hardware decoder.
+ * Pulls frames from a VideoFrameSource and feeds them to the hardware decoder.
  * Runs with THREAD_PRIORITY_DISPLAY for smooth playback.
  *
  * IMPORTANT: Codec is NOT initialized until SPS NAL unit is received.
- * This ensures proper CSD (Codec Specific Data) configuration.
+ * This ensures proper CSD (Codec Specific Data) configuration. Sources that
+ * cache parameter sets themselves let the codec start before one arrives.
+ *
+ * Output buffers more than lateFrameBudgetMs behind the newest frame fed to
+ * the codec are released without rendering, so after a hiccup the picture
+ * catches up at once instead of playing the backlog. Every frame is still
+ * fed and decoded, keyframes included, so references stay intact.
  *
  * @param queue Source of video frames
  * @param surface Target surface for decoded video
  * @param width Video width in pixels
  * @param height Video height in pixels
+ * @param lateFrameBudgetMs Largest lag behind the newest frame still rendered, 0 renders every frame
  */
 class VideoDecodeThread(
-    private val queue: VideoFrameQueue,
+    private val queue: VideoFrameSource,
     private val surface: Surface,
     private val width: Int,
-    private val height: Int
+    private val height: Int,
+    private val maxFrameSize: Int = VideoFrameQueue.MAX_FRAME_SIZE,
+    private val lateFrameBudgetMs: Int = DEFAULT_LATE_FRAME_BUDGET_MS
 ) : HandlerThread("VideoDecodeThread") {
 
     private var codec: MediaCodec? = null
@@ -39,7 +49,7 @@ class VideoDecodeThread(
     private var codecStarted = false
 
     // Reusable buffer - no allocation during decode
-    private val frameBuffer = ByteArray(VideoFrameQueue.MAX_FRAME_SIZE)
+    private val frameBuffer = ByteArray(maxFrameSize)
 
     // Buffered SPS/PPS for codec configuration
     private var bufferedSps: ByteArray? = null
@@ -52,6 +62,10 @@ class VideoDecodeThread(
     // When true, drop all frames until next keyframe to recover from decode errors
     private var waitingForKeyframe = false
 
+    // Presentation time of the last frame fed, what late output is measured against
+    private var newestQueuedUs = 0L
+    private val lateFrameBudgetUs = lateFrameBudgetMs * 1000L
+
     override fun onLooperPrepared() {
         // Set high thread priority for smooth video decoding
         Process.setThreadPriority(Process.THREAD_PRIORITY_URGENT_DISPLAY)
@@ -80,6 +94,8 @@ class VideoDecodeThread(
                 // This is CRITICAL - must drain before trying to feed input to avoid deadlock
                 if (codecStarted) {
                     drainOutput()
+                } else if (bufferedSps == null) {
+                    configureFromSource()
                 }
 
                 // 2. Check if we're falling behind and need to skip to next keyframe
@@ -204,6 +220,19 @@ class VideoDecodeThread(
         releaseCodec()
     }
 
+    /**
+     * Take SPS/PPS cached by the frame source, if it has them.
+     */
+    private fun configureFromSource() {
+        val sets = queue.parameterSets() ?: return
+        if (sets.size != 2) return
+
+        bufferedSps = sets[0]
+        bufferedPps = sets[1]
+        AppLog.i { "Using SPS (${sets[0].size} bytes) + PPS (${sets[1].size} bytes) from frame source" }
+        tryInitCodecWithCsd()
+    }
+
     /**
      * Try to initialize codec with buffered SPS/PPS as CSD buffers.
      * Called when we have both SPS and PPS buffered.
@@ -222,12 +251,20 @@ class VideoDecodeThread(
             return
         }
 
-        AppLog.i { "Initializing codec with SPS (${sps.size} bytes) + PPS (${pps.size} bytes)" }
+        // Exact picture size and input bound from the SPS, so the first
+        // frame doesn't trigger a reconfigure and buffers aren't oversized
+        val stream = NativeUsb.parseSps(sps)
+        val videoWidth = stream?.get(SPS_WIDTH) ?: width
+        val videoHeight = stream?.get(SPS_HEIGHT) ?: height
+        val maxInputSize = stream?.get(SPS_MAX_FRAME_BYTES)?.coerceAtMost(maxFrameSize) ?: maxFrameSize
+
+        AppLog.i { "Initializing codec with SPS (${sps.size} bytes) + PPS (${pps.size} bytes)" +
+            (stream?.let { ", profile ${it[SPS_PROFILE]} level ${it[SPS_LEVEL]} ${videoWidth}x$videoHeight" } ?: "") }
 
         try {
             codec = MediaCodec.createDecoderByType("video/avc")
 
-            val format = MediaFormat.createVideoFormat("video/avc", width, height)
+            val format = MediaFormat.createVideoFormat("video/avc", videoWidth, videoHeight)
 
             // Set CSD-0 (SPS) - required for decoder configuration
             // Using string literal for API 16+ compatibility (MediaFormat.KEY_CSD_0 not in all SDKs)
@@ -254,15 +291,18 @@ class VideoDecodeThread(
             }
 
             // Set max input size hint to help codec allocate appropriate buffers
-            format.setInteger(MediaFormat.KEY_MAX_INPUT_SIZE, VideoFrameQueue.MAX_FRAME_SIZE)
+            format.setInteger(MediaFormat.KEY_MAX_INPUT_SIZE, maxInputSize)
+            stream?.get(SPS_FRAME_RATE_MILLI)?.takeIf { it > 0 }?.let {
+                format.setInteger(MediaFormat.KEY_FRAME_RATE, (it + 500) / 1000)
+            }
 
             codec!!.configure(format, surface, null, 0)
             codec!!.start()
             inputBuffers = codec!!.inputBuffers
             codecStarted = true
 
-            android.util.Log.w("VideoDebug", "Codec initialized with CSD: ${width}x${height}, SDK=${Build.VERSION.SDK_INT}, inputBuffers=${inputBuffers?.size ?: 0}")
-            AppLog.i { "Codec initialized with CSD: ${width}x${height}, SDK=${Build.VERSION.SDK_INT}" }
+            android.util.Log.w("VideoDebug", "Codec initialized with CSD: ${videoWidth}x${videoHeight}, SDK=${Build.VERSION.SDK_INT}, inputBuffers=${inputBuffers?.size ?: 0}")
+            AppLog.i { "Codec initialized with CSD: ${videoWidth}x${videoHeight}, max input ${maxInputSize / 1024} KB, SDK=${Build.VERSION.SDK_INT}" }
 
         } catch (e: Exception) {
             AppLog.e { "Failed to initialize codec with CSD: ${e.message}" }
@@ -286,6 +326,11 @@ class VideoDecodeThread(
         while (true) {
             val index = codec.dequeueOutputBuffer(codecBufferInfo, 0)
             when {
+                index >= 0 && isLate(codecBufferInfo.presentationTimeUs) -> {
+                    // Showing it would only delay the frames decoded after it
+                    codec.releaseOutputBuffer(index, false)
+                    monitor.onFrameLate()
+                }
                 index >= 0 -> {
                     // Render frame immediately for lowest latency in real-time streaming
                     // Vsync alignment adds latency that hurts A/V sync
@@ -313,6 +358,9 @@ class VideoDecodeThread(
         }
     }
 
+    private fun isLate(presentationTimeUs: Long): Boolean =
+        lateFrameBudgetUs > 0 && newestQueuedUs - presentationTimeUs > lateFrameBudgetUs
+
     /**
      * Feed a frame to the codec input.
      * Returns true if frame was successfully queued, false if no buffer available.
@@ -343,13 +391,15 @@ class VideoDecodeThread(
         buffer.clear()
         buffer.put(data, 0, length)
 
+        val presentationTimeUs = System.nanoTime() / 1000
         codec.queueInputBuffer(
             inputIndex,
             0,      // offset
             length, // size
-            System.nanoTime() / 1000, // presentationTimeUs for proper frame timing
+            presentationTimeUs, // Also when it was fed, for late output
             0       // flags
         )
+        newestQueuedUs = presentationTimeUs
 
         val nalType = if (length > 4) data[4].toInt() and 0x1f else -1
         android.util.Log.d("VideoDebug", "feedInput: SUCCESS queued $length bytes (NAL type $nalType) to buffer $inputIndex")
@@ -427,10 +477,20 @@ class VideoDecodeThread(
     }
 
     companion object {
+        // Six frames at 30 fps, well above what a decoder holds in steady state
+        const val DEFAULT_LATE_FRAME_BUDGET_MS = 200
+
         // NAL unit types
         private const val NAL_TYPE_IDR = 5      // Keyframe
         private const val NAL_TYPE_SPS = 7      // Sequence Parameter Set
         private const val NAL_TYPE_PPS = 8      // Picture Parameter Set
+        // Indices into NativeUsb.parseSps()
+        private const val SPS_WIDTH = 0
+        private const val SPS_HEIGHT = 1
+        private const val SPS_PROFILE = 2
+        private const val SPS_LEVEL = 3
+        private const val SPS_MAX_FRAME_BYTES = 4
+        private const val SPS_FRAME_RATE_MILLI = 5
     }
 
     /**
@@ -8,14 +8,29 @@ import info.anodsplace.headunit.utils.AppLog
  * Manages the video decode pipeline lifecycle.
  * 
  * Coordinates VideoFrameQueue and VideoDecodeThread creation/destruction
- * in response to Surface lifecycle events.
+ * in response to Surface lifecycle events. When a native frame source is
+ * set, the decoder reads from it and no VideoFrameQueue is created. A
+ * native decoder replaces both the queue and VideoDecodeThread.
+ *
+ * @param memoryProfile Sizes the queue and decode buffer of each pipeline started
  */
-class VideoDecoderController {
+class VideoDecoderController(
+    private val memoryProfile: () -> MemoryProfile = { MemoryProfile.STANDARD }
+) {
 
     private var frameQueue: VideoFrameQueue? = null
     private var decodeThread: VideoDecodeThread? = null
+    private var nativeSource: VideoFrameSource? = null
+    private var nativeDecoder: NativeVideoDecoder? = null
+    private var nativeDecoderRunning = false
 
     @Volatile private var surfaceReady = false
+
+    /**
+     * Asks the phone for a keyframe once the frame queue had to drop
+     * frames until the next one.
+     */
+    @Volatile var onKeyframeNeeded: (() -> Unit)? = null
     
     // Store last surface info for restart capability
     private var lastHolder: SurfaceHolder? = null
@@ -37,7 +52,7 @@ class VideoDecoderController {
             lastWidth = width
             lastHeight = height
 
-            if (decodeThread != null) {
+            if (decodeThread != null || nativeDecoderRunning) {
                 AppLog.i { "Decoder already running" }
                 return
             }
@@ -58,7 +73,7 @@ class VideoDecoderController {
                 return
             }
             
-            if (decodeThread != null) {
+            if (decodeThread != null || nativeDecoderRunning) {
                 AppLog.i { "Decoder already running, no restart needed" }
                 return
             }
@@ -85,13 +100,30 @@ class VideoDecoderController {
     private fun startDecoder(holder: SurfaceHolder, width: Int, height: Int) {
         android.util.Log.w("VideoDebug", "startDecoder: ${width}x${height}, surface=${holder.surface}, valid=${holder.surface?.isValid}")
 
-        // Create components - capacity of 8 frames handles ~130ms at 60fps burst traffic
-        frameQueue = VideoFrameQueue(capacity = 30)  // ~500ms at 60fps, absorbs USB jitter
+        val native = nativeDecoder
+        if (native != null && native.start(holder.surface, width, height)) {
+            nativeDecoderRunning = true
+            surfaceReady = true
+            AppLog.i { "Native video pipeline started: ${width}x${height}" }
+            return
+        }
+
+        // A lean profile allocates queue slots as frames arrive, sized to the stream
+        val profile = memoryProfile()
+        val source = nativeSource ?: VideoFrameQueue(
+            capacity = profile.frameQueueCapacity,
+            maxFrameSize = profile.maxFrameSize,
+            preallocate = !profile.lean
+        ).also {
+            it.onKeyframeNeeded = { onKeyframeNeeded?.invoke() }
+            frameQueue = it
+        }
         decodeThread = VideoDecodeThread(
-            queue = frameQueue!!,
+            queue = source,
             surface = holder.surface,
             width = width,
-            height = height
+            height = height,
+            maxFrameSize = profile.maxFrameSize
         )
 
         // Start decode thread
@@ -123,6 +155,10 @@ class VideoDecoderController {
                 }
             }
 
+            // Parked native decoders too
+            nativeDecoder?.stop()
+            nativeDecoderRunning = false
+
             decodeThread = null
             frameQueue = null
             
@@ -132,6 +168,26 @@ class VideoDecoderController {
         }
     }
     
+    /**
+     * Called when the surface goes away while the session continues. A
+     * native decoder keeps its codec, to show the cached keyframe as soon
+     * as the next surface is there; anything else stops.
+     *
+     * @param reason Description of why stopping (for logging)
+     */
+    fun park(reason: String) {
+        synchronized(this) {
+            if (!nativeDecoderRunning) {
+                stop(reason)
+                return
+            }
+            surfaceReady = false
+            nativeDecoder?.park()
+            nativeDecoderRunning = false
+            AppLog.i { "Video pipeline parked: $reason" }
+        }
+    }
+
     /**
      * Called when surface is destroyed - clears the stored surface reference.
      */
@@ -143,6 +199,35 @@ class VideoDecoderController {
         }
     }
 
+    /**
+     * Use frames from the native video stage instead of a VideoFrameQueue.
+     * Takes effect on the next decoder start.
+     *
+     * @param source Native frame source, or null to go back to VideoFrameQueue
+     */
+    fun setNativeSource(source: VideoFrameSource?) {
+        synchronized(this) {
+            nativeSource = source
+        }
+    }
+
+    /**
+     * Decode natively with AMediaCodec, falls back to the Kotlin decoder
+     * if it fails to start. Takes effect on the next decoder start.
+     *
+     * @param decoder Native decoder, or null to use VideoDecodeThread
+     * @param width Negotiated video width, with height configures the codec
+     *              ahead of the first surface
+     */
+    fun setNativeDecoder(decoder: NativeVideoDecoder?, width: Int = 0, height: Int = 0) {
+        synchronized(this) {
+            nativeDecoder = decoder
+            if (decoder != null && width > 0 && height > 0 && decoder.prepare(width, height)) {
+                AppLog.i { "Native video decoder prepared: ${width}x$height" }
+            }
+        }
+    }
+
     /**
      * Get the frame queue for writing video data.
      * Returns null if pipeline is not running.
@@ -152,11 +237,12 @@ class VideoDecoderController {
     /**
      * Check if the decode pipeline is running.
      */
-    fun isRunning(): Boolean = surfaceReady && decodeThread != null
+    fun isRunning(): Boolean = surfaceReady && (decodeThread != null || nativeDecoderRunning)
 
     /**
      * Get current performance statistics.
      * Returns null if pipeline is not running.
      */
-    fun getStats(): VideoStats? = decodeThread?.getStats()
+    fun getStats(): VideoStats? =
+        if (nativeDecoderRunning) nativeDecoder?.getStats() else decodeThread?.getStats()
 }
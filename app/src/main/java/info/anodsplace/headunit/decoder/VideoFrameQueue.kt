@@ -4,27 +4,47 @@ package info.anodsplace.headunit.decoder
  * Thread-safe single-producer/single-consumer ring buffer for video frames.
  *
  * Pre-allocates all memory at construction time to eliminate GC pressure
- * during streaming. When queue is full, drops oldest frame to bound latency.
+ * during streaming, or with preallocate off each slot on its first frame,
+ * so a queue that never fills never holds its full capacity. When queue is full, drops queued frames up to the newest
+ * queued keyframe to bound latency, since a dropped P-frame would smear the
+ * picture until the next IDR anyway. Without a queued keyframe all queued
+ * P-frames go, new ones are dropped until an IDR arrives and
+ * onKeyframeNeeded is called once. SPS/PPS are never dropped.
  *
  * Uses lightweight synchronization to ensure memory visibility between
  * producer (USB callback thread) and consumer (decode thread).
  *
  * @param capacity Number of frame slots (default 15 for ~250ms buffer at 60fps)
  * @param maxFrameSize Maximum bytes per frame (default 512KB to handle high-resolution I-frames)
+ * @param preallocate Allocate every slot up front rather than on first use
  */
 class VideoFrameQueue(
     private val capacity: Int = 15,
-    private val maxFrameSize: Int = MAX_FRAME_SIZE
-) {
+    private val maxFrameSize: Int = MAX_FRAME_SIZE,
+    preallocate: Boolean = true
+) : VideoFrameSource {
 
     companion object {
         // Maximum frame size - 512KB to handle large I-frames at high resolutions (1080p+)
         const val MAX_FRAME_SIZE = 524288
+
+        // Frame kinds, from the NAL headers
+        private const val KIND_DELTA = 0
+        private const val KIND_KEYFRAME = 1
+        private const val KIND_CONFIG = 2
     }
 
-    // Pre-allocated frame slots - no runtime allocation
-    private val frames = Array(capacity) { ByteArray(maxFrameSize) }
+    // Frame slots - allocated once, up front or on first use, never freed while streaming
+    private val frames = Array<ByteArray?>(capacity) { if (preallocate) ByteArray(maxFrameSize) else null }
     private val sizes = IntArray(capacity)
+    private val kinds = IntArray(capacity)
+    private var awaitingKeyframe = false
+
+    /**
+     * Called on the producer thread when frames are being dropped until
+     * the next keyframe, to ask the phone for one.
+     */
+    @Volatile var onKeyframeNeeded: (() -> Unit)? = null
 
     // Indices protected by lock for proper memory ordering
     private val lock = Object()
@@ -32,38 +52,145 @@ class VideoFrameQueue(
     private var readIndex = 0
 
     // Statistics for monitoring
-    @Volatile var droppedFrames = 0L
+    @Volatile override var droppedFrames = 0L
+        private set
+
+    /**
+     * Bytes held by the frame slots allocated so far.
+     */
+    @Volatile var allocatedBytes = if (preallocate) capacity.toLong() * maxFrameSize else 0L
         private set
 
     /**
      * Queue a frame for decoding. Called by network thread.
-     * Never blocks - if queue is full, drops oldest frame.
+     * Never blocks - if queue is full, drops frames up to a keyframe.
      *
      * @param data Source byte array containing frame data
      * @param offset Start offset in source array
      * @param length Number of bytes to copy
-     * @return true if frame was queued (always returns true)
+     * @return true if frame was queued, false if dropped while waiting for a keyframe
      */
     fun offer(data: ByteArray, offset: Int, length: Int): Boolean {
-        synchronized(lock) {
-            val currentWrite = writeIndex
-            val nextWrite = (currentWrite + 1) % capacity
-
-            if (nextWrite == readIndex) {
-                // Queue full - drop oldest frame to bound latency
-                readIndex = (readIndex + 1) % capacity
+        val kind = classify(data, offset, length)
+        var requestKeyframe = false
+        val queued = synchronized(lock) {
+            if ((writeIndex + 1) % capacity == readIndex) {
+                requestKeyframe = dropUntilKeyframe()
+            }
+            if (awaitingKeyframe && kind == KIND_DELTA) {
+                // References frames that were dropped
                 droppedFrames++
+                return@synchronized false
+            }
+            if (kind == KIND_KEYFRAME) {
+                awaitingKeyframe = false
             }
 
-            // Copy into pre-allocated slot
+            // Copy into the slot, allocating it the first time round the ring
+            val currentWrite = writeIndex
             val copyLength = minOf(length, maxFrameSize)
-            System.arraycopy(data, offset, frames[currentWrite], 0, copyLength)
+            val frame = frames[currentWrite] ?: ByteArray(maxFrameSize).also {
+                frames[currentWrite] = it
+                allocatedBytes += maxFrameSize
+            }
+            System.arraycopy(data, offset, frame, 0, copyLength)
             sizes[currentWrite] = copyLength
+            kinds[currentWrite] = kind
 
             // Publish - synchronized block ensures memory barrier
-            writeIndex = nextWrite
+            writeIndex = (currentWrite + 1) % capacity
+            true
+        }
+        if (requestKeyframe) {
+            onKeyframeNeeded?.invoke()
+        }
+        return queued
+    }
+
+    /**
+     * Make room in a full queue. Called with lock held.
+     * @return true if no keyframe was queued and one should be requested
+     */
+    private fun dropUntilKeyframe(): Boolean {
+        val count = size()
+
+        // Newest queued keyframe behind the head, everything before it goes
+        var keyframe = 0
+        for (i in count - 1 downTo 1) {
+            if (kinds[(readIndex + i) % capacity] == KIND_KEYFRAME) {
+                keyframe = i
+                break
+            }
+        }
+        var kept = compact(count, if (keyframe > 0) keyframe else count)
+        if (kept == count && keyframe > 0) {
+            // Nothing but SPS/PPS ahead of the keyframe - drop it and all
+            // after it instead, keeping the parameter sets
+            keyframe = 0
+            kept = compact(count, count)
+        }
+        if (kept == count) {
+            // Nothing but SPS/PPS queued at all - drop the oldest
+            readIndex = (readIndex + 1) % capacity
+            droppedFrames++
+            kept--
+        }
+        writeIndex = (readIndex + kept) % capacity
+
+        if (keyframe == 0 && !awaitingKeyframe) {
+            awaitingKeyframe = true
+            return true
+        }
+        return false
+    }
+
+    /**
+     * Drop all but the codec config of the first dropEnd of count frames,
+     * compacting the kept frames towards the head. Called with lock held.
+     * @return the number of frames kept
+     */
+    private fun compact(count: Int, dropEnd: Int): Int {
+        // Swap slot arrays rather than copy
+        var kept = 0
+        for (i in 0 until count) {
+            val src = (readIndex + i) % capacity
+            if (i < dropEnd && kinds[src] != KIND_CONFIG) {
+                droppedFrames++
+                continue
+            }
+            val dst = (readIndex + kept) % capacity
+            if (dst != src) {
+                val frame = frames[dst]
+                frames[dst] = frames[src]
+                frames[src] = frame
+                sizes[dst] = sizes[src]
+                kinds[dst] = kinds[src]
+            }
+            kept++
+        }
+        return kept
+    }
+
+    /**
+     * Classify a frame by its NAL headers, up to the first slice.
+     */
+    private fun classify(data: ByteArray, offset: Int, length: Int): Int {
+        val end = offset + length
+        var sawNal = false
+        var pos = offset
+        while (pos + 3 < end) {
+            if (data[pos].toInt() == 0 && data[pos + 1].toInt() == 0 && data[pos + 2].toInt() == 1) {
+                when (data[pos + 3].toInt() and 0x1f) {
+                    5 -> return KIND_KEYFRAME
+                    in 1..4 -> return KIND_DELTA
+                }
+                sawNal = true
+                pos += 3
+            } else {
+                pos++
+            }
         }
-        return true
+        return if (sawNal) KIND_CONFIG else KIND_DELTA
     }
 
     /**
@@ -72,7 +199,7 @@ class VideoFrameQueue(
      * @param outBuffer Destination buffer (must be at least maxFrameSize)
      * @return Number of bytes copied, or -1 if queue is empty
      */
-    fun poll(outBuffer: ByteArray): Int {
+    override fun poll(outBuffer: ByteArray): Int {
         synchronized(lock) {
             if (readIndex == writeIndex) {
                 return -1 // Empty
@@ -80,7 +207,7 @@ class VideoFrameQueue(
 
             val currentRead = readIndex
             val length = sizes[currentRead]
-            System.arraycopy(frames[currentRead], 0, outBuffer, 0, length)
+            System.arraycopy(frames[currentRead]!!, 0, outBuffer, 0, length)
 
             // Consume - synchronized block ensures memory barrier
             readIndex = (currentRead + 1) % capacity
@@ -96,7 +223,7 @@ class VideoFrameQueue(
     /**
      * Get current number of queued frames.
      */
-    fun size(): Int = synchronized(lock) {
+    override fun size(): Int = synchronized(lock) {
         val w = writeIndex
         val r = readIndex
         if (w >= r) w - r else capacity - r + w
@@ -109,6 +236,7 @@ class VideoFrameQueue(
         synchronized(lock) {
             readIndex = 0
             writeIndex = 0
+            awaitingKeyframe = false
         }
     }
 }
@@ -0,0 +1,36 @@
+package info.anodsplace.headunit.decoder
+
+/**
+ * Frames for VideoDecodeThread, one Annex-B access unit per poll.
+ *
+ * Implemented by VideoFrameQueue for frames reassembled in Kotlin and by
+ * NativeVideoFrameSource for frames reassembled by the native video stage.
+ */
+interface VideoFrameSource {
+
+    /**
+     * Frames dropped to bound latency.
+     */
+    val droppedFrames: Long
+
+    /**
+     * Retrieve next frame for decoding. Called by decode thread.
+     *
+     * @param outBuffer Destination buffer (must be at least VideoFrameQueue.MAX_FRAME_SIZE)
+     * @return Number of bytes copied, or -1 if no frame is ready
+     */
+    fun poll(outBuffer: ByteArray): Int
+
+    /**
+     * Get current number of queued frames.
+     */
+    fun size(): Int
+
+    /**
+     * Parameter sets already seen by the source, each with a start code,
+     * so the codec can be configured without waiting for them in-band.
+     *
+     * @return [SPS, PPS], or null if the source doesn't track them
+     */
+    fun parameterSets(): Array<ByteArray>? = null
+}
@@ -8,11 +8,11 @@ import info.anodsplace.headunit.utils.AppLog
  * Tracks frames decoded, frames dropped, and queue depth.
  * Logs warnings when performance degrades.
  * 
- * @param queue The frame queue to monitor
+ * @param queue The frame source to monitor
  * @param logIntervalMs Minimum time between log messages (default 5 seconds)
  */
 class VideoPerformanceMonitor(
-    private val queue: VideoFrameQueue,
+    private val queue: VideoFrameSource,
     private val logIntervalMs: Long = 5000
 ) {
     private var lastLogTime = 0L
@@ -21,6 +21,9 @@ class VideoPerformanceMonitor(
     @Volatile var framesDecoded = 0L
         private set
 
+    @Volatile var framesLate = 0L
+        private set
+
     /**
      * Called by decode thread after each successful frame decode.
      */
@@ -29,6 +32,13 @@ class VideoPerformanceMonitor(
         maybeLogStats()
     }
 
+    /**
+     * Called by decode thread for an output buffer released without rendering, too late to show.
+     */
+    fun onFrameLate() {
+        framesLate++
+    }
+
     private fun maybeLogStats() {
         val now = System.currentTimeMillis()
         if (now - lastLogTime < logIntervalMs) return
@@ -42,7 +52,7 @@ class VideoPerformanceMonitor(
             AppLog.w {
                 "Video stats: decoded=$framesDecoded, " +
                 "dropped=$newDrops (total=$dropped), " +
-                "queue=$queueDepth/8"
+                "late=$framesLate, queue=$queueDepth/8"
             }
         }
 
@@ -56,7 +66,8 @@ class VideoPerformanceMonitor(
     fun getStats(): VideoStats = VideoStats(
         framesDecoded = framesDecoded,
         framesDropped = queue.droppedFrames,
-        queueDepth = queue.size()
+        queueDepth = queue.size(),
+        framesLate = framesLate
     )
 
     /**
@@ -64,6 +75,7 @@ class VideoPerformanceMonitor(
      */
     fun reset() {
         framesDecoded = 0
+        framesLate = 0
         lastDroppedCount = 0
         lastLogTime = 0
     }
@@ -75,7 +87,9 @@ class VideoPerformanceMonitor(
 data class VideoStats(
     val framesDecoded: Long,
     val framesDropped: Long,
-    val queueDepth: Int
+    val queueDepth: Int,
+    val latency: FrameLatency? = null,
+    val framesLate: Long = 0        // Decoded but not shown, behind the newest frame
 ) {
     /**
      * Fraction of frames dropped (0.0 to 1.0).
@@ -86,3 +100,18 @@ data class VideoStats(
             framesDropped.toFloat() / (framesDecoded + framesDropped)
         } else 0f
 }
+
+/**
+ * Average per-frame latency of the native decoder, in microseconds.
+ * Only available on the native decode path, which knows when each
+ * frame arrived over USB.
+ */
+data class FrameLatency(
+    val frames: Long,
+    val queueUs: Long,      // USB arrival until queued to the codec
+    val decodeUs: Long,     // Queued until decoded
+    val presentUs: Long     // Decoded until the vsync it was shown on
+) {
+    val totalUs: Long
+        get() = queueUs + decodeUs + presentUs
+}
@@ -32,6 +32,12 @@ class GraphicsSettingsFragment : BaseSettingsFragment(), SharedPreferences.OnSha
         // Preserve aspect ratio
         prefs.edit().putBoolean("preserve_aspect_ratio", settings.preserveAspectRatio).apply()
 
+        // Adaptive resolution
+        prefs.edit().putBoolean("adaptive_video", settings.adaptiveVideo).apply()
+
+        // Low memory
+        prefs.edit().putBoolean("memory_lean", settings.memoryLean).apply()
+
         // Margins
         prefs.edit()
             .putInt("margin_top", settings.marginTop)
@@ -68,6 +74,12 @@ class GraphicsSettingsFragment : BaseSettingsFragment(), SharedPreferences.OnSha
         // Preserve aspect ratio
         settings.preserveAspectRatio = prefs.getBoolean("preserve_aspect_ratio", true)
 
+        // Adaptive resolution
+        settings.adaptiveVideo = prefs.getBoolean("adaptive_video", false)
+
+        // Low memory
+        settings.memoryLean = prefs.getBoolean("memory_lean", false)
+
         // Margins
         settings.marginTop = prefs.getInt("margin_top", 0)
         settings.marginBottom = prefs.getInt("margin_bottom", 0)
@@ -90,6 +102,12 @@ class GraphicsSettingsFragment : BaseSettingsFragment(), SharedPreferences.OnSha
             "preserve_aspect_ratio" -> {
                 settings.preserveAspectRatio = sharedPreferences.getBoolean(key, true)
             }
+            "adaptive_video" -> {
+                settings.adaptiveVideo = sharedPreferences.getBoolean(key, false)
+            }
+            "memory_lean" -> {
+                settings.memoryLean = sharedPreferences.getBoolean(key, false)
+            }
             "margin_top" -> {
                 settings.marginTop = sharedPreferences.getInt(key, 0)
             }
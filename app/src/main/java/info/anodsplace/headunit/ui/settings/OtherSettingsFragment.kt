@@ -22,6 +22,12 @@ class OtherSettingsFragment : BaseSettingsFragment(), SharedPreferences.OnShared
         // Initialize preferences with current values from Settings
         val prefs = PreferenceManager.getDefaultSharedPreferences(requireContext())
         prefs.edit().putBoolean("driver_position", settings.driverPosition).apply()
+        prefs.edit()
+            .putBoolean("native_usb", settings.nativeUsb)
+            .putBoolean("native_socket", settings.nativeSocket)
+            .putBoolean("exportable_tls", settings.exportableTls)
+            .putStringSet("native_features", settings.nativeFeatures)
+            .apply()
     }
 
     override fun onResume() {
@@ -40,6 +46,10 @@ class OtherSettingsFragment : BaseSettingsFragment(), SharedPreferences.OnShared
 
     private fun syncAllToSettings(prefs: SharedPreferences) {
         settings.driverPosition = prefs.getBoolean("driver_position", true)
+        settings.nativeUsb = prefs.getBoolean("native_usb", false)
+        settings.nativeSocket = prefs.getBoolean("native_socket", false)
+        settings.exportableTls = prefs.getBoolean("exportable_tls", false)
+        prefs.getStringSet("native_features", null)?.let { settings.nativeFeatures = it }
     }
 
     override fun onSharedPreferenceChanged(sharedPreferences: SharedPreferences?, key: String?) {
@@ -49,6 +59,18 @@ class OtherSettingsFragment : BaseSettingsFragment(), SharedPreferences.OnShared
             "driver_position" -> {
                 settings.driverPosition = sharedPreferences.getBoolean(key, true)
             }
+            "native_usb" -> {
+                settings.nativeUsb = sharedPreferences.getBoolean(key, false)
+            }
+            "native_socket" -> {
+                settings.nativeSocket = sharedPreferences.getBoolean(key, false)
+            }
+            "exportable_tls" -> {
+                settings.exportableTls = sharedPreferences.getBoolean(key, false)
+            }
+            "native_features" -> {
+                sharedPreferences.getStringSet(key, null)?.let { settings.nativeFeatures = it }
+            }
         }
     }
 
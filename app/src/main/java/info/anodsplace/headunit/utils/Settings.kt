@@ -5,6 +5,8 @@ import android.content.Context
 import android.content.SharedPreferences
 import android.location.Location
 import info.anodsplace.headunit.aap.protocol.proto.Control
+import info.anodsplace.headunit.connection.DeviceCalibration
+import info.anodsplace.headunit.connection.NativeUsb
 
 import java.util.HashSet
 
@@ -54,6 +56,31 @@ class Settings(context: Context) { // TODO more settings
         }
         set(value) { prefs.edit().putInt("active-resolution", value.number).apply() }
 
+    // Step the resolution down when decoding can't keep up, see VideoCalibration
+    var adaptiveVideo: Boolean
+        get() = prefs.getBoolean("adaptive-video", false)
+        set(value) { prefs.edit().putBoolean("adaptive-video", value).apply() }
+
+    // Size frame and record buffers to the negotiated stream, see MemoryProfile
+    var memoryLean: Boolean
+        get() = prefs.getBoolean("memory-lean", false)
+        set(value) { prefs.edit().putBoolean("memory-lean", value).apply() }
+
+    // Calibrated steps below the selected resolution
+    fun getVideoStep(resolution: Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType): Int =
+        prefs.getInt("video-step-${resolution.number}", 0)
+
+    // Sessions in a row that decoded comfortably at that step
+    fun getVideoGoodSessions(resolution: Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType): Int =
+        prefs.getInt("video-good-${resolution.number}", 0)
+
+    fun setVideoCalibration(resolution: Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType, step: Int, goodSessions: Int) {
+        prefs.edit()
+            .putInt("video-step-${resolution.number}", step)
+            .putInt("video-good-${resolution.number}", goodSessions)
+            .apply()
+    }
+
     // Manual DPI override (0 = auto-compute based on screen stretch)
     var manualDpi: Int
         get() = prefs.getInt("manual-dpi", 0)
@@ -123,6 +150,90 @@ class Settings(context: Context) { // TODO more settings
         get() = prefs.getBoolean("driver-position", false)
         set(value) { prefs.edit().putBoolean("driver-position", value).apply() }
 
+    // USB on NativeUsbAccessoryConnection instead of UsbAccessoryConnection, which it falls back to
+    var nativeUsb: Boolean
+        get() = prefs.getBoolean("native-usb", false)
+        set(value) { prefs.edit().putBoolean("native-usb", value).apply() }
+
+    // WiFi on NativeSocketAccessoryConnection instead of SocketAccessoryConnection
+    var nativeSocket: Boolean
+        get() = prefs.getBoolean("native-socket", false)
+        set(value) { prefs.edit().putBoolean("native-socket", value).apply() }
+
+    // TLS on AapTlsClient instead of SSLEngine, so the native stages get the traffic keys
+    var exportableTls: Boolean
+        get() = prefs.getBoolean("exportable-tls", false)
+        set(value) { prefs.edit().putBoolean("exportable-tls", value).apply() }
+
+    // Native stages a native connection enables, NATIVE_* values; only native framing until verified on a device
+    var nativeFeatures: Set<String>
+        get() = prefs.getStringSet("native-features", setOf(NATIVE_FRAMING))!!
+        set(value) { prefs.edit().putStringSet("native-features", value).apply() }
+
+    fun hasNativeFeature(feature: String) = feature in nativeFeatures
+
+    // Native dispatcher queue limits per priority ("audio", "video", "control", "background"), 0 keeps the native default;
+    // "dispatch-pool-workers" above 0 runs all but audio on a worker pool. Unset, the calibrated values apply
+    val dispatchQueues: NativeUsb.DispatchQueues
+        get() = NativeUsb.DispatchQueues(
+            audio = getQueueConfig("audio"),
+            video = getQueueConfig("video"),
+            control = getQueueConfig("control"),
+            background = getQueueConfig("background"),
+            poolWorkers = prefs.getInt("dispatch-pool-workers", prefs.getInt("calibrated-pool-workers", 0))
+        )
+
+    fun getQueueConfig(priority: String) = NativeUsb.QueueConfig(
+        slots = prefs.getInt("queue-$priority-slots", prefs.getInt("calibrated-queue-$priority-slots", 0)),
+        bytes = prefs.getInt("queue-$priority-bytes", prefs.getInt("calibrated-queue-$priority-bytes", 0)),
+        policy = prefs.getInt("queue-$priority-policy", NativeUsb.QUEUE_POLICY_DEFAULT),
+        blockTimeoutUs = prefs.getInt("queue-$priority-block-us", 0)
+    )
+
+    fun setQueueConfig(priority: String, config: NativeUsb.QueueConfig) {
+        prefs.edit()
+            .putInt("queue-$priority-slots", config.slots)
+            .putInt("queue-$priority-bytes", config.bytes)
+            .putInt("queue-$priority-policy", config.policy)
+            .putInt("queue-$priority-block-us", config.blockTimeoutUs)
+            .apply()
+    }
+
+    // Build fingerprint DeviceCalibration last ran on, empty before the first run
+    val calibrationBuild: String
+        get() = prefs.getString("calibration-build", "")!!
+
+    // Bulk IN transfers kept in flight and their size, as calibrated
+    val usbTransfers: Int
+        get() = prefs.getInt("calibrated-usb-transfers", 0).takeIf { it > 0 } ?: NativeUsb.DEFAULT_NUM_TRANSFERS
+
+    val usbTransferSize: Int
+        get() = prefs.getInt("calibrated-usb-transfer-size", 0).takeIf { it > 0 } ?: NativeUsb.DEFAULT_TRANSFER_SIZE
+
+    // Parallel decrypt workers, 0 picks one per spare core
+    val decryptWorkers: Int
+        get() = prefs.getInt("calibrated-decrypt-workers", 0)
+
+    // Largest resolution the decoder keeps up with, null if unknown
+    val maxVideoResolution: Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType?
+        get() {
+            val number = prefs.getInt("calibrated-max-resolution", -1)
+            return if (number < 0) null else Control.Service.MediaSinkService.VideoConfiguration.VideoCodecResolutionType.forNumber(number)
+        }
+
+    fun setCalibration(build: String, tuning: DeviceCalibration.Tuning) {
+        prefs.edit()
+            .putString("calibration-build", build)
+            .putInt("calibrated-usb-transfers", tuning.usbTransfers)
+            .putInt("calibrated-usb-transfer-size", tuning.usbTransferSize)
+            .putInt("calibrated-decrypt-workers", tuning.decryptWorkers)
+            .putInt("calibrated-pool-workers", tuning.poolWorkers)
+            .putInt("calibrated-queue-video-slots", tuning.videoQueueSlots)
+            .putInt("calibrated-queue-video-bytes", tuning.videoQueueBytes)
+            .putInt("calibrated-max-resolution", tuning.maxResolution ?: -1)
+            .apply()
+    }
+
     @SuppressLint("ApplySharedPref")
     fun commit() {
         prefs.edit().commit()
@@ -142,6 +253,34 @@ class Settings(context: Context) { // TODO more settings
     }
 
     companion object {
+        // nativeFeatures values, the native_feature_values array
+        const val NATIVE_FRAMING = "framing"
+        const val NATIVE_SHADOW_FRAMING = "shadow-framing"
+        const val NATIVE_ZERO_COPY = "zero-copy"
+        const val NATIVE_DISPATCHER = "dispatcher"
+        const val NATIVE_PARALLEL_DECRYPT = "parallel-decrypt"
+        const val NATIVE_QUALITY_GOVERNOR = "quality-governor"
+        const val NATIVE_VIDEO = "video"
+        const val NATIVE_LOW_LATENCY_VIDEO = "low-latency-video"
+        const val NATIVE_AUDIO = "audio"
+        const val NATIVE_AUDIO_MIXER = "audio-mixer"
+        const val NATIVE_AV_SYNC = "av-sync"
+        const val NATIVE_MEDIA_ACK_BATCHING = "media-ack-batching"
+        const val NATIVE_ACK_FLOW_CONTROL = "ack-flow-control"
+        const val NATIVE_KEEPALIVE = "keepalive"
+        const val NATIVE_BATCHED_CONTROL = "batched-control"
+        const val NATIVE_CONTROL_RING = "control-ring"
+        const val NATIVE_SENSOR_BATCHING = "sensor-batching"
+        const val NATIVE_TOUCH_FAST_PATH = "touch-fast-path"
+        const val NATIVE_MIC = "mic"
+        const val NATIVE_RESUBMIT_FIRST = "resubmit-first"
+        const val NATIVE_LOCKED_BUFFERS = "locked-buffers"
+        const val NATIVE_TRACING = "tracing"
+        const val NATIVE_FAST_LOG = "fast-log"
+        const val NATIVE_PREWARM = "prewarm"
+        const val NATIVE_STALL_SNAPSHOT = "stall-snapshot"
+        const val NATIVE_STATS = "stats"
+
         val MicSampleRates = hashMapOf(
             8000 to 16000,
             16000 to 8000
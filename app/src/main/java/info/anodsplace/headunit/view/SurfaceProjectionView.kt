@@ -72,7 +72,7 @@ class SurfaceProjectionView : SurfaceView, SurfaceHolder.Callback, BaseProjectio
     override fun onDetachedFromWindow() {
         super.onDetachedFromWindow()
         decoderStarted = false
-        videoController.stop("onDetachedFromWindow")
+        videoController.park("onDetachedFromWindow")
     }
 
     override fun surfaceCreated(holder: SurfaceHolder) {
@@ -116,7 +116,7 @@ class SurfaceProjectionView : SurfaceView, SurfaceHolder.Callback, BaseProjectio
     override fun surfaceDestroyed(holder: SurfaceHolder) {
         AppLog.i { "surfaceDestroyed" }
         decoderStarted = false
-        videoController.stop("surfaceDestroyed")
+        videoController.park("surfaceDestroyed")
         videoController.onSurfaceDestroyed()
         surfaceCallback?.surfaceDestroyed(holder)
     }